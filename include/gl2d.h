@@ -96,13 +96,57 @@ void glScreen2D(void);
 /// Sets up OpenGL for 2d rendering.
 ///
 /// Call this before drawing any of GL2D's drawing or sprite functions.
+///
+/// If batching is enabled and there are quads in the batch that haven't been
+/// drawn yet (because glEnd2D() hasn't been called), they are drawn first.
 void glBegin2D(void);
 
 /// Issue this after drawing 2d so that we don't mess the matrix stack.
 ///
-/// The compliment of glBegin2D().
+/// The compliment of glBegin2D(). If batched rendering is enabled, this sends
+/// all the pending primitives to the GPU.
 void glEnd2D(void);
 
+/// Enables batched rendering of GL2D primitives.
+///
+/// In batched mode, sprites and filled boxes aren't sent to the GPU when the
+/// drawing functions are called. They are stored in a packed command list, and
+/// consecutive primitives that use the same texture are drawn inside the same
+/// GL_QUADS block. Rotation and scaling are done by the CPU, so the modelview
+/// matrix isn't modified for every sprite. The list is sent to the GPU with
+/// glCallList() when the texture changes, when the buffer is full, when
+/// glBatch2DFlush() is called, and at glEnd2D().
+///
+/// The other primitives (pixels, lines, triangles and outlined boxes) are still
+/// drawn right away, after flushing the list.
+///
+/// Functions that change the GPU state directly (like glColor() or
+/// glPolyFmt()) are applied right away, so they may affect primitives that
+/// were drawn before calling them. Call glBatch2DFlush() before them.
+///
+/// @param max_quads
+///     Approximate number of quads that can be stored before the list is sent
+///     to the GPU.
+///
+/// @return
+///     It returns true on success, false if there isn't enough memory.
+bool glBatch2DEnable(size_t max_quads);
+
+/// Sends all pending primitives to the GPU, frees the buffer used by batched
+/// mode and goes back to drawing primitives right away.
+void glBatch2DDisable(void);
+
+/// Sends all pending primitives to the GPU.
+///
+/// It doesn't do anything if batched rendering isn't enabled.
+void glBatch2DFlush(void);
+
+/// Returns true if batched rendering is enabled.
+///
+/// @return
+///     It returns true if batched rendering is enabled.
+bool glBatch2DIsEnabled(void);
+
 /// Returns the active texture. Use with care.
 ///
 /// Needed to achieve some effects since libnds 1.5.0.
@@ -122,6 +166,7 @@ static inline int glGetActiveTexture(void)
 ///     Texture to set as active.
 static inline void glSetActiveTexture(int TextureID)
 {
+    glBatch2DFlush();
     glBindTexture(0, TextureID);
     gCurrentTexture = TextureID;
 }
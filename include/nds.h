@@ -20,10 +20,14 @@
 /// - @ref nds/arm9/background.h "2D Background Layers"
 /// - @ref nds/arm9/sprite.h "2D Sprites"
 /// - @ref nds/arm9/window.h "Sprite and background windows"
+/// - @ref nds/arm9/vramUpload.h "VRAM upload queue"
+/// - @ref nds/arm9/hdma.h "Per-scanline effects with HBlank DMA"
 ///
 /// @section video_3D_api 3D engine API
 /// - @ref nds/arm9/videoGL.h "OpenGL (ish)"
+/// - @ref nds/arm9/displayList.h "Display list builder"
 /// - @ref nds/arm9/boxtest.h "Box Test"
+/// - @ref nds/arm9/culling.h "Frustum culling"
 /// - @ref nds/arm9/postest.h "Position test"
 /// - @ref gl2d.h "Simple DS 2D rendering using the 3D core"
 ///
@@ -32,6 +36,7 @@
 ///
 /// @section math_api Math
 /// - @ref nds/arm9/math.h "Hardware Assisted Math"
+/// - @ref nds/arm9/matrix.h "Fixed point vectors and matrices"
 /// - @ref nds/arm9/trig_lut.h "Fixed point trigenometry functions"
 ///
 /// @section memory_api Memory
@@ -64,6 +69,7 @@
 /// - @ref nds/arm9/input.h "Keypad and touch pad"
 /// - @ref nds/arm9/keyboard.h "Keyboard"
 /// - @ref nds/arm9/console.h "Console and Debug Printing"
+/// - @ref nds/arm9/font.h "Proportional bitmap font text renderer"
 /// - @ref nds/touch.h "Touch screen definitions"
 /// - @ref nds/input.h "Input definitions"
 ///
@@ -114,6 +120,8 @@
 /// - @ref nds/arm9/console.h "Debug via printf to DS screen or NO$GBA"
 /// - @ref nds/arm9/sassert.h "Simple assert"
 /// - @ref nds/debug.h "Send message to NO$GBA"
+/// - @ref nds/logring.h "Binary log ring buffers for the ARM7 and ARM9"
+/// - @ref nds/memtrace.h "Heap allocation tracer"
 /// - @ref nds/exceptions.h "Exception handling"
 
 #ifndef LIBNDS_NDS_H__
@@ -143,7 +151,9 @@ extern "C" {
 #include <nds/interrupts.h>
 #include <nds/ipc.h>
 #include <nds/libversion.h>
+#include <nds/logring.h>
 #include <nds/memory.h>
+#include <nds/memtrace.h>
 #include <nds/ndma.h>
 #include <nds/ndstypes.h>
 #include <nds/nwram.h>
@@ -160,13 +170,18 @@ extern "C" {
 #    include <nds/arm9/cache.h>
 #    include <nds/arm9/camera.h>
 #    include <nds/arm9/console.h>
+#    include <nds/arm9/culling.h>
+#    include <nds/arm9/displayList.h>
 #    include <nds/arm9/dynamicArray.h>
+#    include <nds/arm9/font.h>
 #    include <nds/arm9/guitarGrip.h>
+#    include <nds/arm9/hdma.h>
 #    include <nds/arm9/image.h>
 #    include <nds/arm9/input.h>
 #    include <nds/arm9/keyboard.h>
 #    include <nds/arm9/linkedlist.h>
 #    include <nds/arm9/math.h>
+#    include <nds/arm9/matrix.h>
 #    include <nds/arm9/ndsmotion.h>
 #    include <nds/arm9/paddle.h>
 #    include <nds/arm9/grf.h>
@@ -180,6 +195,7 @@ extern "C" {
 #    include <nds/arm9/trig_lut.h>
 #    include <nds/arm9/video.h>
 #    include <nds/arm9/videoGL.h>
+#    include <nds/arm9/vramUpload.h>
 #    include <nds/arm9/window.h>
 #    include <nds/arm9/peripherals/slot2.h>
 #    include <nds/arm9/peripherals/slot2gyro.h>
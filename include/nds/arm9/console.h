@@ -239,6 +239,20 @@ typedef struct PrintConsole
     /// It should return true if it has handled rendering the graphics. If not,
     /// the print engine will attempt to render via tiles).
     ConsolePrint PrintChar;
+
+    /// Scrollback buffer in RAM, or NULL if it isn't used. Initialized by
+    /// consoleSetScrollback().
+    u16 *scrollback;
+    /// Number of lines of the scrollback buffer.
+    u16 scrollbackLines;
+    /// Internal. Line of the scrollback buffer at the top of the window.
+    u16 scrollbackTop;
+    /// Internal. Number of lines that have scrolled out of the window.
+    u16 scrollbackHistory;
+    /// Internal. Number of lines the view is scrolled back.
+    u16 scrollbackOffset;
+    /// Internal. True if the window needs to be rendered again.
+    bool scrollbackDirty;
 } PrintConsole;
 
 /// Console debug devices supported by libnds.
@@ -468,6 +482,74 @@ void consoleSetCustomStdout(ConsoleOutFn fn);
 ///     Callback where stderr is sent.
 void consoleSetCustomStderr(ConsoleOutFn fn);
 
+/// Sets a function that receives a copy of all text sent to the console.
+///
+/// The text is passed before escape sequences are processed, so it's possible
+/// to save the console output to a file, for example:
+///
+/// ```
+/// static FILE *log_file;
+///
+/// static ssize_t log_write(const char *ptr, size_t len)
+/// {
+///     return fwrite(ptr, 1, len, log_file);
+/// }
+///
+/// consoleSetMirror(log_write);
+/// ```
+///
+/// @param fn
+///     Callback that receives the text, or NULL to disable it.
+void consoleSetMirror(ConsoleOutFn fn);
+
+/// Enables a scrollback buffer for a console.
+///
+/// When it's enabled, the text isn't written to the background map. It is
+/// written to a ring buffer of lines in RAM instead, which keeps the lines that
+/// scroll out of the window. The window is copied to the map by
+/// consoleRender(), which only does it if anything has changed. All text
+/// printed between two calls is rendered at once.
+///
+/// consoleInit() and consoleInitEx() free the buffer, so call this function
+/// again after them to keep using it. consoleSetWindow() clears the buffer.
+///
+/// @param console
+///     Console to modify. If NULL, the current console is used.
+/// @param lines
+///     Number of lines to keep, including the ones in the window. If it's
+///     smaller than the height of the window, the height is used. If it's 0,
+///     the buffer is freed and the console writes to the map directly again.
+///
+/// @return
+///     It returns 0 on success, -1 if there isn't enough memory.
+int consoleSetScrollback(PrintConsole *console, int lines);
+
+/// Scrolls the view of a console with a scrollback buffer.
+///
+/// While the view is scrolled back it keeps showing the same lines when new
+/// text is printed. It only moves when the buffer is full and its top line is
+/// replaced by a new one. Call this function with a large negative value to
+/// return to the most recent lines.
+///
+/// @param console
+///     Console to modify. If NULL, the current console is used.
+/// @param delta
+///     Number of lines to scroll. Positive values show older lines.
+///
+/// @return
+///     Number of lines the view is scrolled back (0 shows the most recent
+///     lines).
+int consoleScroll(PrintConsole *console, int delta);
+
+/// Copies the window of a console with a scrollback buffer to the map.
+///
+/// Call it once per frame, during the vertical blanking period. It doesn't do
+/// anything if nothing has changed since the last call.
+///
+/// @param console
+///     Console to render. If NULL, the current console is used.
+void consoleRender(PrintConsole *console);
+
 /// Initialize the ARM7 console and direct the output to the specified console.
 ///
 /// This function allocates a ring buffer in main RAM and shares the pointer
@@ -0,0 +1,181 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#ifndef LIBNDS_NDS_ARM9_CULLING_H__
+#define LIBNDS_NDS_ARM9_CULLING_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @file nds/arm9/culling.h
+///
+/// @brief Frustum culling of lists of bounding boxes.
+///
+/// These functions check which boxes of a list are inside the view frustum, so
+/// that only the visible objects of a scene are sent to the GPU. The results
+/// are returned as a bitset: bit (i % 32) of word (i / 32) is set if box i is
+/// visible.
+///
+/// There are two ways to test boxes:
+///
+/// - With the box test of the GPU. This is exact, and it uses the current
+///   position and projection matrices. The test of each box runs while the CPU
+///   prepares the next one. Note that this sets the polygon format, so you need
+///   to call glPolyFmt() afterwards.
+///
+/// - With the CPU, against the planes of a CullFrustum created from a clip
+///   matrix (for example, the one returned by glGetFixed(GL_GET_MATRIX_CLIP)).
+///   This doesn't use the GPU at all, and it can be faster than the box test.
+///   It is conservative: some boxes close to the corners of the frustum may be
+///   reported as visible when they aren't.
+///
+/// Scenes can also be organized as a bounding volume hierarchy (an array of
+/// CullBVHNode) so that whole groups of objects can be discarded with a single
+/// test.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <nds/arm9/videoGL.h>
+#include <nds/ndstypes.h>
+
+/// Axis-aligned bounding box. The arguments are the same ones used by
+/// BoxTest().
+typedef struct
+{
+    v16 x, y, z;                ///< Corner of the box
+    v16 width, height, depth;   ///< Size of the box
+} CullBox;
+
+/// Planes of a view frustum used for culling with the CPU.
+typedef struct
+{
+    int32_t planes[6][4];   ///< Plane equations (a, b, c, d) in 20.12 format
+} CullFrustum;
+
+/// Node of a bounding volume hierarchy.
+///
+/// Nodes are stored in depth-first order: the children of a node are stored
+/// right after it. If a node isn't visible, the traversal skips to the node at
+/// index "skip", which is the first node after all its children.
+typedef struct
+{
+    CullBox box;        ///< Box that contains all the objects of this node
+    uint16_t skip;      ///< Index of the next node that isn't a child
+    uint16_t first;     ///< First object of this node (leaf nodes)
+    uint16_t count;     ///< Number of objects (0 for nodes with children)
+} CullBVHNode;
+
+/// Returns the number of 32-bit words needed for a bitset of visible boxes.
+///
+/// @param count
+///     Number of boxes.
+///
+/// @return
+///     Size of the bitset in words.
+static inline size_t cullBitsetWords(size_t count)
+{
+    return (count + 31) / 32;
+}
+
+/// Checks if a box is visible in a bitset returned by the culling functions.
+///
+/// @param visible
+///     Bitset.
+/// @param index
+///     Index of the box.
+///
+/// @return
+///     Non zero if the box is visible.
+static inline uint32_t cullIsVisible(const uint32_t *visible, size_t index)
+{
+    return visible[index / 32] & BIT(index % 32);
+}
+
+/// Calculates the planes of a view frustum from a clip matrix.
+///
+/// @param frustum
+///     Frustum to fill.
+/// @param clip
+///     4x4 clip matrix in 20.12 format, as returned by
+///     glGetFixed(GL_GET_MATRIX_CLIP).
+void cullFrustumFromClip(CullFrustum *frustum, const int *clip);
+
+/// Calculates the planes of a view frustum from the current clip matrix.
+///
+/// It waits until the geometry engine isn't busy to read the matrix.
+///
+/// @param frustum
+///     Frustum to fill.
+void cullFrustumFromGPU(CullFrustum *frustum);
+
+/// Checks if a box is inside a view frustum using the CPU.
+///
+/// @param frustum
+///     View frustum.
+/// @param box
+///     Box to test.
+///
+/// @return
+///     Non zero if any part of the box may be inside the frustum.
+int cullBoxFrustum(const CullFrustum *frustum, const CullBox *box);
+
+/// Checks which boxes of a list are inside a view frustum using the CPU.
+///
+/// @param frustum
+///     View frustum.
+/// @param boxes
+///     List of boxes.
+/// @param count
+///     Number of boxes.
+/// @param visible
+///     Bitset of cullBitsetWords(count) words to store the results.
+///
+/// @return
+///     Number of visible boxes.
+size_t cullBoxesFrustum(const CullFrustum *frustum, const CullBox *boxes,
+                        size_t count, uint32_t *visible);
+
+/// Checks which boxes of a list are inside the view frustum using the GPU.
+///
+/// @param boxes
+///     List of boxes.
+/// @param count
+///     Number of boxes.
+/// @param visible
+///     Bitset of cullBitsetWords(count) words to store the results.
+///
+/// @return
+///     Number of visible boxes.
+size_t cullBoxesBoxTest(const CullBox *boxes, size_t count, uint32_t *visible);
+
+/// Checks which objects of a bounding volume hierarchy are visible.
+///
+/// All the objects of a visible leaf node are marked as visible. Objects of a
+/// leaf node with an index equal to or greater than num_objects are ignored, so
+/// a malformed hierarchy can't write outside of the bitset.
+///
+/// @param nodes
+///     Nodes of the hierarchy.
+/// @param num_nodes
+///     Number of nodes.
+/// @param num_objects
+///     Number of objects referenced by the nodes.
+/// @param frustum
+///     View frustum to test the nodes with the CPU, or NULL to use the box test
+///     of the GPU.
+/// @param visible
+///     Bitset of cullBitsetWords(num_objects) words to store the results.
+///
+/// @return
+///     Number of visible objects.
+size_t cullBVH(const CullBVHNode *nodes, size_t num_nodes, size_t num_objects,
+               const CullFrustum *frustum, uint32_t *visible);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBNDS_NDS_ARM9_CULLING_H__
@@ -0,0 +1,326 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#ifndef LIBNDS_NDS_ARM9_DISPLAYLIST_H__
+#define LIBNDS_NDS_ARM9_DISPLAYLIST_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @file nds/arm9/displayList.h
+///
+/// @brief Builder of display lists for the 3D geometry engine.
+///
+/// A display list is a buffer of packed geometry engine commands that can be
+/// sent to the GPU with glCallList(). This is much faster than sending the same
+/// commands with the regular videoGL functions, because glCallList() sends them
+/// with DMA.
+///
+/// The functions of this file mirror the inline functions of videoGL.h, but
+/// they add the commands to a display list instead of sending them to the GPU:
+///
+/// ```
+/// // The buffer can't be a local variable: the stack is in DTCM by default,
+/// // and DMA can't read DTCM.
+/// static uint32_t buffer[256];
+/// GLDisplayList list;
+///
+/// glListInit(&list, buffer, sizeof(buffer));
+/// glListBindTexture(&list, textureID);
+/// glListBegin(&list, GL_QUADS);
+///     glListTexCoord2t16(&list, inttot16(0), inttot16(0));
+///     glListVertex3v16(&list, inttov16(-1), inttov16(-1), 0);
+///     ...
+/// glListEnd(&list);
+///
+/// if (glListFinish(&list) > 0)
+///     glCallList(buffer); // It flushes the list from the data cache
+/// ```
+///
+/// The builder packs four commands in each command word, and it optimizes the
+/// list while it's being built:
+///
+/// - Vertices are sent with the shortest command that can represent them
+///   exactly (VTX_XY, VTX_XZ, VTX_YZ, VTX_DIFF or VTX_10, or VTX_16 if none of
+///   them can be used).
+/// - Commands that set the color, texture coordinates, normal, polygon format
+///   or texture format to the value they already have are removed.
+///
+/// The optimizations only use information from commands of the same list, so
+/// the result is the same regardless of the state of the GPU when the list is
+/// called.
+///
+/// The buffer must be in main RAM (not in DTCM or the stack), and it must be
+/// aligned to 4 bytes. glCallList() flushes the list from the data cache
+/// before sending it with DMA. If the list is sent to the GPU in any other way
+/// with DMA, call DC_FlushRange() first.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <nds/arm9/videoGL.h>
+#include <nds/ndstypes.h>
+
+/// State of a display list that is being built.
+///
+/// All fields are private, use the glList*() functions to modify it.
+typedef struct
+{
+    uint32_t *buffer;   ///< Start of the buffer (the size of the list)
+    uint32_t *ptr;      ///< Write pointer
+    uint32_t *end;      ///< End of the buffer
+    uint32_t *cmd;      ///< Packed command word being filled
+    unsigned int cmd_count; ///< Number of commands in the packed command word
+    bool overflow;      ///< The buffer is too small for the list
+
+    uint32_t valid;     ///< Flags of state cached in the fields below
+    v16 x, y, z;        ///< Last vertex
+    rgb color;          ///< Last vertex color
+    uint32_t texcoord;  ///< Last texture coordinates
+    uint32_t normal;    ///< Last normal
+    uint32_t poly_fmt;  ///< Last polygon format
+    uint32_t tex_fmt;   ///< Last texture format
+    uint32_t pal_fmt;   ///< Last palette format
+} GLDisplayList;
+
+/// Starts building a display list.
+///
+/// @param list
+///     Display list state.
+/// @param buffer
+///     Buffer to store the list. It must be in main RAM (not in DTCM or the
+///     stack) and aligned to 4 bytes.
+/// @param size
+///     Size of the buffer in bytes.
+void glListInit(GLDisplayList *list, void *buffer, size_t size);
+
+/// Finishes a display list so that it can be used with glCallList().
+///
+/// It's possible to keep adding commands to the list after calling this
+/// function. If so, call it again before calling glCallList().
+///
+/// @param list
+///     Display list state.
+///
+/// @return
+///     Size of the list in words (without counting the size field), or -1 if
+///     the buffer was too small to hold all the commands. If the size is 0 the
+///     list must not be passed to glCallList().
+int glListFinish(GLDisplayList *list);
+
+/// Adds a raw command to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param id
+///     Command ID (FIFO_COLOR, FIFO_BEGIN, etc).
+/// @param params
+///     Parameters of the command.
+/// @param num_params
+///     Number of parameters of the command.
+void glListCommand(GLDisplayList *list, uint8_t id, const uint32_t *params,
+                   size_t num_params);
+
+/// Adds a glBegin() command to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param mode
+///     The draw mode for the polygon.
+void glListBegin(GLDisplayList *list, GL_GLBEGIN_ENUM mode);
+
+/// Adds a glEnd() command to a display list.
+///
+/// @param list
+///     Display list state.
+void glListEnd(GLDisplayList *list);
+
+/// Adds a glColor() command to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param color
+///     The color.
+void glListColor(GLDisplayList *list, rgb color);
+
+/// Adds a glVertex3v16() command to a display list.
+///
+/// The command used to send the vertex to the GPU is selected depending on the
+/// previous vertex and the values of the coordinates.
+///
+/// @param list
+///     Display list state.
+/// @param x
+///     The x component for the vertex.
+/// @param y
+///     The y component for the vertex.
+/// @param z
+///     The z component for the vertex.
+void glListVertex3v16(GLDisplayList *list, v16 x, v16 y, v16 z);
+
+/// Adds a glTexCoord2t16() command to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param u
+///     U (a.k.a. S) texture coordinate in texels (12.4 format).
+/// @param v
+///     V (a.k.a. T) texture coordinate in texels (12.4 format).
+void glListTexCoord2t16(GLDisplayList *list, t16 u, t16 v);
+
+/// Adds a glNormal() command to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param normal
+///     The packed normal (three 10 bit values: x, y, z).
+void glListNormal(GLDisplayList *list, u32 normal);
+
+/// Adds a glPolyFmt() command to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param params
+///     The paramters to set for the following polygons.
+void glListPolyFmt(GLDisplayList *list, u32 params);
+
+/// Adds a command to set the texture format to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param format
+///     Value to write to GFX_TEX_FORMAT.
+void glListTexFormat(GLDisplayList *list, u32 format);
+
+/// Adds a command to set the texture palette address to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param format
+///     Value to write to GFX_PAL_FORMAT.
+void glListPalFormat(GLDisplayList *list, u32 format);
+
+/// Adds the commands needed to bind a texture to a display list.
+///
+/// The list stores the current VRAM address of the texture and its palette. If
+/// the texture or palette is moved or deleted, the list has to be built again.
+///
+/// Unlike glBindTexture(), this doesn't change the active texture of videoGL.
+///
+/// @param list
+///     Display list state.
+/// @param name
+///     The name of the texture (or 0 to disable textures).
+///
+/// @return
+///     1 on success, 0 if the texture doesn't exist (textures are disabled).
+int glListBindTexture(GLDisplayList *list, int name);
+
+/// Adds a glMatrixMode() command to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param mode
+///     New mode for the matrix.
+void glListMatrixMode(GLDisplayList *list, GL_MATRIX_MODE_ENUM mode);
+
+/// Adds a glLoadIdentity() command to a display list.
+///
+/// @param list
+///     Display list state.
+void glListLoadIdentity(GLDisplayList *list);
+
+/// Adds a glPushMatrix() command to a display list.
+///
+/// @param list
+///     Display list state.
+void glListPushMatrix(GLDisplayList *list);
+
+/// Adds a glPopMatrix() command to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param num
+///     The number to pop down the stack.
+void glListPopMatrix(GLDisplayList *list, int num);
+
+/// Adds a glStoreMatrix() command to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param index
+///     The location in the stack to put the matrix.
+void glListStoreMatrix(GLDisplayList *list, int index);
+
+/// Adds a glRestoreMatrix() command to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param index
+///     The location in the stack to load the matrix from.
+void glListRestoreMatrix(GLDisplayList *list, int index);
+
+/// Adds a glTranslatef32() command to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param x
+///     Translation on the x axis.
+/// @param y
+///     Translation on the y axis.
+/// @param z
+///     Translation on the z axis.
+void glListTranslatef32(GLDisplayList *list, int x, int y, int z);
+
+/// Adds a glScalef32() command to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param x
+///     Scaling factor on the x axis.
+/// @param y
+///     Scaling factor on the y axis.
+/// @param z
+///     Scaling factor on the z axis.
+void glListScalef32(GLDisplayList *list, int x, int y, int z);
+
+/// Adds a glLoadMatrix4x3() command to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param m
+///     Pointer to a 4x3 matrix.
+void glListLoadMatrix4x3(GLDisplayList *list, const m4x3 *m);
+
+/// Adds a glMultMatrix4x3() command to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param m
+///     Pointer to a 4x3 matrix.
+void glListMultMatrix4x3(GLDisplayList *list, const m4x3 *m);
+
+/// Adds a glMultMatrix3x3() command to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param m
+///     Pointer to a 3x3 matrix.
+void glListMultMatrix3x3(GLDisplayList *list, const m3x3 *m);
+
+/// Adds a glRotateZi() command to a display list.
+///
+/// @param list
+///     Display list state.
+/// @param angle
+///     The angle to rotate by (angle is -32768 to 32767).
+void glListRotateZi(GLDisplayList *list, int angle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBNDS_NDS_ARM9_DISPLAYLIST_H__
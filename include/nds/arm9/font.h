@@ -0,0 +1,320 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#ifndef LIBNDS_NDS_ARM9_FONT_H__
+#define LIBNDS_NDS_ARM9_FONT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @file nds/arm9/font.h
+///
+/// @brief Proportional bitmap font text renderer.
+///
+/// This module draws UTF-8 text with proportional fonts of any size into 4bpp
+/// or 8bpp tiles (for backgrounds and sprites) or into 16-bit bitmaps. The
+/// destination can be in VRAM: only 16-bit and 32-bit writes are used.
+///
+/// Glyphs are decoded from the font the first time they are used and kept in
+/// a cache as rows of 8 pixels of 4 bits each (one word per row and column of
+/// 8 pixels). Glyphs are drawn from the cache one word at a time.
+///
+/// The font format is a single binary blob, loaded from NitroFS or included in
+/// the binary. Fonts can be converted from BDF files with the fontgen tool in
+/// the "tools" folder of libnds. All values are little endian, and all offsets
+/// are in bytes from the start of the blob:
+///
+/// - FontHeader.
+/// - FontGlyph array, sorted by codepoint.
+/// - FontKerning array, sorted by left glyph and then by right glyph.
+/// - Glyph bitmaps. Each row of a glyph starts at a byte boundary, and pixels
+///   are stored starting from the least significant bits of each byte (the
+///   same order as NDS tiles). Pixels of 1 or 2 bits are scaled to 0-15.
+///
+/// Pixel value 0 is transparent. Values 1 to 15 are palette indices (4bpp
+/// tiles), offsets to a base palette index (8bpp tiles) or indices in a table
+/// of 16 colors (16-bit bitmaps).
+///
+/// FontTextBox draws text with word wrapping, and it only redraws the part of
+/// the text that changes between calls. For example, a dialogue box that adds
+/// one character per frame only redraws the line with that character.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <nds/ndstypes.h>
+
+/// Magic number of the font format ("FONT").
+#define FONT_MAGIC      0x544E4F46
+/// Version of the font format supported by this library.
+#define FONT_VERSION    1
+
+/// Header of a font.
+typedef struct
+{
+    uint32_t magic;             ///< FONT_MAGIC
+    uint8_t version;            ///< FONT_VERSION
+    uint8_t bpp;                ///< Bits per pixel of the bitmaps (1, 2 or 4)
+    uint8_t line_height;        ///< Distance between lines in pixels
+    uint8_t ascent;             ///< Distance from the top of a line to the baseline
+    uint16_t num_glyphs;        ///< Number of glyphs
+    uint16_t num_kerning;       ///< Number of kerning pairs
+    uint32_t glyphs_offset;     ///< Offset to the FontGlyph array
+    uint32_t kerning_offset;    ///< Offset to the FontKerning array
+    uint32_t bitmaps_offset;    ///< Offset to the glyph bitmaps
+} FontHeader;
+
+/// Information of a glyph of a font.
+typedef struct
+{
+    uint32_t codepoint;         ///< Unicode codepoint
+    uint32_t bitmap;            ///< Offset of the bitmap from bitmaps_offset
+    uint8_t width;              ///< Width of the bitmap
+    uint8_t height;             ///< Height of the bitmap
+    int8_t x_offset;            ///< From the pen position to the bitmap
+    int8_t y_offset;            ///< From the baseline to the top of the bitmap
+    uint8_t advance;            ///< Horizontal distance to the next glyph
+    uint8_t reserved[3];        ///< Must be 0
+} FontGlyph;
+
+/// Kerning adjustment between two glyphs.
+typedef struct
+{
+    uint16_t left;              ///< Index of the first glyph
+    uint16_t right;             ///< Index of the second glyph
+    int16_t amount;             ///< Adjustment of the advance in pixels
+    uint16_t reserved;          ///< Must be 0
+} FontKerning;
+
+/// Cached glyph. Used internally.
+typedef struct
+{
+    uint32_t codepoint;         ///< Codepoint of the glyph, or UINT32_MAX if empty
+    int16_t index;              ///< Index in the font, or -1 if the font doesn't have it
+    int16_t y_offset;           ///< From the top of the line to the bitmap
+    uint8_t width;              ///< Width of the bitmap
+    uint8_t height;             ///< Height of the bitmap
+    int8_t x_offset;            ///< From the pen position to the bitmap
+    uint8_t advance;            ///< Horizontal distance to the next glyph
+    uint8_t words;              ///< Words per row of the bitmap
+    uint32_t *rows;             ///< Rows of the bitmap
+} FontCacheEntry;
+
+/// Font loaded with fontInit().
+typedef struct
+{
+    const FontHeader *header;   ///< Header of the font data
+    const FontGlyph *glyphs;    ///< Glyphs of the font data
+    const FontKerning *kerning; ///< Kerning pairs of the font data
+    const uint8_t *bitmaps;     ///< Bitmaps of the font data
+
+    FontCacheEntry *cache;      ///< Glyph cache
+    uint32_t *cache_data;       ///< Bitmaps of the glyph cache
+    uint16_t cache_mask;        ///< Number of entries of the cache - 1
+    uint16_t cache_words;       ///< Words of cache data per entry
+    uint32_t fallback;          ///< Codepoint used for missing characters
+} Font;
+
+/// Pixel formats of the destinations of the text.
+typedef enum
+{
+    FONT_SURFACE_4BPP_TILES,    ///< 16 color 8x8 tiles
+    FONT_SURFACE_8BPP_TILES,    ///< 256 color 8x8 tiles
+    FONT_SURFACE_16BPP_BITMAP,  ///< 16-bit bitmap
+} FontSurfaceFormat;
+
+/// Destination of the text.
+///
+/// Tiles are arranged in rows: the tile at tile coordinates (tx, ty) is tile
+/// number (ty * stride + tx). This is the layout of sprites in 1D mapping mode
+/// and of tiled backgrounds set up with fontMapLinear().
+typedef struct
+{
+    void *gfx;                  ///< Tiles or bitmap
+    FontSurfaceFormat format;   ///< Pixel format
+    uint16_t width;             ///< Width in pixels
+    uint16_t height;            ///< Height in pixels
+    uint16_t stride;            ///< Tiles per row of tiles, or pixels per row of the bitmap
+    uint8_t color_base;         ///< 8bpp tiles: Added to pixel values (up to 240)
+    const uint16_t *colors;     ///< 16-bit bitmaps: Table of 16 colors
+} FontSurface;
+
+/// Text box that only redraws the text that changes.
+typedef struct
+{
+    Font *font;                 ///< Font of the text
+    FontSurface surface;        ///< Destination
+    int16_t x;                  ///< Left of the box in the surface
+    int16_t y;                  ///< Top of the box in the surface
+    int16_t width;              ///< Width of the box
+    int16_t height;             ///< Height of the box
+    uint16_t lines;             ///< Lines used by the text that is drawn
+    char *text;                 ///< Copy of the text that is drawn
+    size_t capacity;            ///< Size of the text buffer
+} FontTextBox;
+
+/// Loads a font and allocates its glyph cache.
+///
+/// The font data isn't copied, it must remain valid while the font is in use.
+///
+/// @param font
+///     Font to initialize.
+/// @param data
+///     Font data, aligned to 4 bytes.
+/// @param cache_entries
+///     Number of glyphs that can be cached. It's rounded up to a power of two.
+///
+/// @return
+///     It returns true on success, false if the data isn't a valid font or if
+///     there isn't enough memory.
+bool fontInit(Font *font, const void *data, size_t cache_entries);
+
+/// Frees the glyph cache of a font.
+///
+/// @param font
+///     Font to free.
+void fontFree(Font *font);
+
+/// Sets the character drawn instead of characters that aren't in the font.
+///
+/// By default it's '?'. If the fallback isn't in the font either, missing
+/// characters aren't drawn and they don't advance the pen.
+///
+/// @param font
+///     Font.
+/// @param codepoint
+///     Codepoint of the fallback character.
+void fontSetFallback(Font *font, uint32_t codepoint);
+
+/// Returns the width of a line of text.
+///
+/// The text ends at the first NUL or newline character.
+///
+/// @param font
+///     Font.
+/// @param text
+///     UTF-8 text.
+///
+/// @return
+///     Width in pixels, or -1 if the text isn't valid UTF-8.
+int fontTextWidth(Font *font, const char *text);
+
+/// Draws a line of text.
+///
+/// The text ends at the first NUL or newline character. Pixels outside of the
+/// surface aren't drawn.
+///
+/// @param font
+///     Font.
+/// @param surface
+///     Destination.
+/// @param x
+///     Pen position of the first character.
+/// @param y
+///     Top of the line.
+/// @param text
+///     UTF-8 text.
+///
+/// @return
+///     Pen position after the last character, or -1 if the text isn't valid
+///     UTF-8.
+int fontDrawText(Font *font, const FontSurface *surface, int x, int y,
+                 const char *text);
+
+/// Fills a rectangle of a surface with pixel value 0.
+///
+/// @param surface
+///     Destination.
+/// @param x
+///     Left of the rectangle.
+/// @param y
+///     Top of the rectangle.
+/// @param width
+///     Width of the rectangle.
+/// @param height
+///     Height of the rectangle.
+void fontClearRect(const FontSurface *surface, int x, int y, int width,
+                   int height);
+
+/// Fills part of a tile map so that the tiles are arranged in rows.
+///
+/// @param map
+///     Map of the background (for example, from bgGetMapPtr()).
+/// @param map_width
+///     Width of the map in tiles (32 or 64).
+/// @param x
+///     Left of the area in tiles.
+/// @param y
+///     Top of the area in tiles.
+/// @param width
+///     Width of the area in tiles. This is the stride of the surface.
+/// @param height
+///     Height of the area in tiles.
+/// @param first_tile
+///     Index of the first tile.
+/// @param palette
+///     Palette of the tiles (0 to 15, only used by 4bpp backgrounds).
+void fontMapLinear(u16 *map, int map_width, int x, int y, int width,
+                   int height, int first_tile, int palette);
+
+/// Initializes a text box.
+///
+/// @param box
+///     Text box to initialize.
+/// @param font
+///     Font of the text.
+/// @param surface
+///     Destination of the text. It's copied.
+/// @param x
+///     Left of the box.
+/// @param y
+///     Top of the box.
+/// @param width
+///     Width of the box.
+/// @param height
+///     Height of the box.
+void fontTextBoxInit(FontTextBox *box, Font *font, const FontSurface *surface,
+                     int x, int y, int width, int height);
+
+/// Frees the text buffer of a text box.
+///
+/// It doesn't clear the text from the surface.
+///
+/// @param box
+///     Text box.
+void fontTextBoxFree(FontTextBox *box);
+
+/// Sets the text of a text box and draws the parts that have changed.
+///
+/// The text is wrapped at spaces, and at any character if a word doesn't fit
+/// in a line. Newline characters start a new line. Lines that don't fit in the
+/// box aren't drawn.
+///
+/// The line with the first word that has changed is redrawn, as well as all
+/// the lines after it. Glyphs are clipped to the box, and they must fit in the
+/// height of their line.
+///
+/// @param box
+///     Text box.
+/// @param text
+///     UTF-8 text.
+///
+/// @return
+///     It returns true on success, false if the text isn't valid UTF-8 or if
+///     there isn't enough memory to store a copy of it.
+bool fontTextBoxSet(FontTextBox *box, const char *text);
+
+/// Clears a text box.
+///
+/// @param box
+///     Text box.
+void fontTextBoxClear(FontTextBox *box);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBNDS_NDS_ARM9_FONT_H__
@@ -21,7 +21,8 @@ extern "C" {
 /// file. Compressed blobs may use different compression algorithms. Check the
 /// documentation of decompress() for more information about the supported
 /// formats. Note that all compression formats supported by grit are also
-/// supported by decompress().
+/// supported by decompress(). GRF files may also contain chunks compressed
+/// with LZ16, which is faster to decompress than the BIOS formats.
 ///
 /// Check https://www.coranac.com/man/grit/html/grit.htm for more information.
 
@@ -73,6 +74,7 @@ typedef enum
     GRF_INCONSISTENT_SIZES      = -7, ///< Sizes of "RIFF" and "GRF " don't match
     GRF_NOT_ENOUGH_MEMORY       = -8, ///< Not enough memory for malloc()
     GRF_UNKNOWN_COMPRESSION     = -9, ///< Unknown graphics compression format
+    GRF_INVALID_DATA            = -10, ///< Compressed data is corrupted
 } GRFError;
 
 /// From a GRF file in RAM, extract all data and allocate memory for it.
@@ -82,9 +84,10 @@ typedef enum
 /// function needs to allocate memory for them. Values that aren't needed can be
 /// ignored by passing NULL to the specific argument of the function.
 ///
-/// Note that Huffman decompression isn't VRAM-safe. RLE and LZ77 are VRAM-safe.
-/// If using Huffman compression with your GRF files, don't hardcode the
-/// destination address to VRAM.
+/// All compression formats are decompressed in a VRAM-safe way, so it's
+/// possible to hardcode the destination address to VRAM. However, if you want
+/// to load data straight to VRAM, grfLoadMemVramEx() is faster because it
+/// copies uncompressed data with DMA.
 ///
 /// Let function allocate memory and inform you of the size of the buffer:
 /// ```
@@ -147,6 +150,11 @@ typedef enum
 /// @param mmapSize
 ///     Location to store the metamap data size.
 ///
+/// If a chunk can't be decompressed, the function returns GRF_INVALID_DATA. If
+/// the buffer of that chunk was allocated by the function, it's freed and the
+/// destination pointer is set to NULL. Buffers of chunks that were loaded
+/// before the error are kept, and they must be freed by the caller.
+///
 /// @return
 ///     Returns 0 on success, a negative number on error.
 GRFError grfLoadMemEx(const void *src, GRFHeader *header,
@@ -216,6 +224,10 @@ GRFError grfLoadFile(FILE *file, GRFHeader *header,
 
 /// From a FILE* to a GRF file, extract all data and allocate memory for it.
 ///
+/// Compressed chunks aren't loaded to RAM before decompressing them. They are
+/// read from the file through a small buffer in the stack while they are
+/// decompressed, so the only big buffers used are the destination buffers.
+///
 /// @note
 ///     Check grfLoadMemEx() for details about how to use this function.
 ///
@@ -319,6 +331,161 @@ GRFError grfLoadPathEx(const char *path, GRFHeader *header,
                        void **mtilDst, size_t *mtilSize,
                        void **mmapDst, size_t *mmapSize);
 
+/// Wait for the vertical blanking period before writing palettes.
+///
+/// Use this flag to avoid tearing when replacing a palette that is being used
+/// by the screen. Compressed palettes are decompressed to RAM first. Then the
+/// loader waits in a busy loop until the vertical blanking period starts and
+/// copies the palette. This blocks the caller for up to one frame. Interrupts
+/// are still handled during the wait. If the vertical blanking period has
+/// already started, the palette is copied right away.
+///
+/// To avoid blocking, load the palette to RAM with grfLoadMemEx() or
+/// grfLoadFileEx() and copy it with vramUploadQueue(), which does the copy the
+/// next time vramUploadProcess() is called.
+#define GRF_VRAM_PAL_WAIT_VBLANK (1 << 0)
+
+/// From a GRF file in RAM, extract data directly to VRAM and palette RAM.
+///
+/// This works like grfLoadMemEx(), but the destinations are buffers instead of
+/// pointers to pointers, and they are never allocated by the function.
+/// Components that aren't needed can be ignored by passing NULL as destination.
+///
+/// VRAM and palette RAM don't support 8-bit writes, so all data is written to
+/// them in 16-bit or 32-bit units. Uncompressed data is copied with DMA channel
+/// 3, and compressed data is decompressed directly to the destination.
+///
+/// ```
+/// GRFError ret = grfLoadMemVramEx(grf_file, NULL,
+///                                 BG_TILE_RAM(1), NULL, BG_MAP_RAM(0), NULL,
+///                                 BG_PALETTE, NULL, NULL, NULL, NULL, NULL,
+///                                 GRF_VRAM_PAL_WAIT_VBLANK);
+/// ```
+///
+/// @param src
+///     Pointer to the GRF file in RAM.
+/// @param header
+///     Pointer to a header structure to be filled.
+/// @param gfxDst
+///     Destination of graphics data in VRAM.
+/// @param gfxSize
+///     Location to store the graphics data size.
+/// @param mapDst
+///     Destination of map data in VRAM.
+/// @param mapSize
+///     Location to store the map data size.
+/// @param palDst
+///     Destination of palette data in palette RAM or VRAM.
+/// @param palSize
+///     Location to store the palette data size.
+/// @param mtilDst
+///     Destination of metatile data in VRAM.
+/// @param mtilSize
+///     Location to store the metatile data size.
+/// @param mmapDst
+///     Destination of metamap data in VRAM.
+/// @param mmapSize
+///     Location to store the metamap data size.
+/// @param flags
+///     Set of ORed flags (like GRF_VRAM_PAL_WAIT_VBLANK) or 0.
+///
+/// @return
+///     Returns 0 on success, a negative number on error.
+GRFError grfLoadMemVramEx(const void *src, GRFHeader *header,
+                          void *gfxDst, size_t *gfxSize,
+                          void *mapDst, size_t *mapSize,
+                          void *palDst, size_t *palSize,
+                          void *mtilDst, size_t *mtilSize,
+                          void *mmapDst, size_t *mmapSize,
+                          unsigned int flags);
+
+/// From a FILE pointer, extract data directly to VRAM and palette RAM.
+///
+/// Uncompressed data is read to a small buffer in main RAM and copied from it
+/// to VRAM with DMA, compressed data is decompressed directly to VRAM while it
+/// is being read from the file.
+///
+/// @note Check grfLoadMemVramEx() for details about how to use this function.
+///
+/// @param file
+///     FILE pointer to the GRF file in the filesystem.
+/// @param header
+///     Pointer to a header structure to be filled.
+/// @param gfxDst
+///     Destination of graphics data in VRAM.
+/// @param gfxSize
+///     Location to store the graphics data size.
+/// @param mapDst
+///     Destination of map data in VRAM.
+/// @param mapSize
+///     Location to store the map data size.
+/// @param palDst
+///     Destination of palette data in palette RAM or VRAM.
+/// @param palSize
+///     Location to store the palette data size.
+/// @param mtilDst
+///     Destination of metatile data in VRAM.
+/// @param mtilSize
+///     Location to store the metatile data size.
+/// @param mmapDst
+///     Destination of metamap data in VRAM.
+/// @param mmapSize
+///     Location to store the metamap data size.
+/// @param flags
+///     Set of ORed flags (like GRF_VRAM_PAL_WAIT_VBLANK) or 0.
+///
+/// @return
+///     Returns 0 on success, a negative number on error.
+GRFError grfLoadFileVramEx(FILE *file, GRFHeader *header,
+                           void *gfxDst, size_t *gfxSize,
+                           void *mapDst, size_t *mapSize,
+                           void *palDst, size_t *palSize,
+                           void *mtilDst, size_t *mtilSize,
+                           void *mmapDst, size_t *mmapSize,
+                           unsigned int flags);
+
+/// From a path to a GRF file, extract data directly to VRAM and palette RAM.
+///
+/// @note Check grfLoadMemVramEx() and grfLoadFileVramEx() for details about
+/// how to use this function.
+///
+/// @param path
+///     Path to the GRF file in the filesystem.
+/// @param header
+///     Pointer to a header structure to be filled.
+/// @param gfxDst
+///     Destination of graphics data in VRAM.
+/// @param gfxSize
+///     Location to store the graphics data size.
+/// @param mapDst
+///     Destination of map data in VRAM.
+/// @param mapSize
+///     Location to store the map data size.
+/// @param palDst
+///     Destination of palette data in palette RAM or VRAM.
+/// @param palSize
+///     Location to store the palette data size.
+/// @param mtilDst
+///     Destination of metatile data in VRAM.
+/// @param mtilSize
+///     Location to store the metatile data size.
+/// @param mmapDst
+///     Destination of metamap data in VRAM.
+/// @param mmapSize
+///     Location to store the metamap data size.
+/// @param flags
+///     Set of ORed flags (like GRF_VRAM_PAL_WAIT_VBLANK) or 0.
+///
+/// @return
+///     Returns 0 on success, a negative number on error.
+GRFError grfLoadPathVramEx(const char *path, GRFHeader *header,
+                           void *gfxDst, size_t *gfxSize,
+                           void *mapDst, size_t *mapSize,
+                           void *palDst, size_t *palSize,
+                           void *mtilDst, size_t *mtilSize,
+                           void *mmapDst, size_t *mmapSize,
+                           unsigned int flags);
+
 #ifdef __cplusplus
 }
 #endif
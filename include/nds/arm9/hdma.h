@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#ifndef LIBNDS_NDS_ARM9_HDMA_H__
+#define LIBNDS_NDS_ARM9_HDMA_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @file nds/arm9/hdma.h
+///
+/// @brief Per-scanline effects using HBlank DMA.
+///
+/// Raster effects (wavy backgrounds, perspective floors, circular windows,
+/// blending gradients...) need to change video registers between scanlines.
+/// Doing it from a HBlank interrupt handler costs CPU time in all 192 lines.
+///
+/// These functions use DMA channels in HBlank mode instead. Each effect has a
+/// table with the values of a register (or group of consecutive registers) for
+/// each of the 192 scanlines, and the DMA copies one entry at the end of each
+/// line with no CPU involvement.
+///
+/// The tables are double buffered: you fill the back buffer returned by
+/// hdmaGetBackBuffer() at any time during the frame, and call hdmaSwap() when
+/// it's ready. The new table is used from the next frame.
+///
+/// hdmaVBlank() must be called once per frame during the vertical blanking
+/// period, for example right after swiWaitForVBlank():
+///
+/// ```
+/// hdmaStartBgScroll(1, 0); // DMA channel 1, background 0
+///
+/// while (1)
+/// {
+///     bg_scroll *table = hdmaGetBackBuffer(1);
+///     if (table)
+///     {
+///         hdmaGenWave(table, 0, 0, 8, 512, phase);
+///         hdmaSwap(1);
+///     }
+///     phase += 256;
+///
+///     swiWaitForVBlank();
+///     hdmaVBlank();
+/// }
+/// ```
+///
+/// While an effect is active, its registers are owned by the DMA. For example,
+/// bgUpdate() changes to the scroll or affine registers of a background are
+/// overwritten in the next scanline.
+///
+/// Don't use the DMA channel of an active effect for anything else. Note that
+/// some parts of libnds use DMA channels (for example, glCallList() uses
+/// channel 0, and dmaCopy() uses channel 3).
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <nds/arm9/background.h>
+#include <nds/arm9/window.h>
+#include <nds/ndstypes.h>
+
+/// Number of entries of each effect table (one per visible scanline).
+#define HDMA_LINES  192
+
+/// Starts a per-scanline effect on any group of registers.
+///
+/// @param channel
+///     DMA channel to use (0 to 3).
+/// @param dst
+///     Address of the first register.
+/// @param bytes_per_line
+///     Size of each entry of the table. It must be a multiple of 2. Entries
+///     that are a multiple of 4 bytes are copied faster.
+///
+/// @return
+///     It returns true on success, false if there isn't enough memory or the
+///     arguments aren't valid.
+bool hdmaStart(int channel, volatile void *dst, size_t bytes_per_line);
+
+/// Starts a per-scanline scroll effect on a background.
+///
+/// The table is an array of bg_scroll.
+///
+/// @param channel
+///     DMA channel to use (0 to 3).
+/// @param id
+///     Background ID returned by bgInit() or bgInitSub().
+///
+/// @return
+///     It returns true on success, false on error.
+bool hdmaStartBgScroll(int channel, int id);
+
+/// Starts a per-scanline affine transformation effect on a background.
+///
+/// The table is an array of bg_transform. The reference point (dx, dy) is set
+/// at the start of each line, so it's the map position of the leftmost pixel of
+/// that line, not of the top left corner of the screen.
+///
+/// @param channel
+///     DMA channel to use (0 to 3).
+/// @param id
+///     Background ID returned by bgInit() or bgInitSub(). It must be an affine
+///     or extended rotation background (layers 2 or 3).
+///
+/// @return
+///     It returns true on success, false on error.
+bool hdmaStartBgAffine(int channel, int id);
+
+/// Starts a per-scanline horizontal bounds effect on a window.
+///
+/// The table is an array of u16 values created with HDMA_WINDOW_BOUNDS(). The
+/// vertical bounds of the window are still set with windowSetBounds().
+///
+/// @param channel
+///     DMA channel to use (0 to 3).
+/// @param w
+///     WINDOW_0 or WINDOW_1.
+/// @param sub
+///     True for the sub engine, false for the main engine.
+///
+/// @return
+///     It returns true on success, false on error.
+bool hdmaStartWindow(int channel, WINDOW w, bool sub);
+
+/// Starts a per-scanline blending coefficients effect.
+///
+/// The table is an array of u16 values with the same format as REG_BLDALPHA.
+///
+/// @param channel
+///     DMA channel to use (0 to 3).
+/// @param sub
+///     True for the sub engine, false for the main engine.
+///
+/// @return
+///     It returns true on success, false on error.
+bool hdmaStartBlend(int channel, bool sub);
+
+/// Stops an effect and frees its tables.
+///
+/// The registers keep the last value written by the DMA.
+///
+/// @param channel
+///     DMA channel of the effect.
+void hdmaStop(int channel);
+
+/// Returns the table that can be modified for the next frame.
+///
+/// @param channel
+///     DMA channel of the effect.
+///
+/// @return
+///     Table of HDMA_LINES entries, or NULL if the effect isn't active or if
+///     hdmaSwap() has been called and hdmaVBlank() hasn't been called yet.
+void *hdmaGetBackBuffer(int channel);
+
+/// Makes the back buffer of an effect the active table from the next frame.
+///
+/// @param channel
+///     DMA channel of the effect.
+void hdmaSwap(int channel);
+
+/// Restarts all active effects for the next frame.
+///
+/// It must be called once per frame, during the vertical blanking period.
+void hdmaVBlank(void);
+
+/// Builds the value of a window bounds table entry.
+///
+/// @param left
+///     First column inside the window.
+/// @param right
+///     First column after the window. 256 is stored as 0, which the hardware
+///     treats as "until the end of the scanline" if left is bigger than 0.
+#define HDMA_WINDOW_BOUNDS(left, right) \
+    ((u16)((((left) & 0xFF) << 8) | ((right) & 0xFF)))
+
+/// Generates a table with a horizontal sine wave.
+///
+/// @param table
+///     Table of an hdmaStartBgScroll() effect.
+/// @param scroll_x
+///     Horizontal scroll of the background.
+/// @param scroll_y
+///     Vertical scroll of the background.
+/// @param amplitude
+///     Maximum displacement in pixels.
+/// @param frequency
+///     Angle increment per scanline (DEGREES_IN_CIRCLE, 32768, is a full
+///     turn).
+/// @param phase
+///     Angle of the first scanline (DEGREES_IN_CIRCLE is a full turn).
+void hdmaGenWave(bg_scroll *table, int scroll_x, int scroll_y, int amplitude,
+                 int frequency, int phase);
+
+/// Generates a table with a perspective view of a background (mode 7 floor).
+///
+/// The camera looks at the background as if it was the floor. Scanlines above
+/// the horizon (and the horizon itself) have a null matrix, so they show a
+/// single color. You can hide them with a window.
+///
+/// @param table
+///     Table of an hdmaStartBgAffine() effect.
+/// @param cam_x
+///     X position of the camera on the map (20.8 fixed point).
+/// @param cam_y
+///     Y position of the camera on the map (20.8 fixed point).
+/// @param height
+///     Height of the camera over the map (20.8 fixed point).
+/// @param angle
+///     Direction of the camera (DEGREES_IN_CIRCLE, 32768, is a full turn).
+///     With angle 0, the camera looks towards negative Y.
+/// @param horizon
+///     Scanline of the horizon.
+/// @param focal
+///     Distance from the camera to the screen in pixels.
+void hdmaGenPerspective(bg_transform *table, s32 cam_x, s32 cam_y, s32 height,
+                        int angle, int horizon, int focal);
+
+/// Generates a table with a circular window.
+///
+/// Scanlines outside of the circle have an empty window. The circle can go
+/// past the edges of the screen, and it's clipped to columns 0 to 255. The
+/// hardware can't cover a full scanline with a window, so a line that goes from
+/// column 0 to 255 leaves out column 255.
+///
+/// @param table
+///     Table of an hdmaStartWindow() effect.
+/// @param center_x
+///     X coordinate of the center.
+/// @param center_y
+///     Y coordinate of the center.
+/// @param radius
+///     Radius of the circle in pixels.
+void hdmaGenCircleWindow(u16 *table, int center_x, int center_y, int radius);
+
+/// Generates a table with a vertical gradient of blending coefficients.
+///
+/// @param table
+///     Table of an hdmaStartBlend() effect.
+/// @param eva_top
+///     Coefficient of the first target in the first scanline (0 to 16).
+/// @param evb_top
+///     Coefficient of the second target in the first scanline (0 to 16).
+/// @param eva_bottom
+///     Coefficient of the first target in the last scanline (0 to 16).
+/// @param evb_bottom
+///     Coefficient of the second target in the last scanline (0 to 16).
+void hdmaGenBlendGradient(u16 *table, int eva_top, int evb_top,
+                          int eva_bottom, int evb_bottom);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBNDS_NDS_ARM9_HDMA_H__
@@ -9,11 +9,15 @@
 /// @brief An image abstraction for working with image data.
 ///
 /// Image data buffers must be allocated using malloc() rather than pointing to
-/// stack data, as the conversion routines will free() the argument's image
-/// buffer and allocate a new block for the replacement data.
+/// stack data, as the conversion routines will convert the data in place and
+/// resize the buffer with realloc().
 ///
 /// As such, any loader implemented utilizing this structure must use malloc()
 /// to allocate the image buffer.
+///
+/// The imageConvert functions convert pixels between any two buffers, so they
+/// can also be used to write the result straight to VRAM. They only do 16-bit
+/// and 32-bit writes to the destination.
 
 #ifndef LIBNDS_NDS_ARM9_IMAGE_H__
 #define LIBNDS_NDS_ARM9_IMAGE_H__
@@ -22,6 +26,8 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 #include <nds/arm9/video.h>
 
 /// Holds a red green blue triplet
@@ -50,7 +56,53 @@ typedef struct sImage
 
 } sImage, *psImage;
 
-/// Destructively converts a 24-bit image to 16-bit
+/// Converts 24-bit RGB pixels to 16-bit pixels with the alpha bit set.
+///
+/// Groups of 4 pixels are converted with word accesses if both buffers are
+/// aligned to 4 bytes.
+///
+/// @param dst
+///     Destination buffer. It can be the same as src.
+/// @param src
+///     Source pixels (3 bytes per pixel, in R, G, B order).
+/// @param count
+///     Number of pixels.
+void imageConvert24to16(u16 *dst, const u8 *src, size_t count);
+
+/// Converts 8-bit paletted pixels to 16-bit pixels.
+///
+/// The alpha bit is set in all pixels except the ones that use the transparent
+/// color index.
+///
+/// @param dst
+///     Destination buffer. It can start at the same address as src.
+/// @param src
+///     Source pixels.
+/// @param palette
+///     Palette of 256 colors.
+/// @param count
+///     Number of pixels.
+/// @param transparentColor
+///     Index of the transparent color, or -1 if there isn't one.
+void imageConvert8to16(u16 *dst, const u8 *src, const u16 *palette,
+                       size_t count, int transparentColor);
+
+/// Rearranges 8-bit pixels into a sequence of 8x8 tiles.
+///
+/// @param dst
+///     Destination buffer. It can't be the same as src. It must be aligned to 4
+///     bytes.
+/// @param src
+///     Source pixels. It must be aligned to 4 bytes.
+/// @param width
+///     Width of the image (a multiple of 8).
+/// @param height
+///     Height of the image (a multiple of 8).
+void imageTile8(void *dst, const void *src, int width, int height);
+
+/// Destructively converts a 24-bit image to 16-bit.
+///
+/// The conversion is done in place, and the buffer is shrunk afterwards.
 ///
 /// @param img
 ///     Pointer to the image to manipulate.
@@ -61,6 +113,8 @@ bool image24to16(sImage *img);
 
 /// Destructively converts an 8-bit image to 16 bit setting the alpha bit.
 ///
+/// The buffer is grown with realloc() and converted in place.
+///
 /// @param img
 ///     Pointer to the image to manipulate.
 ///
@@ -90,6 +144,9 @@ void imageDestroy(sImage *img);
 
 /// Tiles 8-bit image data into a sequence of 8x8 tiles.
 ///
+/// The image is tiled in place. It only needs a temporary buffer for 8 rows of
+/// pixels.
+///
 /// @param img
 ///     Pointer to the image to manipulate.
 ///
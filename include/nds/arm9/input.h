@@ -30,6 +30,8 @@ extern "C" {
 ///
 /// @see nds/input.h available key masks on the Nintendo DS
 
+#include <stddef.h>
+
 #include <nds/input.h>
 #include <nds/ndstypes.h>
 #include <nds/touch.h>
@@ -87,6 +89,70 @@ uint32_t keysUp(void);
 ///     A touchPosition pointer which will be filled by the function.
 void touchRead(touchPosition *data);
 
+/// Highest sample rate accepted by touchEventsStart().
+#define TOUCH_EVENTS_MAX_RATE 2000
+
+/// Starts sampling the touch screen at a high rate and queuing the samples.
+///
+/// The ARM7 reads the touch screen from a timer interrupt instead of once per
+/// frame, filters the measurements the same way as touchRead(), and adds
+/// timestamped events to a queue shared with the ARM9. The queue receives
+/// events while the pen touches the screen, and one TOUCH_EVENT_UP event when
+/// it is lifted.
+///
+/// While this mode is active, touchRead() and KEY_TOUCH report the last sample
+/// taken by the timer. Reading the touch screen takes some time with interrupts
+/// disabled in the ARM7, so don't use rates higher than needed (for example,
+/// 240 Hz gives 4 samples per frame). Rates over TOUCH_EVENTS_MAX_RATE would
+/// leave the ARM7 with little time for anything else, so they are rejected.
+///
+/// @param rate
+///     Samples per second (8 to TOUCH_EVENTS_MAX_RATE).
+/// @param timer
+///     ARM7 timer used to take the samples (0 to 3). It must not be used by any
+///     other code of the ARM7. For example, timer 1 is used by the microphone.
+/// @param capacity
+///     Maximum number of events in the queue. It's rounded up to a power of
+///     two. Events are dropped if the queue is full.
+///
+/// @return
+///     It returns 0 on success, -1 if the queue is already active, -2 if the
+///     arguments aren't valid, -3 if there isn't enough memory.
+int touchEventsStart(u32 rate, int timer, size_t capacity);
+
+/// Stops sampling the touch screen at a high rate and frees the queue.
+///
+/// It waits for the ARM7 to stop using the queue. If the ARM7 doesn't reply in
+/// a few frames, the queue is leaked instead of freed so that the ARM7 never
+/// writes to memory that has been reused.
+///
+/// @return
+///     It returns 0 on success (or if the queue wasn't active), -1 if the queue
+///     has been leaked because the ARM7 didn't reply.
+int touchEventsStop(void);
+
+/// Reads touch events taken before the last call to scanKeys().
+///
+/// Call it once per frame after scanKeys() until it returns 0 to read all the
+/// samples since the previous frame. Events that arrive after scanKeys() are
+/// left in the queue for the next frame, so they always match the state of
+/// keysHeld() and touchRead().
+///
+/// @param events
+///     Destination of the events.
+/// @param max
+///     Maximum number of events to read.
+///
+/// @return
+///     Number of events read.
+size_t touchEventsRead(TouchEvent *events, size_t max);
+
+/// Returns the number of events dropped because the queue was full.
+///
+/// @return
+///     Number of events dropped since touchEventsStart().
+u32 touchEventsDropped(void);
+
 // Old way of reading the touchpad state.
 static inline __attribute__((deprecated)) touchPosition touchReadXY(void)
 {
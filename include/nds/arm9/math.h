@@ -19,6 +19,8 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 #include <nds/ndstypes.h>
 
 #define REG_DIVCNT          (*(vu16 *)(0x04000280))
@@ -415,6 +417,62 @@ static inline uint32_t sqrt64(uint64_t a)
 ///     32 bit floating point value
 ARM_CODE float hw_sqrtf(float x);
 
+// Batch versions
+//
+// These functions do the same operations as the functions above for each
+// element of an array, and they return exactly the same results. They are
+// faster because the next operation is started as soon as the previous result
+// has been read, and the CPU stores results and loads operands while the
+// hardware is busy. The mode of the divider and square root units is only set
+// once per call.
+//
+// They run from ITCM. Don't call them from an interrupt handler if the
+// interrupted code may be using the divider or the square root unit.
+
+/// Fixed point divide of arrays: results[i] = divf32(num[i], den[i])
+///
+/// @param results
+///     Array of 20.12 results. It can be the same as num or den.
+/// @param num
+///     Array of 20.12 numerators.
+/// @param den
+///     Array of 20.12 denominators.
+/// @param count
+///     Number of elements.
+void divf32_array(int32_t *results, const int32_t *num, const int32_t *den,
+                  size_t count);
+
+/// Fixed point reciprocal of an array: results[i] = divf32(inttof32(1), values[i])
+///
+/// @param results
+///     Array of 20.12 results. It can be the same as values.
+/// @param values
+///     Array of 20.12 values.
+/// @param count
+///     Number of elements.
+void reciprocal_array(int32_t *results, const int32_t *values, size_t count);
+
+/// Fixed point sqrt of an array: results[i] = sqrtf32(values[i])
+///
+/// @param results
+///     Array of 20.12 results. It can be the same as values.
+/// @param values
+///     Array of 20.12 positive values.
+/// @param count
+///     Number of elements.
+void sqrtf32_array(uint32_t *results, const uint32_t *values, size_t count);
+
+/// Fixed point normalize of an array of vectors, like normalizef32().
+///
+/// The square root of each vector runs at the same time as the divisions of
+/// the previous vector.
+///
+/// @param vectors
+///     Array of 3 dimension vectors (3 * count values) to normalize in place.
+/// @param count
+///     Number of vectors.
+void normalizef32_array(int32_t *vectors, size_t count);
+
 /// 20.12 fixed point cross product.
 ///
 /// Cross product:
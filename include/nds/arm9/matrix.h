@@ -0,0 +1,294 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#ifndef LIBNDS_NDS_ARM9_MATRIX_H__
+#define LIBNDS_NDS_ARM9_MATRIX_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @file nds/arm9/matrix.h
+///
+/// @brief Fixed point vector and matrix functions that run on the CPU.
+///
+/// All values are 20.12 fixed point numbers (f32). Matrices use the same layout
+/// as the 3D hardware and glLoadMatrix4x4()/glLoadMatrix4x3(): they are stored
+/// row by row, and vectors are row vectors multiplied on the left:
+///
+/// ```
+/// x' = x * m[0] + y * m[3] + z * m[6] + m[9]      (m4x3)
+/// y' = x * m[1] + y * m[4] + z * m[7] + m[10]
+/// z' = x * m[2] + y * m[5] + z * m[8] + m[11]
+/// ```
+///
+/// In a m4x3 matrix the last row is the translation, and the last column is
+/// (0, 0, 0, 1). Products are accumulated with 64-bit precision and shifted
+/// once at the end, like the matrix unit of the GPU does.
+///
+/// matTransformPointsGX() transforms points with the matrix unit of the GPU
+/// instead of the CPU.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <nds/arm9/math.h>
+#include <nds/arm9/videoGL.h>
+
+/// Adds two vectors: result = a + b
+///
+/// @param result
+///     Destination vector. It can be the same as a or b.
+/// @param a
+///     First vector.
+/// @param b
+///     Second vector.
+static inline void vecAdd(GLvector *result, const GLvector *a, const GLvector *b)
+{
+    result->x = a->x + b->x;
+    result->y = a->y + b->y;
+    result->z = a->z + b->z;
+}
+
+/// Subtracts two vectors: result = a - b
+///
+/// @param result
+///     Destination vector. It can be the same as a or b.
+/// @param a
+///     First vector.
+/// @param b
+///     Second vector.
+static inline void vecSub(GLvector *result, const GLvector *a, const GLvector *b)
+{
+    result->x = a->x - b->x;
+    result->y = a->y - b->y;
+    result->z = a->z - b->z;
+}
+
+/// Multiplies a vector by a scalar: result = a * s
+///
+/// @param result
+///     Destination vector. It can be the same as a.
+/// @param a
+///     Vector.
+/// @param s
+///     20.12 scale factor.
+static inline void vecScale(GLvector *result, const GLvector *a, int32_t s)
+{
+    result->x = mulf32(a->x, s);
+    result->y = mulf32(a->y, s);
+    result->z = mulf32(a->z, s);
+}
+
+/// Dot product of two vectors.
+///
+/// @param a
+///     First vector.
+/// @param b
+///     Second vector.
+///
+/// @return
+///     20.12 result.
+static inline int32_t vecDot(const GLvector *a, const GLvector *b)
+{
+    int64_t r = (int64_t)a->x * b->x + (int64_t)a->y * b->y
+              + (int64_t)a->z * b->z;
+
+    return (int32_t)(r >> 12);
+}
+
+/// Cross product of two vectors: result = a x b
+///
+/// @param result
+///     Destination vector. It can't be the same as a or b.
+/// @param a
+///     First vector.
+/// @param b
+///     Second vector.
+static inline void vecCross(GLvector *result, const GLvector *a, const GLvector *b)
+{
+    result->x = (int32_t)(((int64_t)a->y * b->z - (int64_t)a->z * b->y) >> 12);
+    result->y = (int32_t)(((int64_t)a->z * b->x - (int64_t)a->x * b->z) >> 12);
+    result->z = (int32_t)(((int64_t)a->x * b->y - (int64_t)a->y * b->x) >> 12);
+}
+
+/// Returns the length of a vector.
+///
+/// @param a
+///     Vector.
+///
+/// @return
+///     20.12 length.
+static inline int32_t vecLength(const GLvector *a)
+{
+    uint64_t sq = (int64_t)a->x * a->x + (int64_t)a->y * a->y
+                + (int64_t)a->z * a->z;
+
+    // The sum is a 40.24 value, its square root is 20.12
+    return sqrt64(sq);
+}
+
+/// Normalizes a vector (sets its length to 1.0 and keeps the direction).
+///
+/// @param a
+///     Vector to normalize. If its length is 0 it isn't modified.
+static inline void vecNormalize(GLvector *a)
+{
+    int32_t len = vecLength(a);
+
+    if (len == 0)
+        return;
+
+    a->x = divf32(a->x, len);
+    a->y = divf32(a->y, len);
+    a->z = divf32(a->z, len);
+}
+
+/// Sets a 4x4 matrix to the identity matrix.
+///
+/// @param m
+///     Matrix.
+void matIdentity4x4(m4x4 *m);
+
+/// Sets a 4x3 matrix to the identity matrix.
+///
+/// @param m
+///     Matrix.
+void matIdentity4x3(m4x3 *m);
+
+/// Multiplies two 4x4 matrices: result = a * b
+///
+/// Transforming a vector by the result is the same as transforming it by a and
+/// then by b.
+///
+/// @param result
+///     Destination matrix. It can be the same as a or b.
+/// @param a
+///     First matrix.
+/// @param b
+///     Second matrix.
+void matMultiply4x4(m4x4 *result, const m4x4 *a, const m4x4 *b);
+
+/// Multiplies two 4x3 matrices: result = a * b
+///
+/// @param result
+///     Destination matrix. It can be the same as a or b.
+/// @param a
+///     First matrix.
+/// @param b
+///     Second matrix.
+void matMultiply4x3(m4x3 *result, const m4x3 *a, const m4x3 *b);
+
+/// Transposes a 4x4 matrix.
+///
+/// @param result
+///     Destination matrix. It can be the same as m.
+/// @param m
+///     Matrix to transpose.
+void matTranspose4x4(m4x4 *result, const m4x4 *m);
+
+/// Transposes a 3x3 matrix.
+///
+/// @param result
+///     Destination matrix. It can be the same as m.
+/// @param m
+///     Matrix to transpose.
+void matTranspose3x3(m3x3 *result, const m3x3 *m);
+
+/// Calculates the inverse of a 4x3 matrix.
+///
+/// @param result
+///     Destination matrix. It can be the same as m.
+/// @param m
+///     Matrix to invert.
+///
+/// @return
+///     It returns false if the matrix can't be inverted, true otherwise.
+bool matInverse4x3(m4x3 *result, const m4x3 *m);
+
+/// Calculates the inverse of a 4x4 matrix.
+///
+/// The intermediate results are kept with 24 fractional bits, so the error of
+/// each element of the result is about one unit of 20.12, plus a relative error
+/// of around 2^-20 in elements with big values (like the translation).
+///
+/// @param result
+///     Destination matrix. It can be the same as m.
+/// @param m
+///     Matrix to invert.
+///
+/// @return
+///     It returns false if the matrix can't be inverted, true otherwise.
+bool matInverse4x4(m4x4 *result, const m4x4 *m);
+
+/// Transforms an array of points by a 4x3 matrix (including the translation).
+///
+/// @param m
+///     Transformation matrix.
+/// @param in
+///     Points to transform.
+/// @param out
+///     Transformed points. It can be the same array as in.
+/// @param count
+///     Number of points.
+void matTransformPoints4x3(const m4x3 *m, const GLvector *in, GLvector *out,
+                           size_t count);
+
+/// Transforms an array of normals or directions by a 4x3 matrix.
+///
+/// The translation is ignored. If the matrix has a non-uniform scale, use the
+/// transpose of its inverse to transform normals.
+///
+/// @param m
+///     Transformation matrix.
+/// @param in
+///     Normals to transform.
+/// @param out
+///     Transformed normals. It can be the same array as in.
+/// @param count
+///     Number of normals.
+void matTransformNormals4x3(const m4x3 *m, const GLvector *in, GLvector *out,
+                            size_t count);
+
+/// Transforms an array of points by a 4x4 matrix (with w = 1).
+///
+/// @param m
+///     Transformation matrix.
+/// @param in
+///     Points to transform.
+/// @param out
+///     Array of 4 * count values to store the transformed (x, y, z, w)
+///     coordinates.
+/// @param count
+///     Number of points.
+void matTransformPoints4x4(const m4x4 *m, const GLvector *in, int32_t *out,
+                           size_t count);
+
+/// Transforms an array of points by a 4x3 matrix using the GPU.
+///
+/// It uses the position test of the geometry engine, which runs while the CPU
+/// reads the results of the previous point and prepares the next one. The
+/// input coordinates are limited to the v16 range (-8.0 to 8.0).
+///
+/// It saves and restores the position and projection matrices, but the matrix
+/// mode is set to GL_MODELVIEW when it returns. Don't call it between
+/// glBegin() and glEnd().
+///
+/// @param m
+///     Transformation matrix.
+/// @param in
+///     Array of 3 * count values with the (x, y, z) coordinates of the points.
+/// @param out
+///     Transformed points.
+/// @param count
+///     Number of points.
+void matTransformPointsGX(const m4x3 *m, const v16 *in, GLvector *out,
+                          size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBNDS_NDS_ARM9_MATRIX_H__
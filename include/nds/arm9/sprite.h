@@ -19,6 +19,8 @@ extern "C" {
 #error Sprites are only available on the ARM9
 #endif
 
+#include <stddef.h>
+
 #include <nds/arm9/video.h>
 #include <nds/memory.h>
 #include <nds/ndstypes.h>
@@ -296,28 +298,48 @@ typedef enum
     SpriteMode_Bitmap = OBJMODE_BITMAP      ///< Sprite is not using tiles, per pixel image data.
 } SpriteMode;
 
-typedef struct AllocHeader
+/// State of the sprite graphics allocator of a 2D engine.
+///
+/// It is a buddy allocator that manages 1024 units of (1 << gfxOffsetStep)
+/// bytes. Blocks have sizes of 2^order units (order 0 to 10), and each order
+/// has a bitmap of free blocks and a bitmap of allocated blocks. The bitmaps of
+/// all orders use 68 words in total (32 + 16 + 8 + 4 + 2 + 1 * 6).
+///
+/// All fields are private, use the oam*() functions to access it.
+typedef struct OamGfxAllocator
 {
-    u16 nextFree;
-    u16 size;
-} AllocHeader;
+    u32 freeOrders;         ///< Orders that have at least one free block
+    u32 freeSummary[11];    ///< Words of freeBits with free blocks, per order
+    u32 freeBits[68];       ///< Free blocks of all orders
+    u32 usedBits[68];       ///< Allocated blocks of all orders
+    bool initialized;       ///< True if the allocator has been initialized
+} OamGfxAllocator;
 
 /// Holds the state for a 2D sprite engine.
 ///
 /// There are two of these objects, oamMain and oamSub and these must be passed
 /// in to all oam functions.
+///
+/// @note The layout of this struct changed when the sprite graphics allocator
+/// was replaced by a buddy allocator (OamGfxAllocator). The fields firstFree,
+/// allocBufferSize and allocBuffer have been removed, and so has the
+/// AllocHeader struct. Code that depends on the layout or size of OamState must
+/// be rebuilt. Code that used those fields has to use oamCountFragments(),
+/// oamGetLargestFreeGfx() and oamAllocReset() instead.
 typedef struct OamState
 {
     int gfxOffsetStep;        ///< The distance between tiles as 2^gfxOffsetStep
-    s16 firstFree;            ///< Pointer to the first free block of tiles
-    s16 allocBufferSize;      ///< Current size of the allocation buffer
-    AllocHeader *allocBuffer; ///< Array, allocation buffer for graphics allocation
+    OamGfxAllocator gfxAlloc; ///< Allocator of sprite graphics
     union
     {
         SpriteEntry *oamMemory;            ///< Pointer to shadow oam memory
         SpriteRotation *oamRotationMemory; ///< Pointer to shadow oam memory for rotation
     };
     SpriteMapping spriteMapping; ///< The mapping of the OAM.
+    u32 dirty[SPRITE_COUNT / 32];  ///< Entries modified since the last oamUpdate()
+    bool dirtyTracking;            ///< If true, oamUpdate() only copies dirty entries
+    s8 doubleBufferDma;            ///< DMA channel of the double buffer, or -1
+    SpriteEntry *frontBuffer;      ///< Copy of OAM sent at VBlank by the DMA
 } OamState;
 
 /// An object representing the main 2D engine.
@@ -326,6 +348,45 @@ extern OamState oamMain;
 /// An object representing the sub 2D engine.
 extern OamState oamSub;
 
+/// Marks an OAM entry as modified so that the next oamUpdate() copies it.
+///
+/// All oam*() functions do this automatically. You only need to call it if you
+/// modify oamMemory or oamRotationMemory directly while dirty tracking is
+/// enabled.
+///
+/// @param oam
+///     Must be &oamMain or &oamSub.
+/// @param id
+///     The OAM number to mark [0 - 127].
+static inline void oamMarkDirty(OamState *oam, int id)
+{
+    oam->dirty[id >> 5] |= BIT(id & 31);
+}
+
+/// Marks a range of OAM entries as modified.
+///
+/// @param oam
+///     Must be &oamMain or &oamSub.
+/// @param start
+///     The first OAM entry to mark.
+/// @param count
+///     The number of entries to mark.
+void oamMarkDirtyRange(OamState *oam, int start, int count);
+
+/// Marks an affine matrix as modified.
+///
+/// Matrix rotId is stored in the fourth attribute of OAM entries (rotId * 4)
+/// to (rotId * 4 + 3), so those entries are marked.
+///
+/// @param oam
+///     Must be &oamMain or &oamSub.
+/// @param rotId
+///     The affine matrix to mark [0 - 31].
+static inline void oamMarkRotationDirty(OamState *oam, int rotId)
+{
+    oam->dirty[rotId >> 3] |= 0xFu << ((rotId & 7) * 4);
+}
+
 /// Convert a VRAM address to an OAM offset
 ///
 /// @param oam
@@ -444,6 +505,8 @@ static inline void oamSetBlendMode(OamState *oam, int id, SpriteMode mode)
     sassert(mode <= SpriteMode_Bitmap, "oamSetBlendMode() mode is invalid");
 
     oam->oamMemory[id].blendMode = (ObjBlendMode)mode;
+
+    oamMarkDirty(oam, id);
 }
 
 /// Returns a SpriteSize enumeration value from dimensions in pixels.
@@ -516,6 +579,8 @@ static inline void oamSetXY(OamState *oam, int id, int x, int y)
 
     oam->oamMemory[id].x = x;
     oam->oamMemory[id].y = y;
+
+    oamMarkDirty(oam, id);
 }
 
 /// Sets an OAM entry to the supplied priority.
@@ -536,6 +601,8 @@ static inline void oamSetPriority(OamState *oam, int id, int priority)
             "oamSetPriority() priority is out of bounds, must be 0-3");
 
     oam->oamMemory[id].priority = (ObjPriority)priority;
+
+    oamMarkDirty(oam, id);
 }
 
 /// Sets a paletted OAM entry to the supplied palette.
@@ -559,6 +626,8 @@ static inline void oamSetPalette(OamState *oam, int id, int palette)
             "oamSetPalette() cannot set palette on a bitmapped sprite");
 
     oam->oamMemory[id].palette = palette;
+
+    oamMarkDirty(oam, id);
 }
 
 /// Sets a bitmapped OAM entry to the supplied transparency.
@@ -582,6 +651,8 @@ static inline void oamSetAlpha(OamState *oam, int id, int alpha)
             "oamSetAlpha() cannot set alpha on a paletted sprite");
 
     oam->oamMemory[id].palette = alpha;
+
+    oamMarkDirty(oam, id);
 }
 
 /// Sets an OAM entry to the supplied shape/size/pointer.
@@ -629,6 +700,8 @@ static inline void oamSetAffineIndex(OamState *oam, int id, int affineIndex,
         oam->oamMemory[id].isSizeDouble  = false;
         oam->oamMemory[id].isRotateScale = false;
     }
+
+    oamMarkDirty(oam, id);
 }
 
 /// Sets an OAM entry to the supplied hidden state.
@@ -649,6 +722,8 @@ static inline void oamSetHidden(OamState *oam, int id, bool hide)
             "oamSetHidden() cannot set hide on a RotateScale sprite");
 
     oam->oamMemory[id].isHidden = hide ? true : false;
+
+    oamMarkDirty(oam, id);
 }
 
 /// Sets an OAM entry to the supplied flipping.
@@ -672,6 +747,8 @@ static inline void oamSetFlip(OamState *oam, int id, bool hflip, bool vflip)
 
     oam->oamMemory[id].hFlip = hflip ? true : false;
     oam->oamMemory[id].vFlip = vflip ? true : false;
+
+    oamMarkDirty(oam, id);
 }
 
 /// Sets an OAM entry to enable or disable mosaic.
@@ -690,6 +767,8 @@ static inline void oamSetMosaicEnabled(OamState *oam, int id, bool mosaic)
             "oamSetMosaicEnabled() index is out of bounds, must be 0-127");
 
     oam->oamMemory[id].isMosaic = mosaic ? true : false;
+
+    oamMarkDirty(oam, id);
 }
 
 /// Hides the sprites in the supplied range.
@@ -714,16 +793,68 @@ static inline void oamClearSprite(OamState *oam, int index)
             "oamClearSprite() index is out of bounds, must be 0-127");
 
     oam->oamMemory[index].attribute[0] = ATTR0_DISABLED;
+
+    oamMarkDirty(oam, index);
 }
 
 /// Causes OAM to be updated.
 ///
-/// It must be called during vblank if using the OAM API.
+/// It must be called during vblank if using the OAM API, unless the double
+/// buffer has been enabled with oamEnableDoubleBuffer(). In that case it can be
+/// called at any time: the new state is sent to OAM at the start of the next
+/// vertical blanking period.
+///
+/// If dirty tracking is enabled, only the entries modified since the last call
+/// are copied.
 ///
 /// @param oam
 ///     Must be &oamMain or &oamSub.
 void oamUpdate(OamState *oam);
 
+/// Enables or disables dirty tracking in oamUpdate().
+///
+/// When it's enabled, oamUpdate() only copies the OAM entries that have been
+/// modified by the oam*() functions since the last update, which is a lot
+/// faster when few sprites change every frame. If you write to oamMemory or
+/// oamRotationMemory directly you must call oamMarkDirty() or
+/// oamMarkRotationDirty() afterwards.
+///
+/// It's disabled by default, and oamUpdate() copies all entries.
+///
+/// @param oam
+///     Must be &oamMain or &oamSub.
+/// @param enable
+///     True to enable dirty tracking, false to disable it.
+void oamSetDirtyTracking(OamState *oam, bool enable);
+
+/// Enables double buffered OAM updates.
+///
+/// oamUpdate() copies the shadow OAM to a second buffer and programs a DMA
+/// channel to copy that buffer to OAM at the start of the next vertical
+/// blanking period. This lets you call oamUpdate() at any point of the frame,
+/// and the game can keep modifying the shadow OAM after that.
+///
+/// The DMA channel must not be used by any other code while the double buffer
+/// is enabled.
+///
+/// @param oam
+///     Must be &oamMain or &oamSub.
+/// @param dmaChannel
+///     DMA channel to use (0 to 3). Each engine must use a different channel.
+///
+/// @return
+///     It returns true on success, false if there isn't enough memory.
+bool oamEnableDoubleBuffer(OamState *oam, int dmaChannel);
+
+/// Disables double buffered OAM updates.
+///
+/// Any update that hasn't been sent to OAM is cancelled. The next call to
+/// oamUpdate() copies all entries.
+///
+/// @param oam
+///     Must be &oamMain or &oamSub.
+void oamDisableDoubleBuffer(OamState *oam);
+
 /// Sets the specified rotation scale entry.
 ///
 /// @param oam
@@ -766,10 +897,15 @@ static inline void oamAffineTransformation(OamState *oam, int rotId, int hdx, in
     oam->oamRotationMemory[rotId].vdx = vdx;
     oam->oamRotationMemory[rotId].hdy = hdy;
     oam->oamRotationMemory[rotId].vdy = vdy;
+
+    oamMarkRotationDirty(oam, rotId);
 }
 
 /// Determines the number of fragments in the allocation engine.
 ///
+/// This is the number of free blocks. Two free blocks next to each other are
+/// counted separately if they can't be merged by the allocator.
+///
 /// @param oam
 ///     Must be &oamMain or &oamSub.
 ///
@@ -777,6 +913,20 @@ static inline void oamAffineTransformation(OamState *oam, int rotId, int hdx, in
 ///     The number of fragments.
 int oamCountFragments(OamState *oam);
 
+/// Returns the size of the largest block that can be allocated with
+/// oamAllocateGfx().
+///
+/// @param oam
+///     Must be &oamMain or &oamSub.
+///
+/// @return
+///     The size of the block in bytes, or 0 if oamInit() hasn't been called.
+size_t oamGetLargestFreeGfx(OamState *oam);
+
+/// Frees all sprite graphics allocated with oamAllocateGfx().
+///
+/// @param oam
+///     Must be &oamMain or &oamSub.
 void oamAllocReset(OamState *oam);
 
 #ifdef __cplusplus
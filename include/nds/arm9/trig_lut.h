@@ -129,6 +129,8 @@ s32 tanLerp(s16 angle);
 
 /// Fixed point arcsin.
 ///
+/// The result is interpolated between the entries of the sine LUT.
+///
 /// @param par
 ///     4.12 fixed point number with the range [-1, 1].
 ///
@@ -145,6 +147,30 @@ s16 asinLerp(s16 par);
 ///     Angle (-32768 to 32767).
 s16 acosLerp(s16 par);
 
+/// Fixed point arctan.
+///
+/// @param par
+///     20.12 fixed point number.
+///
+/// @return
+///     Angle in the range [-8192, 8192] (-90 to 90 degrees).
+s16 atanLerp(s32 par);
+
+/// Fixed point arctan of y / x, using the signs of both arguments to determine
+/// the quadrant of the result.
+///
+/// The arguments can be in any fixed point format, as long as both use the
+/// same one. If both are 0 it returns 0.
+///
+/// @param y
+///     Y coordinate.
+/// @param x
+///     X coordinate.
+///
+/// @return
+///     Angle in the range [-16384, 16384] (-180 to 180 degrees).
+s16 atan2Lerp(s32 y, s32 x);
+
 #ifdef __cplusplus
 }
 #endif
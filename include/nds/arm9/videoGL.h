@@ -23,6 +23,9 @@ extern "C" {
 #error 3D hardware is only available from the ARM9
 #endif
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include <nds/arm9/cache.h>
 #include <nds/arm9/dynamicArray.h>
 #include <nds/arm9/math.h>
@@ -62,7 +65,7 @@ typedef short t16;
 /// Convert float to t16
 #define floattot16(n)       ((t16)((n) * (1 << 4)))
 /// Pack two t16 texture coordinate values into a 32 bit value
-#define TEXTURE_PACK(u, v)  (((u) & 0xFFFF) | ((v) << 16))
+#define TEXTURE_PACK(u, v)  (((u) & 0xFFFF) | ((u32)(v) << 16))
 
 /// Vertex coordinate in 4.12 fixed point
 typedef short int v16;
@@ -75,7 +78,7 @@ typedef short int v16;
 /// Convert float to v16
 #define floattov16(n)       ((v16)((n) * (1 << 12)))
 /// Pack two v16 values into one 32 bit value
-#define VERTEX_PACK(x,y)    (u32)(((x) & 0xFFFF) | ((y) << 16))
+#define VERTEX_PACK(x,y)    (u32)(((x) & 0xFFFF) | ((u32)(y) << 16))
 
 /// Normal component in 0.10 fixed point, not used for 10 bit vertices.
 typedef short int v10;
@@ -348,10 +351,105 @@ typedef enum
     /// Returns the width of the currently bound texture. Use glGetInt()
     GL_GET_TEXTURE_WIDTH,
     /// Returns the height of the currently bound texture. Use glGetInt()
-    GL_GET_TEXTURE_HEIGHT
+    GL_GET_TEXTURE_HEIGHT,
+    /// Returns the number of free bytes of texture VRAM. Use glGetInt()
+    GL_GET_TEXTURE_VRAM_FREE,
+    /// Returns the size of the largest free block of texture VRAM. Use glGetInt()
+    GL_GET_TEXTURE_VRAM_LARGEST_FREE,
+    /// Returns the number of free blocks of texture VRAM. Use glGetInt()
+    GL_GET_TEXTURE_VRAM_FREE_BLOCKS,
+    /// Returns the number of free bytes of texture palette VRAM. Use glGetInt()
+    GL_GET_PALETTE_VRAM_FREE,
+    /// Returns the size of the largest free block of texture palette VRAM. Use
+    /// glGetInt()
+    GL_GET_PALETTE_VRAM_LARGEST_FREE,
+    /// Returns the number of free blocks of texture palette VRAM. Use glGetInt()
+    GL_GET_PALETTE_VRAM_FREE_BLOCKS
 } GL_GET_ENUM;
 
 
+/// Statistics of one frame recorded by the GPU profiler.
+///
+/// Related functions: glProfileStart(), glProfileGetFrames()
+typedef struct
+{
+    uint32_t frame;             ///< Number of the frame since glProfileStart()
+    uint16_t polygons;          ///< Polygons stored in polygon RAM
+    uint16_t vertices;          ///< Vertices stored in vertex RAM
+    uint16_t texture_binds;     ///< Calls to glBindTexture()
+    uint16_t matrix_stack_ops;  ///< Matrix push/pop/store/restore (GL_PROFILE)
+    uint16_t flush_vcount;      ///< Scanline (REG_VCOUNT) when glFlush() was called
+    uint16_t fifo_avg_level;    ///< Average number of commands in the GX FIFO
+    uint32_t fifo_samples;      ///< Number of times the GX FIFO was sampled
+    uint32_t fifo_full_samples; ///< Number of samples with the GX FIFO full
+    uint32_t fifo_stall_cycles; ///< Estimated CPU cycles with the GX FIFO full
+    uint32_t drain_cycles;      ///< CPU cycles waiting for the GPU in glFlush()
+    uint32_t frame_cycles;      ///< CPU cycles since the previous frame
+    uint32_t texture_vram_used; ///< Bytes of texture VRAM allocated
+} GLProfileFrame;
+
+/// Statistics of the frame being recorded by the GPU profiler.
+///
+/// This is used internally by the profiler, don't modify it.
+extern GLProfileFrame glProfileCounters;
+
+#ifdef GL_PROFILE
+#define GL_PROFILE_COUNT(field) (glProfileCounters.field++)
+#else
+#define GL_PROFILE_COUNT(field) ((void)0)
+#endif
+
+/// Starts the GPU profiler.
+///
+/// The profiler records the statistics of each frame in a ring buffer. A frame
+/// ends when glProfileFrame() is called.
+///
+/// The state of the GX FIFO is sampled from the interrupt handler of a
+/// hardware timer. The number of samples with the FIFO full is used to estimate
+/// the time that the CPU may have been blocked writing commands to it. The same
+/// timer is used to measure time.
+///
+/// Some statistics are only recorded in code built with GL_PROFILE defined
+/// before including videoGL.h (like the matrix stack operations). If GL_PROFILE
+/// is defined, glFlush() also calls glProfileFrame() automatically. libnds is
+/// built without GL_PROFILE, so the matrix stack operations done by its own
+/// functions (like the ones of GL2D) aren't counted.
+///
+/// @param num_frames
+///     Number of frames to remember.
+/// @param timer
+///     Hardware timer to use (0 - 3).
+/// @param sample_rate
+///     Number of samples of the GX FIFO per second (at least 512).
+///
+/// @return
+///     It returns true on success, false on error.
+bool glProfileStart(size_t num_frames, int timer, unsigned int sample_rate);
+
+/// Stops the GPU profiler and frees the recorded frames.
+void glProfileStop(void);
+
+/// Ends the current frame of the GPU profiler.
+///
+/// It must be called right before glFlush(). It waits for the GPU to process
+/// all the commands in the GX FIFO to read the polygon and vertex counts.
+void glProfileFrame(void);
+
+/// Gets the most recent frames recorded by the GPU profiler.
+///
+/// The frames are returned from oldest to newest. This can be used to display
+/// graphs in the application, or to write them to a file to be analyzed by a
+/// host tool.
+///
+/// @param frames
+///     Array to store the frames.
+/// @param max_frames
+///     Size of the array.
+///
+/// @return
+///     Number of frames stored in the array.
+size_t glProfileGetFrames(GLProfileFrame *frames, size_t max_frames);
+
 /// Arguments for glFlush().
 ///
 /// Related functions: glEnable(), glDisable(), glInit()
@@ -668,6 +766,8 @@ void glResetTextures(void);
 /// Locks a designated VRAM bank to prevent consideration of the bank when
 /// allocating textures.
 ///
+/// glInit() must be called before this function.
+///
 /// @param addr
 ///     The base address of the VRAM bank.
 ///
@@ -678,6 +778,8 @@ int glLockVRAMBank(uint16_t *addr);
 /// Unlocks a designated VRAM bank to allow consideration of the bank when
 /// allocating textures.
 ///
+/// glInit() must be called before this function.
+///
 /// @param addr
 ///     The base address of the VRAM bank.
 ///
@@ -685,6 +787,37 @@ int glLockVRAMBank(uint16_t *addr);
 ///     1 on success, 0 on failure.
 int glUnlockVRAMBank(uint16_t *addr);
 
+/// Moves textures and palettes in VRAM to merge the free space between them.
+///
+/// After many textures have been created and deleted, the free VRAM may be
+/// split into many small blocks, and it may be impossible to load a texture
+/// even if there is enough free memory. This function moves textures (and
+/// texture palettes) to lower addresses so that the free space is merged.
+///
+/// Texture and palette names don't change, but their addresses in VRAM do. Any
+/// address obtained with glGetTexturePointer() or similar functions has to be
+/// obtained again, and display lists that bind textures need to be rebuilt.
+///
+/// The VRAM banks are set to LCD mode while the data is copied, so textures
+/// can't be used by the GPU during that time. Call this function during the
+/// vertical blanking period, right after swiWaitForVBlank(), and use a budget
+/// small enough to finish before the 3D engine starts rendering the next frame.
+/// If there is more work to do, call it again in the next frame.
+///
+/// GL_COMPRESSED textures and blocks in locked VRAM banks aren't moved.
+///
+/// @param budget
+///     Maximum number of bytes to copy in this call, or 0 for no limit. Blocks
+///     bigger than the budget aren't moved.
+/// @param reclaimed
+///     If not NULL, it returns the number of bytes that the largest free block
+///     of texture VRAM has grown during this call.
+///
+/// @return
+///     It returns true if there is nothing else to move, false if the function
+///     has stopped because of the budget.
+bool glCompactTextures(size_t budget, size_t *reclaimed);
+
 /// Sets texture coordinates for following vertices (fixed point version).
 ///
 /// @param u
@@ -836,6 +969,7 @@ static inline void glTexCoord2i(t16 u, t16 v)
 /// Pushes the current matrix to the stack.
 static inline void glPushMatrix(void)
 {
+    GL_PROFILE_COUNT(matrix_stack_ops);
     MATRIX_PUSH = 0;
 }
 
@@ -845,6 +979,7 @@ static inline void glPushMatrix(void)
 ///     The number of matrices to pop.
 static inline void glPopMatrix(int num)
 {
+    GL_PROFILE_COUNT(matrix_stack_ops);
     MATRIX_POP = num;
 }
 
@@ -854,6 +989,7 @@ static inline void glPopMatrix(int num)
 ///     The location in the stack.
 static inline void glRestoreMatrix(int index)
 {
+    GL_PROFILE_COUNT(matrix_stack_ops);
     MATRIX_RESTORE = index;
 }
 
@@ -863,6 +999,7 @@ static inline void glRestoreMatrix(int index)
 ///     The location in the stack.
 static inline void glStoreMatrix(int index)
 {
+    GL_PROFILE_COUNT(matrix_stack_ops);
     MATRIX_STORE = index;
 }
 
@@ -993,10 +1130,16 @@ static inline void glViewport(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2)
 /// It lets you specify some 3D options: enabling Y-sorting of translucent
 /// polygons and W-Buffering of all vertices.
 ///
+/// If GL_PROFILE is defined it also ends the current frame of the GPU profiler
+/// (check glProfileFrame()).
+///
 /// @param mode
 ///     Flags from GLFLUSH_ENUM.
 static inline void glFlush(u32 mode)
 {
+#ifdef GL_PROFILE
+    glProfileFrame();
+#endif
     GFX_FLUSH = mode;
 }
 
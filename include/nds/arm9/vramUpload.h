@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#ifndef LIBNDS_NDS_ARM9_VRAMUPLOAD_H__
+#define LIBNDS_NDS_ARM9_VRAMUPLOAD_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @file nds/arm9/vramUpload.h
+///
+/// @brief Queue of copies to VRAM serviced during the vertical blanking period.
+///
+/// Copying data to VRAM while the screen is being drawn can cause visible
+/// corruption. This is specially bad with textures, because the VRAM banks need
+/// to be set to LCD mode while they are copied, so the 3D engine can't use any
+/// texture in them during the copy.
+///
+/// This queue lets you request copies at any time. They are done later, during
+/// the vertical blanking period, when vramUploadProcess() is called. Each frame
+/// only copies up to a number of bytes (the budget), and big copies are split
+/// across several frames.
+///
+/// Each copy returns a fence. Use vramUploadIsDone() to check if the copy has
+/// finished (and, for example, if a texture can be used).
+///
+/// If the destination is in the LCD mapping of VRAM (VRAM_A to VRAM_I), the
+/// banks that contain it are set to LCD mode during the copy and restored
+/// afterwards. This is how you upload textures and texture palettes. Other
+/// destinations (like BG_GFX or SPRITE_GFX) are written directly.
+///
+/// To load a texture with the queue, allocate it with glTexImage2D() passing a
+/// NULL pointer as data, then copy the data to glGetTexturePointer():
+///
+/// ```
+/// glBindTexture(0, name);
+/// glTexImage2D(0, 0, GL_RGB256, 128, 128, 0, TEXGEN_TEXCOORD, NULL);
+/// VramUploadFence fence = vramUploadQueue(data, glGetTexturePointer(name),
+///                                         128 * 128);
+///
+/// ...
+///
+/// swiWaitForVBlank();
+/// vramUploadProcess();
+///
+/// if (vramUploadIsDone(fence))
+///     // The texture can be used now
+/// ```
+///
+/// Copies are done with DMA. Consecutive copies whose sources and destinations
+/// are contiguous are merged into a single transfer. The source buffers must be
+/// in main RAM (not in DTCM or the stack), and they must not be modified until
+/// the copy has finished.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Identifier of a copy used to check when it has finished.
+///
+/// A value of 0 is never used by a valid copy.
+typedef uint32_t VramUploadFence;
+
+/// Default number of bytes copied by vramUploadProcess() each time.
+#define VRAM_UPLOAD_DEFAULT_BUDGET  (32 * 1024)
+
+/// Initializes the VRAM upload queue.
+///
+/// @param max_entries
+///     Maximum number of copies waiting in the queue.
+/// @param dma_channel
+///     DMA channel to use for the copies (0 to 3). Don't use a channel that is
+///     used by other code at the same time (for example, glCallList() uses
+///     channel 0).
+///
+/// @return
+///     It returns true on success, false if there isn't enough memory.
+bool vramUploadInit(size_t max_entries, uint8_t dma_channel);
+
+/// Frees the VRAM upload queue.
+///
+/// Any copy that hasn't been done is discarded. Don't call this function from
+/// an interrupt handler, it may interrupt a copy that is in progress.
+void vramUploadExit(void);
+
+/// Sets the maximum number of bytes copied by each call to vramUploadProcess().
+///
+/// @param bytes
+///     Number of bytes, or 0 for no limit.
+void vramUploadSetBudget(size_t bytes);
+
+/// Adds a copy to the queue.
+///
+/// The source, destination and size must be aligned to 2 bytes, because VRAM
+/// doesn't support 8-bit writes. Copies aligned to 4 bytes are faster.
+///
+/// @param src
+///     Source address in main RAM.
+/// @param dst
+///     Destination address in VRAM.
+/// @param size
+///     Size in bytes.
+///
+/// @return
+///     Fence of the copy, or 0 if the queue is full or the arguments aren't
+///     valid.
+VramUploadFence vramUploadQueue(const void *src, void *dst, size_t size);
+
+/// Checks if a copy has finished.
+///
+/// @param fence
+///     Fence returned by vramUploadQueue().
+///
+/// @return
+///     It returns true if the copy has finished. It returns false if the fence
+///     is 0.
+bool vramUploadIsDone(VramUploadFence fence);
+
+/// Returns the number of copies in the queue that haven't finished.
+///
+/// @return
+///     Number of copies.
+size_t vramUploadPending(void);
+
+/// Does copies from the queue until the budget is used.
+///
+/// Call this during the vertical blanking period, right after
+/// swiWaitForVBlank() or from the vertical blank interrupt handler.
+///
+/// Interrupts are only disabled while the queue is updated, not during the
+/// copies. Interrupt handlers can add copies to the queue while this function
+/// runs. If an interrupt handler calls this function (or vramUploadFlush())
+/// while another call is copying data, it returns 0 without doing anything.
+///
+/// @return
+///     Number of bytes copied.
+size_t vramUploadProcess(void);
+
+/// Does all copies in the queue, ignoring the budget.
+///
+/// This is useful in loading screens, when the screen isn't being displayed.
+///
+/// @return
+///     Number of bytes copied.
+size_t vramUploadFlush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBNDS_NDS_ARM9_VRAMUPLOAD_H__
@@ -15,6 +15,8 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 #include <nds/bios.h>
 #include <nds/ndstypes.h>
 
@@ -35,14 +37,48 @@ typedef enum
     /// Run Length Encoding decompression.
     RLE,
     /// Run Length Encoding decompression (VRAM can be used as detination).
-    RLEVram
+    RLEVram,
+    /// LZ16 decompression (VRAM can be used as destination). This format isn't
+    /// supported by the BIOS, it's always decompressed by the CPU.
+    LZ16
 } DecompressType;
 
+/// Compression type of the LZ16 format in the header of the compressed data.
+///
+/// LZ16 is a format similar to the block format of LZ4, designed to be decoded
+/// very quickly. All literals and matches are made of 16-bit units, so the
+/// decoder never needs to write individual bytes, and it can write straight to
+/// VRAM. Matches can be longer and further away than with LZ77, so the
+/// compression ratio is usually similar or better for 16-bit data, but it can
+/// be worse for 8-bit data with many short repetitions.
+///
+/// Data can be compressed with the lz16 tool in the "tools" folder of libnds.
+///
+/// The data starts with the same 32-bit header as the BIOS formats:
+/// (decompressed size << 8) | DECOMPRESS_TYPE_LZ16. The decompressed size must
+/// be a multiple of 2. The header is followed by a list of sequences:
+///
+/// - Token (1 byte): Bits 4-7 are the number of literal halfwords (L). Bits 0-3
+///   are the length of the match minus 2 (M), also in halfwords.
+/// - If L is 15, more bytes follow. Each one is added to L. The last byte is
+///   the first one that isn't 255.
+/// - L literal halfwords (little endian).
+/// - Offset (2 bytes, little endian): Distance to the start of the match in
+///   halfwords, counting back from the current output position. It can't be 0.
+/// - If M is 15, more bytes follow like with L.
+///
+/// The last sequence ends right after its literals, without offset. The decoder
+/// stops when the output buffer is full.
+#define DECOMPRESS_TYPE_LZ16 0x50
+
 /// Decompresses data using the suported type.
 ///
 /// When 'type' is HUFF, this function will allocate 512 bytes in the stack as a
 /// temporary buffer.
 ///
+/// LZ16 data is decompressed with decompressSoftware() because the BIOS doesn't
+/// support it.
+///
 /// @param dst
 ///     Destination to decompress to.
 /// @param data
@@ -53,8 +89,8 @@ void decompress(const void *data, void *dst, DecompressType type);
 
 /// Decompresses data using the suported type.
 ///
-/// Only LZ77Vram, HUFF and RLEVram support streaming, but HUFF isn't supported
-/// by this function at all, use decompressStreamStruct() instead.
+/// Only LZ77Vram, HUFF, RLEVram and LZ16 support streaming, but HUFF isn't
+/// supported by this function at all, use decompressStreamStruct() instead.
 ///
 /// @param dst
 ///     Destination to decompress to.
@@ -71,7 +107,10 @@ void decompressStream(const void *data, void *dst, DecompressType type,
 
 /// Decompresses data using the suported type.
 ///
-/// Only LZ77Vram, HUFF and RLEVram support streaming.
+/// Only LZ77Vram, HUFF, RLEVram and LZ16 support streaming.
+///
+/// LZ16 is decompressed by the CPU. It only uses the getSize() and readByte()
+/// callbacks, and 'param' is passed to getSize().
 ///
 /// For HUFF, make sure to pass a 512 byte buffer in 'param' to be used as a
 /// temporary buffer by the decompression code.
@@ -90,6 +129,72 @@ void decompressStream(const void *data, void *dst, DecompressType type,
 void decompressStreamStruct(const void *data, void *dst, DecompressType type,
                             void *param, TDecompressionStream *ds);
 
+/// Callback used by decompressSoftwareStream() to read compressed data.
+///
+/// @param buffer
+///     Buffer where the data has to be copied.
+/// @param size
+///     Maximum number of bytes to copy.
+/// @param arg
+///     Value passed to decompressSoftwareStream().
+///
+/// @return
+///     Number of bytes copied to the buffer. If it's 0, there is no more data
+///     available and the decompression fails.
+typedef size_t (*DecompressReadCallback)(void *buffer, size_t size, void *arg);
+
+/// Decompresses data using the CPU instead of the BIOS.
+///
+/// The output is the same as the one of decompress(), but this function is a
+/// lot faster. The code runs from ITCM in ARM mode and it doesn't use any
+/// callback per byte when writing to VRAM.
+///
+/// The type has to match the compression format of the data. It's used to
+/// decide if the output must be safe to be written to VRAM (LZ77Vram, RLEVram
+/// and HUFF) or if it can use 8-bit writes (LZ77 and RLE), which is faster.
+///
+/// Data can be decompressed in place. To do it, place the compressed data at
+/// the end of the destination buffer, leaving a margin after the end of the
+/// decompressed data that is big enough for the decompressed data to never
+/// overwrite compressed data that hasn't been read yet.
+///
+/// This function uses around 256 bytes of stack as a temporary buffer. Huffman
+/// decompression needs 512 additional bytes.
+///
+/// Huffman data is rejected if any node of its tree points past the end of the
+/// tree, which the BIOS doesn't check.
+///
+/// @param data
+///     Data to decompress.
+/// @param dst
+///     Destination to decompress to.
+/// @param type
+///     Type of data to decompress.
+///
+/// @return
+///     Size of the decompressed data, or a negative number on error.
+int decompressSoftware(const void *data, void *dst, DecompressType type);
+
+/// Decompresses a stream of data using the CPU instead of the BIOS.
+///
+/// This is the streaming version of decompressSoftware(). The compressed data
+/// (including its header) is requested in small blocks by calling the provided
+/// callback, so it's never needed to have all the compressed data in RAM.
+///
+/// @param dst
+///     Destination to decompress to.
+/// @param type
+///     Type of data to decompress.
+/// @param readCB
+///     Callback used to read compressed data.
+/// @param arg
+///     Value passed to the callback.
+///
+/// @return
+///     Size of the decompressed data, or a negative number on error.
+int decompressSoftwareStream(void *dst, DecompressType type,
+                             DecompressReadCallback readCB, void *arg);
+
 #ifdef __cplusplus
 }
 #endif
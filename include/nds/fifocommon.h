@@ -75,6 +75,8 @@ typedef enum
     SYS_ARM7_ASSERTION,
     SYS_ARM7_CONSOLE_FLUSH,
     SYS_SET_ARM7_CONSOLE,
+    SYS_SET_ARM7_LOG_RING,
+    SYS_SET_TOUCH_EVENTS,
 } FifoSystemCommands;
 
 typedef enum
@@ -119,6 +119,16 @@ typedef struct FifoMessage {
         struct {
             void *buffer;
         } setArm7Console;
+
+        struct {
+            void *buffer;
+        } setArm7LogRing;
+
+        struct {
+            void *buffer;
+            u32 freq;
+            u8 timer;
+        } setTouchEvents;
     };
 
 } ALIGN(4) FifoMessage;
@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#ifndef LIBNDS_NDS_LOGRING_H__
+#define LIBNDS_NDS_LOGRING_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @file nds/logring.h
+///
+/// @brief Binary log ring buffers for the ARM7 and ARM9.
+///
+/// The ARM7 console (nds/arm7/console.h) formats text on the ARM7 and it waits
+/// for the ARM9 when its buffer is full, so it can't be used in timing-critical
+/// code or interrupt handlers.
+///
+/// This log system doesn't format anything when a message is logged. Each
+/// message is stored as a fixed size binary record with a format ID, up to
+/// LOG_RING_MAX_ARGS 32-bit arguments and a timestamp. The ARM9 converts the
+/// records to text later, from the main thread, with a table of format strings
+/// indexed by format ID.
+///
+/// Each CPU has its own ring buffer with a single consumer (the ARM9 main
+/// thread), so there are no locks shared between CPUs. Logging only disables
+/// interrupts for the few cycles needed to copy the record, so it can be used
+/// from interrupt handlers. If a ring is full the record is dropped and
+/// counted, the caller never waits.
+///
+/// Usage:
+///
+/// ```
+/// // Shared between the ARM7 and ARM9 code
+/// enum { LOG_TOUCH, LOG_SOUND_START };
+///
+/// // ARM9
+/// static const char *const formats[] = {
+///     [LOG_TOUCH] = "touch: %lu, %lu",
+///     [LOG_SOUND_START] = "sound: channel %lu",
+/// };
+/// logRingInit(256, 256);
+/// logRingSetFormats(formats, 2);
+///
+/// while (1)
+/// {
+///     swiWaitForVBlank();
+///     logRingProcess(stdout);
+/// }
+///
+/// // ARM7 (or ARM9, even from an interrupt handler)
+/// LOG_RING(LOG_TOUCH, x, y);
+/// ```
+///
+/// The format strings are used with snprintf(), and all arguments are passed
+/// as uint32_t, so they should only use conversions like "%lu", "%ld" or
+/// "%lx". "%s" can only be used by records logged from the ARM9 (the ARM9 can't
+/// read strings stored in ARM7 memory).
+///
+/// Timestamps are the values returned by cpuGetTiming() in the CPU that logs
+/// the record, so they are only meaningful if cpuStartTiming() has been called
+/// in that CPU. The timers of both CPUs aren't synchronized. The scanline
+/// (REG_VCOUNT) of each record is always stored, and it's the same for both
+/// CPUs.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/// Maximum number of arguments of a log record.
+#define LOG_RING_MAX_ARGS   4
+
+/// Binary log record.
+typedef struct
+{
+    uint32_t timestamp; ///< Value of cpuGetTiming() of the CPU that logged it
+    uint16_t format_id; ///< Index in the table of format strings
+    uint16_t info;      ///< Scanline (bits 0-8), arguments (12-14), ARM7 (15)
+    uint32_t args[LOG_RING_MAX_ARGS]; ///< Arguments
+} LogRingRecord;
+
+/// Scanline in which a record was logged.
+#define LOG_RING_INFO_VCOUNT(info)  ((info) & 0x1FF)
+/// Number of arguments of a record.
+#define LOG_RING_INFO_NARGS(info)   (((info) >> 12) & 0x7)
+/// Non-zero if the record was logged by the ARM7.
+#define LOG_RING_INFO_ARM7(info)    ((info) & (1 << 15))
+
+/// Logs a record in the ring buffer of the current CPU.
+///
+/// It can be called from interrupt handlers. It doesn't do anything if the
+/// ring buffer hasn't been setup (in the ARM7, until the ARM9 calls
+/// logRingInit()).
+///
+/// @param format_id
+///     Index of the format string of the record.
+/// @param args
+///     Arguments of the record.
+/// @param nargs
+///     Number of arguments (up to LOG_RING_MAX_ARGS). Extra arguments are
+///     ignored.
+///
+/// @return
+///     It returns true if the record has been logged, false if the ring buffer
+///     is full or it isn't setup.
+bool logRingWrite(uint16_t format_id, const uint32_t *args, size_t nargs);
+
+// Helpers of LOG_RING() that convert each argument to uint32_t explicitly.
+// Without them, C++ doesn't allow signed or 64-bit arguments.
+#define LOG_RING_COUNT_(...) LOG_RING_COUNT_IMPL_(__VA_ARGS__, 4, 3, 2, 1, 0)
+#define LOG_RING_COUNT_IMPL_(z, a, b, c, d, n, ...) n
+#define LOG_RING_CASTS_(n, ...) LOG_RING_CASTS_IMPL_(n, __VA_ARGS__)
+#define LOG_RING_CASTS_IMPL_(n, ...) LOG_RING_CAST_##n(__VA_ARGS__)
+#define LOG_RING_CAST_0(...)
+#define LOG_RING_CAST_1(a) , (uint32_t)(a)
+#define LOG_RING_CAST_2(a, b) , (uint32_t)(a), (uint32_t)(b)
+#define LOG_RING_CAST_3(a, b, c) , (uint32_t)(a), (uint32_t)(b), (uint32_t)(c)
+#define LOG_RING_CAST_4(a, b, c, d) \
+    , (uint32_t)(a), (uint32_t)(b), (uint32_t)(c), (uint32_t)(d)
+
+/// Logs a record with a variable number of integer arguments.
+///
+/// Example: LOG_RING(LOG_TOUCH, x, y);
+///
+/// @param id
+///     Index of the format string of the record.
+/// @param ...
+///     Up to LOG_RING_MAX_ARGS arguments. They are converted to uint32_t.
+#define LOG_RING(id, ...) \
+    do { \
+        const uint32_t log_ring_args_[] = { \
+            0 LOG_RING_CASTS_(LOG_RING_COUNT_(0, ##__VA_ARGS__), ##__VA_ARGS__) \
+        }; \
+        logRingWrite((id), &log_ring_args_[1], \
+                     (sizeof(log_ring_args_) / sizeof(uint32_t)) - 1); \
+    } while (0)
+
+/// Returns the number of records dropped because the ring of this CPU was full.
+///
+/// @return
+///     Number of dropped records.
+uint32_t logRingDropped(void);
+
+#ifdef ARM9
+
+/// Allocates the ring buffers of both CPUs and shares the ARM7 one.
+///
+/// @param arm7_records
+///     Number of records of the ARM7 ring. It's rounded up to a power of two.
+///     If it's 0, the ARM7 can't log anything.
+/// @param arm9_records
+///     Number of records of the ARM9 ring. It's rounded up to a power of two.
+///     If it's 0, the ARM9 can't log anything.
+///
+/// @return
+///     It returns 0 on success, a negative number on error (if the rings are
+///     already setup or if there isn't enough memory).
+int logRingInit(size_t arm7_records, size_t arm9_records);
+
+/// Stops the ARM7 from logging and frees both ring buffers.
+///
+/// Records that haven't been processed are lost. It waits for the ARM7 to stop
+/// using its ring, for a few frames at most. If the ARM7 doesn't reply in time
+/// its ring isn't freed.
+///
+/// @return
+///     It returns 0 on success, -1 if the ARM7 ring has been leaked because the
+///     ARM7 didn't reply.
+int logRingExit(void);
+
+/// Sets the table of format strings used to convert records to text.
+///
+/// The table isn't copied, it must remain valid while it's in use.
+///
+/// @param formats
+///     Array of format strings indexed by format ID. Entries can be NULL.
+/// @param count
+///     Number of entries of the array.
+void logRingSetFormats(const char *const *formats, size_t count);
+
+/// Removes the oldest record from the rings.
+///
+/// The ARM7 ring is checked before the ARM9 ring.
+///
+/// @param record
+///     Destination of the record.
+///
+/// @return
+///     It returns true if a record has been read, false if both rings are
+///     empty.
+bool logRingRead(LogRingRecord *record);
+
+/// Converts a record to text.
+///
+/// The line starts with the CPU, the scanline and the timestamp of the record.
+/// Records with format IDs that aren't in the table are printed with their raw
+/// arguments.
+///
+/// @param record
+///     Record to convert.
+/// @param buffer
+///     Destination buffer.
+/// @param size
+///     Size of the buffer.
+///
+/// @return
+///     Return value of snprintf() for the whole line.
+int logRingFormat(const LogRingRecord *record, char *buffer, size_t size);
+
+/// Converts all pending records to text and writes them to a file.
+///
+/// It must be called from the main thread, not from interrupt handlers.
+///
+/// @param file
+///     Destination file, like stdout, stderr or a file opened with fopen(). If
+///     it's NULL, the text is sent to the debug console of no$gba.
+///
+/// @return
+///     Number of records processed.
+size_t logRingProcess(FILE *file);
+
+#endif // ARM9
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBNDS_NDS_LOGRING_H__
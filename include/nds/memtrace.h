@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#ifndef LIBNDS_NDS_MEMTRACE_H__
+#define LIBNDS_NDS_MEMTRACE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @file nds/memtrace.h
+///
+/// @brief Optional heap allocation tracer.
+///
+/// The tracer is disabled by default. When it is disabled, the only cost is
+/// one check of a global flag per allocation done by libnds.
+///
+/// Allocations done by libnds are tagged with the subsystem that requested
+/// them (GRF loader, videoGL, sprite allocator, threads, etc). When the tracer
+/// is enabled it keeps, for each tag, the current and peak number of bytes in
+/// use, as well as a global histogram of allocation sizes. It can also print a
+/// report of all allocations that haven't been freed when the program exits.
+///
+/// Allocations done by the application with malloc() and free() aren't seen by
+/// the tracer unless the application is linked with the following flags. In
+/// that case they are accounted under MEMTRACE_TAG_USER:
+///
+/// ```
+/// -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free,--wrap=memalign
+/// ```
+///
+/// Buffers returned to the application by libnds (for example, the ones
+/// allocated by grfLoadPath()) are released with free(). If the program isn't
+/// linked with the flags above they will be reported as leaks unless they are
+/// released with memTraceFree().
+///
+/// Every event can also be sent out as a MemTraceRecord so that it can be
+/// analyzed by a host tool. When sent to a file, the records are written in
+/// binary form (little endian, 16 bytes per record). When sent to the no$gba
+/// debug console, each record is printed in a line with the format:
+///
+/// ```
+/// @MT:TTGGPPPPPPPPSSSSSSSSCCCCCCCC
+/// ```
+///
+/// Where TT is the type, GG the tag, P the pointer, S the size and C the
+/// caller address, all of them in hexadecimal.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/// Subsystems that allocations can be accounted to.
+typedef enum
+{
+    MEMTRACE_TAG_USER           = 0,  ///< Application allocations
+    MEMTRACE_TAG_GRF            = 1,  ///< GRF loader
+    MEMTRACE_TAG_VIDEOGL        = 2,  ///< videoGL texture and VRAM metadata
+    MEMTRACE_TAG_SPRITE         = 3,  ///< Sprite graphics (VRAM) and OAM buffers
+    MEMTRACE_TAG_DYNAMIC_ARRAY  = 4,  ///< DynamicArray
+    MEMTRACE_TAG_COTHREAD       = 5,  ///< Thread contexts, stacks and TLS
+    MEMTRACE_TAG_FILESYSTEM     = 6,  ///< NitroFS and FAT filesystem
+    MEMTRACE_TAG_IMAGE          = 7,  ///< Image and PCX helpers
+    MEMTRACE_TAG_CONSOLE        = 8,  ///< Console buffers
+    MEMTRACE_TAG_VRAM_UPLOAD    = 9,  ///< VRAM upload queue
+    MEMTRACE_TAG_HDMA           = 10, ///< HBlank DMA effect tables
+    MEMTRACE_TAG_FONT           = 11, ///< Font glyph caches and text boxes
+    MEMTRACE_TAG_INPUT          = 12, ///< Touch event queue
+
+    MEMTRACE_TAG_COUNT          = 16, ///< Maximum number of tags
+
+    MEMTRACE_TAG_ALL            = 0xFF ///< Used to request global statistics
+} MemTraceTag;
+
+/// Types of records generated by the tracer.
+typedef enum
+{
+    MEMTRACE_RECORD_ALLOC   = 0, ///< A block has been allocated
+    MEMTRACE_RECORD_FREE    = 1, ///< A block has been freed
+    MEMTRACE_RECORD_FAILED  = 2, ///< An allocation has failed (ptr is 0)
+    MEMTRACE_RECORD_LEAK    = 3, ///< A block is still allocated at exit
+} MemTraceRecordType;
+
+/// Record generated by the tracer for each event.
+typedef struct
+{
+    uint8_t  type;      ///< One of MemTraceRecordType
+    uint8_t  tag;       ///< One of MemTraceTag
+    uint16_t reserved;  ///< Unused (always 0)
+    uint32_t ptr;       ///< Address of the block
+    uint32_t size;      ///< Size of the block in bytes
+    uint32_t caller;    ///< Address of the code that requested the operation
+} MemTraceRecord;
+
+/// Statistics of one tag (or all of them).
+typedef struct
+{
+    size_t   current;       ///< Bytes allocated right now
+    size_t   peak;          ///< Maximum value reached by "current"
+    uint32_t allocations;   ///< Number of successful allocations
+    uint32_t frees;         ///< Number of frees
+    uint32_t failures;      ///< Number of failed allocations
+} MemTraceStats;
+
+/// Destinations of the records generated by the tracer.
+typedef enum
+{
+    MEMTRACE_OUTPUT_NONE    = 0, ///< Don't generate records
+    MEMTRACE_OUTPUT_NOCASH  = 1, ///< Send records to the no$gba debug console
+    MEMTRACE_OUTPUT_FILE    = 2, ///< Write records to a FILE
+} MemTraceOutput;
+
+/// Number of buckets of the allocation size histogram.
+///
+/// Bucket N counts allocations of sizes between 2^N and 2^(N + 1) - 1 bytes.
+/// Bucket 0 also counts allocations of 0 bytes. The last bucket counts all
+/// allocations bigger than that.
+#define MEMTRACE_HISTOGRAM_BUCKETS  16
+
+/// Print a report of all blocks that are still allocated at exit.
+#define MEMTRACE_LEAK_REPORT_AT_EXIT    (1 << 0)
+
+/// Start tracing allocations.
+///
+/// The tracer allocates a table to remember the size and tag of all live
+/// allocations. If the table gets full, new allocations are still counted, but
+/// they won't be accounted when they are freed.
+///
+/// @param max_live_allocations
+///     Maximum number of allocations to remember at the same time. If it's 0 a
+///     default value is used.
+/// @param flags
+///     Set of ORed flags (like MEMTRACE_LEAK_REPORT_AT_EXIT) or 0.
+///
+/// @return
+///     It returns true on success, false if there isn't enough memory.
+bool memTraceStart(size_t max_live_allocations, unsigned int flags);
+
+/// Stop tracing allocations and free the resources used by the tracer.
+///
+/// All statistics are cleared.
+void memTraceStop(void);
+
+/// Select where to send the records generated by the tracer.
+///
+/// @param output
+///     Destination of the records.
+/// @param file
+///     File to use with MEMTRACE_OUTPUT_FILE. It must be opened in binary mode.
+void memTraceSetOutput(MemTraceOutput output, FILE *file);
+
+/// Get the statistics of a tag.
+///
+/// @param tag
+///     Tag to check, or MEMTRACE_TAG_ALL to get the global statistics.
+/// @param stats
+///     Pointer to the struct to be filled.
+void memTraceGetStats(MemTraceTag tag, MemTraceStats *stats);
+
+/// Get the histogram of allocation sizes.
+///
+/// @param histogram
+///     Array to be filled with the number of allocations in each bucket.
+void memTraceGetHistogram(uint32_t histogram[MEMTRACE_HISTOGRAM_BUCKETS]);
+
+/// Print the statistics of all tags and the list of live allocations.
+///
+/// The list of live allocations is also sent as MEMTRACE_RECORD_LEAK records
+/// to the selected output.
+///
+/// @param file
+///     File to print the report to (stderr, for example).
+void memTraceReport(FILE *file);
+
+/// Allocate memory and account it to the specified tag.
+///
+/// @param size
+///     Size of the block.
+/// @param tag
+///     Tag of the allocation.
+///
+/// @return
+///     Pointer to the new block, or NULL on error.
+void *memTraceMalloc(size_t size, MemTraceTag tag);
+
+/// Allocate zeroed memory and account it to the specified tag.
+///
+/// @param nmemb
+///     Number of elements.
+/// @param size
+///     Size of each element.
+/// @param tag
+///     Tag of the allocation.
+///
+/// @return
+///     Pointer to the new block, or NULL on error.
+void *memTraceCalloc(size_t nmemb, size_t size, MemTraceTag tag);
+
+/// Allocate aligned memory and account it to the specified tag.
+///
+/// @param alignment
+///     Alignment of the block.
+/// @param size
+///     Size of the block.
+/// @param tag
+///     Tag of the allocation.
+///
+/// @return
+///     Pointer to the new block, or NULL on error.
+void *memTraceMemalign(size_t alignment, size_t size, MemTraceTag tag);
+
+/// Resize a block and account it to the specified tag.
+///
+/// @param ptr
+///     Block to resize (or NULL).
+/// @param size
+///     New size of the block.
+/// @param tag
+///     Tag of the allocation.
+///
+/// @return
+///     Pointer to the new block, or NULL on error (the old block isn't freed).
+void *memTraceRealloc(void *ptr, size_t size, MemTraceTag tag);
+
+/// Free a block allocated with any of the memTrace functions or malloc().
+///
+/// @param ptr
+///     Block to free (or NULL).
+void memTraceFree(void *ptr);
+
+/// Record an allocation done by an allocator that doesn't use the heap.
+///
+/// This is used by allocators of other memory (like the sprite graphics
+/// allocator, which manages VRAM) so that their blocks can be seen by the
+/// tracer. The block is accounted to its tag, but not to the global statistics
+/// or the histogram, which only count heap memory.
+///
+/// @param ptr
+///     Address of the block, or NULL to record a failed allocation.
+/// @param size
+///     Size of the block.
+/// @param tag
+///     Tag of the allocation.
+void memTraceRecordAlloc(const void *ptr, size_t size, MemTraceTag tag);
+
+/// Record that a block passed to memTraceRecordAlloc() has been freed.
+///
+/// @param ptr
+///     Address of the block.
+void memTraceRecordFree(const void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBNDS_NDS_MEMTRACE_H__
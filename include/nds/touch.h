@@ -29,6 +29,25 @@ typedef struct touchPosition
     u16 z2;   ///< Raw cross panel resistance
 } touchPosition;
 
+/// Types of touch screen events.
+typedef enum
+{
+    TOUCH_EVENT_DOWN = 0, ///< The pen has touched the screen
+    TOUCH_EVENT_HELD = 1, ///< The pen is still touching the screen
+    TOUCH_EVENT_UP   = 2, ///< The pen has been lifted (the position is the last one)
+} TouchEventType;
+
+/// Timestamped touch screen sample generated by the ARM7 in high rate mode.
+///
+/// @see touchEventsStart()
+typedef struct
+{
+    u32 time;           ///< Sample periods since touchEventsStart()
+    u16 type;           ///< TouchEventType
+    u16 vcount;         ///< Value of REG_VCOUNT when the sample was taken
+    touchPosition pos;  ///< Filtered touch screen position
+} TouchEvent;
+
 #ifdef __cplusplus
 }
 #endif
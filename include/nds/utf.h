@@ -15,6 +15,7 @@ extern "C" {
 ///
 /// Helpers used to handle different UTF formats.
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <sys/types.h>
 #include <uchar.h>
@@ -26,20 +27,118 @@ extern "C" {
 /// This can be used for the firmware user setting strings, like the user name
 /// and the personal message.
 ///
+/// The conversion stops at the first NUL character or at the end of the source
+/// buffer. The output is always NUL-terminated if there is space for it. ASCII
+/// text is converted two characters at a time if the source buffer is aligned
+/// to 4 bytes.
+///
+/// @param out
+///     Destination buffer for the resulting string encoded as UTF-8. It can be
+///     NULL if out_size is 0.
+/// @param out_size
+///     Size of the destination buffer in bytes.
+/// @param in
+///     Source buffer of the UTF-16LE encoded string.
+/// @param in_size
+///     Size of the source buffer in bytes.
+///
+/// @result
+///     It returns the size of the full converted string in bytes, including the
+///     NUL terminator, or a negative number if the source string isn't valid
+///     UTF-16 (for example, if it has unpaired surrogates). If the returned
+///     size is bigger than out_size the string has been truncated. On error,
+///     the contents of the output buffer shouldn't be used.
+ssize_t utf16_to_utf8(char *out, size_t out_size, const char16_t *in,
+                      size_t in_size);
+
+/// It converts a UTF-8 string to UTF-16LE.
+///
+/// The conversion stops at the first NUL character or at the end of the source
+/// buffer. The output is always NUL-terminated if there is space for it. ASCII
+/// text is converted four characters at a time if the source buffer is aligned
+/// to 4 bytes.
+///
 /// @param out
-///     Destination buffer for the resulting string encoded as UTF-8.
+///     Destination buffer for the resulting string encoded as UTF-16LE. It can
+///     be NULL if out_size is 0.
 /// @param out_size
 ///     Size of the destination buffer in bytes.
 /// @param in
+///     Source buffer of the UTF-8 encoded string.
+/// @param in_size
+///     Size of the source buffer in bytes.
+///
+/// @result
+///     It returns the size of the full converted string in bytes, including the
+///     NUL terminator, or a negative number if the source string isn't valid
+///     UTF-8 (for example, if it has overlong encodings or surrogates). If the
+///     returned size is bigger than out_size the string has been truncated. On
+///     error, the contents of the output buffer shouldn't be used.
+ssize_t utf8_to_utf16(char16_t *out, size_t out_size, const char *in,
+                      size_t in_size);
+
+/// It returns the size that a UTF-16LE string would have encoded as UTF-8.
+///
+/// @param in
 ///     Source buffer of the UTF-16LE encoded string.
+/// @param in_size
+///     Size of the source buffer in bytes.
+///
+/// @result
+///     Size in bytes including the NUL terminator, or a negative number if the
+///     string isn't valid UTF-16.
+ssize_t utf16_to_utf8_len(const char16_t *in, size_t in_size);
+
+/// It returns the size that a UTF-8 string would have encoded as UTF-16LE.
+///
 /// @param in
+///     Source buffer of the UTF-8 encoded string.
+/// @param in_size
 ///     Size of the source buffer in bytes.
 ///
 /// @result
-///     It returns the number of saved bytes in the destination buffer on
-///     success or a negative number on error. On error, the contents of the
-///     output buffer shouldn't be used.
-ssize_t utf16_to_utf8(char *out, size_t out_size, char16_t *in, size_t in_size);
+///     Size in bytes including the NUL terminator, or a negative number if the
+///     string isn't valid UTF-8.
+ssize_t utf8_to_utf16_len(const char *in, size_t in_size);
+
+/// It checks if a UTF-16LE string is valid.
+///
+/// @param in
+///     Source buffer of the UTF-16LE encoded string.
+/// @param in_size
+///     Size of the source buffer in bytes. The check stops at the first NUL
+///     character or at the end of the buffer.
+///
+/// @result
+///     It returns true if the string is valid.
+bool utf16_validate(const char16_t *in, size_t in_size);
+
+/// It checks if a UTF-8 string is valid.
+///
+/// @param in
+///     Source buffer of the UTF-8 encoded string.
+/// @param in_size
+///     Size of the source buffer in bytes. The check stops at the first NUL
+///     character or at the end of the buffer.
+///
+/// @result
+///     It returns true if the string is valid.
+bool utf8_validate(const char *in, size_t in_size);
+
+/// It decodes one character of a NUL-terminated UTF-8 string.
+///
+/// Overlong encodings, surrogates and values over U+10FFFF are rejected.
+///
+/// @param in
+///     Pointer to the first byte of the character.
+/// @param codepoint
+///     Destination of the decoded codepoint.
+///
+/// @result
+///     It returns the number of bytes of the character (1 to 4) or a negative
+///     number if the sequence isn't valid. The NUL terminator is decoded as a
+///     character of 1 byte with codepoint 0.
+int utf8_decode_char(const char *in, char32_t *codepoint);
 
 #ifdef __cplusplus
 }
@@ -12,9 +12,11 @@
 #include <nds/arm7/touch.h>
 #include <nds/fifocommon.h>
 #include <nds/fifomessages.h>
+#include <nds/interrupts.h>
 #include <nds/ipc.h>
 #include <nds/ndstypes.h>
 #include <nds/system.h>
+#include <nds/timers.h>
 #include <nds/touch.h>
 
 // === Touchscreen filter configuration ===
@@ -40,17 +42,18 @@
 #define TOUCH_MAX_NOISE_PEN_UP_IIR_RATIO (1 << TOUCH_MAX_NOISE_PEN_UP_IIR_SHIFT)
 #define TOUCH_MAX_NOISE_PEN_UP_IIR_MIN (TOUCH_MAX_NOISE_PEN_UP - TOUCH_MAX_NOISE_PEN_UP_IIR_RATIO)
 
-static u16 inputTouchUpdate(touchPosition *tempPos)
-{
+typedef struct {
+    touchPosition pos; // Last valid position
+    bool penDown;
 #if PEN_DOWN_DEBOUNCE > 0
-    static touchPosition lastTouchPosition;
-    static bool lastPenDown = false;
-    static u8 penDownDebounce = 0;
-#else
-    touchPosition lastTouchPosition;
-    bool lastPenDown = false;
+    u8 debounce;
 #endif
+} TouchFilterState;
 
+// Takes a new touch screen measurement and filters it. It returns true if the
+// pen is considered to be down, and the position is stored in state->pos.
+static bool inputTouchFilter(TouchFilterState *state)
+{
     bool penDown = touchPenDown();
     if (penDown)
     {
@@ -72,69 +75,168 @@ static u16 inputTouchUpdate(touchPosition *tempPos)
 
         // Valid sample read.
         u16 noisiness = rawXresult.noisiness > rawYresult.noisiness ? rawXresult.noisiness : rawYresult.noisiness;
-        if (noisiness <= (lastPenDown ? TOUCH_MAX_NOISE_PEN_UP : TOUCH_MAX_NOISE_PEN_DOWN))
+        if (noisiness <= (state->penDown ? TOUCH_MAX_NOISE_PEN_UP : TOUCH_MAX_NOISE_PEN_DOWN))
         {
-            lastTouchPosition.z1 = libnds_touchMeasurementFilter(data.z1).value;
-            lastTouchPosition.z2 = libnds_touchMeasurementFilter(data.z2).value;
+            state->pos.z1 = libnds_touchMeasurementFilter(data.z1).value;
+            state->pos.z2 = libnds_touchMeasurementFilter(data.z2).value;
 
 #if TOUCH_MAX_NOISE_PEN_UP_IIR_SHIFT > 0
             // Apply an IIR filter on noisy X/Y samples.
             // Skip the IIR filter if the pen was just pressed.
             int n = (noisiness - TOUCH_MAX_NOISE_PEN_UP_IIR_MIN);
-            if (noisiness <= 0 || !lastPenDown)
+            if (noisiness <= 0 || !state->penDown)
             {
-                lastTouchPosition.rawx = rawXresult.value;
-                lastTouchPosition.rawy = rawYresult.value;
+                state->pos.rawx = rawXresult.value;
+                state->pos.rawy = rawYresult.value;
             }
             else if (noisiness <= TOUCH_MAX_NOISE_PEN_UP_IIR_RATIO)
             {
-                lastTouchPosition.rawx =
+                state->pos.rawx =
                     ((rawXresult.value * (TOUCH_MAX_NOISE_PEN_UP_IIR_RATIO - n))
-                     + (lastTouchPosition.rawx * n)) >> TOUCH_MAX_NOISE_PEN_UP_IIR_SHIFT;
-                lastTouchPosition.rawy =
+                     + (state->pos.rawx * n)) >> TOUCH_MAX_NOISE_PEN_UP_IIR_SHIFT;
+                state->pos.rawy =
                     ((rawYresult.value * (TOUCH_MAX_NOISE_PEN_UP_IIR_RATIO - n))
-                     + (lastTouchPosition.rawy * n)) >> TOUCH_MAX_NOISE_PEN_UP_IIR_SHIFT;
+                     + (state->pos.rawy * n)) >> TOUCH_MAX_NOISE_PEN_UP_IIR_SHIFT;
             }
 #else
-            lastTouchPosition.rawx = rawXresult.value;
-            lastTouchPosition.rawy = rawYresult.value;
+            state->pos.rawx = rawXresult.value;
+            state->pos.rawy = rawYresult.value;
 #endif
 
-            touchApplyCalibration(lastTouchPosition.rawx, lastTouchPosition.rawy, &lastTouchPosition.px, &lastTouchPosition.py);
+            touchApplyCalibration(state->pos.rawx, state->pos.rawy, &state->pos.px, &state->pos.py);
             penDown = true;
         }
 
 #ifdef TOUCH_DEBUG_NOISINESS
-        lastTouchPosition.z1 = rawXresult.noisiness;
-        lastTouchPosition.z2 = rawYresult.noisiness;
+        state->pos.z1 = rawXresult.noisiness;
+        state->pos.z2 = rawYresult.noisiness;
 #endif
     }
 
 noPenDown:
 #if PEN_DOWN_DEBOUNCE > 0
     // Perform simple debouncing.
-    // Hold new presses for PEN_DOWN_DEBOUNCE frames.
-    if (!penDownDebounce)
+    // Hold new presses for PEN_DOWN_DEBOUNCE samples.
+    if (!state->debounce)
     {
-        if (lastPenDown != penDown)
+        if (state->penDown != penDown)
         {
-            lastPenDown = penDown;
+            state->penDown = penDown;
             if (penDown)
-                penDownDebounce = PEN_DOWN_DEBOUNCE;
+                state->debounce = PEN_DOWN_DEBOUNCE;
         }
     }
     else
     {
-        penDownDebounce--;
+        state->debounce--;
     }
 #else
-    lastPenDown = penDown;
+    state->penDown = penDown;
 #endif
 
+    return state->penDown;
+}
+
+// === High rate touch events ===
+
+// State of the filter when the touch screen is sampled once per frame
+static TouchFilterState frameTouchState;
+
+// State of the filter when the touch screen is sampled by the timer
+static TouchFilterState eventTouchState;
+
+static TouchEventIpc *touchEventRing = NULL;
+static int touchEventTimer = -1;
+static u32 touchEventTime = 0;
+
+static void touchEventsTimerHandler(void)
+{
+    TouchEventIpc *ring = touchEventRing;
+
+    bool wasDown = eventTouchState.penDown;
+    bool penDown = inputTouchFilter(&eventTouchState);
+    u32 time = touchEventTime++;
+
+    // Only send events while the pen is down, and one more event when it's
+    // lifted.
+    if (!penDown && !wasDown)
+        return;
+
+    u32 write_index = ring->write_index;
+
+    if (write_index - ring->read_index > ring->mask)
+    {
+        ring->dropped++;
+        return;
+    }
+
+    TouchEvent *event = &ring->events[write_index & ring->mask];
+
+    event->time = time;
+    event->type = !penDown ? TOUCH_EVENT_UP :
+                  (!wasDown ? TOUCH_EVENT_DOWN : TOUCH_EVENT_HELD);
+    event->vcount = REG_VCOUNT;
+    event->pos = eventTouchState.pos;
+
+    // The event has to be complete before the consumer can see it. The ring
+    // isn't cached by the ARM9, so it reads the values in the right order.
+    __asm__ volatile("" ::: "memory");
+    ring->write_index = write_index + 1;
+}
+
+void touchEventsSetup(TouchEventIpc *ring, u32 freq, int timer)
+{
+    int oldIME = enterCriticalSection();
+
+    if (touchEventTimer >= 0)
+    {
+        timerStop(touchEventTimer);
+        irqDisable(IRQ_TIMER(touchEventTimer));
+        touchEventTimer = -1;
+    }
+
+    // The timer interrupt handler can't be running now, so the ARM9 can free
+    // the old ring after this.
+    if (touchEventRing != NULL)
+        touchEventRing->active = 0;
+
+    touchEventRing = ring;
+
+    if ((ring != NULL) && (freq > 0) && (timer >= 0) && (timer < 4))
+    {
+        eventTouchState = (TouchFilterState){ 0 };
+        touchEventTime = 0;
+        touchEventTimer = timer;
+
+        timerStart(timer, ClockDivider_64, TIMER_FREQ_64(freq),
+                   touchEventsTimerHandler);
+    }
+
+    leaveCriticalSection(oldIME);
+}
+
+static u16 inputTouchUpdate(touchPosition *tempPos)
+{
+    TouchFilterState state;
+
+    if (touchEventRing != NULL)
+    {
+        // The touch screen is already being sampled by the timer. Use the last
+        // sample so that the position is consistent with the events.
+        int oldIME = enterCriticalSection();
+        state = eventTouchState;
+        leaveCriticalSection(oldIME);
+    }
+    else
+    {
+        inputTouchFilter(&frameTouchState);
+        state = frameTouchState;
+    }
+
     // Return the touch position and key mask.
-    if (lastPenDown)
+    if (state.penDown)
     {
-        *tempPos = lastTouchPosition;
+        *tempPos = state.pos;
         return 0;
     }
     else
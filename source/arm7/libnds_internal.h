@@ -29,6 +29,8 @@ libnds_touchMeasurementFilterResult libnds_touchMeasurementFilter(u16 values[5])
 
 int consoleSetup(ConsoleArm7Ipc *c);
 
+void touchEventsSetup(TouchEventIpc *ring, u32 freq, int timer);
+
 bool twlSoundExtSetFrequency(unsigned int freq_khz);
 
 #endif // ARM7_LIBNDS_INTERNAL_H__
@@ -185,6 +185,13 @@ void systemMsgHandler(int bytes, void *user_data)
         case SYS_SET_ARM7_CONSOLE:
             consoleSetup(msg.setArm7Console.buffer);
             break;
+        case SYS_SET_ARM7_LOG_RING:
+            logRingSetup(msg.setArm7LogRing.buffer);
+            break;
+        case SYS_SET_TOUCH_EVENTS:
+            touchEventsSetup(msg.setTouchEvents.buffer, msg.setTouchEvents.freq,
+                             msg.setTouchEvents.timer);
+            break;
     }
 }
 
@@ -24,6 +24,7 @@
 #include <nds/fifocommon.h>
 #include <nds/fifomessages.h>
 #include <nds/memory.h>
+#include <nds/memtrace.h>
 #include <nds/ndstypes.h>
 
 #include "common/libnds_internal.h"
@@ -184,6 +185,11 @@ ssize_t nocash_write(const char *ptr, size_t len)
     return len;
 }
 
+static size_t consolePrintRun(const char *ptr, size_t len);
+static void consoleFreeScrollback(PrintConsole *console);
+
+static ConsoleOutFn consoleMirror = NULL;
+
 static ssize_t con_write(const char *ptr, size_t len)
 {
     const char *tmp = ptr;
@@ -191,11 +197,23 @@ static ssize_t con_write(const char *ptr, size_t len)
     if (!tmp || len <= 0)
         return -1;
 
+    if (consoleMirror)
+        consoleMirror(ptr, len);
+
     size_t i = 0;
     size_t count = 0;
 
     while (i < len)
     {
+        size_t run = consolePrintRun(tmp, len - i);
+        if (run > 0)
+        {
+            tmp += run;
+            i += run;
+            count += run;
+            continue;
+        }
+
         char chr = *(tmp++);
         i++;
         count++;
@@ -501,6 +519,8 @@ PrintConsole *consoleInitEx(PrintConsole *console, int layer, BgType type, BgSiz
     else
         console = currentConsole;
 
+    consoleFreeScrollback(console);
+
     *currentConsole = defaultConsole;
 
     if (mainDisplay)
@@ -585,44 +605,173 @@ PrintConsole *consoleDemoInit(void)
                        DEFAULT_CONSOLE_MAP_BASE, DEFAULT_CONSOLE_GFX_BASE, false, true);
 }
 
+// VRAM doesn't support 8-bit writes, so memcpy() and memset() can't be used to
+// modify the map. These functions use 32-bit accesses whenever they can.
+static void consoleMapCopy(u16 *dst, const u16 *src, int count)
+{
+    if ((((uintptr_t)dst ^ (uintptr_t)src) & 3) != 0)
+    {
+        while (count-- > 0)
+            *dst++ = *src++;
+        return;
+    }
+
+    if (((uintptr_t)dst & 3) && (count > 0))
+    {
+        *dst++ = *src++;
+        count--;
+    }
+
+    u32 *dst32 = (u32 *)dst;
+    const u32 *src32 = (const u32 *)src;
+
+    for (int i = 0; i < count / 2; i++)
+        dst32[i] = src32[i];
+
+    if (count & 1)
+        dst[count - 1] = src[count - 1];
+}
+
+static void consoleMapFill(u16 *dst, u16 value, int count)
+{
+    if (((uintptr_t)dst & 3) && (count > 0))
+    {
+        *dst++ = value;
+        count--;
+    }
+
+    u32 *dst32 = (u32 *)dst;
+    u32 value32 = value | ((u32)value << 16);
+
+    for (int i = 0; i < count / 2; i++)
+        dst32[i] = value32;
+
+    if (count & 1)
+        dst[count - 1] = value;
+}
+
+// Returns a pointer to the cell of the window at the given coordinates, which
+// is in the scrollback buffer if the console has one, or in the map otherwise.
+// The caller is expected to write to it.
+static u16 *consoleCellPtr(PrintConsole *con, int x, int y)
+{
+    if (con->scrollback != NULL)
+    {
+        int line = con->scrollbackTop + y;
+        if (line >= con->scrollbackLines)
+            line -= con->scrollbackLines;
+
+        con->scrollbackDirty = true;
+
+        return con->scrollback + line * con->windowWidth + x;
+    }
+
+    return con->fontBgMap + x + con->windowX + (y + con->windowY) * con->consoleWidth;
+}
+
 static void newRow(void)
 {
     currentConsole->cursorY++;
 
     if (currentConsole->cursorY >= currentConsole->windowHeight)
     {
-        int rowCount;
-        int colCount;
+        int width = currentConsole->windowWidth;
+        int stride = currentConsole->consoleWidth;
+        int rows = currentConsole->windowHeight - 1;
 
         currentConsole->cursorY--;
 
-        for (rowCount = 0; rowCount < currentConsole->windowHeight - 1; rowCount++)
+        u16 value = ' ' + currentConsole->fontCharOffset - currentConsole->font.asciiOffset;
+
+        if (currentConsole->scrollback != NULL)
         {
-            for (colCount = 0; colCount < currentConsole->windowWidth; colCount++)
-            {
-                int dst_index = (colCount + currentConsole->windowX)
-                              + (rowCount + currentConsole->windowY) * currentConsole->consoleWidth;
+            // Nothing needs to be moved, the top line of the window becomes
+            // part of the history, and the oldest line becomes the new bottom
+            // line of the window.
+            PrintConsole *con = currentConsole;
 
-                int src_index = (colCount + currentConsole->windowX)
-                              + (rowCount + currentConsole->windowY + 1)
-                                 * currentConsole->consoleWidth;
+            con->scrollbackTop++;
+            if (con->scrollbackTop == con->scrollbackLines)
+                con->scrollbackTop = 0;
 
-                u16 value = currentConsole->fontBgMap[src_index];
+            if (con->scrollbackHistory < con->scrollbackLines - con->windowHeight)
+                con->scrollbackHistory++;
 
-                currentConsole->fontBgMap[dst_index] = value;
+            // Keep showing the same lines if the view is scrolled back. It only
+            // moves when its top line is overwritten by the new line.
+            if (con->scrollbackOffset > 0)
+            {
+                if (con->scrollbackOffset < con->scrollbackHistory)
+                    con->scrollbackOffset++;
             }
+
+            consoleMapFill(consoleCellPtr(con, 0, rows), value, width);
+            return;
         }
 
-        for (colCount = 0; colCount < currentConsole->windowWidth; colCount++)
+        u16 *map = currentConsole->fontBgMap + currentConsole->windowX
+                 + currentConsole->windowY * stride;
+
+        if (width == stride)
         {
-            int index = (colCount + currentConsole->windowX)
-                      + (rowCount + currentConsole->windowY) * currentConsole->consoleWidth;
+            // The rows of the window are contiguous, move them all at once
+            consoleMapCopy(map, map + stride, rows * stride);
+        }
+        else
+        {
+            for (int row = 0; row < rows; row++)
+                consoleMapCopy(map + row * stride, map + (row + 1) * stride, width);
+        }
+
+        consoleMapFill(map + rows * stride, value, width);
+    }
+}
 
-            u16 value = ' ' + currentConsole->fontCharOffset - currentConsole->font.asciiOffset;
+// Writes a run of printable characters straight to the map, up to the end of
+// the current row of the window. It returns the number of characters written,
+// which is 0 if the first character needs to go through consolePrintChar().
+static size_t consolePrintRun(const char *ptr, size_t len)
+{
+    PrintConsole *con = currentConsole;
 
-            currentConsole->fontBgMap[index] = value;
-        }
+    if ((con->PrintChar != NULL) || (con->fontBgMap == NULL))
+        return 0;
+
+    unsigned int first = con->font.asciiOffset;
+    unsigned int end = first + con->font.numChars;
+
+    // Control characters and escape sequences are handled by the slow path
+    unsigned char c = ptr[0];
+    if ((c < ' ') || (c < first) || (c >= end))
+        return 0;
+
+    if (con->cursorX >= con->windowWidth)
+    {
+        con->cursorX = 0;
+        newRow();
+    }
+
+    size_t room = con->windowWidth - con->cursorX;
+    if (len > room)
+        len = room;
+
+    u16 *dst = consoleCellPtr(con, con->cursorX, con->cursorY);
+    u16 base = TILE_PALETTE(con->fontCurPal) + con->fontCharOffset - first;
+
+    size_t n = 0;
+    while (n < len)
+    {
+        c = ptr[n];
+        if ((c < ' ') || (c < first) || (c >= end))
+            break;
+
+        dst[n] = base + c;
+        n++;
     }
+
+    con->cursorX += n;
+
+    return n;
 }
 
 void consolePrintChar(char c)
@@ -665,7 +814,7 @@ void consolePrintChar(char c)
             {
                 if (currentConsole->cursorY > 0)
                 {
-                    currentConsole->cursorX = currentConsole->windowX - 1;
+                    currentConsole->cursorX = currentConsole->windowWidth - 1;
                     currentConsole->cursorY--;
                 }
                 else
@@ -676,11 +825,10 @@ void consolePrintChar(char c)
 
             uint16_t tile = ' ' + currentConsole->fontCharOffset - currentConsole->font.asciiOffset;
 
-            int index = currentConsole->cursorX + currentConsole->windowX
-                      + (currentConsole->cursorY + currentConsole->windowY)
-                         * currentConsole->consoleWidth;
+            u16 *cell = consoleCellPtr(currentConsole, currentConsole->cursorX,
+                                       currentConsole->cursorY);
 
-            currentConsole->fontBgMap[index] = TILE_PALETTE(currentConsole->fontCurPal) | tile;
+            *cell = TILE_PALETTE(currentConsole->fontCurPal) | tile;
             break;
         }
         case 9:
@@ -700,18 +848,21 @@ void consolePrintChar(char c)
 
         default:
         {
-            if (c < currentConsole->font.asciiOffset)
-                c = ' ';
-            if (c >= currentConsole->font.asciiOffset + currentConsole->font.numChars)
-                c = ' ';
+            // Characters are unsigned so that fonts can have glyphs for bytes
+            // 0x80 to 0xFF. consolePrintRun() follows the same rule.
+            unsigned int uc = (unsigned char)c;
 
-            uint16_t tile = c + currentConsole->fontCharOffset - currentConsole->font.asciiOffset;
+            if (uc < currentConsole->font.asciiOffset)
+                uc = ' ';
+            if (uc >= currentConsole->font.asciiOffset + currentConsole->font.numChars)
+                uc = ' ';
 
-            int index = currentConsole->cursorX + currentConsole->windowX
-                      + (currentConsole->cursorY + currentConsole->windowY)
-                         * currentConsole->consoleWidth;
+            uint16_t tile = uc + currentConsole->fontCharOffset - currentConsole->font.asciiOffset;
 
-            currentConsole->fontBgMap[index] = TILE_PALETTE(currentConsole->fontCurPal) | tile;
+            u16 *cell = consoleCellPtr(currentConsole, currentConsole->cursorX,
+                                       currentConsole->cursorY);
+
+            *cell = TILE_PALETTE(currentConsole->fontCurPal) | tile;
             currentConsole->cursorX++;
             break;
         }
@@ -800,6 +951,10 @@ void consoleSetWindow(PrintConsole *console, int x, int y, int width, int height
 
     console->cursorX = 0;
     console->cursorY = 0;
+
+    // The lines of the scrollback buffer depend on the width of the window
+    if (console->scrollback != NULL)
+        consoleSetScrollback(console, console->scrollbackLines);
 }
 
 void consoleSetCustomStdout(ConsoleOutFn fn)
@@ -818,6 +973,146 @@ void consoleSetCustomStderr(ConsoleOutFn fn)
         libnds_stderr_write = con_write;
 }
 
+void consoleSetMirror(ConsoleOutFn fn)
+{
+    consoleMirror = fn;
+}
+
+// Scrollback buffers start with this header. They are kept in a list so that
+// consoleInitEx() can free the buffer of a console without reading the
+// PrintConsole struct, which may not have been initialized yet.
+typedef struct ConsoleScrollbackBlock
+{
+    struct ConsoleScrollbackBlock *next;
+    PrintConsole *owner;
+    u16 cells[];
+} ConsoleScrollbackBlock;
+
+static ConsoleScrollbackBlock *scrollbackBlocks = NULL;
+
+static void consoleFreeScrollback(PrintConsole *console)
+{
+    ConsoleScrollbackBlock **link = &scrollbackBlocks;
+
+    while (*link != NULL)
+    {
+        ConsoleScrollbackBlock *block = *link;
+
+        if (block->owner == console)
+        {
+            *link = block->next;
+            memTraceFree(block);
+
+            console->scrollback = NULL;
+            console->scrollbackLines = 0;
+            return;
+        }
+
+        link = &block->next;
+    }
+}
+
+int consoleSetScrollback(PrintConsole *console, int lines)
+{
+    if (!console)
+        console = currentConsole;
+
+    consoleFreeScrollback(console);
+
+    if (lines <= 0)
+        return 0;
+
+    int width = console->windowWidth;
+    int height = console->windowHeight;
+
+    if (lines < height)
+        lines = height;
+
+    ConsoleScrollbackBlock *block =
+        memTraceMalloc(sizeof(ConsoleScrollbackBlock) + lines * width * sizeof(u16),
+                       MEMTRACE_TAG_CONSOLE);
+    if (block == NULL)
+        return -1;
+
+    block->owner = console;
+    block->next = scrollbackBlocks;
+    scrollbackBlocks = block;
+
+    u16 *buffer = block->cells;
+
+    u16 value = ' ' + console->fontCharOffset - console->font.asciiOffset;
+    consoleMapFill(buffer, value, lines * width);
+
+    // Start with the current contents of the window
+    for (int y = 0; y < height; y++)
+    {
+        const u16 *row = console->fontBgMap + console->windowX
+                       + (y + console->windowY) * console->consoleWidth;
+
+        consoleMapCopy(buffer + y * width, row, width);
+    }
+
+    console->scrollback = buffer;
+    console->scrollbackLines = lines;
+    console->scrollbackTop = 0;
+    console->scrollbackHistory = 0;
+    console->scrollbackOffset = 0;
+    console->scrollbackDirty = false;
+
+    return 0;
+}
+
+int consoleScroll(PrintConsole *console, int delta)
+{
+    if (!console)
+        console = currentConsole;
+
+    int offset = console->scrollbackOffset + delta;
+
+    if (offset > console->scrollbackHistory)
+        offset = console->scrollbackHistory;
+    if (offset < 0)
+        offset = 0;
+
+    if (offset != console->scrollbackOffset)
+    {
+        console->scrollbackOffset = offset;
+        console->scrollbackDirty = true;
+    }
+
+    return offset;
+}
+
+void consoleRender(PrintConsole *console)
+{
+    if (!console)
+        console = currentConsole;
+
+    if ((console->scrollback == NULL) || !console->scrollbackDirty)
+        return;
+
+    int width = console->windowWidth;
+    int lines = console->scrollbackLines;
+
+    int line = console->scrollbackTop - console->scrollbackOffset;
+    if (line < 0)
+        line += lines;
+
+    for (int y = 0; y < console->windowHeight; y++)
+    {
+        u16 *row = console->fontBgMap + console->windowX
+                 + (y + console->windowY) * console->consoleWidth;
+
+        consoleMapCopy(row, console->scrollback + line * width, width);
+
+        line++;
+        if (line == lines)
+            line = 0;
+    }
+
+    console->scrollbackDirty = false;
+}
+
 // ---------------------------------------------------------------------------
 
 static ConsoleArm7Ipc *arm7con = NULL;
@@ -834,7 +1129,7 @@ int consoleArm7Setup(PrintConsole *console, size_t buffer_size)
 
     size_t total_size = sizeof(ConsoleArm7Ipc) + buffer_size;
 
-    ConsoleArm7Ipc *newcon = malloc(total_size);
+    ConsoleArm7Ipc *newcon = memTraceMalloc(total_size, MEMTRACE_TAG_CONSOLE);
     if (newcon == NULL)
         return -3;
 
@@ -875,7 +1170,7 @@ int consoleArm7Disable(void)
 
     fifoSendDatamsg(FIFO_SYSTEM, sizeof(msg), (u8 *)&msg);
 
-    free(memCached(arm7con));
+    memTraceFree(memCached(arm7con));
     arm7con = NULL;
 
     arm7console = NULL;
@@ -4,6 +4,7 @@
 // Copyright (C) 2005 Jason Rogers (dovoto)
 
 #include <nds/arm9/dynamicArray.h>
+#include <nds/memtrace.h>
 
 void *DynamicArrayInit(DynamicArray *v, unsigned int initialSize)
 {
@@ -11,7 +12,8 @@ void *DynamicArrayInit(DynamicArray *v, unsigned int initialSize)
         return NULL;
 
     v->cur_size = initialSize;
-    v->data = malloc(sizeof(void *) * initialSize);
+    v->data = memTraceMalloc(sizeof(void *) * initialSize,
+                             MEMTRACE_TAG_DYNAMIC_ARRAY);
 
     return v->data;
 }
@@ -22,7 +24,7 @@ void DynamicArrayDelete(DynamicArray *v)
         return;
 
     if (v->data != NULL)
-        free(v->data);
+        memTraceFree(v->data);
 }
 
 void *DynamicArrayGet(DynamicArray *v, unsigned int index)
@@ -46,7 +48,8 @@ bool DynamicArraySet(DynamicArray *v, unsigned int index, void *item)
         // resize the array, making sure it is bigger than index.
         unsigned int newSize = (v->cur_size * 2 > index ? v->cur_size * 2 : index + 1);
 
-        void **temp = realloc(v->data, sizeof(void *) * newSize);
+        void **temp = memTraceRealloc(v->data, sizeof(void *) * newSize,
+                                      MEMTRACE_TAG_DYNAMIC_ARRAY);
 
         if (temp == NULL)
             return false;
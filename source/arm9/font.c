@@ -0,0 +1,747 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <nds/arm9/font.h>
+#include <nds/memtrace.h>
+#include <nds/utf.h>
+
+#define FONT_EMPTY_ENTRY    UINT32_MAX
+
+// Glyph lookup and cache
+// ======================
+
+bool fontInit(Font *font, const void *data, size_t cache_entries)
+{
+    const FontHeader *header = data;
+
+    memset(font, 0, sizeof(Font));
+
+    if ((header->magic != FONT_MAGIC) || (header->version != FONT_VERSION))
+        return false;
+
+    if ((header->bpp != 1) && (header->bpp != 2) && (header->bpp != 4))
+        return false;
+
+    const uint8_t *base = data;
+
+    font->header = header;
+    font->glyphs = (const FontGlyph *)(base + header->glyphs_offset);
+    font->kerning = (const FontKerning *)(base + header->kerning_offset);
+    font->bitmaps = base + header->bitmaps_offset;
+    font->fallback = '?';
+
+    // Every cache entry has space for the biggest glyph of the font
+    size_t max_words = 1;
+    for (size_t i = 0; i < header->num_glyphs; i++)
+    {
+        const FontGlyph *g = &font->glyphs[i];
+        size_t words = ((g->width + 7) / 8) * g->height;
+
+        if (words > max_words)
+            max_words = words;
+    }
+
+    size_t count = 1;
+    while ((count < cache_entries) && (count < 0x8000))
+        count <<= 1;
+
+    font->cache = memTraceMalloc(count * sizeof(FontCacheEntry),
+                                 MEMTRACE_TAG_FONT);
+    if (font->cache == NULL)
+        return false;
+
+    font->cache_data = memTraceMalloc(count * max_words * sizeof(uint32_t),
+                                      MEMTRACE_TAG_FONT);
+    if (font->cache_data == NULL)
+    {
+        memTraceFree(font->cache);
+        font->cache = NULL;
+        return false;
+    }
+
+    font->cache_mask = count - 1;
+    font->cache_words = max_words;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        font->cache[i].codepoint = FONT_EMPTY_ENTRY;
+        font->cache[i].rows = font->cache_data + i * max_words;
+    }
+
+    return true;
+}
+
+void fontFree(Font *font)
+{
+    memTraceFree(font->cache);
+    memTraceFree(font->cache_data);
+    font->cache = NULL;
+    font->cache_data = NULL;
+}
+
+void fontSetFallback(Font *font, uint32_t codepoint)
+{
+    font->fallback = codepoint;
+}
+
+static int fontFindGlyph(const Font *font, uint32_t codepoint)
+{
+    int low = 0;
+    int high = font->header->num_glyphs - 1;
+
+    while (low <= high)
+    {
+        int mid = (low + high) >> 1;
+        uint32_t c = font->glyphs[mid].codepoint;
+
+        if (c == codepoint)
+            return mid;
+        else if (c < codepoint)
+            low = mid + 1;
+        else
+            high = mid - 1;
+    }
+
+    return -1;
+}
+
+static int fontKerning(const Font *font, int left, int right)
+{
+    const FontKerning *k = font->kerning;
+    uint32_t key = ((uint32_t)left << 16) | right;
+    int low = 0;
+    int high = font->header->num_kerning - 1;
+
+    while (low <= high)
+    {
+        int mid = (low + high) >> 1;
+        uint32_t c = ((uint32_t)k[mid].left << 16) | k[mid].right;
+
+        if (c == key)
+            return k[mid].amount;
+        else if (c < key)
+            low = mid + 1;
+        else
+            high = mid - 1;
+    }
+
+    return 0;
+}
+
+// Decodes a glyph of the font into a cache entry: one word per 8 pixels of each
+// row, 4 bits per pixel.
+static void fontDecodeGlyph(const Font *font, FontCacheEntry *e, int index)
+{
+    const FontGlyph *g = &font->glyphs[index];
+    const uint8_t *src = font->bitmaps + g->bitmap;
+    unsigned int bpp = font->header->bpp;
+    unsigned int pixel_mask = (1 << bpp) - 1;
+    unsigned int scale = 15 / pixel_mask;
+    size_t src_stride = (g->width * bpp + 7) / 8;
+
+    e->index = index;
+    e->width = g->width;
+    e->height = g->height;
+    e->x_offset = g->x_offset;
+    e->y_offset = font->header->ascent + g->y_offset;
+    e->advance = g->advance;
+    e->words = (g->width + 7) / 8;
+
+    uint32_t *dst = e->rows;
+
+    for (int y = 0; y < g->height; y++)
+    {
+        for (int w = 0; w < e->words; w++)
+            dst[w] = 0;
+
+        for (int x = 0; x < g->width; x++)
+        {
+            unsigned int bit = x * bpp;
+            unsigned int v = (src[bit >> 3] >> (bit & 7)) & pixel_mask;
+
+            dst[x >> 3] |= (v * scale) << ((x & 7) * 4);
+        }
+
+        src += src_stride;
+        dst += e->words;
+    }
+}
+
+static const FontCacheEntry *fontCacheGet(Font *font, uint32_t codepoint)
+{
+    // Direct-mapped cache. Consecutive codepoints (like ASCII) never collide.
+    FontCacheEntry *e = &font->cache[codepoint & font->cache_mask];
+
+    if (e->codepoint == codepoint)
+        return e;
+
+    e->codepoint = codepoint;
+
+    int index = fontFindGlyph(font, codepoint);
+    if (index < 0)
+    {
+        e->index = -1;
+        e->width = 0;
+        e->height = 0;
+        e->advance = 0;
+        e->words = 0;
+        return e;
+    }
+
+    fontDecodeGlyph(font, e, index);
+
+    return e;
+}
+
+// Returns the glyph used to draw a codepoint, or NULL if it can't be drawn.
+static const FontCacheEntry *fontGetGlyph(Font *font, uint32_t codepoint)
+{
+    const FontCacheEntry *e = fontCacheGet(font, codepoint);
+
+    if ((e->index < 0) && (codepoint != font->fallback))
+        e = fontCacheGet(font, font->fallback);
+
+    if (e->index < 0)
+        return NULL;
+
+    return e;
+}
+
+// Drawing
+// =======
+
+// Sets the 4 bits of each non-zero pixel of a word of 8 pixels.
+static inline uint32_t fontNibbleMask(uint32_t v)
+{
+    v |= v >> 1;
+    v |= v >> 2;
+    return (v & 0x11111111) * 0xF;
+}
+
+// Sets the 8 bits of each non-zero pixel of a word of 4 pixels.
+static inline uint32_t fontByteMask(uint32_t v)
+{
+    v |= v >> 4;
+    v |= v >> 2;
+    v |= v >> 1;
+    return (v & 0x01010101) * 0xFF;
+}
+
+// Converts 4 pixels of 4 bits to 4 pixels of 8 bits.
+static inline uint32_t fontExpandNibbles(uint32_t v)
+{
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    return v;
+}
+
+static inline void fontPut(vu32 *dst, uint32_t value, uint32_t mask)
+{
+    *dst = (*dst & ~mask) | value;
+}
+
+// Returns a mask with the pixels of a word of 8 pixels that start at x that
+// are inside the range [0, width).
+static uint32_t fontClipMask(int x, int width)
+{
+    int first = (x < 0) ? -x : 0;
+    int last = (x + 8 > width) ? width - x : 8;
+
+    if (first >= last)
+        return 0;
+
+    uint32_t mask = (last == 8) ? UINT32_MAX : ((1u << (last * 4)) - 1);
+    return mask & ~((1u << (first * 4)) - 1);
+}
+
+// Draws a glyph with the top left corner of its bitmap at (px, py). Only the
+// pixels inside the rectangle [left, right) x [top, bottom) are drawn.
+ARM_CODE static void fontDrawGlyph(const FontSurface *s, const FontCacheEntry *e,
+                                   int px, int py, int left, int top,
+                                   int right, int bottom)
+{
+    int y_start = (py < top) ? top - py : 0;
+    int y_end = e->height;
+    if (py + y_end > bottom)
+        y_end = bottom - py;
+
+    if (y_start >= y_end)
+        return;
+
+    // Pixels outside of the rectangle are removed from each column of 8 pixels
+    uint32_t clip[32];
+    int words = e->words;
+    for (int w = 0; w < words; w++)
+        clip[w] = fontClipMask(px + w * 8 - left, right - left);
+
+    const uint32_t *src = e->rows + y_start * words;
+
+    for (int y = py + y_start; y < py + y_end; y++)
+    {
+        for (int w = 0; w < words; w++)
+        {
+            uint32_t v = src[w] & clip[w];
+            if (v == 0)
+                continue;
+
+            int x = px + w * 8;
+
+            if (s->format == FONT_SURFACE_4BPP_TILES)
+            {
+                // A word of the glyph covers up to two rows of tiles
+                int shift = (x & 7) * 4;
+                int tx = x >> 3;
+                vu32 *row = (vu32 *)s->gfx + ((y >> 3) * s->stride + tx) * 8
+                          + (y & 7);
+
+                uint32_t lo = v << shift;
+                if (lo)
+                    fontPut(row, lo, fontNibbleMask(lo));
+
+                if (shift)
+                {
+                    uint32_t hi = v >> (32 - shift);
+                    if (hi)
+                        fontPut(row + 8, hi, fontNibbleMask(hi));
+                }
+            }
+            else if (s->format == FONT_SURFACE_8BPP_TILES)
+            {
+                // Each word of the tile has 4 pixels. A word of the glyph
+                // covers up to 3 of them.
+                uint32_t base = s->color_base * 0x01010101;
+                uint32_t p[3];
+                int shift = (x & 3) * 8;
+
+                uint64_t v64 = fontExpandNibbles(v & 0xFFFF)
+                             | ((uint64_t)fontExpandNibbles(v >> 16) << 32);
+                uint64_t shifted = v64 << shift;
+
+                p[0] = (uint32_t)shifted;
+                p[1] = (uint32_t)(shifted >> 32);
+                p[2] = shift ? (uint32_t)(v64 >> (64 - shift)) : 0;
+
+                int group = x >> 2;
+
+                for (int i = 0; i < 3; i++, group++)
+                {
+                    if (p[i] == 0)
+                        continue;
+
+                    int tx = group >> 1;
+                    vu32 *dst = (vu32 *)s->gfx
+                              + ((y >> 3) * s->stride + tx) * 16
+                              + (y & 7) * 2 + (group & 1);
+
+                    uint32_t mask = fontByteMask(p[i]);
+                    fontPut(dst, (p[i] + base) & mask, mask);
+                }
+            }
+            else
+            {
+                vu16 *dst = (vu16 *)s->gfx + y * s->stride + x;
+                const uint16_t *colors = s->colors;
+
+                for (int i = 0; i < 8; i++, v >>= 4)
+                {
+                    if (v & 0xF)
+                        dst[i] = colors[v & 0xF];
+                }
+            }
+        }
+
+        src += words;
+    }
+}
+
+void fontClearRect(const FontSurface *s, int x, int y, int width, int height)
+{
+    int x_end = x + width;
+    int y_end = y + height;
+
+    if (x < 0)
+        x = 0;
+    if (y < 0)
+        y = 0;
+    if (x_end > s->width)
+        x_end = s->width;
+    if (y_end > s->height)
+        y_end = s->height;
+
+    if ((x >= x_end) || (y >= y_end))
+        return;
+
+    for (int row = y; row < y_end; row++)
+    {
+        if (s->format == FONT_SURFACE_4BPP_TILES)
+        {
+            for (int col = x & ~7; col < x_end; col += 8)
+            {
+                uint32_t mask = fontClipMask(col - x, x_end - x);
+                vu32 *dst = (vu32 *)s->gfx
+                          + ((row >> 3) * s->stride + (col >> 3)) * 8 + (row & 7);
+
+                *dst &= ~mask;
+            }
+        }
+        else if (s->format == FONT_SURFACE_8BPP_TILES)
+        {
+            for (int col = x & ~3; col < x_end; col += 4)
+            {
+                // Reuse the mask of 8 pixels of 4 bits for 4 pixels of 8 bits
+                uint32_t mask = fontExpandNibbles(fontClipMask(col - x, x_end - x)
+                                                  & 0xFFFF) * 0x11;
+                vu32 *dst = (vu32 *)s->gfx
+                          + ((row >> 3) * s->stride + (col >> 3)) * 16
+                          + (row & 7) * 2 + ((col >> 2) & 1);
+
+                *dst &= ~mask;
+            }
+        }
+        else
+        {
+            vu16 *dst = (vu16 *)s->gfx + row * s->stride;
+
+            for (int col = x; col < x_end; col++)
+                dst[col] = 0;
+        }
+    }
+}
+
+void fontMapLinear(u16 *map, int map_width, int x, int y, int width,
+                   int height, int first_tile, int palette)
+{
+    int tile = first_tile;
+
+    for (int ty = y; ty < y + height; ty++)
+    {
+        for (int tx = x; tx < x + width; tx++)
+        {
+            // Maps wider than 32 tiles are made of 32x32 blocks
+            int index = (ty & 31) * 32 + (tx & 31) + (tx >> 5) * 1024
+                      + (ty >> 5) * (map_width / 32) * 1024;
+
+            map[index] = tile++ | (palette << 12);
+        }
+    }
+}
+
+// Text
+// ====
+
+// Returns the pen position after a glyph, and the position of its bitmap.
+static inline int fontAdvance(Font *font, const FontCacheEntry *e, int *prev,
+                              int x, int *draw_x)
+{
+    if (*prev >= 0)
+        x += fontKerning(font, *prev, e->index);
+
+    *prev = e->index;
+    *draw_x = x + e->x_offset;
+
+    return x + e->advance;
+}
+
+int fontTextWidth(Font *font, const char *text)
+{
+    int x = 0;
+    int prev = -1;
+
+    while (1)
+    {
+        char32_t c;
+        int len = utf8_decode_char(text, &c);
+        if (len < 0)
+            return -1;
+
+        if ((c == 0) || (c == '\n'))
+            break;
+
+        text += len;
+
+        const FontCacheEntry *e = fontGetGlyph(font, c);
+        if (e == NULL)
+            continue;
+
+        int draw_x;
+        x = fontAdvance(font, e, &prev, x, &draw_x);
+    }
+
+    return x;
+}
+
+int fontDrawText(Font *font, const FontSurface *surface, int x, int y,
+                 const char *text)
+{
+    int prev = -1;
+
+    while (1)
+    {
+        char32_t c;
+        int len = utf8_decode_char(text, &c);
+        if (len < 0)
+            return -1;
+
+        if ((c == 0) || (c == '\n'))
+            break;
+
+        text += len;
+
+        const FontCacheEntry *e = fontGetGlyph(font, c);
+        if (e == NULL)
+            continue;
+
+        int draw_x;
+        x = fontAdvance(font, e, &prev, x, &draw_x);
+
+        if (e->width > 0)
+        {
+            fontDrawGlyph(surface, e, draw_x, y + e->y_offset, 0, 0,
+                          surface->width, surface->height);
+        }
+    }
+
+    return x;
+}
+
+// Returns the width of the word that starts at the provided text, continuing
+// from the previous glyph.
+static int fontWordWidth(Font *font, const char *text, int prev)
+{
+    int x = 0;
+
+    while (1)
+    {
+        char32_t c;
+        int len = utf8_decode_char(text, &c);
+        if ((len < 0) || (c == 0) || (c == ' ') || (c == '\n'))
+            break;
+
+        text += len;
+
+        const FontCacheEntry *e = fontGetGlyph(font, c);
+        if (e == NULL)
+            continue;
+
+        int draw_x;
+        x = fontAdvance(font, e, &prev, x, &draw_x);
+    }
+
+    return x;
+}
+
+void fontTextBoxInit(FontTextBox *box, Font *font, const FontSurface *surface,
+                     int x, int y, int width, int height)
+{
+    box->font = font;
+    box->surface = *surface;
+    box->x = x;
+    box->y = y;
+    box->width = width;
+    box->height = height;
+    box->lines = 0;
+    box->text = NULL;
+    box->capacity = 0;
+}
+
+void fontTextBoxFree(FontTextBox *box)
+{
+    memTraceFree(box->text);
+    box->text = NULL;
+    box->capacity = 0;
+    box->lines = 0;
+}
+
+void fontTextBoxClear(FontTextBox *box)
+{
+    fontClearRect(&box->surface, box->x, box->y, box->width, box->height);
+
+    box->lines = 0;
+    if (box->text != NULL)
+        box->text[0] = '\0';
+}
+
+// Lays out the text of a text box. Nothing is drawn until the character at
+// offset "redraw" is reached. Then, the line of that character and all the
+// lines after it are cleared and drawn. It returns the number of lines used by
+// the text.
+static int fontTextBoxLayout(FontTextBox *box, const char *text, size_t redraw)
+{
+    Font *font = box->font;
+    int line_height = font->header->line_height;
+    int x = 0;
+    int line = 0;
+    int prev = -1;
+    bool word_start = true;
+    bool drawing = false;
+    const char *p = text;
+    const char *line_start = text;
+
+    // Glyphs are clipped to the box and to the surface
+    const FontSurface *s = &box->surface;
+    int left = (box->x > 0) ? box->x : 0;
+    int top = (box->y > 0) ? box->y : 0;
+    int right = box->x + box->width;
+    int bottom = box->y + box->height;
+    if (right > s->width)
+        right = s->width;
+    if (bottom > s->height)
+        bottom = s->height;
+
+    while (1)
+    {
+        char32_t c;
+        int len = utf8_decode_char(p, &c);
+
+        if (!drawing && ((size_t)(p - text) >= redraw))
+        {
+            // Glyphs may overlap the ones next to them, so the whole line is
+            // redrawn, not only the changed word. The layout of a line doesn't
+            // depend on the previous lines, so it restarts from its start.
+            if (line < box->lines)
+            {
+                fontClearRect(s, box->x, box->y + line * line_height,
+                              box->width, (box->lines - line) * line_height);
+            }
+
+            drawing = true;
+            p = line_start;
+            x = 0;
+            prev = -1;
+            word_start = true;
+            continue;
+        }
+
+        if (c == 0)
+            break;
+
+        p += len;
+
+        if (c == '\n')
+        {
+            x = 0;
+            line++;
+            prev = -1;
+            word_start = true;
+            line_start = p;
+            continue;
+        }
+
+        if (c == ' ')
+        {
+            word_start = true;
+        }
+        else if (word_start)
+        {
+            word_start = false;
+
+            // Move the whole word to the next line if it doesn't fit
+            if ((x > 0) && (x + fontWordWidth(font, p - len, prev) > box->width))
+            {
+                x = 0;
+                line++;
+                prev = -1;
+                line_start = p - len;
+            }
+        }
+
+        const FontCacheEntry *e = fontGetGlyph(font, c);
+        if (e == NULL)
+            continue;
+
+        // Words longer than a line are split at any character
+        if ((c != ' ') && (x > 0) && (x + e->advance > box->width))
+        {
+            x = 0;
+            line++;
+            prev = -1;
+            line_start = p - len;
+        }
+
+        int draw_x;
+        x = fontAdvance(font, e, &prev, x, &draw_x);
+
+        if (!drawing || (e->width == 0))
+            continue;
+
+        if ((line + 1) * line_height > box->height)
+            continue;
+
+        fontDrawGlyph(&box->surface, e, box->x + draw_x,
+                      box->y + line * line_height + e->y_offset,
+                      left, top, right, bottom);
+    }
+
+    return line + 1;
+}
+
+bool fontTextBoxSet(FontTextBox *box, const char *text)
+{
+    int line_height = box->font->header->line_height;
+    int max_lines = box->height / line_height;
+
+    // Validate the string before drawing anything
+    size_t size = 0;
+    while (1)
+    {
+        char32_t c;
+        int len = utf8_decode_char(text + size, &c);
+        if (len < 0)
+            return false;
+
+        size += len;
+
+        if (c == 0)
+            break;
+    }
+
+    // Find the first word that has changed. Everything before it is laid out
+    // in the same way as before.
+    size_t redraw = 0;
+    if (box->text != NULL)
+    {
+        while ((redraw < size) && (box->text[redraw] == text[redraw]) &&
+               (text[redraw] != '\0'))
+            redraw++;
+
+        if ((text[redraw] == '\0') && (box->text[redraw] == '\0'))
+            return true;
+
+        while ((redraw > 0) && (text[redraw - 1] != ' ') &&
+               (text[redraw - 1] != '\n'))
+            redraw--;
+    }
+
+    int lines = fontTextBoxLayout(box, text, redraw);
+
+    box->lines = (size > 1) ? lines : 0;
+    if (box->lines > max_lines)
+        box->lines = max_lines;
+
+    if (size > box->capacity)
+    {
+        char *buffer = memTraceRealloc(box->text, size, MEMTRACE_TAG_FONT);
+        if (buffer == NULL)
+        {
+            // Force a full redraw next time
+            memTraceFree(box->text);
+            box->text = NULL;
+            box->capacity = 0;
+            box->lines = max_lines;
+            return false;
+        }
+
+        box->text = buffer;
+        box->capacity = size;
+    }
+
+    memcpy(box->text, text, size);
+
+    return true;
+}
@@ -2,13 +2,18 @@
 //
 // Copyright (c) 2024 Antonio Niño Díaz
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <nds/arm9/cache.h>
 #include <nds/arm9/grf.h>
 #include <nds/decompress.h>
+#include <nds/dma.h>
+#include <nds/memtrace.h>
+#include <nds/system.h>
 
 // General file structure:
 //
@@ -45,6 +50,119 @@ typedef struct
 #define ID_MMAP     CHUNK_ID('M', 'M', 'A', 'P')
 #define ID_PAL      CHUNK_ID('P', 'A', 'L', ' ')
 
+// Kinds of chunks that can be extracted from a GRF file
+typedef enum
+{
+    GRF_CHUNK_GFX,
+    GRF_CHUNK_MAP,
+    GRF_CHUNK_PAL,
+    GRF_CHUNK_MTIL,
+    GRF_CHUNK_MMAP,
+
+    GRF_CHUNK_COUNT
+} GRFChunkType;
+
+// Destinations of all the chunks of a GRF file
+typedef struct
+{
+    // Pointers to the destination pointers provided by the caller. If
+    // "vram" is false and a destination pointer is NULL, the buffer is
+    // allocated by the loader.
+    void **dst[GRF_CHUNK_COUNT];
+    size_t *size[GRF_CHUNK_COUNT];
+
+    bool vram;          // Destinations are in VRAM or palette RAM
+    unsigned int flags; // GRF_VRAM_* flags
+} GRFTargets;
+
+static int grf_chunk_type(uint32_t id)
+{
+    switch (id)
+    {
+        case ID_GFX:
+            return GRF_CHUNK_GFX;
+        case ID_MAP:
+            return GRF_CHUNK_MAP;
+        case ID_PAL:
+            return GRF_CHUNK_PAL;
+        case ID_MTIL:
+            return GRF_CHUNK_MTIL;
+        case ID_MMAP:
+            return GRF_CHUNK_MMAP;
+        default:
+            return -1;
+    }
+}
+
+// Special values returned by grf_decompress_type()
+#define GRF_TYPE_UNCOMPRESSED   -1
+#define GRF_TYPE_UNKNOWN        -2
+
+// Returns the DecompressType that needs to be used to decompress a chunk with
+// the specified header. All types are VRAM-safe.
+static int grf_decompress_type(uint32_t header)
+{
+    switch (header & 0xF0)
+    {
+        case 0x00: // No compression
+            return GRF_TYPE_UNCOMPRESSED;
+        case 0x10: // LZ77
+            return LZ77Vram;
+        case 0x20: // Huffman
+            return HUFF;
+        case 0x30: // RLE
+            return RLEVram;
+        case DECOMPRESS_TYPE_LZ16:
+            return LZ16;
+        default:
+            return GRF_TYPE_UNKNOWN;
+    }
+}
+
+// Size of the buffer used to copy uncompressed data from a file to VRAM
+#define GRF_VRAM_STAGING_SIZE 1024
+
+// Used by GRF_VRAM_PAL_WAIT_VBLANK. It returns right away if the vertical
+// blanking period has already started.
+static void grf_wait_vblank(void)
+{
+    while ((REG_DISPSTAT & DISP_IN_VBLANK) == 0);
+}
+
+// Copies data to VRAM or palette RAM, which don't support 8-bit writes. The
+// source must be in main RAM.
+static void grf_copy_vram(void *dst, const void *src, size_t size)
+{
+    size_t size16 = size & ~1;
+
+    if (size16 > 0)
+    {
+        if ((((uintptr_t)src | (uintptr_t)dst) & 1) == 0)
+        {
+            // DMA reads from main RAM, not from the data cache
+            DC_FlushRange(src, size16);
+
+            if ((((uintptr_t)src | (uintptr_t)dst | size16) & 3) == 0)
+                dmaCopyWords(3, src, dst, size16);
+            else
+                dmaCopyHalfWords(3, src, dst, size16);
+        }
+        else
+        {
+            const uint8_t *s = src;
+            uint16_t *d = dst;
+            for (size_t i = 0; i < size16; i += 2)
+                *d++ = s[i] | (s[i + 1] << 8);
+        }
+    }
+
+    if (size & 1)
+    {
+        uint16_t *last = (uint16_t *)((uintptr_t)dst + size16);
+        *last = (*last & 0xFF00) | ((const uint8_t *)src)[size16];
+    }
+}
+
 // Extracts a GRF item
 static GRFError grfExtract(const void *src, void **dst, size_t *sz)
 {
@@ -57,42 +175,96 @@ static GRFError grfExtract(const void *src, void **dst, size_t *sz)
     uint32_t header = *(const uint32_t *)src;
     uint32_t size = header >> 8;
 
+    int type = grf_decompress_type(header);
+    if (type == GRF_TYPE_UNKNOWN)
+        return GRF_UNKNOWN_COMPRESSION;
+
     if (sz != NULL)
         *sz = size;
 
     // If the user has already provided a pointer, use it. If not, allocate mem
+    bool allocated = false;
     if (*dst == NULL)
     {
-        *dst = malloc(size);
+        *dst = memTraceMalloc(size, MEMTRACE_TAG_GRF);
         if (*dst == NULL)
             return GRF_NOT_ENOUGH_MEMORY;
+        allocated = true;
     }
 
-    switch (header & 0xF0)
+    if (type == GRF_TYPE_UNCOMPRESSED)
     {
-        case 0x00: // No compression
-            memcpy(*dst, (const uint8_t *)src + 4, size);
-            return GRF_NO_ERROR;
-        case 0x10: // LZ77
-            decompress(src, *dst, LZ77Vram);
-            return GRF_NO_ERROR;
-        case 0x20: // Huffman
-            decompress(src, *dst, HUFF);
-            return GRF_NO_ERROR;
-        case 0x30: // RLE
-            decompress(src, *dst, RLEVram);
-            return GRF_NO_ERROR;
-        default:
-            return GRF_UNKNOWN_COMPRESSION;
+        memcpy(*dst, (const uint8_t *)src + 4, size);
     }
+    else if (decompressSoftware(src, *dst, type) < 0)
+    {
+        if (allocated)
+        {
+            memTraceFree(*dst);
+            *dst = NULL;
+        }
+        return GRF_INVALID_DATA;
+    }
+
+    return GRF_NO_ERROR;
 }
 
-GRFError grfLoadMemEx(const void *src, GRFHeader *header,
-                      void **gfxDst, size_t *gfxSize,
-                      void **mapDst, size_t *mapSize,
-                      void **palDst, size_t *palSize,
-                      void **mtilDst, size_t *mtilSize,
-                      void **mmapDst, size_t *mmapSize)
+// Extracts a GRF item to VRAM or palette RAM
+static GRFError grfExtractVram(const void *src, void *dst, size_t *sz,
+                               bool vblank)
+{
+    if ((src == NULL) || (dst == NULL))
+        return GRF_NULL_POINTER;
+
+    uint32_t header = *(const uint32_t *)src;
+    uint32_t size = header >> 8;
+
+    int type = grf_decompress_type(header);
+    if (type == GRF_TYPE_UNKNOWN)
+        return GRF_UNKNOWN_COMPRESSION;
+
+    if (sz != NULL)
+        *sz = size;
+
+    if (type == GRF_TYPE_UNCOMPRESSED)
+    {
+        if (vblank)
+            grf_wait_vblank();
+
+        grf_copy_vram(dst, (const uint8_t *)src + 4, size);
+        return GRF_NO_ERROR;
+    }
+
+    if (!vblank)
+    {
+        // All the decompression types used by GRF files are VRAM-safe
+        if (decompressSoftware(src, dst, type) < 0)
+            return GRF_INVALID_DATA;
+        return GRF_NO_ERROR;
+    }
+
+    // Decompress to RAM so that the data can be copied quickly during VBlank
+
+    void *tmp = memTraceMalloc(size, MEMTRACE_TAG_GRF);
+    if (tmp == NULL)
+        return GRF_NOT_ENOUGH_MEMORY;
+
+    if (decompressSoftware(src, tmp, type) < 0)
+    {
+        memTraceFree(tmp);
+        return GRF_INVALID_DATA;
+    }
+
+    grf_wait_vblank();
+    grf_copy_vram(dst, tmp, size);
+
+    memTraceFree(tmp);
+
+    return GRF_NO_ERROR;
+}
+
+static GRFError grfLoadMemInternal(const void *src, GRFHeader *header,
+                                   GRFTargets *targets)
 {
     if (src == NULL)
         return GRF_NULL_POINTER;
@@ -128,38 +300,35 @@ GRFError grfLoadMemEx(const void *src, GRFHeader *header,
 
         ptr += size + 8;
 
-        GRFError ret = GRF_NO_ERROR;
-
-        switch (id)
+        if (id == ID_HDRX)
         {
-            case ID_HDRX:
-                if (size != sizeof(GRFHeader))
-                    return GRF_INCONSISTENT_SIZES;
+            if (size != sizeof(GRFHeader))
+                return GRF_INCONSISTENT_SIZES;
+            if (header)
                 memcpy(header, data, size);
-                break;
-            case ID_GFX:
-                if (gfxDst)
-                    ret = grfExtract(data, gfxDst, gfxSize);
-                break;
-            case ID_MAP:
-                if (mapDst)
-                    ret = grfExtract(data, mapDst, mapSize);
-                break;
-            case ID_MTIL:
-                if (mtilDst)
-                    ret = grfExtract(data, mtilDst, mtilSize);
-                break;
-            case ID_MMAP:
-                if (mmapDst)
-                    ret = grfExtract(data, mmapDst, mmapSize);
-                break;
-            case ID_PAL:
-                if (palDst)
-                    ret = grfExtract(data, palDst, palSize);
-                break;
-            default:
-                // Ignore unknown chunks rather than failing
-                break;
+            continue;
+        }
+
+        // Ignore unknown chunks rather than failing
+        int type = grf_chunk_type(id);
+        if (type < 0)
+            continue;
+
+        void **dst = targets->dst[type];
+        if (dst == NULL)
+            continue;
+
+        GRFError ret;
+
+        if (targets->vram)
+        {
+            bool vblank = (type == GRF_CHUNK_PAL) &&
+                          (targets->flags & GRF_VRAM_PAL_WAIT_VBLANK);
+            ret = grfExtractVram(data, *dst, targets->size[type], vblank);
+        }
+        else
+        {
+            ret = grfExtract(data, dst, targets->size[type]);
         }
 
         if (ret != GRF_NO_ERROR)
@@ -169,6 +338,47 @@ GRFError grfLoadMemEx(const void *src, GRFHeader *header,
     return GRF_NO_ERROR;
 }
 
+GRFError grfLoadMemEx(const void *src, GRFHeader *header,
+                      void **gfxDst, size_t *gfxSize,
+                      void **mapDst, size_t *mapSize,
+                      void **palDst, size_t *palSize,
+                      void **mtilDst, size_t *mtilSize,
+                      void **mmapDst, size_t *mmapSize)
+{
+    GRFTargets targets = {
+        .dst = { gfxDst, mapDst, palDst, mtilDst, mmapDst },
+        .size = { gfxSize, mapSize, palSize, mtilSize, mmapSize },
+        .vram = false,
+        .flags = 0
+    };
+
+    return grfLoadMemInternal(src, header, &targets);
+}
+
+GRFError grfLoadMemVramEx(const void *src, GRFHeader *header,
+                          void *gfxDst, size_t *gfxSize,
+                          void *mapDst, size_t *mapSize,
+                          void *palDst, size_t *palSize,
+                          void *mtilDst, size_t *mtilSize,
+                          void *mmapDst, size_t *mmapSize,
+                          unsigned int flags)
+{
+    GRFTargets targets = {
+        .dst = {
+            gfxDst ? &gfxDst : NULL,
+            mapDst ? &mapDst : NULL,
+            palDst ? &palDst : NULL,
+            mtilDst ? &mtilDst : NULL,
+            mmapDst ? &mmapDst : NULL
+        },
+        .size = { gfxSize, mapSize, palSize, mtilSize, mmapSize },
+        .vram = true,
+        .flags = flags
+    };
+
+    return grfLoadMemInternal(src, header, &targets);
+}
+
 GRFError grfLoadMem(const void *src, GRFHeader *header,
                     void **gfxDst, size_t *gfxSize,
                     void **mapDst, size_t *mapSize,
@@ -178,11 +388,65 @@ GRFError grfLoadMem(const void *src, GRFHeader *header,
                         palDst, palSize, NULL, NULL, NULL, NULL);
 }
 
+// State of a compressed chunk that is being read from a file. The compressed
+// data is never loaded to RAM at once, it is read in small blocks by the
+// decompression routine as it needs it.
+typedef struct
+{
+    FILE       *file;
+    uint32_t    header;      // Header of the compressed data (already read)
+    bool        header_sent; // Set after the header is passed to the decoder
+    bool        read_error;  // Set if fread() fails
+    size_t      remaining;   // Bytes of the chunk that haven't been read yet
+} GRFFileStream;
+
+static size_t grf_file_stream_read(void *buffer, size_t size, void *arg)
+{
+    GRFFileStream *s = arg;
+
+    // The decoder expects to find the header at the start of the stream. The
+    // buffer is always big enough to hold it.
+    if (!s->header_sent)
+    {
+        memcpy(buffer, &s->header, sizeof(s->header));
+        s->header_sent = true;
+        return sizeof(s->header);
+    }
+
+    if (size > s->remaining)
+        size = s->remaining;
+
+    if (size == 0)
+        return 0;
+
+    if (fread(buffer, 1, size, s->file) != size)
+    {
+        s->read_error = true;
+        return 0;
+    }
+
+    s->remaining -= size;
+
+    return size;
+}
+
+// Decompresses a chunk from a file. The error is GRF_FILE_NOT_READ if the file
+// couldn't be read, or GRF_INVALID_DATA if the compressed data is corrupted or
+// the chunk ends before the end of the compressed data.
+static GRFError grf_file_stream_decompress(GRFFileStream *stream, void *dst,
+                                           int type)
+{
+    if (decompressSoftwareStream(dst, type, grf_file_stream_read, stream) >= 0)
+        return GRF_NO_ERROR;
+
+    return stream->read_error ? GRF_FILE_NOT_READ : GRF_INVALID_DATA;
+}
+
 // Extracts a GRF item from a FILE pointer
 static GRFError grfExtractFile(FILE *file, size_t chunk_size,
                                void **dst, size_t *sz)
 {
-    if ((file == NULL) || (chunk_size == 0) || (dst == NULL))
+    if ((file == NULL) || (chunk_size < 4) || (dst == NULL))
         return GRF_NULL_POINTER;
 
     // The header of this data is the header used for all GBA/NDS BIOS
@@ -196,68 +460,186 @@ static GRFError grfExtractFile(FILE *file, size_t chunk_size,
 
     uint32_t size = header >> 8;
 
+    int type = grf_decompress_type(header);
+    if (type == GRF_TYPE_UNKNOWN)
+        return GRF_UNKNOWN_COMPRESSION;
+
     // Allocate destination buffer
     if (sz != NULL)
         *sz = size;
 
+    GRFFileStream stream = {
+        .file = file,
+        .header = header,
+        .header_sent = false,
+        .read_error = false,
+        .remaining = chunk_size - 4
+    };
+
+    if ((type == GRF_TYPE_UNCOMPRESSED) && (size > stream.remaining))
+        return GRF_INCONSISTENT_SIZES;
+
     // If the user has already provided a pointer, use it. If not, allocate mem
+    bool allocated = false;
     if (*dst == NULL)
     {
-        *dst = malloc(size);
+        *dst = memTraceMalloc(size, MEMTRACE_TAG_GRF);
         if (*dst == NULL)
             return GRF_NOT_ENOUGH_MEMORY;
+        allocated = true;
     }
 
-    if ((header & 0xF0) == 0x00)
+    GRFError err = GRF_NO_ERROR;
+
+    if (type == GRF_TYPE_UNCOMPRESSED)
     {
         // No compression. Read the data to the destination buffer
-        if (fread(*dst, 1, chunk_size - 4, file) != (chunk_size - 4))
-            return GRF_FILE_NOT_READ;
+        if (fread(*dst, 1, size, file) != size)
+            err = GRF_FILE_NOT_READ;
 
-        return GRF_NO_ERROR;
+        stream.remaining -= size;
+    }
+    else
+    {
+        // Stream the compressed data from the file to the decompression
+        // routine. The data in the file is read as it's needed.
+        err = grf_file_stream_decompress(&stream, *dst, type);
     }
 
-    // Allocate temporary buffer to hold the compressed contents of the file
+    // Skip any padding at the end of the chunk
+    if ((err == GRF_NO_ERROR) && (stream.remaining > 0))
+    {
+        if (fseek(file, stream.remaining, SEEK_CUR) != 0)
+            err = GRF_FILE_NOT_READ;
+    }
 
-    uint32_t *tmp = malloc(chunk_size);
-    if (tmp == NULL)
-        return GRF_NOT_ENOUGH_MEMORY;
+    if ((err != GRF_NO_ERROR) && allocated)
+    {
+        memTraceFree(*dst);
+        *dst = NULL;
+    }
 
-    // We have already read the header. Read the rest of the chunk.
-    *tmp = header;
-    if (fread(tmp + 1, 1, chunk_size - 4, file) != (chunk_size - 4))
+    return err;
+}
+
+// Extracts a GRF item from a FILE pointer to VRAM or palette RAM
+static GRFError grfExtractFileVram(FILE *file, size_t chunk_size,
+                                   void *dst, size_t *sz, bool vblank)
+{
+    if ((file == NULL) || (chunk_size < 4) || (dst == NULL))
+        return GRF_NULL_POINTER;
+
+    uint32_t header;
+
+    if (fread(&header, sizeof(header), 1, file) != 1)
         return GRF_FILE_NOT_READ;
 
+    uint32_t size = header >> 8;
+
+    int type = grf_decompress_type(header);
+    if (type == GRF_TYPE_UNKNOWN)
+        return GRF_UNKNOWN_COMPRESSION;
+
+    if (sz != NULL)
+        *sz = size;
+
+    GRFFileStream stream = {
+        .file = file,
+        .header = header,
+        .header_sent = false,
+        .read_error = false,
+        .remaining = chunk_size - 4
+    };
+
+    if ((type == GRF_TYPE_UNCOMPRESSED) && (size > stream.remaining))
+        return GRF_INCONSISTENT_SIZES;
+
     GRFError err = GRF_NO_ERROR;
 
-    switch (header & 0xF0)
+    if (vblank)
     {
-        case 0x10: // LZ77
-            decompress(tmp, *dst, LZ77Vram);
-            break;
-        case 0x20: // Huffman
-            decompress(tmp, *dst, HUFF);
-            break;
-        case 0x30: // RLE
-            decompress(tmp, *dst, RLEVram);
-            break;
-        default:
-            err = GRF_UNKNOWN_COMPRESSION;
-            break;
+        // Load the whole chunk to RAM so that it can be copied quickly during
+        // VBlank. This is only used for palettes, which are small.
+
+        void *tmp = memTraceMalloc(size, MEMTRACE_TAG_GRF);
+        if (tmp == NULL)
+            return GRF_NOT_ENOUGH_MEMORY;
+
+        if (type == GRF_TYPE_UNCOMPRESSED)
+        {
+            if (fread(tmp, 1, size, file) != size)
+                err = GRF_FILE_NOT_READ;
+            stream.remaining -= size;
+        }
+        else
+        {
+            err = grf_file_stream_decompress(&stream, tmp, type);
+        }
+
+        if (err == GRF_NO_ERROR)
+        {
+            grf_wait_vblank();
+            grf_copy_vram(dst, tmp, size);
+        }
+
+        memTraceFree(tmp);
     }
+    else if (type == GRF_TYPE_UNCOMPRESSED)
+    {
+        // fread() may use 8-bit writes, so the data is read to a small buffer
+        // in main RAM and copied from there with DMA.
 
-    // Free the temporary buffer
-    free(tmp);
+        uint8_t *staging = memTraceMalloc(GRF_VRAM_STAGING_SIZE,
+                                          MEMTRACE_TAG_GRF);
+        if (staging == NULL)
+            return GRF_NOT_ENOUGH_MEMORY;
 
-    return err;
+        uint8_t *out = dst;
+        size_t left = size;
+
+        while (left > 0)
+        {
+            size_t block = left;
+            if (block > GRF_VRAM_STAGING_SIZE)
+                block = GRF_VRAM_STAGING_SIZE;
+
+            if (fread(staging, 1, block, file) != block)
+            {
+                err = GRF_FILE_NOT_READ;
+                break;
+            }
+
+            grf_copy_vram(out, staging, block);
+
+            out += block;
+            left -= block;
+        }
+
+        stream.remaining -= size;
+
+        memTraceFree(staging);
+    }
+    else
+    {
+        // All the decompression types used by GRF files are VRAM-safe
+        err = grf_file_stream_decompress(&stream, dst, type);
+    }
+
+    if (err != GRF_NO_ERROR)
+        return err;
+
+    // Skip any padding at the end of the chunk
+    if (stream.remaining > 0)
+    {
+        if (fseek(file, stream.remaining, SEEK_CUR) != 0)
+            return GRF_FILE_NOT_READ;
+    }
+
+    return GRF_NO_ERROR;
 }
 
-GRFError grfLoadFileEx(FILE *file, GRFHeader *header,
-                       void **gfxDst, size_t *gfxSize,
-                       void **mapDst, size_t *mapSize,
-                       void **palDst, size_t *palSize,
-                       void **mtilDst, size_t *mtilSize,
-                       void **mmapDst, size_t *mmapSize)
+static GRFError grfLoadFileInternal(FILE *file, GRFHeader *header,
+                                    GRFTargets *targets)
 {
     if (file == NULL)
         return GRF_NULL_POINTER;
@@ -302,80 +684,44 @@ GRFError grfLoadFileEx(FILE *file, GRFHeader *header,
 
         GRFError ret = GRF_NO_ERROR;
 
-        switch (id)
+        if (id == ID_HDRX)
         {
-            case ID_HDRX:
-                if (size != sizeof(GRFHeader))
-                    return GRF_INCONSISTENT_SIZES;
+            if (size != sizeof(GRFHeader))
+                return GRF_INCONSISTENT_SIZES;
+
+            if (header)
+            {
                 if (fread(header, sizeof(GRFHeader), 1, file) != 1)
                     return GRF_FILE_NOT_READ;
-                break;
-
-            case ID_GFX:
-                if (gfxDst)
-                {
-                    ret = grfExtractFile(file, size, gfxDst, gfxSize);
-                }
-                else
-                {
-                    if (fseek(file, size, SEEK_CUR) != 0)
-                        ret = GRF_FILE_NOT_READ;
-                }
-                break;
-
-            case ID_MAP:
-                if (mapDst)
-                {
-                    ret = grfExtractFile(file, size, mapDst, mapSize);
-                }
-                else
-                {
-                    if (fseek(file, size, SEEK_CUR) != 0)
-                        ret = GRF_FILE_NOT_READ;
-                }
-                break;
-
-            case ID_MTIL:
-                if (mtilDst)
-                {
-                    ret = grfExtractFile(file, size, mtilDst, mtilSize);
-                }
-                else
-                {
-                    if (fseek(file, size, SEEK_CUR) != 0)
-                        ret = GRF_FILE_NOT_READ;
-                }
-                break;
-
-            case ID_MMAP:
-                if (mmapDst)
-                {
-                    ret = grfExtractFile(file, size, mmapDst, mmapSize);
-                }
-                else
-                {
-                    if (fseek(file, size, SEEK_CUR) != 0)
-                        ret = GRF_FILE_NOT_READ;
-                }
-                break;
+            }
+            else
+            {
+                if (fseek(file, size, SEEK_CUR) != 0)
+                    return GRF_FILE_NOT_READ;
+            }
+            continue;
+        }
 
-            case ID_PAL:
-                if (palDst)
-                {
-                    ret = grfExtractFile(file, size, palDst, palSize);
-                }
-                else
-                {
-                    if (fseek(file, size, SEEK_CUR) != 0)
-                        ret = GRF_FILE_NOT_READ;
-                }
-                break;
+        int type = grf_chunk_type(id);
+        void **dst = (type < 0) ? NULL : targets->dst[type];
 
-            default:
-                // Ignore unknown chunks rather than failing
-                if (fseek(file, size, SEEK_CUR) != 0)
-                    ret = GRF_FILE_NOT_READ;
-                break;
+        if (dst == NULL)
+        {
+            // Skip chunks that aren't needed, and ignore unknown chunks rather
+            // than failing
+            if (fseek(file, size, SEEK_CUR) != 0)
+                ret = GRF_FILE_NOT_READ;
+        }
+        else if (targets->vram)
+        {
+            bool vblank = (type == GRF_CHUNK_PAL) &&
+                          (targets->flags & GRF_VRAM_PAL_WAIT_VBLANK);
+            ret = grfExtractFileVram(file, size, *dst, targets->size[type],
+                                     vblank);
+        }
+        else
+        {
+            ret = grfExtractFile(file, size, dst, targets->size[type]);
         }
 
         if (ret != GRF_NO_ERROR)
@@ -385,6 +731,47 @@ GRFError grfLoadFileEx(FILE *file, GRFHeader *header,
     return GRF_NO_ERROR;
 }
 
+GRFError grfLoadFileEx(FILE *file, GRFHeader *header,
+                       void **gfxDst, size_t *gfxSize,
+                       void **mapDst, size_t *mapSize,
+                       void **palDst, size_t *palSize,
+                       void **mtilDst, size_t *mtilSize,
+                       void **mmapDst, size_t *mmapSize)
+{
+    GRFTargets targets = {
+        .dst = { gfxDst, mapDst, palDst, mtilDst, mmapDst },
+        .size = { gfxSize, mapSize, palSize, mtilSize, mmapSize },
+        .vram = false,
+        .flags = 0
+    };
+
+    return grfLoadFileInternal(file, header, &targets);
+}
+
+GRFError grfLoadFileVramEx(FILE *file, GRFHeader *header,
+                           void *gfxDst, size_t *gfxSize,
+                           void *mapDst, size_t *mapSize,
+                           void *palDst, size_t *palSize,
+                           void *mtilDst, size_t *mtilSize,
+                           void *mmapDst, size_t *mmapSize,
+                           unsigned int flags)
+{
+    GRFTargets targets = {
+        .dst = {
+            gfxDst ? &gfxDst : NULL,
+            mapDst ? &mapDst : NULL,
+            palDst ? &palDst : NULL,
+            mtilDst ? &mtilDst : NULL,
+            mmapDst ? &mmapDst : NULL
+        },
+        .size = { gfxSize, mapSize, palSize, mtilSize, mmapSize },
+        .vram = true,
+        .flags = flags
+    };
+
+    return grfLoadFileInternal(file, header, &targets);
+}
+
 GRFError grfLoadFile(FILE *file, GRFHeader *header,
                      void **gfxDst, size_t *gfxSize,
                      void **mapDst, size_t *mapSize,
@@ -426,3 +813,29 @@ GRFError grfLoadPath(const char *path, GRFHeader *header,
     return grfLoadPathEx(path, header, gfxDst, gfxSize, mapDst, mapSize,
                          palDst, palSize, NULL, NULL, NULL, NULL);
 }
+
+GRFError grfLoadPathVramEx(const char *path, GRFHeader *header,
+                           void *gfxDst, size_t *gfxSize,
+                           void *mapDst, size_t *mapSize,
+                           void *palDst, size_t *palSize,
+                           void *mtilDst, size_t *mtilSize,
+                           void *mmapDst, size_t *mmapSize,
+                           unsigned int flags)
+{
+    if (path == NULL)
+        return GRF_NULL_POINTER;
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return GRF_FILE_NOT_OPENED;
+
+    GRFError ret = grfLoadFileVramEx(file, header, gfxDst, gfxSize,
+                                     mapDst, mapSize, palDst, palSize,
+                                     mtilDst, mtilSize, mmapDst, mmapSize,
+                                     flags);
+
+    if (fclose(file) != 0)
+        return GRF_FILE_NOT_CLOSED;
+
+    return ret;
+}
@@ -5,86 +5,175 @@
 // Copyright (C) 2005 Jason Rogers (dovoto)
 // Copyright (C) 2005 Dave Murphy (WinterMute)
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <nds/arm9/image.h>
 #include <nds/arm9/sassert.h>
 #include <nds/dma.h>
+#include <nds/memtrace.h>
 #include <nds/ndstypes.h>
 
 #define ALPHA_BIT_ARGB16 (1u << 15)
 
-bool image24to16(sImage *img)
+// Converts the lowest 24 bits of a value with R, G and B bytes to ARGB16.
+#define RGB24_TO_ARGB16(v) \
+    (ALPHA_BIT_ARGB16 | (((v) >> 3) & 0x1F) | (((v) >> 6) & (0x1F << 5)) \
+     | (((v) >> 9) & (0x1F << 10)))
+
+ARM_CODE void imageConvert24to16(u16 *dst, const u8 *src, size_t count)
 {
-    u16 *temp = malloc(img->height * img->width * sizeof(u16));
-    if (temp == NULL)
-        return false;
+    // Convert 4 pixels at a time: 3 words are read and 2 words are written.
+    // The destination never overtakes the source, so they can be the same.
+    if ((((uintptr_t)dst | (uintptr_t)src) & 3) == 0)
+    {
+        const u32 *s = (const u32 *)src;
+        u32 *d = (u32 *)dst;
+
+        while (count >= 4)
+        {
+            u32 w0 = s[0]; // R0 G0 B0 R1
+            u32 w1 = s[1]; // G1 B1 R2 G2
+            u32 w2 = s[2]; // B2 R3 G3 B3
+            s += 3;
+
+            u32 p0 = RGB24_TO_ARGB16(w0);
+            u32 p1 = RGB24_TO_ARGB16((w0 >> 24) | (w1 << 8));
+            u32 p2 = RGB24_TO_ARGB16((w1 >> 16) | (w2 << 16));
+            u32 p3 = RGB24_TO_ARGB16(w2 >> 8);
+
+            d[0] = p0 | (p1 << 16);
+            d[1] = p2 | (p3 << 16);
+            d += 2;
+
+            count -= 4;
+        }
+
+        src = (const u8 *)s;
+        dst = (u16 *)d;
+    }
+
+    while (count > 0)
+    {
+        *dst++ = RGB24_TO_ARGB16(src[0] | (src[1] << 8) | (src[2] << 16));
+        src += 3;
+        count--;
+    }
+}
+
+ARM_CODE static void image8to16Lut(u16 *dst, const u8 *src, const u16 *lut,
+                                   size_t count)
+{
+    // Convert from the end so that the destination can start at the same
+    // address as the source (the source is never overwritten before reading it)
+    while (count & 3)
+    {
+        count--;
+        dst[count] = lut[src[count]];
+    }
 
-    for (int y = 0; y < img->height; y++)
+    if (((uintptr_t)dst | (uintptr_t)src) & 3)
     {
-        for (int x = 0; x < img->width; x++)
+        while (count > 0)
         {
-            temp[x + y * img->width] =
-                ALPHA_BIT_ARGB16
-                | RGB15(img->image.data8[x * 3 + y * img->width * 3] >> 3,
-                        img->image.data8[x * 3 + y * img->width * 3 + 1] >> 3,
-                        img->image.data8[x * 3 + y * img->width * 3 + 2] >> 3);
+            count--;
+            dst[count] = lut[src[count]];
         }
+        return;
     }
 
-    free(img->image.data8);
+    const u32 *s = (const u32 *)(src + count);
+    u32 *d = (u32 *)(dst + count);
 
-    img->bpp = 16;
-    img->image.data16 = temp;
+    while (count > 0)
+    {
+        u32 p = *--s;
 
-    return true;
+        d -= 2;
+        d[1] = lut[(p >> 16) & 0xFF] | ((u32)lut[p >> 24] << 16);
+        d[0] = lut[p & 0xFF] | ((u32)lut[(p >> 8) & 0xFF] << 16);
+
+        count -= 4;
+    }
 }
 
-bool image8to16(sImage *img)
+void imageConvert8to16(u16 *dst, const u8 *src, const u16 *palette,
+                       size_t count, int transparentColor)
 {
-    sassert(img->bpp == 8, "image must be 8 bpp");
-    sassert(img->palette != NULL, "image must have a palette set");
+    // Apply the alpha bit to the palette once instead of once per pixel
+    u16 lut[256];
 
-    u16 *temp = malloc(img->height * img->width * sizeof(u16));
-    if (temp == NULL)
-        return false;
+    for (int i = 0; i < 256; i++)
+        lut[i] = palette[i] | ALPHA_BIT_ARGB16;
 
-    for (int i = 0; i < img->height * img->width; i++)
-        temp[i] = img->palette[img->image.data8[i]] | ALPHA_BIT_ARGB16;
+    if ((transparentColor >= 0) && (transparentColor < 256))
+        lut[transparentColor] = palette[transparentColor];
 
-    free(img->image.data8);
-    free(img->palette);
+    image8to16Lut(dst, src, lut, count);
+}
 
-    img->palette = NULL;
+ARM_CODE void imageTile8(void *dst, const void *src, int width, int height)
+{
+    const int stride = width >> 2; // In words
+    u32 *d = dst;
+
+    for (int ty = 0; ty < (height >> 3); ty++)
+    {
+        const u32 *band = (const u32 *)src + ty * 8 * stride;
+
+        for (int tx = 0; tx < (width >> 3); tx++)
+        {
+            const u32 *s = band + tx * 2;
+
+            for (int iy = 0; iy < 8; iy++)
+            {
+                d[0] = s[0];
+                d[1] = s[1];
+                d += 2;
+                s += stride;
+            }
+        }
+    }
+}
+
+bool image24to16(sImage *img)
+{
+    size_t count = img->height * img->width;
+
+    // The conversion is done in place. Shrinking the buffer afterwards can't
+    // fail, and if it does the old buffer is still valid.
+    imageConvert24to16(img->image.data16, img->image.data8, count);
+
+    u16 *temp = memTraceRealloc(img->image.data16, count * sizeof(u16),
+                                MEMTRACE_TAG_IMAGE);
+    if (temp != NULL)
+        img->image.data16 = temp;
 
     img->bpp = 16;
-    img->image.data16 = temp;
 
     return true;
 }
 
-bool image8to16trans(sImage *img, u8 transparentColor)
+static bool image8to16Common(sImage *img, int transparentColor)
 {
     sassert(img->bpp == 8, "image must be 8 bpp");
     sassert(img->palette != NULL, "image must have a palette set");
 
-    u16 *temp = malloc(img->height * img->width * sizeof(u16));
+    size_t count = img->height * img->width;
+
+    // Grow the buffer and convert it in place, from the end. There is never a
+    // second full-size buffer allocated at the same time (unless realloc()
+    // needs to move it).
+    u16 *temp = memTraceRealloc(img->image.data8, count * sizeof(u16),
+                                MEMTRACE_TAG_IMAGE);
     if (temp == NULL)
         return false;
 
-    for (int i = 0; i < img->height * img->width; i++)
-    {
-        u8 c = img->image.data8[i];
-
-        if (c != transparentColor)
-            temp[i] = img->palette[c] | ALPHA_BIT_ARGB16;
-        else
-            temp[i] = img->palette[c];
-    }
+    imageConvert8to16(temp, (const u8 *)temp, img->palette, count,
+                      transparentColor);
 
-    free(img->image.data8);
-    free(img->palette);
+    memTraceFree(img->palette);
 
     img->palette = NULL;
 
@@ -94,37 +183,40 @@ bool image8to16trans(sImage *img, u8 transparentColor)
     return true;
 }
 
+bool image8to16(sImage *img)
+{
+    return image8to16Common(img, -1);
+}
+
+bool image8to16trans(sImage *img, u8 transparentColor)
+{
+    return image8to16Common(img, transparentColor);
+}
+
 bool imageTileData(sImage *img)
 {
     // Can only tile 8 bit data that is a multiple of 8 in dimention
     sassert(img->bpp == 8, "image must be 8 bpp");
     sassert((img->height & 7) == 0 && (img->width & 7) == 0, "image must be a multiple of 8 in dimension");
 
-    int th = img->height >> 3;
-    int tw = img->width >> 3;
+    // Each row of tiles uses the same bytes as the 8 rows of pixels it is made
+    // from, so the image can be tiled in place one band of 8 rows at a time.
+    size_t band_size = img->width * 8;
 
-    // Buffer to hold data
-    u32 *temp = malloc(img->height * img->width * sizeof(u32));
-    if (temp == NULL)
+    u32 *band = memTraceMalloc(band_size, MEMTRACE_TAG_IMAGE);
+    if (band == NULL)
         return false;
 
-    int i = 0;
+    u8 *data = img->image.data8;
 
-    for (int ty = 0; ty < th; ty++)
+    for (int ty = 0; ty < (img->height >> 3); ty++)
     {
-        for (int tx = 0; tx < tw; tx++)
-        {
-            for (int iy = 0; iy < 8; iy++)
-            {
-                for (int ix = 0; ix < 2; ix++)
-                    temp[i++] = img->image.data32[ix + tx * 2 + (iy + ty * 8) * tw * 2];
-            }
-        }
+        memcpy(band, data, band_size);
+        imageTile8(data, band, img->width, 8);
+        data += band_size;
     }
 
-    free(img->image.data32);
-
-    img->image.data32 = (u32 *)temp;
+    memTraceFree(band);
 
     return true;
 }
@@ -132,8 +224,8 @@ bool imageTileData(sImage *img)
 void imageDestroy(sImage *img)
 {
     if (img->image.data8)
-        free(img->image.data8);
+        memTraceFree(img->image.data8);
 
     if (img->palette && img->bpp == 8)
-        free(img->palette);
+        memTraceFree(img->palette);
 }
@@ -19,6 +19,7 @@
 #include <nds/arm9/dldi.h>
 #include <nds/card.h>
 #include <nds/memory.h>
+#include <nds/memtrace.h>
 #include <nds/system.h>
 
 #include "fatfs/cache.h"
@@ -500,7 +501,7 @@ off_t nitrofs_lseek(int fd, off_t offset, int whence)
 int nitrofs_close(int fd)
 {
     nitrofs_file_t *f = (nitrofs_file_t *) FD_DESC(fd);
-    free(f);
+    memTraceFree(f);
     return 0;
 }
 
@@ -519,7 +520,8 @@ static int nitrofs_open_by_id(nitrofs_file_t *f, uint16_t id)
 
 int nitroFSOpenById(uint16_t id)
 {
-    nitrofs_file_t *f = malloc(sizeof(nitrofs_file_t));
+    nitrofs_file_t *f = memTraceMalloc(sizeof(nitrofs_file_t),
+                                       MEMTRACE_TAG_FILESYSTEM);
     if (f == NULL)
     {
         errno = ENOMEM;
@@ -529,7 +531,7 @@ int nitroFSOpenById(uint16_t id)
     int32_t res = nitrofs_open_by_id(f, id);
     if (res < 0)
     {
-        free(f);
+        memTraceFree(f);
         errno = ENOENT;
         return -1;
     }
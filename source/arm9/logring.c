@@ -0,0 +1,294 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <nds/arm9/cache.h>
+#include <nds/debug.h>
+#include <nds/fifocommon.h>
+#include <nds/fifomessages.h>
+#include <nds/logring.h>
+#include <nds/memory.h>
+#include <nds/memtrace.h>
+#include <nds/system.h>
+
+#include "common/libnds_internal.h"
+
+// Uncached pointers to the rings. The ARM9 ring is also used through an
+// uncached pointer so that both rings are handled the same way.
+static LogRingIpc *arm7_ring = NULL;
+static LogRingIpc *arm9_ring = NULL;
+
+static const char *const *log_formats = NULL;
+static size_t log_formats_count = 0;
+
+static uint32_t arm7_dropped_reported = 0;
+static uint32_t arm9_dropped_reported = 0;
+
+static LogRingIpc *logRingAlloc(size_t records)
+{
+    if (records == 0)
+        return NULL;
+
+    size_t count = 1;
+    while (count < records)
+        count <<= 1;
+
+    size_t size = sizeof(LogRingIpc) + count * sizeof(LogRingRecord);
+
+    LogRingIpc *ring = memTraceMalloc(size, MEMTRACE_TAG_CONSOLE);
+    if (ring == NULL)
+        return NULL;
+
+    ring->write_index = 0;
+    ring->read_index = 0;
+    ring->dropped = 0;
+    ring->mask = count - 1;
+    ring->active = 1;
+
+    DC_FlushRange(ring, size);
+
+    return memUncached(ring);
+}
+
+static void logRingSendArm7(LogRingIpc *ring)
+{
+    FifoMessage msg;
+
+    msg.type = SYS_SET_ARM7_LOG_RING;
+    msg.setArm7LogRing.buffer = ring;
+
+    fifoSendDatamsg(FIFO_SYSTEM, sizeof(msg), (u8 *)&msg);
+}
+
+int logRingInit(size_t arm7_records, size_t arm9_records)
+{
+    // Fail if the rings have already been initialized
+    if ((arm7_ring != NULL) || (arm9_ring != NULL))
+        return -1;
+
+    arm7_ring = logRingAlloc(arm7_records);
+    if ((arm7_records > 0) && (arm7_ring == NULL))
+        return -2;
+
+    arm9_ring = logRingAlloc(arm9_records);
+    if ((arm9_records > 0) && (arm9_ring == NULL))
+    {
+        if (arm7_ring != NULL)
+            memTraceFree(memCached(arm7_ring));
+        arm7_ring = NULL;
+        return -2;
+    }
+
+    arm7_dropped_reported = 0;
+    arm9_dropped_reported = 0;
+
+    if (arm7_ring != NULL)
+        logRingSendArm7(memCached(arm7_ring));
+
+    logRingSetup(arm9_ring);
+
+    return 0;
+}
+
+// The ARM7 clears the flag of its ring as soon as it handles the FIFO message,
+// which normally takes a few microseconds. Give up after a few frames in case
+// it isn't handling FIFO messages (for example, if it has crashed).
+#define LOG_RING_EXIT_TIMEOUT_LINES (263 * 4)
+
+static bool logRingWaitArm7(void)
+{
+    uint16_t vcount = REG_VCOUNT;
+    unsigned int lines = 0;
+
+    while (arm7_ring->active)
+    {
+        if (REG_VCOUNT != vcount)
+        {
+            vcount = REG_VCOUNT;
+            lines++;
+            if (lines == LOG_RING_EXIT_TIMEOUT_LINES)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+int logRingExit(void)
+{
+    int ret = 0;
+
+    logRingSetup(NULL);
+
+    if (arm9_ring != NULL)
+    {
+        memTraceFree(memCached(arm9_ring));
+        arm9_ring = NULL;
+    }
+
+    if (arm7_ring != NULL)
+    {
+        // The ARM7 may be writing a record right now. It clears the flag when
+        // it stops using the ring. If it doesn't do it, the ring is leaked so
+        // that the ARM7 never writes to memory that has been reused.
+        logRingSendArm7(NULL);
+        if (logRingWaitArm7())
+            memTraceFree(memCached(arm7_ring));
+        else
+            ret = -1;
+
+        arm7_ring = NULL;
+    }
+
+    return ret;
+}
+
+void logRingSetFormats(const char *const *formats, size_t count)
+{
+    log_formats = formats;
+    log_formats_count = count;
+}
+
+static bool logRingPop(LogRingIpc *ring, LogRingRecord *record)
+{
+    if (ring == NULL)
+        return false;
+
+    uint32_t read_index = ring->read_index;
+
+    if (read_index == ring->write_index)
+        return false;
+
+    *record = ring->records[read_index & ring->mask];
+
+    // The producer can reuse the slot after this, so the copy must be done
+    // before updating the index.
+    __asm__ volatile("" ::: "memory");
+    ring->read_index = read_index + 1;
+
+    return true;
+}
+
+bool logRingRead(LogRingRecord *record)
+{
+    if (logRingPop(arm7_ring, record))
+        return true;
+
+    return logRingPop(arm9_ring, record);
+}
+
+int logRingFormat(const LogRingRecord *record, char *buffer, size_t size)
+{
+    const uint32_t *a = record->args;
+    uint32_t info = record->info;
+
+    int len = snprintf(buffer, size, "[%c %3lu %08lX] ",
+                       LOG_RING_INFO_ARM7(info) ? '7' : '9',
+                       LOG_RING_INFO_VCOUNT(info), record->timestamp);
+    if (len < 0)
+        return len;
+
+    // If the prefix doesn't fit, the rest is only measured
+    char *rest = NULL;
+    size_t rest_size = 0;
+    if ((size_t)len < size)
+    {
+        rest = buffer + len;
+        rest_size = size - len;
+    }
+
+    const char *fmt = NULL;
+    if (record->format_id < log_formats_count)
+        fmt = log_formats[record->format_id];
+
+    int ret;
+
+    // Unused arguments are passed as 0. They aren't read by the format string,
+    // and the stored values may be from an older record.
+    uint32_t n = LOG_RING_INFO_NARGS(info);
+    uint32_t a0 = n > 0 ? a[0] : 0;
+    uint32_t a1 = n > 1 ? a[1] : 0;
+    uint32_t a2 = n > 2 ? a[2] : 0;
+    uint32_t a3 = n > 3 ? a[3] : 0;
+
+    if (fmt == NULL)
+    {
+        ret = snprintf(rest, rest_size,
+                       "id %u (%lu): %08lX %08lX %08lX %08lX",
+                       record->format_id, n, a0, a1, a2, a3);
+    }
+    else
+    {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+        ret = snprintf(rest, rest_size, fmt, a0, a1, a2, a3);
+#pragma GCC diagnostic pop
+    }
+
+    if (ret < 0)
+        return ret;
+
+    return len + ret;
+}
+
+static void logRingOutput(FILE *file, const char *str, size_t len)
+{
+    if (file == NULL)
+        nocashWrite(str, len);
+    else
+        fwrite(str, 1, len, file);
+}
+
+static void logRingReportDropped(FILE *file, LogRingIpc *ring,
+                                 uint32_t *reported, char cpu)
+{
+    if (ring == NULL)
+        return;
+
+    uint32_t dropped = ring->dropped;
+    if (dropped == *reported)
+        return;
+
+    char line[64];
+    int len = snprintf(line, sizeof(line), "[%c] %lu records dropped\n", cpu,
+                       dropped - *reported);
+    if (len > 0)
+        logRingOutput(file, line, len);
+
+    *reported = dropped;
+}
+
+size_t logRingProcess(FILE *file)
+{
+    LogRingRecord record;
+    size_t count = 0;
+
+    // Record the drop counters first, so that they are printed before the
+    // records that were logged after the ring stopped being full.
+    logRingReportDropped(file, arm7_ring, &arm7_dropped_reported, '7');
+    logRingReportDropped(file, arm9_ring, &arm9_dropped_reported, '9');
+
+    while (logRingRead(&record))
+    {
+        char line[160];
+
+        int len = logRingFormat(&record, line, sizeof(line) - 1);
+        if (len < 0)
+            continue;
+
+        if ((size_t)len > sizeof(line) - 2)
+            len = sizeof(line) - 2;
+
+        line[len++] = '\n';
+
+        logRingOutput(file, line, len);
+        count++;
+    }
+
+    return count;
+}
@@ -98,3 +98,140 @@ ARM_CODE float hw_sqrtf(float x)
         return xu.f; // returns +0 or -0 as appropriate
     }
 }
+
+ITCM_CODE ARM_CODE
+void divf32_array(int32_t *results, const int32_t *num, const int32_t *den,
+                  size_t count)
+{
+    if (count == 0)
+        return;
+
+    REG_DIVCNT = DIV_64_32;
+
+    REG_DIV_NUMER = (int64_t)((uint64_t)(int64_t)num[0] << 12);
+    REG_DIV_DENOM_L = den[0];
+
+    for (size_t i = 1; i < count; i++)
+    {
+        // Load the next operands while the divider is busy
+        int64_t n = (int64_t)((uint64_t)(int64_t)num[i] << 12);
+        int32_t d = den[i];
+
+        while (REG_DIVCNT & DIV_BUSY);
+        int32_t r = REG_DIV_RESULT_L;
+
+        REG_DIV_NUMER = n;
+        REG_DIV_DENOM_L = d;
+
+        results[i - 1] = r;
+    }
+
+    while (REG_DIVCNT & DIV_BUSY);
+    results[count - 1] = REG_DIV_RESULT_L;
+}
+
+ITCM_CODE ARM_CODE
+void reciprocal_array(int32_t *results, const int32_t *values, size_t count)
+{
+    if (count == 0)
+        return;
+
+    REG_DIVCNT = DIV_64_32;
+
+    // The numerator is the same for all divisions. Writing the denominator is
+    // enough to start a new division.
+    REG_DIV_NUMER = (int64_t)inttof32(1) << 12;
+    REG_DIV_DENOM_L = values[0];
+
+    for (size_t i = 1; i < count; i++)
+    {
+        int32_t d = values[i];
+
+        while (REG_DIVCNT & DIV_BUSY);
+        int32_t r = REG_DIV_RESULT_L;
+
+        REG_DIV_DENOM_L = d;
+
+        results[i - 1] = r;
+    }
+
+    while (REG_DIVCNT & DIV_BUSY);
+    results[count - 1] = REG_DIV_RESULT_L;
+}
+
+ITCM_CODE ARM_CODE
+void sqrtf32_array(uint32_t *results, const uint32_t *values, size_t count)
+{
+    if (count == 0)
+        return;
+
+    REG_SQRTCNT = SQRT_64;
+
+    REG_SQRT_PARAM = ((uint64_t)values[0]) << 12;
+
+    for (size_t i = 1; i < count; i++)
+    {
+        uint64_t a = ((uint64_t)values[i]) << 12;
+
+        while (REG_SQRTCNT & SQRT_BUSY);
+        uint32_t r = REG_SQRT_RESULT;
+
+        REG_SQRT_PARAM = a;
+
+        results[i - 1] = r;
+    }
+
+    while (REG_SQRTCNT & SQRT_BUSY);
+    results[count - 1] = REG_SQRT_RESULT;
+}
+
+// Starts the square root of the squared magnitude of a vector, with the same
+// operations as normalizef32().
+ITCM_CODE ARM_CODE static inline void normalize_start_sqrt(const int32_t *v)
+{
+    uint32_t sq = mulf32(v[0], v[0]) + mulf32(v[1], v[1]) + mulf32(v[2], v[2]);
+
+    REG_SQRT_PARAM = ((uint64_t)sq) << 12;
+}
+
+ITCM_CODE ARM_CODE
+void normalizef32_array(int32_t *vectors, size_t count)
+{
+    if (count == 0)
+        return;
+
+    REG_DIVCNT = DIV_64_32;
+    REG_SQRTCNT = SQRT_64;
+
+    normalize_start_sqrt(&vectors[0]);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        int32_t *v = &vectors[i * 3];
+        int32_t x = v[0], y = v[1], z = v[2];
+
+        while (REG_SQRTCNT & SQRT_BUSY);
+        int32_t magnitude = REG_SQRT_RESULT;
+
+        REG_DIV_NUMER = (int64_t)((uint64_t)(int64_t)x << 12);
+        REG_DIV_DENOM_L = magnitude;
+
+        // The square root unit is free now, start the next vector while the
+        // divider works on this one.
+        if (i + 1 < count)
+            normalize_start_sqrt(&v[3]);
+
+        // The denominator doesn't change, writing the numerator is enough to
+        // start the next division.
+        while (REG_DIVCNT & DIV_BUSY);
+        v[0] = REG_DIV_RESULT_L;
+        REG_DIV_NUMER = (int64_t)((uint64_t)(int64_t)y << 12);
+
+        while (REG_DIVCNT & DIV_BUSY);
+        v[1] = REG_DIV_RESULT_L;
+        REG_DIV_NUMER = (int64_t)((uint64_t)(int64_t)z << 12);
+
+        while (REG_DIVCNT & DIV_BUSY);
+        v[2] = REG_DIV_RESULT_L;
+    }
+}
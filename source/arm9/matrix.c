@@ -0,0 +1,341 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <nds/arm9/math.h>
+#include <nds/arm9/matrix.h>
+#include <nds/arm9/postest.h>
+#include <nds/arm9/video.h>
+#include <nds/arm9/videoGL.h>
+
+// Sum of products of 20.12 values, converted back to 20.12. The compiler turns
+// this into a smull followed by smlal instructions.
+#define DOT2(a, b, c, d) \
+    ((int32_t)(((int64_t)(a) * (b) + (int64_t)(c) * (d)) >> 12))
+#define DOT3(a, b, c, d, e, f) \
+    ((int32_t)(((int64_t)(a) * (b) + (int64_t)(c) * (d) + \
+                (int64_t)(e) * (f)) >> 12))
+#define DOT4(a, b, c, d, e, f, g, h) \
+    ((int32_t)(((int64_t)(a) * (b) + (int64_t)(c) * (d) + \
+                (int64_t)(e) * (f) + (int64_t)(g) * (h)) >> 12))
+
+void matIdentity4x4(m4x4 *m)
+{
+    memset(m, 0, sizeof(m4x4));
+
+    m->m[0] = inttof32(1);
+    m->m[5] = inttof32(1);
+    m->m[10] = inttof32(1);
+    m->m[15] = inttof32(1);
+}
+
+void matIdentity4x3(m4x3 *m)
+{
+    memset(m, 0, sizeof(m4x3));
+
+    m->m[0] = inttof32(1);
+    m->m[4] = inttof32(1);
+    m->m[8] = inttof32(1);
+}
+
+ARM_CODE void matMultiply4x4(m4x4 *result, const m4x4 *a, const m4x4 *b)
+{
+    const int *x = a->m;
+    const int *y = b->m;
+    m4x4 r;
+
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            r.m[i * 4 + j] = DOT4(x[i * 4 + 0], y[0 + j], x[i * 4 + 1], y[4 + j],
+                                  x[i * 4 + 2], y[8 + j], x[i * 4 + 3], y[12 + j]);
+        }
+    }
+
+    *result = r;
+}
+
+ARM_CODE void matMultiply4x3(m4x3 *result, const m4x3 *a, const m4x3 *b)
+{
+    const int *x = a->m;
+    const int *y = b->m;
+    m4x3 r;
+
+    // The implicit last column of both matrices is (0, 0, 0, 1)
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            r.m[i * 3 + j] = DOT3(x[i * 3 + 0], y[0 + j], x[i * 3 + 1], y[3 + j],
+                                  x[i * 3 + 2], y[6 + j]);
+        }
+    }
+
+    for (int j = 0; j < 3; j++)
+    {
+        r.m[9 + j] = DOT4(x[9], y[0 + j], x[10], y[3 + j], x[11], y[6 + j],
+                          inttof32(1), y[9 + j]);
+    }
+
+    *result = r;
+}
+
+void matTranspose4x4(m4x4 *result, const m4x4 *m)
+{
+    m4x4 r;
+
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+            r.m[j * 4 + i] = m->m[i * 4 + j];
+    }
+
+    *result = r;
+}
+
+void matTranspose3x3(m3x3 *result, const m3x3 *m)
+{
+    m3x3 r;
+
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+            r.m[j * 3 + i] = m->m[i * 3 + j];
+    }
+
+    *result = r;
+}
+
+// Divides each element of an adjugate matrix by the determinant. It uses the
+// 64-bit mode of the hardware divider to keep all the precision.
+static void matDivideByDet(int *dst, const int32_t *adj, size_t count, int32_t det)
+{
+    for (size_t i = 0; i < count; i++)
+        dst[i] = div64((int64_t)adj[i] * 4096, det);
+}
+
+bool matInverse4x3(m4x3 *result, const m4x3 *m)
+{
+    const int *a = m->m;
+    int32_t adj[9];
+
+    adj[0] = DOT2(a[4], a[8], -a[5], a[7]);
+    adj[1] = DOT2(a[2], a[7], -a[1], a[8]);
+    adj[2] = DOT2(a[1], a[5], -a[2], a[4]);
+    adj[3] = DOT2(a[5], a[6], -a[3], a[8]);
+    adj[4] = DOT2(a[0], a[8], -a[2], a[6]);
+    adj[5] = DOT2(a[2], a[3], -a[0], a[5]);
+    adj[6] = DOT2(a[3], a[7], -a[4], a[6]);
+    adj[7] = DOT2(a[1], a[6], -a[0], a[7]);
+    adj[8] = DOT2(a[0], a[4], -a[1], a[3]);
+
+    int32_t det = DOT3(a[0], adj[0], a[1], adj[3], a[2], adj[6]);
+    if (det == 0)
+        return false;
+
+    int32_t tx = a[9], ty = a[10], tz = a[11];
+
+    matDivideByDet(result->m, adj, 9, det);
+
+    // The inverse translation is -t * inverse(R)
+    const int *r = result->m;
+    result->m[9] = -DOT3(tx, r[0], ty, r[3], tz, r[6]);
+    result->m[10] = -DOT3(tx, r[1], ty, r[4], tz, r[7]);
+    result->m[11] = -DOT3(tx, r[2], ty, r[5], tz, r[8]);
+
+    return true;
+}
+
+// Multiplies a 20.12 number by a 2x2 determinant with 24 fractional bits, and
+// returns the result with 24 fractional bits. The determinant is split in two
+// parts so that the products fit in 64 bits.
+static inline int64_t matMulDet(int32_t a, int64_t d)
+{
+    return (int64_t)a * (d >> 12) + (((int64_t)a * (d & 0xFFF)) >> 12);
+}
+
+// Multiplies two 2x2 determinants with 24 fractional bits, and returns the
+// result with 24 fractional bits.
+static inline int64_t matMulDets(int64_t s, int64_t c)
+{
+    return matMulDet((int32_t)(s >> 12), c) + (((s & 0xFFF) * (c >> 12)) >> 12);
+}
+
+#define DET2(a, b, c, d) ((int64_t)(a) * (b) - (int64_t)(c) * (d))
+
+#define ADJ3(a, b, c, d, e, f) \
+    (matMulDet(a, b) + matMulDet(c, d) + matMulDet(e, f))
+
+// Like matDivideByDet(), but the adjugate matrix and the determinant have 24
+// fractional bits. Both are shifted right only as much as needed for the
+// determinant to fit in the 32-bit denominator of the divider.
+static void matDivideByDet64(int *dst, const int64_t *adj, size_t count,
+                             int64_t det)
+{
+    int shift = 0;
+    while ((det >> shift) != (int32_t)(det >> shift))
+        shift++;
+
+    for (size_t i = 0; i < count; i++)
+        dst[i] = div64((adj[i] >> shift) * 4096, (int32_t)(det >> shift));
+}
+
+bool matInverse4x4(m4x4 *result, const m4x4 *m)
+{
+    const int *a = m->m;
+    int64_t adj[16];
+
+    // 2x2 determinants of the first two rows and the last two rows. They, the
+    // adjugate matrix and the determinant are kept with 24 fractional bits. If
+    // they were truncated to 20.12, the error would be multiplied by the
+    // translation, and a small determinant would lose most of its precision.
+    int64_t s0 = DET2(a[0], a[5], a[4], a[1]);
+    int64_t s1 = DET2(a[0], a[6], a[4], a[2]);
+    int64_t s2 = DET2(a[0], a[7], a[4], a[3]);
+    int64_t s3 = DET2(a[1], a[6], a[5], a[2]);
+    int64_t s4 = DET2(a[1], a[7], a[5], a[3]);
+    int64_t s5 = DET2(a[2], a[7], a[6], a[3]);
+
+    int64_t c5 = DET2(a[10], a[15], a[14], a[11]);
+    int64_t c4 = DET2(a[9], a[15], a[13], a[11]);
+    int64_t c3 = DET2(a[9], a[14], a[13], a[10]);
+    int64_t c2 = DET2(a[8], a[15], a[12], a[11]);
+    int64_t c1 = DET2(a[8], a[14], a[12], a[10]);
+    int64_t c0 = DET2(a[8], a[13], a[12], a[9]);
+
+    int64_t det = matMulDets(s0, c5) - matMulDets(s1, c4)
+                + matMulDets(s2, c3) + matMulDets(s3, c2)
+                - matMulDets(s4, c1) + matMulDets(s5, c0);
+
+    // Matrices with a determinant that is 0 in 20.12 format can't be inverted
+    if ((det > -4096) && (det < 4096))
+        return false;
+
+    adj[0] = ADJ3(a[5], c5, -a[6], c4, a[7], c3);
+    adj[1] = ADJ3(-a[1], c5, a[2], c4, -a[3], c3);
+    adj[2] = ADJ3(a[13], s5, -a[14], s4, a[15], s3);
+    adj[3] = ADJ3(-a[9], s5, a[10], s4, -a[11], s3);
+
+    adj[4] = ADJ3(-a[4], c5, a[6], c2, -a[7], c1);
+    adj[5] = ADJ3(a[0], c5, -a[2], c2, a[3], c1);
+    adj[6] = ADJ3(-a[12], s5, a[14], s2, -a[15], s1);
+    adj[7] = ADJ3(a[8], s5, -a[10], s2, a[11], s1);
+
+    adj[8] = ADJ3(a[4], c4, -a[5], c2, a[7], c0);
+    adj[9] = ADJ3(-a[0], c4, a[1], c2, -a[3], c0);
+    adj[10] = ADJ3(a[12], s4, -a[13], s2, a[15], s0);
+    adj[11] = ADJ3(-a[8], s4, a[9], s2, -a[11], s0);
+
+    adj[12] = ADJ3(-a[4], c3, a[5], c1, -a[6], c0);
+    adj[13] = ADJ3(a[0], c3, -a[1], c1, a[2], c0);
+    adj[14] = ADJ3(-a[12], s3, a[13], s1, -a[14], s0);
+    adj[15] = ADJ3(a[8], s3, -a[9], s1, a[10], s0);
+
+    matDivideByDet64(result->m, adj, 16, det);
+
+    return true;
+}
+
+ARM_CODE void matTransformPoints4x3(const m4x3 *m, const GLvector *in,
+                                    GLvector *out, size_t count)
+{
+    const int m0 = m->m[0], m1 = m->m[1], m2 = m->m[2];
+    const int m3 = m->m[3], m4 = m->m[4], m5 = m->m[5];
+    const int m6 = m->m[6], m7 = m->m[7], m8 = m->m[8];
+    const int64_t tx = (int64_t)m->m[9] * 4096;
+    const int64_t ty = (int64_t)m->m[10] * 4096;
+    const int64_t tz = (int64_t)m->m[11] * 4096;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        int32_t x = in[i].x, y = in[i].y, z = in[i].z;
+
+        out[i].x = (int32_t)((tx + (int64_t)x * m0 + (int64_t)y * m3 + (int64_t)z * m6) >> 12);
+        out[i].y = (int32_t)((ty + (int64_t)x * m1 + (int64_t)y * m4 + (int64_t)z * m7) >> 12);
+        out[i].z = (int32_t)((tz + (int64_t)x * m2 + (int64_t)y * m5 + (int64_t)z * m8) >> 12);
+    }
+}
+
+ARM_CODE void matTransformNormals4x3(const m4x3 *m, const GLvector *in,
+                                     GLvector *out, size_t count)
+{
+    const int m0 = m->m[0], m1 = m->m[1], m2 = m->m[2];
+    const int m3 = m->m[3], m4 = m->m[4], m5 = m->m[5];
+    const int m6 = m->m[6], m7 = m->m[7], m8 = m->m[8];
+
+    for (size_t i = 0; i < count; i++)
+    {
+        int32_t x = in[i].x, y = in[i].y, z = in[i].z;
+
+        out[i].x = DOT3(x, m0, y, m3, z, m6);
+        out[i].y = DOT3(x, m1, y, m4, z, m7);
+        out[i].z = DOT3(x, m2, y, m5, z, m8);
+    }
+}
+
+ARM_CODE void matTransformPoints4x4(const m4x4 *m, const GLvector *in,
+                                    int32_t *out, size_t count)
+{
+    const int *a = m->m;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        int32_t x = in[i].x, y = in[i].y, z = in[i].z;
+
+        for (int j = 0; j < 4; j++)
+        {
+            out[j] = DOT4(x, a[j], y, a[4 + j], z, a[8 + j],
+                          inttof32(1), a[12 + j]);
+        }
+
+        out += 4;
+    }
+}
+
+void matTransformPointsGX(const m4x3 *m, const v16 *in, GLvector *out,
+                          size_t count)
+{
+    // The position test multiplies the point by the position matrix and the
+    // projection matrix. Make the projection matrix the identity.
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glMatrixMode(GL_POSITION);
+    glPushMatrix();
+    glLoadMatrix4x3(m);
+
+    if (count > 0)
+    {
+        PosTest_Asynch(in[0], in[1], in[2]);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            // Wait until the matrix commands and the test have been executed
+            while (GFX_STATUS & (GFX_STATUS_TEST_BUSY | GFX_STATUS_BUSY));
+
+            int32_t x = PosTestXresult();
+            int32_t y = PosTestYresult();
+            int32_t z = PosTestZresult();
+
+            // Start the next test before storing the results of this one
+            if (i + 1 < count)
+                PosTest_Asynch(in[i * 3 + 3], in[i * 3 + 4], in[i * 3 + 5]);
+
+            out[i].x = x;
+            out[i].y = y;
+            out[i].z = z;
+        }
+    }
+
+    glPopMatrix(1);
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix(1);
+    glMatrixMode(GL_MODELVIEW);
+}
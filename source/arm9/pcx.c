@@ -5,10 +5,12 @@
 // Copyright (C) 2005 Dave Murphy (WinterMute)
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <nds/arm9/image.h>
 #include <nds/arm9/pcx.h>
 #include <nds/arm9/video.h>
+#include <nds/memtrace.h>
 
 bool loadPCX(const unsigned char *pcx, sImage *image)
 {
@@ -32,37 +34,47 @@ bool loadPCX(const unsigned char *pcx, sImage *image)
     if (hdr->bitsPerPixel != 8)
         return false;
 
-    unsigned char *scanline = image->image.data8 = malloc(size);
+    unsigned char *scanline = image->image.data8 =
+        memTraceMalloc(size, MEMTRACE_TAG_IMAGE);
     if (scanline == NULL)
         return false;
 
-    image->palette = malloc(256 * 2);
+    image->palette = memTraceMalloc(256 * 2, MEMTRACE_TAG_IMAGE);
     if (image->palette == NULL)
     {
-        free(scanline);
+        memTraceFree(scanline);
         return false;
     }
 
-    int count = 0;
-
     for (int iy = 0; iy < height; iy++)
     {
-        count = 0;
+        // Lines are padded to bytesPerLine, which may be bigger than the width
+        // of the image. The padding is decoded but not stored.
+        int count = 0;
+
         while (count < scansize)
         {
             unsigned char c = *pcx++;
 
             if (c < 192)
             {
-                scanline[count++] = c;
+                if (count < width)
+                    scanline[count] = c;
+                count++;
             }
             else
             {
-                int run = c - 192;
+                int end = count + c - 192;
+                if (end > scansize)
+                    end = scansize;
+
                 c = *pcx++;
 
-                for (int i = 0; i < run && count < scansize; i++)
-                    scanline[count++] = c;
+                int fill_end = (end < width) ? end : width;
+                if (fill_end > count)
+                    memset(scanline + count, c, fill_end - count);
+
+                count = end;
             }
         }
         scanline += width;
@@ -73,9 +85,9 @@ bool loadPCX(const unsigned char *pcx, sImage *image)
     // here. Anyway, the support among other apps is poor, so we're going to reject it.
     if (*pcx != 0x0C)
     {
-        free(image->image.data8);
+        memTraceFree(image->image.data8);
         image->image.data8 = 0;
-        free(image->palette);
+        memTraceFree(image->palette);
         image->palette = 0;
         return false;
     }
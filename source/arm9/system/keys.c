@@ -8,10 +8,15 @@
 
 #include <stdlib.h>
 
+#include <nds/arm9/cache.h>
 #include <nds/arm9/input.h>
+#include <nds/fifocommon.h>
+#include <nds/fifomessages.h>
 #include <nds/ipc.h>
 #include <nds/input.h>
 #include <nds/interrupts.h>
+#include <nds/memory.h>
+#include <nds/memtrace.h>
 #include <nds/system.h>
 
 #include "common/libnds_internal.h"
@@ -30,6 +35,14 @@ static u16 receivedArm7Buttons = 0xFFFF; // Not pressed
 static touchPosition latchedTouchPosition;
 static u16 latchedArm7Buttons = 0xFFFF;
 
+// Uncached pointer to the ring of touch events shared with the ARM7
+static TouchEventIpc *touchEventRing = NULL;
+
+// Write index of the ring when scanKeys() was called. touchEventsRead() doesn't
+// read events past this point, so that the events match the state returned by
+// keysHeld() and touchRead().
+static u32 latchedTouchEventIndex = 0;
+
 static uint16_t keys_cur(void)
 {
     const uint16_t keyinput_mask = KEY_A | KEY_B | KEY_SELECT | KEY_START |
@@ -67,6 +80,9 @@ void scanKeys(void)
     latchedTouchPosition = receivedTouchPosition;
     latchedArm7Buttons = receivedArm7Buttons;
 
+    if (touchEventRing != NULL)
+        latchedTouchEventIndex = touchEventRing->write_index;
+
     keysold = keys;
     keys = keys_cur();
 
@@ -140,3 +156,129 @@ void setTransferInputData(touchPosition *touch, u16 buttons)
     receivedTouchPosition = *touch;
     receivedArm7Buttons = buttons;
 }
+
+static void touchEventsSendArm7(TouchEventIpc *ring, u32 rate, int timer)
+{
+    FifoMessage msg;
+
+    msg.type = SYS_SET_TOUCH_EVENTS;
+    msg.setTouchEvents.buffer = ring;
+    msg.setTouchEvents.freq = rate;
+    msg.setTouchEvents.timer = timer;
+
+    fifoSendDatamsg(FIFO_SYSTEM, sizeof(msg), (u8 *)&msg);
+}
+
+int touchEventsStart(u32 rate, int timer, size_t capacity)
+{
+    if (touchEventRing != NULL)
+        return -1;
+
+    if ((rate < 8) || (rate > TOUCH_EVENTS_MAX_RATE) || (timer < 0) ||
+        (timer > 3) || (capacity == 0))
+        return -2;
+
+    size_t entries = 1;
+    while (entries < capacity)
+        entries <<= 1;
+
+    size_t size = sizeof(TouchEventIpc) + entries * sizeof(TouchEvent);
+
+    TouchEventIpc *ring = memTraceMalloc(size, MEMTRACE_TAG_INPUT);
+    if (ring == NULL)
+        return -3;
+
+    ring->write_index = 0;
+    ring->read_index = 0;
+    ring->dropped = 0;
+    ring->mask = entries - 1;
+    ring->active = 1;
+
+    DC_FlushRange(ring, size);
+
+    int oldIME = enterCriticalSection();
+    touchEventRing = memUncached(ring);
+    latchedTouchEventIndex = 0;
+    leaveCriticalSection(oldIME);
+
+    touchEventsSendArm7(ring, rate, timer);
+
+    return 0;
+}
+
+// Number of scanlines to wait for the ARM7 to stop using the ring (4 frames)
+#define TOUCH_EVENTS_STOP_TIMEOUT_LINES (263 * 4)
+
+static bool touchEventsWaitArm7(TouchEventIpc *ring)
+{
+    uint16_t vcount = REG_VCOUNT;
+    unsigned int lines = 0;
+
+    while (ring->active)
+    {
+        if (REG_VCOUNT != vcount)
+        {
+            vcount = REG_VCOUNT;
+            lines++;
+            if (lines == TOUCH_EVENTS_STOP_TIMEOUT_LINES)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+int touchEventsStop(void)
+{
+    if (touchEventRing == NULL)
+        return 0;
+
+    TouchEventIpc *ring = touchEventRing;
+
+    int oldIME = enterCriticalSection();
+    touchEventRing = NULL;
+    leaveCriticalSection(oldIME);
+
+    // The ARM7 may be writing an event right now. It clears the flag when it
+    // stops using the ring. If it doesn't do it, the ring is leaked so that the
+    // ARM7 never writes to memory that has been reused.
+    touchEventsSendArm7(NULL, 0, 0);
+    if (!touchEventsWaitArm7(ring))
+        return -1;
+
+    memTraceFree(memCached(ring));
+
+    return 0;
+}
+
+size_t touchEventsRead(TouchEvent *events, size_t max)
+{
+    TouchEventIpc *ring = touchEventRing;
+
+    if ((ring == NULL) || (events == NULL))
+        return 0;
+
+    u32 read_index = ring->read_index;
+    u32 available = latchedTouchEventIndex - read_index;
+
+    if (available > max)
+        available = max;
+
+    for (u32 i = 0; i < available; i++)
+        events[i] = ring->events[(read_index + i) & ring->mask];
+
+    // The ARM7 can reuse the slots after this, so the copy must be done before
+    // updating the index.
+    __asm__ volatile("" ::: "memory");
+    ring->read_index = read_index + available;
+
+    return available;
+}
+
+u32 touchEventsDropped(void)
+{
+    if (touchEventRing == NULL)
+        return 0;
+
+    return touchEventRing->dropped;
+}
@@ -3,7 +3,7 @@
 //
 // Copyright (C) 2005 Jason Rogers (dovoto)
 
-#include <stdlib.h>
+#include <stdbool.h>
 
 #include <nds/arm9/math.h>
 #include <nds/arm9/trig_lut.h>
@@ -156,56 +156,42 @@ s32 tanLerp(s16 angle)
     return (result >> (TAN_BITSFRACTION - 12));
 }
 
-int asinComp(const void *a, const void *b)
+// Returns the index of the last entry of the first LUT_SIZE entries of SIN_LUT
+// that is less than or equal to the value. The search is unrolled by the
+// compiler, and it doesn't have any unpredictable branch.
+static inline int sinLutSearch(u32 value)
 {
-    u16 par = (*(const u16 *)a);
-    const u16 *lut = b;
+    int i = 0;
 
-    if (par == lut[0] || (par > lut[0] && par < lut[1]))
-        return 0;
-
-    if (par < lut[0])
-        return -1;
+    for (int step = LUT_SIZE / 2; step > 0; step >>= 1)
+    {
+        if (SIN_LUT[i + step] <= value)
+            i += step;
+    }
 
-    return 1;
+    return i;
 }
 
 s16 asinLerp(s16 par)
 {
-    bool neg = false;
-    u16 param;
-
-    if (par < 0)
-    {
-        param = -par;
-        neg = true;
-    }
-    else
-    {
-        param = par;
-    }
+    bool neg = par < 0;
 
-    // convert from 4.12 to 1.15
-    param = param << (SIN_BITSFRACTION - 12);
+    // Convert from 4.12 to 1.15
+    u32 param = (neg ? -(s32)par : par) << (SIN_BITSFRACTION - 12);
 
-    if (param < ANGLE_FRACTION)
-        return 0;
+    if (param >= SIN_LUT[LUT_SIZE])
+        return neg ? -LIBNDS_QUARTER_ANGLE : LIBNDS_QUARTER_ANGLE;
 
-    if (param > SIN_LUT[LUT_SIZE])
-        return (neg ? -LIBNDS_QUARTER_ANGLE : LIBNDS_QUARTER_ANGLE);
+    int index = sinLutSearch(param);
 
-    u16 *lutIndexPointer =
-        (u16 *)bsearch(&param, SIN_LUT, LUT_SIZE + 1, sizeof(u16), asinComp);
+    // Interpolate between the two LUT entries around the value
+    u32 base = SIN_LUT[index];
+    u32 delta = SIN_LUT[index + 1] - base;
+    u32 frac = (((param - base) << ANGLE_FRACTION_BITS) + (delta >> 1)) / delta;
 
-    if (lutIndexPointer == NULL)
-        return 0;
+    int angle = intToFixed(index, ANGLE_FRACTION_BITS) + frac;
 
-    int index = (int)(lutIndexPointer - SIN_LUT);
-    // index is in (0, 256)
-
-    int angle = intToFixed(index, ANGLE_FRACTION_BITS);
-
-    return (neg ? -angle : angle);
+    return neg ? -angle : angle;
 }
 
 s16 acosLerp(s16 par)
@@ -214,64 +200,63 @@ s16 acosLerp(s16 par)
     return LIBNDS_QUARTER_ANGLE - asinLerp(par); // returns a value in [0, 256]
 }
 
-int atanComp(const void *a, const void *b)
+// Returns the arctangent of a 16.16 value in the range [0, 1] as an angle in
+// the range [0, LIBNDS_QUARTER_ANGLE / 2]. It uses the first half of TAN_LUT.
+static inline int atanOctant(u32 ratio)
 {
-    s32 par = (*(const s32 *)a);
-    const s32 *lut = b;
+    int i = 0;
 
-    if (par == lut[0] || (par > lut[0] && par < lut[1]))
-        return 0;
+    for (int step = LUT_SIZE / 4; step > 0; step >>= 1)
+    {
+        if ((u32)TAN_LUT[i + step] <= ratio)
+            i += step;
+    }
 
-    if (par < lut[0])
-        return -1;
+    u32 base = TAN_LUT[i];
+    u32 delta = TAN_LUT[i + 1] - base;
+    u32 frac = (((ratio - base) << ANGLE_FRACTION_BITS) + (delta >> 1)) / delta;
 
-    return 1;
-}
+    int angle = intToFixed(i, ANGLE_FRACTION_BITS) + frac;
 
-// TODO: Implement and test
+    // tan(45) is stored as slightly less than 1.0
+    if (angle > LIBNDS_QUARTER_ANGLE / 2)
+        angle = LIBNDS_QUARTER_ANGLE / 2;
 
-#if 0
+    return angle;
+}
 
-s32 atanLerp(s32 par)
+s16 atan2Lerp(s32 y, s32 x)
 {
-    bool neg = false;
-    if (par < 0)
-    {
-        par = -par;
-        neg = true;
-    }
-
-    // If the parameter is less than the second value in the LUT, we can be
-    // assured the binary search will return the first, which is zero.This zero
-    // will cause a divide by zero later, so this saves the trouble of dealing
-    // with that.
+    u32 ax = (x < 0) ? -(u32)x : (u32)x;
+    u32 ay = (y < 0) ? -(u32)y : (u32)y;
 
-    if (par < TAN_LUT[1])
-    {
+    if ((ax | ay) == 0)
         return 0;
-    }
 
-    // If the parameter is greater than the maximum value the LUT supports, we
-    // can be assured the binary search may fail as atanComp doesn't run bounds
-    // checking. It is faster to add this than fix that (in terms of runtime
-    // speed, I'm not just being lazy).
+    // Reduce the angle to the first octant, where the ratio is in [0, 1]
+    bool swap = ay > ax;
+    u32 num = swap ? ax : ay;
+    u32 den = swap ? ay : ax;
 
-    if (par >= TAN_LUT[LUT_SIZE])
+    // Make sure that the numerator can be shifted left 16 bits
+    int shift = 16 - __builtin_clz(den);
+    if (shift > 0)
     {
-        return inttof32(128);
+        num >>= shift;
+        den >>= shift;
     }
 
-    s32 *at = (s32 *)bsearch(&par, TAN_LUT, LUT_SIZE, sizeof(s32), atanComp);
+    int angle = atanOctant((num << TAN_BITSFRACTION) / den);
 
-    if (at == NULL)
-    {
-        at = TAN_LUT + LUT_SIZE;
-        neg = !neg;
-    }
+    if (swap)
+        angle = LIBNDS_QUARTER_ANGLE - angle;
+    if (x < 0)
+        angle = 2 * LIBNDS_QUARTER_ANGLE - angle;
 
-    s32 angle = divf32(mulf32(inttof32(at - TAN_LUT), par), (*at));
+    return (y < 0) ? -angle : angle;
+}
 
-    // returns a value in [-128, 128]
-    return (neg ? -angle : angle);
+s16 atanLerp(s32 par)
+{
+    return atan2Lerp(par, inttof32(1));
 }
-#endif
@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <nds/arm9/culling.h>
+#include <nds/arm9/video.h>
+#include <nds/arm9/videoGL.h>
+
+void cullFrustumFromClip(CullFrustum *frustum, const int *clip)
+{
+    // The DS multiplies row vectors by matrices, so clip coordinate j of a
+    // vertex is: x * clip[j] + y * clip[4 + j] + z * clip[8 + j] + clip[12 + j]
+    //
+    // A vertex is inside the frustum if -w <= x, y, z <= w, which gives the
+    // planes w + x >= 0, w - x >= 0, w + y >= 0, etc.
+    for (int p = 0; p < 6; p++)
+    {
+        int axis = p >> 1;
+        int sign = (p & 1) ? -1 : 1;
+
+        for (int i = 0; i < 4; i++)
+            frustum->planes[p][i] = clip[i * 4 + 3] + sign * clip[i * 4 + axis];
+    }
+}
+
+void cullFrustumFromGPU(CullFrustum *frustum)
+{
+    int clip[16];
+
+    glGetFixed(GL_GET_MATRIX_CLIP, clip);
+    cullFrustumFromClip(frustum, clip);
+}
+
+ARM_CODE int cullBoxFrustum(const CullFrustum *frustum, const CullBox *box)
+{
+    int32_t x0 = box->x, x1 = box->x + box->width;
+    int32_t y0 = box->y, y1 = box->y + box->height;
+    int32_t z0 = box->z, z1 = box->z + box->depth;
+
+    for (int p = 0; p < 6; p++)
+    {
+        const int32_t *plane = frustum->planes[p];
+
+        // Use the corner of the box that is the furthest along the normal of
+        // the plane. If it is outside, the whole box is outside.
+        int64_t dist = (int64_t)plane[0] * ((plane[0] >= 0) ? x1 : x0)
+                     + (int64_t)plane[1] * ((plane[1] >= 0) ? y1 : y0)
+                     + (int64_t)plane[2] * ((plane[2] >= 0) ? z1 : z0)
+                     + ((int64_t)plane[3] << 12);
+
+        if (dist < 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+// Sets bits [first, first + count) of a bitset, one word at a time
+static void cullSetRange(uint32_t *visible, size_t first, size_t count)
+{
+    size_t end = first + count;
+    size_t w = first / 32;
+
+    uint32_t mask = ~0u << (first % 32);
+    while (w < end / 32)
+    {
+        visible[w++] |= mask;
+        mask = ~0u;
+    }
+
+    if (end % 32)
+        visible[w] |= mask & ~(~0u << (end % 32));
+}
+
+static size_t cullCountBits(const uint32_t *visible, size_t words)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < words; i++)
+        count += __builtin_popcount(visible[i]);
+
+    return count;
+}
+
+size_t cullBoxesFrustum(const CullFrustum *frustum, const CullBox *boxes,
+                        size_t count, uint32_t *visible)
+{
+    size_t num_visible = 0;
+
+    memset(visible, 0, cullBitsetWords(count) * sizeof(uint32_t));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (cullBoxFrustum(frustum, &boxes[i]))
+        {
+            visible[i / 32] |= BIT(i % 32);
+            num_visible++;
+        }
+    }
+
+    return num_visible;
+}
+
+static void cullBoxTestSetup(void)
+{
+    // The box test needs a polygon with these flags to work properly. It only
+    // needs to be set once for all the tests.
+    glPolyFmt(POLY_RENDER_FAR_POLYS | POLY_RENDER_1DOT_POLYS);
+    glBegin(GL_TRIANGLES);
+    glEnd();
+}
+
+static inline void cullBoxPack(const CullBox *box, uint32_t *params)
+{
+    params[0] = VERTEX_PACK(box->x, box->y);
+    params[1] = VERTEX_PACK(box->z, box->width);
+    params[2] = VERTEX_PACK(box->height, box->depth);
+}
+
+size_t cullBoxesBoxTest(const CullBox *boxes, size_t count, uint32_t *visible)
+{
+    size_t num_visible = 0;
+    uint32_t params[3];
+
+    memset(visible, 0, cullBitsetWords(count) * sizeof(uint32_t));
+
+    if (count == 0)
+        return 0;
+
+    cullBoxTestSetup();
+
+    cullBoxPack(&boxes[0], params);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        GFX_BOX_TEST = params[0];
+        GFX_BOX_TEST = params[1];
+        GFX_BOX_TEST = params[2];
+
+        // Prepare the next box while the GPU tests this one
+        if (i + 1 < count)
+            cullBoxPack(&boxes[i + 1], params);
+
+        while (GFX_STATUS & GFX_STATUS_TEST_BUSY);
+
+        if (GFX_STATUS & GFX_STATUS_TEST_INSIDE)
+        {
+            visible[i / 32] |= BIT(i % 32);
+            num_visible++;
+        }
+    }
+
+    return num_visible;
+}
+
+size_t cullBVH(const CullBVHNode *nodes, size_t num_nodes, size_t num_objects,
+               const CullFrustum *frustum, uint32_t *visible)
+{
+    memset(visible, 0, cullBitsetWords(num_objects) * sizeof(uint32_t));
+
+    if (frustum == NULL)
+        cullBoxTestSetup();
+
+    size_t i = 0;
+    while (i < num_nodes)
+    {
+        const CullBVHNode *node = &nodes[i];
+        int inside;
+
+        if (frustum)
+        {
+            inside = cullBoxFrustum(frustum, &node->box);
+        }
+        else
+        {
+            uint32_t params[3];
+            cullBoxPack(&node->box, params);
+
+            GFX_BOX_TEST = params[0];
+            GFX_BOX_TEST = params[1];
+            GFX_BOX_TEST = params[2];
+
+            while (GFX_STATUS & GFX_STATUS_TEST_BUSY);
+
+            inside = GFX_STATUS & GFX_STATUS_TEST_INSIDE;
+        }
+
+        if (!inside)
+        {
+            // Skip all the children of this node
+            i = (node->skip > i) ? node->skip : i + 1;
+            continue;
+        }
+
+        // Objects outside of the bitset are ignored
+        if ((node->count > 0) && (node->first < num_objects))
+        {
+            size_t count = node->count;
+            if (count > num_objects - node->first)
+                count = num_objects - node->first;
+
+            cullSetRange(visible, node->first, count);
+        }
+
+        // Go to the first child, or to the next node if this is a leaf
+        i++;
+    }
+
+    // Count the bits instead of adding the sizes of the ranges, in case some
+    // objects belong to more than one leaf.
+    return cullCountBits(visible, cullBitsetWords(num_objects));
+}
@@ -0,0 +1,361 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <nds/arm9/displayList.h>
+#include <nds/arm9/sassert.h>
+#include <nds/arm9/trig_lut.h>
+#include <nds/arm9/video.h>
+#include <nds/arm9/videoGL.h>
+
+// Flags of the state cached in GLDisplayList
+#define LIST_VALID_VERTEX   (1 << 0)
+#define LIST_VALID_COLOR    (1 << 1)
+#define LIST_VALID_TEXCOORD (1 << 2)
+#define LIST_VALID_NORMAL   (1 << 3)
+#define LIST_VALID_POLY_FMT (1 << 4)
+#define LIST_VALID_TEX_FMT  (1 << 5)
+#define LIST_VALID_PAL_FMT  (1 << 6)
+
+#define FIFO_VERTEX_DIFF    REG2ID(GFX_VERTEX_DIFF)
+
+#define FIFO_MTX_MODE       REG2ID(MATRIX_CONTROL)
+#define FIFO_MTX_PUSH       REG2ID(MATRIX_PUSH)
+#define FIFO_MTX_POP        REG2ID(MATRIX_POP)
+#define FIFO_MTX_STORE      REG2ID(MATRIX_STORE)
+#define FIFO_MTX_RESTORE    REG2ID(MATRIX_RESTORE)
+#define FIFO_MTX_IDENTITY   REG2ID(MATRIX_IDENTITY)
+#define FIFO_MTX_LOAD_4x3   REG2ID(MATRIX_LOAD4x3)
+#define FIFO_MTX_MULT_4x3   REG2ID(MATRIX_MULT4x3)
+#define FIFO_MTX_MULT_3x3   REG2ID(MATRIX_MULT3x3)
+#define FIFO_MTX_SCALE      REG2ID(MATRIX_SCALE)
+#define FIFO_MTX_TRANS      REG2ID(MATRIX_TRANSLATE)
+
+// Adds a command ID to the list and reserves space for its parameters. It
+// returns a pointer to the space for the parameters, or NULL if the list is
+// full.
+static uint32_t *glListAdd(GLDisplayList *list, uint8_t id, size_t num_params)
+{
+    size_t needed = num_params + ((list->cmd_count == 0) ? 1 : 0);
+
+    if ((size_t)(list->end - list->ptr) < needed)
+    {
+        list->overflow = true;
+        return NULL;
+    }
+
+    // Each packed command word holds up to 4 command IDs, followed by all the
+    // parameters of those commands. Unused IDs are left as 0 (NOP).
+    if (list->cmd_count == 0)
+    {
+        list->cmd = list->ptr++;
+        *list->cmd = id;
+    }
+    else
+    {
+        *list->cmd |= (uint32_t)id << (list->cmd_count * 8);
+    }
+
+    list->cmd_count = (list->cmd_count + 1) & 3;
+
+    uint32_t *params = list->ptr;
+    list->ptr += num_params;
+    return params;
+}
+
+static void glListAdd1(GLDisplayList *list, uint8_t id, uint32_t param)
+{
+    uint32_t *p = glListAdd(list, id, 1);
+    if (p != NULL)
+        p[0] = param;
+}
+
+// Symbol defined by the linker
+extern char __dtcm_start[];
+
+void glListInit(GLDisplayList *list, void *buffer, size_t size)
+{
+    // glCallList() sends the list with DMA, which can't read DTCM
+    sassert(((uintptr_t)buffer - (uintptr_t)__dtcm_start) >= (16 * 1024),
+            "Display lists can't be in DTCM (the stack is in DTCM)");
+
+    list->buffer = buffer;
+    list->end = list->buffer + (size / sizeof(uint32_t));
+    list->cmd = NULL;
+    list->cmd_count = 0;
+    list->valid = 0;
+
+    if (size < sizeof(uint32_t))
+    {
+        list->ptr = list->end;
+        list->overflow = true;
+        return;
+    }
+
+    // The first word is reserved for the size of the list
+    list->buffer[0] = 0;
+    list->ptr = list->buffer + 1;
+    list->overflow = false;
+}
+
+int glListFinish(GLDisplayList *list)
+{
+    if (list->overflow)
+        return -1;
+
+    uint32_t size = list->ptr - (list->buffer + 1);
+    list->buffer[0] = size;
+
+    return size;
+}
+
+void glListCommand(GLDisplayList *list, uint8_t id, const uint32_t *params,
+                   size_t num_params)
+{
+    uint32_t *p = glListAdd(list, id, num_params);
+    if (p == NULL)
+        return;
+
+    for (size_t i = 0; i < num_params; i++)
+        p[i] = params[i];
+
+    // The command may modify any state, so forget everything
+    list->valid = 0;
+}
+
+void glListBegin(GLDisplayList *list, GL_GLBEGIN_ENUM mode)
+{
+    glListAdd1(list, FIFO_BEGIN, mode);
+
+    // Don't rely on the previous vertex for relative vertex commands
+    list->valid &= ~LIST_VALID_VERTEX;
+}
+
+void glListEnd(GLDisplayList *list)
+{
+    glListAdd(list, FIFO_END, 0);
+}
+
+void glListColor(GLDisplayList *list, rgb color)
+{
+    if ((list->valid & LIST_VALID_COLOR) && (list->color == color))
+        return;
+
+    glListAdd1(list, FIFO_COLOR, color);
+
+    // Sending the same normal again would replace this color, so it can't be
+    // skipped anymore.
+    list->color = color;
+    list->valid |= LIST_VALID_COLOR;
+    list->valid &= ~LIST_VALID_NORMAL;
+}
+
+void glListVertex3v16(GLDisplayList *list, v16 x, v16 y, v16 z)
+{
+    uint32_t *p;
+
+    if (list->valid & LIST_VALID_VERTEX)
+    {
+        // Commands that reuse one coordinate of the previous vertex
+        if (z == list->z)
+        {
+            glListAdd1(list, FIFO_VERTEX_XY, VERTEX_PACK(x, y));
+            goto end;
+        }
+        if (y == list->y)
+        {
+            glListAdd1(list, FIFO_VERTEX_XZ, VERTEX_PACK(x, z));
+            goto end;
+        }
+        if (x == list->x)
+        {
+            glListAdd1(list, FIFO_VERTEX_YZ, VERTEX_PACK(y, z));
+            goto end;
+        }
+
+        // Small differences can be sent as 10-bit signed values
+        int32_t dx = x - list->x;
+        int32_t dy = y - list->y;
+        int32_t dz = z - list->z;
+
+        if ((dx >= -512) && (dx <= 511) && (dy >= -512) && (dy <= 511) &&
+            (dz >= -512) && (dz <= 511))
+        {
+            glListAdd1(list, FIFO_VERTEX_DIFF, (dx & 0x3FF) | ((dy & 0x3FF) << 10)
+                                               | ((dz & 0x3FF) << 20));
+            goto end;
+        }
+    }
+
+    // VTX_10 uses 4.6 fixed point values, so it can only be used if the 6 least
+    // significant bits of all coordinates are zero.
+    if (((x | y | z) & 0x3F) == 0)
+    {
+        glListAdd1(list, FIFO_VERTEX10, ((x >> 6) & 0x3FF)
+                                        | (((y >> 6) & 0x3FF) << 10)
+                                        | (((z >> 6) & 0x3FF) << 20));
+        goto end;
+    }
+
+    p = glListAdd(list, FIFO_VERTEX16, 2);
+    if (p != NULL)
+    {
+        p[0] = VERTEX_PACK(x, y);
+        p[1] = (uint16_t)z;
+    }
+
+end:
+    list->x = x;
+    list->y = y;
+    list->z = z;
+    list->valid |= LIST_VALID_VERTEX;
+}
+
+void glListTexCoord2t16(GLDisplayList *list, t16 u, t16 v)
+{
+    uint32_t texcoord = TEXTURE_PACK(u, v);
+
+    if ((list->valid & LIST_VALID_TEXCOORD) && (list->texcoord == texcoord))
+        return;
+
+    glListAdd1(list, FIFO_TEX_COORD, texcoord);
+
+    // Same as with the color, a normal may replace the texture coordinates
+    list->texcoord = texcoord;
+    list->valid |= LIST_VALID_TEXCOORD;
+    list->valid &= ~LIST_VALID_NORMAL;
+}
+
+void glListNormal(GLDisplayList *list, u32 normal)
+{
+    if ((list->valid & LIST_VALID_NORMAL) && (list->normal == normal))
+        return;
+
+    glListAdd1(list, FIFO_NORMAL, normal);
+
+    // The normal command calculates a new vertex color from the lights, and it
+    // may also modify the texture coordinates (if they are generated from
+    // normals).
+    list->normal = normal;
+    list->valid |= LIST_VALID_NORMAL;
+    list->valid &= ~(LIST_VALID_COLOR | LIST_VALID_TEXCOORD);
+}
+
+void glListPolyFmt(GLDisplayList *list, u32 params)
+{
+    if ((list->valid & LIST_VALID_POLY_FMT) && (list->poly_fmt == params))
+        return;
+
+    glListAdd1(list, FIFO_POLY_FORMAT, params);
+
+    list->poly_fmt = params;
+    list->valid |= LIST_VALID_POLY_FMT;
+}
+
+void glListTexFormat(GLDisplayList *list, u32 format)
+{
+    if ((list->valid & LIST_VALID_TEX_FMT) && (list->tex_fmt == format))
+        return;
+
+    glListAdd1(list, FIFO_TEX_FORMAT, format);
+
+    list->tex_fmt = format;
+    list->valid |= LIST_VALID_TEX_FMT;
+}
+
+void glListPalFormat(GLDisplayList *list, u32 format)
+{
+    if ((list->valid & LIST_VALID_PAL_FMT) && (list->pal_fmt == format))
+        return;
+
+    glListAdd1(list, FIFO_PAL_FORMAT, format);
+
+    list->pal_fmt = format;
+    list->valid |= LIST_VALID_PAL_FMT;
+}
+
+void glListMatrixMode(GLDisplayList *list, GL_MATRIX_MODE_ENUM mode)
+{
+    glListAdd1(list, FIFO_MTX_MODE, mode);
+}
+
+void glListLoadIdentity(GLDisplayList *list)
+{
+    glListAdd(list, FIFO_MTX_IDENTITY, 0);
+}
+
+void glListPushMatrix(GLDisplayList *list)
+{
+    glListAdd(list, FIFO_MTX_PUSH, 0);
+}
+
+void glListPopMatrix(GLDisplayList *list, int num)
+{
+    glListAdd1(list, FIFO_MTX_POP, num);
+}
+
+void glListStoreMatrix(GLDisplayList *list, int index)
+{
+    glListAdd1(list, FIFO_MTX_STORE, index);
+}
+
+void glListRestoreMatrix(GLDisplayList *list, int index)
+{
+    glListAdd1(list, FIFO_MTX_RESTORE, index);
+}
+
+static void glListAddN(GLDisplayList *list, uint8_t id, const int *values,
+                       size_t count)
+{
+    uint32_t *p = glListAdd(list, id, count);
+    if (p == NULL)
+        return;
+
+    for (size_t i = 0; i < count; i++)
+        p[i] = values[i];
+}
+
+void glListTranslatef32(GLDisplayList *list, int x, int y, int z)
+{
+    const int v[3] = { x, y, z };
+    glListAddN(list, FIFO_MTX_TRANS, v, 3);
+}
+
+void glListScalef32(GLDisplayList *list, int x, int y, int z)
+{
+    const int v[3] = { x, y, z };
+    glListAddN(list, FIFO_MTX_SCALE, v, 3);
+}
+
+void glListLoadMatrix4x3(GLDisplayList *list, const m4x3 *m)
+{
+    glListAddN(list, FIFO_MTX_LOAD_4x3, m->m, 12);
+}
+
+void glListMultMatrix4x3(GLDisplayList *list, const m4x3 *m)
+{
+    glListAddN(list, FIFO_MTX_MULT_4x3, m->m, 12);
+}
+
+void glListMultMatrix3x3(GLDisplayList *list, const m3x3 *m)
+{
+    glListAddN(list, FIFO_MTX_MULT_3x3, m->m, 9);
+}
+
+void glListRotateZi(GLDisplayList *list, int angle)
+{
+    int sine = sinLerp(angle);
+    int cosine = cosLerp(angle);
+
+    const m3x3 m = {{
+        cosine, sine, 0,
+        -sine, cosine, 0,
+        0, 0, inttof32(1)
+    }};
+
+    glListMultMatrix3x3(list, &m);
+}
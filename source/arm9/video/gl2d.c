@@ -9,7 +9,15 @@
 //
 // A very small and simple DS rendering lib using the 3d core to render 2D stuff
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include <gl2d.h>
+#include <nds/memtrace.h>
+
+// Scale factor used by glBegin2D() for the projection matrix. Check the
+// comments in glBegin2D() for more information.
+#define GL2D_SCALE_FACTOR 2
 
 // Our static global variable used for depth values since we cannot disable
 // depth testing in the DS hardware. This value is incremented for every draw
@@ -17,6 +25,299 @@
 static v16 g_depth = 0;
 int gCurrentTexture = 0;
 
+// Batched rendering
+// -----------------
+//
+// When batching is enabled, quads aren't sent to the GPU right away. They are
+// stored in a packed command list that is sent with glCallList() when the
+// texture changes, when the buffer is full, or when glEnd2D() is called. All
+// quads of the list are drawn inside the same GL_QUADS block.
+//
+// Rotation and scaling are done by the CPU so that there is no need to modify
+// the modelview matrix for each sprite. The list scales the modelview matrix
+// down by (1 << GL2D_SCALE_FACTOR) so that the vertices of the list can be
+// specified with sub-pixel accuracy, like when the GPU does the
+// transformations.
+
+// Maximum number of words used by one quad, including the commands that start
+// a list.
+#define GL2D_BATCH_QUAD_WORDS   24
+// Maximum number of words used by the commands that end a list.
+#define GL2D_BATCH_END_WORDS    4
+// Average number of words used by a quad. Used to calculate the buffer size.
+#define GL2D_BATCH_AVG_WORDS    12
+
+typedef struct
+{
+    uint32_t *buffer;   // buffer[0] is the size of the list in words
+    uint32_t *ptr;      // Write pointer
+    uint32_t *end;      // End of the buffer
+    uint32_t *cmd;      // Packed command word being filled
+    int cmd_count;      // Number of commands in the packed command word
+    bool open;          // The commands that start the list have been added
+    bool color_dirty;   // The vertex color isn't white
+} gl2d_batch_state;
+
+static gl2d_batch_state g_batch;
+
+// Vertices of a quad, in the order used by the GL2D sprite functions
+typedef struct
+{
+    int32_t x[4];   // Sub-pixel coordinates
+    int32_t y[4];
+    uint32_t t[4];  // Packed texture coordinates
+    int color[4];
+} gl2d_quad;
+
+typedef enum
+{
+    GL2D_QUAD_TEXTURED, // Textured quad drawn with the current vertex color
+    GL2D_QUAD_FLAT,     // Untextured quad of color[0]
+    GL2D_QUAD_GRADIENT  // Untextured quad, one color per vertex
+} gl2d_quad_mode;
+
+#define GL2D_TEXCOORD(u, v) (((uint32_t)(v) << 20) | (((u) << 4) & 0xFFFF))
+
+static inline void gl2d_batch_cmd(uint8_t id)
+{
+    if (g_batch.cmd_count == 0)
+    {
+        g_batch.cmd = g_batch.ptr++;
+        *g_batch.cmd = id;
+    }
+    else
+    {
+        *g_batch.cmd |= (uint32_t)id << (g_batch.cmd_count * 8);
+    }
+
+    g_batch.cmd_count = (g_batch.cmd_count + 1) & 3;
+}
+
+static inline void gl2d_batch_param(uint32_t param)
+{
+    *g_batch.ptr++ = param;
+}
+
+static void gl2d_batch_reset(void)
+{
+    g_batch.ptr = g_batch.buffer + 1;
+    g_batch.cmd_count = 0;
+    g_batch.open = false;
+}
+
+static void gl2d_batch_flush(void)
+{
+    if (!g_batch.open)
+        return;
+
+    gl2d_batch_cmd(FIFO_END);
+
+    // Leave the vertex color as it would be after drawing the quads one by one
+    if (g_batch.color_dirty)
+    {
+        gl2d_batch_cmd(FIFO_COLOR);
+        gl2d_batch_param(0x7FFF);
+        g_batch.color_dirty = false;
+    }
+
+    gl2d_batch_cmd(REG2ID(MATRIX_POP));
+    gl2d_batch_param(1);
+
+    g_batch.buffer[0] = g_batch.ptr - (g_batch.buffer + 1);
+    glCallList(g_batch.buffer);
+
+    gl2d_batch_reset();
+}
+
+// Flushes the batch and binds the specified texture if it isn't active
+static void gl2d_batch_texture(int texture)
+{
+    if (texture == gCurrentTexture)
+        return;
+
+    gl2d_batch_flush();
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    gCurrentTexture = texture;
+}
+
+static void gl2d_batch_quad(const gl2d_quad *q, gl2d_quad_mode mode)
+{
+    if (g_batch.ptr + GL2D_BATCH_QUAD_WORDS + GL2D_BATCH_END_WORDS > g_batch.end)
+        gl2d_batch_flush();
+
+    if (!g_batch.open)
+    {
+        gl2d_batch_cmd(REG2ID(MATRIX_PUSH));
+
+        gl2d_batch_cmd(REG2ID(MATRIX_SCALE));
+        gl2d_batch_param(inttof32(1) >> GL2D_SCALE_FACTOR);
+        gl2d_batch_param(inttof32(1) >> GL2D_SCALE_FACTOR);
+        gl2d_batch_param(inttof32(1));
+
+        gl2d_batch_cmd(FIFO_BEGIN);
+        gl2d_batch_param(GL_QUADS);
+
+        g_batch.open = true;
+    }
+
+    if (mode == GL2D_QUAD_FLAT)
+    {
+        gl2d_batch_cmd(FIFO_COLOR);
+        gl2d_batch_param(q->color[0]);
+        g_batch.color_dirty = true;
+    }
+    else if ((mode == GL2D_QUAD_TEXTURED) && g_batch.color_dirty)
+    {
+        gl2d_batch_cmd(FIFO_COLOR);
+        gl2d_batch_param(0x7FFF);
+        g_batch.color_dirty = false;
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (mode == GL2D_QUAD_GRADIENT)
+        {
+            gl2d_batch_cmd(FIFO_COLOR);
+            gl2d_batch_param(q->color[i]);
+        }
+        else if (mode == GL2D_QUAD_TEXTURED)
+        {
+            gl2d_batch_cmd(FIFO_TEX_COORD);
+            gl2d_batch_param(q->t[i]);
+        }
+
+        uint32_t xy = ((uint32_t)(uint16_t)q->y[i] << 16) | (uint16_t)q->x[i];
+
+        if (i == 0)
+        {
+            // Use the 16-bit vertex command to set the depth of the quad
+            gl2d_batch_cmd(FIFO_VERTEX16);
+            gl2d_batch_param(xy);
+            gl2d_batch_param((uint16_t)g_depth);
+        }
+        else
+        {
+            gl2d_batch_cmd(FIFO_VERTEX_XY);
+            gl2d_batch_param(xy);
+        }
+    }
+
+    if (mode == GL2D_QUAD_GRADIENT)
+        g_batch.color_dirty = true;
+}
+
+// Sets the vertices of an axis-aligned quad
+static void gl2d_quad_rect(gl2d_quad *q, int x1, int y1, int x2, int y2)
+{
+    q->x[0] = q->x[1] = x1 << GL2D_SCALE_FACTOR;
+    q->x[2] = q->x[3] = x2 << GL2D_SCALE_FACTOR;
+    q->y[0] = q->y[3] = y1 << GL2D_SCALE_FACTOR;
+    q->y[1] = q->y[2] = y2 << GL2D_SCALE_FACTOR;
+}
+
+// Sets the vertices of a quad with corners (x1, y1) and (x2, y2), rotated and
+// scaled around (0, 0), and translated to (x, y). This is the same
+// transformation done by glSpriteRotateScaleXY() with the modelview matrix.
+static void gl2d_quad_transform(gl2d_quad *q, int x, int y,
+                                int x1, int y1, int x2, int y2,
+                                s32 angle, s32 scaleX, s32 scaleY)
+{
+    const int shift = 24 - GL2D_SCALE_FACTOR;
+    const int64_t round = (int64_t)1 << (shift - 1);
+
+    int32_t sine = sinLerp(angle);
+    int32_t cosine = cosLerp(angle);
+
+    const int cx[4] = { x1, x1, x2, x2 };
+    const int cy[4] = { y1, y2, y2, y1 };
+
+    for (int i = 0; i < 4; i++)
+    {
+        int32_t rx = cx[i] * cosine - cy[i] * sine;
+        int32_t ry = cx[i] * sine + cy[i] * cosine;
+
+        q->x[i] = (x << GL2D_SCALE_FACTOR)
+                + (int32_t)(((int64_t)rx * scaleX + round) >> shift);
+        q->y[i] = (y << GL2D_SCALE_FACTOR)
+                + (int32_t)(((int64_t)ry * scaleY + round) >> shift);
+    }
+}
+
+// Sets the texture coordinates of a sprite
+static void gl2d_quad_texcoords(gl2d_quad *q, int flipmode, const glImage *spr)
+{
+    int u1 = spr->u_off + ((flipmode & GL_FLIP_H) ? spr->width - 1 : 0);
+    int u2 = spr->u_off + ((flipmode & GL_FLIP_H) ? 0 : spr->width);
+    int v1 = spr->v_off + ((flipmode & GL_FLIP_V) ? spr->height - 1 : 0);
+    int v2 = spr->v_off + ((flipmode & GL_FLIP_V) ? 0 : spr->height);
+
+    q->t[0] = GL2D_TEXCOORD(u1, v1);
+    q->t[1] = GL2D_TEXCOORD(u1, v2);
+    q->t[2] = GL2D_TEXCOORD(u2, v2);
+    q->t[3] = GL2D_TEXCOORD(u2, v1);
+}
+
+static void gl2d_batch_sprite(int x, int y, s32 angle, s32 scaleX, s32 scaleY,
+                              int flipmode, const glImage *spr)
+{
+    int s_half_x = ((spr->width) + (spr->width & 1)) / 2;
+    int s_half_y = ((spr->height) + (spr->height & 1)) / 2;
+
+    gl2d_quad q;
+
+    gl2d_batch_texture(spr->textureID);
+    gl2d_quad_transform(&q, x, y, -s_half_x, -s_half_y, s_half_x, s_half_y,
+                        angle, scaleX, scaleY);
+    gl2d_quad_texcoords(&q, flipmode, spr);
+    gl2d_batch_quad(&q, GL2D_QUAD_TEXTURED);
+
+    g_depth++;
+}
+
+bool glBatch2DEnable(size_t max_quads)
+{
+    glBatch2DDisable();
+
+    size_t words = 1 + (max_quads * GL2D_BATCH_AVG_WORDS)
+                 + GL2D_BATCH_QUAD_WORDS + GL2D_BATCH_END_WORDS;
+
+    g_batch.buffer = memTraceMalloc(words * sizeof(uint32_t),
+                                    MEMTRACE_TAG_VIDEOGL);
+    if (g_batch.buffer == NULL)
+        return false;
+
+    g_batch.end = g_batch.buffer + words;
+    g_batch.color_dirty = false;
+    gl2d_batch_reset();
+
+    return true;
+}
+
+void glBatch2DDisable(void)
+{
+    if (g_batch.buffer == NULL)
+        return;
+
+    gl2d_batch_flush();
+
+    memTraceFree(g_batch.buffer);
+    g_batch.buffer = NULL;
+}
+
+void glBatch2DFlush(void)
+{
+    if (g_batch.buffer == NULL)
+        return;
+
+    gl2d_batch_flush();
+}
+
+bool glBatch2DIsEnabled(void)
+{
+    return g_batch.buffer != NULL;
+}
+
 void glScreen2D(void)
 {
     // Initialize gl
@@ -61,6 +362,10 @@ void glScreen2D(void)
 
 void glBegin2D(void)
 {
+    // If glEnd2D() hasn't been called, there may be quads in the batch that
+    // were added with the previous state. Draw them before changing anything.
+    glBatch2DFlush();
+
     // Reset texture matrix just in case we did some funky stuff with it
     glMatrixMode(GL_TEXTURE);
     glLoadIdentity();
@@ -102,7 +407,7 @@ void glBegin2D(void)
     // In my tests, Y axis distortion starts to happen with a factor of 4, so a
     // factor of 2 should be safe and reduce enough flickering.
 
-    int factor = 2;
+    int factor = GL2D_SCALE_FACTOR;
 
     // Downscale projection matrix
     glOrthof32(0, SCREEN_WIDTH << factor, SCREEN_HEIGHT << factor, 0, -inttof32(1), inttof32(1));
@@ -129,10 +434,15 @@ void glBegin2D(void)
     gCurrentTexture = 0; // Set current texture to 0
     // Set depth to 0. We need this var since we cannot disable depth testing
     g_depth = 0;
+
+    // The vertex color has just been set to white
+    g_batch.color_dirty = false;
 }
 
 void glEnd2D(void)
 {
+    glBatch2DFlush();
+
     // Restore 3d matrices and set current matrix to modelview
     glMatrixMode(GL_PROJECTION);
     glPopMatrix(1);
@@ -142,6 +452,8 @@ void glEnd2D(void)
 
 void glPutPixel(int x, int y, int color)
 {
+    glBatch2DFlush();
+
     glBindTexture(0, 0);
     glColor(color);
     glBegin(GL_TRIANGLES);
@@ -156,6 +468,8 @@ void glPutPixel(int x, int y, int color)
 
 void glLine(int x1, int y1, int x2, int y2, int color)
 {
+    glBatch2DFlush();
+
     x2++;
     y2++;
 
@@ -173,6 +487,8 @@ void glLine(int x1, int y1, int x2, int y2, int color)
 
 void glBox(int x1, int y1, int x2, int y2, int color)
 {
+    glBatch2DFlush();
+
     x2++;
     y2++;
 
@@ -209,6 +525,17 @@ void glBoxFilled(int x1, int y1, int x2, int y2, int color)
     x2++;
     y2++;
 
+    if (g_batch.buffer != NULL)
+    {
+        gl2d_quad q;
+        gl2d_batch_texture(0);
+        gl2d_quad_rect(&q, x1, y1, x2, y2);
+        q.color[0] = color;
+        gl2d_batch_quad(&q, GL2D_QUAD_FLAT);
+        g_depth++;
+        return;
+    }
+
     glBindTexture(0, 0);
     glColor(color);
     glBegin(GL_QUADS);
@@ -230,6 +557,20 @@ void glBoxFilledGradient(int x1, int y1, int x2, int y2,
     x2++;
     y2++;
 
+    if (g_batch.buffer != NULL)
+    {
+        gl2d_quad q;
+        gl2d_batch_texture(0);
+        gl2d_quad_rect(&q, x1, y1, x2, y2);
+        q.color[0] = color1;
+        q.color[1] = color2;
+        q.color[2] = color3;
+        q.color[3] = color4;
+        gl2d_batch_quad(&q, GL2D_QUAD_GRADIENT);
+        g_depth++;
+        return;
+    }
+
     glBindTexture(0,0);
     glBegin(GL_QUADS);
         glColor(color1);
@@ -250,6 +591,8 @@ void glBoxFilledGradient(int x1, int y1, int x2, int y2,
 
 void glTriangle(int x1, int y1, int x2, int y2, int x3, int y3, int color)
 {
+    glBatch2DFlush();
+
     glBindTexture(0, 0);
     glColor(color);
     glBegin(GL_TRIANGLES);
@@ -274,6 +617,8 @@ void glTriangle(int x1, int y1, int x2, int y2, int x3, int y3, int color)
 
 void glTriangleFilled(int x1, int y1, int x2, int y2, int x3, int y3, int color)
 {
+    glBatch2DFlush();
+
     glBindTexture(0, 0);
     glColor(color);
     glBegin(GL_TRIANGLES);
@@ -291,6 +636,8 @@ void glTriangleFilled(int x1, int y1, int x2, int y2, int x3, int y3, int color)
 void glTriangleFilledGradient(int x1, int y1, int x2, int y2, int x3, int y3,
                               int color1, int color2, int color3)
 {
+    glBatch2DFlush();
+
     glBindTexture(0, 0);
     glBegin(GL_TRIANGLES);
         // Use 3i for first vertex so that we increment HW depth
@@ -309,6 +656,17 @@ void glTriangleFilledGradient(int x1, int y1, int x2, int y2, int x3, int y3,
 
 void glSprite(int x, int y, int flipmode, const glImage *spr)
 {
+    if (g_batch.buffer != NULL)
+    {
+        gl2d_quad q;
+        gl2d_batch_texture(spr->textureID);
+        gl2d_quad_rect(&q, x, y, x + spr->width, y + spr->height);
+        gl2d_quad_texcoords(&q, flipmode, spr);
+        gl2d_batch_quad(&q, GL2D_QUAD_TEXTURED);
+        g_depth++;
+        return;
+    }
+
     int x1 = x;
     int y1 = y;
     int x2 = x + spr->width;
@@ -339,6 +697,18 @@ void glSprite(int x, int y, int flipmode, const glImage *spr)
 
 void glSpriteScale(int x, int y, s32 scale, int flipmode, const glImage *spr)
 {
+    if (g_batch.buffer != NULL)
+    {
+        gl2d_quad q;
+        gl2d_batch_texture(spr->textureID);
+        gl2d_quad_transform(&q, x, y, 0, 0, spr->width, spr->height,
+                            0, scale, scale);
+        gl2d_quad_texcoords(&q, flipmode, spr);
+        gl2d_batch_quad(&q, GL2D_QUAD_TEXTURED);
+        g_depth++;
+        return;
+    }
+
     int x1 = 0;
     int y1 = 0;
     int x2 = spr->width;
@@ -380,6 +750,18 @@ void glSpriteScale(int x, int y, s32 scale, int flipmode, const glImage *spr)
 void glSpriteScaleXY(int x, int y, s32 scaleX, s32 scaleY, int flipmode,
                      const glImage *spr)
 {
+    if (g_batch.buffer != NULL)
+    {
+        gl2d_quad q;
+        gl2d_batch_texture(spr->textureID);
+        gl2d_quad_transform(&q, x, y, 0, 0, spr->width, spr->height,
+                            0, scaleX, scaleY);
+        gl2d_quad_texcoords(&q, flipmode, spr);
+        gl2d_batch_quad(&q, GL2D_QUAD_TEXTURED);
+        g_depth++;
+        return;
+    }
+
     int x1 = 0;
     int y1 = 0;
     int x2 = spr->width;
@@ -420,6 +802,12 @@ void glSpriteScaleXY(int x, int y, s32 scaleX, s32 scaleY, int flipmode,
 
 void glSpriteRotate(int x, int y, s32 angle, int flipmode, const glImage *spr)
 {
+    if (g_batch.buffer != NULL)
+    {
+        gl2d_batch_sprite(x, y, angle, inttof32(1), inttof32(1), flipmode, spr);
+        return;
+    }
+
     int s_half_x = ((spr->width) + (spr->width & 1)) / 2;
     int s_half_y = ((spr->height) + (spr->height & 1)) / 2;
 
@@ -466,6 +854,12 @@ void glSpriteRotate(int x, int y, s32 angle, int flipmode, const glImage *spr)
 void glSpriteRotateScale(int x, int y, s32 angle, s32 scale, int flipmode,
                          const glImage *spr)
 {
+    if (g_batch.buffer != NULL)
+    {
+        gl2d_batch_sprite(x, y, angle, scale, scale, flipmode, spr);
+        return;
+    }
+
     int s_half_x = ((spr->width) + (spr->width & 1)) / 2;
     int s_half_y = ((spr->height) + (spr->height & 1)) / 2;
 
@@ -514,6 +908,12 @@ void glSpriteRotateScale(int x, int y, s32 angle, s32 scale, int flipmode,
 void glSpriteRotateScaleXY(int x, int y, s32 angle, s32 scaleX, s32 scaleY,
                            int flipmode, const glImage *spr)
 {
+    if (g_batch.buffer != NULL)
+    {
+        gl2d_batch_sprite(x, y, angle, scaleX, scaleY, flipmode, spr);
+        return;
+    }
+
 
     int s_half_x = ((spr->width) + (spr->width & 1)) / 2;
     int s_half_y = ((spr->height) + (spr->height & 1))  / 2;
@@ -573,6 +973,35 @@ void glSpriteStretchHorizontal(int x, int y, int length_x, const glImage *spr)
     int v1 = spr->v_off;
     int v2 = spr->v_off + spr->height;
 
+    if (g_batch.buffer != NULL)
+    {
+        gl2d_quad q;
+        gl2d_batch_texture(spr->textureID);
+
+        // Left
+        gl2d_quad_rect(&q, x1, y1, x + su, y2);
+        q.t[0] = GL2D_TEXCOORD(u1, v1);
+        q.t[1] = GL2D_TEXCOORD(u1, v2);
+        q.t[2] = GL2D_TEXCOORD(u1 + su, v2);
+        q.t[3] = GL2D_TEXCOORD(u1 + su, v1);
+        gl2d_batch_quad(&q, GL2D_QUAD_TEXTURED);
+
+        // Center
+        gl2d_quad_rect(&q, x + su, y1, x2 - su - 1, y2);
+        q.t[0] = q.t[3];
+        q.t[1] = q.t[2];
+        gl2d_batch_quad(&q, GL2D_QUAD_TEXTURED);
+
+        // Right
+        gl2d_quad_rect(&q, x2 - su - 1, y1, x2, y2);
+        q.t[2] = GL2D_TEXCOORD(u2, v2);
+        q.t[3] = GL2D_TEXCOORD(u2, v1);
+        gl2d_batch_quad(&q, GL2D_QUAD_TEXTURED);
+
+        g_depth++;
+        return;
+    }
+
     if (spr->textureID != gCurrentTexture)
     {
         glBindTexture(GL_TEXTURE_2D, spr->textureID);
@@ -645,6 +1074,24 @@ void glSpriteOnQuad(int x1, int y1, int x2, int y2, int x3, int y3, int x4, int
     int v1 = spr->v_off + ((flipmode & GL_FLIP_V) ? spr->height - 1 : 0);
     int v2 = spr->v_off + ((flipmode & GL_FLIP_V) ? 0 : spr->height);
 
+    if (g_batch.buffer != NULL)
+    {
+        gl2d_quad q = {
+            .x = { x1 << GL2D_SCALE_FACTOR, x2 << GL2D_SCALE_FACTOR,
+                   x3 << GL2D_SCALE_FACTOR, x4 << GL2D_SCALE_FACTOR },
+            .y = { y1 << GL2D_SCALE_FACTOR, y2 << GL2D_SCALE_FACTOR,
+                   y3 << GL2D_SCALE_FACTOR, y4 << GL2D_SCALE_FACTOR },
+            .t = { GL2D_TEXCOORD(u1 + uoff, v1 + voff),
+                   GL2D_TEXCOORD(u1 + uoff, v2 + voff),
+                   GL2D_TEXCOORD(u2 + uoff, v2 + voff),
+                   GL2D_TEXCOORD(u2 + uoff, v1 + voff) }
+        };
+        gl2d_batch_texture(spr->textureID);
+        gl2d_batch_quad(&q, GL2D_QUAD_TEXTURED);
+        g_depth++;
+        return;
+    }
+
     if (spr->textureID != gCurrentTexture)
     {
         glBindTexture(GL_TEXTURE_2D, spr->textureID);
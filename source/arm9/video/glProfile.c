@@ -0,0 +1,188 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <nds/arm9/video.h>
+#include <nds/arm9/videoGL.h>
+#include <nds/interrupts.h>
+#include <nds/memtrace.h>
+#include <nds/system.h>
+#include <nds/timers.h>
+
+// Size of the texture VRAM managed by videoGL (VRAM_A to VRAM_D)
+#define TEXTURE_VRAM_SIZE   (512 * 1024)
+
+GLProfileFrame glProfileCounters;
+
+static struct
+{
+    bool active;
+    int timer;
+    uint16_t reload;            // Reload value of the timer
+    uint32_t period;            // Timer ticks between samples
+
+    volatile uint32_t overflows; // Number of samples taken
+    uint32_t level_sum;         // Sum of GX FIFO levels of this frame
+    uint32_t last_ticks;        // Time of the end of the previous frame
+    uint32_t frame;
+
+    GLProfileFrame *frames;     // Ring buffer of recorded frames
+    size_t capacity;
+    size_t next;
+    size_t count;
+} prof;
+
+static void glProfileSample(void)
+{
+    uint32_t status = GFX_STATUS;
+
+    prof.overflows++;
+
+    glProfileCounters.fifo_samples++;
+    if (status & BIT(24)) // Command FIFO full
+        glProfileCounters.fifo_full_samples++;
+
+    prof.level_sum += (status >> 16) & 0x1FF; // Number of commands in the FIFO
+}
+
+// Returns the number of timer ticks since the profiler was started
+static uint32_t glProfileTicks(void)
+{
+    int oldIME = enterCriticalSection();
+
+    uint32_t overflows = prof.overflows;
+    uint16_t elapsed = TIMER_DATA(prof.timer) - prof.reload;
+
+    // If the timer has overflowed but the interrupt hasn't been handled yet,
+    // the value of the counter has been reset.
+    if ((REG_IF & IRQ_TIMER(prof.timer)) && (elapsed < (prof.period / 2)))
+        overflows++;
+
+    leaveCriticalSection(oldIME);
+
+    return (overflows * prof.period) + elapsed;
+}
+
+bool glProfileStart(size_t num_frames, int timer, unsigned int sample_rate)
+{
+    glProfileStop();
+
+    if ((num_frames == 0) || (timer < 0) || (timer > 3))
+        return false;
+
+    // The timer can't count more than 0x10000 ticks between samples
+    if (sample_rate < 512)
+        return false;
+
+    prof.frames = memTraceCalloc(num_frames, sizeof(GLProfileFrame),
+                                 MEMTRACE_TAG_VIDEOGL);
+    if (prof.frames == NULL)
+        return false;
+
+    prof.capacity = num_frames;
+    prof.next = 0;
+    prof.count = 0;
+    prof.frame = 0;
+
+    prof.timer = timer;
+    prof.reload = timerFreqToTicks_1(sample_rate);
+    prof.period = 0x10000 - prof.reload;
+    prof.overflows = 0;
+    prof.level_sum = 0;
+
+    memset(&glProfileCounters, 0, sizeof(glProfileCounters));
+
+    timerStart(timer, ClockDivider_1, prof.reload, glProfileSample);
+
+    prof.last_ticks = glProfileTicks();
+    prof.active = true;
+
+    return true;
+}
+
+void glProfileStop(void)
+{
+    if (!prof.active)
+        return;
+
+    prof.active = false;
+
+    timerStop(prof.timer);
+    irqDisable(IRQ_TIMER(prof.timer));
+    irqClear(IRQ_TIMER(prof.timer));
+
+    memTraceFree(prof.frames);
+    prof.frames = NULL;
+}
+
+void glProfileFrame(void)
+{
+    if (!prof.active)
+        return;
+
+    GLProfileFrame *f = &glProfileCounters;
+
+    f->flush_vcount = REG_VCOUNT;
+
+    // The polygon and vertex counts are only final when the geometry engine
+    // has processed all commands.
+    uint32_t start = glProfileTicks();
+    while (GFX_BUSY);
+    uint32_t end = glProfileTicks();
+
+    // The ARM9 runs at twice the frequency of the timers
+    f->drain_cycles = (end - start) * 2;
+    f->frame_cycles = (end - prof.last_ticks) * 2;
+    prof.last_ticks = end;
+
+    f->polygons = GFX_POLYGON_RAM_USAGE;
+    f->vertices = GFX_VERTEX_RAM_USAGE;
+
+    int vram_free = 0;
+    glGetInt(GL_GET_TEXTURE_VRAM_FREE, &vram_free);
+    f->texture_vram_used = TEXTURE_VRAM_SIZE - vram_free;
+
+    int oldIME = enterCriticalSection();
+
+    if (f->fifo_samples > 0)
+        f->fifo_avg_level = prof.level_sum / f->fifo_samples;
+    f->fifo_stall_cycles = f->fifo_full_samples * prof.period * 2;
+    f->frame = prof.frame++;
+
+    prof.frames[prof.next] = *f;
+    prof.next = (prof.next + 1) % prof.capacity;
+    if (prof.count < prof.capacity)
+        prof.count++;
+
+    memset(f, 0, sizeof(GLProfileFrame));
+    prof.level_sum = 0;
+
+    leaveCriticalSection(oldIME);
+}
+
+size_t glProfileGetFrames(GLProfileFrame *frames, size_t max_frames)
+{
+    if (!prof.active || (frames == NULL))
+        return 0;
+
+    int oldIME = enterCriticalSection();
+
+    size_t count = (prof.count < max_frames) ? prof.count : max_frames;
+
+    // Start from the oldest of the frames that fit in the array
+    size_t index = (prof.next + prof.capacity - count) % prof.capacity;
+    for (size_t i = 0; i < count; i++)
+    {
+        frames[i] = prof.frames[index];
+        index = (index + 1) % prof.capacity;
+    }
+
+    leaveCriticalSection(oldIME);
+
+    return count;
+}
@@ -0,0 +1,314 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <nds/arm9/cache.h>
+#include <nds/arm9/hdma.h>
+#include <nds/arm9/math.h>
+#include <nds/arm9/trig_lut.h>
+#include <nds/dma.h>
+#include <nds/interrupts.h>
+#include <nds/memtrace.h>
+
+#define HDMA_NUM_CHANNELS   4
+
+typedef struct
+{
+    volatile void *dst;
+    uint8_t *buffer[2];
+    uint16_t entry_size;
+    uint8_t front;
+    bool swap_pending;
+    bool running;       // False until the first call to hdmaSwap()
+} HdmaEffect;
+
+static HdmaEffect hdma_effects[HDMA_NUM_CHANNELS];
+
+// The DMA copies entry N + 1 at the end of scanline N, so the table has one
+// extra entry that is copied at the end of the last scanline.
+static size_t hdmaBufferSize(size_t entry_size)
+{
+    size_t size = (HDMA_LINES + 1) * entry_size;
+
+    // Keep each buffer in its own cache lines
+    return (size + 31) & ~31;
+}
+
+bool hdmaStart(int channel, volatile void *dst, size_t bytes_per_line)
+{
+    if ((channel < 0) || (channel >= HDMA_NUM_CHANNELS) || (dst == NULL))
+        return false;
+
+    if ((bytes_per_line == 0) || (bytes_per_line & 1))
+        return false;
+
+    hdmaStop(channel);
+
+    size_t size = hdmaBufferSize(bytes_per_line);
+
+    uint8_t *mem = memTraceMemalign(32, 2 * size, MEMTRACE_TAG_HDMA);
+    if (mem == NULL)
+        return false;
+
+    memset(mem, 0, 2 * size);
+
+    HdmaEffect *e = &hdma_effects[channel];
+
+    e->dst = dst;
+    e->buffer[0] = mem;
+    e->buffer[1] = mem + size;
+    e->entry_size = bytes_per_line;
+    e->front = 0;
+    e->swap_pending = false;
+    e->running = false;
+
+    return true;
+}
+
+bool hdmaStartBgScroll(int channel, int id)
+{
+    sassert(id >= 0 && id < 8, "hdmaStartBgScroll(): Invalid background ID");
+
+    return hdmaStart(channel, bgScrollTable[id], sizeof(bg_scroll));
+}
+
+bool hdmaStartBgAffine(int channel, int id)
+{
+    sassert(id >= 0 && id < 8, "hdmaStartBgAffine(): Invalid background ID");
+
+    if (bgTransform[id] == NULL)
+        return false;
+
+    return hdmaStart(channel, bgTransform[id], sizeof(bg_transform));
+}
+
+bool hdmaStartWindow(int channel, WINDOW w, bool sub)
+{
+    uintptr_t reg;
+
+    if (w == WINDOW_0)
+        reg = 0x04000040;
+    else if (w == WINDOW_1)
+        reg = 0x04000042;
+    else
+        return false;
+
+    if (sub)
+        reg += 0x1000;
+
+    return hdmaStart(channel, (vu16 *)reg, sizeof(u16));
+}
+
+bool hdmaStartBlend(int channel, bool sub)
+{
+    return hdmaStart(channel, sub ? &REG_BLDALPHA_SUB : &REG_BLDALPHA,
+                     sizeof(u16));
+}
+
+void hdmaStop(int channel)
+{
+    if ((channel < 0) || (channel >= HDMA_NUM_CHANNELS))
+        return;
+
+    HdmaEffect *e = &hdma_effects[channel];
+
+    if (e->buffer[0] == NULL)
+        return;
+
+    dmaStopSafe(channel);
+
+    memTraceFree(e->buffer[0]);
+    e->buffer[0] = NULL;
+    e->buffer[1] = NULL;
+    e->running = false;
+    e->swap_pending = false;
+}
+
+void *hdmaGetBackBuffer(int channel)
+{
+    if ((channel < 0) || (channel >= HDMA_NUM_CHANNELS))
+        return NULL;
+
+    HdmaEffect *e = &hdma_effects[channel];
+
+    // The old front buffer is in use until the next vertical blank
+    if ((e->buffer[0] == NULL) || e->swap_pending)
+        return NULL;
+
+    return e->buffer[e->front ^ 1];
+}
+
+void hdmaSwap(int channel)
+{
+    if ((channel < 0) || (channel >= HDMA_NUM_CHANNELS))
+        return;
+
+    HdmaEffect *e = &hdma_effects[channel];
+
+    if ((e->buffer[0] == NULL) || e->swap_pending)
+        return;
+
+    // The DMA reads the table from RAM, not from the data cache
+    DC_FlushRange(e->buffer[e->front ^ 1], hdmaBufferSize(e->entry_size));
+
+    e->swap_pending = true;
+}
+
+void hdmaVBlank(void)
+{
+    for (int ch = 0; ch < HDMA_NUM_CHANNELS; ch++)
+    {
+        HdmaEffect *e = &hdma_effects[ch];
+
+        if (e->buffer[0] == NULL)
+            continue;
+
+        if (e->swap_pending)
+        {
+            e->front ^= 1;
+            e->swap_pending = false;
+            e->running = true;
+        }
+
+        if (!e->running)
+            continue;
+
+        const uint8_t *table = e->buffer[e->front];
+        size_t size = e->entry_size;
+
+        dmaStopSafe(ch);
+
+        // The values of the first scanline are set now. The DMA sets the ones
+        // of each following scanline during the horizontal blank before it.
+        uint32_t unit;
+        if (size & 3)
+        {
+            for (size_t i = 0; i < size; i += 2)
+                *(vu16 *)((uintptr_t)e->dst + i) = *(const u16 *)(table + i);
+            unit = DMA_16_BIT;
+            size >>= 1;
+        }
+        else
+        {
+            for (size_t i = 0; i < size; i += 4)
+                *(vu32 *)((uintptr_t)e->dst + i) = *(const u32 *)(table + i);
+            unit = DMA_32_BIT;
+            size >>= 2;
+        }
+
+        dmaSetParams(ch, table + e->entry_size, (void *)e->dst,
+                     DMA_ENABLE | DMA_START_HBL | DMA_REPEAT | DMA_DST_RESET
+                     | unit | size);
+    }
+}
+
+void hdmaGenWave(bg_scroll *table, int scroll_x, int scroll_y, int amplitude,
+                 int frequency, int phase)
+{
+    for (int i = 0; i < HDMA_LINES; i++)
+    {
+        int offset = (amplitude * sinLerp(phase + i * frequency)) >> 12;
+
+        table[i].x = scroll_x + offset;
+        table[i].y = scroll_y;
+    }
+}
+
+void hdmaGenPerspective(bg_transform *table, s32 cam_x, s32 cam_y, s32 height,
+                        int angle, int horizon, int focal)
+{
+    int32_t s = sinLerp(angle);
+    int32_t c = cosLerp(angle);
+
+    for (int i = 0; i < HDMA_LINES; i++)
+    {
+        bg_transform *t = &table[i];
+        int dist = i - horizon;
+
+        t->vdx = 0;
+        t->vdy = 0;
+
+        if (dist <= 0)
+        {
+            t->hdx = 0;
+            t->hdy = 0;
+            t->dx = cam_x;
+            t->dy = cam_y;
+            continue;
+        }
+
+        // Map pixels per screen pixel in this scanline, and distance from the
+        // camera to the scanline along the view direction (20.8).
+        int32_t lambda = div32(height, dist);
+        int32_t z = lambda * focal;
+
+        int32_t pa = (c * lambda) >> 12;
+        int32_t pc = (s * lambda) >> 12;
+
+        t->hdx = pa;
+        t->hdy = pc;
+
+        // Start from the point in front of the camera and move to the left
+        // edge of the screen.
+        t->dx = cam_x + (int32_t)(((int64_t)s * z) >> 12) - pa * (SCREEN_WIDTH / 2);
+        t->dy = cam_y - (int32_t)(((int64_t)c * z) >> 12) - pc * (SCREEN_WIDTH / 2);
+    }
+}
+
+void hdmaGenCircleWindow(u16 *table, int center_x, int center_y, int radius)
+{
+    for (int i = 0; i < HDMA_LINES; i++)
+    {
+        int d = i - center_y;
+
+        if ((d <= -radius) || (d >= radius))
+        {
+            table[i] = HDMA_WINDOW_BOUNDS(0, 0);
+            continue;
+        }
+
+        int half = sqrt32(radius * radius - d * d);
+        int left = center_x - half;
+        int right = center_x + half;
+
+        if (left < 0)
+            left = 0;
+        if (right > SCREEN_WIDTH)
+            right = SCREEN_WIDTH;
+
+        // A right edge of 256 is stored as 0, which only works if the left edge
+        // isn't 0 too.
+        if ((left == 0) && (right == SCREEN_WIDTH))
+            right = SCREEN_WIDTH - 1;
+
+        if (left >= right)
+            table[i] = HDMA_WINDOW_BOUNDS(0, 0);
+        else
+            table[i] = HDMA_WINDOW_BOUNDS(left, right);
+    }
+}
+
+void hdmaGenBlendGradient(u16 *table, int eva_top, int evb_top,
+                          int eva_bottom, int evb_bottom)
+{
+    // 16.16 fixed point steps per scanline. The differences can be negative,
+    // so they are multiplied instead of shifted.
+    int32_t step_a = ((eva_bottom - eva_top) * 65536) / (HDMA_LINES - 1);
+    int32_t step_b = ((evb_bottom - evb_top) * 65536) / (HDMA_LINES - 1);
+
+    int32_t eva = eva_top * 65536 + (1 << 15);
+    int32_t evb = evb_top * 65536 + (1 << 15);
+
+    for (int i = 0; i < HDMA_LINES; i++)
+    {
+        table[i] = (eva >> 16) | ((evb >> 16) << 8);
+
+        eva += step_a;
+        evb += step_b;
+    }
+}
@@ -4,11 +4,14 @@
 // Copyright (C) 2008-2010 Jason Rogers (dovoto)
 // Copyright (C) 2008-2010 Dave Murphy (WinterMute)
 
+#include <string.h>
+
 #include <nds/arm9/cache.h>
 #include <nds/arm9/sprite.h>
 #include <nds/arm9/trig_lut.h>
 #include <nds/dma.h>
 #include <nds/interrupts.h>
+#include <nds/memtrace.h>
 
 SpriteEntry OamMemorySub[128];
 SpriteEntry OamMemory[128];
@@ -16,21 +19,17 @@ SpriteEntry OamMemory[128];
 OamState oamMain =
 {
     .gfxOffsetStep = -1,
-    .firstFree = 0,
-    .allocBufferSize = 32,
-    .allocBuffer = NULL,
     .oamMemory = OamMemory,
-    .spriteMapping = SpriteMapping_1D_128
+    .spriteMapping = SpriteMapping_1D_128,
+    .doubleBufferDma = -1
 };
 
 OamState oamSub =
 {
     .gfxOffsetStep = -1,
-    .firstFree = 0,
-    .allocBufferSize = 32,
-    .allocBuffer = NULL,
     .oamMemory = OamMemorySub,
-    .spriteMapping = SpriteMapping_1D_128
+    .spriteMapping = SpriteMapping_1D_128,
+    .doubleBufferDma = -1
 };
 
 void oamInit(OamState *oam, SpriteMapping mapping, bool extPalette)
@@ -72,6 +71,13 @@ void oamInit(OamState *oam, SpriteMapping mapping, bool extPalette)
         REG_DISPCNT_SUB |= DISPLAY_SPR_ACTIVE | (mapping & 0xffffff0) | extPaletteFlag;
     }
 
+    // OAM is now up to date. If the double buffer is enabled, the front buffer
+    // still holds the old state, so it needs a full update.
+    if (oam->frontBuffer != NULL)
+        oamMarkDirtyRange(oam, 0, SPRITE_COUNT);
+    else
+        memset(oam->dirty, 0, sizeof(oam->dirty));
+
     oamAllocReset(oam);
 }
 
@@ -114,6 +120,14 @@ void oamClear(OamState *oam, int start, int count)
 
     for (i = start; i < count + start; i++)
         oam->oamMemory[i].attribute[0] = ATTR0_DISABLED;
+
+    oamMarkDirtyRange(oam, start, count);
+}
+
+void oamMarkDirtyRange(OamState *oam, int start, int count)
+{
+    for (int i = start; i < start + count; i++)
+        oamMarkDirty(oam, i);
 }
 
 unsigned int oamGfxPtrToOffset(OamState *oam, const void *offset)
@@ -192,6 +206,8 @@ void oamSet(OamState *oam, int id, int x, int y, int priority, int palette_alpha
             int affineIndex, bool sizeDouble, bool hide, bool hflip, bool vflip,
             bool mosaic)
 {
+    oamMarkDirty(oam, id);
+
     if (hide)
     {
         oam->oamMemory[id].attribute[0] = ATTR0_DISABLED;
@@ -248,6 +264,8 @@ void oamSetGfx(OamState *oam, int id, SpriteSize size, SpriteColorFormat format,
     oam->oamMemory[id].size     = (ObjSize)SPRITE_SIZE_SIZE(size);
     oam->oamMemory[id].gfxIndex = oamGfxPtrToOffset(oam, gfxOffset);
 
+    oamMarkDirty(oam, id);
+
     if (format == SpriteColorFormat_Bmp)
     {
         oam->oamMemory[id].blendMode = OBJMODE_BITMAP;
@@ -262,14 +280,128 @@ void oamSetGfx(OamState *oam, int id, SpriteSize size, SpriteColorFormat format,
     }
 }
 
+// Copies the dirty entries of the shadow OAM to dst and clears the dirty bits.
+// The shadow OAM is read from the data cache, so this doesn't need to flush it.
+// If flush is true the destination is flushed so that the DMA can read it.
+static void oamCopyDirty(OamState *oam, SpriteEntry *dst, bool flush)
+{
+    for (int w = 0; w < SPRITE_COUNT / 32; w++)
+    {
+        u32 bits = oam->dirty[w];
+
+        while (bits != 0)
+        {
+            // Find the next run of consecutive dirty entries
+            int first = __builtin_ctz(bits);
+            u32 run = bits >> first;
+            int len = (run == 0xFFFFFFFF) ? 32 : __builtin_ctz(~run);
+
+            int id = w * 32 + first;
+            const u32 *s = (const u32 *)&oam->oamMemory[id];
+            vu32 *d = (vu32 *)&dst[id];
+
+            // OAM only supports 16 and 32 bit writes
+            for (int i = 0; i < len * 2; i++)
+                d[i] = s[i];
+
+            if (flush)
+                DC_FlushRange(&dst[id], len * sizeof(SpriteEntry));
+
+            if (len == 32)
+                break;
+
+            bits &= ~(((1u << len) - 1) << first);
+        }
+
+        oam->dirty[w] = 0;
+    }
+}
+
 void oamUpdate(OamState *oam)
 {
-    DC_FlushRange(oam->oamMemory, sizeof(OamMemory));
+    SpriteEntry *hw = (SpriteEntry *)((oam == &oamMain) ? OAM : OAM_SUB);
 
-    if (oam == &oamMain)
-        dmaCopy(oam->oamMemory, OAM, sizeof(OamMemory));
+    if (oam->frontBuffer == NULL)
+    {
+        if (oam->dirtyTracking)
+        {
+            oamCopyDirty(oam, hw, false);
+            return;
+        }
+
+        DC_FlushRange(oam->oamMemory, sizeof(OamMemory));
+        dmaCopy(oam->oamMemory, hw, sizeof(OamMemory));
+        memset(oam->dirty, 0, sizeof(oam->dirty));
+        return;
+    }
+
+    int ch = oam->doubleBufferDma;
+
+    // Stop the pending transfer (if any) while the front buffer is updated
+    dmaStopSafe(ch);
+
+    if (oam->dirtyTracking)
+    {
+        oamCopyDirty(oam, oam->frontBuffer, true);
+    }
     else
-        dmaCopy(oam->oamMemory, OAM_SUB, sizeof(OamMemory));
+    {
+        memcpy(oam->frontBuffer, oam->oamMemory, sizeof(OamMemory));
+        DC_FlushRange(oam->frontBuffer, sizeof(OamMemory));
+        memset(oam->dirty, 0, sizeof(oam->dirty));
+    }
+
+    dmaSetParams(ch, oam->frontBuffer, hw, DMA_ENABLE | DMA_START_VBL |
+                 DMA_32_BIT | (sizeof(OamMemory) >> 2));
+}
+
+void oamSetDirtyTracking(OamState *oam, bool enable)
+{
+    // Entries modified while tracking was disabled haven't been marked
+    if (enable && !oam->dirtyTracking)
+        oamMarkDirtyRange(oam, 0, SPRITE_COUNT);
+
+    oam->dirtyTracking = enable;
+}
+
+bool oamEnableDoubleBuffer(OamState *oam, int dmaChannel)
+{
+    sassert(oam == &oamMain || oam == &oamSub,
+            "oamEnableDoubleBuffer() oam must be &oamMain or &oamSub");
+    sassert(dmaChannel >= 0 && dmaChannel <= 3,
+            "oamEnableDoubleBuffer() invalid DMA channel");
+
+    oamDisableDoubleBuffer(oam);
+
+    // Align it to a cache line so that flushing it doesn't affect other data
+    SpriteEntry *buffer = memTraceMemalign(32, sizeof(OamMemory),
+                                           MEMTRACE_TAG_SPRITE);
+    if (buffer == NULL)
+        return false;
+
+    // Start with the current state of OAM, not the shadow OAM, so that the
+    // entries that haven't been updated yet are still copied by oamUpdate().
+    memcpy(buffer, (oam == &oamMain) ? OAM : OAM_SUB, sizeof(OamMemory));
+
+    oam->frontBuffer = buffer;
+    oam->doubleBufferDma = dmaChannel;
+
+    return true;
+}
+
+void oamDisableDoubleBuffer(OamState *oam)
+{
+    if (oam->frontBuffer == NULL)
+        return;
+
+    dmaStopSafe(oam->doubleBufferDma);
+
+    memTraceFree(oam->frontBuffer);
+    oam->frontBuffer = NULL;
+    oam->doubleBufferDma = -1;
+
+    // The dirty bits of the cancelled update have already been cleared
+    oamMarkDirtyRange(oam, 0, SPRITE_COUNT);
 }
 
 void oamRotateScale(OamState *oam, int rotId, int angle, int sx, int sy)
@@ -284,4 +416,6 @@ void oamRotateScale(OamState *oam, int rotId, int angle, int sx, int sy)
     oam->oamRotationMemory[rotId].vdx = (-ss * sx) >> 12;
     oam->oamRotationMemory[rotId].hdy = (ss * sy) >> 12;
     oam->oamRotationMemory[rotId].vdy = (cc * sy) >> 12;
+
+    oamMarkRotationDirty(oam, rotId);
 }
@@ -4,228 +4,176 @@
 // Copyright (C) 2008-2010 Jason Rogers (dovoto)
 // Copyright (C) 2008-2009 Dave Murphy (WinterMute)
 
-#include <stdlib.h>
+#include <string.h>
 
-#include <nds/arm9/cache.h>
-#include <nds/arm9/console.h>
-#include <nds/arm9/input.h>
 #include <nds/arm9/sprite.h>
-#include <nds/bios.h>
-#include <nds/dma.h>
+#include <nds/memtrace.h>
 
-// A terse macro to convert an allocation buffer index into an AllocHeader.
-// Assumes 'oam' is in the current scope.
+// The allocator manages 1024 units of sprite graphics. Blocks have a size of
+// 2^order units, from order 0 (1 unit) to order 10 (all memory). Blocks are
+// always aligned to their size, so the buddy of block "index" of an order is
+// block "index ^ 1" of the same order.
 
-#define AH(id) getAllocHeader(oam, id)
+#define GFX_UNITS       1024
+#define GFX_MAX_ORDER   10
 
-// buffer grows depending on usage
-static void resizeBuffer(OamState *oam)
-{
-    oam->allocBufferSize *= 2;
+// First word of the bitmaps of each order
+static const u8 gfxWordBase[GFX_MAX_ORDER + 1] = {
+    0, 32, 48, 56, 60, 62, 63, 64, 65, 66, 67
+};
 
-    oam->allocBuffer = realloc(oam->allocBuffer,
-                               sizeof(AllocHeader) * oam->allocBufferSize);
+static inline bool gfxIsFree(OamGfxAllocator *a, int order, int index)
+{
+    return a->freeBits[gfxWordBase[order] + (index >> 5)] & BIT(index & 31);
 }
 
-static AllocHeader *getAllocHeader(OamState *oam, int index)
+static inline void gfxSetFree(OamGfxAllocator *a, int order, int index)
 {
-    // Note that this function may resize the allocBuffer any time you refer to
-    // a new 'index' for the first time. This will invalidate any pointers that
-    // getAllocHeader() has previously returned, since the buffer may have moved
-    // to a different location in memory. The pointers returned by this function
-    // must be discarded any time a new allocHeader may have been allocated.
-
-    // resize buffer if needed
-    if (index >= oam->allocBufferSize)
-        resizeBuffer(oam);
-
-    return &oam->allocBuffer[index];
+    a->freeBits[gfxWordBase[order] + (index >> 5)] |= BIT(index & 31);
+    a->freeSummary[order] |= BIT(index >> 5);
+    a->freeOrders |= BIT(order);
 }
 
-static void oamAllocPrepare(OamState *oam)
+static inline void gfxClearFree(OamGfxAllocator *a, int order, int index)
 {
-    // Allocate the buffer if NULL
-    if (oam->allocBuffer == NULL)
+    u32 *word = &a->freeBits[gfxWordBase[order] + (index >> 5)];
+
+    *word &= ~BIT(index & 31);
+    if (*word == 0)
     {
-        oam->allocBuffer = malloc(sizeof(AllocHeader) * oam->allocBufferSize);
-        AH(0)->nextFree = 1024;
-        AH(0)->size = 1024;
+        a->freeSummary[order] &= ~BIT(index >> 5);
+        if (a->freeSummary[order] == 0)
+            a->freeOrders &= ~BIT(order);
     }
 }
 
-void oamAllocReset(OamState *oam)
+static inline bool gfxIsUsed(OamGfxAllocator *a, int order, int index)
 {
-    // free the buffer if not null & reset size
-    if (oam->allocBuffer != NULL)
-    {
-        free(oam->allocBuffer);
-        oam->allocBuffer = NULL;
-        oam->allocBufferSize = 32;
-        oam->firstFree = 0;
-    }
+    return a->usedBits[gfxWordBase[order] + (index >> 5)] & BIT(index & 31);
 }
 
-static int simpleAlloc(OamState *oam, int size)
+static inline void gfxSetUsed(OamGfxAllocator *a, int order, int index, bool used)
 {
-    oamAllocPrepare(oam);
-
-    u16 curOffset = oam->firstFree;
+    u32 *word = &a->usedBits[gfxWordBase[order] + (index >> 5)];
 
-    // check for out of memory
-    if (oam->firstFree >= 1024 || oam->firstFree == -1)
-    {
-        oam->firstFree = -1;
-        return -1;
-    }
+    if (used)
+        *word |= BIT(index & 31);
+    else
+        *word &= ~BIT(index & 31);
+}
 
-    int misalignment = curOffset & (size - 1);
+static void oamAllocPrepare(OamState *oam)
+{
+    OamGfxAllocator *a = &oam->gfxAlloc;
 
-    if (misalignment)
-        misalignment = size - misalignment;
+    if (a->initialized)
+        return;
 
-    int next = oam->firstFree;
-    int last = next;
+    memset(a, 0, sizeof(OamGfxAllocator));
 
-    // find a big enough block
-    while (AH(next)->size - misalignment < size)
-    {
-        curOffset = AH(next)->nextFree;
+    // All memory starts as a single free block
+    gfxSetFree(a, GFX_MAX_ORDER, 0);
+    a->initialized = true;
+}
 
-        misalignment = curOffset & (size - 1);
+void oamAllocReset(OamState *oam)
+{
+    OamGfxAllocator *a = &oam->gfxAlloc;
 
-        if (misalignment)
-            misalignment = size - misalignment;
+    // Tell the tracer that all blocks have been freed
+    if (a->initialized)
+    {
+        for (int order = 0; order <= GFX_MAX_ORDER; order++)
+        {
+            for (int index = 0; index < (GFX_UNITS >> order); index++)
+            {
+                if (gfxIsUsed(a, order, index))
+                    memTraceRecordFree(oamGetGfxPtr(oam, index << order));
+            }
+        }
+    }
 
-        if (curOffset >= 1024)
-            return -1;
+    a->initialized = false;
+    oamAllocPrepare(oam);
+}
 
-        last = next;
-        next = curOffset;
-    }
+// Returns the order of the smallest block that can hold "size" units
+static inline int gfxOrder(int size)
+{
+    return (size > 1) ? 32 - __builtin_clz(size - 1) : 0;
+}
 
-    // Next should now point to a large enough block and last should point to
-    // the block prior
+static int buddyAlloc(OamState *oam, int size)
+{
+    OamGfxAllocator *a = &oam->gfxAlloc;
 
-    // Align to block size
-    if (misalignment)
-    {
-        int tempSize = AH(next)->size;
-        int tempNextFree = AH(next)->nextFree;
+    oamAllocPrepare(oam);
 
-        curOffset += misalignment;
+    int order = gfxOrder(size);
+    if (order > GFX_MAX_ORDER)
+        return -1;
 
-        AH(next)->size = misalignment;
-        AH(next)->nextFree = curOffset;
+    // Find the smallest order with free blocks that is big enough
+    u32 orders = a->freeOrders & ~(BIT(order) - 1);
+    if (orders == 0)
+        return -1;
 
-        last = next;
-        next = curOffset;
+    int cur = __builtin_ctz(orders);
+    int word = __builtin_ctz(a->freeSummary[cur]);
+    int index = (word << 5) + __builtin_ctz(a->freeBits[gfxWordBase[cur] + word]);
 
-        AH(next)->size = tempSize - misalignment;
-        AH(next)->nextFree = tempNextFree;
-    }
+    gfxClearFree(a, cur, index);
 
-    // Is the block the first free block?
-    if (curOffset == oam->firstFree)
-    {
-        if (AH(next)->size == size)
-        {
-            oam->firstFree = AH(next)->nextFree;
-        }
-        else
-        {
-            oam->firstFree = curOffset + size;
-            AH(oam->firstFree)->nextFree = AH(next)->nextFree;
-            AH(oam->firstFree)->size = AH(next)->size - size;
-        }
-    }
-    else
+    // Split the block until it has the right size. The second half of each
+    // split block is left free.
+    while (cur > order)
     {
-        if (AH(next)->size == size)
-        {
-            AH(last)->nextFree = AH(next)->nextFree;
-        }
-        else
-        {
-            AH(last)->nextFree = curOffset + size;
-
-            AH(curOffset + size)->nextFree = AH(next)->nextFree;
-            AH(curOffset + size)->size = AH(next)->size - size;
-        }
+        cur--;
+        index <<= 1;
+        gfxSetFree(a, cur, index + 1);
     }
 
-    AH(next)->size = size;
+    gfxSetUsed(a, order, index, true);
 
-    return curOffset;
+    return index << order;
 }
 
-static void simpleFree(OamState *oam, int index)
+// Returns true if the block has been freed
+static bool buddyFree(OamState *oam, int offset)
 {
-    u16 curOffset = oam->firstFree;
+    OamGfxAllocator *a = &oam->gfxAlloc;
 
-    int next = oam->firstFree;
-    int current = index;
+    if (!a->initialized || (offset < 0) || (offset >= GFX_UNITS))
+        return false;
 
-    // If we were out of memory it's trivial.
-    if (oam->firstFree == -1 || oam->firstFree >= 1024)
+    // Find the size of the allocated block. Only one order can have an
+    // allocated block that starts at this offset.
+    int order;
+    for (order = 0; order <= GFX_MAX_ORDER; order++)
     {
-        oam->firstFree = index;
-        AH(current)->nextFree = 1024;
-        return;
-    }
+        if (offset & (BIT(order) - 1))
+            return false;
 
-    // If this index is before the first free block its also trivial.
-    if (index < oam->firstFree)
-    {
-        // Check for abutment and combine if necessary.
-        if (index + AH(current)->size == oam->firstFree)
-        {
-            AH(current)->size += AH(next)->size;
-            AH(current)->nextFree = AH(next)->nextFree;
-        }
-        else
-        {
-            AH(current)->nextFree = oam->firstFree;
-        }
-
-        oam->firstFree = index;
-
-        return;
+        if (gfxIsUsed(a, order, offset >> order))
+            break;
     }
 
-    // Otherwise locate the free block prior to index.
-    while (index > AH(next)->nextFree)
-    {
-        curOffset = AH(next)->nextFree;
-
-        next = AH(next)->nextFree;
-    }
+    if (order > GFX_MAX_ORDER)
+        return false;
 
-    // Check if the next free block and current can be appended
-    //
-    //  [curOffset]         [index]          [next->nextFree]
-    //     next      | ~ |  current    | ~ |     nextFree
+    int index = offset >> order;
+    gfxSetUsed(a, order, index, false);
 
-    // check if current abuts nextFree
-    if (AH(next)->nextFree == index + AH(current)->size && AH(next)->nextFree < 1024)
+    // Merge the block with its buddy while the buddy is free
+    while ((order < GFX_MAX_ORDER) && gfxIsFree(a, order, index ^ 1))
     {
-        AH(current)->size += AH(AH(next)->nextFree)->size;
-        AH(current)->nextFree = AH(AH(next)->nextFree)->nextFree;
-    }
-    else
-    {
-        AH(current)->nextFree = AH(next)->nextFree;
+        gfxClearFree(a, order, index ^ 1);
+        index >>= 1;
+        order++;
     }
 
-    // Check if current abuts previous free block
-    if (curOffset + AH(next)->size == index)
-    {
-        AH(next)->size += AH(current)->size;
-        AH(next)->nextFree = AH(current)->nextFree;
-    }
-    else
-    {
-        AH(next)->nextFree = index;
-    }
+    gfxSetFree(a, order, index);
+    return true;
 }
 
 u16 *oamAllocateGfx(OamState *oam, SpriteSize size, SpriteColorFormat colorFormat)
@@ -237,37 +185,56 @@ u16 *oamAllocateGfx(OamState *oam, SpriteSize size, SpriteColorFormat colorForma
     else if (colorFormat == SpriteColorFormat_Bmp)
         bytes = bytes << 1;
 
-    bytes = bytes >> oam->gfxOffsetStep;
+    // oamInit() hasn't been called
+    if (oam->gfxOffsetStep < 0)
+        return NULL;
+
+    int units = bytes >> oam->gfxOffsetStep;
+    if (units == 0)
+        units = 1;
 
-    int offset = simpleAlloc(oam, bytes ? bytes : 1);
+    u16 *ptr = oamGetGfxPtr(oam, buddyAlloc(oam, units));
 
-    return oamGetGfxPtr(oam, offset);
+    // Account the size of the whole block, including the unused space
+    memTraceRecordAlloc(ptr, (size_t)BIT(gfxOrder(units)) << oam->gfxOffsetStep,
+                        MEMTRACE_TAG_SPRITE);
+
+    return ptr;
 }
 
 void oamFreeGfx(OamState *oam, const void *gfxOffset)
 {
-    simpleFree(oam, oamGfxPtrToOffset(oam, gfxOffset));
+    if (buddyFree(oam, oamGfxPtrToOffset(oam, gfxOffset)))
+        memTraceRecordFree(gfxOffset);
 }
 
 int oamCountFragments(OamState *oam)
 {
-    int frags = 1;
+    OamGfxAllocator *a = &oam->gfxAlloc;
+    int frags = 0;
 
-    int curOffset;
+    if (!a->initialized)
+        return 0;
 
-    if (oam->allocBuffer == NULL)
+    for (unsigned int i = 0; i < sizeof(a->freeBits) / sizeof(a->freeBits[0]); i++)
+        frags += __builtin_popcount(a->freeBits[i]);
+
+    return frags;
+}
+
+size_t oamGetLargestFreeGfx(OamState *oam)
+{
+    // oamInit() hasn't been called
+    if (oam->gfxOffsetStep < 0)
         return 0;
 
-    AllocHeader *next = getAllocHeader(oam, oam->firstFree);
+    oamAllocPrepare(oam);
 
-    curOffset = next->nextFree;
+    u32 orders = oam->gfxAlloc.freeOrders;
+    if (orders == 0)
+        return 0;
 
-    while (curOffset < 1024 && curOffset < oam->allocBufferSize)
-    {
-        curOffset = next->nextFree;
-        next = getAllocHeader(oam, next->nextFree);
-        frags++;
-    }
+    int order = 31 - __builtin_clz(orders);
 
-    return frags;
+    return (size_t)BIT(order) << oam->gfxOffsetStep;
 }
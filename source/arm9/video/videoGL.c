@@ -7,6 +7,7 @@
 
 // Video API vaguely similar to OpenGL
 
+#include <nds/arm9/displayList.h>
 #include <nds/arm9/math.h>
 #include <nds/arm9/sassert.h>
 #include <nds/arm9/trig_lut.h>
@@ -15,41 +16,11 @@
 #include <nds/bios.h>
 #include <nds/interrupts.h>
 #include <nds/memory.h>
+#include <nds/memtrace.h>
 #include <nds/ndstypes.h>
 #include <nds/system.h>
 
-// Structures specific to allocating and deallocating texture and palette VRAM
-// ---------------------------------------------------------------------------
-
-typedef struct s_SingleBlock
-{
-    uint32_t indexOut;
-    uint8_t *AddrSet;
-
-    // 0-1: prev/next memory block
-    // 2-3: prev/next empty/alloc block
-    struct s_SingleBlock *node[4];
-
-    uint32_t blockSize;
-} s_SingleBlock;
-
-typedef struct s_vramBlock
-{
-    uint8_t *startAddr, *endAddr;
-    struct s_SingleBlock *firstBlock;
-    struct s_SingleBlock *firstEmpty;
-    struct s_SingleBlock *firstAlloc;
-
-    struct s_SingleBlock *lastExamined;
-    uint8_t *lastExaminedAddr;
-    uint32_t lastExaminedSize;
-
-    DynamicArray blockPtrs;
-    DynamicArray deallocBlocks;
-
-    uint32_t blockCount;
-    uint32_t deallocCount;
-} s_vramBlock;
+#include "vramBlock.h"
 
 typedef struct gl_texture_data
 {
@@ -67,6 +38,7 @@ typedef struct gl_palette_data
     uint32_t palIndex;      // The index in the memory block
     uint16_t addr;          // The offset address for texture palettes in VRAM
     uint16_t palSize;       // The length of the palette
+    uint8_t addrShift;      // The shift applied to the offset to get "addr"
     uint32_t connectCount;  // The number of textures currently using this palette
 } gl_palette_data;
 
@@ -78,8 +50,6 @@ typedef struct gl_hidden_globals
 
     s_vramBlock *vramBlocksTex; // One for textures
     s_vramBlock *vramBlocksPal; // One for palettes
-    int vramLockTex; // Holds the current lock state of the VRAM banks
-    int vramLockPal; // Holds the current lock state of the VRAM banks
 
     // Texture/palette manamenent
     // --------------------------
@@ -355,592 +325,6 @@ ARM_CODE void glTexCoord2f32(int32_t u, int32_t v)
     }
 }
 
-//------------------------------------------------------------------------------
-// Internal VRAM allocation/deallocation functions. Calling these functions
-// outside of videoGL may interfere with normal operations.
-
-int vramBlock_init(s_vramBlock *mb)
-{
-    // Construct a new block that will be set as the first block, as well as the
-    // first empty block.
-    struct s_SingleBlock *newBlock = calloc(1, sizeof(struct s_SingleBlock));
-    if (newBlock == NULL)
-        return 0;
-
-    newBlock->AddrSet = mb->startAddr;
-    newBlock->blockSize = (uint32_t)mb->endAddr - (uint32_t)mb->startAddr;
-
-    mb->firstBlock = mb->firstEmpty = newBlock;
-
-    // Default settings and initializations for up to 16 blocks (will increase
-    // as limit is reached).
-    mb->blockCount = 1;
-    mb->deallocCount = 0;
-
-    mb->lastExamined = NULL;
-    mb->lastExaminedAddr = NULL;
-    mb->lastExaminedSize = 0;
-
-    if (DynamicArrayInit(&mb->blockPtrs, 16) == NULL)
-    {
-        free(newBlock);
-        return 0;
-    }
-    if (DynamicArrayInit(&mb->deallocBlocks, 16) == NULL)
-    {
-        DynamicArrayDelete(&mb->blockPtrs);
-        free(newBlock);
-        return 0;
-    }
-
-    for (int i = 0; i < 16; i++)
-    {
-        // This should always work because we've already allocated 16 elements
-        DynamicArraySet(&mb->blockPtrs, i, (void *)0);
-        DynamicArraySet(&mb->deallocBlocks, i, (void *)0);
-    }
-
-    return 1;
-}
-
-s_vramBlock *vramBlock_Construct(uint8_t *start, uint8_t *end)
-{
-    // Block Container is constructed, with a starting and ending address. Then
-    // initialization of the first block is made.
-    struct s_vramBlock *mb = malloc(sizeof(s_vramBlock));
-    if (mb == NULL)
-        return NULL;
-
-    if (start > end)
-    {
-        mb->startAddr = end;
-        mb->endAddr = start;
-    }
-    else
-    {
-        mb->startAddr = start;
-        mb->endAddr = end;
-    }
-
-    if (vramBlock_init(mb) == 0)
-    {
-        free(mb);
-        return NULL;
-    }
-
-    return mb;
-}
-
-void vramBlock_terminate(s_vramBlock *mb)
-{
-    // Starts at the container's first block, and goes through each sequential block,
-    // deleting them.
-    struct s_SingleBlock *curBlock = mb->firstBlock;
-
-    while (curBlock != NULL)
-    {
-        struct s_SingleBlock *nextBlock = curBlock->node[1];
-        free(curBlock);
-        curBlock = nextBlock;
-    }
-
-    DynamicArrayDelete(&mb->deallocBlocks);
-    DynamicArrayDelete(&mb->blockPtrs);
-}
-
-void vramBlock_Deconstruct(s_vramBlock *mb)
-{
-    // Container must exist for deconstructing
-    if (mb)
-    {
-        vramBlock_terminate(mb);
-        free(mb);
-    }
-}
-
-struct s_SingleBlock *vramBlock__allocateBlock(s_vramBlock *mb,
-                                               struct s_SingleBlock *block,
-                                               uint8_t *addr, uint32_t size)
-{
-    // Initial tests to ensure allocation is valid
-    if (!size || !addr || !block || block->indexOut || addr < block->AddrSet
-        || (addr + size) > (block->AddrSet + block->blockSize))
-        return NULL;
-
-    // Get pointers to the various blocks, as those may change from allocation
-    struct s_SingleBlock **first = &mb->firstBlock;
-    struct s_SingleBlock **alloc = &mb->firstAlloc;
-    struct s_SingleBlock **empty = &mb->firstEmpty;
-
-    // The nodes in the test block array will change as examinations of pre/post
-    // blocks are done
-    struct s_SingleBlock *testBlock[4] = {
-        block->node[0], block->node[1], block->node[2], block->node[3]
-    };
-
-    // Boolean comparisons ( for determining if an empty block set for
-    // allocation should be split once, twice, or not at all )
-    uint32_t valComp[2] = {
-        addr != block->AddrSet,
-        addr + size < block->AddrSet + block->blockSize
-    };
-
-    for (int i = 0; i < 2; i++)
-    {
-        // Generate a new block if condition requires it, based on earlier
-        // comparison
-        if (valComp[i])
-        {
-            // If comparison check is true, then empty block is split in two
-            // empty blocks.  Addresses set, block sizes corrected, and nodes
-            // linked between the two. This can be done up to two times,
-            // resulting in 3 empty blocks sequentially. The middle in this case
-            // will be the true allocated block. If split once in total, either
-            // block will be the true block. Also done is examination of the
-            // first block and first empty block, which will be set as well.
-
-            struct s_SingleBlock *newBlock = malloc(sizeof(struct s_SingleBlock));
-            if (newBlock == NULL)
-                return NULL;
-
-            newBlock->indexOut = 0;
-            newBlock->AddrSet = block->AddrSet + (i * size);
-
-            if (i)
-            {
-                newBlock->blockSize = block->blockSize - size;
-                block->blockSize = size;
-            }
-            else
-            {
-                newBlock->blockSize = (uint32_t)addr - (uint32_t)block->AddrSet;
-                block->AddrSet = addr;
-                block->blockSize -= newBlock->blockSize;
-                if (block == *first)
-                    *first = newBlock;
-            }
-
-            // To get an idea of what the nodes represent, the first two in the
-            // array refer to the immediate pre/post blocks, which can be either
-            // empty or allocated blocks. The last two in the array refer to the
-            // prior/next blocks of the same type (empty or allocated), which
-            // can skip over blocks of a differing type. This allows for quick
-            // examination of similar blocks while keeping the organization of
-            // all the blocks in an ordered fashion. Think of it like a
-            // doubly-doubly linked list.
-
-            newBlock->node[1 - i] = block;
-            newBlock->node[i] = testBlock[i];
-            newBlock->node[i + 2] = testBlock[i + 2];
-
-            block->node[i] = newBlock;
-            if (testBlock[i])
-                testBlock[i]->node[1 - i] = newBlock;
-            if (testBlock[i + 2])
-                testBlock[i + 2]->node[3 - i] = newBlock;
-
-            testBlock[i + 2] = newBlock;
-
-            if (block == *empty)
-                *empty = newBlock;
-        }
-    }
-
-    // Finish off node linking (in this case, NULL is possible, which refers to
-    // the end of the block sequences)
-    if (testBlock[2])
-        testBlock[2]->node[3] = testBlock[3];
-    if (testBlock[3])
-        testBlock[3]->node[2] = testBlock[2];
-
-    // The condition of examining the first empty block is needed, in case the
-    // comparison check early is false for both
-    if (block == *empty)
-        *empty = block->node[3];
-
-    block->node[2] = testBlock[0];
-    block->node[3] = testBlock[1];
-
-    if (testBlock[0])
-        testBlock[0]->node[3] = block;
-    else
-        *alloc = block;
-
-    if (testBlock[1])
-        testBlock[1]->node[2] = block;
-
-    return block;
-}
-
-uint32_t vramBlock__deallocateBlock(s_vramBlock *mb, struct s_SingleBlock *block)
-{
-    // Test to see if this is an allocated block
-    if (!block->indexOut)
-        return 0;
-
-    struct s_SingleBlock **first = &mb->firstBlock;
-    struct s_SingleBlock **alloc = &mb->firstAlloc;
-    struct s_SingleBlock **empty = &mb->firstEmpty;
-
-    // Unlike empty blocks, allocated blocks can be next to each other to help
-    // retain the actual spaces being allocated.
-    //
-    // This is why when contructing the Test Block for the deallocation process,
-    // it fills it with the prior/next links for both sets instead of including
-    // the immediate pre/post blocks for figuring out the prior/next closest
-    // empty block
-    struct s_SingleBlock *testBlock[4] = { block->node[2], block->node[3], block->node[2],
-                                           block->node[3] };
-
-    for (int i = 0; i < 2; i++)
-    {
-        // If the immediate prior/next test link is not the block's immediate
-        // prior/next link (meaning an empty block separates them), then set the
-        // prior/next link to that empty block.
-
-        if (testBlock[i] != block->node[i])
-        {
-            testBlock[i + 2] = block->node[i];
-        }
-        else
-        {
-            // If not, then scan through the prior/next links until either an
-            // empty block is found, or no blocks (NULL) are found
-            while (testBlock[i + 2] && testBlock[i + 2]->indexOut)
-                testBlock[i + 2] = testBlock[i + 2]->node[i];
-        }
-    }
-
-    // Begin initial "rewiring" stage for when the block transitions from
-    // allocated to empty
-    if (testBlock[0])
-        testBlock[0]->node[3] = testBlock[1];
-    if (testBlock[1])
-        testBlock[1]->node[2] = testBlock[0];
-    if (testBlock[2])
-        testBlock[2]->node[3] = block;
-    if (testBlock[3])
-        testBlock[3]->node[2] = block;
-
-    block->node[2] = testBlock[2];
-    block->node[3] = testBlock[3];
-    block->indexOut = 0;
-
-    // If this block was the first allocated block of the group, then pass
-    // allocation lead to next one, even if that is NULL
-    if (block == *alloc)
-        *alloc = testBlock[1];
-
-    for (int i = 0; i < 2; i++)
-    {
-        if (testBlock[i + 2])
-        {
-            // If true, then we must do more rewiring, as well as merging blocks
-            // together. This also includes reassigning the first block and
-            // first empty block if necessary
-            if (testBlock[i + 2] == block->node[i])
-            {
-                block->node[i] = testBlock[i + 2]->node[i];
-
-                if (block->node[i])
-                    block->node[i]->node[1 - i] = block;
-
-                block->node[i + 2] = testBlock[i + 2]->node[i + 2];
-
-                if (block->node[i + 2])
-                    block->node[i + 2]->node[3 - i] = block;
-
-                block->blockSize += testBlock[i + 2]->blockSize;
-
-                if (!i)
-                {
-                    block->AddrSet = testBlock[2]->AddrSet;
-                    if (testBlock[2] == *first)
-                        *first = block;
-                }
-
-                if (testBlock[i + 2] == *empty)
-                    *empty = block;
-
-                free(testBlock[i + 2]);
-
-                // Even if the above did not happen, there is still a chance the
-                // new deallocated block may now be the first empty block, so
-                // assign it if that is the case.
-            }
-            else if (i && testBlock[i + 2] == *empty)
-            {
-                *empty = block;
-            }
-        }
-    }
-
-    return 1;
-}
-
-uint8_t *vramBlock_examineSpecial(s_vramBlock *mb, uint8_t *addr, uint32_t size,
-                                  uint8_t align)
-{
-    // Simple validity tests
-    if (!addr || !mb->firstEmpty || !size || align >= 8)
-        return NULL;
-
-    // Start with the first empty block
-    struct s_SingleBlock *block = mb->firstEmpty;
-
-    // Set these value to 0/NULL (should only be filled in with valid data in
-    // case of error), and copy the address to start checking.
-    mb->lastExamined = NULL;
-    mb->lastExaminedAddr = NULL;
-    mb->lastExaminedSize = 0;
-    uint8_t *checkAddr = addr;
-
-    // If the address is within a valid block, examine if it will initially fit
-    // in it.
-    while (block && checkAddr >= block->AddrSet + block->blockSize)
-        block = block->node[3];
-
-    if (!block)
-        return NULL;
-
-    // Move the address up if before the first valid block
-    if (checkAddr < block->AddrSet)
-        checkAddr = block->AddrSet;
-
-    uint8_t *bankLock[5] = { 0x0 };
-    uint32_t bankSize[5] = { 0x0 };
-    uint32_t curBank = 0;
-
-    // Values that hold which banks to examine
-    uint32_t isNotMainBank = (checkAddr >= (uint8_t *)VRAM_E ? 1 : 0);
-    uint32_t vramCtrl = (isNotMainBank ? VRAM_EFG_CR : VRAM_CR);
-    int vramLock = isNotMainBank ? glGlob.vramLockPal : glGlob.vramLockTex;
-    uint32_t iEnd = (isNotMainBank ? 3 : 4);
-
-    // Fill in the array with only those banks that are not set for textures or
-    // texture palettes
-    for (uint32_t i = 0; i < iEnd; i++)
-    {
-        // if VRAM_ENABLE | ( VRAM_x_TEXTURE | VRAM_x_TEX_PALETTE )
-        if (((vramCtrl & 0x83) != 0x83) || (vramLock & 0x1))
-        {
-            if (isNotMainBank)
-            {
-                bankLock[curBank] =
-                    (i == 0 ? (uint8_t *)VRAM_E : (uint8_t *)VRAM_F + ((i - 1) * 0x4000));
-                bankSize[curBank] = (i == 0 ? 0x10000 : 0x4000);
-            }
-            else
-            {
-                bankLock[curBank] = (uint8_t *)VRAM_A + (i * 0x20000);
-                bankSize[curBank] = 0x20000;
-            }
-            curBank++;
-        }
-        vramCtrl >>= 8;
-        vramLock >>= 1;
-    }
-    curBank = 0;
-
-    // Retrieve the available area from this block using the address given
-    uint32_t curBlockSize =
-        block->blockSize - ((uint32_t)checkAddr - (uint32_t)block->AddrSet);
-    do
-    {
-        // Do address adjustments based on locked banks
-        if (bankLock[curBank])
-        {
-            // Skip to corresponding bank that address is in
-            while (bankLock[curBank]
-                   && checkAddr >= (bankLock[curBank] + bankSize[curBank]))
-            {
-                curBank++;
-            }
-
-            do
-            {
-                // Examine is address is within locked bank, and push it to next
-                // bank if needed
-                if (bankLock[curBank] && checkAddr >= bankLock[curBank]
-                    && checkAddr < bankLock[curBank] + bankSize[curBank])
-                {
-                    checkAddr = bankLock[curBank] + bankSize[curBank];
-                }
-                else
-                {
-                    break;
-                }
-            } while (bankLock[++curBank] != NULL);
-
-            // Continue block and address adjustments
-            while (block && checkAddr >= block->AddrSet + block->blockSize)
-                block = block->node[3];
-
-            if (!block)
-                return NULL;
-
-            if (checkAddr < block->AddrSet)
-                checkAddr = block->AddrSet;
-
-            // Adjust the blocks available size based on address location within
-            // said block
-            if (bankLock[curBank]
-                && bankLock[curBank] < block->AddrSet + block->blockSize)
-            {
-                curBlockSize = (uint32_t)bankLock[curBank] - (uint32_t)checkAddr;
-            }
-            else
-            {
-                curBlockSize =
-                    block->blockSize - ((uint32_t)checkAddr - (uint32_t)block->AddrSet);
-            }
-        }
-
-        // Obtained an aligned address, and adjust the available area that can
-        // be used
-        uint8_t *aligned_checkAddr =
-            (uint8_t *)(((uint32_t)checkAddr + ((1 << align) - 1)) & (~((1 << align) - 1)));
-        uint32_t excess = ((uint32_t)aligned_checkAddr - (uint32_t)checkAddr);
-        curBlockSize -= excess;
-
-        if (curBlockSize >= size)
-        {
-            mb->lastExamined = block;
-            mb->lastExaminedAddr = aligned_checkAddr;
-            mb->lastExaminedSize = size;
-            return aligned_checkAddr;
-        }
-        else
-        {
-            if (bankLock[curBank]
-                && bankLock[curBank] < block->AddrSet + block->blockSize)
-            {
-                checkAddr = bankLock[curBank] + bankSize[curBank];
-                curBlockSize = 0;
-            }
-            else
-            {
-                block = block->node[3];
-
-                if (!block)
-                    return NULL;
-
-                checkAddr = block->AddrSet;
-                curBlockSize = block->blockSize;
-            }
-        }
-    } while (block != NULL);
-
-    return NULL;
-}
-
-uint32_t vramBlock_allocateSpecial(s_vramBlock *mb, uint8_t *addr, uint32_t size)
-{
-    // Simple validity tests. Special allocations require "examination" data
-    if (!addr || !size || !mb->lastExamined || !mb->lastExaminedAddr)
-        return 0;
-
-    if (mb->lastExaminedAddr != addr || mb->lastExaminedSize != size)
-        return 0;
-
-    // Can only get here if prior tests passed, meaning a spot is available, and
-    // can be allocated
-    struct s_SingleBlock *newBlock = vramBlock__allocateBlock(mb, mb->lastExamined, addr, size);
-    if (newBlock == NULL)
-        return 0;
-
-    // with current implementation, it should never be false if it gets to here
-    uint32_t curBlock;
-
-    // Use a prior index if one exists. Else, obtain a new index
-    if (mb->deallocCount)
-        curBlock = (uint32_t)DynamicArrayGet(&mb->deallocBlocks, mb->deallocCount--);
-    else
-        curBlock = mb->blockCount++;
-
-    DynamicArraySet(&mb->blockPtrs, curBlock, (void *)newBlock);
-    // Clear out examination data
-    mb->lastExamined = NULL;
-    mb->lastExaminedAddr = NULL;
-    mb->lastExaminedSize = 0;
-    newBlock->indexOut = curBlock;
-    return curBlock;
-}
-
-uint32_t vramBlock_allocateBlock(s_vramBlock *mb, uint32_t size, uint8_t align)
-{
-    // Simple valid tests, such as if there are no more empty blocks as
-    // indicated by "firstEmpty"
-    if (mb->firstEmpty == NULL || !size || align >= 8)
-        return 0;
-
-    // Grab the first empty block, and begin examination for a valid spot from
-    // there
-    struct s_SingleBlock *block = mb->firstEmpty;
-    uint8_t *checkAddr = vramBlock_examineSpecial(mb, block->AddrSet, size, align);
-    if (checkAddr == NULL)
-        return 0;
-
-    // If execution gets here, then a spot was found, so allocate it
-    return vramBlock_allocateSpecial(mb, checkAddr, size);
-}
-
-// TODO: The return value of this function isn't checked anywhere, but I'm not
-// sure if this is the right approach. All we can do if we fail to deallocate
-// memory is crash.
-uint32_t vramBlock_deallocateBlock(s_vramBlock *mb, uint32_t index)
-{
-    // Retrieve the block from the index array, and see if it exists. If it
-    // does, and is deallocated (which it should), remove from index list
-    struct s_SingleBlock *block = DynamicArrayGet(&mb->blockPtrs, index);
-
-    if (block && vramBlock__deallocateBlock(mb, block))
-    {
-        // Clear the current element
-        DynamicArraySet(&mb->blockPtrs, index, NULL);
-
-        // Add the block to the array of deallocated blocks
-        if (!DynamicArraySet(&mb->deallocBlocks, ++mb->deallocCount, (void *)index))
-        {
-            // It's pretty hard to recover from this. At least, try to detect it
-            // in debug builds.
-            sassert(false, "Can't add block to deallocBlocks");
-            return 0;
-        }
-        return 1;
-    }
-    return 0;
-}
-
-int vramBlock_deallocateAll(s_vramBlock *mb)
-{
-    // Reset the entire container
-    vramBlock_terminate(mb);
-    if (vramBlock_init(mb) == 0)
-        return 0;
-
-    return 1;
-}
-
-uint8_t *vramBlock_getAddr(s_vramBlock *mb, uint32_t index)
-{
-    struct s_SingleBlock *getBlock = DynamicArrayGet(&mb->blockPtrs, index);
-    if (getBlock)
-        return getBlock->AddrSet;
-
-    return NULL;
-}
-
-// TODO: This is unused. Remove?
-uint32_t vramBlock_getSize(s_vramBlock *mb, uint32_t index)
-{
-    struct s_SingleBlock *getBlock = DynamicArrayGet(&mb->blockPtrs, index);
-    if (getBlock)
-        return getBlock->blockSize;
-
-    return 0;
-}
-
 //------------------------------------------------------------------------------
 
 int glInit(void)
@@ -958,9 +342,6 @@ int glInit(void)
     if (glGlob.vramBlocksPal == NULL)
         goto cleanup;
 
-    glGlob.vramLockTex = 0;
-    glGlob.vramLockPal = 0;
-
     // init texture globals
 
     glGlob.clearColor = 0;
@@ -1097,7 +478,7 @@ void glResetTextures(void)
         gl_texture_data *texture = DynamicArrayGet(&glGlob.texturePtrs, i);
         if (texture)
         {
-            free(texture);
+            memTraceFree(texture);
             DynamicArraySet(&glGlob.texturePtrs, i, NULL);
         }
     }
@@ -1108,7 +489,7 @@ void glResetTextures(void)
         gl_palette_data *palette = DynamicArrayGet(&glGlob.palettePtrs, i);
         if (palette)
         {
-            free(palette);
+            memTraceFree(palette);
             DynamicArraySet(&glGlob.palettePtrs, i, NULL);
         }
     }
@@ -1162,7 +543,7 @@ static void removePaletteFromTexture(gl_texture_data *tex)
         DynamicArraySet(&glGlob.deallocPal, glGlob.deallocPalSize, (void *)tex->palIndex);
         glGlob.deallocPalSize++;
 
-        free(palette);
+        memTraceFree(palette);
         DynamicArraySet(&glGlob.palettePtrs, tex->palIndex, NULL);
 
         // If the active palette is the one we have just removed
@@ -1177,7 +558,8 @@ static void removePaletteFromTexture(gl_texture_data *tex)
 // Internal function that returns a new texture name
 static int glGenTexture(void)
 {
-    gl_texture_data *texture = calloc(1, sizeof(gl_texture_data));
+    gl_texture_data *texture = memTraceCalloc(1, sizeof(gl_texture_data),
+                                              MEMTRACE_TAG_VIDEOGL);
     if (texture == NULL)
         return 0;
 
@@ -1191,7 +573,7 @@ static int glGenTexture(void)
 
         if (!DynamicArraySet(&glGlob.texturePtrs, name, texture))
         {
-            free(texture);
+            memTraceFree(texture);
             return 0;
         }
 
@@ -1207,7 +589,7 @@ static int glGenTexture(void)
 
         if (!DynamicArraySet(&glGlob.texturePtrs, name, texture))
         {
-            free(texture);
+            memTraceFree(texture);
             return 0;
         }
 
@@ -1292,7 +674,7 @@ int glDeleteTextures(int n, int *names)
             if (texture->palIndex)
                 removePaletteFromTexture(texture);
 
-            free(texture);
+            memTraceFree(texture);
 
             // Clear pointer to mark the name as not having a texture
             DynamicArraySet(&glGlob.texturePtrs, names[index], NULL);
@@ -1342,22 +724,26 @@ int glLockVRAMBank(uint16_t *addr)
     if (actualVRAMBank < VRAM_A || actualVRAMBank > VRAM_G)
         return 0;
 
+    // The lock state is stored in the VRAM blocks, created by glInit()
+    if (glGlob.isActive == 0)
+        return 0;
+
     // Texture banks
     if (actualVRAMBank == VRAM_A)
-        glGlob.vramLockTex |= BIT(0);
+        glGlob.vramBlocksTex->lock |= BIT(0);
     else if (actualVRAMBank == VRAM_B)
-        glGlob.vramLockTex |= BIT(1);
+        glGlob.vramBlocksTex->lock |= BIT(1);
     else if (actualVRAMBank == VRAM_C)
-        glGlob.vramLockTex |= BIT(2);
+        glGlob.vramBlocksTex->lock |= BIT(2);
     else if (actualVRAMBank == VRAM_D)
-        glGlob.vramLockTex |= BIT(3);
+        glGlob.vramBlocksTex->lock |= BIT(3);
     // Palette banks
     else if (actualVRAMBank == VRAM_E)
-        glGlob.vramLockPal |= BIT(0);
+        glGlob.vramBlocksPal->lock |= BIT(0);
     else if (actualVRAMBank == VRAM_F)
-        glGlob.vramLockPal |= BIT(1);
+        glGlob.vramBlocksPal->lock |= BIT(1);
     else if (actualVRAMBank == VRAM_G)
-        glGlob.vramLockPal |= BIT(2);
+        glGlob.vramBlocksPal->lock |= BIT(2);
 
     return 1;
 }
@@ -1370,26 +756,284 @@ int glUnlockVRAMBank(uint16_t *addr)
     if (actualVRAMBank < VRAM_A || actualVRAMBank > VRAM_G)
         return 0;
 
+    // The lock state is stored in the VRAM blocks, created by glInit()
+    if (glGlob.isActive == 0)
+        return 0;
+
     // Texture banks
     if (actualVRAMBank == VRAM_A)
-        glGlob.vramLockTex &= ~BIT(0);
+        glGlob.vramBlocksTex->lock &= ~BIT(0);
     else if (actualVRAMBank == VRAM_B)
-        glGlob.vramLockTex &= ~BIT(1);
+        glGlob.vramBlocksTex->lock &= ~BIT(1);
     else if (actualVRAMBank == VRAM_C)
-        glGlob.vramLockTex &= ~BIT(2);
+        glGlob.vramBlocksTex->lock &= ~BIT(2);
     else if (actualVRAMBank == VRAM_D)
-        glGlob.vramLockTex &= ~BIT(3);
+        glGlob.vramBlocksTex->lock &= ~BIT(3);
     // Palette banks
     else if (actualVRAMBank == VRAM_E)
-        glGlob.vramLockPal &= ~BIT(0);
+        glGlob.vramBlocksPal->lock &= ~BIT(0);
     else if (actualVRAMBank == VRAM_F)
-        glGlob.vramLockPal &= ~BIT(1);
+        glGlob.vramBlocksPal->lock &= ~BIT(1);
     else if (actualVRAMBank == VRAM_G)
-        glGlob.vramLockPal &= ~BIT(2);
+        glGlob.vramBlocksPal->lock &= ~BIT(2);
 
     return 1;
 }
 
+// Returns the offset of a palette in the texture palette slots from its address
+// in VRAM.
+static uint32_t glPaletteAddr(const uint8_t *vramAddr)
+{
+    uint16_t *baseBank = vramGetBank((uint16_t *)vramAddr);
+    uint32_t addr = ((uint32_t)vramAddr - (uint32_t)baseBank);
+    uint8_t offset = 0;
+
+    if (baseBank == VRAM_F)
+        offset = (VRAM_F_CR >> 3) & 3;
+    else if (baseBank == VRAM_G)
+        offset = (VRAM_G_CR >> 3) & 3;
+    addr += ((offset & 0x1) * 0x4000) + ((offset & 0x2) * 0x8000);
+
+    return addr;
+}
+
+// Returns the name of the texture that owns a block of texture VRAM, or 0 if it
+// can't be moved (it doesn't belong to any texture or it is a GL_COMPRESSED
+// texture, whose two blocks need to be kept together).
+static int glCompactFindTexture(uint32_t index)
+{
+    for (unsigned int i = 0; i < glGlob.texturePtrs.cur_size; i++)
+    {
+        gl_texture_data *tex = DynamicArrayGet(&glGlob.texturePtrs, i);
+        if ((tex == NULL) || (tex->texIndex != index))
+            continue;
+
+        if (tex->texIndexExt != 0)
+            return 0;
+
+        return i;
+    }
+
+    return 0;
+}
+
+// Returns the name of the palette that owns a block of texture palette VRAM, or
+// 0 if it doesn't belong to any palette.
+static int glCompactFindPalette(uint32_t index)
+{
+    for (unsigned int i = 0; i < glGlob.palettePtrs.cur_size; i++)
+    {
+        gl_palette_data *pal = DynamicArrayGet(&glGlob.palettePtrs, i);
+        if ((pal != NULL) && (pal->palIndex == index))
+            return i;
+    }
+
+    return 0;
+}
+
+// Sets all the VRAM banks of a VRAM block that can be used by videoGL as LCD.
+static void glCompactSetLCD(bool isPal)
+{
+    if (isPal)
+    {
+        uint32_t vramCtrl = VRAM_EFG_CR;
+        int vramLock = glGlob.vramBlocksPal->lock;
+
+        if (((vramCtrl & 0x83) == 0x83) && !(vramLock & BIT(0)))
+            vramSetBankE(VRAM_E_LCD);
+        if (((vramCtrl & 0x8300) == 0x8300) && !(vramLock & BIT(1)))
+            vramSetBankF(VRAM_F_LCD);
+        if (((vramCtrl & 0x830000) == 0x830000) && !(vramLock & BIT(2)))
+            vramSetBankG(VRAM_G_LCD);
+    }
+    else
+    {
+        uint32_t vramCtrl = VRAM_CR;
+        int vramLock = glGlob.vramBlocksTex->lock;
+
+        if (((vramCtrl & 0x83) == 0x83) && !(vramLock & BIT(0)))
+            vramSetBankA(VRAM_A_LCD);
+        if (((vramCtrl & 0x8300) == 0x8300) && !(vramLock & BIT(1)))
+            vramSetBankB(VRAM_B_LCD);
+        if (((vramCtrl & 0x830000) == 0x830000) && !(vramLock & BIT(2)))
+            vramSetBankC(VRAM_C_LCD);
+        if (((vramCtrl & 0x83000000) == 0x83000000) && !(vramLock & BIT(3)))
+            vramSetBankD(VRAM_D_LCD);
+    }
+}
+
+// Moves blocks of a VRAM block to lower addresses to merge the free space
+// between them. It returns the number of bytes that have been copied. "done" is
+// set to false if it has stopped because of the budget.
+static size_t glCompactBlock(s_vramBlock *mb, bool isPal, size_t budget,
+                             bool *done)
+{
+    s_vramRange ranges[VRAM_MAX_RANGES];
+    int count = vramBlock_getRanges(mb, ranges);
+
+    uint32_t vramTemp = isPal ? VRAM_EFG_CR : VRAM_CR;
+    bool lcd = false;
+    size_t moved = 0;
+
+    int32_t i = mb->firstNode;
+    while (i != VRAM_NODE_NONE)
+    {
+        s_vramNode *n = &mb->nodes[i];
+        int32_t next = n->next;
+
+        // Only allocated blocks right after a free block can be moved
+        if ((n->state != VRAM_NODE_ALLOC) || (n->prev == VRAM_NODE_NONE) ||
+            (mb->nodes[n->prev].state != VRAM_NODE_FREE))
+        {
+            i = next;
+            continue;
+        }
+
+        uint32_t size = n->size;
+
+        // Blocks in banks that are locked or not mapped can't be moved
+        if (!vramBlock_rangesContain(ranges, count, n->addr, n->addr + size))
+        {
+            i = next;
+            continue;
+        }
+
+        int name = isPal ? glCompactFindPalette(i + 1) : glCompactFindTexture(i + 1);
+        if (name == 0)
+        {
+            i = next;
+            continue;
+        }
+
+        uint32_t align = 3;
+        if (isPal)
+        {
+            gl_palette_data *pal = DynamicArrayGet(&glGlob.palettePtrs, name);
+            align = pal->addrShift;
+        }
+
+        // Find the lowest address where the block fits, considering the free
+        // block before it and the space used by the block itself.
+        s_vramNode area = {
+            .addr = mb->nodes[n->prev].addr,
+            .size = mb->nodes[n->prev].size + size,
+        };
+        uint32_t dest = vramBlock_fit(&area, area.addr, size, align, ranges, count);
+
+        // Palettes can't be split between two banks because they may not be
+        // mapped to consecutive palette slots.
+        if (isPal && (dest != 0) && (vramGetBank((uint16_t *)dest)
+                      != vramGetBank((uint16_t *)(dest + size - 1))))
+            dest = 0;
+
+        if ((dest == 0) || (dest >= n->addr))
+        {
+            i = next;
+            continue;
+        }
+
+        if ((budget != 0) && (moved + size > budget))
+        {
+            // Blocks bigger than the budget are never moved
+            if (size <= budget)
+            {
+                *done = false;
+                break;
+            }
+
+            i = next;
+            continue;
+        }
+
+        uint32_t src = n->addr;
+        if (vramBlock_moveDown(mb, i + 1, dest) == 0)
+            break;
+
+        if (!lcd)
+        {
+            glCompactSetLCD(isPal);
+            lcd = true;
+        }
+
+        // The destination is always below the source, so it's safe to copy
+        // forwards even if the two areas overlap.
+        if (isPal)
+        {
+            dmaCopyHalfWords(0, (const void *)src, (void *)dest, size);
+
+            gl_palette_data *pal = DynamicArrayGet(&glGlob.palettePtrs, name);
+            pal->vramAddr = (void *)dest;
+            pal->addr = glPaletteAddr((uint8_t *)dest) >> pal->addrShift;
+
+            if (glGlob.activePalette == name)
+                GFX_PAL_FORMAT = pal->addr;
+        }
+        else
+        {
+            dmaCopyWords(0, (const void *)src, (void *)dest, size);
+
+            gl_texture_data *tex = DynamicArrayGet(&glGlob.texturePtrs, name);
+            tex->vramAddr = (void *)dest;
+            tex->texFormat = (tex->texFormat & ~0xFFFF) | ((dest >> 3) & 0xFFFF);
+
+            if (glGlob.activeTexture == name)
+                GFX_TEX_FORMAT = tex->texFormat;
+        }
+
+        moved += size;
+
+        // The free space is now after this block, so the next block may be
+        // moved too.
+        i = next;
+    }
+
+    if (lcd)
+    {
+        if (isPal)
+            vramRestoreBanks_EFG(vramTemp);
+        else
+            vramRestorePrimaryBanks(vramTemp);
+    }
+
+    return moved;
+}
+
+bool glCompactTextures(size_t budget, size_t *reclaimed)
+{
+    bool done = true;
+
+    if (glGlob.isActive == 0)
+    {
+        if (reclaimed)
+            *reclaimed = 0;
+        return true;
+    }
+
+    uint32_t before, after;
+    vramBlock_getStats(glGlob.vramBlocksTex, NULL, &before, NULL);
+
+    size_t moved = glCompactBlock(glGlob.vramBlocksTex, false, budget, &done);
+
+    if (done)
+    {
+        size_t left = 0;
+        if (budget != 0)
+            left = (moved < budget) ? budget - moved : 0;
+
+        if ((budget == 0) || (left != 0))
+            glCompactBlock(glGlob.vramBlocksPal, true, left, &done);
+        else
+            done = false;
+    }
+
+    vramBlock_getStats(glGlob.vramBlocksTex, NULL, &after, NULL);
+
+    if (reclaimed)
+        *reclaimed = (after > before) ? after - before : 0;
+
+    return done;
+}
+
 // Set the current named texture to the active texture. The target is ignored as
 // all DS textures are 2D.
 int glBindTexture(int target, int name)
@@ -1400,6 +1044,8 @@ int glBindTexture(int target, int name)
     if (glGlob.activeTexture == name)
         return 0;
 
+    glProfileCounters.texture_binds++;
+
     gl_texture_data *tex = DynamicArrayGet(&glGlob.texturePtrs, name);
 
     // Has the name been generated with glGenTextures()?
@@ -1431,6 +1077,35 @@ int glBindTexture(int target, int name)
     return 1;
 }
 
+// Add the commands that bind a texture to a display list. This doesn't modify
+// the active texture.
+int glListBindTexture(GLDisplayList *list, int name)
+{
+    gl_texture_data *tex = DynamicArrayGet(&glGlob.texturePtrs, name);
+
+    if (tex == NULL)
+    {
+        glListTexFormat(list, 0);
+        glListPalFormat(list, 0);
+        return 0;
+    }
+
+    glListTexFormat(list, tex->texFormat);
+
+    if (tex->palIndex)
+    {
+        gl_palette_data *pal = DynamicArrayGet(&glGlob.palettePtrs, tex->palIndex);
+        sassert(pal, "tex->palIndex is set, but no pal available");
+        glListPalFormat(list, pal->addr);
+    }
+    else
+    {
+        glListPalFormat(list, 0);
+    }
+
+    return 1;
+}
+
 // Load a 15-bit color format palette into palette memory, and set it to the
 // currently bound texture.
 int glColorTableEXT(int target, int empty1, uint16_t width, int empty2, int empty3,
@@ -1472,17 +1147,7 @@ int glColorTableEXT(int target, int empty1, uint16_t width, int empty2, int empt
     }
 
     // Calculate the address, logical and actual, of where the palette will go
-    uint16_t *baseBank = vramGetBank((uint16_t *)checkAddr);
-    uint32_t addr = ((uint32_t)checkAddr - (uint32_t)baseBank);
-    uint8_t offset = 0;
-
-    if (baseBank == VRAM_F)
-        offset = (VRAM_F_CR >> 3) & 3;
-    else if (baseBank == VRAM_G)
-        offset = (VRAM_G_CR >> 3) & 3;
-    addr += ((offset & 0x1) * 0x4000) + ((offset & 0x2) * 0x8000);
-
-    addr >>= colFormatVal;
+    uint32_t addr = glPaletteAddr(checkAddr) >> colFormatVal;
     if (colFormatVal == 3 && addr >= 0x2000)
     {
         // Palette location not good because 4 color mode cannot extend
@@ -1491,7 +1156,8 @@ int glColorTableEXT(int target, int empty1, uint16_t width, int empty2, int empt
         return 0;
     }
 
-    gl_palette_data *palette = malloc(sizeof(gl_palette_data));
+    gl_palette_data *palette = memTraceMalloc(sizeof(gl_palette_data),
+                                              MEMTRACE_TAG_VIDEOGL);
     if (palette == NULL)
         return 0;
 
@@ -1503,7 +1169,7 @@ int glColorTableEXT(int target, int empty1, uint16_t width, int empty2, int empt
 
         if (!DynamicArraySet(&glGlob.palettePtrs, palIndex, palette))
         {
-            free(palette);
+            memTraceFree(palette);
             return 0;
         }
 
@@ -1516,7 +1182,7 @@ int glColorTableEXT(int target, int empty1, uint16_t width, int empty2, int empt
 
         if (!DynamicArraySet(&glGlob.palettePtrs, palIndex, palette))
         {
-            free(palette);
+            memTraceFree(palette);
             return 0;
         }
 
@@ -1530,6 +1196,7 @@ int glColorTableEXT(int target, int empty1, uint16_t width, int empty2, int empt
 
     palette->vramAddr = checkAddr;
     palette->addr = addr;
+    palette->addrShift = colFormatVal;
 
     palette->connectCount = 1;
     palette->palSize = width << 1;
@@ -1854,11 +1521,6 @@ int glTexImage2D(int target, int empty1, GL_TEXTURE_TYPE_ENUM type, int sizeX, i
         }
         else // if (type == GL_COMPRESSED)
         {
-            uint8_t *vramBAddr = (uint8_t *)VRAM_B;
-            uint8_t *vramACAddr = NULL;
-            uint8_t *vramBFound, *vramACFound;
-            uint32_t vramBAllocSize = size >> 1;
-
             // The main texture chunk needs to fit in one VRAM bank (A or C)
             if (size > 128 * 1024)
                 return 0;
@@ -1872,81 +1534,11 @@ int glTexImage2D(int target, int empty1, GL_TEXTURE_TYPE_ENUM type, int sizeX, i
                 (VRAM_C_CR != (VRAM_ENABLE | VRAM_C_TEXTURE_SLOT2)))
                 return 0;
 
-            // The process of finding a valid spot for compressed textures
-            // is as follows:
-            //
-            // - Examine first available spot in VRAM_B for the header data.
-            // - Extrapolate where the tile data would go in VRAM_A or VRAM_C if
-            //   the spot in VRAM_B were used.
-            // - Check the extrapolated area to see if it is an empty spot.
-            // - If not, then adjust the header spot in VRAM_B by a ratio amount
-            //   found by the tile spot.
-
-            while (1)
-            {
-                // Check designated opening, and return available spot
-                vramBFound = vramBlock_examineSpecial(glGlob.vramBlocksTex,
-                                                      vramBAddr, vramBAllocSize, 2);
-
-                // Make sure that the space found in VRAM_B is completely in
-                // it, and not extending out of it. If it extends out of it,
-                // there is no space in VRAM_B, so the texture can't be loaded.
-                if ((vramGetBank((uint16_t *)vramBFound) != VRAM_B) ||
-                    (vramGetBank((uint16_t *)(vramBFound + vramBAllocSize) - 1) != VRAM_B))
-                {
-                    return 0;
-                }
-
-                uint32_t offset = (uint32_t)vramBFound - (uint32_t)VRAM_B;
-
-                // Make sure it is completely on either half of VRAM_B. The
-                // first half maps to VRAM_A, the second half maps to VRAM_C.
-                if ((offset < 0x10000) && (offset + vramBAllocSize > 0x10000))
-                {
-                    // If the slot is in both halves, try again starting from
-                    // the second half of VRAM_B.
-                    vramBAddr = (uint8_t *)VRAM_B + 0x10000;
-                    continue;
-                }
-
-                // Retrieve the tile location in VRAM_A or VRAM_C
-                vramACAddr = (uint8_t *)(offset >= 0x10000 ? VRAM_C : VRAM_A)
-                             + ((offset & 0xFFFF) << 1);
-
-                vramACFound = vramBlock_examineSpecial(glGlob.vramBlocksTex,
-                                                       vramACAddr, size, 3);
-                if (vramACAddr == vramACFound)
-                {
-                    // Valid addresses found, lock them for this texture.
-                    tex->texIndex = vramBlock_allocateSpecial(glGlob.vramBlocksTex,
-                                                              vramACFound, size);
-                    tex->texIndexExt = vramBlock_allocateSpecial(
-                        glGlob.vramBlocksTex,
-                        vramBlock_examineSpecial(glGlob.vramBlocksTex, vramBFound,
-                                                 vramBAllocSize, 2),
-                        vramBAllocSize);
-
-                    // This should never happen because we have just checked
-                    // that they are free.
-                    sassert((tex->texIndex != 0) && (tex->texIndexExt != 0),
-                            "Failed to lock tex and texExt VRAM");
-                    break;
-                }
-
-                // If we started to look for space from VRAM_A, but VRAM_A is
-                // completely full (or not mapped for textures) it is possible
-                // that vramACFound is inside VRAM_B. If that happens, restart
-                // from VRAM_C.
-                if (vramGetBank((uint16_t *)vramACFound) == VRAM_B)
-                {
-                    vramBAddr = (uint8_t *)VRAM_B + 0x10000;
-                    continue;
-                }
-
-                // Advance the address in VRAM_B by the difference found with
-                // VRAM_A/VRAM_C, divided by 2. Then, try again there.
-                vramBAddr += ((uint32_t)vramACFound - (uint32_t)vramACAddr) >> 1;
-            }
+            // Find a spot in VRAM_A or VRAM_C for the texel data that has the
+            // matching spot in VRAM_B free for the palette index data.
+            if (vramBlock_allocateCompressed(glGlob.vramBlocksTex, size,
+                                             &tex->texIndex, &tex->texIndexExt) == 0)
+                return 0;
         }
 
         if (tex->texIndex)
@@ -2105,6 +1697,29 @@ void glGetInt(GL_GET_ENUM param, int *i)
                 *i = 8 << ((tex->texFormat >> 23) & 7);
             break;
 
+        // These values count all the memory managed by the allocators, even if
+        // some VRAM banks aren't mapped or are locked.
+        case GL_GET_TEXTURE_VRAM_FREE:
+        case GL_GET_TEXTURE_VRAM_LARGEST_FREE:
+        case GL_GET_TEXTURE_VRAM_FREE_BLOCKS:
+        case GL_GET_PALETTE_VRAM_FREE:
+        case GL_GET_PALETTE_VRAM_LARGEST_FREE:
+        case GL_GET_PALETTE_VRAM_FREE_BLOCKS:
+        {
+            bool isPal = param >= GL_GET_PALETTE_VRAM_FREE;
+            s_vramBlock *mb = isPal ? glGlob.vramBlocksPal : glGlob.vramBlocksTex;
+            uint32_t stats[3] = { 0, 0, 0 };
+
+            if (mb != NULL)
+                vramBlock_getStats(mb, &stats[0], &stats[1], &stats[2]);
+
+            if (isPal)
+                *i = stats[param - GL_GET_PALETTE_VRAM_FREE];
+            else
+                *i = stats[param - GL_GET_TEXTURE_VRAM_FREE];
+            break;
+        }
+
         default:
             break;
     }
@@ -0,0 +1,870 @@
+// SPDX-License-Identifier: Zlib
+// SPDX-FileNotice: Modified from the original version by the BlocksDS project.
+//
+// Copyright (C) 2005 Michael Noland (joat)
+// Copyright (C) 2005 Jason Rogers (dovoto)
+// Copyright (C) 2005 Dave Murphy (WinterMute)
+
+// Allocator of texture and palette VRAM used by videoGL
+
+#include <nds/arm9/sassert.h>
+#include <nds/arm9/video.h>
+#include <nds/memtrace.h>
+#include <nds/ndstypes.h>
+
+#include "vramBlock.h"
+
+// Returns true if node "a" goes before node "b" in the tree of free nodes
+static inline bool vramBlock_freeBefore(const s_vramNode *a, const s_vramNode *b)
+{
+    return (a->size < b->size) || ((a->size == b->size) && (a->addr < b->addr));
+}
+
+// Replace child "old" of node "parent" by "child". If "parent" is
+// VRAM_NODE_NONE, "old" is the root of the tree.
+static void vramBlock_replaceChild(s_vramBlock *mb, int32_t parent, int32_t old,
+                                   int32_t child)
+{
+    if (parent == VRAM_NODE_NONE)
+        mb->freeRoot = child;
+    else if (mb->nodes[parent].left == old)
+        mb->nodes[parent].left = child;
+    else
+        mb->nodes[parent].right = child;
+}
+
+// Rotate the tree of free nodes so that node "x" takes the place of its parent.
+// The order of the nodes doesn't change.
+static void vramBlock_rotateUp(s_vramBlock *mb, int32_t x)
+{
+    s_vramNode *nodes = mb->nodes;
+    int32_t p = nodes[x].parent;
+    int32_t g = nodes[p].parent;
+
+    if (nodes[p].left == x)
+    {
+        int32_t b = nodes[x].right;
+        nodes[p].left = b;
+        if (b != VRAM_NODE_NONE)
+            nodes[b].parent = p;
+        nodes[x].right = p;
+    }
+    else
+    {
+        int32_t b = nodes[x].left;
+        nodes[p].right = b;
+        if (b != VRAM_NODE_NONE)
+            nodes[b].parent = p;
+        nodes[x].left = p;
+    }
+
+    nodes[p].parent = x;
+    nodes[x].parent = g;
+    vramBlock_replaceChild(mb, g, p, x);
+}
+
+// Insert a node in the tree of free nodes. It's added as a leaf, and then it's
+// rotated up until its parent has a higher priority.
+static void vramBlock_freeInsert(s_vramBlock *mb, int32_t i)
+{
+    s_vramNode *n = &mb->nodes[i];
+
+    int32_t parent = VRAM_NODE_NONE;
+    int32_t *link = &mb->freeRoot;
+    while (*link != VRAM_NODE_NONE)
+    {
+        parent = *link;
+        s_vramNode *p = &mb->nodes[parent];
+        link = vramBlock_freeBefore(n, p) ? &p->left : &p->right;
+    }
+
+    *link = i;
+    n->state = VRAM_NODE_FREE;
+    n->parent = parent;
+    n->left = VRAM_NODE_NONE;
+    n->right = VRAM_NODE_NONE;
+
+    uint32_t priority = vramBlock_priority(i);
+    while ((n->parent != VRAM_NODE_NONE) &&
+           (vramBlock_priority(n->parent) < priority))
+        vramBlock_rotateUp(mb, i);
+
+    mb->freeBytes += n->size;
+    mb->freeNodes++;
+}
+
+// Remove a node from the tree of free nodes. It's rotated down until it has at
+// most one child, and then it's replaced by that child.
+static void vramBlock_freeRemove(s_vramBlock *mb, int32_t i)
+{
+    s_vramNode *n = &mb->nodes[i];
+
+    while ((n->left != VRAM_NODE_NONE) && (n->right != VRAM_NODE_NONE))
+    {
+        if (vramBlock_priority(n->left) > vramBlock_priority(n->right))
+            vramBlock_rotateUp(mb, n->left);
+        else
+            vramBlock_rotateUp(mb, n->right);
+    }
+
+    int32_t child = (n->left != VRAM_NODE_NONE) ? n->left : n->right;
+    if (child != VRAM_NODE_NONE)
+        mb->nodes[child].parent = n->parent;
+    vramBlock_replaceChild(mb, n->parent, i, child);
+
+    mb->freeBytes -= n->size;
+    mb->freeNodes--;
+}
+
+// Returns the first free node in tree order that is at least "size" bytes big,
+// which is the smallest one (with the lowest address if there are several of
+// the same size).
+static int32_t vramBlock_freeLowerBound(s_vramBlock *mb, uint32_t size)
+{
+    int32_t found = VRAM_NODE_NONE;
+    int32_t i = mb->freeRoot;
+
+    while (i != VRAM_NODE_NONE)
+    {
+        if (mb->nodes[i].size >= size)
+        {
+            found = i;
+            i = mb->nodes[i].left;
+        }
+        else
+        {
+            i = mb->nodes[i].right;
+        }
+    }
+
+    return found;
+}
+
+// Returns the free node that goes after a free node in tree order
+static int32_t vramBlock_freeNext(s_vramBlock *mb, int32_t i)
+{
+    if (mb->nodes[i].right != VRAM_NODE_NONE)
+    {
+        i = mb->nodes[i].right;
+        while (mb->nodes[i].left != VRAM_NODE_NONE)
+            i = mb->nodes[i].left;
+        return i;
+    }
+
+    int32_t p = mb->nodes[i].parent;
+    while ((p != VRAM_NODE_NONE) && (mb->nodes[p].right == i))
+    {
+        i = p;
+        p = mb->nodes[p].parent;
+    }
+
+    return p;
+}
+
+// Make sure that there are at least "count" unused nodes in the pool. This
+// needs to be called before modifying the list of nodes so that the pool
+// doesn't need to grow (and fail) halfway through an operation. The array of
+// nodes may be moved, so pointers to nodes aren't valid after calling this.
+static int vramBlock_reserveNodes(s_vramBlock *mb, uint32_t count)
+{
+    if (mb->numUnused >= count)
+        return 1;
+
+    uint32_t newNum = mb->numNodes * 2;
+    if (newNum < mb->numNodes + count)
+        newNum = mb->numNodes + count;
+
+    s_vramNode *nodes = memTraceRealloc(mb->nodes, newNum * sizeof(s_vramNode),
+                                        MEMTRACE_TAG_VIDEOGL);
+    if (nodes == NULL)
+        return 0;
+
+    for (uint32_t i = mb->numNodes; i < newNum; i++)
+    {
+        nodes[i].state = VRAM_NODE_UNUSED;
+        nodes[i].right = mb->firstUnused;
+        mb->firstUnused = i;
+    }
+
+    mb->nodes = nodes;
+    mb->numUnused += newNum - mb->numNodes;
+    mb->numNodes = newNum;
+
+    return 1;
+}
+
+static int32_t vramBlock_newNode(s_vramBlock *mb)
+{
+    int32_t i = mb->firstUnused;
+    sassert(i != VRAM_NODE_NONE, "No VRAM nodes reserved");
+
+    mb->firstUnused = mb->nodes[i].right;
+    mb->numUnused--;
+
+    return i;
+}
+
+static void vramBlock_releaseNode(s_vramBlock *mb, int32_t i)
+{
+    mb->nodes[i].state = VRAM_NODE_UNUSED;
+    mb->nodes[i].right = mb->firstUnused;
+    mb->firstUnused = i;
+    mb->numUnused++;
+}
+
+// Get the address ranges that can be used for allocations, which are the ones
+// of VRAM banks that are mapped for textures (or texture palettes) and aren't
+// locked. Contiguous banks are merged into a single range.
+int vramBlock_getRanges(s_vramBlock *mb, s_vramRange *ranges)
+{
+    bool isPal = mb->startAddr >= (uint8_t *)VRAM_E;
+    uint32_t vramCtrl = isPal ? VRAM_EFG_CR : VRAM_CR;
+    int vramLock = mb->lock;
+    uint32_t numBanks = isPal ? 3 : 4;
+    int count = 0;
+
+    for (uint32_t i = 0; i < numBanks; i++)
+    {
+        uint32_t start, size;
+
+        if (isPal)
+        {
+            start = (i == 0) ? (uint32_t)VRAM_E : (uint32_t)VRAM_F + ((i - 1) * 0x4000);
+            size = (i == 0) ? 0x10000 : 0x4000;
+        }
+        else
+        {
+            start = (uint32_t)VRAM_A + (i * 0x20000);
+            size = 0x20000;
+        }
+
+        // VRAM_ENABLE | ( VRAM_x_TEXTURE | VRAM_x_TEX_PALETTE )
+        if (((vramCtrl & 0x83) == 0x83) && !(vramLock & 0x1))
+        {
+            if ((count > 0) && (ranges[count - 1].end == start))
+            {
+                ranges[count - 1].end = start + size;
+            }
+            else
+            {
+                ranges[count].start = start;
+                ranges[count].end = start + size;
+                count++;
+            }
+        }
+
+        vramCtrl >>= 8;
+        vramLock >>= 1;
+    }
+
+    return count;
+}
+
+bool vramBlock_rangesContain(const s_vramRange *ranges, int count,
+                             uint32_t start, uint32_t end)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if ((start >= ranges[i].start) && (end <= ranges[i].end))
+            return true;
+    }
+
+    return false;
+}
+
+// Returns the lowest address in a free node, not lower than "from", where
+// "size" bytes aligned to (1 << align) fit inside the usable ranges. It
+// returns 0 if they don't fit.
+uint32_t vramBlock_fit(const s_vramNode *n, uint32_t from, uint32_t size,
+                       uint32_t align, const s_vramRange *ranges, int count)
+{
+    uint32_t mask = (1 << align) - 1;
+    uint32_t nodeEnd = n->addr + n->size;
+
+    if (from < n->addr)
+        from = n->addr;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (ranges[i].end <= from)
+            continue;
+        if (ranges[i].start >= nodeEnd)
+            break;
+
+        uint32_t start = (from > ranges[i].start) ? from : ranges[i].start;
+        uint32_t end = (nodeEnd < ranges[i].end) ? nodeEnd : ranges[i].end;
+
+        start = (start + mask) & ~mask;
+
+        if ((start < end) && (end - start >= size))
+            return start;
+    }
+
+    return 0;
+}
+
+// Allocate the area [addr, addr + size) of a free node. The free space before
+// and after the area is split into new free nodes. The caller must reserve 2
+// nodes before calling this function.
+static int32_t vramBlock_carve(s_vramBlock *mb, int32_t i, uint32_t addr,
+                               uint32_t size)
+{
+    vramBlock_freeRemove(mb, i);
+
+    s_vramNode *n = &mb->nodes[i];
+    uint32_t end = n->addr + n->size;
+
+    if (addr > n->addr)
+    {
+        int32_t h = vramBlock_newNode(mb);
+        s_vramNode *head = &mb->nodes[h];
+
+        head->addr = n->addr;
+        head->size = addr - n->addr;
+        head->prev = n->prev;
+        head->next = i;
+
+        if (n->prev != VRAM_NODE_NONE)
+            mb->nodes[n->prev].next = h;
+        else
+            mb->firstNode = h;
+        n->prev = h;
+
+        vramBlock_freeInsert(mb, h);
+    }
+
+    if (addr + size < end)
+    {
+        int32_t t = vramBlock_newNode(mb);
+        s_vramNode *tail = &mb->nodes[t];
+
+        tail->addr = addr + size;
+        tail->size = end - (addr + size);
+        tail->prev = i;
+        tail->next = n->next;
+
+        if (n->next != VRAM_NODE_NONE)
+            mb->nodes[n->next].prev = t;
+        n->next = t;
+
+        vramBlock_freeInsert(mb, t);
+    }
+
+    n->addr = addr;
+    n->size = size;
+    n->state = VRAM_NODE_ALLOC;
+
+    return i;
+}
+
+// Free an allocated node and merge it with the free nodes next to it
+static void vramBlock_release(s_vramBlock *mb, int32_t i)
+{
+    s_vramNode *n = &mb->nodes[i];
+
+    int32_t p = n->prev;
+    if ((p != VRAM_NODE_NONE) && (mb->nodes[p].state == VRAM_NODE_FREE))
+    {
+        vramBlock_freeRemove(mb, p);
+
+        n->addr = mb->nodes[p].addr;
+        n->size += mb->nodes[p].size;
+        n->prev = mb->nodes[p].prev;
+
+        if (n->prev != VRAM_NODE_NONE)
+            mb->nodes[n->prev].next = i;
+        else
+            mb->firstNode = i;
+
+        vramBlock_releaseNode(mb, p);
+    }
+
+    int32_t q = n->next;
+    if ((q != VRAM_NODE_NONE) && (mb->nodes[q].state == VRAM_NODE_FREE))
+    {
+        vramBlock_freeRemove(mb, q);
+
+        n->size += mb->nodes[q].size;
+        n->next = mb->nodes[q].next;
+
+        if (n->next != VRAM_NODE_NONE)
+            mb->nodes[n->next].prev = i;
+
+        vramBlock_releaseNode(mb, q);
+    }
+
+    vramBlock_freeInsert(mb, i);
+}
+
+// Find the free node that contains an address, starting the search at the
+// specified node.
+static int32_t vramBlock_findFree(s_vramBlock *mb, int32_t i, uint32_t addr)
+{
+    while (i != VRAM_NODE_NONE)
+    {
+        s_vramNode *n = &mb->nodes[i];
+
+        if (addr < n->addr)
+            i = n->prev;
+        else if (addr >= n->addr + n->size)
+            i = n->next;
+        else
+            return (n->state == VRAM_NODE_FREE) ? i : VRAM_NODE_NONE;
+    }
+
+    return VRAM_NODE_NONE;
+}
+
+static int vramBlock_init(s_vramBlock *mb)
+{
+    mb->nodes = NULL;
+    mb->numNodes = 0;
+    mb->numUnused = 0;
+    mb->firstUnused = VRAM_NODE_NONE;
+
+    mb->freeRoot = VRAM_NODE_NONE;
+
+    mb->freeBytes = 0;
+    mb->freeNodes = 0;
+
+    mb->lastExamined = VRAM_NODE_NONE;
+    mb->lastExaminedAddr = NULL;
+    mb->lastExaminedSize = 0;
+
+    // Start with enough nodes for a few allocations. The pool will grow if
+    // more are needed.
+    if (vramBlock_reserveNodes(mb, 32) == 0)
+        return 0;
+
+    // One free node that covers all the memory
+    int32_t i = vramBlock_newNode(mb);
+    mb->nodes[i].addr = (uint32_t)mb->startAddr;
+    mb->nodes[i].size = (uint32_t)mb->endAddr - (uint32_t)mb->startAddr;
+    mb->nodes[i].prev = VRAM_NODE_NONE;
+    mb->nodes[i].next = VRAM_NODE_NONE;
+    mb->firstNode = i;
+
+    vramBlock_freeInsert(mb, i);
+
+    return 1;
+}
+
+s_vramBlock *vramBlock_Construct(uint8_t *start, uint8_t *end)
+{
+    // Block Container is constructed, with a starting and ending address. Then
+    // initialization of the first block is made.
+    struct s_vramBlock *mb = memTraceMalloc(sizeof(s_vramBlock),
+                                            MEMTRACE_TAG_VIDEOGL);
+    if (mb == NULL)
+        return NULL;
+
+    if (start > end)
+    {
+        mb->startAddr = end;
+        mb->endAddr = start;
+    }
+    else
+    {
+        mb->startAddr = start;
+        mb->endAddr = end;
+    }
+
+    mb->lock = 0;
+
+    if (vramBlock_init(mb) == 0)
+    {
+        memTraceFree(mb);
+        return NULL;
+    }
+
+    return mb;
+}
+
+static void vramBlock_terminate(s_vramBlock *mb)
+{
+    memTraceFree(mb->nodes);
+    mb->nodes = NULL;
+    mb->numNodes = 0;
+}
+
+void vramBlock_Deconstruct(s_vramBlock *mb)
+{
+    // Container must exist for deconstructing
+    if (mb)
+    {
+        vramBlock_terminate(mb);
+        memTraceFree(mb);
+    }
+}
+
+// Find the first free address (starting at "addr") where "size" bytes fit. The
+// result is remembered so that vramBlock_allocateSpecial() can use it.
+uint8_t *vramBlock_examineSpecial(s_vramBlock *mb, uint8_t *addr, uint32_t size,
+                                  uint8_t align)
+{
+    mb->lastExamined = VRAM_NODE_NONE;
+    mb->lastExaminedAddr = NULL;
+    mb->lastExaminedSize = 0;
+
+    // Simple validity tests
+    if (!addr || !size || align >= 8)
+        return NULL;
+
+    s_vramRange ranges[VRAM_MAX_RANGES];
+    int count = vramBlock_getRanges(mb, ranges);
+
+    for (int32_t i = mb->firstNode; i != VRAM_NODE_NONE; i = mb->nodes[i].next)
+    {
+        s_vramNode *n = &mb->nodes[i];
+
+        if ((n->state != VRAM_NODE_FREE) || (n->addr + n->size <= (uint32_t)addr))
+            continue;
+
+        uint32_t found = vramBlock_fit(n, (uint32_t)addr, size, align, ranges, count);
+        if (found != 0)
+        {
+            mb->lastExamined = i;
+            mb->lastExaminedAddr = (uint8_t *)found;
+            mb->lastExaminedSize = size;
+            return (uint8_t *)found;
+        }
+    }
+
+    return NULL;
+}
+
+uint32_t vramBlock_allocateSpecial(s_vramBlock *mb, uint8_t *addr, uint32_t size)
+{
+    // Simple validity tests. Special allocations require "examination" data
+    if (!addr || !size || mb->lastExamined == VRAM_NODE_NONE)
+        return 0;
+
+    if (mb->lastExaminedAddr != addr || mb->lastExaminedSize != size)
+        return 0;
+
+    if (vramBlock_reserveNodes(mb, 2) == 0)
+        return 0;
+
+    int32_t i = vramBlock_carve(mb, mb->lastExamined, (uint32_t)addr, size);
+
+    // Clear out examination data
+    mb->lastExamined = VRAM_NODE_NONE;
+    mb->lastExaminedAddr = NULL;
+    mb->lastExaminedSize = 0;
+
+    return i + 1;
+}
+
+// Allocate a block using the free node that fits best
+uint32_t vramBlock_allocateBlock(s_vramBlock *mb, uint32_t size, uint8_t align)
+{
+    if (!size || align >= 8)
+        return 0;
+
+    if (vramBlock_reserveNodes(mb, 2) == 0)
+        return 0;
+
+    s_vramRange ranges[VRAM_MAX_RANGES];
+    int count = vramBlock_getRanges(mb, ranges);
+
+    // The free nodes are checked in tree order, starting with the smallest one
+    // that is big enough, so the first node that can be used is the best fit
+    // (the smallest one, with the lowest address if there are several of the
+    // same size). Normally, this stops at the first node.
+    //
+    // Nodes that are big enough are only skipped if alignment or locked banks
+    // prevent them from being used, so in the worst case all free nodes are
+    // checked.
+    for (int32_t i = vramBlock_freeLowerBound(mb, size); i != VRAM_NODE_NONE;
+         i = vramBlock_freeNext(mb, i))
+    {
+        s_vramNode *n = &mb->nodes[i];
+
+        uint32_t addr = vramBlock_fit(n, n->addr, size, align, ranges, count);
+        if (addr != 0)
+            return vramBlock_carve(mb, i, addr, size) + 1;
+    }
+
+    return 0;
+}
+
+// Iterator over the free areas of a VRAM block inside a window
+typedef struct
+{
+    int32_t next;       // Next node to check
+    int32_t node;       // Node of the current area
+    uint32_t start;     // Current area
+    uint32_t end;
+    uint32_t winStart;  // Window
+    uint32_t winEnd;
+} s_vramFreeIter;
+
+static bool vramBlock_nextFree(s_vramBlock *mb, s_vramFreeIter *it)
+{
+    while (it->next != VRAM_NODE_NONE)
+    {
+        s_vramNode *n = &mb->nodes[it->next];
+
+        if (n->addr >= it->winEnd)
+            break;
+
+        it->node = it->next;
+        it->next = n->next;
+
+        if (n->state != VRAM_NODE_FREE)
+            continue;
+
+        uint32_t start = (n->addr > it->winStart) ? n->addr : it->winStart;
+        uint32_t end = n->addr + n->size;
+        if (end > it->winEnd)
+            end = it->winEnd;
+
+        if (start < end)
+        {
+            it->start = start;
+            it->end = end;
+            return true;
+        }
+    }
+
+    it->next = VRAM_NODE_NONE;
+    return false;
+}
+
+// Allocate the two blocks of a GL_COMPRESSED texture. The texel data goes to
+// VRAM_A or VRAM_C, and the palette index data goes to VRAM_B. Texel data at
+// offset N of VRAM_A uses the index data at offset N / 2 of VRAM_B. Texel data
+// at offset N of VRAM_C uses the index data at offset 0x10000 + N / 2 of
+// VRAM_B.
+//
+// The free areas of VRAM_B and VRAM_A (or VRAM_C) are checked in address order
+// at the same time, so this is linear in the number of nodes.
+int vramBlock_allocateCompressed(s_vramBlock *mb, uint32_t size,
+                                 uint32_t *index, uint32_t *indexExt)
+{
+    uint32_t extSize = size >> 1;
+
+    if ((size == 0) || (size > 0x20000))
+        return 0;
+
+    if (vramBlock_reserveNodes(mb, 4) == 0)
+        return 0;
+
+    s_vramRange ranges[VRAM_MAX_RANGES];
+    int count = vramBlock_getRanges(mb, ranges);
+
+    for (int half = 0; half < 2; half++)
+    {
+        uint32_t extBase = (uint32_t)VRAM_B + (half * 0x10000);
+        uint32_t mainBase = (uint32_t)(half ? VRAM_C : VRAM_A);
+
+        if (!vramBlock_rangesContain(ranges, count, extBase, extBase + 0x10000))
+            continue;
+        if (!vramBlock_rangesContain(ranges, count, mainBase, mainBase + 0x20000))
+            continue;
+
+        s_vramFreeIter ext = {
+            mb->firstNode, VRAM_NODE_NONE, 0, 0, extBase, extBase + 0x10000
+        };
+        s_vramFreeIter tex = {
+            mb->firstNode, VRAM_NODE_NONE, 0, 0, mainBase, mainBase + 0x20000
+        };
+
+        bool hasExt = vramBlock_nextFree(mb, &ext);
+        bool hasMain = vramBlock_nextFree(mb, &tex);
+
+        while (hasExt && hasMain)
+        {
+            // Range of offsets inside this half of VRAM_B that can be used
+            // according to each free area.
+            int32_t extLo = ext.start - extBase;
+            int32_t extHi = (int32_t)(ext.end - extBase) - (int32_t)extSize;
+            int32_t mainLo = (tex.start - mainBase + 1) / 2;
+            int32_t mainHi = ((int32_t)(tex.end - mainBase) - (int32_t)size) / 2;
+
+            // The index data must be aligned to 4 bytes, which also aligns the
+            // texel data to 8 bytes.
+            int32_t lo = (extLo > mainLo) ? extLo : mainLo;
+            int32_t hi = (extHi < mainHi) ? extHi : mainHi;
+            lo = (lo + 3) & ~3;
+
+            if ((extHi >= 0) && (mainHi >= 0) && (lo <= hi))
+            {
+                uint32_t mainAddr = mainBase + (lo * 2);
+                uint32_t extAddr = extBase + lo;
+
+                int32_t m = vramBlock_carve(mb, tex.node, mainAddr, size);
+
+                // The node of the index data may have been split by the
+                // previous allocation.
+                int32_t e = vramBlock_findFree(mb, m, extAddr);
+                sassert(e != VRAM_NODE_NONE, "Compressed texture block not free");
+                e = vramBlock_carve(mb, e, extAddr, extSize);
+
+                *index = m + 1;
+                *indexExt = e + 1;
+                return 1;
+            }
+
+            // Move forward the area that ends first
+            if (extHi < mainHi)
+                hasExt = vramBlock_nextFree(mb, &ext);
+            else
+                hasMain = vramBlock_nextFree(mb, &tex);
+        }
+    }
+
+    return 0;
+}
+
+s_vramNode *vramBlock_getNode(s_vramBlock *mb, uint32_t index)
+{
+    if ((index == 0) || (index > mb->numNodes))
+        return NULL;
+
+    s_vramNode *n = &mb->nodes[index - 1];
+    if (n->state != VRAM_NODE_ALLOC)
+        return NULL;
+
+    return n;
+}
+
+// TODO: The return value of this function isn't checked anywhere, but I'm not
+// sure if this is the right approach. All we can do if we fail to deallocate
+// memory is crash.
+uint32_t vramBlock_deallocateBlock(s_vramBlock *mb, uint32_t index)
+{
+    if (vramBlock_getNode(mb, index) == NULL)
+        return 0;
+
+    vramBlock_release(mb, index - 1);
+    return 1;
+}
+
+int vramBlock_deallocateAll(s_vramBlock *mb)
+{
+    // Reset the entire container
+    vramBlock_terminate(mb);
+    if (vramBlock_init(mb) == 0)
+        return 0;
+
+    return 1;
+}
+
+uint8_t *vramBlock_getAddr(s_vramBlock *mb, uint32_t index)
+{
+    s_vramNode *n = vramBlock_getNode(mb, index);
+    if (n)
+        return (uint8_t *)n->addr;
+
+    return NULL;
+}
+
+// TODO: This is unused. Remove?
+uint32_t vramBlock_getSize(s_vramBlock *mb, uint32_t index)
+{
+    s_vramNode *n = vramBlock_getNode(mb, index);
+    if (n)
+        return n->size;
+
+    return 0;
+}
+
+// Get fragmentation statistics of a VRAM block
+void vramBlock_getStats(s_vramBlock *mb, uint32_t *freeBytes,
+                        uint32_t *largestFree, uint32_t *freeNodes)
+{
+    uint32_t largest = 0;
+
+    // The largest free node is the last one in tree order
+    int32_t i = mb->freeRoot;
+    if (i != VRAM_NODE_NONE)
+    {
+        while (mb->nodes[i].right != VRAM_NODE_NONE)
+            i = mb->nodes[i].right;
+        largest = mb->nodes[i].size;
+    }
+
+    if (freeBytes)
+        *freeBytes = mb->freeBytes;
+    if (largestFree)
+        *largestFree = largest;
+    if (freeNodes)
+        *freeNodes = mb->freeNodes;
+}
+
+// Move an allocated node to a lower address inside the free node right before
+// it. The free space is moved after the node. The handle of the node doesn't
+// change.
+int vramBlock_moveDown(s_vramBlock *mb, uint32_t index, uint32_t addr)
+{
+    // This may move the array of nodes, so it has to be done before getting any
+    // pointer to a node.
+    if (vramBlock_reserveNodes(mb, 1) == 0)
+        return 0;
+
+    s_vramNode *n = vramBlock_getNode(mb, index);
+    if (n == NULL)
+        return 0;
+
+    int32_t i = index - 1;
+    int32_t p = n->prev;
+    if ((p == VRAM_NODE_NONE) || (mb->nodes[p].state != VRAM_NODE_FREE))
+        return 0;
+
+    s_vramNode *prev = &mb->nodes[p];
+    if ((addr < prev->addr) || (addr >= n->addr))
+        return 0;
+
+    uint32_t oldEnd = n->addr + n->size;
+
+    // Shrink or remove the free node before this one
+    vramBlock_freeRemove(mb, p);
+    if (addr > prev->addr)
+    {
+        prev->size = addr - prev->addr;
+        vramBlock_freeInsert(mb, p);
+    }
+    else
+    {
+        n->prev = prev->prev;
+        if (n->prev != VRAM_NODE_NONE)
+            mb->nodes[n->prev].next = i;
+        else
+            mb->firstNode = i;
+
+        vramBlock_releaseNode(mb, p);
+    }
+
+    n->addr = addr;
+
+    // Add the space left by the node to the free node after it, or create a new
+    // one if there isn't one.
+    uint32_t gapStart = addr + n->size;
+    int32_t q = n->next;
+    if ((q != VRAM_NODE_NONE) && (mb->nodes[q].state == VRAM_NODE_FREE))
+    {
+        vramBlock_freeRemove(mb, q);
+        mb->nodes[q].size += mb->nodes[q].addr - gapStart;
+        mb->nodes[q].addr = gapStart;
+        vramBlock_freeInsert(mb, q);
+    }
+    else
+    {
+        int32_t t = vramBlock_newNode(mb);
+        s_vramNode *tail = &mb->nodes[t];
+
+        tail->addr = gapStart;
+        tail->size = oldEnd - gapStart;
+        tail->prev = i;
+        tail->next = q;
+
+        if (q != VRAM_NODE_NONE)
+            mb->nodes[q].prev = t;
+        n->next = t;
+
+        vramBlock_freeInsert(mb, t);
+    }
+
+    return 1;
+}
@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: Zlib
+// SPDX-FileNotice: Modified from the original version by the BlocksDS project.
+//
+// Copyright (C) 2005 Michael Noland (joat)
+// Copyright (C) 2005 Jason Rogers (dovoto)
+// Copyright (C) 2005 Dave Murphy (WinterMute)
+
+// Allocator of texture and palette VRAM used by videoGL. Calling these
+// functions outside of videoGL may interfere with normal operations.
+
+#ifndef ARM9_VIDEO_VRAMBLOCK_H__
+#define ARM9_VIDEO_VRAMBLOCK_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Each region of VRAM (free or allocated) is represented by a node. Nodes are
+// stored in a pool that grows when it's full, so splitting and merging regions
+// doesn't require calling malloc() and free(). Nodes are referenced by their
+// index in the pool, so the pool can be reallocated without invalidating them.
+//
+// All nodes are linked in address order. Free nodes are also stored in a
+// binary search tree sorted by size, and by address for nodes of the same
+// size. The tree is a treap: each node has a priority derived from its index,
+// and parents have a higher priority than their children, which keeps the tree
+// balanced on average. Finding the smallest free node where an allocation fits
+// takes O(log n) time.
+//
+// The index of an allocated node plus one is used as the handle of the
+// allocation.
+
+#define VRAM_NODE_NONE      -1
+
+#define VRAM_NODE_UNUSED    0 // Node in the pool of unused nodes
+#define VRAM_NODE_FREE      1 // Free region
+#define VRAM_NODE_ALLOC     2 // Allocated region
+
+// Maximum number of usable address ranges of a VRAM block
+#define VRAM_MAX_RANGES     4
+
+typedef struct s_vramNode
+{
+    uint32_t addr;      // Address of the region
+    uint32_t size;      // Size of the region in bytes
+    int32_t prev, next; // Previous/next node in address order
+    int32_t parent;     // Parent and children in the tree of free nodes. For
+    int32_t left;       // unused nodes, "right" is the next unused node.
+    int32_t right;
+    uint32_t state;
+} s_vramNode;
+
+// Priority of a node in the tree of free nodes. It's a hash of the index of the
+// node, so it doesn't need to be stored. Different indices have different
+// priorities.
+static inline uint32_t vramBlock_priority(int32_t i)
+{
+    uint32_t x = i;
+    x ^= x >> 16;
+    x *= 0x7FEB352D;
+    x ^= x >> 15;
+    x *= 0x846CA68B;
+    x ^= x >> 16;
+    return x;
+}
+
+typedef struct s_vramBlock
+{
+    uint8_t *startAddr, *endAddr;
+
+    s_vramNode *nodes;      // Pool of nodes
+    uint32_t numNodes;      // Size of the pool
+    int32_t firstUnused;    // First node in the list of unused nodes
+    uint32_t numUnused;     // Number of unused nodes
+    int32_t firstNode;      // Node with the lowest address
+
+    int32_t freeRoot;       // Root of the tree of free nodes
+
+    uint32_t freeBytes;     // Total size of all free regions
+    uint32_t freeNodes;     // Number of free regions
+
+    // Banks locked with glLockVRAMBank(). Bit N is the Nth bank of the block.
+    int lock;
+
+    // Result of the last call to vramBlock_examineSpecial()
+    int32_t lastExamined;
+    uint8_t *lastExaminedAddr;
+    uint32_t lastExaminedSize;
+} s_vramBlock;
+
+// Address range that can be used for allocations
+typedef struct
+{
+    uint32_t start, end;
+} s_vramRange;
+
+s_vramBlock *vramBlock_Construct(uint8_t *start, uint8_t *end);
+void vramBlock_Deconstruct(s_vramBlock *mb);
+
+uint8_t *vramBlock_examineSpecial(s_vramBlock *mb, uint8_t *addr, uint32_t size,
+                                  uint8_t align);
+uint32_t vramBlock_allocateSpecial(s_vramBlock *mb, uint8_t *addr, uint32_t size);
+uint32_t vramBlock_allocateBlock(s_vramBlock *mb, uint32_t size, uint8_t align);
+int vramBlock_allocateCompressed(s_vramBlock *mb, uint32_t size,
+                                 uint32_t *index, uint32_t *indexExt);
+uint32_t vramBlock_deallocateBlock(s_vramBlock *mb, uint32_t index);
+int vramBlock_deallocateAll(s_vramBlock *mb);
+
+s_vramNode *vramBlock_getNode(s_vramBlock *mb, uint32_t index);
+uint8_t *vramBlock_getAddr(s_vramBlock *mb, uint32_t index);
+uint32_t vramBlock_getSize(s_vramBlock *mb, uint32_t index);
+void vramBlock_getStats(s_vramBlock *mb, uint32_t *freeBytes,
+                        uint32_t *largestFree, uint32_t *freeNodes);
+
+int vramBlock_getRanges(s_vramBlock *mb, s_vramRange *ranges);
+bool vramBlock_rangesContain(const s_vramRange *ranges, int count,
+                             uint32_t start, uint32_t end);
+uint32_t vramBlock_fit(const s_vramNode *n, uint32_t from, uint32_t size,
+                       uint32_t align, const s_vramRange *ranges, int count);
+int vramBlock_moveDown(s_vramBlock *mb, uint32_t index, uint32_t addr);
+
+#endif // ARM9_VIDEO_VRAMBLOCK_H__
@@ -0,0 +1,300 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <nds/arm9/cache.h>
+#include <nds/arm9/video.h>
+#include <nds/arm9/vramUpload.h>
+#include <nds/dma.h>
+#include <nds/interrupts.h>
+#include <nds/memtrace.h>
+
+// Control register of VRAM bank N (A = 0, ..., I = 8). There is a gap between
+// the registers of banks G and H.
+#define VRAM_BANK_CR(n) (*(vu8 *)(0x04000240 + ((n) < 7 ? (n) : (n) + 1)))
+
+#define VRAM_NUM_BANKS  9
+
+// Addresses of the VRAM banks in LCD mode
+static const struct
+{
+    uintptr_t start, end;
+}
+vram_lcd_ranges[VRAM_NUM_BANKS] = {
+    { 0x06800000, 0x06820000 }, // A
+    { 0x06820000, 0x06840000 }, // B
+    { 0x06840000, 0x06860000 }, // C
+    { 0x06860000, 0x06880000 }, // D
+    { 0x06880000, 0x06890000 }, // E
+    { 0x06890000, 0x06894000 }, // F
+    { 0x06894000, 0x06898000 }, // G
+    { 0x06898000, 0x068A0000 }, // H
+    { 0x068A0000, 0x068A4000 }, // I
+};
+
+typedef struct
+{
+    const uint8_t *src;
+    uint8_t *dst;
+    uint32_t size;          // Bytes left to copy
+    VramUploadFence fence;
+    uint16_t banks;         // Banks that need to be set to LCD mode
+    uint16_t unit;          // Size of each DMA transfer (2 or 4 bytes)
+} VramUploadEntry;
+
+static VramUploadEntry *upload_entries = NULL;
+static size_t upload_capacity;
+static size_t upload_head;
+static size_t upload_count;
+
+static VramUploadFence upload_submitted;
+static VramUploadFence upload_completed;
+
+static size_t upload_budget = VRAM_UPLOAD_DEFAULT_BUDGET;
+static uint8_t upload_dma_channel;
+
+// Set while vramUploadRun() is copying data
+static bool upload_running;
+
+bool vramUploadInit(size_t max_entries, uint8_t dma_channel)
+{
+    vramUploadExit();
+
+    if ((max_entries == 0) || (dma_channel > 3))
+        return false;
+
+    upload_entries = memTraceMalloc(max_entries * sizeof(VramUploadEntry),
+                                    MEMTRACE_TAG_VRAM_UPLOAD);
+    if (upload_entries == NULL)
+        return false;
+
+    upload_capacity = max_entries;
+    upload_dma_channel = dma_channel;
+
+    return true;
+}
+
+void vramUploadExit(void)
+{
+    int oldIME = enterCriticalSection();
+
+    memTraceFree(upload_entries);
+    upload_entries = NULL;
+    upload_capacity = 0;
+    upload_head = 0;
+    upload_count = 0;
+
+    // Consider all discarded copies as finished
+    upload_completed = upload_submitted;
+
+    leaveCriticalSection(oldIME);
+}
+
+void vramUploadSetBudget(size_t bytes)
+{
+    upload_budget = bytes;
+}
+
+static uint16_t vramUploadBanks(uintptr_t start, uintptr_t end)
+{
+    uint16_t banks = 0;
+
+    for (int i = 0; i < VRAM_NUM_BANKS; i++)
+    {
+        if ((start < vram_lcd_ranges[i].end) && (end > vram_lcd_ranges[i].start))
+            banks |= BIT(i);
+    }
+
+    return banks;
+}
+
+VramUploadFence vramUploadQueue(const void *src, void *dst, size_t size)
+{
+    uintptr_t s = (uintptr_t)src;
+    uintptr_t d = (uintptr_t)dst;
+
+    if ((src == NULL) || (dst == NULL) || (size == 0))
+        return 0;
+
+    // VRAM doesn't support 8-bit writes
+    if ((s | d | size) & 1)
+        return 0;
+
+    uint16_t unit = ((s | d | size) & 3) ? 2 : 4;
+    uint16_t banks = vramUploadBanks(d, d + size);
+
+    // The DMA reads the source from RAM, not from the data cache
+    DC_FlushRange(src, size);
+
+    int oldIME = enterCriticalSection();
+
+    if (upload_entries == NULL)
+    {
+        leaveCriticalSection(oldIME);
+        return 0;
+    }
+
+    // Merge this copy with the last one in the queue if they are contiguous.
+    // The fence of the merged copy is the fence of this copy, which is fine
+    // because all copies finish in the order they were added to the queue.
+    if (upload_count > 0)
+    {
+        size_t last = (upload_head + upload_count - 1) % upload_capacity;
+        VramUploadEntry *e = &upload_entries[last];
+
+        if ((e->src + e->size == src) && (e->dst + e->size == dst) &&
+            (e->unit == unit))
+        {
+            e->size += size;
+            e->banks |= banks;
+            e->fence = ++upload_submitted;
+            if (e->fence == 0) // Skip 0 when the counter wraps around
+                e->fence = ++upload_submitted;
+
+            VramUploadFence fence = e->fence;
+            leaveCriticalSection(oldIME);
+            return fence;
+        }
+    }
+
+    if (upload_count == upload_capacity)
+    {
+        leaveCriticalSection(oldIME);
+        return 0;
+    }
+
+    size_t tail = (upload_head + upload_count) % upload_capacity;
+    VramUploadEntry *e = &upload_entries[tail];
+
+    e->src = src;
+    e->dst = dst;
+    e->size = size;
+    e->banks = banks;
+    e->unit = unit;
+    e->fence = ++upload_submitted;
+    if (e->fence == 0)
+        e->fence = ++upload_submitted;
+
+    upload_count++;
+
+    VramUploadFence fence = e->fence;
+    leaveCriticalSection(oldIME);
+    return fence;
+}
+
+bool vramUploadIsDone(VramUploadFence fence)
+{
+    // 0 is returned by vramUploadQueue() on failure
+    if (fence == 0)
+        return false;
+
+    // This works even if the counter has wrapped around
+    return (int32_t)(upload_completed - fence) >= 0;
+}
+
+size_t vramUploadPending(void)
+{
+    return upload_count;
+}
+
+static size_t vramUploadRun(size_t budget)
+{
+    uint8_t saved[VRAM_NUM_BANKS];
+    uint16_t lcd = 0;
+    size_t copied = 0;
+
+    int oldIME = enterCriticalSection();
+
+    // Only one call can copy data at a time. This can happen if an interrupt
+    // handler calls this function while it's running.
+    if (upload_running)
+    {
+        leaveCriticalSection(oldIME);
+        return 0;
+    }
+    upload_running = true;
+
+    while (upload_count > 0)
+    {
+        VramUploadEntry *e = &upload_entries[upload_head];
+
+        size_t chunk = e->size;
+        if (budget != 0)
+        {
+            size_t left = budget - copied;
+            if (chunk > left)
+                chunk = left & ~(e->unit - 1);
+        }
+
+        if (chunk == 0)
+            break;
+
+        // Set the banks of the destination to LCD mode, and remember their
+        // previous mode so that they can be restored.
+        uint16_t banks = e->banks & ~lcd;
+        for (int i = 0; banks != 0; i++, banks >>= 1)
+        {
+            if (banks & 1)
+            {
+                saved[i] = VRAM_BANK_CR(i);
+                VRAM_BANK_CR(i) = VRAM_ENABLE;
+            }
+        }
+        lcd |= e->banks;
+
+        const uint8_t *src = e->src;
+        uint8_t *dst = e->dst;
+        uint16_t unit = e->unit;
+
+        // Only the queue needs to be protected, the copy is done with
+        // interrupts enabled. Interrupt handlers may add copies to the queue
+        // in the meantime, but they are only added after this entry or merged
+        // at the end of it, so the part that is being copied doesn't change.
+        leaveCriticalSection(oldIME);
+
+        if (unit == 4)
+            dmaCopyWords(upload_dma_channel, src, dst, chunk);
+        else
+            dmaCopyHalfWords(upload_dma_channel, src, dst, chunk);
+
+        oldIME = enterCriticalSection();
+
+        e->src += chunk;
+        e->dst += chunk;
+        e->size -= chunk;
+        copied += chunk;
+
+        if (e->size == 0)
+        {
+            upload_completed = e->fence;
+            upload_head = (upload_head + 1) % upload_capacity;
+            upload_count--;
+        }
+    }
+
+    for (int i = 0; lcd != 0; i++, lcd >>= 1)
+    {
+        if (lcd & 1)
+            VRAM_BANK_CR(i) = saved[i];
+    }
+
+    upload_running = false;
+
+    leaveCriticalSection(oldIME);
+
+    return copied;
+}
+
+size_t vramUploadProcess(void)
+{
+    return vramUploadRun(upload_budget);
+}
+
+size_t vramUploadFlush(void)
+{
+    return vramUploadRun(0);
+}
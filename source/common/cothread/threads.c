@@ -18,6 +18,9 @@
 #include <nds/bios.h>
 #include <nds/cothread.h>
 #include <nds/interrupts.h>
+#ifdef ARM9
+#include <nds/memtrace.h>
+#endif
 #include <nds/ndstypes.h>
 
 // Generate a reference to __retarget_lock_acquire(). This will force the linker
@@ -51,6 +54,20 @@ __asm__(".equ __retarget_lock_acquire_reference, __retarget_lock_acquire");
 
 #define DEFAULT_STACK_SIZE_CHILD (1 * 1024)
 
+// The allocation tracer is only used in the ARM9. Using it in the ARM7 would
+// add its output code (stdio and no$gba helpers) to every ARM7 binary.
+#ifdef ARM9
+#define thread_calloc(n, s)     memTraceCalloc(n, s, MEMTRACE_TAG_COTHREAD)
+#define thread_malloc(s)        memTraceMalloc(s, MEMTRACE_TAG_COTHREAD)
+#define thread_memalign(a, s)   memTraceMemalign(a, s, MEMTRACE_TAG_COTHREAD)
+#define thread_free             memTraceFree
+#else
+#define thread_calloc(n, s)     calloc(n, s)
+#define thread_malloc(s)        malloc(s)
+#define thread_memalign(a, s)   memalign(a, s)
+#define thread_free             free
+#endif
+
 // This is a trick so that the garbage collector of the linker can remove free()
 // from any application that doesn't actually create any thread. This pointer is
 // set to free() when any thread is created. At that point, free is needed to
@@ -227,7 +244,7 @@ static void cothread_delete_internal(cothread_info_t *ctx)
     if (ctx->stack_base)
         free_fn(ctx->stack_base);
 
-    free(ctx->tls);
+    thread_free(ctx->tls);
 
     free_fn(ctx);
 }
@@ -282,7 +299,7 @@ cothread_t cothread_create_manual(int (*entrypoint)(void *), void *arg,
 
     // Setup context
 
-    cothread_info_t *ctx = calloc(1, sizeof(cothread_info_t));
+    cothread_info_t *ctx = thread_calloc(1, sizeof(cothread_info_t));
     if (ctx == NULL)
     {
         errno = ENOMEM;
@@ -291,10 +308,10 @@ cothread_t cothread_create_manual(int (*entrypoint)(void *), void *arg,
 
     size_t __tls_size = (uintptr_t)__tls_end - (uintptr_t)__tls_start;
 
-    void *tls = malloc(__tls_size);
+    void *tls = thread_malloc(__tls_size);
     if (tls == NULL)
     {
-        free(ctx);
+        thread_free(ctx);
         errno = ENOMEM;
         return -1;
     }
@@ -304,7 +321,7 @@ cothread_t cothread_create_manual(int (*entrypoint)(void *), void *arg,
     // Assign the free() function to the pointer because now we are sure that we
     // will need to free the resources of the newly created thread eventually.
 
-    free_fn = free;
+    free_fn = thread_free;
 
     // Add context to the scheduler
     cothread_list_add_ctx(ctx);
@@ -333,7 +350,7 @@ cothread_t cothread_create(int (*entrypoint)(void *), void *arg,
         stack_size = DEFAULT_STACK_SIZE_CHILD;
 
     // The stack must be aligned to 8 bytes
-    void *stack_base = memalign(8, stack_size);
+    void *stack_base = thread_memalign(8, stack_size);
     if (stack_base == NULL)
     {
         errno = ENOMEM;
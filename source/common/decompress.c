@@ -4,7 +4,9 @@
 // Copyright (C) 2005 Jason Rogers (dovoto)
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <nds/bios.h>
 #include <nds/decompress.h>
@@ -41,6 +43,60 @@ TDecompressionStream decomStream =
     decompress_read_32
 };
 
+// Adapter that lets the software decoders read data with the callbacks used by
+// the BIOS decompression routines. The BIOS callbacks don't say how much data
+// is available, so data is requested one byte at a time.
+typedef struct
+{
+    uint8_t *source;
+    uint16_t *dst;
+    uint32_t arg;
+    bool header_sent;
+    getHeaderCallback getHeader;
+    getByteCallback readByte;
+} DecompressCallbackStream;
+
+static size_t decompress_callback_read(void *buffer, size_t size, void *arg)
+{
+    DecompressCallbackStream *cs = arg;
+
+    (void)size;
+
+    if (!cs->header_sent)
+    {
+        int header = cs->getHeader(cs->source, cs->dst, cs->arg);
+        if (header < 0)
+            return 0;
+
+        memcpy(buffer, &header, sizeof(header));
+        cs->source += sizeof(header);
+        cs->header_sent = true;
+        return sizeof(header);
+    }
+
+    *(uint8_t *)buffer = cs->readByte(cs->source);
+    cs->source++;
+    return 1;
+}
+
+static void decompress_callback_software(const void *data, void *dst,
+                                         DecompressType type, uint32_t arg,
+                                         getHeaderCallback getHeaderCB,
+                                         getByteCallback readCB)
+{
+    DecompressCallbackStream cs =
+    {
+        .source = (uint8_t *)data,
+        .dst = dst,
+        .arg = arg,
+        .header_sent = false,
+        .getHeader = getHeaderCB,
+        .readByte = readCB
+    };
+
+    decompressSoftwareStream(dst, type, decompress_callback_read, &cs);
+}
+
 void decompress(const void *data, void *dst, DecompressType type)
 {
     switch (type)
@@ -65,6 +121,9 @@ void decompress(const void *data, void *dst, DecompressType type)
         case RLEVram:
             swiDecompressRLEVram(data, dst, 0, &decomStream);
             break;
+        case LZ16:
+            decompressSoftware(data, dst, LZ16);
+            break;
         default:
             break;
     }
@@ -96,6 +155,10 @@ void decompressStream(const void *data, void *dst, DecompressType type,
         case RLEVram:
             swiDecompressRLEVram(data, dst, 0, &decompresStream);
             break;
+        case LZ16:
+            decompress_callback_software(data, dst, LZ16, 0,
+                                         getHeaderCB, readCB);
+            break;
         default:
             break;
     }
@@ -126,6 +189,12 @@ void decompressStreamStruct(const void *data, void *dst, DecompressType type,
         case RLEVram:
             swiDecompressRLEVram(data, dst, (uintptr_t)param, ds);
             break;
+        case LZ16:
+            decompress_callback_software(data, dst, LZ16, (uintptr_t)param,
+                                         ds->getSize, ds->readByte);
+            if (ds->getResult != NULL)
+                ds->getResult((uint8_t *)data);
+            break;
         default:
             break;
     }
@@ -0,0 +1,596 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <nds/decompress.h>
+#include <nds/ndstypes.h>
+
+// Software implementations of the decompression routines of the BIOS. They
+// produce the same output as the BIOS routines, but they are a lot faster:
+// they run from ITCM in ARM mode instead of from the uncached BIOS ROM, and
+// they don't call a function for every byte when the destination is VRAM.
+//
+// All decoders read the compressed data through a small buffer that can be
+// refilled with a callback. When the data is in RAM, the end of the buffer is
+// set to an address that can never be reached, so the refill check is the only
+// overhead.
+
+#ifdef ARM9
+#define DECOMPRESS_CODE ITCM_CODE ARM_CODE
+#else
+#define DECOMPRESS_CODE ARM_CODE
+#endif
+
+#define DECOMPRESS_INPUT_BUFFER_SIZE 256
+
+typedef struct
+{
+    DecompressReadCallback read;
+    void *arg;
+    bool error;
+    uint8_t buffer[DECOMPRESS_INPUT_BUFFER_SIZE];
+} DecompressSource;
+
+// Returned by source_refill() when there is no more data available. The
+// decoders keep reading zeroes until the output buffer is full, and the error
+// is reported at the end.
+static const uint8_t decompress_zeroes[4] = { 0 };
+
+DECOMPRESS_CODE __attribute__((noinline))
+static const uint8_t *source_refill(DecompressSource *s, const uint8_t **end)
+{
+    if ((s->read != NULL) && !s->error)
+    {
+        size_t size = s->read(s->buffer, sizeof(s->buffer), s->arg);
+        if ((size > 0) && (size <= sizeof(s->buffer)))
+        {
+            *end = &s->buffer[size];
+            return &s->buffer[0];
+        }
+    }
+
+    s->error = true;
+    *end = &decompress_zeroes[sizeof(decompress_zeroes)];
+    return &decompress_zeroes[0];
+}
+
+#define READ_8(var) \
+    do \
+    { \
+        if (src == src_end) \
+            src = source_refill(s, &src_end); \
+        var = *src++; \
+    } while (0)
+
+#define READ_32(var) \
+    do \
+    { \
+        if ((size_t)(src_end - src) >= 4) \
+        { \
+            var = src[0] | (src[1] << 8) | (src[2] << 16) | \
+                  ((uint32_t)src[3] << 24); \
+            src += 4; \
+        } \
+        else \
+        { \
+            uint32_t b0_, b1_, b2_, b3_; \
+            READ_8(b0_); \
+            READ_8(b1_); \
+            READ_8(b2_); \
+            READ_8(b3_); \
+            var = b0_ | (b1_ << 8) | (b2_ << 16) | (b3_ << 24); \
+        } \
+    } while (0)
+
+// VRAM doesn't support 8-bit writes. When "vram" is true the output is written
+// in 16-bit units. The low byte of a halfword is kept in "pending" until the
+// high byte is available.
+#define WRITE_8(value) \
+    do \
+    { \
+        if (!vram) \
+        { \
+            *out = (value); \
+        } \
+        else \
+        { \
+            if (((uintptr_t)out & 1) == 0) \
+                pending = (value); \
+            else \
+                *(uint16_t *)(out - 1) = pending | ((value) << 8); \
+        } \
+        out++; \
+    } while (0)
+
+// Write the last byte if the size of the output is odd.
+#define WRITE_FLUSH() \
+    do \
+    { \
+        if (vram && ((uintptr_t)out & 1)) \
+        { \
+            uint16_t *last_ = (uint16_t *)(out - 1); \
+            *last_ = (*last_ & 0xFF00) | pending; \
+        } \
+    } while (0)
+
+static inline __attribute__((always_inline))
+void lz77_decode(DecompressSource *s, const uint8_t *src, const uint8_t *src_end,
+                 uint8_t *dst, uint32_t size, bool vram)
+{
+    uint8_t *out = dst;
+    uint8_t *out_end = dst + size;
+    uint32_t pending = 0;
+
+    while (out < out_end)
+    {
+        uint32_t flags;
+        READ_8(flags);
+
+        for (int i = 0; i < 8; i++)
+        {
+            if (out >= out_end)
+                break;
+
+            if (flags & 0x80)
+            {
+                uint32_t b0, b1;
+                READ_8(b0);
+                READ_8(b1);
+
+                uint32_t len = (b0 >> 4) + 3;
+                uint32_t disp = (((b0 & 0xF) << 8) | b1) + 1;
+
+                if (len > (uint32_t)(out_end - out))
+                    len = out_end - out;
+
+                const uint8_t *from = out - disp;
+
+                if (!vram)
+                {
+                    while (len--)
+                        *out++ = *from++;
+                }
+                else
+                {
+                    while (len--)
+                    {
+                        uint32_t value;
+
+                        // The previous byte may not have been written yet
+                        if (((uintptr_t)out & 1) && (from == out - 1))
+                            value = pending;
+                        else
+                            value = *from;
+
+                        from++;
+                        WRITE_8(value);
+                    }
+                }
+            }
+            else
+            {
+                uint32_t value;
+                READ_8(value);
+                WRITE_8(value);
+            }
+
+            flags <<= 1;
+        }
+    }
+
+    WRITE_FLUSH();
+}
+
+static inline __attribute__((always_inline))
+void rle_decode(DecompressSource *s, const uint8_t *src, const uint8_t *src_end,
+                uint8_t *dst, uint32_t size, bool vram)
+{
+    uint8_t *out = dst;
+    uint8_t *out_end = dst + size;
+    uint32_t pending = 0;
+
+    while (out < out_end)
+    {
+        uint32_t flag;
+        READ_8(flag);
+
+        if (flag & 0x80)
+        {
+            uint32_t len = (flag & 0x7F) + 3;
+            if (len > (uint32_t)(out_end - out))
+                len = out_end - out;
+
+            uint32_t value;
+            READ_8(value);
+
+            if (!vram)
+            {
+                memset(out, value, len);
+                out += len;
+            }
+            else
+            {
+                // Complete the pending halfword, then fill whole halfwords
+                if (((uintptr_t)out & 1) && (len > 0))
+                {
+                    WRITE_8(value);
+                    len--;
+                }
+
+                uint16_t value16 = value | (value << 8);
+                while (len >= 2)
+                {
+                    *(uint16_t *)out = value16;
+                    out += 2;
+                    len -= 2;
+                }
+
+                if (len > 0)
+                    WRITE_8(value);
+            }
+        }
+        else
+        {
+            uint32_t len = (flag & 0x7F) + 1;
+            if (len > (uint32_t)(out_end - out))
+                len = out_end - out;
+
+            while (len--)
+            {
+                uint32_t value;
+                READ_8(value);
+                WRITE_8(value);
+            }
+        }
+    }
+
+    WRITE_FLUSH();
+}
+
+// Huffman always writes 32-bit words, so it is always VRAM-safe.
+static inline __attribute__((always_inline))
+void huffman_decode(DecompressSource *s, const uint8_t *src,
+                    const uint8_t *src_end, uint8_t *dst, uint32_t size,
+                    uint32_t data_bits)
+{
+    // The tree is at most 512 bytes long (including the size byte). It is
+    // copied to the stack so that it doesn't matter if the source is streamed.
+    uint8_t tree[512];
+
+    uint32_t tree_size;
+    READ_8(tree_size);
+    tree[0] = tree_size;
+    tree_size = (tree_size + 1) * 2;
+
+    for (uint32_t i = 1; i < tree_size; i++)
+        READ_8(tree[i]);
+
+    // The child offsets come from the compressed data, so they can point past
+    // the end of the tree. Check all nodes that can be reached from the root
+    // before decoding anything. Children are always after their parent, so
+    // one pass in order is enough. This keeps the checks out of the loop that
+    // decodes the bitstream.
+    uint32_t is_node[512 / 32] = { 0 };
+    is_node[0] = 1u << 1; // Root node
+
+    for (uint32_t node = 1; node < tree_size; node++)
+    {
+        if ((is_node[node / 32] & (1u << (node % 32))) == 0)
+            continue;
+
+        uint32_t value = tree[node];
+        uint32_t next = (node & ~1) + ((value & 0x3F) << 1) + 2;
+
+        if (next + 1 >= tree_size)
+        {
+            s->error = true;
+            return;
+        }
+
+        if ((value & 0x80) == 0)
+            is_node[next / 32] |= 1u << (next % 32);
+        if ((value & 0x40) == 0)
+            is_node[(next + 1) / 32] |= 1u << ((next + 1) % 32);
+    }
+
+    uint32_t data_mask = (1 << data_bits) - 1;
+
+    uint32_t *out = (uint32_t *)dst;
+    uint32_t *out_end = out + ((size + 3) / 4);
+
+    uint32_t out_word = 0;
+    uint32_t out_bits = 0;
+
+    // The root node is right after the size byte
+    uint32_t node = 1;
+
+    while (out < out_end)
+    {
+        uint32_t bitstream;
+        READ_32(bitstream);
+
+        for (int i = 0; i < 32; i++)
+        {
+            uint32_t bit = bitstream >> 31;
+            bitstream <<= 1;
+
+            uint32_t value = tree[node];
+            uint32_t next = (node & ~1) + ((value & 0x3F) << 1) + 2 + bit;
+
+            // Bit 7 is the end flag of child 0, bit 6 of child 1
+            if (value & (0x80 >> bit))
+            {
+                out_word |= (tree[next] & data_mask) << out_bits;
+                out_bits += data_bits;
+                node = 1;
+
+                if (out_bits == 32)
+                {
+                    *out++ = out_word;
+                    out_word = 0;
+                    out_bits = 0;
+
+                    if (out >= out_end)
+                        break;
+                }
+            }
+            else
+            {
+                node = next;
+            }
+        }
+    }
+}
+
+// LZ16 works in 16-bit units, so it is always VRAM-safe and it never needs to
+// merge bytes before writing them. Check decompress.h for the format.
+static inline __attribute__((always_inline))
+void lz16_decode(DecompressSource *s, const uint8_t *src, const uint8_t *src_end,
+                 uint8_t *dst, uint32_t size)
+{
+    uint16_t *out = (uint16_t *)dst;
+    uint16_t *out_end = out + (size / 2);
+
+    while (out < out_end)
+    {
+        uint32_t token;
+        READ_8(token);
+
+        uint32_t literals = token >> 4;
+        if (literals == 15)
+        {
+            uint32_t extra;
+            do
+            {
+                READ_8(extra);
+                literals += extra;
+            }
+            while (extra == 255);
+        }
+
+        if (literals > (uint32_t)(out_end - out))
+            literals = out_end - out;
+
+        if ((size_t)(src_end - src) >= literals * 2)
+        {
+            // Fast path: All literals are in the buffer
+            while (literals--)
+            {
+                *out++ = src[0] | (src[1] << 8);
+                src += 2;
+            }
+        }
+        else
+        {
+            while (literals--)
+            {
+                uint32_t lo, hi;
+                READ_8(lo);
+                READ_8(hi);
+                *out++ = lo | (hi << 8);
+            }
+        }
+
+        // The last sequence only contains literals
+        if (out >= out_end)
+            break;
+
+        uint32_t lo, hi;
+        READ_8(lo);
+        READ_8(hi);
+        uint32_t offset = lo | (hi << 8);
+
+        uint32_t len = token & 0xF;
+        if (len == 15)
+        {
+            uint32_t extra;
+            do
+            {
+                READ_8(extra);
+                len += extra;
+            }
+            while (extra == 255);
+        }
+        len += 2;
+
+        if ((offset == 0) || (offset > (uint32_t)(out - (uint16_t *)dst)))
+        {
+            s->error = true;
+            break;
+        }
+
+        if (len > (uint32_t)(out_end - out))
+            len = out_end - out;
+
+        const uint16_t *from = out - offset;
+
+        // If the offset is a multiple of 4 bytes, both pointers have the same
+        // alignment and the copy can be done with 32-bit accesses.
+        if (((offset & 1) == 0) && (len >= 4))
+        {
+            if ((uintptr_t)out & 2)
+            {
+                *out++ = *from++;
+                len--;
+            }
+
+            uint32_t *out32 = (uint32_t *)out;
+            const uint32_t *from32 = (const uint32_t *)from;
+
+            while (len >= 2)
+            {
+                *out32++ = *from32++;
+                len -= 2;
+            }
+
+            out = (uint16_t *)out32;
+            from = (const uint16_t *)from32;
+        }
+
+        while (len--)
+            *out++ = *from++;
+    }
+}
+
+DECOMPRESS_CODE
+static void lz77_decode_8(DecompressSource *s, const uint8_t *src,
+                          const uint8_t *src_end, uint8_t *dst, uint32_t size)
+{
+    lz77_decode(s, src, src_end, dst, size, false);
+}
+
+DECOMPRESS_CODE
+static void lz77_decode_16(DecompressSource *s, const uint8_t *src,
+                           const uint8_t *src_end, uint8_t *dst, uint32_t size)
+{
+    lz77_decode(s, src, src_end, dst, size, true);
+}
+
+DECOMPRESS_CODE
+static void rle_decode_8(DecompressSource *s, const uint8_t *src,
+                         const uint8_t *src_end, uint8_t *dst, uint32_t size)
+{
+    rle_decode(s, src, src_end, dst, size, false);
+}
+
+DECOMPRESS_CODE
+static void rle_decode_16(DecompressSource *s, const uint8_t *src,
+                          const uint8_t *src_end, uint8_t *dst, uint32_t size)
+{
+    rle_decode(s, src, src_end, dst, size, true);
+}
+
+DECOMPRESS_CODE
+static void huffman_decode_32(DecompressSource *s, const uint8_t *src,
+                              const uint8_t *src_end, uint8_t *dst,
+                              uint32_t size, uint32_t data_bits)
+{
+    huffman_decode(s, src, src_end, dst, size, data_bits);
+}
+
+DECOMPRESS_CODE
+static void lz16_decode_16(DecompressSource *s, const uint8_t *src,
+                           const uint8_t *src_end, uint8_t *dst, uint32_t size)
+{
+    lz16_decode(s, src, src_end, dst, size);
+}
+
+static int decompress_software_internal(DecompressSource *s, const uint8_t *src,
+                                        const uint8_t *src_end, void *dst,
+                                        DecompressType type)
+{
+    uint32_t header;
+    READ_32(header);
+
+    uint32_t size = header >> 8;
+
+    switch (type)
+    {
+        case LZ77:
+        case LZ77Vram:
+            if ((header & 0xF0) != 0x10)
+                return -1;
+            if (type == LZ77)
+                lz77_decode_8(s, src, src_end, dst, size);
+            else
+                lz77_decode_16(s, src, src_end, dst, size);
+            break;
+
+        case RLE:
+        case RLEVram:
+            if ((header & 0xF0) != 0x30)
+                return -1;
+            if (type == RLE)
+                rle_decode_8(s, src, src_end, dst, size);
+            else
+                rle_decode_16(s, src, src_end, dst, size);
+            break;
+
+        case HUFF:
+        {
+            if ((header & 0xF0) != 0x20)
+                return -1;
+
+            uint32_t data_bits = header & 0xF;
+            if ((data_bits != 4) && (data_bits != 8))
+                return -1;
+
+            huffman_decode_32(s, src, src_end, dst, size, data_bits);
+            break;
+        }
+
+        case LZ16:
+            if ((header & 0xF0) != 0x50)
+                return -1;
+            lz16_decode_16(s, src, src_end, dst, size);
+            break;
+
+        default:
+            return -1;
+    }
+
+    if (s->error)
+        return -1;
+
+    return size;
+}
+
+int decompressSoftware(const void *data, void *dst, DecompressType type)
+{
+    if ((data == NULL) || (dst == NULL))
+        return -1;
+
+    DecompressSource s;
+    s.read = NULL;
+    s.arg = NULL;
+    s.error = false;
+
+    // The data is already in RAM, so it's never needed to refill the buffer.
+    // Set the end pointer to an address that can't be reached.
+    const uint8_t *src = data;
+    const uint8_t *src_end = (const uint8_t *)UINTPTR_MAX;
+
+    return decompress_software_internal(&s, src, src_end, dst, type);
+}
+
+int decompressSoftwareStream(void *dst, DecompressType type,
+                             DecompressReadCallback readCB, void *arg)
+{
+    if ((dst == NULL) || (readCB == NULL))
+        return -1;
+
+    DecompressSource s;
+    s.read = readCB;
+    s.arg = arg;
+    s.error = false;
+
+    // Start with an empty buffer so that the first read refills it
+    const uint8_t *src = &s.buffer[0];
+    const uint8_t *src_end = &s.buffer[0];
+
+    return decompress_software_internal(&s, src, src_end, dst, type);
+}
@@ -13,8 +13,10 @@
 #include <stdio.h>
 #include <time.h>
 
+#include <nds/logring.h>
 #include <nds/ndstypes.h>
 #include <nds/system.h>
+#include <nds/touch.h>
 
 // ARM7-ARM9 shared memory
 
@@ -98,6 +100,28 @@ typedef struct {
     char buffer[];
 } ConsoleArm7Ipc;
 
+// Log ring buffers
+
+typedef struct {
+    volatile uint32_t write_index; // Only modified by the producer
+    volatile uint32_t read_index; // Only modified by the consumer (ARM9)
+    volatile uint32_t dropped;
+    volatile uint32_t active; // Cleared by the producer when it stops using it
+    uint32_t mask; // Number of records - 1 (a power of two - 1)
+    LogRingRecord records[];
+} LogRingIpc;
+
+void logRingSetup(LogRingIpc *ring);
+
+typedef struct {
+    volatile uint32_t write_index; // Only modified by the producer (ARM7)
+    volatile uint32_t read_index; // Only modified by the consumer (ARM9)
+    volatile uint32_t dropped;
+    volatile uint32_t active; // Cleared by the producer when it stops using it
+    uint32_t mask; // Number of events - 1 (a power of two - 1)
+    TouchEvent events[];
+} TouchEventIpc;
+
 // Other functions present in the ARM7 and ARM9
 
 void __libnds_exit(int rc);
@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <nds/interrupts.h>
+#include <nds/logring.h>
+#include <nds/system.h>
+#include <nds/timers.h>
+
+#include "common/libnds_internal.h"
+
+// In the ARM7 this is set by the FIFO handler when the ARM9 shares the ring. In
+// the ARM9 it's an uncached pointer to the ring allocated by logRingInit().
+static LogRingIpc *log_ring = NULL;
+
+void logRingSetup(LogRingIpc *ring)
+{
+    // This isn't called while a record is being written (logRingWrite() runs
+    // with interrupts disabled), so the ARM9 can free the old ring after this.
+    if (log_ring != NULL)
+        log_ring->active = 0;
+
+    log_ring = ring;
+}
+
+ARM_CODE bool logRingWrite(uint16_t format_id, const uint32_t *args, size_t nargs)
+{
+    LogRingIpc *ring = log_ring;
+
+    if (ring == NULL)
+        return false;
+
+    if (nargs > LOG_RING_MAX_ARGS)
+        nargs = LOG_RING_MAX_ARGS;
+
+    uint32_t info = (REG_VCOUNT & 0x1FF) | (nargs << 12);
+#ifdef ARM7
+    info |= 1 << 15;
+#endif
+
+    // Interrupt handlers may log records too, so the write index must not
+    // change between reading it and publishing the record.
+    int oldIME = enterCriticalSection();
+
+    uint32_t write_index = ring->write_index;
+
+    if (write_index - ring->read_index > ring->mask)
+    {
+        ring->dropped++;
+        leaveCriticalSection(oldIME);
+        return false;
+    }
+
+    LogRingRecord *r = &ring->records[write_index & ring->mask];
+
+    r->timestamp = cpuGetTiming();
+    r->format_id = format_id;
+    r->info = info;
+    for (size_t i = 0; i < nargs; i++)
+        r->args[i] = args[i];
+
+    // The record has to be complete before the consumer can see it. The ring
+    // isn't cached, so the writes reach memory in the order of the program.
+    __asm__ volatile("" ::: "memory");
+    ring->write_index = write_index + 1;
+
+    leaveCriticalSection(oldIME);
+
+    return true;
+}
+
+uint32_t logRingDropped(void)
+{
+    if (log_ring == NULL)
+        return 0;
+
+    return log_ring->dropped;
+}
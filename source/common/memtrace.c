@@ -0,0 +1,570 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nds/debug.h>
+#include <nds/interrupts.h>
+#include <nds/memtrace.h>
+
+// When the application is linked with --wrap=malloc (and the rest of the
+// allocation functions), the linker resolves __real_malloc to the actual
+// malloc() of the C library, and all calls to malloc() are redirected to
+// __wrap_malloc(). If the application isn't linked with those flags, the
+// __real_ symbols are left undefined, and they are NULL because they are weak.
+//
+// The tracer must always use the __real_ functions if they are available. If
+// not, calling malloc() would end in __wrap_malloc(), which would call the
+// tracer again.
+extern void *__real_malloc(size_t size) __attribute__((weak));
+extern void *__real_calloc(size_t nmemb, size_t size) __attribute__((weak));
+extern void *__real_realloc(void *ptr, size_t size) __attribute__((weak));
+extern void *__real_memalign(size_t alignment, size_t size) __attribute__((weak));
+extern void __real_free(void *ptr) __attribute__((weak));
+
+static void *trace_malloc_raw(size_t size)
+{
+    return __real_malloc ? __real_malloc(size) : malloc(size);
+}
+
+static void *trace_calloc_raw(size_t nmemb, size_t size)
+{
+    return __real_calloc ? __real_calloc(nmemb, size) : calloc(nmemb, size);
+}
+
+static void *trace_realloc_raw(void *ptr, size_t size)
+{
+    return __real_realloc ? __real_realloc(ptr, size) : realloc(ptr, size);
+}
+
+static void *trace_memalign_raw(size_t alignment, size_t size)
+{
+    return __real_memalign ? __real_memalign(alignment, size)
+                           : memalign(alignment, size);
+}
+
+static void trace_free_raw(void *ptr)
+{
+    if (__real_free)
+        __real_free(ptr);
+    else
+        free(ptr);
+}
+
+#define DEFAULT_MAX_LIVE_ALLOCATIONS 1024
+
+// Entry of the table of live allocations. A NULL pointer means that the entry
+// is empty.
+typedef struct
+{
+    uintptr_t   ptr;
+    uint32_t    size;
+    uint32_t    caller;
+    uint8_t     tag;
+    bool        external; // Not in the heap (see memTraceRecordAlloc())
+} TraceEntry;
+
+static bool trace_enabled = false;
+
+// This is set while the tracer is emitting a record. Any allocation done by the
+// output functions (like the buffers of stdio) isn't traced.
+static bool trace_busy = false;
+
+static unsigned int trace_flags;
+static bool trace_atexit_registered = false;
+
+static TraceEntry *trace_table = NULL;
+static uint32_t trace_table_mask; // Number of entries - 1 (power of two)
+static uint32_t trace_table_used;
+static uint32_t trace_table_dropped;
+
+static MemTraceStats trace_stats[MEMTRACE_TAG_COUNT];
+static MemTraceStats trace_stats_all;
+static uint32_t trace_histogram[MEMTRACE_HISTOGRAM_BUCKETS];
+
+static MemTraceOutput trace_output = MEMTRACE_OUTPUT_NONE;
+static FILE *trace_output_file = NULL;
+
+static const char *trace_tag_names[MEMTRACE_TAG_COUNT] = {
+    [MEMTRACE_TAG_USER] = "user",
+    [MEMTRACE_TAG_GRF] = "grf",
+    [MEMTRACE_TAG_VIDEOGL] = "videoGL",
+    [MEMTRACE_TAG_SPRITE] = "sprite",
+    [MEMTRACE_TAG_DYNAMIC_ARRAY] = "dynamicArray",
+    [MEMTRACE_TAG_COTHREAD] = "cothread",
+    [MEMTRACE_TAG_FILESYSTEM] = "filesystem",
+    [MEMTRACE_TAG_IMAGE] = "image",
+    [MEMTRACE_TAG_CONSOLE] = "console",
+    [MEMTRACE_TAG_VRAM_UPLOAD] = "vramUpload",
+    [MEMTRACE_TAG_HDMA] = "hdma",
+    [MEMTRACE_TAG_FONT] = "font",
+    [MEMTRACE_TAG_INPUT] = "input",
+};
+
+static uint32_t trace_hash(uintptr_t ptr)
+{
+    // Blocks are aligned to 8 bytes, so the bottom bits are always zero.
+    return ((uint32_t)(ptr >> 3) * 2654435761u) & trace_table_mask;
+}
+
+static void trace_emit(MemTraceRecordType type, MemTraceTag tag, uintptr_t ptr,
+                       size_t size, uint32_t caller)
+{
+    if (trace_output == MEMTRACE_OUTPUT_NONE)
+        return;
+
+    MemTraceRecord record = {
+        .type = type,
+        .tag = tag,
+        .reserved = 0,
+        .ptr = ptr,
+        .size = size,
+        .caller = caller
+    };
+
+    trace_busy = true;
+
+    if (trace_output == MEMTRACE_OUTPUT_NOCASH)
+    {
+        char line[40];
+        int len = snprintf(line, sizeof(line), "@MT:%02X%02X%08lX%08lX%08lX",
+                           record.type, record.tag, (unsigned long)record.ptr,
+                           (unsigned long)record.size,
+                           (unsigned long)record.caller);
+        nocashWrite(line, len);
+    }
+    else if (trace_output_file != NULL)
+    {
+        fwrite(&record, sizeof(record), 1, trace_output_file);
+    }
+
+    trace_busy = false;
+}
+
+static void trace_histogram_add(size_t size)
+{
+    unsigned int bucket = 0;
+
+    if (size > 1)
+        bucket = 31 - __builtin_clz(size);
+
+    if (bucket >= MEMTRACE_HISTOGRAM_BUCKETS)
+        bucket = MEMTRACE_HISTOGRAM_BUCKETS - 1;
+
+    trace_histogram[bucket]++;
+}
+
+static void trace_stats_add(MemTraceStats *stats, size_t size)
+{
+    stats->current += size;
+    stats->allocations++;
+    if (stats->current > stats->peak)
+        stats->peak = stats->current;
+}
+
+static void trace_stats_remove(MemTraceStats *stats, size_t size)
+{
+    stats->current -= size;
+    stats->frees++;
+}
+
+// Blocks that aren't in the heap are only accounted to their tag, not to the
+// global statistics or the histogram.
+static void trace_record_alloc(const void *ptr, size_t size, MemTraceTag tag,
+                               uint32_t caller, bool external)
+{
+    if (tag >= MEMTRACE_TAG_COUNT)
+        tag = MEMTRACE_TAG_USER;
+
+    int oldIME = enterCriticalSection();
+
+    if (ptr == NULL)
+    {
+        trace_stats[tag].failures++;
+        if (!external)
+            trace_stats_all.failures++;
+        leaveCriticalSection(oldIME);
+
+        trace_emit(MEMTRACE_RECORD_FAILED, tag, 0, size, caller);
+        return;
+    }
+
+    trace_stats_add(&trace_stats[tag], size);
+    if (!external)
+    {
+        trace_stats_add(&trace_stats_all, size);
+        trace_histogram_add(size);
+    }
+
+    // Leave at least one empty entry so that lookups always finish
+    if (trace_table_used < trace_table_mask)
+    {
+        uint32_t i = trace_hash((uintptr_t)ptr);
+
+        while (trace_table[i].ptr != 0)
+            i = (i + 1) & trace_table_mask;
+
+        trace_table[i].ptr = (uintptr_t)ptr;
+        trace_table[i].size = size;
+        trace_table[i].caller = caller;
+        trace_table[i].tag = tag;
+        trace_table[i].external = external;
+        trace_table_used++;
+    }
+    else
+    {
+        trace_table_dropped++;
+    }
+
+    leaveCriticalSection(oldIME);
+
+    trace_emit(MEMTRACE_RECORD_ALLOC, tag, (uintptr_t)ptr, size, caller);
+}
+
+static void trace_record_free(const void *ptr, uint32_t caller)
+{
+    if (ptr == NULL)
+        return;
+
+    int oldIME = enterCriticalSection();
+
+    uint32_t i = trace_hash((uintptr_t)ptr);
+
+    while (trace_table[i].ptr != (uintptr_t)ptr)
+    {
+        if (trace_table[i].ptr == 0)
+        {
+            // This block isn't in the table. It was allocated before the
+            // tracer was started, or when the table was full.
+            leaveCriticalSection(oldIME);
+            return;
+        }
+        i = (i + 1) & trace_table_mask;
+    }
+
+    TraceEntry entry = trace_table[i];
+
+    trace_stats_remove(&trace_stats[entry.tag], entry.size);
+    if (!entry.external)
+        trace_stats_remove(&trace_stats_all, entry.size);
+
+    // Remove the entry and move back any entry after it that would become
+    // unreachable because of the new gap (backward shift deletion).
+    uint32_t gap = i;
+    uint32_t j = i;
+    while (1)
+    {
+        j = (j + 1) & trace_table_mask;
+
+        if (trace_table[j].ptr == 0)
+            break;
+
+        uint32_t home = trace_hash(trace_table[j].ptr);
+
+        // Check if the home of the entry is cyclically outside of (gap, j]
+        if (((j - home) & trace_table_mask) >= ((j - gap) & trace_table_mask))
+        {
+            trace_table[gap] = trace_table[j];
+            gap = j;
+        }
+    }
+    trace_table[gap].ptr = 0;
+    trace_table_used--;
+
+    leaveCriticalSection(oldIME);
+
+    trace_emit(MEMTRACE_RECORD_FREE, entry.tag, (uintptr_t)ptr, entry.size,
+               caller);
+}
+
+static inline bool trace_active(void)
+{
+    return trace_enabled && !trace_busy;
+}
+
+#define CALLER() ((uint32_t)(uintptr_t)__builtin_return_address(0))
+
+void *memTraceMalloc(size_t size, MemTraceTag tag)
+{
+    void *ptr = trace_malloc_raw(size);
+
+    if (trace_active())
+        trace_record_alloc(ptr, size, tag, CALLER(), false);
+
+    return ptr;
+}
+
+void *memTraceCalloc(size_t nmemb, size_t size, MemTraceTag tag)
+{
+    void *ptr = trace_calloc_raw(nmemb, size);
+
+    if (trace_active())
+        trace_record_alloc(ptr, nmemb * size, tag, CALLER(), false);
+
+    return ptr;
+}
+
+void *memTraceMemalign(size_t alignment, size_t size, MemTraceTag tag)
+{
+    void *ptr = trace_memalign_raw(alignment, size);
+
+    if (trace_active())
+        trace_record_alloc(ptr, size, tag, CALLER(), false);
+
+    return ptr;
+}
+
+void *memTraceRealloc(void *ptr, size_t size, MemTraceTag tag)
+{
+    void *new_ptr = trace_realloc_raw(ptr, size);
+
+    if (trace_active())
+    {
+        uint32_t caller = CALLER();
+
+        // If it fails, the old block is still valid
+        if ((new_ptr != NULL) || (size == 0))
+            trace_record_free(ptr, caller);
+
+        if (size > 0)
+            trace_record_alloc(new_ptr, size, tag, caller, false);
+    }
+
+    return new_ptr;
+}
+
+void memTraceFree(void *ptr)
+{
+    if (trace_active())
+        trace_record_free(ptr, CALLER());
+
+    trace_free_raw(ptr);
+}
+
+void memTraceRecordAlloc(const void *ptr, size_t size, MemTraceTag tag)
+{
+    if (trace_active())
+        trace_record_alloc(ptr, size, tag, CALLER(), true);
+}
+
+void memTraceRecordFree(const void *ptr)
+{
+    if (trace_active())
+        trace_record_free(ptr, CALLER());
+}
+
+// Wrappers used when the application is linked with --wrap
+
+void *__wrap_malloc(size_t size)
+{
+    void *ptr = trace_malloc_raw(size);
+
+    if (trace_active())
+        trace_record_alloc(ptr, size, MEMTRACE_TAG_USER, CALLER(), false);
+
+    return ptr;
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    void *ptr = trace_calloc_raw(nmemb, size);
+
+    if (trace_active())
+        trace_record_alloc(ptr, nmemb * size, MEMTRACE_TAG_USER, CALLER(), false);
+
+    return ptr;
+}
+
+void *__wrap_memalign(size_t alignment, size_t size)
+{
+    void *ptr = trace_memalign_raw(alignment, size);
+
+    if (trace_active())
+        trace_record_alloc(ptr, size, MEMTRACE_TAG_USER, CALLER(), false);
+
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    void *new_ptr = trace_realloc_raw(ptr, size);
+
+    if (trace_active())
+    {
+        uint32_t caller = CALLER();
+
+        if ((new_ptr != NULL) || (size == 0))
+            trace_record_free(ptr, caller);
+
+        if (size > 0)
+            trace_record_alloc(new_ptr, size, MEMTRACE_TAG_USER, caller, false);
+    }
+
+    return new_ptr;
+}
+
+void __wrap_free(void *ptr)
+{
+    if (trace_active())
+        trace_record_free(ptr, CALLER());
+
+    trace_free_raw(ptr);
+}
+
+static void trace_atexit_handler(void)
+{
+    if (trace_enabled && (trace_flags & MEMTRACE_LEAK_REPORT_AT_EXIT))
+        memTraceReport(stderr);
+}
+
+bool memTraceStart(size_t max_live_allocations, unsigned int flags)
+{
+    memTraceStop();
+
+    if (max_live_allocations == 0)
+        max_live_allocations = DEFAULT_MAX_LIVE_ALLOCATIONS;
+
+    // Round up to a power of two, and leave some space so that the table never
+    // gets too full.
+    uint32_t entries = 8;
+    while (entries < max_live_allocations + (max_live_allocations / 4) + 1)
+        entries <<= 1;
+
+    trace_table = trace_calloc_raw(entries, sizeof(TraceEntry));
+    if (trace_table == NULL)
+        return false;
+
+    trace_table_mask = entries - 1;
+    trace_flags = flags;
+
+    if ((flags & MEMTRACE_LEAK_REPORT_AT_EXIT) && !trace_atexit_registered)
+    {
+        if (atexit(trace_atexit_handler) == 0)
+            trace_atexit_registered = true;
+    }
+
+    trace_enabled = true;
+
+    return true;
+}
+
+void memTraceStop(void)
+{
+    trace_enabled = false;
+
+    trace_free_raw(trace_table);
+    trace_table = NULL;
+    trace_table_used = 0;
+    trace_table_dropped = 0;
+
+    memset(trace_stats, 0, sizeof(trace_stats));
+    memset(&trace_stats_all, 0, sizeof(trace_stats_all));
+    memset(trace_histogram, 0, sizeof(trace_histogram));
+}
+
+void memTraceSetOutput(MemTraceOutput output, FILE *file)
+{
+    if ((output == MEMTRACE_OUTPUT_FILE) && (file == NULL))
+        output = MEMTRACE_OUTPUT_NONE;
+
+    trace_output = output;
+    trace_output_file = file;
+}
+
+void memTraceGetStats(MemTraceTag tag, MemTraceStats *stats)
+{
+    if (stats == NULL)
+        return;
+
+    int oldIME = enterCriticalSection();
+
+    if (tag == MEMTRACE_TAG_ALL)
+        *stats = trace_stats_all;
+    else if (tag < MEMTRACE_TAG_COUNT)
+        *stats = trace_stats[tag];
+    else
+        memset(stats, 0, sizeof(MemTraceStats));
+
+    leaveCriticalSection(oldIME);
+}
+
+void memTraceGetHistogram(uint32_t histogram[MEMTRACE_HISTOGRAM_BUCKETS])
+{
+    if (histogram == NULL)
+        return;
+
+    int oldIME = enterCriticalSection();
+    memcpy(histogram, trace_histogram, sizeof(trace_histogram));
+    leaveCriticalSection(oldIME);
+}
+
+void memTraceReport(FILE *file)
+{
+    if ((file == NULL) || !trace_enabled)
+        return;
+
+    // Don't trace allocations done by stdio while printing the report
+    bool old_busy = trace_busy;
+    trace_busy = true;
+
+    fprintf(file, "memtrace: current %zu, peak %zu, allocs %lu, frees %lu\n",
+            trace_stats_all.current, trace_stats_all.peak,
+            (unsigned long)trace_stats_all.allocations,
+            (unsigned long)trace_stats_all.frees);
+
+    if (trace_table_dropped > 0)
+    {
+        fprintf(file, "memtrace: %lu allocations not tracked (table full)\n",
+                (unsigned long)trace_table_dropped);
+    }
+
+    for (unsigned int i = 0; i < MEMTRACE_TAG_COUNT; i++)
+    {
+        MemTraceStats *s = &trace_stats[i];
+
+        if ((s->allocations == 0) && (s->failures == 0))
+            continue;
+
+        const char *name = trace_tag_names[i] ? trace_tag_names[i] : "?";
+
+        fprintf(file, "  %-12s cur %7zu peak %7zu n %5lu fail %lu\n", name,
+                s->current, s->peak, (unsigned long)s->allocations,
+                (unsigned long)s->failures);
+    }
+
+    fprintf(file, "memtrace: size histogram\n");
+    for (unsigned int i = 0; i < MEMTRACE_HISTOGRAM_BUCKETS; i++)
+    {
+        if (trace_histogram[i] == 0)
+            continue;
+
+        fprintf(file, "  %6u+ : %lu\n", 1u << i,
+                (unsigned long)trace_histogram[i]);
+    }
+
+    fprintf(file, "memtrace: live blocks\n");
+    for (uint32_t i = 0; i <= trace_table_mask; i++)
+    {
+        TraceEntry *e = &trace_table[i];
+
+        if (e->ptr == 0)
+            continue;
+
+        const char *name = trace_tag_names[e->tag] ? trace_tag_names[e->tag] : "?";
+
+        fprintf(file, "  %08lX %6lu %-12s from %08lX\n", (unsigned long)e->ptr,
+                (unsigned long)e->size, name, (unsigned long)e->caller);
+
+        trace_busy = false;
+        trace_emit(MEMTRACE_RECORD_LEAK, e->tag, e->ptr, e->size, e->caller);
+        trace_busy = true;
+    }
+
+    trace_busy = old_busy;
+}
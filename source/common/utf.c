@@ -2,66 +2,269 @@
 //
 // Copyright (c) 2025 Antonio Niño Díaz
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include <nds/ndstypes.h>
 #include <nds/utf.h>
 
-ssize_t utf16_to_utf8(char *out, size_t out_size, char16_t *in, size_t in_size)
+// Used to read and write strings one word at a time
+typedef uint32_t __attribute__((may_alias)) u32_alias;
+
+// True if any of the 4 bytes of the word is zero
+#define WORD_HAS_ZERO_BYTE(w)   ((((w) - 0x01010101) & ~(w) & 0x80808080) != 0)
+
+// Decodes one UTF-8 character of at most "size" bytes.
+//
+// https://en.wikipedia.org/wiki/UTF-8#Description
+static int utf8_decode(const unsigned char *s, size_t size, char32_t *codepoint)
 {
-    ssize_t out_len = 0;
+    unsigned int c = s[0];
+
+    if (c < 0x80)
+    {
+        *codepoint = c;
+        return 1;
+    }
+
+    int len;
+    char32_t min;
+
+    if ((c & 0xE0) == 0xC0)
+    {
+        len = 2;
+        min = 0x80;
+        c &= 0x1F;
+    }
+    else if ((c & 0xF0) == 0xE0)
+    {
+        len = 3;
+        min = 0x800;
+        c &= 0xF;
+    }
+    else if ((c & 0xF8) == 0xF0)
+    {
+        len = 4;
+        min = 0x10000;
+        c &= 0x7;
+    }
+    else
+    {
+        return -1;
+    }
+
+    if ((size_t)len > size)
+        return -1;
+
+    char32_t value = c;
+
+    // A NUL terminator fails this check, so it never reads past the end of
+    // the string.
+    for (int i = 1; i < len; i++)
+    {
+        if ((s[i] & 0xC0) != 0x80)
+            return -1;
+
+        value = (value << 6) | (s[i] & 0x3F);
+    }
+
+    if ((value < min) || (value > 0x10FFFF) ||
+        ((value >= 0xD800) && (value <= 0xDFFF)))
+        return -1;
+
+    *codepoint = value;
+    return len;
+}
+
+int utf8_decode_char(const char *in, char32_t *codepoint)
+{
+    return utf8_decode((const unsigned char *)in, 4, codepoint);
+}
+
+// Decodes one UTF-16 character of at most "units" code units.
+//
+// https://datatracker.ietf.org/doc/html/rfc2781
+static int utf16_decode(const char16_t *in, size_t units, char32_t *codepoint)
+{
+    char16_t w1 = in[0];
+
+    if ((w1 <= 0xD7FF) || (w1 >= 0xE000)) // NUL is included here
+    {
+        *codepoint = w1;
+        return 1;
+    }
+
+    // The first unit must be a high surrogate followed by a low surrogate
+    if ((w1 >= 0xDC00) || (units < 2))
+        return -1;
+
+    char16_t w2 = in[1];
+    if ((w2 < 0xDC00) || (w2 > 0xDFFF))
+        return -1;
+
+    *codepoint = 0x10000 + (((w1 & 0x3FF) << 10) | (w2 & 0x3FF));
+    return 2;
+}
+
+ssize_t utf8_to_utf16(char16_t *out, size_t out_size, const char *in,
+                      size_t in_size)
+{
+    const unsigned char *s = (const unsigned char *)in;
+    size_t out_len = 0;
 
     while (1)
     {
-        char32_t codepoint;
+        // ASCII fast path: 4 characters per iteration. It stops at the first
+        // word with a NUL terminator or any non-ASCII character.
+        if (((uintptr_t)s & 3) == 0)
+        {
+            while (in_size >= 4)
+            {
+                uint32_t w = *(const u32_alias *)s;
 
-        // Decode UTF-16
-        // -------------
+                if ((w & 0x80808080) || WORD_HAS_ZERO_BYTE(w))
+                    break;
 
-        // https://datatracker.ietf.org/doc/html/rfc2781
+                if (out_size >= 8)
+                {
+                    if (((uintptr_t)out & 3) == 0)
+                    {
+                        u32_alias *o = (u32_alias *)out;
+                        o[0] = (w & 0xFF) | ((w << 8) & 0xFF0000);
+                        o[1] = ((w >> 16) & 0xFF) | ((w >> 8) & 0xFF0000);
+                    }
+                    else
+                    {
+                        out[0] = w & 0xFF;
+                        out[1] = (w >> 8) & 0xFF;
+                        out[2] = (w >> 16) & 0xFF;
+                        out[3] = w >> 24;
+                    }
+                    out += 4;
+                    out_size -= 8;
+                }
+                else if (out_size > 0)
+                {
+                    // Let the slow path fill the end of the buffer
+                    break;
+                }
+
+                s += 4;
+                in_size -= 4;
+                out_len += 8;
+            }
+        }
 
         // If we have run out of input buffer without finding a terminator
         // character, try to add one before returning.
-        if (in_size < 2)
+        if (in_size == 0)
         {
-            if (out_size > 0)
-            {
-                *out = '\0';
-                out_len++;
-            }
+            if (out_size >= 2)
+                *out = 0;
 
+            out_len += 2;
             break;
         }
 
-        char16_t w1 = *in++;
-        in_size -= 2;
+        char32_t codepoint;
+        int len = utf8_decode(s, in_size, &codepoint);
+        if (len < 0)
+            return -1;
 
-        if ((w1 <= 0xD7FF) || (w1 >= 0xE000)) // NUL is included here
+        s += len;
+        in_size -= len;
+
+        char16_t utf16[2];
+        int units;
+
+        if (codepoint < 0x10000)
         {
-            codepoint = w1;
+            utf16[0] = codepoint;
+            units = 1;
         }
         else
         {
-            if ((w1 >= 0xD800) && (w1 <= 0xDBFF) && (in_size >= 2))
+            // Don't modify the codepoint, U+10000 would become a terminator
+            char32_t value = codepoint - 0x10000;
+            utf16[0] = 0xD800 | (value >> 10);
+            utf16[1] = 0xDC00 | (value & 0x3FF);
+            units = 2;
+        }
+
+        for (int i = 0; i < units; i++)
+        {
+            out_len += 2;
+
+            if (out_size < 2)
+                continue;
+
+            *out++ = utf16[i];
+            out_size -= 2;
+        }
+
+        if (codepoint == 0)
+            break;
+    }
+
+    return out_len;
+}
+
+ssize_t utf16_to_utf8(char *out, size_t out_size, const char16_t *in,
+                      size_t in_size)
+{
+    ssize_t out_len = 0;
+
+    while (1)
+    {
+        // ASCII fast path: 2 code units (4 bytes) per iteration. It stops at
+        // the first word with a NUL terminator or any non-ASCII character.
+        if (((uintptr_t)in & 3) == 0)
+        {
+            while (in_size >= 4)
             {
-                char16_t w2 = *in; // Don't advance pointer yet
-                if ((w2 < 0xDC00) || (w1 > 0xDFFF))
+                uint32_t w = *(const u32_alias *)in;
+
+                if ((w & 0xFF80FF80) || ((w & 0xFFFF) == 0) || ((w >> 16) == 0))
+                    break;
+
+                if (out_size >= 2)
                 {
-                    codepoint = ((w1 & 0x3FF) << 10) | (w2 & 0x3FF);
-                    in++;
-                    in_size -= 2;
+                    out[0] = w & 0xFF;
+                    out[1] = w >> 16;
+                    out += 2;
+                    out_size -= 2;
                 }
-                else // Values outside of that range or NUL characters
+                else if (out_size > 0)
                 {
-                    return -1;
+                    break;
                 }
+
+                in += 2;
+                in_size -= 4;
+                out_len += 2;
             }
-            else
-            {
-                return -1;
-            }
         }
 
+        // If we have run out of input buffer without finding a terminator
+        // character, try to add one before returning.
+        if (in_size < 2)
+        {
+            if (out_size > 0)
+                *out = '\0';
+
+            out_len++;
+            break;
+        }
+
+        char32_t codepoint;
+        int units = utf16_decode(in, in_size / 2, &codepoint);
+        if (units < 0)
+            return -1;
+
+        in += units;
+        in_size -= units * 2;
+
         // Encode UTF-8
         // ------------
 
@@ -70,11 +273,7 @@ ssize_t utf16_to_utf8(char *out, size_t out_size, char16_t *in, size_t in_size)
         char utf8[4];
         int utf8_len;
 
-        if (codepoint > 0x10FFFF)
-        {
-            return -1;
-        }
-        else if (codepoint <= 0x7F)
+        if (codepoint <= 0x7F)
         {
             utf8[0] = codepoint & 0x7F;
             utf8_len = 1;
@@ -92,7 +291,7 @@ ssize_t utf16_to_utf8(char *out, size_t out_size, char16_t *in, size_t in_size)
             utf8[2] = 0x80 | (codepoint & 0x3F);
             utf8_len = 3;
         }
-        else if (codepoint <= 0x10FFFF)
+        else
         {
             utf8[0] = 0xF0 | ((codepoint >> 18) & 0x7);
             utf8[1] = 0x80 | ((codepoint >> 12) & 0x3F);
@@ -110,7 +309,7 @@ ssize_t utf16_to_utf8(char *out, size_t out_size, char16_t *in, size_t in_size)
             out_len++;
 
             if (out_size == 0)
-                break;
+                continue;
 
             *out = utf8[i];
             out++;
@@ -125,3 +324,23 @@ ssize_t utf16_to_utf8(char *out, size_t out_size, char16_t *in, size_t in_size)
 
     return out_len;
 }
+
+ssize_t utf8_to_utf16_len(const char *in, size_t in_size)
+{
+    return utf8_to_utf16(NULL, 0, in, in_size);
+}
+
+ssize_t utf16_to_utf8_len(const char16_t *in, size_t in_size)
+{
+    return utf16_to_utf8(NULL, 0, in, in_size);
+}
+
+bool utf8_validate(const char *in, size_t in_size)
+{
+    return utf8_to_utf16_len(in, in_size) >= 0;
+}
+
+bool utf16_validate(const char16_t *in, size_t in_size)
+{
+    return utf16_to_utf8_len(in, in_size) >= 0;
+}
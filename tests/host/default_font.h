@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Replacement of the header that grit generates from graphics/default_font.png
+// when libnds is built. The host tests don't check the font graphics, so the
+// array is defined by the tests that need it.
+
+#ifndef DEFAULT_FONT_H__
+#define DEFAULT_FONT_H__
+
+#define default_fontTilesLen 768
+
+extern const unsigned int default_fontTiles[192];
+
+#endif // DEFAULT_FONT_H__
@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <string.h>
+
+#include "gx.h"
+
+// https://problemkaputt.de/gbatek.htm#ds3dgeometrycommands
+int gxParamCount(uint8_t id)
+{
+    switch (id)
+    {
+        case 0x00: // NOP
+        case 0x11: // MTX_PUSH
+        case 0x15: // MTX_IDENTITY
+        case 0x41: // END_VTXS
+            return 0;
+
+        case 0x10: // MTX_MODE
+        case 0x12: // MTX_POP
+        case 0x13: // MTX_STORE
+        case 0x14: // MTX_RESTORE
+        case 0x20: // COLOR
+        case 0x21: // NORMAL
+        case 0x22: // TEXCOORD
+        case 0x24: // VTX_10
+        case 0x25: // VTX_XY
+        case 0x26: // VTX_XZ
+        case 0x27: // VTX_YZ
+        case 0x28: // VTX_DIFF
+        case 0x29: // POLYGON_ATTR
+        case 0x2A: // TEXIMAGE_PARAM
+        case 0x2B: // PLTT_BASE
+        case 0x30: // DIF_AMB
+        case 0x31: // SPE_EMI
+        case 0x32: // LIGHT_VECTOR
+        case 0x33: // LIGHT_COLOR
+        case 0x40: // BEGIN_VTXS
+        case 0x50: // SWAP_BUFFERS
+        case 0x60: // VIEWPORT
+        case 0x72: // VEC_TEST
+            return 1;
+
+        case 0x23: // VTX_16
+        case 0x71: // POS_TEST
+            return 2;
+
+        case 0x1B: // MTX_SCALE
+        case 0x1C: // MTX_TRANS
+        case 0x70: // BOX_TEST
+            return 3;
+
+        case 0x1A: // MTX_MULT_3x3
+            return 9;
+
+        case 0x17: // MTX_LOAD_4x3
+        case 0x19: // MTX_MULT_4x3
+            return 12;
+
+        case 0x16: // MTX_LOAD_4x4
+        case 0x18: // MTX_MULT_4x4
+            return 16;
+
+        case 0x34: // SHININESS
+            return 32;
+
+        default:
+            return -1;
+    }
+}
+
+int gxDecodeList(const uint32_t *list, GxCommand *cmds, int max_cmds)
+{
+    uint32_t size = list[0];
+    const uint32_t *ptr = &list[1];
+    const uint32_t *end = ptr + size;
+    int count = 0;
+
+    while (ptr < end)
+    {
+        uint32_t packed = *ptr++;
+        bool nop_found = false;
+
+        for (int i = 0; i < 4; i++)
+        {
+            uint8_t id = packed >> (i * 8);
+
+            if (id == 0)
+            {
+                nop_found = true;
+                continue;
+            }
+
+            if (nop_found)
+                return -1;
+
+            int n = gxParamCount(id);
+            if ((n < 0) || (end - ptr < n) || (count == max_cmds))
+                return -1;
+
+            GxCommand *cmd = &cmds[count++];
+            cmd->id = id;
+            cmd->num_params = n;
+            memcpy(cmd->params, ptr, n * sizeof(uint32_t));
+            ptr += n;
+        }
+    }
+
+    return count;
+}
+
+void gxStateInit(GxState *state)
+{
+    memset(state, 0xFF, sizeof(GxState));
+}
+
+// Sign-extends a field of "bits" bits
+static int32_t sext(uint32_t value, int bits)
+{
+    return (int32_t)(value << (32 - bits)) >> (32 - bits);
+}
+
+// Coordinates are 16-bit values, the result of VTX_DIFF wraps around.
+static uint32_t coord(int32_t value)
+{
+    return (uint16_t)value;
+}
+
+static void set_xy(GxState *state, uint32_t x, uint32_t y)
+{
+    state->x = x;
+    state->y = y;
+}
+
+bool gxExecute(GxState *state, const GxCommand *cmd)
+{
+    uint32_t p = cmd->params[0];
+
+    switch (cmd->id)
+    {
+        case 0x20: // COLOR
+            state->color = p & 0x7FFF;
+            return false;
+
+        case 0x21: // NORMAL
+            // If lighting is enabled the vertex color is calculated from the
+            // normal. If the texture coordinates are generated from the normal,
+            // they change too. Consider both of them unknown.
+            state->normal = p;
+            state->color = GX_UNKNOWN;
+            state->texcoord = GX_UNKNOWN;
+            return false;
+
+        case 0x22: // TEXCOORD
+            state->texcoord = p;
+            return false;
+
+        case 0x29: // POLYGON_ATTR
+            state->poly_fmt = p;
+            return false;
+
+        case 0x2A: // TEXIMAGE_PARAM
+            state->tex_fmt = p;
+            return false;
+
+        case 0x2B: // PLTT_BASE
+            state->pal_fmt = p;
+            return false;
+
+        case 0x23: // VTX_16
+            set_xy(state, p & 0xFFFF, p >> 16);
+            state->z = cmd->params[1] & 0xFFFF;
+            return true;
+
+        case 0x24: // VTX_10 (4.6 fixed point)
+            state->x = coord(sext(p, 10) * 64);
+            state->y = coord(sext(p >> 10, 10) * 64);
+            state->z = coord(sext(p >> 20, 10) * 64);
+            return true;
+
+        case 0x25: // VTX_XY
+            set_xy(state, p & 0xFFFF, p >> 16);
+            return true;
+
+        case 0x26: // VTX_XZ
+            state->x = p & 0xFFFF;
+            state->z = p >> 16;
+            return true;
+
+        case 0x27: // VTX_YZ
+            state->y = p & 0xFFFF;
+            state->z = p >> 16;
+            return true;
+
+        case 0x28: // VTX_DIFF
+            if ((state->x == GX_UNKNOWN) || (state->y == GX_UNKNOWN) ||
+                (state->z == GX_UNKNOWN))
+            {
+                state->x = state->y = state->z = GX_UNKNOWN;
+                return true;
+            }
+            state->x = coord(sext(state->x, 16) + sext(p, 10));
+            state->y = coord(sext(state->y, 16) + sext(p >> 10, 10));
+            state->z = coord(sext(state->z, 16) + sext(p >> 20, 10));
+            return true;
+
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Reference decoder of the command lists of the 3D geometry engine, written
+// from the description in GBATEK. It's used to check the lists generated by
+// libnds without real hardware.
+
+#ifndef TESTS_HOST_GX_H__
+#define TESTS_HOST_GX_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Value of the state that isn't known by the decoder
+#define GX_UNKNOWN  0xFFFFFFFF
+
+typedef struct {
+    uint8_t id;
+    uint8_t num_params;
+    uint32_t params[32];
+} GxCommand;
+
+typedef struct {
+    uint32_t x, y, z;   // 1.3.12 fixed point, or GX_UNKNOWN
+    uint32_t color;
+    uint32_t texcoord;
+    uint32_t normal;
+    uint32_t poly_fmt;
+    uint32_t tex_fmt;
+    uint32_t pal_fmt;
+} GxState;
+
+// Returns the number of parameters of a command, or -1 if the ID isn't valid.
+int gxParamCount(uint8_t id);
+
+// Decodes a packed command list in the format used by glCallList() (the first
+// word is the size of the list in words). NOP commands are skipped.
+//
+// It returns the number of commands, or -1 if the list is malformed: if it has
+// an invalid command ID, if the parameters of a command don't fit in the list,
+// or if it has non-zero IDs after the first NOP of a packed command word.
+int gxDecodeList(const uint32_t *list, GxCommand *cmds, int max_cmds);
+
+// Sets all fields of the state to GX_UNKNOWN.
+void gxStateInit(GxState *state);
+
+// Applies a command to the state. It returns true if the command sends a
+// vertex to the GPU (the state has the coordinates and attributes of the
+// vertex).
+bool gxExecute(GxState *state, const GxCommand *cmd);
+
+#endif // TESTS_HOST_GX_H__
@@ -0,0 +1,311 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Replacements of hardware-specific parts of libnds for the host tests.
+//
+// All the functions that replace libnds functions are weak so that a test can
+// provide its own version (for example, to capture FIFO messages).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include <nds.h>
+
+uint32_t hostTimerTicks;
+uint64_t hostIoAccesses;
+
+uint64_t hostTimeNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Memory map
+// ----------
+
+static const struct {
+    uintptr_t base;
+    size_t size;
+} host_regions[] = {
+    { 0x04000000, 0x00100000 }, // I/O registers
+    { 0x05000000, 0x00001000 }, // Palettes
+    { 0x06000000, 0x00A00000 }, // VRAM (all banks and LCDC mirrors)
+    { 0x07000000, 0x00001000 }, // OAM
+};
+
+__attribute__((constructor)) static void host_map_hardware(void)
+{
+    for (size_t i = 0; i < sizeof(host_regions) / sizeof(host_regions[0]); i++)
+    {
+        void *addr = (void *)host_regions[i].base;
+        void *p = mmap(addr, host_regions[i].size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+        if (p != addr)
+        {
+            fprintf(stderr, "host: can't map %p\n", addr);
+            exit(1);
+        }
+    }
+}
+
+#ifdef ARM9
+
+// DMA
+// ---
+
+// Transfers are done right away when they are started, and the ones that are
+// started by the vertical blank are done by hostDmaVBlank(). Only the modes
+// used by libnds are supported: incrementing or fixed source, incrementing
+// destination.
+//
+// Pointers don't fit in the 32-bit address registers on the host, so only
+// transfers started with dmaSetParams() work.
+
+static uintptr_t host_dma_src[4], host_dma_dst[4];
+
+static void host_dma_run(int channel)
+{
+    uint32_t cr = DMA_CR(channel);
+    uintptr_t src = host_dma_src[channel];
+    uintptr_t dst = host_dma_dst[channel];
+    uint32_t count = cr & 0x1FFFFF;
+    size_t unit = (cr & DMA_32_BIT) ? 4 : 2;
+
+    if (count == 0)
+        count = 0x200000;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (unit == 4)
+            *(vu32 *)dst = *(vu32 *)src;
+        else
+            *(vu16 *)dst = *(vu16 *)src;
+
+        if (!(cr & DMA_SRC_FIX))
+            src += unit;
+        dst += unit;
+    }
+
+    if (!(cr & DMA_REPEAT))
+        DMA_CR(channel) = cr & ~DMA_ENABLE;
+}
+
+__attribute__((weak)) void dmaSetParams(uint8_t channel, const void *src,
+                                        void *dest, uint32_t ctrl)
+{
+    host_dma_src[channel] = (uintptr_t)src;
+    host_dma_dst[channel] = (uintptr_t)dest;
+
+    DMA_SRC(channel) = (uintptr_t)src;
+    DMA_DEST(channel) = (uintptr_t)dest;
+    DMA_CR(channel) = ctrl;
+
+    if ((ctrl & DMA_ENABLE) && ((ctrl & (7 << 27)) == DMA_START_NOW))
+        host_dma_run(channel);
+}
+
+__attribute__((weak)) void dmaStopSafe(uint8_t channel)
+{
+    DMA_CR(channel) = 0;
+}
+
+void hostDmaVBlank(void)
+{
+    for (int ch = 0; ch < 4; ch++)
+    {
+        uint32_t cr = DMA_CR(ch);
+        if ((cr & DMA_ENABLE) && ((cr & (7 << 27)) == DMA_START_VBL))
+            host_dma_run(ch);
+    }
+}
+
+__attribute__((weak)) void swiWaitForVBlank(void)
+{
+    hostDmaVBlank();
+}
+
+// DTCM
+// ----
+
+// Symbol defined by the linker. Nothing is placed in DTCM on the host.
+char __dtcm_start[16 * 1024];
+
+// Divider and square root units
+// -----------------------------
+
+static void host_div_update(void)
+{
+    int64_t numer, denom;
+
+    switch (REG_DIVCNT & DIV_MODE_MASK)
+    {
+        case DIV_32_32:
+            numer = (int32_t)REG_DIV_NUMER_L;
+            denom = (int32_t)REG_DIV_DENOM_L;
+            break;
+        case DIV_64_32:
+            numer = REG_DIV_NUMER;
+            denom = (int32_t)REG_DIV_DENOM_L;
+            break;
+        default:
+            numer = REG_DIV_NUMER;
+            denom = REG_DIV_DENOM;
+            break;
+    }
+
+    int64_t result, remainder;
+
+    if (denom == 0)
+    {
+        // The result is +1 or -1 with the opposite sign of the numerator
+        result = (numer < 0) ? 1 : -1;
+        remainder = numer;
+        REG_DIVCNT |= BIT(14);
+    }
+    else
+    {
+        if ((numer == INT64_MIN) && (denom == -1))
+        {
+            result = INT64_MIN;
+            remainder = 0;
+        }
+        else
+        {
+            result = numer / denom;
+            remainder = numer % denom;
+        }
+        REG_DIVCNT &= ~BIT(14);
+    }
+
+    *(vs64 *)0x040002A0 = result;
+    *(vs64 *)0x040002A8 = remainder;
+}
+
+static void host_sqrt_update(void)
+{
+    uint64_t param = REG_SQRT_PARAM;
+
+    if ((REG_SQRTCNT & SQRT_MODE_MASK) == SQRT_32)
+        param &= 0xFFFFFFFF;
+
+    // Bit by bit integer square root (rounded down)
+    uint64_t res = 0;
+    uint64_t bit = 1ull << 62;
+
+    while (bit > param)
+        bit >>= 2;
+
+    while (bit != 0)
+    {
+        if (param >= res + bit)
+        {
+            param -= res + bit;
+            res = (res >> 1) + bit;
+        }
+        else
+        {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    *(vu32 *)0x040002B4 = res;
+}
+
+// Called by trap.c before each access to the first page of I/O registers
+void hostIoTrap(void)
+{
+    host_div_update();
+    host_sqrt_update();
+    hostIoAccesses++;
+}
+
+// Cache
+// -----
+
+// The cache functions of libnds are inline wrappers of these ones.
+
+__attribute__((weak)) void CP15_CleanAndFlushDCacheRange(const void *base,
+                                                         size_t size)
+{
+    (void)base;
+    (void)size;
+}
+
+__attribute__((weak)) void CP15_FlushDCacheRange(const void *base, size_t size)
+{
+    (void)base;
+    (void)size;
+}
+
+__attribute__((weak)) void CP15_CleanAndFlushDCache(void)
+{
+}
+
+__attribute__((weak)) void CP15_FlushDCache(void)
+{
+}
+
+#endif // ARM9
+
+// System
+// ------
+
+#ifdef ARM9
+__attribute__((weak)) void __sassert(const char *fileName, int lineNumber,
+                                     const char *conditionString,
+                                     const char *format, ...)
+{
+    printf("%s:%d: assertion failed: %s\n", fileName, lineNumber,
+           conditionString);
+    fflush(stdout);
+    abort();
+}
+#endif
+
+__attribute__((weak)) void *memCached(void *address)
+{
+    return address;
+}
+
+__attribute__((weak)) void *memUncached(void *address)
+{
+    return address;
+}
+
+__attribute__((weak)) u32 cpuGetTiming(void)
+{
+    return hostTimerTicks;
+}
+
+__attribute__((weak)) void nocashWrite(const char *message, int len)
+{
+    fwrite(message, 1, len, stdout);
+    fputc('\n', stdout);
+}
+
+__attribute__((weak)) void nocashMessage(const char *message)
+{
+    puts(message);
+}
+
+__attribute__((weak)) bool fifoSendDatamsg(u32 channel, u32 num_bytes,
+                                           u8 *data_array)
+{
+    (void)channel;
+    (void)num_bytes;
+    (void)data_array;
+    return true;
+}
+
+__attribute__((weak)) bool fifoSendValue32(u32 channel, u32 value32)
+{
+    (void)channel;
+    (void)value32;
+    return true;
+}
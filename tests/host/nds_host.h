@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Header included before every source file of the host tests (with the
+// "-include" option of the compiler).
+//
+// It lets libnds sources that don't depend on the hardware be built and run on
+// a PC without modifying them:
+//
+// - Attributes that only make sense for the ARM CPUs are removed.
+// - The memory regions of the hardware registers, palettes, VRAM and OAM are
+//   mapped as normal memory at their real addresses (see host.c), so code that
+//   touches REG_IME, VRAM, etc. doesn't crash.
+// - The divider and square root units can be emulated by calling
+//   hostEmulateMathUnits(). The units are never busy.
+// - DMA transfers are done by the CPU when they are started. Transfers that
+//   start at the vertical blank period are done by hostDmaVBlank().
+
+#ifndef TESTS_HOST_NDS_HOST_H__
+#define TESTS_HOST_NDS_HOST_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// glibc doesn't have this macro
+#ifndef __printflike
+#define __printflike(fmt, args) __attribute__((format(printf, fmt, args)))
+#endif
+
+#include <nds/ndstypes.h>
+
+#undef ITCM_CODE
+#undef DTCM_DATA
+#undef DTCM_BSS
+#undef TWL_CODE
+#undef TWL_DATA
+#undef TWL_BSS
+#undef ARM_CODE
+#undef THUMB_CODE
+
+#define ITCM_CODE
+#define DTCM_DATA
+#define DTCM_BSS
+#define TWL_CODE
+#define TWL_DATA
+#define TWL_BSS
+#define ARM_CODE
+#define THUMB_CODE
+
+
+// Helpers for the tests
+
+// Value returned by cpuGetTiming(). Tests can modify it.
+extern uint32_t hostTimerTicks;
+
+// Returns a monotonic time in nanoseconds, used for benchmarks.
+uint64_t hostTimeNs(void);
+
+#ifdef ARM9
+// Starts emulating the divider and square root units. After this call every
+// access to the first page of I/O registers is trapped, and the results of the
+// units are calculated from the current parameters before the access is done.
+// This is very slow, so it's only enabled by the tests that need it.
+void hostEmulateMathUnits(void);
+#endif
+
+// Number of accesses to the first page of I/O registers trapped after calling
+// hostEmulateMathUnits(). Tests can use it to compare how many register
+// accesses different functions need.
+extern uint64_t hostIoAccesses;
+
+#ifdef ARM9
+// Runs the DMA transfers that start at the vertical blank period. It's
+// also called by swiWaitForVBlank().
+void hostDmaVBlank(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TESTS_HOST_NDS_HOST_H__
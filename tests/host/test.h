@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Minimal helpers shared by the host tests.
+
+#ifndef TESTS_HOST_TEST_H__
+#define TESTS_HOST_TEST_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned int test_failures = 0;
+
+// Checks a condition. On failure it prints the location and the condition, and
+// the test continues so that all failures are reported.
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond))                                                        \
+        {                                                                   \
+            if (test_failures < 20)                                         \
+                printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,     \
+                       #cond);                                              \
+            test_failures++;                                                \
+        }                                                                   \
+    } while (0)
+
+// Like CHECK(), but it also prints two integer values.
+#define CHECK_EQ(a, b)                                                      \
+    do {                                                                    \
+        long long va_ = (long long)(a), vb_ = (long long)(b);               \
+        if (va_ != vb_)                                                     \
+        {                                                                   \
+            if (test_failures < 20)                                         \
+                printf("%s:%d: %s == %s failed (%lld != %lld)\n", __FILE__, \
+                       __LINE__, #a, #b, va_, vb_);                         \
+            test_failures++;                                                \
+        }                                                                   \
+    } while (0)
+
+// Returns true if the program has been called with the benchmark flag ("-b").
+static inline bool test_bench_requested(int argc, char *argv[])
+{
+    return (argc > 1) && (strcmp(argv[1], "-b") == 0);
+}
+
+// Small deterministic PRNG (xorshift32) so that the results are reproducible.
+static uint32_t test_rand_state = 0x12345678;
+
+static inline uint32_t test_rand(void)
+{
+    uint32_t x = test_rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    test_rand_state = x;
+    return x;
+}
+
+// Prints the result of the test and returns the exit code of the program.
+static inline int test_end(const char *name)
+{
+    if (test_failures == 0)
+    {
+        printf("%s: OK\n", name);
+        return 0;
+    }
+
+    printf("%s: %u failures\n", name, test_failures);
+    return 1;
+}
+
+#endif // TESTS_HOST_TEST_H__
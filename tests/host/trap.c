@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Traps accesses to the first page of I/O registers so that the divider and
+// square root units can be emulated (see hostEmulateMathUnits()).
+//
+// The page is protected. When it's accessed, hostIoTrap() is called, the page
+// is unprotected, and the trap flag of the CPU is set so that the access is
+// done and the page is protected again right after it.
+//
+// This file is built without the include paths of libnds, which has its own
+// ucontext.h.
+
+#define _GNU_SOURCE
+
+#include <signal.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+#if !defined(__x86_64__) || !defined(__linux__)
+#error "The emulation of the divider and square root units needs x86-64 Linux"
+#endif
+
+#define HOST_IO_PAGE        0x04000000
+#define HOST_IO_PAGE_SIZE   0x1000
+#define HOST_TRAP_FLAG      0x100
+
+void hostIoTrap(void);
+void hostEmulateMathUnits(void);
+
+static void host_io_segv(int sig, siginfo_t *info, void *context)
+{
+    uintptr_t addr = (uintptr_t)info->si_addr;
+
+    if ((addr < HOST_IO_PAGE) || (addr >= HOST_IO_PAGE + HOST_IO_PAGE_SIZE))
+    {
+        // Not an access to the registers. Crash normally.
+        signal(sig, SIG_DFL);
+        return;
+    }
+
+    ucontext_t *uc = context;
+
+    mprotect((void *)HOST_IO_PAGE, HOST_IO_PAGE_SIZE, PROT_READ | PROT_WRITE);
+
+    hostIoTrap();
+
+    uc->uc_mcontext.gregs[REG_EFL] |= HOST_TRAP_FLAG;
+}
+
+static void host_io_step(int sig, siginfo_t *info, void *context)
+{
+    (void)sig;
+    (void)info;
+
+    ucontext_t *uc = context;
+
+    uc->uc_mcontext.gregs[REG_EFL] &= ~HOST_TRAP_FLAG;
+
+    mprotect((void *)HOST_IO_PAGE, HOST_IO_PAGE_SIZE, PROT_NONE);
+}
+
+void hostEmulateMathUnits(void)
+{
+    struct sigaction sa = { 0 };
+    sa.sa_flags = SA_SIGINFO;
+
+    sa.sa_sigaction = host_io_segv;
+    sigaction(SIGSEGV, &sa, NULL);
+
+    sa.sa_sigaction = host_io_step;
+    sigaction(SIGTRAP, &sa, NULL);
+
+    mprotect((void *)HOST_IO_PAGE, HOST_IO_PAGE_SIZE, PROT_NONE);
+}
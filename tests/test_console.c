@@ -0,0 +1,370 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Tests of the text console. Text written to stdout goes through con_write(),
+// which has a fast path for runs of printable characters. The result must be
+// the same as printing the text one character at a time with
+// consolePrintChar(), which is the reference. The same applies to consoles with
+// a scrollback buffer once they are rendered.
+//
+// With "-b" it measures the time needed to print 10000 lines with and without
+// the fast path, and with a scrollback buffer.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <nds/arm9/background.h>
+#include <nds/arm9/console.h>
+#include <nds/memtrace.h>
+
+#include "arm9/libnds_internal.h"
+#include "test.h"
+
+// The font graphics aren't loaded in these tests
+const unsigned int default_fontTiles[192];
+
+#define MAP_FAST    20
+#define MAP_SLOW    22
+#define MAP_CELLS   (32 * 32)
+
+static PrintConsole con_fast, con_slow;
+
+static u16 *map_of(int base)
+{
+    return (u16 *)BG_MAP_RAM(base);
+}
+
+static void init(PrintConsole *con, int layer, int map_base)
+{
+    consoleInit(con, layer, BgType_Text4bpp, BgSize_T_256x256, map_base, 0,
+                true, false);
+}
+
+static void write_fast(const char *text, size_t len)
+{
+    consoleSelect(&con_fast);
+    libnds_stdout_write(text, len);
+}
+
+static void write_slow(const char *text, size_t len)
+{
+    consoleSelect(&con_slow);
+    for (size_t i = 0; i < len; i++)
+        consolePrintChar(text[i]);
+}
+
+static bool consoles_match(void)
+{
+    if ((con_fast.cursorX != con_slow.cursorX) || (con_fast.cursorY != con_slow.cursorY))
+        return false;
+
+    return memcmp(map_of(MAP_FAST), map_of(MAP_SLOW), MAP_CELLS * sizeof(u16)) == 0;
+}
+
+// Random text with long lines, control characters and bytes over 0x7F. Escape
+// sequences aren't included because consolePrintChar() doesn't handle them.
+static size_t random_text(char *buf, size_t max)
+{
+    size_t len = 1 + test_rand() % max;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        uint32_t r = test_rand() % 100;
+
+        if (r < 70)
+            buf[i] = ' ' + test_rand() % 95;
+        else if (r < 80)
+            buf[i] = '\n';
+        else if (r < 82)
+            buf[i] = '\r';
+        else if (r < 84)
+            buf[i] = '\t';
+        else if (r < 85)
+            buf[i] = '\b';
+        else if (r < 90)
+            buf[i] = 1 + test_rand() % 31;
+        else
+            buf[i] = 0x7F + test_rand() % 129;
+
+        if (buf[i] == 0x1B)
+            buf[i] = '.';
+    }
+
+    return len;
+}
+
+// Tests
+// =====
+
+static void setup(ConsoleFont *font, int x, int y, int w, int h)
+{
+    init(&con_fast, 0, MAP_FAST);
+    init(&con_slow, 1, MAP_SLOW);
+
+    if (font != NULL)
+    {
+        con_fast.font = *font;
+        con_slow.font = *font;
+    }
+
+    if (w > 0)
+    {
+        consoleSetWindow(&con_fast, x, y, w, h);
+        consoleSetWindow(&con_slow, x, y, w, h);
+    }
+
+    CHECK(consoles_match());
+}
+
+static void test_fast_path(ConsoleFont *font, int x, int y, int w, int h)
+{
+    setup(font, x, y, w, h);
+
+    for (int n = 0; n < 2000; n++)
+    {
+        char buf[200];
+        size_t len = random_text(buf, sizeof(buf));
+
+        // consoleSetColor() changes the selected console
+        int color = test_rand() % 8;
+        consoleSelect(&con_fast);
+        consoleSetColor(NULL, color);
+        consoleSelect(&con_slow);
+        consoleSetColor(NULL, color);
+
+        write_fast(buf, len);
+        write_slow(buf, len);
+
+        CHECK(consoles_match());
+    }
+}
+
+// Bytes over 0x7F are printed as spaces if the font doesn't have them, and as
+// glyphs if it does, by both paths.
+static void test_high_bytes(void)
+{
+    static const char text[] = { 'A', (char)0x80, (char)0xE9, (char)0xFF, 'B' };
+
+    ConsoleFont font = consoleGetDefault()->font;
+
+    for (int glyphs = 0; glyphs < 2; glyphs++)
+    {
+        font.numChars = glyphs ? 224 : 96;
+
+        test_fast_path(&font, 0, 0, 0, 0);
+
+        setup(&font, 0, 0, 0, 0);
+        write_fast(text, sizeof(text));
+        write_slow(text, sizeof(text));
+        CHECK(consoles_match());
+
+        const u16 *row = map_of(MAP_FAST);
+        for (size_t i = 0; i < sizeof(text); i++)
+        {
+            unsigned int c = (unsigned char)text[i];
+            if (!glyphs && (c >= 0x80))
+                c = ' ';
+            CHECK_EQ(row[i] & 0x3FF, c - 32);
+        }
+    }
+}
+
+static void test_scrollback_output(int x, int y, int w, int h)
+{
+    setup(NULL, x, y, w, h);
+
+    CHECK_EQ(consoleSetScrollback(&con_fast, 50), 0);
+
+    for (int n = 0; n < 2000; n++)
+    {
+        char buf[200];
+        size_t len = random_text(buf, sizeof(buf));
+
+        write_fast(buf, len);
+        write_slow(buf, len);
+
+        consoleRender(&con_fast);
+        CHECK(consoles_match());
+    }
+
+    consoleSetScrollback(&con_fast, 0);
+}
+
+// Returns the number printed at the start of a row of the window
+static int row_number(int row)
+{
+    const u16 *cells = map_of(MAP_FAST) + row * 32;
+    int value = 0;
+
+    for (int i = 0; (cells[i] & 0x3FF) != 0; i++)
+        value = value * 10 + (cells[i] & 0x3FF) - ('0' - 32);
+
+    return value;
+}
+
+static void print_lines(int first, int count)
+{
+    for (int i = first; i < first + count; i++)
+    {
+        char buf[16];
+        int len = snprintf(buf, sizeof(buf), "\n%d", i);
+        write_fast(buf, len);
+    }
+}
+
+static void test_scrollback_view(void)
+{
+    const int lines = 100;
+    const int height = 24;
+
+    setup(NULL, 0, 0, 0, 0);
+    CHECK_EQ(consoleSetScrollback(&con_fast, lines), 0);
+
+    // The cursor starts at the top, so line N ends up in row N until the window
+    // is full.
+    print_lines(1, 59);
+    consoleRender(&con_fast);
+    CHECK_EQ(row_number(height - 1), 59);
+    CHECK_EQ(row_number(0), 59 - height + 1);
+
+    // 36 lines have scrolled out of the window
+    CHECK_EQ(consoleScroll(&con_fast, 10), 10);
+    consoleRender(&con_fast);
+    CHECK_EQ(row_number(0), 26);
+
+    // New lines don't move the view
+    print_lines(60, 20);
+    consoleRender(&con_fast);
+    CHECK_EQ(row_number(0), 26);
+    CHECK_EQ(consoleScroll(&con_fast, 0), 30);
+
+    CHECK_EQ(consoleScroll(&con_fast, 1000), 56);
+    consoleRender(&con_fast);
+    CHECK_EQ(row_number(0), 0);
+
+    // The view moves when the buffer is full and its lines are overwritten
+    print_lines(80, 30);
+    consoleRender(&con_fast);
+    CHECK_EQ(consoleScroll(&con_fast, 0), lines - height);
+    CHECK_EQ(row_number(0), 109 - lines + 1);
+
+    // Scrolling back to the most recent lines
+    CHECK_EQ(consoleScroll(&con_fast, -1000), 0);
+    consoleRender(&con_fast);
+    CHECK_EQ(row_number(height - 1), 109);
+
+    // New lines are visible again
+    print_lines(110, 1);
+    consoleRender(&con_fast);
+    CHECK_EQ(row_number(height - 1), 110);
+
+    consoleSetScrollback(&con_fast, 0);
+}
+
+static void test_scrollback_memory(void)
+{
+    MemTraceStats stats;
+
+    memTraceStart(0, 0);
+
+    setup(NULL, 0, 0, 0, 0);
+    CHECK_EQ(consoleSetScrollback(&con_fast, 100), 0);
+    CHECK_EQ(consoleSetScrollback(&con_slow, 50), 0);
+    memTraceGetStats(MEMTRACE_TAG_CONSOLE, &stats);
+    CHECK(stats.current >= 150 * 32 * sizeof(u16));
+
+    // Reinitializing a console frees its buffer only
+    init(&con_fast, 0, MAP_FAST);
+    CHECK(con_fast.scrollback == NULL);
+    CHECK(con_slow.scrollback != NULL);
+    memTraceGetStats(MEMTRACE_TAG_CONSOLE, &stats);
+    CHECK(stats.current < 100 * 32 * sizeof(u16));
+
+    init(&con_slow, 1, MAP_SLOW);
+    memTraceGetStats(MEMTRACE_TAG_CONSOLE, &stats);
+    CHECK_EQ(stats.current, 0);
+
+    // The struct passed to consoleInit() doesn't need to be initialized
+    PrintConsole garbage;
+    memset(&garbage, 0xA5, sizeof(garbage));
+    init(&garbage, 2, 24);
+    CHECK(garbage.scrollback == NULL);
+    CHECK_EQ(consoleSetScrollback(&garbage, 30), 0);
+    consoleSetWindow(&garbage, 2, 2, 10, 10);
+    CHECK(garbage.scrollback != NULL);
+    init(&garbage, 2, 24);
+    memTraceGetStats(MEMTRACE_TAG_CONSOLE, &stats);
+    CHECK_EQ(stats.current, 0);
+
+    memTraceStop();
+}
+
+// Benchmarks
+// ==========
+
+static bool slow_print(void *con, char c)
+{
+    (void)con;
+    (void)c;
+
+    // Returning false makes the console print the character, but the fast path
+    // is only used when there is no callback.
+    return false;
+}
+
+static void bench(void)
+{
+    const int lines = 10000;
+    uint64_t t[3];
+
+    for (int mode = 0; mode < 3; mode++)
+    {
+        init(&con_fast, 0, MAP_FAST);
+        con_fast.PrintChar = (mode == 0) ? slow_print : NULL;
+        if (mode == 2)
+            consoleSetScrollback(&con_fast, 200);
+
+        uint64_t start = hostTimeNs();
+        for (int i = 0; i < lines; i++)
+        {
+            char buf[64];
+            int len = snprintf(buf, sizeof(buf), "Line %5d: the quick brown fox\n", i);
+            write_fast(buf, len);
+
+            // Render once per frame, assuming 10 lines per frame
+            if ((i % 10) == 9)
+                consoleRender(&con_fast);
+        }
+        t[mode] = hostTimeNs() - start;
+    }
+
+    printf("Printing %d lines on the host (ns per line):\n", lines);
+    printf("  one character at a time %7.1f   fast path %7.1f   scrollback %7.1f\n",
+           (double)t[0] / lines, (double)t[1] / lines, (double)t[2] / lines);
+
+    consoleSetScrollback(&con_fast, 0);
+    con_fast.PrintChar = NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    static ConsoleFont *no_font = NULL;
+
+    // Full width window, whose rows are moved with a single copy, and a smaller
+    // window, which is moved row by row.
+    test_fast_path(no_font, 0, 0, 0, 0);
+    test_fast_path(no_font, 3, 2, 20, 10);
+    test_fast_path(no_font, 1, 1, 31, 23);
+    test_high_bytes();
+    test_scrollback_output(0, 0, 0, 0);
+    test_scrollback_output(3, 2, 20, 10);
+    test_scrollback_view();
+    test_scrollback_memory();
+
+    if (test_bench_requested(argc, argv))
+        bench();
+
+    return test_end("console");
+}
@@ -0,0 +1,306 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Tests of the culling functions that use the CPU. The frustum used by the
+// tests is the cube [-1, 1] in all axes (an identity clip matrix), so the
+// results can be compared with a simple overlap test.
+//
+// With "-b" it compares the time needed to cull 1000 objects one by one and
+// with a bounding volume hierarchy.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <nds/arm9/culling.h>
+
+#include "test.h"
+
+#define NUM_OBJECTS     1000
+#define MAX_NODES       (NUM_OBJECTS * 2)
+#define LEAF_SIZE       8
+
+static CullBox objects[NUM_OBJECTS];
+static CullBVHNode nodes[MAX_NODES];
+static size_t num_nodes;
+
+// Bitsets with a canary word after them
+static uint32_t visible[(NUM_OBJECTS + 31) / 32 + 1];
+static uint32_t expected[(NUM_OBJECTS + 31) / 32 + 1];
+
+static const int identity_clip[16] = {
+    4096, 0, 0, 0,
+    0, 4096, 0, 0,
+    0, 0, 4096, 0,
+    0, 0, 0, 4096,
+};
+
+// Used by cullFrustumFromGPU()
+void glGetFixed(const GL_GET_ENUM param, int *f)
+{
+    if (param == GL_GET_MATRIX_CLIP)
+        memcpy(f, identity_clip, sizeof(identity_clip));
+}
+
+// Reference test for the identity frustum
+static bool ref_visible(const CullBox *b)
+{
+    return (b->x <= 4096) && (b->x + b->width >= -4096) &&
+           (b->y <= 4096) && (b->y + b->height >= -4096) &&
+           (b->z <= 4096) && (b->z + b->depth >= -4096);
+}
+
+// The size of the box that contains all boxes must fit in a v16, so "spread"
+// must be smaller than 15360.
+static void random_box(CullBox *b, int spread)
+{
+    b->x = (int)(test_rand() % (2 * spread)) - spread;
+    b->y = (int)(test_rand() % (2 * spread)) - spread;
+    b->z = (int)(test_rand() % (2 * spread)) - spread;
+    b->width = test_rand() % 2048;
+    b->height = test_rand() % 2048;
+    b->depth = test_rand() % 2048;
+}
+
+static CullBox box_union(const CullBox *a, const CullBox *b)
+{
+    int x0 = (a->x < b->x) ? a->x : b->x;
+    int y0 = (a->y < b->y) ? a->y : b->y;
+    int z0 = (a->z < b->z) ? a->z : b->z;
+    int x1 = (a->x + a->width > b->x + b->width) ? a->x + a->width : b->x + b->width;
+    int y1 = (a->y + a->height > b->y + b->height) ? a->y + a->height : b->y + b->height;
+    int z1 = (a->z + a->depth > b->z + b->depth) ? a->z + a->depth : b->z + b->depth;
+
+    return (CullBox){ x0, y0, z0, x1 - x0, y1 - y0, z1 - z0 };
+}
+
+// Objects sorted along the X axis so that the hierarchy groups objects that
+// are close to each other.
+static void gen_objects(int spread)
+{
+    for (int i = 0; i < NUM_OBJECTS; i++)
+        random_box(&objects[i], spread);
+
+    for (int i = 1; i < NUM_OBJECTS; i++)
+    {
+        CullBox b = objects[i];
+        int j = i;
+        for ( ; (j > 0) && (objects[j - 1].x > b.x); j--)
+            objects[j] = objects[j - 1];
+        objects[j] = b;
+    }
+}
+
+// Builds the nodes of objects [first, first + count) in depth-first order
+static void build_bvh(size_t first, size_t count)
+{
+    size_t n = num_nodes++;
+    CullBVHNode *node = &nodes[n];
+
+    node->box = objects[first];
+    for (size_t i = 1; i < count; i++)
+        node->box = box_union(&node->box, &objects[first + i]);
+
+    if (count <= LEAF_SIZE)
+    {
+        node->first = first;
+        node->count = count;
+    }
+    else
+    {
+        node->first = 0;
+        node->count = 0;
+        build_bvh(first, count / 2);
+        build_bvh(first + count / 2, count - count / 2);
+    }
+
+    nodes[n].skip = num_nodes;
+}
+
+// Tests
+// =====
+
+static void test_frustum_from_clip(void)
+{
+    CullFrustum a, b;
+
+    cullFrustumFromClip(&a, identity_clip);
+    cullFrustumFromGPU(&b);
+    CHECK(memcmp(&a, &b, sizeof(a)) == 0);
+
+    for (int n = 0; n < 100000; n++)
+    {
+        CullBox box;
+        random_box(&box, 8192);
+        CHECK_EQ(cullBoxFrustum(&a, &box) != 0, ref_visible(&box));
+    }
+}
+
+static void test_boxes(void)
+{
+    CullFrustum frustum;
+    cullFrustumFromClip(&frustum, identity_clip);
+
+    for (int n = 0; n < 50; n++)
+    {
+        size_t count = test_rand() % (NUM_OBJECTS + 1);
+        gen_objects(8192);
+
+        size_t words = cullBitsetWords(count);
+        memset(visible, 0xAA, sizeof(visible));
+
+        size_t num = cullBoxesFrustum(&frustum, objects, count, visible);
+
+        size_t ref = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            bool v = ref_visible(&objects[i]);
+            CHECK_EQ(cullIsVisible(visible, i) != 0, v);
+            ref += v;
+        }
+        CHECK_EQ(num, ref);
+
+        // Unused bits of the last word must be clear
+        if (count % 32)
+            CHECK_EQ(visible[words - 1] >> (count % 32), 0);
+        CHECK_EQ(visible[words], 0xAAAAAAAA);
+    }
+}
+
+static void test_bvh(void)
+{
+    CullFrustum frustum;
+    cullFrustumFromClip(&frustum, identity_clip);
+
+    for (int n = 0; n < 50; n++)
+    {
+        gen_objects(4096 + (test_rand() % 11000));
+        num_nodes = 0;
+        build_bvh(0, NUM_OBJECTS);
+
+        size_t words = cullBitsetWords(NUM_OBJECTS);
+        memset(visible, 0xAA, sizeof(visible));
+
+        size_t num = cullBVH(nodes, num_nodes, NUM_OBJECTS, &frustum, visible);
+
+        // The objects of a leaf are visible if the box of the leaf is visible.
+        // The boxes of the parents contain the leaf, so they are visible too.
+        memset(expected, 0, sizeof(expected));
+        size_t ref = 0;
+        for (size_t i = 0; i < num_nodes; i++)
+        {
+            if ((nodes[i].count == 0) || !ref_visible(&nodes[i].box))
+                continue;
+
+            for (size_t j = nodes[i].first; j < nodes[i].first + nodes[i].count; j++)
+                expected[j / 32] |= BIT(j % 32);
+            ref += nodes[i].count;
+        }
+
+        CHECK(memcmp(visible, expected, words * sizeof(uint32_t)) == 0);
+        CHECK_EQ(num, ref);
+        CHECK_EQ(visible[words], 0xAAAAAAAA);
+    }
+}
+
+// Ranges of objects outside of the bitset must be ignored
+static void test_bvh_invalid_ranges(void)
+{
+    CullFrustum frustum;
+    cullFrustumFromClip(&frustum, identity_clip);
+
+    CullBVHNode bad[4] = {
+        { { -100, -100, -100, 200, 200, 200 }, 4, 0, 0 },
+        { { -100, -100, -100, 200, 200, 200 }, 2, 30, 10 },    // Cut at num_objects
+        { { -100, -100, -100, 200, 200, 200 }, 3, 1000, 5 },   // Starts outside
+        { { -100, -100, -100, 200, 200, 200 }, 4, 0, 2 },      // Overlaps
+    };
+
+    for (size_t num_objects = 0; num_objects <= 64; num_objects++)
+    {
+        size_t words = cullBitsetWords(num_objects);
+        memset(visible, 0xAA, sizeof(visible));
+
+        size_t num = cullBVH(bad, 4, num_objects, &frustum, visible);
+
+        size_t ref = 0;
+        for (size_t i = 0; i < num_objects; i++)
+        {
+            bool v = (i < 2) || ((i >= 30) && (i < 40));
+            CHECK_EQ(cullIsVisible(visible, i) != 0, v);
+            ref += v;
+        }
+        CHECK_EQ(num, ref);
+        CHECK_EQ(visible[words], 0xAAAAAAAA);
+    }
+}
+
+// The box test of the GPU is emulated by setting the result bit by hand
+static void test_bvh_box_test(void)
+{
+    gen_objects(8192);
+    num_nodes = 0;
+    build_bvh(0, NUM_OBJECTS);
+
+    GFX_STATUS = GFX_STATUS_TEST_INSIDE;
+    CHECK_EQ(cullBVH(nodes, num_nodes, NUM_OBJECTS, NULL, visible), NUM_OBJECTS);
+    CHECK_EQ(cullBoxesBoxTest(objects, NUM_OBJECTS, visible), NUM_OBJECTS);
+
+    GFX_STATUS = 0;
+    CHECK_EQ(cullBVH(nodes, num_nodes, NUM_OBJECTS, NULL, visible), 0);
+    CHECK_EQ(cullBoxesBoxTest(objects, NUM_OBJECTS, visible), 0);
+}
+
+// Benchmarks
+// ==========
+
+static void bench_scene(const char *name, int spread)
+{
+    const int iterations = 2000;
+    CullFrustum frustum;
+    cullFrustumFromClip(&frustum, identity_clip);
+
+    gen_objects(spread);
+    num_nodes = 0;
+    build_bvh(0, NUM_OBJECTS);
+
+    size_t num_list = 0, num_bvh = 0;
+
+    uint64_t start = hostTimeNs();
+    for (int i = 0; i < iterations; i++)
+        num_list = cullBoxesFrustum(&frustum, objects, NUM_OBJECTS, visible);
+    uint64_t t_list = hostTimeNs() - start;
+
+    start = hostTimeNs();
+    for (int i = 0; i < iterations; i++)
+        num_bvh = cullBVH(nodes, num_nodes, NUM_OBJECTS, &frustum, visible);
+    uint64_t t_bvh = hostTimeNs() - start;
+
+    printf("  %-16s list %7.2f us (%4zu visible)   BVH %7.2f us (%4zu visible, "
+           "%zu nodes)\n", name, t_list / 1000.0 / iterations, num_list,
+           t_bvh / 1000.0 / iterations, num_bvh, num_nodes);
+}
+
+static void bench(void)
+{
+    printf("Culling %d objects with the CPU on the host:\n", NUM_OBJECTS);
+
+    bench_scene("all visible", 3000);
+    bench_scene("some visible", 8000);
+    bench_scene("few visible", 15000);
+}
+
+int main(int argc, char *argv[])
+{
+    test_frustum_from_clip();
+    test_boxes();
+    test_bvh();
+    test_bvh_invalid_ranges();
+    test_bvh_box_test();
+
+    if (test_bench_requested(argc, argv))
+        bench();
+
+    return test_end("culling");
+}
@@ -0,0 +1,644 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Tests of the software decompression routines of libnds. They are compared
+// with simple reference decoders written from the description of the BIOS
+// formats in GBATEK, using randomly generated compressed data.
+//
+// With "-b" it also measures the speed of the decoders on the host. The speed
+// of the BIOS can only be measured on real hardware.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nds/decompress.h>
+
+#include "test.h"
+
+#define MAX_OUT_SIZE    (64 * 1024)
+#define MAX_IN_SIZE     (MAX_OUT_SIZE * 2)
+
+// Extra space after the compressed data. decompressSoftware() doesn't know the
+// size of its input, so a broken stream can make it read a bit past the end.
+#define IN_PADDING      1024
+
+static uint8_t in_buf[MAX_IN_SIZE + IN_PADDING];
+static uint8_t out_ref[MAX_OUT_SIZE + 4];
+static uint8_t out_test[MAX_OUT_SIZE + 4] __attribute__((aligned(4)));
+
+static void put_header(uint8_t *buf, uint32_t type, uint32_t size)
+{
+    uint32_t header = (size << 8) | type;
+    buf[0] = header;
+    buf[1] = header >> 8;
+    buf[2] = header >> 16;
+    buf[3] = header >> 24;
+}
+
+static uint32_t get_header_size(const uint8_t *buf)
+{
+    return buf[1] | (buf[2] << 8) | (buf[3] << 16);
+}
+
+// Reference decoders
+// ==================
+
+// They return false if the data tries to access anything outside of the input
+// data, the tree or the output data.
+
+static bool ref_lz77(const uint8_t *in, size_t in_size, uint8_t *out)
+{
+    uint32_t size = get_header_size(in);
+    size_t i = 4;
+    uint32_t o = 0;
+
+    while (o < size)
+    {
+        if (i >= in_size)
+            return false;
+        uint8_t flags = in[i++];
+
+        for (int b = 0; (b < 8) && (o < size); b++)
+        {
+            if (flags & (0x80 >> b))
+            {
+                if (i + 2 > in_size)
+                    return false;
+                uint32_t len = (in[i] >> 4) + 3;
+                uint32_t disp = (((in[i] & 0xF) << 8) | in[i + 1]) + 1;
+                i += 2;
+
+                if (disp > o)
+                    return false;
+
+                for (uint32_t j = 0; (j < len) && (o < size); j++, o++)
+                    out[o] = out[o - disp];
+            }
+            else
+            {
+                if (i >= in_size)
+                    return false;
+                out[o++] = in[i++];
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool ref_rle(const uint8_t *in, size_t in_size, uint8_t *out)
+{
+    uint32_t size = get_header_size(in);
+    size_t i = 4;
+    uint32_t o = 0;
+
+    while (o < size)
+    {
+        if (i >= in_size)
+            return false;
+        uint8_t flag = in[i++];
+
+        if (flag & 0x80)
+        {
+            if (i >= in_size)
+                return false;
+            uint8_t value = in[i++];
+            for (uint32_t j = 0; (j < (flag & 0x7Fu) + 3) && (o < size); j++)
+                out[o++] = value;
+        }
+        else
+        {
+            for (uint32_t j = 0; (j < (flag & 0x7Fu) + 1) && (o < size); j++)
+            {
+                if (i >= in_size)
+                    return false;
+                out[o++] = in[i++];
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool ref_huffman(const uint8_t *in, size_t in_size, uint8_t *out)
+{
+    uint32_t size = get_header_size(in);
+    uint32_t bits = in[0] & 0xF;
+    const uint8_t *tree = &in[4];
+    size_t tree_size = (tree[0] + 1) * 2;
+    size_t i = 4 + tree_size;
+
+    uint32_t words = (size + 3) / 4;
+    uint32_t o = 0;
+    uint32_t acc = 0, acc_bits = 0;
+    size_t node = 1;
+
+    while (o < words)
+    {
+        if (i + 4 > in_size)
+            return false;
+        uint32_t stream = in[i] | (in[i + 1] << 8) | (in[i + 2] << 16) |
+                          ((uint32_t)in[i + 3] << 24);
+        i += 4;
+
+        for (int b = 31; (b >= 0) && (o < words); b--)
+        {
+            uint32_t bit = (stream >> b) & 1;
+            size_t child = (node & ~1) + (tree[node] & 0x3F) * 2 + 2 + bit;
+            if (child >= tree_size)
+                return false;
+
+            if (tree[node] & (0x80 >> bit))
+            {
+                acc |= (tree[child] & ((1u << bits) - 1)) << acc_bits;
+                acc_bits += bits;
+                node = 1;
+
+                if (acc_bits == 32)
+                {
+                    memcpy(&out[o * 4], &acc, 4);
+                    o++;
+                    acc = 0;
+                    acc_bits = 0;
+                }
+            }
+            else
+            {
+                node = child;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Random compressed data generators
+// =================================
+
+// Symbols with a skewed distribution, so that the data looks like real data.
+static uint8_t random_byte(void)
+{
+    uint32_t r = test_rand();
+    if (r & 1)
+        return (r >> 8) & 0xF;
+    return r >> 8;
+}
+
+static size_t gen_lz77(uint8_t *in, uint32_t size)
+{
+    put_header(in, 0x10, size);
+    size_t i = 4;
+    uint32_t o = 0;
+
+    while (o < size)
+    {
+        size_t flags_pos = i++;
+        uint8_t flags = 0;
+
+        for (int b = 0; (b < 8) && (o < size); b++)
+        {
+            if ((o > 0) && (test_rand() & 1))
+            {
+                uint32_t max_disp = o < 4096 ? o : 4096;
+                uint32_t disp = (test_rand() % max_disp) + 1;
+                if (test_rand() & 1) // Short distances are common
+                    disp = (disp % 8) + 1;
+                if (disp > o)
+                    disp = o;
+                uint32_t len = (test_rand() % 16) + 3;
+
+                in[i++] = ((len - 3) << 4) | ((disp - 1) >> 8);
+                in[i++] = (disp - 1) & 0xFF;
+                flags |= 0x80 >> b;
+                o += len;
+            }
+            else
+            {
+                in[i++] = random_byte();
+                o++;
+            }
+        }
+
+        in[flags_pos] = flags;
+    }
+
+    return i;
+}
+
+static size_t gen_rle(uint8_t *in, uint32_t size)
+{
+    put_header(in, 0x30, size);
+    size_t i = 4;
+    uint32_t o = 0;
+
+    while (o < size)
+    {
+        if (test_rand() & 1)
+        {
+            uint32_t len = (test_rand() % 128) + 3;
+            in[i++] = 0x80 | (len - 3);
+            in[i++] = random_byte();
+            o += len;
+        }
+        else
+        {
+            uint32_t len = (test_rand() % 128) + 1;
+            if (len > size - o)
+                len = size - o;
+            in[i++] = len - 1;
+            for (uint32_t j = 0; j < len; j++)
+                in[i++] = random_byte();
+            o += len;
+        }
+    }
+
+    return i;
+}
+
+typedef struct {
+    int child[2]; // Index of the children, or -1 - symbol for leaves
+} HuffNode;
+
+// Generates a random tree and stores it in the format of the BIOS. Returns the
+// size of the tree, or 0 if an offset doesn't fit in 6 bits.
+static size_t gen_huffman_tree(uint8_t *tree, uint32_t bits,
+                               uint32_t codes[256], uint32_t lengths[256],
+                               uint8_t *symbols, uint32_t *num_symbols)
+{
+    uint32_t max_symbols = 1 << bits;
+    uint32_t leaves = 2 + (test_rand() % (max_symbols - 1));
+
+    // Pick random distinct symbols
+    uint8_t perm[256];
+    for (uint32_t i = 0; i < max_symbols; i++)
+        perm[i] = i;
+    for (uint32_t i = max_symbols - 1; i > 0; i--)
+    {
+        uint32_t j = test_rand() % (i + 1);
+        uint8_t t = perm[i];
+        perm[i] = perm[j];
+        perm[j] = t;
+    }
+
+    // Join random pairs of subtrees until there is only one left
+    HuffNode nodes[256];
+    int pool[256];
+    uint32_t pool_size = leaves;
+    uint32_t num_nodes = 0;
+
+    for (uint32_t i = 0; i < leaves; i++)
+        pool[i] = -1 - perm[i];
+
+    while (pool_size > 1)
+    {
+        uint32_t a = test_rand() % pool_size;
+        int na = pool[a];
+        pool[a] = pool[--pool_size];
+        uint32_t b = test_rand() % pool_size;
+        int nb = pool[b];
+
+        nodes[num_nodes].child[0] = na;
+        nodes[num_nodes].child[1] = nb;
+        pool[b] = num_nodes++;
+    }
+
+    int root = pool[0];
+
+    // Store the nodes in breadth-first order. The root is at position 1, and
+    // the children of each node are stored in pairs.
+    int queue[256];
+    uint32_t pos[256];
+    uint32_t head = 0, tail = 0;
+    uint32_t next_pair = 2;
+
+    queue[tail++] = root;
+    pos[root] = 1;
+
+    while (head < tail)
+    {
+        int n = queue[head++];
+        uint32_t p = pos[n];
+        uint32_t pair = next_pair;
+        next_pair += 2;
+
+        uint32_t offset = (pair - (p & ~1) - 2) / 2;
+        if (offset > 63)
+            return 0;
+
+        uint8_t value = offset;
+
+        for (int c = 0; c < 2; c++)
+        {
+            int child = nodes[n].child[c];
+            if (child < 0)
+            {
+                value |= 0x80 >> c;
+                tree[pair + c] = -1 - child;
+            }
+            else
+            {
+                pos[child] = pair + c;
+                queue[tail++] = child;
+            }
+        }
+
+        tree[p] = value;
+    }
+
+    // Make the size of the tree a multiple of 4, like real encoders do
+    size_t tree_size = next_pair;
+    if (tree_size & 2)
+    {
+        tree[tree_size] = 0;
+        tree[tree_size + 1] = 0;
+        tree_size += 2;
+    }
+    tree[0] = tree_size / 2 - 1;
+
+    // Calculate the code of each symbol
+    memset(lengths, 0, 256 * sizeof(uint32_t));
+
+    struct { int node; uint32_t code, len; } stack[512];
+    int sp = 0;
+    stack[sp++] = (typeof(stack[0])){ root, 0, 0 };
+
+    while (sp > 0)
+    {
+        typeof(stack[0]) e = stack[--sp];
+        for (int c = 0; c < 2; c++)
+        {
+            int child = nodes[e.node].child[c];
+            uint32_t code = (e.code << 1) | c;
+            if (child < 0)
+            {
+                codes[-1 - child] = code;
+                lengths[-1 - child] = e.len + 1;
+            }
+            else
+            {
+                stack[sp++] = (typeof(stack[0])){ child, code, e.len + 1 };
+            }
+        }
+    }
+
+    memcpy(symbols, perm, leaves);
+    *num_symbols = leaves;
+
+    return tree_size;
+}
+
+static size_t gen_huffman(uint8_t *in, uint32_t size, uint32_t bits)
+{
+    uint32_t codes[256], lengths[256];
+    uint8_t symbols[256];
+    uint32_t num_symbols;
+    size_t tree_size;
+
+    do
+    {
+        tree_size = gen_huffman_tree(&in[4], bits, codes, lengths, symbols,
+                                     &num_symbols);
+    }
+    while (tree_size == 0);
+
+    put_header(in, 0x20 | bits, size);
+    size_t i = 4 + tree_size;
+
+    uint32_t word = 0, word_bits = 0;
+    uint32_t count = size * 8 / bits;
+
+    for (uint32_t n = 0; n < count; n++)
+    {
+        uint8_t sym = symbols[test_rand() % num_symbols];
+        // Make some symbols more common than others
+        if (test_rand() & 1)
+            sym = symbols[0];
+
+        for (int b = lengths[sym] - 1; b >= 0; b--)
+        {
+            word |= ((codes[sym] >> b) & 1) << (31 - word_bits);
+            if (++word_bits == 32)
+            {
+                memcpy(&in[i], &word, 4);
+                i += 4;
+                word = 0;
+                word_bits = 0;
+            }
+        }
+    }
+
+    if (word_bits > 0)
+    {
+        memcpy(&in[i], &word, 4);
+        i += 4;
+    }
+
+    return i;
+}
+
+// Streaming
+// =========
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+} StreamState;
+
+static size_t stream_read(void *buffer, size_t size, void *arg)
+{
+    StreamState *st = arg;
+
+    // Return blocks of random sizes to test all refill paths
+    size_t n = (test_rand() % size) + 1;
+    if (n > st->size)
+        n = st->size;
+
+    memcpy(buffer, st->data, n);
+    st->data += n;
+    st->size -= n;
+
+    return n;
+}
+
+// Tests
+// =====
+
+typedef bool (*RefDecoder)(const uint8_t *in, size_t in_size, uint8_t *out);
+
+static void check_decoder(const char *name, DecompressType type, size_t in_size,
+                          RefDecoder ref)
+{
+    uint32_t size = get_header_size(in_buf);
+
+    CHECK(ref(in_buf, in_size, out_ref));
+
+    memset(out_test, 0xEE, sizeof(out_test));
+    CHECK_EQ(decompressSoftware(in_buf, out_test, type), size);
+    if (memcmp(out_ref, out_test, size) != 0)
+    {
+        printf("%s: output doesn't match (size %u)\n", name, (unsigned)size);
+        test_failures++;
+    }
+
+    // Nothing must be written after the end of the buffer, except for the
+    // padding to 32 bits of Huffman.
+    uint32_t end = (type == HUFF) ? (size + 3) & ~3 : size;
+    CHECK_EQ(out_test[end], 0xEE);
+
+    memset(out_test, 0xEE, sizeof(out_test));
+    StreamState st = { in_buf, in_size };
+    CHECK_EQ(decompressSoftwareStream(out_test, type, stream_read, &st), size);
+    CHECK(memcmp(out_ref, out_test, size) == 0);
+
+    // If the stream is cut short, the decoder must fail
+    if (in_size > 8)
+    {
+        st = (StreamState){ in_buf, in_size - 1 - (test_rand() % 4) };
+        if (decompressSoftwareStream(out_test, type, stream_read, &st) >= 0)
+        {
+            printf("%s: truncated stream accepted\n", name);
+            test_failures++;
+        }
+    }
+}
+
+static uint32_t random_size(void)
+{
+    uint32_t r = test_rand();
+    if (r & 1)
+        return r % 64;
+    return (r >> 1) % MAX_OUT_SIZE;
+}
+
+static void test_lz77_rle(void)
+{
+    for (int n = 0; n < 300; n++)
+    {
+        uint32_t size = random_size();
+
+        size_t in_size = gen_lz77(in_buf, size);
+        check_decoder("LZ77", LZ77, in_size, ref_lz77);
+        check_decoder("LZ77Vram", LZ77Vram, in_size, ref_lz77);
+
+        in_size = gen_rle(in_buf, size);
+        check_decoder("RLE", RLE, in_size, ref_rle);
+        check_decoder("RLEVram", RLEVram, in_size, ref_rle);
+    }
+}
+
+static void test_huffman(void)
+{
+    for (int n = 0; n < 300; n++)
+    {
+        uint32_t size = random_size() & ~3;
+        uint32_t bits = (n & 1) ? 8 : 4;
+
+        size_t in_size = gen_huffman(in_buf, size, bits);
+        check_decoder("HUFF", HUFF, in_size, ref_huffman);
+    }
+}
+
+// Corrupt the trees of valid Huffman data. The decoder must never read outside
+// of the tree, and it must fail if the reference decoder goes out of the tree.
+// If it accepts the data, the output must be the same as with the reference.
+static void test_huffman_corrupted(void)
+{
+    unsigned int rejected = 0;
+
+    for (int n = 0; n < 5000; n++)
+    {
+        uint32_t size = (test_rand() % 256) * 4;
+        uint32_t bits = (n & 1) ? 8 : 4;
+
+        size_t in_size = gen_huffman(in_buf, size, bits);
+        size_t tree_size = (in_buf[4] + 1) * 2;
+
+        int changes = 1 + (test_rand() % 4);
+        for (int c = 0; c < changes; c++)
+        {
+            size_t pos = 4 + (test_rand() % tree_size);
+            in_buf[pos] ^= 1 << (test_rand() % 8);
+        }
+
+        // A broken tree can make the codes a lot longer, so the decoders can
+        // read a lot more data than the size of the original stream.
+        memset(&in_buf[in_size], 0, sizeof(in_buf) - in_size);
+
+        bool ref_ok = ref_huffman(in_buf, sizeof(in_buf), out_ref);
+        int ret = decompressSoftware(in_buf, out_test, HUFF);
+
+        if (ret < 0)
+        {
+            rejected++;
+            continue;
+        }
+
+        CHECK(ref_ok);
+        CHECK_EQ(ret, size);
+        if (ref_ok)
+            CHECK(memcmp(out_ref, out_test, size) == 0);
+    }
+
+    // Make sure that the test isn't trivial
+    CHECK(rejected > 100);
+}
+
+// Benchmarks
+// ==========
+
+static void bench_decoder(const char *name, DecompressType type, size_t in_size,
+                          RefDecoder ref)
+{
+    uint32_t size = get_header_size(in_buf);
+    const int iterations = 200;
+
+    uint64_t start = hostTimeNs();
+    for (int i = 0; i < iterations; i++)
+        decompressSoftware(in_buf, out_test, type);
+    uint64_t t_soft = hostTimeNs() - start;
+
+    start = hostTimeNs();
+    for (int i = 0; i < iterations; i++)
+        ref(in_buf, in_size, out_ref);
+    uint64_t t_ref = hostTimeNs() - start;
+
+    double mb = (double)size * iterations / (1024 * 1024);
+
+    printf("  %-9s libnds %8.1f MB/s  reference %8.1f MB/s\n", name,
+           mb / (t_soft / 1e9), mb / (t_ref / 1e9));
+}
+
+static void bench(void)
+{
+    printf("Decompression speed on the host (output size %d KB):\n",
+           MAX_OUT_SIZE / 1024);
+
+    size_t in_size = gen_lz77(in_buf, MAX_OUT_SIZE);
+    bench_decoder("LZ77", LZ77, in_size, ref_lz77);
+    bench_decoder("LZ77Vram", LZ77Vram, in_size, ref_lz77);
+
+    in_size = gen_rle(in_buf, MAX_OUT_SIZE);
+    bench_decoder("RLE", RLE, in_size, ref_rle);
+    bench_decoder("RLEVram", RLEVram, in_size, ref_rle);
+
+    in_size = gen_huffman(in_buf, MAX_OUT_SIZE, 8);
+    bench_decoder("HUFF 8", HUFF, in_size, ref_huffman);
+
+    in_size = gen_huffman(in_buf, MAX_OUT_SIZE, 4);
+    bench_decoder("HUFF 4", HUFF, in_size, ref_huffman);
+}
+
+int main(int argc, char *argv[])
+{
+    test_lz77_rle();
+    test_huffman();
+    test_huffman_corrupted();
+
+    if (test_bench_requested(argc, argv))
+        bench();
+
+    return test_end("decompress");
+}
@@ -0,0 +1,446 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Tests of the display list builder. Random sequences of glList*() calls are
+// applied to a simple model of the GPU state, and the lists generated by the
+// builder are decoded and executed with the reference decoder in host/gx.c.
+// Both must send the same vertices (with the same attributes) and the same
+// matrix and polygon commands in the same order.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <nds/arm9/displayList.h>
+#include <nds/arm9/trig_lut.h>
+
+#include "gx.h"
+#include "test.h"
+
+#define MAX_EVENTS  4096
+#define EVENT_VERTEX 0xFF
+
+typedef struct {
+    uint8_t id;
+    uint8_t num_params;
+    uint32_t params[16];
+    GxState state; // Only for EVENT_VERTEX
+} Event;
+
+typedef struct {
+    Event events[MAX_EVENTS];
+    int count;
+    GxState state;
+} EventLog;
+
+static EventLog expected, decoded;
+
+static uint32_t list_buffer[16 * 1024];
+static GxCommand cmds[MAX_EVENTS * 2];
+
+static void log_command(EventLog *log, uint8_t id, const uint32_t *params,
+                        int num_params)
+{
+    Event *e = &log->events[log->count++];
+    memset(e, 0, sizeof(Event));
+    e->id = id;
+    e->num_params = num_params;
+    if (num_params > 0)
+        memcpy(e->params, params, num_params * sizeof(uint32_t));
+}
+
+static void log_vertex(EventLog *log)
+{
+    Event *e = &log->events[log->count++];
+    memset(e, 0, sizeof(Event));
+    e->id = EVENT_VERTEX;
+    e->state = log->state;
+}
+
+// Builds the list of events from the output of the builder
+static bool decode(const uint32_t *list)
+{
+    decoded.count = 0;
+    gxStateInit(&decoded.state);
+
+    int n = gxDecodeList(list, cmds, MAX_EVENTS * 2);
+    if (n < 0)
+        return false;
+
+    for (int i = 0; i < n; i++)
+    {
+        if (gxExecute(&decoded.state, &cmds[i]))
+        {
+            log_vertex(&decoded);
+            continue;
+        }
+
+        switch (cmds[i].id)
+        {
+            case 0x20: // Attributes of the vertices
+            case 0x21:
+            case 0x22:
+            case 0x29:
+            case 0x2A:
+            case 0x2B:
+                break;
+            default:
+                log_command(&decoded, cmds[i].id, cmds[i].params,
+                            cmds[i].num_params);
+                break;
+        }
+    }
+
+    return true;
+}
+
+static bool compare_logs(void)
+{
+    if (expected.count != decoded.count)
+    {
+        printf("Events: %d expected, %d decoded\n", expected.count,
+               decoded.count);
+        return false;
+    }
+
+    for (int i = 0; i < expected.count; i++)
+    {
+        if (memcmp(&expected.events[i], &decoded.events[i], sizeof(Event)) != 0)
+        {
+            const Event *a = &expected.events[i], *b = &decoded.events[i];
+            printf("Event %d is different (id 0x%02X, 0x%02X)\n", i, a->id,
+                   b->id);
+            if ((a->id == EVENT_VERTEX) && (b->id == EVENT_VERTEX))
+            {
+                printf("  color %08X %08X, texcoord %08X %08X\n",
+                       a->state.color, b->state.color, a->state.texcoord,
+                       b->state.texcoord);
+            }
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Random operations
+// =================
+
+static v16 random_coord(void)
+{
+    // Small set of values so that there are repeated coordinates
+    static const v16 values[] = {
+        0, 64, -64, 4096, -4096, 1, -1, 511, -512, 32767, -32768, 12345
+    };
+    if (test_rand() & 1)
+        return values[test_rand() % (sizeof(values) / sizeof(values[0]))];
+    return test_rand();
+}
+
+static void random_vertex(GLDisplayList *list)
+{
+    GxState *st = &expected.state;
+    v16 x = random_coord(), y = random_coord(), z = random_coord();
+
+    // Vertices that can use the short commands
+    if (st->x != GX_UNKNOWN)
+    {
+        switch (test_rand() % 5)
+        {
+            case 0:
+                z = st->z;
+                break;
+            case 1:
+                y = st->y;
+                break;
+            case 2:
+                x = st->x;
+                break;
+            case 3:
+                x = st->x + (int)(test_rand() % 1024) - 512;
+                y = st->y + (int)(test_rand() % 1024) - 512;
+                z = st->z + (int)(test_rand() % 1024) - 512;
+                break;
+            default:
+                break;
+        }
+    }
+    if ((test_rand() % 4) == 0)
+    {
+        x &= ~0x3F;
+        y &= ~0x3F;
+        z &= ~0x3F;
+    }
+
+    glListVertex3v16(list, x, y, z);
+
+    st->x = (uint16_t)x;
+    st->y = (uint16_t)y;
+    st->z = (uint16_t)z;
+    log_vertex(&expected);
+}
+
+static void random_op(GLDisplayList *list)
+{
+    GxState *st = &expected.state;
+    uint32_t r = test_rand() % 20;
+
+    switch (r)
+    {
+        case 0:
+        {
+            uint32_t mode = test_rand() % 4;
+            glListBegin(list, mode);
+            log_command(&expected, 0x40, &mode, 1);
+            break;
+        }
+        case 1:
+            glListEnd(list);
+            log_command(&expected, 0x41, NULL, 0);
+            break;
+        case 2:
+        {
+            rgb color = test_rand() % 4; // Repeated values
+            glListColor(list, color);
+            st->color = color;
+            break;
+        }
+        case 3:
+        {
+            t16 u = (test_rand() % 3) * 16, v = (test_rand() % 3) * 16;
+            glListTexCoord2t16(list, u, v);
+            st->texcoord = TEXTURE_PACK(u, v);
+            break;
+        }
+        case 4:
+        {
+            uint32_t normal = test_rand() % 3;
+            glListNormal(list, normal);
+            st->normal = normal;
+            st->color = GX_UNKNOWN;
+            st->texcoord = GX_UNKNOWN;
+            break;
+        }
+        case 5:
+        {
+            uint32_t fmt = test_rand() % 3;
+            glListPolyFmt(list, fmt);
+            st->poly_fmt = fmt;
+            break;
+        }
+        case 6:
+        {
+            uint32_t fmt = test_rand() % 3;
+            glListTexFormat(list, fmt);
+            st->tex_fmt = fmt;
+            break;
+        }
+        case 7:
+        {
+            uint32_t fmt = test_rand() % 3;
+            glListPalFormat(list, fmt);
+            st->pal_fmt = fmt;
+            break;
+        }
+        case 8:
+        {
+            uint32_t mode = test_rand() % 4;
+            glListMatrixMode(list, mode);
+            log_command(&expected, 0x10, &mode, 1);
+            break;
+        }
+        case 9:
+            glListPushMatrix(list);
+            log_command(&expected, 0x11, NULL, 0);
+            break;
+        case 10:
+        {
+            uint32_t num = test_rand() % 4;
+            glListPopMatrix(list, num);
+            log_command(&expected, 0x12, &num, 1);
+            break;
+        }
+        case 11:
+            glListLoadIdentity(list);
+            log_command(&expected, 0x15, NULL, 0);
+            break;
+        case 12:
+        {
+            uint32_t v[3] = { test_rand(), test_rand(), test_rand() };
+            glListTranslatef32(list, v[0], v[1], v[2]);
+            log_command(&expected, 0x1C, v, 3);
+            break;
+        }
+        case 13:
+        {
+            uint32_t v[3] = { test_rand(), test_rand(), test_rand() };
+            glListScalef32(list, v[0], v[1], v[2]);
+            log_command(&expected, 0x1B, v, 3);
+            break;
+        }
+        case 14:
+        {
+            m4x3 m;
+            for (int i = 0; i < 12; i++)
+                m.m[i] = test_rand();
+            glListMultMatrix4x3(list, &m);
+            log_command(&expected, 0x19, (const uint32_t *)m.m, 12);
+            break;
+        }
+        case 15:
+        {
+            int angle = test_rand() & 0x7FFF;
+            glListRotateZi(list, angle);
+
+            int s = sinLerp(angle), c = cosLerp(angle);
+            uint32_t m[9] = { c, s, 0, -s, c, 0, 0, 0, inttof32(1) };
+            log_command(&expected, 0x1A, m, 9);
+            break;
+        }
+        case 16:
+        {
+            // Raw command: The builder must forget all cached state
+            uint32_t param = 0;
+            glListCommand(list, 0x30, &param, 1); // DIF_AMB
+            log_command(&expected, 0x30, &param, 1);
+            break;
+        }
+        default:
+            random_vertex(list);
+            break;
+    }
+}
+
+// Tests
+// =====
+
+static void test_random_lists(void)
+{
+    for (int n = 0; n < 500; n++)
+    {
+        GLDisplayList list;
+        glListInit(&list, list_buffer, sizeof(list_buffer));
+
+        expected.count = 0;
+        gxStateInit(&expected.state);
+
+        int ops = test_rand() % 300;
+        for (int i = 0; i < ops; i++)
+            random_op(&list);
+
+        int size = glListFinish(&list);
+        CHECK(size >= 0);
+        CHECK_EQ(list_buffer[0], size);
+
+        CHECK(decode(list_buffer));
+        if (!compare_logs())
+        {
+            test_failures++;
+            return;
+        }
+
+        // Adding commands after finishing the list must be possible
+        random_vertex(&list);
+        CHECK(glListFinish(&list) > size);
+        CHECK(decode(list_buffer));
+        CHECK(compare_logs());
+    }
+}
+
+// Lists that don't fit in the buffer must be rejected
+static void test_overflow(void)
+{
+    for (int n = 0; n < 500; n++)
+    {
+        size_t words = test_rand() % 64;
+
+        // Canary after the end of the buffer
+        list_buffer[words] = 0xDEADBEEF;
+
+        GLDisplayList list;
+        glListInit(&list, list_buffer, words * sizeof(uint32_t));
+
+        expected.count = 0;
+        gxStateInit(&expected.state);
+
+        int ops = test_rand() % 40;
+        for (int i = 0; i < ops; i++)
+            random_op(&list);
+
+        CHECK_EQ(list_buffer[words], 0xDEADBEEF);
+
+        int size = glListFinish(&list);
+        if (size < 0)
+            continue;
+
+        CHECK((size_t)size < words);
+        CHECK(decode(list_buffer));
+        CHECK(compare_logs());
+    }
+}
+
+// Check that the shortest vertex commands are used
+static void test_vertex_commands(void)
+{
+    GLDisplayList list;
+    glListInit(&list, list_buffer, sizeof(list_buffer));
+
+    glListBegin(&list, GL_TRIANGLES);
+    glListVertex3v16(&list, 100, 200, 300);     // VTX_16
+    glListVertex3v16(&list, 101, 201, 300);     // VTX_XY
+    glListVertex3v16(&list, 102, 201, 301);     // VTX_XZ
+    glListVertex3v16(&list, 102, 202, 302);     // VTX_YZ
+    glListVertex3v16(&list, 90, 210, 290);      // VTX_DIFF
+    glListVertex3v16(&list, 4096, -64, 640);    // VTX_10
+    glListVertex3v16(&list, 4000, 8192, 32000); // VTX_16
+    glListColor(&list, 5);                      // COLOR
+    glListColor(&list, 5);                      // Removed
+    glListEnd(&list);
+
+    CHECK(glListFinish(&list) > 0);
+
+    static const uint8_t ids[] = {
+        0x40, 0x23, 0x25, 0x26, 0x27, 0x28, 0x24, 0x23, 0x20, 0x41
+    };
+
+    int n = gxDecodeList(list_buffer, cmds, MAX_EVENTS);
+    CHECK_EQ(n, sizeof(ids));
+    for (int i = 0; (i < n) && (i < (int)sizeof(ids)); i++)
+        CHECK_EQ(cmds[i].id, ids[i]);
+
+    // 3 packed command words, 1 + 2 + 1 * 5 + 2 + 1 parameters
+    CHECK_EQ(list_buffer[0], 3 + 11);
+}
+
+static void test_small_buffers(void)
+{
+    GLDisplayList list;
+
+    // Not enough space for the size field
+    glListInit(&list, list_buffer, 3);
+    glListEnd(&list);
+    CHECK_EQ(glListFinish(&list), -1);
+
+    // Empty list
+    glListInit(&list, list_buffer, 4);
+    CHECK_EQ(glListFinish(&list), 0);
+
+    // Exactly enough space
+    glListInit(&list, list_buffer, 4 * 4);
+    glListColor(&list, 1);
+    glListColor(&list, 2);
+    CHECK_EQ(glListFinish(&list), 3);
+    glListColor(&list, 3);
+    CHECK_EQ(glListFinish(&list), -1);
+}
+
+int main(int argc, char *argv[])
+{
+    test_vertex_commands();
+    test_small_buffers();
+    test_random_lists();
+    test_overflow();
+
+    return test_end("displaylist");
+}
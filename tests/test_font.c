@@ -0,0 +1,774 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Tests of the proportional font renderer using fonts generated with the BDF
+// converter in tools/fontgen. Random BDF fonts of 1, 2 and 4 bits per pixel are
+// converted and loaded with fontInit(). Text drawn into the three surface
+// formats must match a per-pixel reference renderer that uses the glyphs of
+// the BDF font. Text boxes updated one character at a time must match text
+// boxes drawn in one go.
+//
+// With "-b" it measures the time needed to draw glyphs into each surface
+// format, and the time needed to update a dialogue box one character at a time.
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nds/arm9/font.h>
+#include <nds/memtrace.h>
+
+#include "../tools/fontgen/fontgen.h"
+#include "test.h"
+
+#define ASCENT      10
+#define DESCENT     3
+#define MAX_SIZE    14
+
+#define SURF_W      96
+#define SURF_H      48
+#define STRIDE      (SURF_W / 8)
+
+// Codepoint that is never in the fonts
+#define MISSING     0x4E00
+
+// Reference font
+// ==============
+
+typedef struct
+{
+    uint32_t codepoint;
+    int width;
+    int height;
+    int x_offset;
+    int y_offset; // BDF convention
+    int advance;
+    uint8_t pixels[MAX_SIZE * MAX_SIZE];
+} RefGlyph;
+
+typedef struct
+{
+    uint32_t left;
+    uint32_t right;
+    int amount;
+} RefKerning;
+
+static RefGlyph ref_glyphs[128];
+static int ref_num_glyphs;
+static RefKerning ref_kerning[64];
+static int ref_num_kerning;
+static int ref_bpp;
+
+static char bdf[256 * 1024];
+static char kerning_text[4096];
+
+static const RefGlyph *ref_find(uint32_t codepoint)
+{
+    for (int i = 0; i < ref_num_glyphs; i++)
+    {
+        if (ref_glyphs[i].codepoint == codepoint)
+            return &ref_glyphs[i];
+    }
+
+    return NULL;
+}
+
+static int ref_find_kerning(uint32_t left, uint32_t right)
+{
+    for (int i = 0; i < ref_num_kerning; i++)
+    {
+        if ((ref_kerning[i].left == left) && (ref_kerning[i].right == right))
+            return ref_kerning[i].amount;
+    }
+
+    return 0;
+}
+
+static size_t bdf_append(size_t len, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static size_t bdf_append(size_t len, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    len += vsnprintf(bdf + len, sizeof(bdf) - len, fmt, args);
+    va_end(args);
+
+    return len;
+}
+
+static size_t bdf_append_glyph(size_t len, const RefGlyph *g, long encoding,
+                               int depth)
+{
+    len = bdf_append(len, "STARTCHAR U+%04X\nENCODING %ld\nSWIDTH 500 0\n"
+                     "DWIDTH %d 0\nBBX %d %d %d %d\nBITMAP\n", g->codepoint,
+                     encoding, g->advance, g->width, g->height, g->x_offset,
+                     g->y_offset);
+
+    // The first pixel is in the most significant bits
+    for (int y = 0; y < g->height; y++)
+    {
+        uint8_t row[MAX_SIZE] = { 0 };
+        int bytes = (g->width * depth + 7) / 8;
+
+        for (int x = 0; x < g->width; x++)
+        {
+            int bit = x * depth;
+            row[bit >> 3] |= g->pixels[y * g->width + x] << (8 - depth - (bit & 7));
+        }
+
+        for (int i = 0; i < bytes; i++)
+            len = bdf_append(len, "%02X", row[i]);
+        len = bdf_append(len, "\n");
+    }
+
+    return bdf_append(len, "ENDCHAR\n");
+}
+
+// Generates a random font with ASCII characters and a few characters encoded
+// with 2, 3 and 4 bytes in UTF-8. It returns the size of the BDF text.
+static size_t gen_font(int bpp)
+{
+    static const uint32_t extra[] = { 0xE9, 0x3042, 0x1F600 };
+    int mask = (1 << bpp) - 1;
+
+    ref_bpp = bpp;
+    ref_num_glyphs = 0;
+
+    for (uint32_t c = ' '; c < 0x7F + 3; c++)
+    {
+        RefGlyph *g = &ref_glyphs[ref_num_glyphs++];
+        memset(g, 0, sizeof(*g));
+
+        g->codepoint = (c < 0x7F) ? c : extra[c - 0x7F];
+        g->advance = 1 + test_rand() % 12;
+
+        if (c == ' ')
+            continue;
+
+        // Glyphs fit in the height of a line, and they may have empty rows and
+        // columns around them.
+        g->width = 1 + test_rand() % MAX_SIZE;
+        g->height = 1 + test_rand() % (ASCENT + DESCENT);
+        g->x_offset = (int)(test_rand() % 5) - 2;
+        g->y_offset = -DESCENT + (int)(test_rand() % (ASCENT + DESCENT - g->height + 1));
+
+        int density = test_rand() % 4;
+        for (int i = 0; i < g->width * g->height; i++)
+        {
+            if ((test_rand() % 4) <= (uint32_t)density)
+                g->pixels[i] = test_rand() & mask;
+        }
+    }
+
+    ref_num_kerning = 0;
+    size_t klen = 0;
+
+    while (ref_num_kerning < 40)
+    {
+        uint32_t left = 'A' + test_rand() % 26;
+        uint32_t right = 'a' + test_rand() % 26;
+        if (ref_find_kerning(left, right) != 0)
+            continue;
+
+        int amount = (int)(test_rand() % 5) - 3;
+        if (amount == 0)
+            amount = 1;
+
+        ref_kerning[ref_num_kerning++] = (RefKerning){ left, right, amount };
+        klen += snprintf(kerning_text + klen, sizeof(kerning_text) - klen,
+                         "0x%X %u %d # %c%c\n", left, right, amount, left, right);
+    }
+
+    size_t len = 0;
+    len = bdf_append(len, "STARTFONT 2.3\nFONT -test-random\n");
+    len = bdf_append(len, "SIZE %d 75 75 %d\n", ASCENT + DESCENT, bpp);
+    len = bdf_append(len, "FONTBOUNDINGBOX %d %d -2 %d\n", MAX_SIZE,
+                     ASCENT + DESCENT, -DESCENT);
+    len = bdf_append(len, "STARTPROPERTIES 3\nCOPYRIGHT \"Public domain\"\n"
+                     "FONT_ASCENT %d\nFONT_DESCENT %d\nENDPROPERTIES\n",
+                     ASCENT, DESCENT);
+    len = bdf_append(len, "CHARS %d\n", ref_num_glyphs + 1);
+
+    // Glyphs aren't sorted in BDF files
+    for (int i = ref_num_glyphs - 1; i >= 0; i--)
+        len = bdf_append_glyph(len, &ref_glyphs[i], ref_glyphs[i].codepoint, bpp);
+
+    // Characters without encoding are ignored
+    RefGlyph unencoded = { .codepoint = 0, .advance = 5, .width = 2, .height = 2 };
+    len = bdf_append_glyph(len, &unencoded, -1, bpp);
+
+    return bdf_append(len, "ENDFONT\n");
+}
+
+// Converts a BDF font to the format of libnds
+static void *convert(size_t bdf_size, const char *kerning, size_t *size)
+{
+    FontgenFont f = { 0 };
+    void *blob = NULL;
+
+    if (fontgen_parse_bdf(&f, bdf, bdf_size))
+    {
+        if ((kerning == NULL) || fontgen_parse_kerning(&f, kerning, strlen(kerning)))
+            blob = fontgen_build(&f, size);
+    }
+
+    if (blob == NULL)
+        printf("fontgen: %s\n", f.error);
+
+    fontgen_free(&f);
+    return blob;
+}
+
+// Returns the error of converting a font, or an empty string if it's converted
+static const char *convert_error(const char *text, const char *kerning)
+{
+    static FontgenFont f;
+    size_t size;
+
+    memset(&f, 0, sizeof(f));
+
+    bool ok = fontgen_parse_bdf(&f, text, strlen(text));
+    if (ok && (kerning != NULL))
+        ok = fontgen_parse_kerning(&f, kerning, strlen(kerning));
+    if (ok)
+    {
+        void *blob = fontgen_build(&f, &size);
+        ok = (blob != NULL);
+        free(blob);
+    }
+
+    fontgen_free(&f);
+    return ok ? "" : f.error;
+}
+
+// Reference renderer
+// ==================
+
+static uint8_t canvas[SURF_H][SURF_W];
+
+static void ref_draw_glyph(const RefGlyph *g, int pen, int line_top)
+{
+    int scale = 15 / ((1 << ref_bpp) - 1);
+    int left = pen + g->x_offset;
+    int top = line_top + ASCENT - (g->y_offset + g->height);
+
+    for (int y = 0; y < g->height; y++)
+    {
+        for (int x = 0; x < g->width; x++)
+        {
+            int v = g->pixels[y * g->width + x];
+            int cx = left + x;
+            int cy = top + y;
+
+            if ((v == 0) || (cx < 0) || (cy < 0) || (cx >= SURF_W) || (cy >= SURF_H))
+                continue;
+
+            canvas[cy][cx] = v * scale;
+        }
+    }
+}
+
+// Draws a list of codepoints, and returns the pen position after them
+static int ref_draw_text(const uint32_t *text, int count, int x, int y, bool draw)
+{
+    uint32_t prev = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        const RefGlyph *g = ref_find(text[i]);
+        if (g == NULL)
+            g = ref_find('?');
+
+        if (prev != 0)
+            x += ref_find_kerning(prev, g->codepoint);
+        prev = g->codepoint;
+
+        if (draw)
+            ref_draw_glyph(g, x, y);
+
+        x += g->advance;
+    }
+
+    return x;
+}
+
+static size_t utf8_encode(char *out, const uint32_t *text, int count)
+{
+    size_t len = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t c = text[i];
+
+        if (c < 0x80)
+        {
+            out[len++] = c;
+        }
+        else if (c < 0x800)
+        {
+            out[len++] = 0xC0 | (c >> 6);
+            out[len++] = 0x80 | (c & 0x3F);
+        }
+        else if (c < 0x10000)
+        {
+            out[len++] = 0xE0 | (c >> 12);
+            out[len++] = 0x80 | ((c >> 6) & 0x3F);
+            out[len++] = 0x80 | (c & 0x3F);
+        }
+        else
+        {
+            out[len++] = 0xF0 | (c >> 18);
+            out[len++] = 0x80 | ((c >> 12) & 0x3F);
+            out[len++] = 0x80 | ((c >> 6) & 0x3F);
+            out[len++] = 0x80 | (c & 0x3F);
+        }
+    }
+
+    out[len] = '\0';
+    return len;
+}
+
+static int random_text(uint32_t *text, int max, bool spaces)
+{
+    int count = 1 + test_rand() % max;
+
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t r = test_rand() % 100;
+
+        if (spaces && (r < 15))
+            text[i] = ' ';
+        else if (r < 18)
+            text[i] = MISSING;
+        else
+            text[i] = ref_glyphs[1 + test_rand() % (ref_num_glyphs - 1)].codepoint;
+    }
+
+    return count;
+}
+
+// Surfaces
+// ========
+
+static uint32_t gfx4[STRIDE * (SURF_H / 8) * 8];
+static uint32_t gfx8[STRIDE * (SURF_H / 8) * 16];
+static uint16_t gfx16[SURF_W * SURF_H];
+static uint16_t colors[16];
+
+#define COLOR_BASE  32
+
+static FontSurface surfaces[3] = {
+    { gfx4, FONT_SURFACE_4BPP_TILES, SURF_W, SURF_H, STRIDE, 0, NULL },
+    { gfx8, FONT_SURFACE_8BPP_TILES, SURF_W, SURF_H, STRIDE, COLOR_BASE, NULL },
+    { gfx16, FONT_SURFACE_16BPP_BITMAP, SURF_W, SURF_H, SURF_W, 0, colors },
+};
+
+static void clear_all(void)
+{
+    memset(gfx4, 0, sizeof(gfx4));
+    memset(gfx8, 0, sizeof(gfx8));
+    memset(gfx16, 0, sizeof(gfx16));
+    memset(canvas, 0, sizeof(canvas));
+}
+
+static unsigned int read_pixel(const FontSurface *s, int x, int y)
+{
+    int tile = (y >> 3) * s->stride + (x >> 3);
+
+    if (s->format == FONT_SURFACE_4BPP_TILES)
+        return (((const uint32_t *)s->gfx)[tile * 8 + (y & 7)] >> ((x & 7) * 4)) & 0xF;
+    else if (s->format == FONT_SURFACE_8BPP_TILES)
+        return ((const uint8_t *)s->gfx)[tile * 64 + (y & 7) * 8 + (x & 7)];
+    else
+        return ((const uint16_t *)s->gfx)[y * s->stride + x];
+}
+
+// Compares a surface with the reference canvas
+static bool surface_matches(const FontSurface *s)
+{
+    for (int y = 0; y < SURF_H; y++)
+    {
+        for (int x = 0; x < SURF_W; x++)
+        {
+            unsigned int v = canvas[y][x];
+            unsigned int expected = v;
+
+            if (s->format == FONT_SURFACE_8BPP_TILES)
+                expected = v ? v + COLOR_BASE : 0;
+            else if (s->format == FONT_SURFACE_16BPP_BITMAP)
+                expected = v ? colors[v] : 0;
+
+            if (read_pixel(s, x, y) != expected)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+// Tests
+// =====
+
+static void test_generator(void)
+{
+    static const char header[] =
+        "STARTFONT 2.1\nSIZE 8 75 75\nFONTBOUNDINGBOX 8 8 0 -2\n";
+    static const char glyph_a[] =
+        "STARTCHAR A\nENCODING 65\nDWIDTH 6 0\nBBX 6 8 0 -2\nBITMAP\n"
+        "00\n20\n50\n88\nF8\n88\n00\n00\nENDCHAR\n";
+    static const char glyph_b[] =
+        "STARTCHAR B\nENCODING 66\nDWIDTH 6 0\nBBX 1 1 0 0\nBITMAP\n80\nENDCHAR\n";
+    char text[1024];
+
+    // Metrics from the bounding box of the font. Empty rows and columns around
+    // glyphs are removed.
+    snprintf(text, sizeof(text), "%s%s%sENDFONT\n", header, glyph_a, glyph_b);
+
+    FontgenFont f = { 0 };
+    size_t size;
+    CHECK(fontgen_parse_bdf(&f, text, strlen(text)));
+    const char *kerning = "66 65 -2\n\n# comment\n";
+    CHECK(fontgen_parse_kerning(&f, kerning, strlen(kerning)));
+    uint8_t *blob = fontgen_build(&f, &size);
+    fontgen_free(&f);
+
+    CHECK(blob != NULL);
+    CHECK_EQ(size % 4, 0);
+
+    const FontHeader *h = (const FontHeader *)blob;
+    CHECK_EQ(h->magic, FONT_MAGIC);
+    CHECK_EQ(h->version, FONT_VERSION);
+    CHECK_EQ(h->bpp, 1);
+    CHECK_EQ(h->ascent, 6);
+    CHECK_EQ(h->line_height, 8);
+    CHECK_EQ(h->num_glyphs, 2);
+    CHECK_EQ(h->num_kerning, 1);
+    CHECK_EQ(h->bitmaps_offset % 4, 0);
+
+    const FontGlyph *g = (const FontGlyph *)(blob + h->glyphs_offset);
+    CHECK_EQ(g[0].codepoint, 'A');
+    CHECK(g[0].width == 5 && g[0].height == 5);
+    CHECK(g[0].x_offset == 0 && g[0].y_offset == -5);
+    CHECK(g[1].width == 1 && g[1].height == 1);
+    CHECK_EQ(g[1].y_offset, -1);
+
+    // Rows start at a byte boundary with the first pixel in the lowest bit
+    const uint8_t *bitmap = blob + h->bitmaps_offset + g[0].bitmap;
+    static const uint8_t rows_a[] = { 0x04, 0x0A, 0x11, 0x1F, 0x11 };
+    CHECK(memcmp(bitmap, rows_a, sizeof(rows_a)) == 0);
+
+    const FontKerning *k = (const FontKerning *)(blob + h->kerning_offset);
+    CHECK(k[0].left == 1 && k[0].right == 0 && k[0].amount == -2);
+
+    free(blob);
+
+    // Errors
+    snprintf(text, sizeof(text), "%s%s%sENDFONT\n", header, glyph_a, glyph_a);
+    CHECK(strstr(convert_error(text, NULL), "defined twice") != NULL);
+
+    snprintf(text, sizeof(text), "%s%s", header, glyph_a);
+    CHECK(strstr(convert_error(text, NULL), "missing ENDFONT") != NULL);
+
+    snprintf(text, sizeof(text), "%sSTARTCHAR A\nENCODING 65\nDWIDTH 6 0\n"
+             "BBX 8 2 0 0\nBITMAP\nFF\nGG\nENDCHAR\nENDFONT\n", header);
+    CHECK(strstr(convert_error(text, NULL), "line 10: invalid bitmap row") != NULL);
+
+    char wide_row[76 + 1];
+    memset(wide_row, 'F', 76);
+    wide_row[76] = '\0';
+    snprintf(text, sizeof(text), "%sSTARTCHAR A\nENCODING 65\nDWIDTH 6 0\n"
+             "BBX 300 1 0 0\nBITMAP\n%s\nENDCHAR\nENDFONT\n", header, wide_row);
+    CHECK(strstr(convert_error(text, NULL), "too big") != NULL);
+
+    snprintf(text, sizeof(text), "%s%s%sENDFONT\n", header, glyph_a, glyph_b);
+    CHECK(strstr(convert_error(text, "65 66 1\n65 66 2\n"), "defined twice") != NULL);
+    CHECK(strstr(convert_error(text, "65 67 1\n"), "not in the font") != NULL);
+    CHECK(strstr(convert_error(text, "65 66\n"), "line 1") != NULL);
+    CHECK_EQ(convert_error(text, "0x41 0x42 -1 # A B\n")[0], 0);
+
+    CHECK(strstr(convert_error("FONT x\n", NULL), "STARTFONT") != NULL);
+
+    // Fonts of 8 bits per pixel are reduced to 4 bits per pixel
+    snprintf(text, sizeof(text), "STARTFONT 2.3\nSIZE 8 75 75 8\n"
+             "FONTBOUNDINGBOX 8 1 0 0\nSTARTCHAR A\nENCODING 65\nDWIDTH 8 0\n"
+             "BBX 8 1 0 0\nBITMAP\n0F10203F80C0F0FF\nENDCHAR\nENDFONT\n");
+    f = (FontgenFont){ 0 };
+    CHECK(fontgen_parse_bdf(&f, text, strlen(text)));
+    CHECK_EQ(f.bpp, 4);
+    static const uint8_t levels[] = { 0, 1, 2, 3, 8, 12, 15, 15 };
+    CHECK(memcmp(f.glyphs[0].pixels, levels, sizeof(levels)) == 0);
+    fontgen_free(&f);
+}
+
+static void test_draw(Font *font)
+{
+    for (int n = 0; n < 300; n++)
+    {
+        clear_all();
+
+        // Overlapping lines of text, partially outside of the surfaces
+        for (int i = 0; i < 3; i++)
+        {
+            uint32_t text[16];
+            char utf8[16 * 4 + 1];
+            int count = random_text(text, 16, true);
+            utf8_encode(utf8, text, count);
+
+            int x = (int)(test_rand() % (SURF_W + 20)) - 20;
+            int y = (int)(test_rand() % (SURF_H + 10)) - 10;
+
+            int end = ref_draw_text(text, count, x, y, true);
+
+            for (int s = 0; s < 3; s++)
+                CHECK_EQ(fontDrawText(font, &surfaces[s], x, y, utf8), end);
+
+            CHECK_EQ(fontTextWidth(font, utf8), end - x);
+        }
+
+        for (int s = 0; s < 3; s++)
+            CHECK(surface_matches(&surfaces[s]));
+    }
+
+    // Invalid UTF-8
+    CHECK_EQ(fontTextWidth(font, "A\xC3"), -1);
+    CHECK_EQ(fontDrawText(font, &surfaces[0], 0, 0, "\xFF"), -1);
+}
+
+// Builds a text of words with the glyphs of the font
+static size_t random_words(char *out, int words)
+{
+    size_t len = 0;
+
+    for (int w = 0; w < words; w++)
+    {
+        uint32_t text[8];
+        int count = random_text(text, 8, false);
+        len += utf8_encode(out + len, text, count);
+
+        out[len++] = (test_rand() % 8) ? ' ' : '\n';
+    }
+
+    out[len] = '\0';
+    return len;
+}
+
+static void test_text_box(Font *font)
+{
+    // Text boxes are compared with text boxes in another surface
+    static uint32_t full4[sizeof(gfx4) / 4];
+    static uint16_t full16[sizeof(gfx16) / 2];
+    FontSurface full_surfaces[2] = { surfaces[0], surfaces[2] };
+    full_surfaces[0].gfx = full4;
+    full_surfaces[1].gfx = full16;
+
+    for (int n = 0; n < 6; n++)
+    {
+        int s = n & 1;
+        const FontSurface *surface = &surfaces[s * 2];
+        const FontSurface *full_surface = &full_surfaces[s];
+        size_t size = (s == 0) ? sizeof(gfx4) : sizeof(gfx16);
+        int bx = test_rand() % 10;
+        int by = test_rand() % 6;
+        int bw = 40 + test_rand() % 50;
+        int bh = 20 + test_rand() % 25;
+
+        char text[512];
+        char prefix[512];
+        size_t len = random_words(text, 12);
+
+        clear_all();
+
+        FontTextBox box, full;
+        fontTextBoxInit(&box, font, surface, bx, by, bw, bh);
+
+        // Typewriter effect
+        for (size_t i = 1; i <= len; i++)
+        {
+            if ((text[i] & 0xC0) == 0x80)
+                continue;
+
+            memcpy(prefix, text, i);
+            prefix[i] = '\0';
+            CHECK(fontTextBoxSet(&box, prefix));
+
+            memset(full_surface->gfx, 0, size);
+            fontTextBoxInit(&full, font, full_surface, bx, by, bw, bh);
+            CHECK(fontTextBoxSet(&full, prefix));
+            fontTextBoxFree(&full);
+
+            CHECK(memcmp(surface->gfx, full_surface->gfx, size) == 0);
+        }
+
+        // Changing a word in the middle and removing text
+        char *space = strchr(text + len / 2, ' ');
+        if (space != NULL)
+        {
+            *space = '?';
+            CHECK(fontTextBoxSet(&box, text));
+            space[1] = '\0';
+            CHECK(fontTextBoxSet(&box, text));
+
+            memset(full_surface->gfx, 0, size);
+            fontTextBoxInit(&full, font, full_surface, bx, by, bw, bh);
+            CHECK(fontTextBoxSet(&full, text));
+            fontTextBoxFree(&full);
+
+            CHECK(memcmp(surface->gfx, full_surface->gfx, size) == 0);
+        }
+
+        // Nothing is drawn outside of the box
+        for (int y = 0; y < SURF_H; y++)
+        {
+            for (int x = 0; x < SURF_W; x++)
+            {
+                if ((x >= bx) && (x < bx + bw) && (y >= by) && (y < by + bh))
+                    continue;
+
+                if (read_pixel(surface, x, y) != 0)
+                {
+                    CHECK(false);
+                    y = SURF_H;
+                    break;
+                }
+            }
+        }
+
+        CHECK(!fontTextBoxSet(&box, "\xC3"));
+
+        fontTextBoxClear(&box);
+        for (size_t i = 0; i < size; i += 4)
+            CHECK_EQ(*(uint32_t *)((uint8_t *)surface->gfx + i), 0);
+
+        fontTextBoxFree(&box);
+    }
+}
+
+static void test_fonts(void)
+{
+    MemTraceStats stats;
+
+    for (int i = 0; i < 16; i++)
+        colors[i] = 0x8000 | (i * 0x0421);
+
+    memTraceStart(0, 0);
+
+    for (int bpp = 1; bpp <= 4; bpp *= 2)
+    {
+        size_t bdf_size = gen_font(bpp);
+        size_t size;
+        void *blob = convert(bdf_size, kerning_text, &size);
+        CHECK(blob != NULL);
+        if (blob == NULL)
+            continue;
+
+        Font font;
+        CHECK(fontInit(&font, blob, 16));
+        CHECK_EQ(font.header->bpp, bpp);
+        CHECK_EQ(font.header->num_glyphs, ref_num_glyphs);
+        CHECK_EQ(font.header->num_kerning, ref_num_kerning);
+
+        test_draw(&font);
+        test_text_box(&font);
+
+        fontFree(&font);
+        free(blob);
+
+        memTraceGetStats(MEMTRACE_TAG_FONT, &stats);
+        CHECK_EQ(stats.current, 0);
+    }
+
+    memTraceStop();
+}
+
+// Benchmarks
+// ==========
+
+static void bench(void)
+{
+    const int lines = 20000;
+    size_t size;
+
+    void *blob = convert(gen_font(4), kerning_text, &size);
+    Font font;
+    fontInit(&font, blob, 128);
+
+    uint32_t text[32];
+    char utf8[32 * 4 + 1];
+    for (int i = 0; i < 32; i++)
+        text[i] = ref_glyphs[1 + i % 60].codepoint;
+    utf8_encode(utf8, text, 32);
+
+    static const char *names[3] = { "4bpp tiles", "8bpp tiles", "16-bit bitmap" };
+
+    printf("Drawing glyphs on the host (ns per glyph):\n");
+
+    for (int s = 0; s < 3; s++)
+    {
+        uint64_t start = hostTimeNs();
+        for (int i = 0; i < lines; i++)
+            fontDrawText(&font, &surfaces[s], (i & 7) - 4, (i & 31), utf8);
+        uint64_t t = hostTimeNs() - start;
+
+        printf("  %-14s %6.1f\n", names[s], (double)t / (lines * 32));
+    }
+
+    // Dialogue box of 5 lines filled one character per frame, compared with
+    // redrawing the whole box every frame.
+    char words[512];
+    size_t len = random_words(words, 30);
+    char prefix[512];
+    FontTextBox box;
+    uint64_t t_box = 0, t_full = 0;
+    int frames = 0;
+
+    fontTextBoxInit(&box, &font, &surfaces[0], 0, 0, SURF_W, 5 * (ASCENT + DESCENT));
+
+    for (int rep = 0; rep < 50; rep++)
+    {
+        fontTextBoxClear(&box);
+
+        for (size_t i = 1; i <= len; i++)
+        {
+            if ((words[i] & 0xC0) == 0x80)
+                continue;
+
+            memcpy(prefix, words, i);
+            prefix[i] = '\0';
+
+            uint64_t start = hostTimeNs();
+            fontTextBoxSet(&box, prefix);
+            t_box += hostTimeNs() - start;
+
+            start = hostTimeNs();
+            fontTextBoxClear(&box);
+            fontTextBoxSet(&box, prefix);
+            t_full += hostTimeNs() - start;
+
+            frames++;
+        }
+    }
+
+    fontTextBoxFree(&box);
+
+    printf("Dialogue box, one character per frame (ns per frame):\n");
+    printf("  changed lines %8.1f   whole box %8.1f\n",
+           (double)t_box / frames, (double)t_full / frames);
+
+    fontFree(&font);
+    free(blob);
+}
+
+int main(int argc, char *argv[])
+{
+    test_generator();
+    test_fonts();
+
+    if (test_bench_requested(argc, argv))
+        bench();
+
+    return test_end("font");
+}
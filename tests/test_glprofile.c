@@ -0,0 +1,188 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Tests of the GPU profiler. The hardware timer is replaced by a function that
+// captures the interrupt handler, and the test calls it to simulate samples of
+// the GX FIFO. The state of the GPU is set by writing to its registers.
+
+// Count the matrix stack operations of this file
+#define GL_PROFILE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <nds/arm9/video.h>
+#include <nds/arm9/videoGL.h>
+#include <nds/interrupts.h>
+#include <nds/memtrace.h>
+#include <nds/timers.h>
+
+#include "test.h"
+
+#define TIMER       2
+#define RATE        4096
+#define RELOAD      ((uint16_t)timerFreqToTicks_1(RATE))
+#define PERIOD      (0x10000 - RELOAD)
+
+// Replacements of libnds functions
+// ================================
+
+static VoidFn timer_handler;
+static int texture_vram_free = 512 * 1024;
+
+void timerStart(int timer, ClockDivider divider, u16 ticks, VoidFn callback)
+{
+    CHECK_EQ(timer, TIMER);
+    CHECK_EQ(divider, ClockDivider_1);
+    CHECK_EQ(ticks, RELOAD);
+
+    TIMER_DATA(timer) = ticks;
+    timer_handler = callback;
+}
+
+u16 timerStop(int timer)
+{
+    timer_handler = NULL;
+    return 0;
+}
+
+void irqDisable(u32 irq)
+{
+}
+
+void irqClear(u32 irq)
+{
+    REG_IF &= ~irq;
+}
+
+void glGetInt(GL_GET_ENUM param, int *i)
+{
+    CHECK_EQ(param, GL_GET_TEXTURE_VRAM_FREE);
+    *i = texture_vram_free;
+}
+
+// Simulates "count" samples of the GX FIFO with the given number of commands
+static void sample(int count, int level)
+{
+    GFX_STATUS = (level << 16) | ((level >= 256) ? BIT(24) : 0);
+
+    for (int i = 0; i < count; i++)
+        timer_handler();
+
+    GFX_STATUS = 0;
+}
+
+// Tests
+// =====
+
+static void test_arguments(void)
+{
+    CHECK(!glProfileStart(0, TIMER, RATE));
+    CHECK(!glProfileStart(4, 4, RATE));
+    CHECK(!glProfileStart(4, -1, RATE));
+    CHECK(!glProfileStart(4, TIMER, 511));
+
+    GLProfileFrame frames[4];
+    CHECK_EQ(glProfileGetFrames(frames, 4), 0);
+
+    // It does nothing if the profiler isn't active
+    glProfileFrame();
+    glProfileStop();
+}
+
+static void test_frames(void)
+{
+    memTraceStart(0, 0);
+
+    CHECK(glProfileStart(4, TIMER, RATE));
+    CHECK(timer_handler != NULL);
+
+    // Frame 0: 10 samples, half of them with the FIFO full
+    sample(5, 100);
+    sample(5, 256);
+    GFX_POLYGON_RAM_USAGE = 123;
+    GFX_VERTEX_RAM_USAGE = 456;
+    REG_VCOUNT = 150;
+    texture_vram_free = 512 * 1024 - 2048;
+    TIMER_DATA(TIMER) = RELOAD + 100;
+
+    glPushMatrix();
+    glPopMatrix(1);
+    glStoreMatrix(0);
+    glRestoreMatrix(0);
+
+    // glFlush() ends the frame because GL_PROFILE is defined
+    glFlush(0);
+
+    GLProfileFrame f[4];
+    CHECK_EQ(glProfileGetFrames(f, 4), 1);
+    CHECK_EQ(f[0].frame, 0);
+    CHECK_EQ(f[0].polygons, 123);
+    CHECK_EQ(f[0].vertices, 456);
+    CHECK_EQ(f[0].flush_vcount, 150);
+    CHECK_EQ(f[0].texture_vram_used, 2048);
+    CHECK_EQ(f[0].matrix_stack_ops, 4);
+    CHECK_EQ(f[0].fifo_samples, 10);
+    CHECK_EQ(f[0].fifo_full_samples, 5);
+    CHECK_EQ(f[0].fifo_avg_level, (5 * 100 + 5 * 256) / 10);
+    CHECK_EQ(f[0].fifo_stall_cycles, 5 * PERIOD * 2);
+
+    // The ARM9 runs at twice the frequency of the timer
+    CHECK_EQ(f[0].frame_cycles, (10 * PERIOD + 100) * 2);
+    CHECK_EQ(f[0].drain_cycles, 0);
+
+    // The counters are cleared for the next frame
+    CHECK_EQ(glProfileCounters.fifo_samples, 0);
+    CHECK_EQ(glProfileCounters.matrix_stack_ops, 0);
+
+    // Frame 1: the timer has overflowed, but the interrupt hasn't been
+    // handled yet.
+    sample(2, 0);
+    TIMER_DATA(TIMER) = RELOAD + 10;
+    REG_IF |= IRQ_TIMER(TIMER);
+    glProfileFrame();
+    REG_IF &= ~IRQ_TIMER(TIMER);
+
+    CHECK_EQ(glProfileGetFrames(f, 4), 2);
+    CHECK_EQ(f[1].frame, 1);
+    CHECK_EQ(f[1].fifo_avg_level, 0);
+    CHECK_EQ(f[1].frame_cycles, (3 * PERIOD + 10 - 100) * 2);
+
+    // Only the most recent frames are kept, from oldest to newest
+    for (int i = 0; i < 5; i++)
+        glProfileFrame();
+
+    CHECK_EQ(glProfileGetFrames(f, 4), 4);
+    for (int i = 0; i < 4; i++)
+        CHECK_EQ(f[i].frame, 3 + i);
+
+    CHECK_EQ(glProfileGetFrames(f, 2), 2);
+    CHECK_EQ(f[0].frame, 5);
+    CHECK_EQ(f[1].frame, 6);
+
+    CHECK_EQ(glProfileGetFrames(NULL, 2), 0);
+
+    // Stopping the profiler frees the frames
+    MemTraceStats stats;
+    memTraceGetStats(MEMTRACE_TAG_VIDEOGL, &stats);
+    CHECK_EQ(stats.current, 4 * sizeof(GLProfileFrame));
+
+    glProfileStop();
+    CHECK(timer_handler == NULL);
+    CHECK_EQ(glProfileGetFrames(f, 4), 0);
+
+    memTraceGetStats(MEMTRACE_TAG_VIDEOGL, &stats);
+    CHECK_EQ(stats.current, 0);
+
+    memTraceStop();
+}
+
+int main(int argc, char *argv[])
+{
+    test_arguments();
+    test_frames();
+
+    return test_end("glprofile");
+}
@@ -0,0 +1,860 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Tests of the GRF loaders. GRF files are generated with chunks compressed with
+// all the formats supported by the loaders, and they are loaded from memory,
+// from a FILE pointer and from a path. The results of all loaders must match
+// the original data, and loading from a file must not need more memory than
+// the destination buffers. The VRAM loaders are tested the same way, with
+// destinations in VRAM and palette RAM.
+//
+// With "-b" it measures the time and the peak memory needed to load a GRF file
+// from memory and from a file with each compression format.
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <nds/arm9/grf.h>
+#include <nds/arm9/video.h>
+#include <nds/decompress.h>
+#include <nds/memtrace.h>
+#include <nds/system.h>
+
+#include "../tools/lz16/lz16.h"
+#include "test.h"
+
+#define CHUNK_ID(a, b, c, d) \
+    ((uint32_t)((a) | ((b) << 8) | ((c) << 16) | ((d) << 24)))
+
+// Chunks of the GRF files, in the order used by grfLoadMemEx()
+enum
+{
+    ITEM_GFX,
+    ITEM_MAP,
+    ITEM_PAL,
+    ITEM_MTIL,
+    ITEM_MMAP,
+    ITEM_COUNT
+};
+
+static const uint32_t item_ids[ITEM_COUNT] = {
+    CHUNK_ID('G', 'F', 'X', ' '),
+    CHUNK_ID('M', 'A', 'P', ' '),
+    CHUNK_ID('P', 'A', 'L', ' '),
+    CHUNK_ID('M', 'T', 'I', 'L'),
+    CHUNK_ID('M', 'M', 'A', 'P'),
+};
+
+// Sizes of a 256x192 background with 8 bpp tiles. The size of the metatiles
+// isn't a multiple of 4 to test the padding at the end of chunks.
+static const size_t item_sizes[ITEM_COUNT] = {
+    256 * 192, 32 * 24 * 2, 256 * 2, 126, 8 * 6 * 2
+};
+
+typedef enum
+{
+    COMP_NONE,
+    COMP_LZ77,
+    COMP_RLE,
+    COMP_LZ16,
+    COMP_COUNT,
+
+    COMP_BROKEN // LZ16 data with a match before the start of the output
+} Compression;
+
+static const char *comp_names[COMP_COUNT] = {
+    "Uncompressed", "LZ77", "RLE", "LZ16"
+};
+
+static uint8_t items[ITEM_COUNT][256 * 192];
+static GRFHeader grf_header;
+
+#define MAX_GRF_SIZE (512 * 1024)
+
+static uint8_t grf[MAX_GRF_SIZE] __attribute__((aligned(4)));
+static size_t grf_size;
+
+// Data generators
+// ===============
+
+// Bitmap made of 8x8 tiles, like a background drawn with a tile editor.
+static void gen_tiles(uint8_t *buf, size_t size)
+{
+    uint8_t tiles[8][64];
+
+    for (int t = 0; t < 8; t++)
+    {
+        uint8_t colors[4];
+        for (int c = 0; c < 4; c++)
+            colors[c] = test_rand();
+
+        for (int i = 0; i < 64; i++)
+            tiles[t][i] = colors[test_rand() % 4];
+    }
+
+    for (size_t i = 0; i < size; i += 64)
+    {
+        const uint8_t *tile = tiles[(test_rand() & 3) ? 0 : (test_rand() % 8)];
+        size_t len = (size - i < 64) ? size - i : 64;
+        memcpy(&buf[i], tile, len);
+    }
+}
+
+static void gen_items(void)
+{
+    gen_tiles(items[ITEM_GFX], item_sizes[ITEM_GFX]);
+
+    for (int i = ITEM_MAP; i < ITEM_COUNT; i++)
+    {
+        for (size_t j = 0; j < item_sizes[i]; j++)
+            items[i][j] = (test_rand() & 1) ? 0 : test_rand();
+    }
+
+    grf_header = (GRFHeader){
+        .version = 2,
+        .gfxAttr = 8,
+        .mapAttr = 16,
+        .mmapAttr = 16,
+        .palAttr = 256,
+        .tileWidth = 8,
+        .tileHeight = 8,
+        .metaWidth = 4,
+        .metaHeight = 4,
+        .gfxWidth = 256,
+        .gfxHeight = 192,
+    };
+}
+
+// Compressors
+// ===========
+
+static void put_header(uint8_t *out, uint32_t type, size_t size)
+{
+    out[0] = type;
+    out[1] = size;
+    out[2] = size >> 8;
+    out[3] = size >> 16;
+}
+
+// LZ77 compressor for the BIOS format with a small window. It never uses a
+// distance of 1 so that the result can be decompressed to VRAM.
+static size_t lz77_compress(const uint8_t *in, size_t size, uint8_t *out)
+{
+    put_header(out, 0x10, size);
+
+    size_t o = 4;
+    size_t pos = 0;
+
+    while (pos < size)
+    {
+        size_t flags_pos = o++;
+        uint8_t flags = 0;
+
+        for (int b = 0; (b < 8) && (pos < size); b++)
+        {
+            size_t best_len = 0, best_disp = 0;
+            size_t max_len = size - pos < 18 ? size - pos : 18;
+
+            for (size_t disp = 2; (disp <= 256) && (disp <= pos); disp++)
+            {
+                size_t len = 0;
+                while ((len < max_len) && (in[pos - disp + len] == in[pos + len]))
+                    len++;
+
+                if (len > best_len)
+                {
+                    best_len = len;
+                    best_disp = disp;
+                    if (len == max_len)
+                        break;
+                }
+            }
+
+            if (best_len >= 3)
+            {
+                out[o++] = ((best_len - 3) << 4) | ((best_disp - 1) >> 8);
+                out[o++] = (best_disp - 1) & 0xFF;
+                flags |= 0x80 >> b;
+                pos += best_len;
+            }
+            else
+            {
+                out[o++] = in[pos++];
+            }
+        }
+
+        out[flags_pos] = flags;
+    }
+
+    return o;
+}
+
+static size_t rle_compress(const uint8_t *in, size_t size, uint8_t *out)
+{
+    put_header(out, 0x30, size);
+
+    size_t o = 4;
+    size_t pos = 0;
+
+    while (pos < size)
+    {
+        size_t run = 1;
+        while ((pos + run < size) && (run < 130) && (in[pos + run] == in[pos]))
+            run++;
+
+        if (run >= 3)
+        {
+            out[o++] = 0x80 | (run - 3);
+            out[o++] = in[pos];
+            pos += run;
+            continue;
+        }
+
+        // Literals until the next run of 3 bytes
+        size_t len = 0;
+        while ((pos + len < size) && (len < 128))
+        {
+            if ((pos + len + 2 < size) && (in[pos + len] == in[pos + len + 1])
+                && (in[pos + len] == in[pos + len + 2]))
+                break;
+            len++;
+        }
+
+        out[o++] = len - 1;
+        memcpy(&out[o], &in[pos], len);
+        o += len;
+        pos += len;
+    }
+
+    return o;
+}
+
+static size_t compress(Compression comp, const uint8_t *in, size_t size,
+                       uint8_t *out)
+{
+    switch (comp)
+    {
+        case COMP_NONE:
+            put_header(out, 0x00, size);
+            memcpy(out + 4, in, size);
+            return size + 4;
+        case COMP_LZ77:
+            return lz77_compress(in, size, out);
+        case COMP_RLE:
+            return rle_compress(in, size, out);
+        case COMP_LZ16:
+            return lz16_compress(in, size, out);
+        case COMP_BROKEN:
+            put_header(out, DECOMPRESS_TYPE_LZ16, size);
+            memcpy(out + 4, "\x10\x34\x12\x02\x00", 5);
+            return 9;
+        default:
+            return 0;
+    }
+}
+
+// GRF files
+// =========
+
+static uint8_t *put_chunk(uint8_t *out, uint32_t id, size_t size)
+{
+    memcpy(out, &id, 4);
+    uint32_t s = size;
+    memcpy(out + 4, &s, 4);
+    return out + 8;
+}
+
+// Builds a GRF file with the items in "order" (from 0 to "count" - 1), each one
+// compressed with the format in "comp". An unknown chunk is added before the
+// palette.
+static void build_grf(const int *order, int count, const Compression *comp)
+{
+    uint8_t *out = grf + 16;
+
+    out = put_chunk(out, CHUNK_ID('H', 'D', 'R', 'X'), sizeof(GRFHeader));
+    memcpy(out, &grf_header, sizeof(GRFHeader));
+    out += sizeof(GRFHeader);
+
+    for (int i = 0; i < count; i++)
+    {
+        int item = order[i];
+
+        if (item == ITEM_PAL)
+        {
+            out = put_chunk(out, CHUNK_ID('U', 'N', 'K', 'N'), 4);
+            memset(out, 0xAA, 4);
+            out += 4;
+        }
+
+        uint8_t *data = out + 8;
+        size_t size = compress(comp[item], items[item], item_sizes[item], data);
+        CHECK(size > 0);
+
+        // Chunks are padded to a multiple of 4 bytes
+        size_t padded = (size + 3) & ~3;
+        memset(data + size, 0xCC, padded - size);
+
+        put_chunk(out, item_ids[item], padded);
+        out = data + padded;
+    }
+
+    grf_size = out - grf;
+    CHECK(grf_size <= MAX_GRF_SIZE);
+
+    put_chunk(grf, CHUNK_ID('R', 'I', 'F', 'F'), grf_size - 8);
+    put_chunk(grf + 8, CHUNK_ID('G', 'R', 'F', ' '), grf_size - 16);
+}
+
+static const int default_order[ITEM_COUNT] = {
+    ITEM_GFX, ITEM_MAP, ITEM_PAL, ITEM_MTIL, ITEM_MMAP
+};
+
+static void build_grf_all(Compression comp)
+{
+    Compression c[ITEM_COUNT];
+    for (int i = 0; i < ITEM_COUNT; i++)
+        c[i] = comp;
+
+    build_grf(default_order, ITEM_COUNT, c);
+}
+
+static FILE *grf_to_file(void)
+{
+    FILE *f = tmpfile();
+    CHECK(f != NULL);
+    CHECK_EQ(fwrite(grf, 1, grf_size, f), grf_size);
+    rewind(f);
+    return f;
+}
+
+// Loaders
+// =======
+
+typedef enum
+{
+    LOAD_MEM,
+    LOAD_FILE,
+    LOAD_PATH,
+} LoadSource;
+
+typedef struct
+{
+    void *dst[ITEM_COUNT];
+    size_t size[ITEM_COUNT];
+    GRFHeader header;
+} LoadResult;
+
+static GRFError load(LoadSource source, LoadResult *r)
+{
+    void **d = r->dst;
+    size_t *s = r->size;
+
+    if (source == LOAD_MEM)
+    {
+        return grfLoadMemEx(grf, &r->header, &d[0], &s[0], &d[1], &s[1],
+                            &d[2], &s[2], &d[3], &s[3], &d[4], &s[4]);
+    }
+
+    if (source == LOAD_FILE)
+    {
+        FILE *f = grf_to_file();
+        GRFError ret = grfLoadFileEx(f, &r->header, &d[0], &s[0], &d[1], &s[1],
+                                     &d[2], &s[2], &d[3], &s[3], &d[4], &s[4]);
+        fclose(f);
+        return ret;
+    }
+
+    char path[] = "/tmp/test_grf_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    CHECK_EQ(write(fd, grf, grf_size), grf_size);
+    close(fd);
+
+    GRFError ret = grfLoadPathEx(path, &r->header, &d[0], &s[0], &d[1], &s[1],
+                                 &d[2], &s[2], &d[3], &s[3], &d[4], &s[4]);
+    unlink(path);
+    return ret;
+}
+
+// Destinations of the VRAM loaders. The map isn't aligned to 4 bytes.
+static void *const vram_dst[ITEM_COUNT] = {
+    (void *)0x06000000, (void *)0x06010002, (void *)0x05000000,
+    (void *)0x06020000, (void *)0x06030000
+};
+
+static GRFError load_vram(LoadSource source, LoadResult *r, unsigned int flags)
+{
+    void **d = r->dst;
+    size_t *s = r->size;
+
+    for (int i = 0; i < ITEM_COUNT; i++)
+    {
+        d[i] = vram_dst[i];
+        memset(d[i], 0, item_sizes[i]);
+    }
+
+    if (source == LOAD_MEM)
+    {
+        return grfLoadMemVramEx(grf, &r->header, d[0], &s[0], d[1], &s[1],
+                                d[2], &s[2], d[3], &s[3], d[4], &s[4], flags);
+    }
+
+    if (source == LOAD_FILE)
+    {
+        FILE *f = grf_to_file();
+        GRFError ret = grfLoadFileVramEx(f, &r->header, d[0], &s[0], d[1],
+                                         &s[1], d[2], &s[2], d[3], &s[3], d[4],
+                                         &s[4], flags);
+        fclose(f);
+        return ret;
+    }
+
+    char path[] = "/tmp/test_grf_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    CHECK_EQ(write(fd, grf, grf_size), grf_size);
+    close(fd);
+
+    GRFError ret = grfLoadPathVramEx(path, &r->header, d[0], &s[0], d[1], &s[1],
+                                     d[2], &s[2], d[3], &s[3], d[4], &s[4],
+                                     flags);
+    unlink(path);
+    return ret;
+}
+
+static bool result_matches(const LoadResult *r)
+{
+    bool ok = memcmp(&r->header, &grf_header, sizeof(GRFHeader)) == 0;
+
+    for (int i = 0; i < ITEM_COUNT; i++)
+    {
+        if ((r->dst[i] == NULL) || (r->size[i] != item_sizes[i]))
+            ok = false;
+        else if (memcmp(r->dst[i], items[i], item_sizes[i]) != 0)
+            ok = false;
+    }
+
+    return ok;
+}
+
+static void free_result(LoadResult *r)
+{
+    for (int i = 0; i < ITEM_COUNT; i++)
+    {
+        memTraceFree(r->dst[i]);
+        r->dst[i] = NULL;
+    }
+}
+
+static size_t total_items_size(void)
+{
+    size_t total = 0;
+    for (int i = 0; i < ITEM_COUNT; i++)
+        total += item_sizes[i];
+    return total;
+}
+
+// Tests
+// =====
+
+// All loaders must give the same result. The buffers are allocated by the
+// loaders, and they must not allocate anything else that is left allocated or
+// that increases the peak memory usage.
+static void test_load(void)
+{
+    for (int c = 0; c < COMP_COUNT; c++)
+    {
+        build_grf_all(c);
+
+        for (LoadSource source = LOAD_MEM; source <= LOAD_PATH; source++)
+        {
+            LoadResult r = { 0 };
+            MemTraceStats stats;
+
+            memTraceStart(0, 0);
+
+            CHECK_EQ(load(source, &r), GRF_NO_ERROR);
+            CHECK(result_matches(&r));
+
+            memTraceGetStats(MEMTRACE_TAG_GRF, &stats);
+            CHECK_EQ(stats.current, total_items_size());
+            CHECK_EQ(stats.peak, total_items_size());
+
+            free_result(&r);
+            memTraceStop();
+        }
+    }
+}
+
+// Chunks with different compression formats in the same file, in a different
+// order, loaded to buffers provided by the caller.
+static void test_mixed(void)
+{
+    static const int order[ITEM_COUNT] = {
+        ITEM_PAL, ITEM_MMAP, ITEM_GFX, ITEM_MTIL, ITEM_MAP
+    };
+    static uint8_t bufs[ITEM_COUNT][256 * 192];
+
+    for (int n = 0; n < 20; n++)
+    {
+        Compression comp[ITEM_COUNT];
+        for (int i = 0; i < ITEM_COUNT; i++)
+            comp[i] = test_rand() % COMP_COUNT;
+
+        build_grf(order, ITEM_COUNT, comp);
+
+        for (LoadSource source = LOAD_MEM; source <= LOAD_FILE; source++)
+        {
+            LoadResult r = { 0 };
+            for (int i = 0; i < ITEM_COUNT; i++)
+                r.dst[i] = bufs[i];
+
+            memset(bufs, 0, sizeof(bufs));
+            CHECK_EQ(load(source, &r), GRF_NO_ERROR);
+            CHECK(result_matches(&r));
+
+            for (int i = 0; i < ITEM_COUNT; i++)
+                CHECK(r.dst[i] == bufs[i]);
+        }
+    }
+}
+
+// Chunks that aren't requested are skipped
+static void test_skip(void)
+{
+    build_grf_all(COMP_LZ77);
+
+    void *gfx = NULL, *pal = NULL;
+    size_t gfx_size = 0, pal_size = 0;
+
+    CHECK_EQ(grfLoadMem(grf, NULL, &gfx, &gfx_size, NULL, NULL, &pal, &pal_size),
+             GRF_NO_ERROR);
+    CHECK(gfx != NULL && pal != NULL);
+    CHECK_EQ(gfx_size, item_sizes[ITEM_GFX]);
+    CHECK(memcmp(pal, items[ITEM_PAL], item_sizes[ITEM_PAL]) == 0);
+    memTraceFree(gfx);
+    memTraceFree(pal);
+
+    FILE *f = grf_to_file();
+    gfx = pal = NULL;
+    CHECK_EQ(grfLoadFile(f, NULL, &gfx, NULL, NULL, NULL, &pal, NULL),
+             GRF_NO_ERROR);
+    CHECK(memcmp(gfx, items[ITEM_GFX], item_sizes[ITEM_GFX]) == 0);
+    CHECK(memcmp(pal, items[ITEM_PAL], item_sizes[ITEM_PAL]) == 0);
+    memTraceFree(gfx);
+    memTraceFree(pal);
+    fclose(f);
+}
+
+static void test_errors(void)
+{
+    GRFHeader header;
+    void *gfx = NULL;
+
+    build_grf_all(COMP_NONE);
+
+    CHECK_EQ(grfLoadMem(NULL, &header, NULL, NULL, NULL, NULL, NULL, NULL),
+             GRF_NULL_POINTER);
+    CHECK_EQ(grfLoadPath("/nonexistent/file.grf", &header, NULL, NULL,
+                         NULL, NULL, NULL, NULL),
+             GRF_FILE_NOT_OPENED);
+
+    // Wrong IDs and sizes
+    grf[0] = 'X';
+    CHECK_EQ(grfLoadMem(grf, &header, NULL, NULL, NULL, NULL, NULL, NULL),
+             GRF_INVALID_ID_RIFF);
+    grf[0] = 'R';
+    grf[8] = 'X';
+    CHECK_EQ(grfLoadMem(grf, &header, NULL, NULL, NULL, NULL, NULL, NULL),
+             GRF_INVALID_ID_GRF);
+    grf[8] = 'G';
+    grf[4]++;
+    CHECK_EQ(grfLoadMem(grf, &header, NULL, NULL, NULL, NULL, NULL, NULL),
+             GRF_INCONSISTENT_SIZES);
+    FILE *f = grf_to_file();
+    CHECK_EQ(grfLoadFile(f, &header, NULL, NULL, NULL, NULL, NULL, NULL),
+             GRF_INCONSISTENT_SIZES);
+    fclose(f);
+    grf[4]--;
+
+    // Unknown compression format. The first chunk after the header is GFX.
+    uint8_t *gfx_data = grf + 16 + 8 + sizeof(GRFHeader) + 8;
+    gfx_data[0] = 0x40;
+    CHECK_EQ(grfLoadMem(grf, NULL, &gfx, NULL, NULL, NULL, NULL, NULL),
+             GRF_UNKNOWN_COMPRESSION);
+    CHECK(gfx == NULL);
+    f = grf_to_file();
+    CHECK_EQ(grfLoadFile(f, NULL, &gfx, NULL, NULL, NULL, NULL, NULL),
+             GRF_UNKNOWN_COMPRESSION);
+    CHECK(gfx == NULL);
+    fclose(f);
+    gfx_data[0] = 0x00;
+
+    // Truncated files
+    for (int c = 0; c < COMP_COUNT; c++)
+    {
+        build_grf_all(c);
+        size_t full_size = grf_size;
+        grf_size = 16 + 8 + sizeof(GRFHeader) + 8 + 100;
+
+        memTraceStart(0, 0);
+
+        f = grf_to_file();
+        CHECK_EQ(grfLoadFile(f, NULL, &gfx, NULL, NULL, NULL, NULL, NULL),
+                 GRF_FILE_NOT_READ);
+        CHECK(gfx == NULL);
+        fclose(f);
+
+        // The buffer allocated by the loader is freed
+        MemTraceStats stats;
+        memTraceGetStats(MEMTRACE_TAG_GRF, &stats);
+        CHECK_EQ(stats.current, 0);
+
+        memTraceStop();
+
+        grf_size = full_size;
+    }
+}
+
+// Compressed data that can't be decompressed is an error. The buffer of the
+// broken chunk is freed, the buffers of the previous chunks are kept.
+static void test_corrupted(void)
+{
+    for (int broken = 0; broken < ITEM_COUNT; broken++)
+    {
+        Compression comp[ITEM_COUNT];
+        for (int i = 0; i < ITEM_COUNT; i++)
+            comp[i] = (i == broken) ? COMP_BROKEN : COMP_LZ77;
+
+        build_grf(default_order, ITEM_COUNT, comp);
+
+        size_t loaded = 0;
+        for (int i = 0; i < broken; i++)
+            loaded += item_sizes[default_order[i]];
+
+        for (LoadSource source = LOAD_MEM; source <= LOAD_PATH; source++)
+        {
+            LoadResult r = { 0 };
+            MemTraceStats stats;
+
+            memTraceStart(0, 0);
+
+            CHECK_EQ(load(source, &r), GRF_INVALID_DATA);
+            CHECK(r.dst[broken] == NULL);
+
+            for (int i = 0; i < broken; i++)
+                CHECK(memcmp(r.dst[i], items[i], item_sizes[i]) == 0);
+
+            memTraceGetStats(MEMTRACE_TAG_GRF, &stats);
+            CHECK_EQ(stats.current, loaded);
+
+            free_result(&r);
+            memTraceStop();
+        }
+
+        // Buffers provided by the caller aren't freed
+        static uint8_t buf[256 * 192];
+        void *dst = buf;
+
+        if (broken == ITEM_GFX)
+        {
+            CHECK_EQ(grfLoadMem(grf, NULL, &dst, NULL, NULL, NULL, NULL, NULL),
+                     GRF_INVALID_DATA);
+            CHECK(dst == buf);
+        }
+    }
+}
+
+// The VRAM loaders only need temporary buffers to read uncompressed data from
+// files, and to decompress palettes that have to wait for the vertical blanking
+// period.
+static void test_vram(void)
+{
+    for (int c = 0; c < COMP_COUNT; c++)
+    {
+        build_grf_all(c);
+
+        for (LoadSource source = LOAD_MEM; source <= LOAD_PATH; source++)
+        {
+            for (unsigned int flags = 0; flags <= GRF_VRAM_PAL_WAIT_VBLANK;
+                 flags += GRF_VRAM_PAL_WAIT_VBLANK)
+            {
+                LoadResult r = { 0 };
+                MemTraceStats stats;
+
+                REG_DISPSTAT |= DISP_IN_VBLANK;
+                memTraceStart(0, 0);
+
+                CHECK_EQ(load_vram(source, &r, flags), GRF_NO_ERROR);
+                CHECK(result_matches(&r));
+
+                size_t peak = 0;
+                if ((source != LOAD_MEM) && (c == COMP_NONE))
+                    peak = 1024;
+                else if ((flags & GRF_VRAM_PAL_WAIT_VBLANK) && (c != COMP_NONE))
+                    peak = item_sizes[ITEM_PAL];
+
+                memTraceGetStats(MEMTRACE_TAG_GRF, &stats);
+                CHECK_EQ(stats.current, 0);
+                CHECK_EQ(stats.peak, peak);
+
+                memTraceStop();
+            }
+        }
+    }
+
+    // Broken compressed data
+    Compression comp[ITEM_COUNT] = {
+        COMP_LZ16, COMP_LZ77, COMP_BROKEN, COMP_RLE, COMP_NONE
+    };
+    build_grf(default_order, ITEM_COUNT, comp);
+
+    for (LoadSource source = LOAD_MEM; source <= LOAD_PATH; source++)
+    {
+        LoadResult r = { 0 };
+        MemTraceStats stats;
+
+        memTraceStart(0, 0);
+
+        CHECK_EQ(load_vram(source, &r, GRF_VRAM_PAL_WAIT_VBLANK),
+                 GRF_INVALID_DATA);
+        CHECK(memcmp(r.dst[ITEM_GFX], items[ITEM_GFX],
+                     item_sizes[ITEM_GFX]) == 0);
+
+        memTraceGetStats(MEMTRACE_TAG_GRF, &stats);
+        CHECK_EQ(stats.current, 0);
+
+        memTraceStop();
+    }
+}
+
+// Simulated start of the vertical blanking period
+static volatile bool vblank_thread_done;
+
+static void *vblank_thread(void *arg)
+{
+    (void)arg;
+
+    nanosleep(&(struct timespec){ 0, 20 * 1000 * 1000 }, NULL);
+
+    vblank_thread_done = true;
+    REG_DISPSTAT |= DISP_IN_VBLANK;
+
+    return NULL;
+}
+
+// With GRF_VRAM_PAL_WAIT_VBLANK the palette is only written when the vertical
+// blanking period starts, and the loader doesn't return before that.
+static void test_vram_wait(void)
+{
+    for (int c = 0; c < COMP_COUNT; c++)
+    {
+        build_grf_all(c);
+
+        for (LoadSource source = LOAD_MEM; source <= LOAD_FILE; source++)
+        {
+            LoadResult r = { 0 };
+            pthread_t thread;
+
+            REG_DISPSTAT &= ~DISP_IN_VBLANK;
+            vblank_thread_done = false;
+            pthread_create(&thread, NULL, vblank_thread, NULL);
+
+            CHECK_EQ(load_vram(source, &r, GRF_VRAM_PAL_WAIT_VBLANK),
+                     GRF_NO_ERROR);
+            CHECK(vblank_thread_done);
+            CHECK(result_matches(&r));
+
+            pthread_join(thread, NULL);
+        }
+    }
+
+    REG_DISPSTAT &= ~DISP_IN_VBLANK;
+}
+
+// Benchmarks
+// ==========
+
+static void bench(void)
+{
+    const int iterations = 100;
+
+    printf("Loading a 256x192 background (%zu bytes) on the host:\n",
+           total_items_size());
+    printf("  %-13s %8s %10s %10s %10s %10s\n", "", "Size", "Memory", "Peak",
+           "File", "Peak");
+
+    for (int c = 0; c < COMP_COUNT; c++)
+    {
+        build_grf_all(c);
+
+        double time[2];
+        size_t peak[2];
+
+        for (LoadSource source = LOAD_MEM; source <= LOAD_FILE; source++)
+        {
+            FILE *f = grf_to_file();
+            uint64_t total = 0;
+
+            for (int i = 0; i < iterations; i++)
+            {
+                LoadResult r = { 0 };
+                void **d = r.dst;
+                MemTraceStats stats;
+
+                rewind(f);
+                memTraceStart(0, 0);
+
+                uint64_t start = hostTimeNs();
+                if (source == LOAD_MEM)
+                {
+                    grfLoadMemEx(grf, &r.header, &d[0], NULL, &d[1], NULL,
+                                 &d[2], NULL, &d[3], NULL, &d[4], NULL);
+                }
+                else
+                {
+                    grfLoadFileEx(f, &r.header, &d[0], NULL, &d[1], NULL,
+                                  &d[2], NULL, &d[3], NULL, &d[4], NULL);
+                }
+                total += hostTimeNs() - start;
+
+                memTraceGetStats(MEMTRACE_TAG_GRF, &stats);
+                peak[source] = stats.peak;
+
+                free_result(&r);
+                memTraceStop();
+            }
+
+            fclose(f);
+            time[source] = (double)total / iterations / 1000.0;
+        }
+
+        printf("  %-13s %8zu %7.1f us %10zu %7.1f us %10zu\n", comp_names[c],
+               grf_size, time[LOAD_MEM], peak[LOAD_MEM], time[LOAD_FILE],
+               peak[LOAD_FILE]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    gen_items();
+
+    test_load();
+    test_mixed();
+    test_skip();
+    test_errors();
+    test_corrupted();
+    test_vram();
+    test_vram_wait();
+
+    if (test_bench_requested(argc, argv))
+        bench();
+
+    return test_end("grf");
+}
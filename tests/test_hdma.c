@@ -0,0 +1,299 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Tests of the HBlank DMA effects. The table generators are compared with
+// versions that use floating point numbers, and the DMA transfers started by
+// hdmaVBlank() are captured to check their parameters.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <nds/arm9/hdma.h>
+#include <nds/arm9/trig_lut.h>
+#include <nds/dma.h>
+#include <nds/memtrace.h>
+
+#include "test.h"
+
+#define ANGLE_TO_RADIANS(a) ((a) * (2 * M_PI / DEGREES_IN_CIRCLE))
+
+// DMA
+// ===
+
+static struct {
+    const void *src;
+    void *dest;
+    uint32_t ctrl;
+    bool stopped;
+} dma[4];
+
+void dmaSetParams(uint8_t channel, const void *src, void *dest, uint32_t ctrl)
+{
+    dma[channel].src = src;
+    dma[channel].dest = dest;
+    dma[channel].ctrl = ctrl;
+    dma[channel].stopped = false;
+}
+
+void dmaStopSafe(uint8_t channel)
+{
+    dma[channel].ctrl = 0;
+    dma[channel].stopped = true;
+}
+
+// Tests
+// =====
+
+static void test_effects(void)
+{
+    memTraceStart(0, 0);
+
+    // Scroll of a background: 4 bytes per line
+    static vu32 scroll_reg;
+    CHECK(hdmaStart(1, &scroll_reg, sizeof(bg_scroll)));
+
+    // Window bounds: 2 bytes per line
+    CHECK(hdmaStartWindow(2, WINDOW_1, true));
+
+    // Invalid arguments
+    CHECK(!hdmaStart(4, &scroll_reg, 4));
+    CHECK(!hdmaStart(1, &scroll_reg, 3));
+    CHECK(!hdmaStart(1, NULL, 4));
+    CHECK(hdmaGetBackBuffer(0) == NULL);
+
+    bg_scroll *scroll = hdmaGetBackBuffer(1);
+    u16 *window = hdmaGetBackBuffer(2);
+    CHECK(scroll != NULL && window != NULL);
+
+    for (int i = 0; i < HDMA_LINES; i++)
+    {
+        scroll[i].x = i;
+        scroll[i].y = 1000 + i;
+        window[i] = HDMA_WINDOW_BOUNDS(i, i + 10);
+    }
+
+    // Nothing is started until the first swap
+    dma[1].ctrl = dma[2].ctrl = 0xFFFFFFFF;
+    hdmaVBlank();
+    CHECK_EQ(dma[1].ctrl, 0xFFFFFFFF);
+    CHECK_EQ(dma[2].ctrl, 0xFFFFFFFF);
+
+    hdmaSwap(1);
+    hdmaSwap(2);
+
+    // The old front buffer is used until the next vertical blank
+    CHECK(hdmaGetBackBuffer(1) == NULL);
+
+    hdmaVBlank();
+
+    // The first line is written by the CPU, the DMA copies the rest
+    CHECK_EQ(scroll_reg, 0 | (1000 << 16));
+    CHECK(dma[1].src == &scroll[1]);
+    CHECK(dma[1].dest == (void *)&scroll_reg);
+    CHECK_EQ(dma[1].ctrl, DMA_ENABLE | DMA_START_HBL | DMA_REPEAT | DMA_DST_RESET
+                          | DMA_32_BIT | 1);
+
+    vu16 *win1h_sub = (vu16 *)0x04001042;
+    CHECK_EQ(*win1h_sub, HDMA_WINDOW_BOUNDS(0, 10));
+    CHECK(dma[2].src == &window[1]);
+    CHECK(dma[2].dest == (void *)win1h_sub);
+    CHECK_EQ(dma[2].ctrl, DMA_ENABLE | DMA_START_HBL | DMA_REPEAT | DMA_DST_RESET
+                          | DMA_16_BIT | 1);
+
+    // The front and back buffers are swapped
+    CHECK(hdmaGetBackBuffer(1) != NULL);
+    CHECK(hdmaGetBackBuffer(1) != scroll);
+
+    MemTraceStats stats;
+    memTraceGetStats(MEMTRACE_TAG_HDMA, &stats);
+    CHECK(stats.current > 0);
+
+    hdmaStop(1);
+    hdmaStop(2);
+    CHECK(dma[1].stopped && dma[2].stopped);
+    CHECK(hdmaGetBackBuffer(1) == NULL);
+
+    memTraceGetStats(MEMTRACE_TAG_HDMA, &stats);
+    CHECK_EQ(stats.current, 0);
+
+    memTraceStop();
+}
+
+static void test_wave(void)
+{
+    bg_scroll table[HDMA_LINES];
+
+    for (int n = 0; n < 200; n++)
+    {
+        int scroll_x = (int)(test_rand() % 512) - 256;
+        int scroll_y = test_rand() % 512;
+        int amplitude = test_rand() % 64;
+        int frequency = (int)(test_rand() % 2048) - 1024;
+        int phase = test_rand() % DEGREES_IN_CIRCLE;
+
+        hdmaGenWave(table, scroll_x, scroll_y, amplitude, frequency, phase);
+
+        for (int i = 0; i < HDMA_LINES; i++)
+        {
+            double ref = scroll_x + amplitude
+                       * sin(ANGLE_TO_RADIANS(phase + i * frequency));
+
+            // The offset is rounded down, and the interpolated sine adds a
+            // small error.
+            CHECK(fabs((int16_t)table[i].x - ref) < 1.1);
+            CHECK_EQ(table[i].y, scroll_y);
+        }
+    }
+}
+
+static void test_perspective(void)
+{
+    bg_transform table[HDMA_LINES];
+
+    for (int n = 0; n < 200; n++)
+    {
+        s32 cam_x = (test_rand() % 1024) << 8;
+        s32 cam_y = (test_rand() % 1024) << 8;
+        s32 height = (8 + test_rand() % 64) << 8;
+        int angle = test_rand() % DEGREES_IN_CIRCLE;
+        int horizon = test_rand() % 96;
+        int focal = 64 + test_rand() % 192;
+
+        hdmaGenPerspective(table, cam_x, cam_y, height, angle, horizon, focal);
+
+        double s = sin(ANGLE_TO_RADIANS(angle));
+        double c = cos(ANGLE_TO_RADIANS(angle));
+
+        for (int i = 0; i < HDMA_LINES; i++)
+        {
+            bg_transform *t = &table[i];
+            int dist = i - horizon;
+
+            CHECK_EQ(t->vdx, 0);
+            CHECK_EQ(t->vdy, 0);
+
+            if (dist <= 0)
+            {
+                CHECK_EQ(t->hdx, 0);
+                CHECK_EQ(t->hdy, 0);
+                CHECK_EQ(t->dx, cam_x);
+                CHECK_EQ(t->dy, cam_y);
+                continue;
+            }
+
+            // Map pixels per screen pixel and distance to the camera (20.8)
+            double lambda = (double)height / dist;
+            double z = lambda * focal;
+
+            double hdx = c * lambda;
+            double hdy = s * lambda;
+
+            // The point in front of the camera is z map pixels away from it.
+            // The left edge of the screen is half a screen to the left.
+            double dx = cam_x + s * z - hdx * (SCREEN_WIDTH / 2);
+            double dy = cam_y - c * z - hdy * (SCREEN_WIDTH / 2);
+
+            // The results are truncated, and the sine and cosine have an error
+            // of about 1/4096. The error of the step is multiplied by the
+            // number of pixels to the edge of the screen.
+            double step_error = 2.0 + lambda / 2048;
+            double pos_error = 2.0 + focal + z / 2048
+                             + step_error * (SCREEN_WIDTH / 2);
+
+            CHECK(fabs(t->hdx - hdx) <= step_error);
+            CHECK(fabs(t->hdy - hdy) <= step_error);
+            CHECK(fabs(t->dx - dx) <= pos_error);
+            CHECK(fabs(t->dy - dy) <= pos_error);
+        }
+    }
+}
+
+static void test_circle_window(void)
+{
+    u16 table[HDMA_LINES];
+
+    for (int n = 0; n < 200; n++)
+    {
+        int cx = (int)(test_rand() % 512) - 128;
+        int cy = (int)(test_rand() % 384) - 96;
+        int radius = test_rand() % 300;
+
+        hdmaGenCircleWindow(table, cx, cy, radius);
+
+        for (int i = 0; i < HDMA_LINES; i++)
+        {
+            int d = i - cy;
+            int left = 0, right = 0;
+
+            if (abs(d) < radius)
+            {
+                int half = (int)floor(sqrt((double)(radius * radius - d * d)));
+
+                left = cx - half;
+                right = cx + half;
+
+                if (left < 0)
+                    left = 0;
+                if (right > SCREEN_WIDTH)
+                    right = SCREEN_WIDTH;
+                if ((left == 0) && (right == SCREEN_WIDTH))
+                    right = SCREEN_WIDTH - 1;
+                if (left >= right)
+                    left = right = 0;
+            }
+
+            CHECK_EQ(table[i], HDMA_WINDOW_BOUNDS(left, right));
+
+            // A right edge of 0 must mean "until the end of the line"
+            if (((table[i] & 0xFF) == 0) && (table[i] != 0))
+                CHECK_EQ(right, SCREEN_WIDTH);
+        }
+    }
+}
+
+static void test_blend_gradient(void)
+{
+    u16 table[HDMA_LINES];
+
+    for (int eva_top = 0; eva_top <= 16; eva_top++)
+    {
+        for (int eva_bottom = 0; eva_bottom <= 16; eva_bottom++)
+        {
+            // Gradients that go up and down at the same time
+            int evb_top = 16 - eva_top;
+            int evb_bottom = 16 - eva_bottom;
+
+            hdmaGenBlendGradient(table, eva_top, evb_top, eva_bottom, evb_bottom);
+
+            CHECK_EQ(table[0], eva_top | (evb_top << 8));
+            CHECK_EQ(table[HDMA_LINES - 1], eva_bottom | (evb_bottom << 8));
+
+            for (int i = 0; i < HDMA_LINES; i++)
+            {
+                double t = (double)i / (HDMA_LINES - 1);
+                double eva = eva_top + (eva_bottom - eva_top) * t;
+                double evb = evb_top + (evb_bottom - evb_top) * t;
+
+                CHECK(fabs((table[i] & 0xFF) - eva) <= 0.5 + 1e-6);
+                CHECK(fabs((table[i] >> 8) - evb) <= 0.5 + 1e-6);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // The generators use the divider and square root units
+    hostEmulateMathUnits();
+
+    test_effects();
+    test_wave();
+    test_perspective();
+    test_circle_window();
+    test_blend_gradient();
+
+    return test_end("hdma");
+}
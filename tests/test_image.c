@@ -0,0 +1,389 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Tests of the image conversion functions. The results must be the same as the
+// ones of the previous per-pixel implementations, which are copied here, with
+// aligned and unaligned buffers, and when converting in place. PCX files are
+// generated with RLE runs and line padding and loaded with loadPCX().
+//
+// With "-b" it compares the time needed by the previous and new functions to
+// convert 256x192 images.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nds/arm9/image.h>
+#include <nds/arm9/pcx.h>
+#include <nds/arm9/video.h>
+#include <nds/memtrace.h>
+
+#include "test.h"
+
+#define WIDTH       256
+#define HEIGHT      192
+#define PIXELS      (WIDTH * HEIGHT)
+
+// Buffers with room for an offset to test unaligned accesses
+static u8 src_buf[PIXELS * 3 + 8] __attribute__((aligned(4)));
+static u16 dst_buf[PIXELS + 8] __attribute__((aligned(4)));
+static u16 ref_buf[PIXELS + 8] __attribute__((aligned(4)));
+static u16 palette[256];
+
+// Previous implementations
+// ------------------------
+
+static void old_convert24to16(u16 *dst, const u8 *src, int width, int height)
+{
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            dst[x + y * width] =
+                (1u << 15)
+                | RGB15(src[x * 3 + y * width * 3] >> 3,
+                        src[x * 3 + y * width * 3 + 1] >> 3,
+                        src[x * 3 + y * width * 3 + 2] >> 3);
+        }
+    }
+}
+
+static void old_convert8to16(u16 *dst, const u8 *src, const u16 *pal, int count)
+{
+    for (int i = 0; i < count; i++)
+        dst[i] = pal[src[i]] | (1u << 15);
+}
+
+static void old_convert8to16trans(u16 *dst, const u8 *src, const u16 *pal,
+                                  int count, u8 transparentColor)
+{
+    for (int i = 0; i < count; i++)
+    {
+        u8 c = src[i];
+
+        if (c != transparentColor)
+            dst[i] = pal[c] | (1u << 15);
+        else
+            dst[i] = pal[c];
+    }
+}
+
+static void old_tile8(u32 *dst, const u32 *src, int width, int height)
+{
+    int th = height >> 3;
+    int tw = width >> 3;
+    int i = 0;
+
+    for (int ty = 0; ty < th; ty++)
+    {
+        for (int tx = 0; tx < tw; tx++)
+        {
+            for (int iy = 0; iy < 8; iy++)
+            {
+                for (int ix = 0; ix < 2; ix++)
+                    dst[i++] = src[ix + tx * 2 + (iy + ty * 8) * tw * 2];
+            }
+        }
+    }
+}
+
+static void random_fill(void *buf, size_t size)
+{
+    u8 *p = buf;
+    for (size_t i = 0; i < size; i++)
+        p[i] = test_rand();
+}
+
+// Tests
+// =====
+
+static void test_convert24to16(void)
+{
+    for (int n = 0; n < 200; n++)
+    {
+        size_t count = (n == 0) ? PIXELS : test_rand() % 1000;
+        size_t src_off = test_rand() % 4;
+        size_t dst_off = test_rand() % 2;
+
+        random_fill(src_buf, sizeof(src_buf));
+        old_convert24to16(ref_buf, src_buf + src_off, count, 1);
+
+        dst_buf[dst_off + count] = 0x5555;
+        imageConvert24to16(dst_buf + dst_off, src_buf + src_off, count);
+        CHECK(memcmp(dst_buf + dst_off, ref_buf, count * sizeof(u16)) == 0);
+        CHECK_EQ(dst_buf[dst_off + count], 0x5555);
+
+        // In place
+        memmove(src_buf, src_buf + src_off, count * 3);
+        imageConvert24to16((u16 *)(void *)src_buf, src_buf, count);
+        CHECK(memcmp(src_buf, ref_buf, count * sizeof(u16)) == 0);
+    }
+}
+
+static void test_convert8to16(void)
+{
+    for (int n = 0; n < 200; n++)
+    {
+        size_t count = (n == 0) ? PIXELS : test_rand() % 1000;
+        size_t src_off = test_rand() % 4;
+        size_t dst_off = test_rand() % 2;
+        int trans = (n % 3) ? (int)(test_rand() % 256) : -1;
+
+        // Colors with and without the alpha bit set
+        random_fill(palette, sizeof(palette));
+        random_fill(src_buf, sizeof(src_buf));
+
+        if (trans < 0)
+            old_convert8to16(ref_buf, src_buf + src_off, palette, count);
+        else
+            old_convert8to16trans(ref_buf, src_buf + src_off, palette, count, trans);
+
+        dst_buf[dst_off + count] = 0x5555;
+        imageConvert8to16(dst_buf + dst_off, src_buf + src_off, palette, count, trans);
+        CHECK(memcmp(dst_buf + dst_off, ref_buf, count * sizeof(u16)) == 0);
+        CHECK_EQ(dst_buf[dst_off + count], 0x5555);
+
+        // In place, with the destination starting at the same address
+        u16 *inplace = (u16 *)(void *)src_buf;
+        memmove(src_buf, src_buf + src_off, count);
+        imageConvert8to16(inplace, src_buf, palette, count, trans);
+        CHECK(memcmp(inplace, ref_buf, count * sizeof(u16)) == 0);
+    }
+}
+
+static void test_tile8(void)
+{
+    for (int n = 0; n < 50; n++)
+    {
+        int width = 8 * (1 + test_rand() % 32);
+        int height = 8 * (1 + test_rand() % 24);
+
+        random_fill(src_buf, width * height);
+        old_tile8((u32 *)ref_buf, (const u32 *)src_buf, width, height);
+        imageTile8(dst_buf, src_buf, width, height);
+        CHECK(memcmp(dst_buf, ref_buf, width * height) == 0);
+    }
+}
+
+static void test_simage(void)
+{
+    MemTraceStats stats;
+    sImage img;
+
+    memTraceStart(0, 0);
+
+    // 24 bit
+    img.width = WIDTH;
+    img.height = HEIGHT;
+    img.bpp = 24;
+    img.palette = NULL;
+    img.image.data8 = memTraceMalloc(PIXELS * 3, MEMTRACE_TAG_IMAGE);
+    random_fill(img.image.data8, PIXELS * 3);
+    old_convert24to16(ref_buf, img.image.data8, WIDTH, HEIGHT);
+
+    CHECK(image24to16(&img));
+    CHECK_EQ(img.bpp, 16);
+    CHECK(memcmp(img.image.data16, ref_buf, PIXELS * sizeof(u16)) == 0);
+    memTraceGetStats(MEMTRACE_TAG_IMAGE, &stats);
+    CHECK_EQ(stats.current, PIXELS * sizeof(u16));
+    imageDestroy(&img);
+
+    // 8 bit, with and without a transparent color
+    for (int trans = -1; trans < 256; trans += 100)
+    {
+        img.bpp = 8;
+        img.image.data8 = memTraceMalloc(PIXELS, MEMTRACE_TAG_IMAGE);
+        img.palette = memTraceMalloc(256 * sizeof(u16), MEMTRACE_TAG_IMAGE);
+        random_fill(img.image.data8, PIXELS);
+        random_fill(img.palette, 256 * sizeof(u16));
+
+        if (trans < 0)
+        {
+            old_convert8to16(ref_buf, img.image.data8, img.palette, PIXELS);
+            CHECK(image8to16(&img));
+        }
+        else
+        {
+            old_convert8to16trans(ref_buf, img.image.data8, img.palette, PIXELS, trans);
+            CHECK(image8to16trans(&img, trans));
+        }
+
+        CHECK_EQ(img.bpp, 16);
+        CHECK(img.palette == NULL);
+        CHECK(memcmp(img.image.data16, ref_buf, PIXELS * sizeof(u16)) == 0);
+        memTraceGetStats(MEMTRACE_TAG_IMAGE, &stats);
+        CHECK_EQ(stats.current, PIXELS * sizeof(u16));
+        imageDestroy(&img);
+    }
+
+    // Tiling only needs one band of 8 rows of extra memory
+    memTraceStop();
+    memTraceStart(0, 0);
+
+    img.bpp = 8;
+    img.image.data8 = memTraceMalloc(PIXELS, MEMTRACE_TAG_IMAGE);
+    img.palette = NULL;
+    random_fill(img.image.data8, PIXELS);
+    old_tile8((u32 *)ref_buf, img.image.data32, WIDTH, HEIGHT);
+
+    CHECK(imageTileData(&img));
+    CHECK(memcmp(img.image.data8, ref_buf, PIXELS) == 0);
+    memTraceGetStats(MEMTRACE_TAG_IMAGE, &stats);
+    CHECK_EQ(stats.peak, PIXELS + WIDTH * 8);
+    imageDestroy(&img);
+
+    memTraceGetStats(MEMTRACE_TAG_IMAGE, &stats);
+    CHECK_EQ(stats.current, 0);
+    memTraceStop();
+}
+
+// Encodes an image as a PCX file. Runs are encoded with RLE, and lines are
+// padded to "pitch" bytes.
+static size_t make_pcx(u8 *out, const u8 *pixels, int width, int height,
+                       int pitch, const RGB_24 *pal)
+{
+    PCXHeader hdr = { 0 };
+    hdr.manufacturer = 10;
+    hdr.version = 5;
+    hdr.encoding = 1;
+    hdr.bitsPerPixel = 8;
+    hdr.xmax = width - 1;
+    hdr.ymax = height - 1;
+    hdr.colorPlanes = 1;
+    hdr.bytesPerLine = pitch;
+    memcpy(out, &hdr, sizeof(hdr));
+
+    size_t pos = sizeof(hdr);
+
+    for (int y = 0; y < height; y++)
+    {
+        int x = 0;
+        while (x < pitch)
+        {
+            u8 c = (x < width) ? pixels[y * width + x] : 0xEE;
+            int run = 1;
+            while ((x + run < pitch) && (run < 63)
+                   && (((x + run < width) ? pixels[y * width + x + run] : 0xEE) == c))
+                run++;
+
+            if ((run > 1) || (c >= 192))
+                out[pos++] = 192 + run;
+            out[pos++] = c;
+            x += run;
+        }
+    }
+
+    out[pos++] = 0x0C;
+    memcpy(out + pos, pal, 256 * sizeof(RGB_24));
+
+    return pos + 256 * sizeof(RGB_24);
+}
+
+static void test_pcx(void)
+{
+    static u8 file[sizeof(PCXHeader) + 2 * PIXELS + 2 * HEIGHT + 1 + 768];
+    static u8 pixels[PIXELS];
+    RGB_24 pal[256];
+
+    random_fill(pal, sizeof(pal));
+
+    for (int n = 0; n < 20; n++)
+    {
+        int width = 1 + test_rand() % WIDTH;
+        int height = 1 + test_rand() % HEIGHT;
+        int pitch = width + (test_rand() % 3) * (test_rand() % 64);
+        if (pitch > WIDTH)
+            pitch = WIDTH;
+        if (width > pitch)
+            width = pitch;
+
+        // Runs of random lengths, and single random pixels
+        for (int i = 0; i < width * height; )
+        {
+            u8 c = test_rand();
+            int run = (test_rand() & 1) ? 1 : 1 + test_rand() % 100;
+            while ((run-- > 0) && (i < width * height))
+                pixels[i++] = c;
+        }
+
+        size_t size = make_pcx(file, pixels, width, height, pitch, pal);
+        CHECK(size <= sizeof(file));
+
+        sImage img;
+        CHECK(loadPCX(file, &img));
+        CHECK_EQ(img.width, width);
+        CHECK_EQ(img.height, height);
+        CHECK_EQ(img.bpp, 8);
+        CHECK(memcmp(img.image.data8, pixels, width * height) == 0);
+
+        for (int i = 0; i < 256; i++)
+        {
+            int r = (pal[i].r + 4 > 255) ? 255 : pal[i].r + 4;
+            int g = (pal[i].g + 4 > 255) ? 255 : pal[i].g + 4;
+            int b = (pal[i].b + 4 > 255) ? 255 : pal[i].b + 4;
+            CHECK_EQ(img.palette[i], RGB15(r >> 3, g >> 3, b >> 3));
+        }
+
+        imageDestroy(&img);
+
+        // Files without the palette marker are rejected
+        file[size - 769] = 0;
+        CHECK(!loadPCX(file, &img));
+    }
+}
+
+// Benchmarks
+// ==========
+
+#define BENCH(name, old_expr, new_expr)                                     \
+    do {                                                                    \
+        uint64_t start_ = hostTimeNs();                                     \
+        for (int n = 0; n < iterations; n++)                                \
+            old_expr;                                                       \
+        uint64_t old_ = hostTimeNs() - start_;                              \
+        start_ = hostTimeNs();                                              \
+        for (int n = 0; n < iterations; n++)                                \
+            new_expr;                                                       \
+        uint64_t new_ = hostTimeNs() - start_;                              \
+        printf("  %-14s previous %7.1f us   new %7.1f us\n", name,          \
+               old_ / 1000.0 / iterations, new_ / 1000.0 / iterations);     \
+    } while (0)
+
+static void bench(void)
+{
+    const int iterations = 500;
+
+    random_fill(src_buf, sizeof(src_buf));
+    random_fill(palette, sizeof(palette));
+
+    printf("Converting a %dx%d image on the host:\n", WIDTH, HEIGHT);
+
+    BENCH("24 to 16 bit",
+          old_convert24to16(dst_buf, src_buf, WIDTH, HEIGHT),
+          imageConvert24to16(dst_buf, src_buf, PIXELS));
+    BENCH("8 to 16 bit",
+          old_convert8to16(dst_buf, src_buf, palette, PIXELS),
+          imageConvert8to16(dst_buf, src_buf, palette, PIXELS, -1));
+    BENCH("8 to 16 trans",
+          old_convert8to16trans(dst_buf, src_buf, palette, PIXELS, 0),
+          imageConvert8to16(dst_buf, src_buf, palette, PIXELS, 0));
+    BENCH("tiling",
+          old_tile8((u32 *)dst_buf, (const u32 *)src_buf, WIDTH, HEIGHT),
+          imageTile8(dst_buf, src_buf, WIDTH, HEIGHT));
+}
+
+int main(int argc, char *argv[])
+{
+    test_convert24to16();
+    test_convert8to16();
+    test_tile8();
+    test_simage();
+    test_pcx();
+
+    if (test_bench_requested(argc, argv))
+        bench();
+
+    return test_end("image");
+}
@@ -0,0 +1,373 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Tests of the binary log rings. The ARM7 is simulated by this file: it
+// receives the FIFO messages sent by the ARM9 and writes records to the ARM7
+// ring the same way as logRingWrite().
+//
+// The time needed to log a record must be well under a microsecond. With "-b"
+// it also compares the cost of logging a record and formatting it later with
+// the cost of formatting the text right away.
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <nds/fifocommon.h>
+#include <nds/fifomessages.h>
+#include <nds/logring.h>
+#include <nds/memtrace.h>
+#include <nds/system.h>
+
+#include "common/libnds_internal.h"
+#include "test.h"
+
+// Simulated ARM7
+// --------------
+
+static LogRingIpc *arm7_ring;
+static bool arm7_replies = true;
+
+bool fifoSendDatamsg(u32 channel, u32 num_bytes, u8 *data_array)
+{
+    FifoMessage msg;
+
+    CHECK_EQ(channel, FIFO_SYSTEM);
+    CHECK_EQ(num_bytes, sizeof(msg));
+    memcpy(&msg, data_array, sizeof(msg));
+    CHECK_EQ(msg.type, SYS_SET_ARM7_LOG_RING);
+
+    if (!arm7_replies)
+        return true;
+
+    // Same as logRingSetup() in the ARM7
+    if (arm7_ring != NULL)
+        arm7_ring->active = 0;
+
+    arm7_ring = msg.setArm7LogRing.buffer;
+
+    return true;
+}
+
+static bool arm7_log(uint16_t format_id, uint32_t arg)
+{
+    LogRingIpc *ring = arm7_ring;
+
+    if (ring->write_index - ring->read_index > ring->mask)
+    {
+        ring->dropped++;
+        return false;
+    }
+
+    LogRingRecord *r = &ring->records[ring->write_index & ring->mask];
+    r->timestamp = 0;
+    r->format_id = format_id;
+    r->info = (REG_VCOUNT & 0x1FF) | (1 << 12) | (1 << 15);
+    r->args[0] = arg;
+    ring->write_index++;
+
+    return true;
+}
+
+// Scanline counter, advanced by a thread while the ARM9 waits for the ARM7
+static volatile bool vcount_running;
+
+static void *vcount_thread(void *arg)
+{
+    (void)arg;
+
+    while (vcount_running)
+    {
+        REG_VCOUNT = (REG_VCOUNT + 1) % 263;
+        nanosleep(&(struct timespec){ 0, 1000 }, NULL);
+    }
+
+    return NULL;
+}
+
+// Tests
+// =====
+
+enum { LOG_NONE, LOG_ONE, LOG_TWO, LOG_FOUR, LOG_SIGNED, LOG_UNKNOWN = 10 };
+
+static const char *const formats[] = {
+    [LOG_NONE] = "none",
+    [LOG_ONE] = "one %u",
+    [LOG_TWO] = "two %u %u",
+    [LOG_FOUR] = "four %u %u %u %x",
+    [LOG_SIGNED] = "signed %d %d",
+};
+
+static void test_write_read(void)
+{
+    LogRingRecord r;
+
+    CHECK_EQ(logRingInit(5, 6), 0);
+    CHECK_EQ(logRingInit(5, 6), -1);
+    CHECK(arm7_ring != NULL);
+    CHECK_EQ(arm7_ring->mask, 7);
+
+    logRingSetFormats(formats, sizeof(formats) / sizeof(formats[0]));
+
+    REG_VCOUNT = 100;
+    hostTimerTicks = 1234;
+
+    LOG_RING(LOG_NONE);
+    LOG_RING(LOG_ONE, 1);
+    LOG_RING(LOG_TWO, 2, 3);
+    LOG_RING(LOG_FOUR, 4, 5, 6, 0xABCDEF);
+
+    int16_t s = -5;
+    int64_t big = 0x100000007;
+    LOG_RING(LOG_SIGNED, s, big);
+
+    CHECK(logRingRead(&r));
+    CHECK_EQ(r.format_id, LOG_NONE);
+    CHECK_EQ(LOG_RING_INFO_NARGS(r.info), 0);
+    CHECK_EQ(LOG_RING_INFO_VCOUNT(r.info), 100);
+    CHECK(!LOG_RING_INFO_ARM7(r.info));
+    CHECK_EQ(r.timestamp, 1234);
+
+    CHECK(logRingRead(&r));
+    CHECK_EQ(LOG_RING_INFO_NARGS(r.info), 1);
+    CHECK_EQ(r.args[0], 1);
+
+    CHECK(logRingRead(&r));
+    CHECK_EQ(LOG_RING_INFO_NARGS(r.info), 2);
+    CHECK(r.args[0] == 2 && r.args[1] == 3);
+
+    CHECK(logRingRead(&r));
+    CHECK_EQ(LOG_RING_INFO_NARGS(r.info), 4);
+    CHECK_EQ(r.args[3], 0xABCDEF);
+
+    CHECK(logRingRead(&r));
+    CHECK_EQ(r.args[0], (uint32_t)-5);
+    CHECK_EQ(r.args[1], 7);
+
+    CHECK(!logRingRead(&r));
+
+    // Extra arguments are ignored by logRingWrite()
+    uint32_t args[6] = { 1, 2, 3, 4, 5, 6 };
+    CHECK(logRingWrite(LOG_FOUR, args, 6));
+    CHECK(logRingRead(&r));
+    CHECK_EQ(LOG_RING_INFO_NARGS(r.info), 4);
+
+    // The ARM7 ring is read first
+    LOG_RING(LOG_ONE, 9);
+    arm7_log(LOG_ONE, 7);
+    CHECK(logRingRead(&r));
+    CHECK(LOG_RING_INFO_ARM7(r.info) && (r.args[0] == 7));
+    CHECK(logRingRead(&r));
+    CHECK(!LOG_RING_INFO_ARM7(r.info) && (r.args[0] == 9));
+    CHECK(!logRingRead(&r));
+}
+
+static void test_full(void)
+{
+    LogRingRecord r;
+
+    // The ARM9 ring has 8 records
+    for (uint32_t i = 0; i < 8; i++)
+        CHECK(logRingWrite(LOG_ONE, &i, 1));
+
+    uint32_t extra = 8;
+    CHECK(!logRingWrite(LOG_ONE, &extra, 1));
+    CHECK(!logRingWrite(LOG_ONE, &extra, 1));
+    CHECK_EQ(logRingDropped(), 2);
+
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        CHECK(logRingRead(&r));
+        CHECK_EQ(r.args[0], i);
+    }
+    CHECK(!logRingRead(&r));
+
+    // The indices wrap around correctly
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        CHECK(logRingWrite(LOG_ONE, &i, 1));
+        CHECK(logRingRead(&r));
+        CHECK_EQ(r.args[0], i);
+    }
+}
+
+static void test_format(void)
+{
+    char buf[200];
+    LogRingRecord r = {
+        .timestamp = 0x1234ABCD,
+        .format_id = LOG_TWO,
+        .info = 42 | (2 << 12) | (1 << 15),
+        .args = { 10, 20, 30, 40 },
+    };
+
+    int len = logRingFormat(&r, buf, sizeof(buf));
+    CHECK(strcmp(buf, "[7  42 1234ABCD] two 10 20") == 0);
+    CHECK_EQ(len, (int)strlen(buf));
+
+    r.format_id = LOG_UNKNOWN;
+    r.info = 5 | (1 << 12);
+    logRingFormat(&r, buf, sizeof(buf));
+    CHECK(strcmp(buf, "[9   5 1234ABCD] id 10 (1): 0000000A 00000000 00000000 00000000") == 0);
+
+    // Truncated output returns the full length
+    r.format_id = LOG_TWO;
+    r.info = 42 | (2 << 12);
+    len = logRingFormat(&r, buf, 10);
+    CHECK_EQ(strlen(buf), 9);
+    CHECK_EQ(len, (int)strlen("[9  42 1234ABCD] two 10 20"));
+
+    // Processing all records, with the dropped records first
+    for (uint32_t i = 0; i < 10; i++)
+        logRingWrite(LOG_ONE, &i, 1);
+    arm7_log(LOG_NONE, 0);
+
+    char out[2048] = { 0 };
+    FILE *f = fmemopen(out, sizeof(out), "w");
+    CHECK_EQ(logRingProcess(f), 9);
+    fclose(f);
+
+    CHECK(strncmp(out, "[9] 4 records dropped\n[7 ", 25) == 0);
+    CHECK(strstr(out, "] one 7\n") != NULL);
+    CHECK(strstr(out, "] one 8\n") == NULL);
+
+    // The counter is only reported once
+    memset(out, 0, sizeof(out));
+    f = fmemopen(out, sizeof(out), "w");
+    CHECK_EQ(logRingProcess(f), 0);
+    fclose(f);
+    CHECK_EQ(out[0], 0);
+}
+
+static void test_speed(void)
+{
+    const int batches = 1000;
+    uint64_t total = 0;
+    LogRingRecord r;
+
+    for (int n = 0; n < batches; n++)
+    {
+        uint64_t start = hostTimeNs();
+        for (uint32_t i = 0; i < 8; i++)
+            LOG_RING(LOG_FOUR, i, n, 3, 4);
+        total += hostTimeNs() - start;
+
+        while (logRingRead(&r))
+            ;
+    }
+
+    double ns = (double)total / (batches * 8);
+    printf("  LOG_RING() with 4 arguments: %.1f ns\n", ns);
+
+    // This includes the time needed to read the clock
+    CHECK(ns < 500);
+}
+
+static void test_exit(void)
+{
+    MemTraceStats stats;
+
+    // The ARM7 replies: both rings are freed
+    CHECK_EQ(logRingExit(), 0);
+    CHECK(arm7_ring == NULL);
+    CHECK(!logRingWrite(LOG_NONE, NULL, 0));
+
+    memTraceStart(0, 0);
+
+    CHECK_EQ(logRingInit(16, 16), 0);
+    memTraceGetStats(MEMTRACE_TAG_CONSOLE, &stats);
+    size_t both = stats.current;
+    CHECK(both > 0);
+
+    CHECK_EQ(logRingExit(), 0);
+    memTraceGetStats(MEMTRACE_TAG_CONSOLE, &stats);
+    CHECK_EQ(stats.current, 0);
+
+    // The ARM7 doesn't reply: the ARM9 gives up after a few frames and leaks
+    // the ARM7 ring.
+    CHECK_EQ(logRingInit(16, 16), 0);
+    LogRingIpc *stuck = arm7_ring;
+    arm7_replies = false;
+
+    pthread_t thread;
+    vcount_running = true;
+    pthread_create(&thread, NULL, vcount_thread, NULL);
+
+    CHECK_EQ(logRingExit(), -1);
+
+    vcount_running = false;
+    pthread_join(thread, NULL);
+
+    memTraceGetStats(MEMTRACE_TAG_CONSOLE, &stats);
+    CHECK_EQ(stats.current, both / 2);
+    CHECK(stuck->active);
+
+    // The simulated ARM7 will never use it
+    memTraceFree(stuck);
+
+    memTraceStop();
+
+    // The rings can be setup again
+    arm7_replies = true;
+    arm7_ring = NULL;
+    CHECK_EQ(logRingInit(4, 4), 0);
+    CHECK_EQ(logRingExit(), 0);
+}
+
+// Benchmarks
+// ==========
+
+static volatile int bench_sink;
+
+static void bench(void)
+{
+    const int batches = 100000;
+    LogRingRecord r;
+    char line[160];
+    uint64_t t_log = 0, t_format = 0, t_snprintf = 0;
+
+    logRingInit(0, 16);
+    logRingSetFormats(formats, sizeof(formats) / sizeof(formats[0]));
+
+    for (int n = 0; n < batches; n++)
+    {
+        uint64_t start = hostTimeNs();
+        for (uint32_t i = 0; i < 16; i++)
+            LOG_RING(LOG_FOUR, i, n, 3, 4);
+        t_log += hostTimeNs() - start;
+
+        start = hostTimeNs();
+        while (logRingRead(&r))
+            bench_sink += logRingFormat(&r, line, sizeof(line));
+        t_format += hostTimeNs() - start;
+
+        start = hostTimeNs();
+        for (uint32_t i = 0; i < 16; i++)
+            bench_sink += snprintf(line, sizeof(line), "four %u %u %u %x", i, n, 3, 4);
+        t_snprintf += hostTimeNs() - start;
+    }
+
+    logRingExit();
+
+    double count = (double)batches * 16;
+    printf("Time per record on the host:\n");
+    printf("  LOG_RING() %6.1f ns   logRingFormat() later %6.1f ns   snprintf() %6.1f ns\n",
+           t_log / count, t_format / count, t_snprintf / count);
+}
+
+int main(int argc, char *argv[])
+{
+    test_write_read();
+    test_full();
+    test_format();
+    test_speed();
+    test_exit();
+
+    if (test_bench_requested(argc, argv))
+        bench();
+
+    return test_end("logring");
+}
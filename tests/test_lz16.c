@@ -0,0 +1,357 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Tests of the LZ16 decoder of libnds using the compressor in tools/lz16.
+//
+// With "-b" it compares the compression ratio and decompression speed of LZ16
+// with LZ77. Both are decoded by decompressSoftware(), which produces the same
+// output as the BIOS. The speed of the BIOS can only be measured on hardware.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nds/decompress.h>
+
+#include "../tools/lz16/lz16.h"
+#include "test.h"
+
+#define MAX_SIZE (256 * 1024)
+
+static uint8_t data[MAX_SIZE];
+static uint8_t comp[MAX_SIZE * 2];
+static uint8_t out[MAX_SIZE + 4] __attribute__((aligned(4)));
+
+// Data generators
+// ===============
+
+static void gen_random(uint8_t *buf, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        buf[i] = test_rand();
+}
+
+// Bitmap made of 8x8 tiles, like a background drawn with a tile editor.
+static void gen_tiled_bitmap(uint8_t *buf, size_t width, size_t height,
+                             size_t bytes_per_pixel)
+{
+    uint16_t tiles[16][8][8];
+
+    for (int t = 0; t < 16; t++)
+    {
+        uint16_t palette[4];
+        for (int c = 0; c < 4; c++)
+            palette[c] = test_rand() & 0x7FFF;
+
+        for (int y = 0; y < 8; y++)
+            for (int x = 0; x < 8; x++)
+                tiles[t][y][x] = palette[test_rand() % 4];
+    }
+
+    for (size_t ty = 0; ty < height / 8; ty++)
+    {
+        for (size_t tx = 0; tx < width / 8; tx++)
+        {
+            // Most of the map uses a few tiles
+            int t = (test_rand() & 3) ? (test_rand() % 4) : (test_rand() % 16);
+
+            for (int y = 0; y < 8; y++)
+            {
+                for (int x = 0; x < 8; x++)
+                {
+                    size_t i = (ty * 8 + y) * width + tx * 8 + x;
+                    uint16_t color = tiles[t][y][x];
+
+                    if (bytes_per_pixel == 1)
+                    {
+                        buf[i] = color & 0xFF;
+                    }
+                    else
+                    {
+                        buf[i * 2] = color & 0xFF;
+                        buf[i * 2 + 1] = color >> 8;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void gen_mixed(uint8_t *buf, size_t size)
+{
+    size_t i = 0;
+
+    while (i < size)
+    {
+        size_t len = 1 + (test_rand() % 600);
+        if (len > size - i)
+            len = size - i;
+
+        switch (test_rand() % 4)
+        {
+            case 0: // Random data
+                gen_random(&buf[i], len);
+                break;
+            case 1: // Repeated value
+                memset(&buf[i], test_rand(), len);
+                break;
+            case 2: // Copy of previous data
+                if (i > 0)
+                {
+                    size_t from = test_rand() % i;
+                    for (size_t j = 0; j < len; j++)
+                        buf[i + j] = buf[from + j];
+                    break;
+                }
+                gen_random(&buf[i], len);
+                break;
+            case 3: // Small alphabet
+                for (size_t j = 0; j < len; j++)
+                    buf[i + j] = test_rand() % 4;
+                break;
+        }
+
+        i += len;
+    }
+}
+
+// Tests
+// =====
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+} StreamState;
+
+static size_t stream_read(void *buffer, size_t size, void *arg)
+{
+    StreamState *st = arg;
+
+    size_t n = (test_rand() % size) + 1;
+    if (n > st->size)
+        n = st->size;
+
+    memcpy(buffer, st->data, n);
+    st->data += n;
+    st->size -= n;
+
+    return n;
+}
+
+static void check_round_trip(const uint8_t *buf, size_t size)
+{
+    CHECK(lz16_compress_bound(size) <= sizeof(comp));
+
+    size_t comp_size = lz16_compress(buf, size, comp);
+    CHECK(comp_size > 0);
+    CHECK(comp_size <= lz16_compress_bound(size));
+
+    memset(out, 0xEE, sizeof(out));
+    CHECK_EQ(decompressSoftware(comp, out, LZ16), size);
+    CHECK(memcmp(buf, out, size) == 0);
+    CHECK_EQ(out[size], 0xEE);
+
+    memset(out, 0xEE, sizeof(out));
+    StreamState st = { comp, comp_size };
+    CHECK_EQ(decompressSoftwareStream(out, LZ16, stream_read, &st), size);
+    CHECK(memcmp(buf, out, size) == 0);
+    CHECK_EQ(st.size, 0);
+
+    // If the stream is cut short, the decoder must fail
+    if (comp_size > 4)
+    {
+        st = (StreamState){ comp, comp_size - 1 };
+        CHECK(decompressSoftwareStream(out, LZ16, stream_read, &st) < 0);
+    }
+}
+
+static void test_round_trip(void)
+{
+    // Sizes that are special for the length encoding (15 + 255 * n)
+    static const size_t special[] = { 0, 2, 4, 28, 30, 32, 34, 538, 540, 542 };
+
+    for (size_t i = 0; i < sizeof(special) / sizeof(special[0]); i++)
+    {
+        gen_random(data, special[i]);
+        check_round_trip(data, special[i]);
+
+        memset(data, 0x55, special[i]);
+        check_round_trip(data, special[i]);
+    }
+
+    for (int n = 0; n < 200; n++)
+    {
+        size_t size = (test_rand() % (MAX_SIZE / 4)) & ~1;
+
+        switch (n % 3)
+        {
+            case 0:
+                gen_random(data, size);
+                break;
+            case 1:
+                gen_mixed(data, size);
+                break;
+            case 2:
+                memset(data, 0, size);
+                break;
+        }
+
+        check_round_trip(data, size);
+    }
+
+    gen_tiled_bitmap(data, 256, 192, 2);
+    check_round_trip(data, 256 * 192 * 2);
+
+    // Odd sizes aren't supported
+    CHECK_EQ(lz16_compress(data, 3, comp), 0);
+}
+
+static void test_invalid(void)
+{
+    // Offset 0
+    static const uint8_t offset_zero[] = {
+        0x50, 0x08, 0x00, 0x00, // 8 bytes
+        0x10, 0x34, 0x12,       // 1 literal, match of 2 halfwords
+        0x00, 0x00,             // Offset 0
+    };
+    CHECK(decompressSoftware(offset_zero, out, LZ16) < 0);
+
+    // Offset before the start of the buffer
+    static const uint8_t offset_big[] = {
+        0x50, 0x08, 0x00, 0x00,
+        0x10, 0x34, 0x12,
+        0x02, 0x00,             // Offset 2
+    };
+    CHECK(decompressSoftware(offset_big, out, LZ16) < 0);
+
+    // Overlapping match, it's valid
+    static const uint8_t overlap[] = {
+        0x11, 0x34, 0x12,       // 1 literal, match of 3 halfwords
+        0x01, 0x00,             // Offset 1
+    };
+    uint8_t buf[sizeof(overlap) + 4];
+    buf[0] = 0x50;
+    buf[1] = 0x08;
+    buf[2] = 0;
+    buf[3] = 0;
+    memcpy(&buf[4], overlap, sizeof(overlap));
+    CHECK_EQ(decompressSoftware(buf, out, LZ16), 8);
+    CHECK(memcmp(out, "\x34\x12\x34\x12\x34\x12\x34\x12", 8) == 0);
+
+    // Wrong type in the header
+    buf[0] = 0x10;
+    CHECK(decompressSoftware(buf, out, LZ16) < 0);
+}
+
+// Benchmarks
+// ==========
+
+// Simple LZ77 compressor for the BIOS format. It never uses a distance of 1 so
+// that the result can also be decompressed to VRAM by the BIOS.
+static size_t lz77_compress(const uint8_t *in, size_t size, uint8_t *dst)
+{
+    dst[0] = 0x10;
+    dst[1] = size;
+    dst[2] = size >> 8;
+    dst[3] = size >> 16;
+
+    size_t o = 4;
+    size_t pos = 0;
+
+    while (pos < size)
+    {
+        size_t flags_pos = o++;
+        uint8_t flags = 0;
+
+        for (int b = 0; (b < 8) && (pos < size); b++)
+        {
+            size_t best_len = 0, best_disp = 0;
+            size_t max_len = size - pos < 18 ? size - pos : 18;
+
+            for (size_t disp = 2; (disp <= 4096) && (disp <= pos); disp++)
+            {
+                size_t len = 0;
+                while ((len < max_len) && (in[pos - disp + len] == in[pos + len]))
+                    len++;
+
+                if (len > best_len)
+                {
+                    best_len = len;
+                    best_disp = disp;
+                    if (len == max_len)
+                        break;
+                }
+            }
+
+            if (best_len >= 3)
+            {
+                dst[o++] = ((best_len - 3) << 4) | ((best_disp - 1) >> 8);
+                dst[o++] = (best_disp - 1) & 0xFF;
+                flags |= 0x80 >> b;
+                pos += best_len;
+            }
+            else
+            {
+                dst[o++] = in[pos++];
+            }
+        }
+
+        dst[flags_pos] = flags;
+    }
+
+    return o;
+}
+
+static double bench_decode(DecompressType type, size_t size)
+{
+    const int iterations = 200;
+
+    uint64_t start = hostTimeNs();
+    for (int i = 0; i < iterations; i++)
+        decompressSoftware(comp, out, type);
+    uint64_t t = hostTimeNs() - start;
+
+    return ((double)size * iterations / (1024 * 1024)) / (t / 1e9);
+}
+
+static void bench_data(const char *name, size_t size)
+{
+    size_t lz77_size = lz77_compress(data, size, comp);
+    double lz77_speed = bench_decode(LZ77Vram, size);
+    CHECK(memcmp(out, data, size) == 0);
+
+    size_t lz16_size = lz16_compress(data, size, comp);
+    double lz16_speed = bench_decode(LZ16, size);
+    CHECK(memcmp(out, data, size) == 0);
+
+    printf("  %-20s LZ77 %5.1f%% %8.1f MB/s   LZ16 %5.1f%% %8.1f MB/s\n", name,
+           100.0 * lz77_size / size, lz77_speed, 100.0 * lz16_size / size,
+           lz16_speed);
+}
+
+static void bench(void)
+{
+    printf("Compressed size and decompression speed on the host:\n");
+
+    gen_tiled_bitmap(data, 256, 192, 1);
+    bench_data("256x192 8 bpp tiles", 256 * 192);
+
+    gen_tiled_bitmap(data, 256, 192, 2);
+    bench_data("256x192 16 bpp tiles", 256 * 192 * 2);
+
+    gen_mixed(data, 128 * 1024);
+    bench_data("Mixed data", 128 * 1024);
+}
+
+int main(int argc, char *argv[])
+{
+    test_round_trip();
+    test_invalid();
+
+    if (test_bench_requested(argc, argv))
+        bench();
+
+    return test_end("lz16");
+}
@@ -0,0 +1,346 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Tests of the batch versions of the divider and square root functions. Their
+// results must be identical to the ones of the single value functions, and to
+// a reference implementation that doesn't use the (emulated) hardware units.
+//
+// With "-b" it compares the number of register accesses done by the batch
+// functions and by a loop of single value calls.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <nds/arm9/math.h>
+
+#include "test.h"
+
+#define COUNT   1024
+
+static int32_t num[COUNT + 1], den[COUNT + 1], res[COUNT + 1], ref[COUNT + 1];
+static int32_t vec[COUNT * 3 + 1], vec_ref[COUNT * 3 + 1];
+
+// Reference implementations
+// -------------------------
+
+// 64 by 32 bit division of the hardware, only the low 32 bits of the result
+static int32_t ref_divf32(int32_t n, int32_t d)
+{
+    if (d == 0)
+        return (n < 0) ? 1 : -1;
+
+    return (int32_t)(((int64_t)n * 4096) / d);
+}
+
+static uint32_t ref_sqrtf32(uint32_t a)
+{
+    uint64_t v = (uint64_t)a << 12;
+    uint64_t r = 0;
+
+    // Largest r such that r * r <= v
+    for (int bit = 31; bit >= 0; bit--)
+    {
+        uint64_t t = r | (1ull << bit);
+        if (t * t <= v)
+            r = t;
+    }
+
+    return r;
+}
+
+static void ref_normalizef32(int32_t *v)
+{
+    int64_t sq = 0;
+    for (int i = 0; i < 3; i++)
+        sq += ((int64_t)v[i] * v[i]) >> 12;
+
+    int32_t magnitude = ref_sqrtf32((uint32_t)sq);
+
+    for (int i = 0; i < 3; i++)
+        v[i] = ref_divf32(v[i], magnitude);
+}
+
+// Operands with a mix of small, big, negative and zero values
+static int32_t random_operand(void)
+{
+    switch (test_rand() % 8)
+    {
+        case 0:
+            return 0;
+        case 1:
+            return (int32_t)(test_rand() % 16) - 8;
+        case 2:
+            return (test_rand() & 1) ? INT32_MAX : INT32_MIN;
+        case 3:
+            return (int32_t)(test_rand() % (2 * 4096)) - 4096;
+        default:
+            return (int32_t)test_rand();
+    }
+}
+
+// Components small enough for the sum of squares to fit in 32 bits
+static int32_t random_component(void)
+{
+    if ((test_rand() % 16) == 0)
+        return 0;
+
+    int shift = test_rand() % 21;
+    return (int32_t)(test_rand() % (2u << shift)) - (1 << shift);
+}
+
+// Tests
+// =====
+
+static void test_divf32_array(void)
+{
+    for (int n = 0; n < 50; n++)
+    {
+        size_t count = test_rand() % (COUNT + 1);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            num[i] = random_operand();
+            den[i] = random_operand();
+        }
+
+        res[count] = 0x55555555;
+        divf32_array(res, num, den, count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            CHECK_EQ(res[i], ref_divf32(num[i], den[i]));
+            CHECK_EQ(res[i], divf32(num[i], den[i]));
+        }
+        CHECK_EQ(res[count], 0x55555555);
+
+        // In place
+        memcpy(ref, res, count * sizeof(int32_t));
+        divf32_array(num, num, den, count);
+        CHECK(memcmp(num, ref, count * sizeof(int32_t)) == 0);
+    }
+}
+
+static void test_reciprocal_array(void)
+{
+    for (int n = 0; n < 50; n++)
+    {
+        size_t count = test_rand() % (COUNT + 1);
+
+        for (size_t i = 0; i < count; i++)
+            den[i] = random_operand();
+
+        res[count] = 0x55555555;
+        reciprocal_array(res, den, count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            CHECK_EQ(res[i], ref_divf32(inttof32(1), den[i]));
+            CHECK_EQ(res[i], divf32(inttof32(1), den[i]));
+        }
+        CHECK_EQ(res[count], 0x55555555);
+
+        memcpy(ref, res, count * sizeof(int32_t));
+        reciprocal_array(den, den, count);
+        CHECK(memcmp(den, ref, count * sizeof(int32_t)) == 0);
+    }
+}
+
+static void test_sqrtf32_array(void)
+{
+    uint32_t *values = (uint32_t *)num;
+    uint32_t *results = (uint32_t *)res;
+
+    for (int n = 0; n < 50; n++)
+    {
+        size_t count = test_rand() % (COUNT + 1);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t v = test_rand();
+            if ((i % 4) == 0)
+                v >>= test_rand() % 32;
+            values[i] = v;
+        }
+        if (count > 1)
+        {
+            values[0] = 0;
+            values[1] = UINT32_MAX;
+        }
+
+        results[count] = 0x55555555;
+        sqrtf32_array(results, values, count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            CHECK_EQ(results[i], ref_sqrtf32(values[i]));
+            CHECK_EQ(results[i], sqrtf32(values[i]));
+        }
+        CHECK_EQ(results[count], 0x55555555);
+
+        memcpy(ref, results, count * sizeof(uint32_t));
+        sqrtf32_array(values, values, count);
+        CHECK(memcmp(values, ref, count * sizeof(uint32_t)) == 0);
+    }
+}
+
+static void test_normalizef32_array(void)
+{
+    for (int n = 0; n < 50; n++)
+    {
+        size_t count = test_rand() % (COUNT + 1);
+
+        for (size_t i = 0; i < count * 3; i++)
+            vec[i] = random_component();
+
+        memcpy(vec_ref, vec, count * 3 * sizeof(int32_t));
+        vec[count * 3] = 0x55555555;
+
+        normalizef32_array(vec, count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            int32_t single[3];
+            memcpy(single, &vec_ref[i * 3], sizeof(single));
+            normalizef32(single);
+
+            ref_normalizef32(&vec_ref[i * 3]);
+
+            for (int j = 0; j < 3; j++)
+            {
+                CHECK_EQ(vec[i * 3 + j], vec_ref[i * 3 + j]);
+                CHECK_EQ(vec[i * 3 + j], single[j]);
+            }
+        }
+        CHECK_EQ(vec[count * 3], 0x55555555);
+    }
+}
+
+// The batch functions must leave the units in a mode that the single value
+// functions can use.
+static void test_mixed_modes(void)
+{
+    int32_t a = inttof32(3), b = inttof32(2);
+
+    REG_DIVCNT = DIV_32_32;
+    divf32_array(res, &a, &b, 1);
+    CHECK_EQ(res[0], divf32(a, b));
+    CHECK_EQ(div32(7, 2), 3);
+    CHECK_EQ(divf32(a, b), floattof32(1.5));
+
+    REG_SQRTCNT = SQRT_32;
+    sqrtf32_array((uint32_t *)res, (const uint32_t *)&a, 1);
+    CHECK_EQ(sqrt32(49), 7);
+    CHECK_EQ(sqrtf32(inttof32(4)), inttof32(2));
+}
+
+// Benchmarks
+// ==========
+
+// The time needed on the host is dominated by the emulation of the units, so
+// this counts the accesses to the registers instead. Each access to the
+// hardware registers costs several cycles on a DS, and the batch functions
+// avoid the ones that aren't needed. Note that the host accesses 64-bit
+// registers with one instruction, and the ARM9 needs two.
+
+static void single_div(void)
+{
+    for (size_t i = 0; i < COUNT; i++)
+        res[i] = divf32(num[i], den[i]);
+}
+
+static void batch_div(void)
+{
+    divf32_array(res, num, den, COUNT);
+}
+
+static void single_reciprocal(void)
+{
+    for (size_t i = 0; i < COUNT; i++)
+        res[i] = divf32(inttof32(1), den[i]);
+}
+
+static void batch_reciprocal(void)
+{
+    reciprocal_array(res, den, COUNT);
+}
+
+static void single_sqrt(void)
+{
+    for (size_t i = 0; i < COUNT; i++)
+        res[i] = sqrtf32(num[i]);
+}
+
+static void batch_sqrt(void)
+{
+    sqrtf32_array((uint32_t *)res, (const uint32_t *)num, COUNT);
+}
+
+static void single_normalize(void)
+{
+    for (size_t i = 0; i < COUNT; i++)
+        normalizef32(&vec_ref[i * 3]);
+}
+
+static void batch_normalize(void)
+{
+    normalizef32_array(vec_ref, COUNT);
+}
+
+static double accesses_per_element(void (*fn)(void))
+{
+    memcpy(vec_ref, vec, sizeof(vec));
+
+    uint64_t start = hostIoAccesses;
+    fn();
+    return (double)(hostIoAccesses - start) / COUNT;
+}
+
+static void bench(void)
+{
+    static const struct {
+        const char *name;
+        void (*single)(void);
+        void (*batch)(void);
+    } ops[] = {
+        { "divf32", single_div, batch_div },
+        { "reciprocal", single_reciprocal, batch_reciprocal },
+        { "sqrtf32", single_sqrt, batch_sqrt },
+        { "normalizef32", single_normalize, batch_normalize },
+    };
+
+    for (size_t i = 0; i < COUNT; i++)
+    {
+        num[i] = random_operand();
+        den[i] = random_operand() | 1;
+        vec[i * 3] = random_component();
+        vec[i * 3 + 1] = random_component();
+        vec[i * 3 + 2] = random_component() | 1;
+    }
+
+    printf("Register accesses per element (the units are never busy on the host):\n");
+
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+    {
+        printf("  %-12s single %5.2f   batch %5.2f\n", ops[i].name,
+               accesses_per_element(ops[i].single),
+               accesses_per_element(ops[i].batch));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    hostEmulateMathUnits();
+
+    test_divf32_array();
+    test_reciprocal_array();
+    test_sqrtf32_array();
+    test_normalizef32_array();
+    test_mixed_modes();
+
+    if (test_bench_requested(argc, argv))
+        bench();
+
+    return test_end("math");
+}
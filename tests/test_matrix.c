@@ -0,0 +1,447 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Tests of the fixed point vector and matrix functions that run on the CPU.
+// Products must be exactly the ones of a reference that uses 128-bit integers.
+// Inverses and normalized vectors are checked against the expected properties
+// or a floating point reference with a small tolerance.
+//
+// matTransformPointsGX() needs the geometry engine, so it isn't tested here.
+//
+// With "-b" it compares the time needed to transform points with the batch
+// functions and with a loop of mulf32() calls.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nds/arm9/matrix.h>
+
+#include "test.h"
+
+#define NUM_POINTS  1000
+
+static GLvector points[NUM_POINTS], result[NUM_POINTS], expected[NUM_POINTS];
+static int32_t result4[NUM_POINTS * 4];
+
+// Reference implementations
+// -------------------------
+
+static int32_t ref_dot(const int32_t *a, const int32_t *b, int n)
+{
+    __int128 sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += (__int128)a[i] * b[i];
+    return (int32_t)(sum >> 12);
+}
+
+// Element (i, j) of the product of two matrices with "cols" columns, where
+// "rows" rows of b are used. The implicit last column of a 4x3 matrix is added
+// by the caller.
+static void ref_mul4x4(int32_t *r, const int32_t *a, const int32_t *b)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            int32_t col[4] = { b[j], b[4 + j], b[8 + j], b[12 + j] };
+            r[i * 4 + j] = ref_dot(&a[i * 4], col, 4);
+        }
+    }
+}
+
+// Extends a 4x3 matrix to 4x4
+static void to4x4(int32_t *r, const m4x3 *m)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 3; j++)
+            r[i * 4 + j] = m->m[i * 3 + j];
+        r[i * 4 + 3] = (i == 3) ? inttof32(1) : 0;
+    }
+}
+
+// Random values
+// -------------
+
+static int32_t rand_range(int32_t min, int32_t max)
+{
+    return min + (int32_t)(test_rand() % (uint32_t)(max - min + 1));
+}
+
+static void rand_vector(GLvector *v, int32_t range)
+{
+    v->x = rand_range(-range, range);
+    v->y = rand_range(-range, range);
+    v->z = rand_range(-range, range);
+}
+
+// Rotation around a random axis, random scale and random translation, so that
+// the matrix can be inverted.
+static void rand_transform(m4x3 *m, int32_t translation)
+{
+    int angle = test_rand() % DEGREES_IN_CIRCLE;
+    int32_t s = sinLerp(angle), c = cosLerp(angle);
+    int32_t scale = rand_range(inttof32(1) / 2, inttof32(2));
+
+    matIdentity4x3(m);
+
+    switch (test_rand() % 3)
+    {
+        case 0: // X axis
+            m->m[4] = c; m->m[5] = s;
+            m->m[7] = -s; m->m[8] = c;
+            break;
+        case 1: // Y axis
+            m->m[0] = c; m->m[2] = -s;
+            m->m[6] = s; m->m[8] = c;
+            break;
+        case 2: // Z axis
+            m->m[0] = c; m->m[1] = s;
+            m->m[3] = -s; m->m[4] = c;
+            break;
+    }
+
+    for (int i = 0; i < 9; i++)
+        m->m[i] = mulf32(m->m[i], scale);
+
+    m->m[9] = rand_range(-translation, translation);
+    m->m[10] = rand_range(-translation, translation);
+    m->m[11] = rand_range(-translation, translation);
+}
+
+static void rand_matrix4x4(m4x4 *m, int32_t range)
+{
+    for (int i = 0; i < 16; i++)
+        m->m[i] = rand_range(-range, range);
+}
+
+static bool near(int32_t a, int32_t b, int32_t tolerance)
+{
+    return abs(a - b) <= tolerance;
+}
+
+// Tests
+// =====
+
+static void test_vectors(void)
+{
+    for (int n = 0; n < 10000; n++)
+    {
+        GLvector a, b, r;
+        rand_vector(&a, inttof32(1000));
+        rand_vector(&b, inttof32(1000));
+
+        int32_t va[3] = { a.x, a.y, a.z };
+        int32_t vb[3] = { b.x, b.y, b.z };
+
+        vecAdd(&r, &a, &b);
+        CHECK(r.x == a.x + b.x && r.y == a.y + b.y && r.z == a.z + b.z);
+        vecSub(&r, &a, &b);
+        CHECK(r.x == a.x - b.x && r.y == a.y - b.y && r.z == a.z - b.z);
+
+        int32_t s = rand_range(-inttof32(4), inttof32(4));
+        vecScale(&r, &a, s);
+        CHECK_EQ(r.x, ref_dot(&va[0], &s, 1));
+        CHECK_EQ(r.z, ref_dot(&va[2], &s, 1));
+
+        CHECK_EQ(vecDot(&a, &b), ref_dot(va, vb, 3));
+
+        vecCross(&r, &a, &b);
+        int32_t cx[2] = { a.y, -a.z }, cx_b[2] = { b.z, b.y };
+        int32_t cy[2] = { a.z, -a.x }, cy_b[2] = { b.x, b.z };
+        int32_t cz[2] = { a.x, -a.y }, cz_b[2] = { b.y, b.x };
+        CHECK_EQ(r.x, ref_dot(cx, cx_b, 2));
+        CHECK_EQ(r.y, ref_dot(cy, cy_b, 2));
+        CHECK_EQ(r.z, ref_dot(cz, cz_b, 2));
+
+        // The length is the floor of the exact square root
+        __int128 sq = (__int128)a.x * a.x + (__int128)a.y * a.y
+                    + (__int128)a.z * a.z;
+        int64_t len = vecLength(&a);
+        CHECK(((__int128)len * len <= sq) && ((__int128)(len + 1) * (len + 1) > sq));
+
+        // Normalized vectors have length 1.0 and the same direction
+        r = a;
+        vecNormalize(&r);
+        if ((a.x | a.y | a.z) != 0)
+        {
+            CHECK(near(vecLength(&r), inttof32(1), 4));
+            CHECK((r.x >= 0) == (a.x >= 0) || (r.x == 0));
+            GLvector c;
+            vecCross(&c, &r, &a);
+            CHECK(near(vecLength(&c), 0, (vecLength(&a) >> 11) + 2));
+        }
+    }
+
+    GLvector zero = { 0, 0, 0 };
+    vecNormalize(&zero);
+    CHECK(zero.x == 0 && zero.y == 0 && zero.z == 0);
+}
+
+static void test_multiply(void)
+{
+    for (int n = 0; n < 10000; n++)
+    {
+        m4x4 a, b, r;
+        int32_t ref[16];
+
+        rand_matrix4x4(&a, inttof32(64));
+        rand_matrix4x4(&b, inttof32(64));
+
+        ref_mul4x4(ref, a.m, b.m);
+        matMultiply4x4(&r, &a, &b);
+        CHECK(memcmp(r.m, ref, sizeof(ref)) == 0);
+
+        // In place
+        matMultiply4x4(&a, &a, &b);
+        CHECK(memcmp(a.m, ref, sizeof(ref)) == 0);
+
+        m4x3 c, d, e;
+        int32_t c4[16], d4[16];
+        rand_transform(&c, inttof32(100));
+        rand_transform(&d, inttof32(100));
+        to4x4(c4, &c);
+        to4x4(d4, &d);
+        ref_mul4x4(ref, c4, d4);
+
+        matMultiply4x3(&e, &c, &d);
+        for (int i = 0; i < 4; i++)
+        {
+            for (int j = 0; j < 3; j++)
+                CHECK_EQ(e.m[i * 3 + j], ref[i * 4 + j]);
+        }
+
+        matMultiply4x3(&d, &c, &d);
+        CHECK(memcmp(d.m, e.m, sizeof(e.m)) == 0);
+    }
+
+    // The identity doesn't change anything
+    m4x4 a, id, r;
+    rand_matrix4x4(&a, inttof32(1000));
+    matIdentity4x4(&id);
+    matMultiply4x4(&r, &a, &id);
+    CHECK(memcmp(r.m, a.m, sizeof(a.m)) == 0);
+    matMultiply4x4(&r, &id, &a);
+    CHECK(memcmp(r.m, a.m, sizeof(a.m)) == 0);
+}
+
+static void test_transpose(void)
+{
+    m4x4 a, t, tt;
+    rand_matrix4x4(&a, inttof32(1000));
+    matTranspose4x4(&t, &a);
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+            CHECK_EQ(t.m[i * 4 + j], a.m[j * 4 + i]);
+    }
+    matTranspose4x4(&tt, &t);
+    CHECK(memcmp(tt.m, a.m, sizeof(a.m)) == 0);
+    matTranspose4x4(&t, &t);
+    CHECK(memcmp(t.m, a.m, sizeof(a.m)) == 0);
+
+    m3x3 b, u;
+    for (int i = 0; i < 9; i++)
+        b.m[i] = test_rand();
+    matTranspose3x3(&u, &b);
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+            CHECK_EQ(u.m[i * 3 + j], b.m[j * 3 + i]);
+    }
+    matTranspose3x3(&u, &u);
+    CHECK(memcmp(u.m, b.m, sizeof(b.m)) == 0);
+}
+
+// Inverse of a 4x3 matrix calculated with floating point numbers
+static void ref_inverse4x3(double *r, const m4x3 *m)
+{
+    const int *a = m->m;
+    double adj[9];
+
+    adj[0] = (double)a[4] * a[8] - (double)a[5] * a[7];
+    adj[1] = (double)a[2] * a[7] - (double)a[1] * a[8];
+    adj[2] = (double)a[1] * a[5] - (double)a[2] * a[4];
+    adj[3] = (double)a[5] * a[6] - (double)a[3] * a[8];
+    adj[4] = (double)a[0] * a[8] - (double)a[2] * a[6];
+    adj[5] = (double)a[2] * a[3] - (double)a[0] * a[5];
+    adj[6] = (double)a[3] * a[7] - (double)a[4] * a[6];
+    adj[7] = (double)a[1] * a[6] - (double)a[0] * a[7];
+    adj[8] = (double)a[0] * a[4] - (double)a[1] * a[3];
+
+    double det = a[0] * adj[0] + a[1] * adj[3] + a[2] * adj[6];
+
+    for (int i = 0; i < 9; i++)
+        r[i] = adj[i] * 4096 * 4096 / det;
+
+    for (int j = 0; j < 3; j++)
+        r[9 + j] = -(a[9] * r[j] + a[10] * r[3 + j] + a[11] * r[6 + j]) / 4096;
+}
+
+static void test_inverse(void)
+{
+    for (int n = 0; n < 2000; n++)
+    {
+        m4x3 m, inv, prod;
+        rand_transform(&m, inttof32((n & 1) ? 1000 : 100));
+
+        CHECK(matInverse4x3(&inv, &m));
+        matMultiply4x3(&prod, &m, &inv);
+
+        for (int i = 0; i < 9; i++)
+            CHECK(near(prod.m[i], ((i % 4) == 0) ? inttof32(1) : 0, 16));
+        for (int i = 9; i < 12; i++)
+            CHECK(near(prod.m[i], 0, 16));
+
+        // The general 4x4 inverse must be close to the exact inverse, also with
+        // big translations. Big values only have a small relative error.
+        m4x4 m4, inv4;
+        to4x4(m4.m, &m);
+
+        double ref[12];
+        ref_inverse4x3(ref, &m);
+
+        // In place
+        matInverse4x3(&m, &m);
+        CHECK(memcmp(m.m, inv.m, sizeof(m.m)) == 0);
+
+        CHECK(matInverse4x4(&inv4, &m4));
+
+        for (int i = 0; i < 4; i++)
+        {
+            for (int j = 0; j < 3; j++)
+                CHECK(fabs(inv4.m[i * 4 + j] - ref[i * 3 + j])
+                      < 2.0 + fabs(ref[i * 3 + j]) / (1 << 20));
+            CHECK(near(inv4.m[i * 4 + 3], (i == 3) ? inttof32(1) : 0, 1));
+        }
+
+        matInverse4x4(&m4, &m4);
+        CHECK(memcmp(m4.m, inv4.m, sizeof(m4.m)) == 0);
+    }
+
+    // Singular matrices
+    m4x3 zero = { 0 };
+    m4x3 out;
+    CHECK(!matInverse4x3(&out, &zero));
+
+    m4x4 flat;
+    matIdentity4x4(&flat);
+    flat.m[10] = 0; // Z scale of 0
+    m4x4 out4;
+    CHECK(!matInverse4x4(&out4, &flat));
+}
+
+static void test_transform(void)
+{
+    for (int n = 0; n < 100; n++)
+    {
+        m4x3 m;
+        rand_transform(&m, inttof32(100));
+
+        int32_t m4[16];
+        to4x4(m4, &m);
+
+        size_t count = test_rand() % (NUM_POINTS + 1);
+        for (size_t i = 0; i < count; i++)
+            rand_vector(&points[i], inttof32(500));
+
+        for (size_t i = 0; i < count; i++)
+        {
+            int32_t p[4] = { points[i].x, points[i].y, points[i].z, inttof32(1) };
+            int32_t col[3][4];
+            for (int j = 0; j < 3; j++)
+            {
+                for (int k = 0; k < 4; k++)
+                    col[j][k] = m4[k * 4 + j];
+            }
+            expected[i].x = ref_dot(p, col[0], 4);
+            expected[i].y = ref_dot(p, col[1], 4);
+            expected[i].z = ref_dot(p, col[2], 4);
+        }
+
+        matTransformPoints4x3(&m, points, result, count);
+        CHECK(memcmp(result, expected, count * sizeof(GLvector)) == 0);
+
+        // The 4x4 version returns the same values and w = 1.0
+        m4x4 mat4;
+        memcpy(mat4.m, m4, sizeof(m4));
+        matTransformPoints4x4(&mat4, points, result4, count);
+        for (size_t i = 0; i < count; i++)
+        {
+            CHECK_EQ(result4[i * 4 + 0], expected[i].x);
+            CHECK_EQ(result4[i * 4 + 1], expected[i].y);
+            CHECK_EQ(result4[i * 4 + 2], expected[i].z);
+            CHECK_EQ(result4[i * 4 + 3], inttof32(1));
+        }
+
+        // Normals ignore the translation
+        matTransformNormals4x3(&m, points, result, count);
+        for (size_t i = 0; i < count; i++)
+        {
+            int32_t p[3] = { points[i].x, points[i].y, points[i].z };
+            int32_t col[3] = { m.m[0], m.m[3], m.m[6] };
+            CHECK_EQ(result[i].x, ref_dot(p, col, 3));
+        }
+
+        // In place
+        matTransformPoints4x3(&m, points, points, count);
+        CHECK(memcmp(points, expected, count * sizeof(GLvector)) == 0);
+    }
+}
+
+// Benchmarks
+// ==========
+
+static void bench(void)
+{
+    const int iterations = 2000;
+    m4x3 m;
+    rand_transform(&m, inttof32(100));
+
+    for (size_t i = 0; i < NUM_POINTS; i++)
+        rand_vector(&points[i], inttof32(500));
+
+    uint64_t start = hostTimeNs();
+    for (int n = 0; n < iterations; n++)
+    {
+        const int *a = m.m;
+        for (size_t i = 0; i < NUM_POINTS; i++)
+        {
+            int32_t x = points[i].x, y = points[i].y, z = points[i].z;
+            result[i].x = mulf32(x, a[0]) + mulf32(y, a[3]) + mulf32(z, a[6]) + a[9];
+            result[i].y = mulf32(x, a[1]) + mulf32(y, a[4]) + mulf32(z, a[7]) + a[10];
+            result[i].z = mulf32(x, a[2]) + mulf32(y, a[5]) + mulf32(z, a[8]) + a[11];
+        }
+    }
+    uint64_t t_mulf32 = hostTimeNs() - start;
+
+    start = hostTimeNs();
+    for (int n = 0; n < iterations; n++)
+        matTransformPoints4x3(&m, points, result, NUM_POINTS);
+    uint64_t t_batch = hostTimeNs() - start;
+
+    printf("Transforming %d points by a 4x3 matrix on the host:\n", NUM_POINTS);
+    printf("  mulf32() loop %6.2f ns/point   matTransformPoints4x3() %6.2f ns/point\n",
+           (double)t_mulf32 / iterations / NUM_POINTS,
+           (double)t_batch / iterations / NUM_POINTS);
+}
+
+int main(int argc, char *argv[])
+{
+    hostEmulateMathUnits();
+
+    test_vectors();
+    test_multiply();
+    test_transpose();
+    test_inverse();
+    test_transform();
+
+    if (test_bench_requested(argc, argv))
+        bench();
+
+    return test_end("matrix");
+}
@@ -0,0 +1,273 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Tests of the allocation tracer and of the host tool that parses its records
+// (tools/memtrace).
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nds/memtrace.h>
+
+#include "test.h"
+
+#define PARSER "../tools/build/memtrace"
+
+// Lines sent to the no$gba console
+static char nocash_lines[16][64];
+static int nocash_count;
+
+void nocashWrite(const char *message, int len)
+{
+    if (nocash_count >= 16)
+        return;
+
+    if (len > 63)
+        len = 63;
+
+    memcpy(nocash_lines[nocash_count], message, len);
+    nocash_lines[nocash_count][len] = '\0';
+    nocash_count++;
+}
+
+// Runs the parser with a file and returns its output in a static buffer.
+static const char *run_parser(const char *path)
+{
+    static char output[8192];
+    char cmd[256];
+
+    snprintf(cmd, sizeof(cmd), PARSER " %s", path);
+
+    FILE *p = popen(cmd, "r");
+    if (p == NULL)
+        return "";
+
+    size_t len = fread(output, 1, sizeof(output) - 1, p);
+    output[len] = '\0';
+
+    if (pclose(p) != 0)
+        return "";
+
+    return output;
+}
+
+static void test_stats(void)
+{
+    CHECK(memTraceStart(16, 0));
+
+    void *a = memTraceMalloc(100, MEMTRACE_TAG_SPRITE);
+    void *b = memTraceCalloc(4, 50, MEMTRACE_TAG_SPRITE);
+    void *c = memTraceMemalign(32, 1000, MEMTRACE_TAG_CONSOLE);
+    CHECK((a != NULL) && (b != NULL) && (c != NULL));
+    CHECK(((uintptr_t)c & 31) == 0);
+
+    MemTraceStats s;
+
+    memTraceGetStats(MEMTRACE_TAG_SPRITE, &s);
+    CHECK_EQ(s.current, 300);
+    CHECK_EQ(s.peak, 300);
+    CHECK_EQ(s.allocations, 2);
+
+    memTraceFree(a);
+    a = memTraceRealloc(NULL, 10, MEMTRACE_TAG_SPRITE);
+    b = memTraceRealloc(b, 400, MEMTRACE_TAG_SPRITE);
+
+    memTraceGetStats(MEMTRACE_TAG_SPRITE, &s);
+    CHECK_EQ(s.current, 410);
+    CHECK_EQ(s.peak, 410);
+    CHECK_EQ(s.allocations, 4);
+    CHECK_EQ(s.frees, 2);
+
+    // An allocation that can't succeed
+    CHECK(memTraceMalloc(SIZE_MAX / 2, MEMTRACE_TAG_CONSOLE) == NULL);
+
+    memTraceGetStats(MEMTRACE_TAG_CONSOLE, &s);
+    CHECK_EQ(s.current, 1000);
+    CHECK_EQ(s.failures, 1);
+
+    memTraceGetStats(MEMTRACE_TAG_ALL, &s);
+    CHECK_EQ(s.current, 1410);
+    CHECK_EQ(s.peak, 1410);
+    CHECK_EQ(s.allocations, 5);
+
+    uint32_t histogram[MEMTRACE_HISTOGRAM_BUCKETS];
+    memTraceGetHistogram(histogram);
+    CHECK_EQ(histogram[3], 1); // 10
+    CHECK_EQ(histogram[6], 1); // 100
+    CHECK_EQ(histogram[7], 1); // 200
+    CHECK_EQ(histogram[8], 1); // 400
+    CHECK_EQ(histogram[9], 1); // 1000
+
+    memTraceFree(a);
+    memTraceFree(b);
+    memTraceFree(c);
+
+    memTraceGetStats(MEMTRACE_TAG_ALL, &s);
+    CHECK_EQ(s.current, 0);
+    CHECK_EQ(s.frees, 5);
+
+    memTraceStop();
+}
+
+// Blocks of other memory (like VRAM) are only accounted to their tag
+static void test_external(void)
+{
+    CHECK(memTraceStart(16, 0));
+
+    void *heap = memTraceMalloc(100, MEMTRACE_TAG_SPRITE);
+    const void *vram = (const void *)0x06400000;
+
+    memTraceRecordAlloc(vram, 2048, MEMTRACE_TAG_SPRITE);
+    memTraceRecordAlloc(NULL, 512, MEMTRACE_TAG_SPRITE);
+
+    MemTraceStats s;
+
+    memTraceGetStats(MEMTRACE_TAG_SPRITE, &s);
+    CHECK_EQ(s.current, 2148);
+    CHECK_EQ(s.allocations, 2);
+    CHECK_EQ(s.failures, 1);
+
+    memTraceGetStats(MEMTRACE_TAG_ALL, &s);
+    CHECK_EQ(s.current, 100);
+    CHECK_EQ(s.allocations, 1);
+    CHECK_EQ(s.failures, 0);
+
+    uint32_t histogram[MEMTRACE_HISTOGRAM_BUCKETS];
+    memTraceGetHistogram(histogram);
+    CHECK_EQ(histogram[11], 0);
+
+    memTraceRecordFree(vram);
+    memTraceFree(heap);
+
+    memTraceGetStats(MEMTRACE_TAG_SPRITE, &s);
+    CHECK_EQ(s.current, 0);
+    CHECK_EQ(s.frees, 2);
+
+    memTraceGetStats(MEMTRACE_TAG_ALL, &s);
+    CHECK_EQ(s.current, 0);
+    CHECK_EQ(s.frees, 1);
+
+    memTraceStop();
+}
+
+static void test_file_records(void)
+{
+    char path[] = "/tmp/test_memtrace_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+
+    FILE *f = fdopen(fd, "wb");
+
+    CHECK(memTraceStart(16, 0));
+    memTraceSetOutput(MEMTRACE_OUTPUT_FILE, f);
+
+    void *a = memTraceMalloc(64, MEMTRACE_TAG_GRF);
+    void *b = memTraceMalloc(128, MEMTRACE_TAG_GRF);
+    void *c = memTraceMalloc(512, MEMTRACE_TAG_FONT);
+    memTraceMalloc(SIZE_MAX / 2, MEMTRACE_TAG_FONT);
+    uint32_t b_addr = (uint32_t)(uintptr_t)b;
+    memTraceFree(b);
+
+    // This emits one leak record per live block (a and c)
+    FILE *null = fopen("/dev/null", "w");
+    memTraceReport(null);
+    fclose(null);
+
+    memTraceSetOutput(MEMTRACE_OUTPUT_NONE, NULL);
+    memTraceStop();
+    fclose(f);
+
+    uint32_t a_addr = (uint32_t)(uintptr_t)a;
+    free(a);
+    free(c);
+
+    // Check the raw records
+    f = fopen(path, "rb");
+    MemTraceRecord r[8];
+    size_t n = fread(r, sizeof(MemTraceRecord), 8, f);
+    fclose(f);
+
+    CHECK_EQ(n, 7);
+    CHECK_EQ(r[0].type, MEMTRACE_RECORD_ALLOC);
+    CHECK_EQ(r[0].tag, MEMTRACE_TAG_GRF);
+    CHECK_EQ(r[0].size, 64);
+    CHECK_EQ(r[0].ptr, a_addr);
+    CHECK_EQ(r[3].type, MEMTRACE_RECORD_FAILED);
+    CHECK_EQ(r[3].ptr, 0);
+    CHECK_EQ(r[4].type, MEMTRACE_RECORD_FREE);
+    CHECK_EQ(r[4].ptr, b_addr);
+    CHECK_EQ(r[5].type, MEMTRACE_RECORD_LEAK);
+    CHECK_EQ(r[6].type, MEMTRACE_RECORD_LEAK);
+
+    // Check the report of the parser
+    const char *out = run_parser(path);
+
+    CHECK(strstr(out, "records: 7\n") != NULL);
+    CHECK(strstr(out, "total: current 576 peak 704 allocs 3 frees 1 "
+                      "failures 1\n") != NULL);
+    CHECK(strstr(out, "  grf          current       64 peak      192 allocs"
+                      "      2 frees      1 failures 0\n") != NULL);
+    CHECK(strstr(out, "  font         current      512 peak      512 allocs"
+                      "      1 frees      0 failures 1\n") != NULL);
+    CHECK(strstr(out, "  2 blocks, 576 bytes (leak records)\n") != NULL);
+    CHECK(strstr(out, "      64+ : 1\n") != NULL);
+    CHECK(strstr(out, "     128+ : 1\n") != NULL);
+    CHECK(strstr(out, "     512+ : 1\n") != NULL);
+
+    remove(path);
+}
+
+static void test_nocash_records(void)
+{
+    CHECK(memTraceStart(16, 0));
+    memTraceSetOutput(MEMTRACE_OUTPUT_NOCASH, NULL);
+
+    nocash_count = 0;
+    void *a = memTraceMalloc(0x1234, MEMTRACE_TAG_HDMA);
+    uint32_t a_addr = (uint32_t)(uintptr_t)a;
+    memTraceFree(a);
+
+    memTraceSetOutput(MEMTRACE_OUTPUT_NONE, NULL);
+    memTraceStop();
+
+    CHECK_EQ(nocash_count, 2);
+
+    char expected[64];
+    snprintf(expected, sizeof(expected), "@MT:000A%08X00001234", a_addr);
+    CHECK(strncmp(nocash_lines[0], expected, strlen(expected)) == 0);
+    CHECK_EQ(strlen(nocash_lines[0]), 4 + 2 + 2 + 8 + 8 + 8);
+
+    snprintf(expected, sizeof(expected), "@MT:010A%08X", a_addr);
+    CHECK(strncmp(nocash_lines[1], expected, strlen(expected)) == 0);
+
+    // The parser must accept the same lines inside of an emulator log, and it
+    // reports the block as not freed because there are no leak records.
+    char path[] = "/tmp/test_memtrace_XXXXXX";
+    int fd = mkstemp(path);
+    FILE *f = fdopen(fd, "w");
+    fprintf(f, "Some other message\n");
+    fprintf(f, "[ARM9] %s\n", nocash_lines[0]);
+    fclose(f);
+
+    const char *out = run_parser(path);
+    CHECK(strstr(out, "records: 1\n") != NULL);
+    CHECK(strstr(out, "  1 blocks, 4660 bytes not freed at the end of the "
+                      "log\n") != NULL);
+
+    remove(path);
+}
+
+int main(int argc, char *argv[])
+{
+    test_stats();
+    test_external();
+    test_file_records();
+    test_nocash_records();
+
+    return test_end("memtrace");
+}
@@ -0,0 +1,314 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Tests of oamUpdate() with and without dirty tracking and the double buffer.
+// DMA transfers are emulated by host.c, and the vertical blank period is
+// simulated by calling hostDmaVBlank().
+//
+// With "-b" it measures the time needed by oamUpdate() depending on the number
+// of entries that have changed since the previous update.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <nds/arm9/sprite.h>
+#include <nds/dma.h>
+#include <nds/memtrace.h>
+
+#include "test.h"
+
+#define OAM_BYTES   (SPRITE_COUNT * sizeof(SpriteEntry))
+#define POISON      0xDEADBEEF
+
+static SpriteEntry *hw_oam(void)
+{
+    return (SpriteEntry *)OAM;
+}
+
+static bool oam_matches_shadow(void)
+{
+    return memcmp(hw_oam(), oamMain.oamMemory, OAM_BYTES) == 0;
+}
+
+static bool dirty_is_clear(void)
+{
+    for (int i = 0; i < SPRITE_COUNT / 32; i++)
+    {
+        if (oamMain.dirty[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+// Modifies an entry with the oam*() functions or directly
+static void change_entry(int id)
+{
+    switch (test_rand() % 5)
+    {
+        case 0:
+            oamSetXY(&oamMain, id, test_rand() % 256, test_rand() % 192);
+            break;
+        case 1:
+            oamSetPalette(&oamMain, id, test_rand() % 16);
+            break;
+        case 2:
+            oamSetFlip(&oamMain, id, test_rand() & 1, test_rand() & 1);
+            break;
+        case 3:
+            oamRotateScale(&oamMain, test_rand() % 32, test_rand() % 32768,
+                           256 + (test_rand() % 256), 256);
+            break;
+        case 4:
+            oamMain.oamMemory[id].attribute[2] = test_rand();
+            oamMarkDirty(&oamMain, id);
+            break;
+    }
+}
+
+// Tests
+// =====
+
+static void test_init(void)
+{
+    memset(hw_oam(), 0xFF, OAM_BYTES);
+
+    oamInit(&oamMain, SpriteMapping_1D_128, false);
+
+    CHECK(oam_matches_shadow());
+    CHECK(dirty_is_clear());
+    for (int i = 0; i < SPRITE_COUNT; i++)
+        CHECK(hw_oam()[i].isHidden);
+
+    // Make all sprites visible so that they can be modified by change_entry()
+    for (int i = 0; i < SPRITE_COUNT; i++)
+    {
+        oamSet(&oamMain, i, i, i, 0, 0, SpriteSize_16x16,
+               SpriteColorFormat_16Color, SPRITE_GFX, -1, false, false, false,
+               false, false);
+    }
+}
+
+static void test_full_copy(void)
+{
+    oamSetDirtyTracking(&oamMain, false);
+
+    for (int n = 0; n < 100; n++)
+    {
+        // Entries that haven't been marked must be copied too
+        oamMain.oamMemory[test_rand() % SPRITE_COUNT].attribute[1] = test_rand();
+        change_entry(test_rand() % SPRITE_COUNT);
+
+        oamUpdate(&oamMain);
+
+        CHECK(oam_matches_shadow());
+        CHECK(dirty_is_clear());
+    }
+}
+
+static void test_dirty_tracking(void)
+{
+    // Enabling tracking marks everything, so the first update is complete
+    oamMain.oamMemory[5].attribute[1] = 0x1234;
+    oamSetDirtyTracking(&oamMain, true);
+    oamUpdate(&oamMain);
+    CHECK(oam_matches_shadow());
+    CHECK(dirty_is_clear());
+
+    for (int n = 0; n < 1000; n++)
+    {
+        // Write a value to the hardware OAM that must only be overwritten if
+        // the entry is modified.
+        int canary = test_rand() % SPRITE_COUNT;
+        ((u32 *)&hw_oam()[canary])[0] = POISON;
+
+        int changes = test_rand() % 40;
+        for (int i = 0; i < changes; i++)
+            change_entry(test_rand() % SPRITE_COUNT);
+
+        // Affine matrices are spread over 4 entries, so the canary may have
+        // been modified even if its index hasn't been used.
+        bool touched = (oamMain.dirty[canary >> 5] & BIT(canary & 31)) != 0;
+
+        oamUpdate(&oamMain);
+
+        CHECK(dirty_is_clear());
+
+        if (touched)
+        {
+            CHECK(oam_matches_shadow());
+        }
+        else
+        {
+            CHECK_EQ(((u32 *)&hw_oam()[canary])[0], POISON);
+            ((u32 *)&hw_oam()[canary])[0] = ((u32 *)&oamMain.oamMemory[canary])[0];
+            CHECK(oam_matches_shadow());
+        }
+    }
+
+    // Runs of all lengths and at all positions
+    for (int first = 0; first < SPRITE_COUNT; first += 7)
+    {
+        for (int len = 1; first + len <= SPRITE_COUNT; len += 5)
+        {
+            memset(hw_oam(), 0, OAM_BYTES);
+            for (int i = first; i < first + len; i++)
+                oamMain.oamMemory[i].attribute[2] = test_rand();
+            oamMarkDirtyRange(&oamMain, first, len);
+
+            oamUpdate(&oamMain);
+
+            for (int i = 0; i < SPRITE_COUNT; i++)
+            {
+                bool in_run = (i >= first) && (i < first + len);
+                SpriteEntry zero = { 0 };
+                const SpriteEntry *ref = in_run ? &oamMain.oamMemory[i] : &zero;
+                CHECK(memcmp(&hw_oam()[i], ref, sizeof(SpriteEntry)) == 0);
+            }
+        }
+    }
+
+    // Leave the hardware OAM in sync for the next tests
+    oamMarkDirtyRange(&oamMain, 0, SPRITE_COUNT);
+    oamUpdate(&oamMain);
+    CHECK(oam_matches_shadow());
+}
+
+static void test_double_buffer(bool tracking)
+{
+    MemTraceStats stats;
+
+    oamSetDirtyTracking(&oamMain, tracking);
+
+    memTraceStart(0, 0);
+    CHECK(oamEnableDoubleBuffer(&oamMain, 2));
+    memTraceGetStats(MEMTRACE_TAG_SPRITE, &stats);
+    CHECK_EQ(stats.current, OAM_BYTES);
+
+    // The front buffer starts with the current state of OAM
+    CHECK(memcmp(oamMain.frontBuffer, hw_oam(), OAM_BYTES) == 0);
+
+    for (int n = 0; n < 200; n++)
+    {
+        SpriteEntry before[SPRITE_COUNT];
+        memcpy(before, hw_oam(), sizeof(before));
+
+        int changes = 1 + test_rand() % 20;
+        for (int i = 0; i < changes; i++)
+            change_entry(test_rand() % SPRITE_COUNT);
+
+        SpriteEntry expected[SPRITE_COUNT];
+        memcpy(expected, oamMain.oamMemory, sizeof(expected));
+
+        oamUpdate(&oamMain);
+        CHECK(dirty_is_clear());
+
+        // Nothing is sent to OAM before the vertical blank period
+        CHECK(memcmp(hw_oam(), before, sizeof(before)) == 0);
+
+        // Changes done after oamUpdate() must not be sent
+        change_entry(test_rand() % SPRITE_COUNT);
+
+        hostDmaVBlank();
+        CHECK(memcmp(hw_oam(), expected, sizeof(expected)) == 0);
+
+        // The transfer is only done once
+        CHECK_EQ(DMA_CR(2) & DMA_ENABLE, 0);
+    }
+
+    // Calling oamUpdate() twice in the same frame sends the latest state
+    change_entry(10);
+    oamUpdate(&oamMain);
+    change_entry(20);
+    oamUpdate(&oamMain);
+    hostDmaVBlank();
+    CHECK(oam_matches_shadow());
+
+    // Pending updates are cancelled when the double buffer is disabled
+    SpriteEntry before[SPRITE_COUNT];
+    memcpy(before, hw_oam(), sizeof(before));
+    oamSetXY(&oamMain, 30, 1, 2);
+    oamUpdate(&oamMain);
+    oamDisableDoubleBuffer(&oamMain);
+    hostDmaVBlank();
+    CHECK(memcmp(hw_oam(), before, sizeof(before)) == 0);
+    CHECK(oamMain.frontBuffer == NULL);
+    CHECK_EQ(oamMain.doubleBufferDma, -1);
+
+    memTraceGetStats(MEMTRACE_TAG_SPRITE, &stats);
+    CHECK_EQ(stats.current, 0);
+    memTraceStop();
+
+    // The cancelled update is sent by the next call to oamUpdate()
+    oamUpdate(&oamMain);
+    CHECK(oam_matches_shadow());
+}
+
+// Benchmarks
+// ==========
+
+static void bench_ratio(int changes, bool scattered)
+{
+    const int iterations = 20000;
+    uint64_t t[2];
+
+    for (int mode = 0; mode < 2; mode++)
+    {
+        oamSetDirtyTracking(&oamMain, mode == 1);
+        oamUpdate(&oamMain);
+
+        uint64_t total = 0;
+        for (int n = 0; n < iterations; n++)
+        {
+            int first = test_rand() % SPRITE_COUNT;
+            for (int i = 0; i < changes; i++)
+            {
+                int id = scattered ? (int)(test_rand() % SPRITE_COUNT)
+                                   : (first + i) % SPRITE_COUNT;
+                oamMain.oamMemory[id].x = n;
+                oamMarkDirty(&oamMain, id);
+            }
+
+            uint64_t start = hostTimeNs();
+            oamUpdate(&oamMain);
+            total += hostTimeNs() - start;
+        }
+
+        t[mode] = total;
+    }
+
+    printf("  %3d entries %-10s full copy %7.1f ns   dirty %7.1f ns\n",
+           changes, scattered ? "scattered" : "contiguous",
+           (double)t[0] / iterations, (double)t[1] / iterations);
+}
+
+static void bench(void)
+{
+    static const int changes[] = { 0, 1, 13, 32, 64, 128 };
+
+    printf("oamUpdate() on the host (the full copy uses the emulated DMA):\n");
+
+    for (size_t i = 0; i < sizeof(changes) / sizeof(changes[0]); i++)
+    {
+        bench_ratio(changes[i], false);
+        if ((changes[i] > 1) && (changes[i] < SPRITE_COUNT))
+            bench_ratio(changes[i], true);
+    }
+
+    oamSetDirtyTracking(&oamMain, false);
+}
+
+int main(int argc, char *argv[])
+{
+    test_init();
+    test_full_copy();
+    test_dirty_tracking();
+    test_double_buffer(false);
+    test_double_buffer(true);
+
+    if (test_bench_requested(argc, argv))
+        bench();
+
+    return test_end("sprite");
+}
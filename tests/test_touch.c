@@ -0,0 +1,384 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Tests of the queue of high rate touch screen events. The ARM7 is simulated by
+// this file: it receives the FIFO messages sent by the ARM9 and writes events
+// to the ring the same way as the timer interrupt handler of the ARM7.
+//
+// With "-b" it measures the time needed to read events from the queue.
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <nds/arm9/input.h>
+#include <nds/fifocommon.h>
+#include <nds/fifomessages.h>
+#include <nds/memtrace.h>
+#include <nds/system.h>
+
+#include "common/libnds_internal.h"
+#include "test.h"
+
+// Simulated ARM7
+// --------------
+
+static TouchEventIpc *arm7_ring;
+static u32 arm7_rate;
+static int arm7_timer;
+static bool arm7_replies = true;
+static bool arm7_pen_down;
+static u32 arm7_time;
+
+bool fifoSendDatamsg(u32 channel, u32 num_bytes, u8 *data_array)
+{
+    FifoMessage msg;
+
+    CHECK_EQ(channel, FIFO_SYSTEM);
+    CHECK_EQ(num_bytes, sizeof(msg));
+    memcpy(&msg, data_array, sizeof(msg));
+    CHECK_EQ(msg.type, SYS_SET_TOUCH_EVENTS);
+
+    if (!arm7_replies)
+        return true;
+
+    // Same as touchEventsSetup() in the ARM7
+    if (arm7_ring != NULL)
+        arm7_ring->active = 0;
+
+    arm7_ring = msg.setTouchEvents.buffer;
+    arm7_rate = msg.setTouchEvents.freq;
+    arm7_timer = msg.setTouchEvents.timer;
+    arm7_pen_down = false;
+    arm7_time = 0;
+
+    return true;
+}
+
+// Same as touchEventsTimerHandler() in the ARM7, with the result of the filter
+// passed as an argument. The X coordinate is the time of the sample.
+static void arm7_sample(bool pen_down)
+{
+    TouchEventIpc *ring = arm7_ring;
+    bool was_down = arm7_pen_down;
+    u32 time = arm7_time++;
+
+    arm7_pen_down = pen_down;
+
+    if (!pen_down && !was_down)
+        return;
+
+    u32 write_index = ring->write_index;
+
+    if (write_index - ring->read_index > ring->mask)
+    {
+        ring->dropped++;
+        return;
+    }
+
+    TouchEvent *event = &ring->events[write_index & ring->mask];
+
+    event->time = time;
+    event->type = !pen_down ? TOUCH_EVENT_UP :
+                  (!was_down ? TOUCH_EVENT_DOWN : TOUCH_EVENT_HELD);
+    event->vcount = REG_VCOUNT;
+    event->pos.px = time & 0xFF;
+
+    __asm__ volatile("" ::: "memory");
+    ring->write_index = write_index + 1;
+}
+
+// Scanline counter, advanced by a thread while the ARM9 waits for the ARM7
+static volatile bool vcount_running;
+
+static void *vcount_thread(void *arg)
+{
+    (void)arg;
+
+    while (vcount_running)
+    {
+        REG_VCOUNT = (REG_VCOUNT + 1) % 263;
+        nanosleep(&(struct timespec){ 0, 1000 }, NULL);
+    }
+
+    return NULL;
+}
+
+// Tests
+// =====
+
+static void test_start(void)
+{
+    CHECK_EQ(touchEventsStart(7, 0, 16), -2);
+    CHECK_EQ(touchEventsStart(TOUCH_EVENTS_MAX_RATE + 1, 0, 16), -2);
+    CHECK_EQ(touchEventsStart(240, -1, 16), -2);
+    CHECK_EQ(touchEventsStart(240, 4, 16), -2);
+    CHECK_EQ(touchEventsStart(240, 0, 0), -2);
+    CHECK(arm7_ring == NULL);
+
+    // Nothing to do if it isn't active
+    CHECK_EQ(touchEventsStop(), 0);
+    CHECK_EQ(touchEventsRead(NULL, 0), 0);
+    CHECK_EQ(touchEventsDropped(), 0);
+
+    CHECK_EQ(touchEventsStart(TOUCH_EVENTS_MAX_RATE, 3, 10), 0);
+    CHECK_EQ(touchEventsStart(240, 0, 16), -1);
+    CHECK(arm7_ring != NULL);
+    CHECK_EQ(arm7_ring->mask, 15);
+    CHECK(arm7_ring->active);
+    CHECK_EQ(arm7_rate, TOUCH_EVENTS_MAX_RATE);
+    CHECK_EQ(arm7_timer, 3);
+
+    CHECK_EQ(touchEventsStop(), 0);
+    CHECK(arm7_ring == NULL);
+}
+
+static void test_latch(void)
+{
+    TouchEvent events[16];
+
+    CHECK_EQ(touchEventsStart(240, 0, 16), 0);
+
+    // Events that arrive after scanKeys() are left for the next frame
+    arm7_sample(false);
+    arm7_sample(true);
+    arm7_sample(true);
+    arm7_sample(true);
+    CHECK_EQ(touchEventsRead(events, 16), 0);
+
+    scanKeys();
+    arm7_sample(true);
+    arm7_sample(false);
+    arm7_sample(false);
+
+    CHECK_EQ(touchEventsRead(events, 2), 2);
+    CHECK(events[0].type == TOUCH_EVENT_DOWN && events[0].time == 1);
+    CHECK(events[1].type == TOUCH_EVENT_HELD && events[1].time == 2);
+    CHECK_EQ(touchEventsRead(events, 16), 1);
+    CHECK_EQ(events[0].time, 3);
+    CHECK_EQ(touchEventsRead(events, 16), 0);
+
+    scanKeys();
+    CHECK_EQ(touchEventsRead(events, 16), 2);
+    CHECK(events[0].type == TOUCH_EVENT_HELD && events[0].time == 4);
+    CHECK(events[1].type == TOUCH_EVENT_UP && events[1].time == 5);
+
+    // Only the first sample without the pen creates an event
+    scanKeys();
+    CHECK_EQ(touchEventsRead(events, 16), 0);
+    CHECK_EQ(touchEventsDropped(), 0);
+
+    CHECK_EQ(touchEventsStop(), 0);
+}
+
+static void test_full(void)
+{
+    TouchEvent events[16];
+
+    CHECK_EQ(touchEventsStart(240, 0, 8), 0);
+
+    for (int i = 0; i < 11; i++)
+        arm7_sample(true);
+
+    CHECK_EQ(touchEventsDropped(), 3);
+
+    scanKeys();
+    CHECK_EQ(touchEventsRead(events, 16), 8);
+    for (int i = 0; i < 8; i++)
+        CHECK_EQ(events[i].time, i);
+
+    // The indices wrap around correctly
+    for (u32 i = 0; i < 100; i++)
+    {
+        arm7_sample(true);
+        arm7_sample(true);
+        arm7_sample(true);
+        scanKeys();
+        CHECK_EQ(touchEventsRead(events, 16), 3);
+        CHECK_EQ(events[2].time, 11 + i * 3 + 2);
+    }
+
+    CHECK_EQ(touchEventsDropped(), 3);
+    CHECK_EQ(touchEventsStop(), 0);
+}
+
+// The ARM7 writes events from an interrupt handler while the ARM9 reads them.
+// Every event must be read once, in order, unless it has been dropped.
+static volatile bool producer_running;
+static volatile u32 produced;
+
+static void *producer_thread(void *arg)
+{
+    (void)arg;
+
+    while (producer_running)
+    {
+        arm7_sample(true);
+        produced++;
+
+        // Let the consumer run even if there is a single CPU
+        if ((produced % 8) == 0)
+            sched_yield();
+    }
+
+    return NULL;
+}
+
+static void test_concurrent(void)
+{
+    TouchEvent events[32];
+    u32 received = 0;
+    u32 next_time = 0;
+    bool in_order = true;
+
+    CHECK_EQ(touchEventsStart(TOUCH_EVENTS_MAX_RATE, 0, 64), 0);
+
+    // Make sure that the first event isn't a TOUCH_EVENT_DOWN
+    arm7_sample(true);
+    scanKeys();
+    touchEventsRead(events, 32);
+    next_time = 1;
+
+    pthread_t thread;
+    producer_running = true;
+    produced = 0;
+    pthread_create(&thread, NULL, producer_thread, NULL);
+
+    for (int frame = 0; produced < 200000; frame++)
+    {
+        sched_yield();
+        scanKeys();
+
+        size_t count;
+        while ((count = touchEventsRead(events, 1 + frame % 32)) > 0)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                // Dropped events leave gaps in the time values
+                if ((events[i].time < next_time) || (events[i].type != TOUCH_EVENT_HELD)
+                    || (events[i].pos.px != (events[i].time & 0xFF)))
+                    in_order = false;
+
+                next_time = events[i].time + 1;
+            }
+
+            received += count;
+        }
+    }
+
+    producer_running = false;
+    pthread_join(thread, NULL);
+
+    scanKeys();
+    received += touchEventsRead(events, 32);
+    received += touchEventsRead(events, 32);
+    received += touchEventsRead(events, 32);
+
+    CHECK(in_order);
+    CHECK(produced > 0);
+    CHECK_EQ(received + touchEventsDropped(), produced);
+
+    CHECK_EQ(touchEventsStop(), 0);
+}
+
+static void test_stop(void)
+{
+    MemTraceStats stats;
+    TouchEvent event;
+
+    memTraceStart(0, 0);
+
+    CHECK_EQ(touchEventsStart(240, 0, 16), 0);
+    memTraceGetStats(MEMTRACE_TAG_INPUT, &stats);
+    CHECK(stats.current > 16 * sizeof(TouchEvent));
+
+    CHECK_EQ(touchEventsStop(), 0);
+    memTraceGetStats(MEMTRACE_TAG_INPUT, &stats);
+    CHECK_EQ(stats.current, 0);
+
+    // The ARM7 doesn't reply: the ARM9 gives up after a few frames and leaks
+    // the ring.
+    CHECK_EQ(touchEventsStart(240, 0, 16), 0);
+    TouchEventIpc *stuck = arm7_ring;
+    arm7_replies = false;
+
+    pthread_t thread;
+    vcount_running = true;
+    pthread_create(&thread, NULL, vcount_thread, NULL);
+
+    CHECK_EQ(touchEventsStop(), -1);
+
+    vcount_running = false;
+    pthread_join(thread, NULL);
+
+    memTraceGetStats(MEMTRACE_TAG_INPUT, &stats);
+    CHECK(stats.current > 0);
+    CHECK(stuck->active);
+
+    // The queue isn't used by the ARM9 anymore
+    scanKeys();
+    CHECK_EQ(touchEventsRead(&event, 1), 0);
+
+    // The simulated ARM7 will never use it
+    memTraceFree(stuck);
+
+    memTraceStop();
+
+    // The queue can be started again
+    arm7_replies = true;
+    arm7_ring = NULL;
+    CHECK_EQ(touchEventsStart(240, 0, 16), 0);
+    CHECK_EQ(touchEventsStop(), 0);
+}
+
+// Benchmarks
+// ==========
+
+static void bench(void)
+{
+    const int frames = 100000;
+    TouchEvent events[8];
+    uint64_t total = 0;
+    volatile u32 sink = 0;
+
+    touchEventsStart(480, 0, 16);
+
+    // 480 Hz gives 8 samples per frame
+    for (int frame = 0; frame < frames; frame++)
+    {
+        for (int i = 0; i < 8; i++)
+            arm7_sample(true);
+
+        scanKeys();
+
+        uint64_t start = hostTimeNs();
+        size_t count = touchEventsRead(events, 8);
+        total += hostTimeNs() - start;
+
+        sink += count;
+    }
+
+    touchEventsStop();
+
+    printf("Reading touch events on the host:\n");
+    printf("  touchEventsRead() %6.1f ns per event\n",
+           (double)total / ((double)frames * 8));
+}
+
+int main(int argc, char *argv[])
+{
+    test_start();
+    test_latch();
+    test_full();
+    test_concurrent();
+    test_stop();
+
+    if (test_bench_requested(argc, argv))
+        bench();
+
+    return test_end("touch");
+}
@@ -0,0 +1,296 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Accuracy tests of the inverse trigonometric functions, compared with the
+// functions of libm. Errors are measured in libnds angle units (32768 units per
+// turn).
+//
+// With "-b" it compares the speed of asinLerp() with the previous version,
+// which used bsearch(), and the speed of all functions with libm.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <nds/arm9/math.h>
+#include <nds/arm9/trig_lut.h>
+
+#include "test.h"
+
+#define ANGLE_UNITS_PER_RADIAN  (DEGREES_IN_CIRCLE / (2 * M_PI))
+
+// Maximum errors allowed. The sine LUT is very flat close to 1, so asinLerp()
+// is less accurate there.
+#define MAX_ERROR_ASIN          6.0
+#define MAX_ERROR_ASIN_MIDDLE   1.0 // For arguments in [-0.9, 0.9]
+#define MAX_ERROR_ATAN          1.0
+
+extern const u16 SIN_LUT[];
+
+// Tests
+// =====
+
+static void test_asin_acos(void)
+{
+    double max_err = 0, max_err_middle = 0;
+    int prev = -DEGREES_IN_CIRCLE;
+
+    // All valid arguments
+    for (int par = -4096; par <= 4096; par++)
+    {
+        double ref = asin(par / 4096.0) * ANGLE_UNITS_PER_RADIAN;
+        int res = asinLerp(par);
+
+        double err = fabs(res - ref);
+        if (err > max_err)
+            max_err = err;
+        if ((abs(par) <= 3686) && (err > max_err_middle))
+            max_err_middle = err;
+
+        // The result must be monotonic and odd
+        CHECK(res >= prev);
+        CHECK_EQ(asinLerp(-par), -res);
+        prev = res;
+
+        CHECK_EQ(acosLerp(par), DEGREES_IN_CIRCLE / 4 - res);
+    }
+
+    CHECK_EQ(asinLerp(0), 0);
+    CHECK_EQ(asinLerp(4096), DEGREES_IN_CIRCLE / 4);
+    CHECK_EQ(asinLerp(-4096), -DEGREES_IN_CIRCLE / 4);
+    CHECK_EQ(acosLerp(4096), 0);
+    CHECK_EQ(acosLerp(-4096), DEGREES_IN_CIRCLE / 2);
+
+    CHECK(max_err <= MAX_ERROR_ASIN);
+    CHECK(max_err_middle <= MAX_ERROR_ASIN_MIDDLE);
+    printf("  asinLerp:  max error %.2f (%.2f in [-0.9, 0.9])\n", max_err,
+           max_err_middle);
+}
+
+static void test_atan(void)
+{
+    double max_err = 0;
+    int prev = -DEGREES_IN_CIRCLE;
+
+    // From -64.0 to 64.0 with all fractional values
+    for (int32_t par = -inttof32(64); par <= inttof32(64); par++)
+    {
+        double ref = atan(par / 4096.0) * ANGLE_UNITS_PER_RADIAN;
+        int res = atanLerp(par);
+
+        double err = fabs(res - ref);
+        if (err > max_err)
+            max_err = err;
+
+        CHECK(res >= prev);
+        prev = res;
+    }
+
+    // Very big arguments
+    for (int n = 0; n < 100000; n++)
+    {
+        int32_t par = (int32_t)test_rand();
+        double ref = atan(par / 4096.0) * ANGLE_UNITS_PER_RADIAN;
+        double err = fabs(atanLerp(par) - ref);
+        if (err > max_err)
+            max_err = err;
+    }
+
+    CHECK_EQ(atanLerp(0), 0);
+    CHECK_EQ(atanLerp(inttof32(1)), DEGREES_IN_CIRCLE / 8);
+    CHECK_EQ(atanLerp(-inttof32(1)), -DEGREES_IN_CIRCLE / 8);
+
+    CHECK(max_err <= MAX_ERROR_ATAN);
+    printf("  atanLerp:  max error %.2f\n", max_err);
+}
+
+static void test_atan2(void)
+{
+    double max_err = 0;
+
+    // Points in all quadrants with all sorts of magnitudes, including the
+    // extremes of the range of the arguments.
+    for (int n = 0; n < 1000000; n++)
+    {
+        int32_t x = (int32_t)test_rand();
+        x >>= test_rand() % 32;
+        int32_t y = (int32_t)test_rand();
+        y >>= test_rand() % 32;
+
+        switch (n % 16)
+        {
+            case 0:
+                x = 0;
+                break;
+            case 1:
+                y = 0;
+                break;
+            case 2:
+                x = INT32_MIN;
+                break;
+            case 3:
+                y = INT32_MIN;
+                break;
+            case 4:
+                x = y;
+                break;
+        }
+
+        if ((x == 0) && (y == 0))
+            continue;
+
+        double ref = atan2(y, x) * ANGLE_UNITS_PER_RADIAN;
+        int res = atan2Lerp(y, x);
+
+        // -180 and 180 degrees are the same angle
+        double err = fabs(res - ref);
+        if (err > DEGREES_IN_CIRCLE / 2)
+            err = fabs(err - DEGREES_IN_CIRCLE);
+
+        if (err > max_err)
+            max_err = err;
+    }
+
+    CHECK_EQ(atan2Lerp(0, 0), 0);
+    CHECK_EQ(atan2Lerp(0, 1), 0);
+    CHECK_EQ(atan2Lerp(1, 0), DEGREES_IN_CIRCLE / 4);
+    CHECK_EQ(atan2Lerp(0, -1), DEGREES_IN_CIRCLE / 2);
+    CHECK_EQ(atan2Lerp(-1, 0), -DEGREES_IN_CIRCLE / 4);
+    CHECK_EQ(atan2Lerp(5, 5), DEGREES_IN_CIRCLE / 8);
+    CHECK_EQ(atan2Lerp(-5, -5), -3 * DEGREES_IN_CIRCLE / 8);
+
+    // The scale of the arguments doesn't matter
+    for (int n = 0; n < 10000; n++)
+    {
+        int32_t x = (int32_t)(test_rand() % 2001) - 1000;
+        int32_t y = (int32_t)(test_rand() % 2001) - 1000;
+        CHECK_EQ(atan2Lerp(y, x), atan2Lerp(y * 4096, x * 4096));
+    }
+
+    CHECK(max_err <= MAX_ERROR_ATAN);
+    printf("  atan2Lerp: max error %.2f\n", max_err);
+}
+
+// Benchmarks
+// ==========
+
+// Previous version of asinLerp(), which returned the angle of the LUT entry
+// right below the argument.
+
+static int old_asinComp(const void *a, const void *b)
+{
+    u16 par = (*(const u16 *)a);
+    const u16 *lut = b;
+
+    if (par == lut[0] || (par > lut[0] && par < lut[1]))
+        return 0;
+
+    if (par < lut[0])
+        return -1;
+
+    return 1;
+}
+
+static s16 old_asinLerp(s16 par)
+{
+    bool neg = false;
+    u16 param;
+
+    if (par < 0)
+    {
+        param = -par;
+        neg = true;
+    }
+    else
+    {
+        param = par;
+    }
+
+    // convert from 4.12 to 1.15
+    param = param << 3;
+
+    if (param < 64)
+        return 0;
+
+    if (param > SIN_LUT[128])
+        return (neg ? -8192 : 8192);
+
+    u16 *lutIndexPointer =
+        (u16 *)bsearch(&param, SIN_LUT, 128 + 1, sizeof(u16), old_asinComp);
+
+    if (lutIndexPointer == NULL)
+        return 0;
+
+    int index = (int)(lutIndexPointer - SIN_LUT);
+
+    int angle = index << 6;
+
+    return (neg ? -angle : angle);
+}
+
+static volatile int bench_sink;
+
+#define BENCH(name, expr)                                                   \
+    do {                                                                    \
+        unsigned int sum_ = 0;                                              \
+        uint64_t start_ = hostTimeNs();                                     \
+        for (int n = 0; n < iterations; n++)                                \
+        {                                                                   \
+            int32_t a = args_a[n & 4095], b = args_b[n & 4095];             \
+            (void)a;                                                        \
+            (void)b;                                                        \
+            sum_ += (expr);                                                 \
+        }                                                                   \
+        uint64_t t_ = hostTimeNs() - start_;                                \
+        bench_sink = sum_;                                                  \
+        printf("  %-16s %6.2f ns\n", name, (double)t_ / iterations);        \
+    } while (0)
+
+static void bench(void)
+{
+    const int iterations = 10000000;
+    static int32_t args_a[4096], args_b[4096];
+
+    for (int i = 0; i < 4096; i++)
+    {
+        args_a[i] = (int32_t)(test_rand() % 8193) - 4096;
+        args_b[i] = (int32_t)(test_rand() % 8193) - 4096;
+    }
+
+    // Check the accuracy of the old version too
+    double max_err = 0;
+    for (int par = -4096; par <= 4096; par++)
+    {
+        double ref = asin(par / 4096.0) * ANGLE_UNITS_PER_RADIAN;
+        double err = fabs(old_asinLerp(par) - ref);
+        if (err > max_err)
+            max_err = err;
+    }
+    printf("Previous asinLerp(): max error %.2f\n", max_err);
+
+    printf("Time per call on the host:\n");
+
+    BENCH("asinLerp (old)", old_asinLerp(a));
+    BENCH("asinLerp", asinLerp(a));
+    BENCH("asin (libm)", (int)(asin(a / 4096.0) * ANGLE_UNITS_PER_RADIAN));
+    BENCH("atanLerp", atanLerp(a * 16));
+    BENCH("atan (libm)", (int)(atan(a / 256.0) * ANGLE_UNITS_PER_RADIAN));
+    BENCH("atan2Lerp", atan2Lerp(a, b));
+    BENCH("atan2 (libm)", (int)(atan2(a, b) * ANGLE_UNITS_PER_RADIAN));
+}
+
+int main(int argc, char *argv[])
+{
+    printf("Accuracy of the inverse trigonometric functions (angle units):\n");
+
+    test_asin_acos();
+    test_atan();
+    test_atan2();
+
+    if (test_bench_requested(argc, argv))
+        bench();
+
+    return test_end("trig");
+}
@@ -0,0 +1,399 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2025 Antonio Niño Díaz
+
+// Tests of the UTF conversion functions. Random strings are converted with the
+// functions of libnds and with iconv, which is the reference. The strings mix
+// valid and invalid characters, embedded NUL characters and truncated input,
+// and they are converted from misaligned buffers into short output buffers.
+//
+// With "-b" it measures the time needed to convert file names with the ASCII
+// fast path (aligned source) and without it (misaligned source).
+
+#include <iconv.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <uchar.h>
+
+#include <nds/utf.h>
+
+#include "test.h"
+
+static iconv_t to_utf16, to_utf8;
+
+static char in_buf[1024] __attribute__((aligned(4)));
+static char expected[4096];
+static char out_buf[4096] __attribute__((aligned(4)));
+
+#define CANARY  0x55
+
+// Converts a string with iconv up to the first NUL character (of "unit" bytes)
+// or the end of the buffer. It returns the size of the result including the
+// NUL terminator, or -1 if the string isn't valid.
+static ssize_t reference(iconv_t cd, const char *in, size_t in_size, size_t unit,
+                         char *out, size_t out_size)
+{
+    size_t len = 0;
+
+    while (len + unit <= in_size)
+    {
+        bool zero = true;
+        for (size_t i = 0; i < unit; i++)
+        {
+            if (in[len + i] != 0)
+                zero = false;
+        }
+
+        if (zero)
+            break;
+
+        len += unit;
+    }
+
+    iconv(cd, NULL, NULL, NULL, NULL);
+
+    char *src = (char *)in;
+    char *dst = out;
+    size_t src_left = len;
+    size_t dst_left = out_size;
+
+    if (iconv(cd, &src, &src_left, &dst, &dst_left) == (size_t)-1)
+        return -1;
+
+    // The terminator has the size of a character of the output
+    size_t size = out_size - dst_left;
+    size_t nul_size = (unit == 1) ? 2 : 1;
+    memset(out + size, 0, nul_size);
+
+    return size + nul_size;
+}
+
+static size_t put_utf8(char *s, uint32_t c)
+{
+    if (c < 0x80)
+    {
+        s[0] = c;
+        return 1;
+    }
+    else if (c < 0x800)
+    {
+        s[0] = 0xC0 | (c >> 6);
+        s[1] = 0x80 | (c & 0x3F);
+        return 2;
+    }
+    else if (c < 0x10000)
+    {
+        s[0] = 0xE0 | (c >> 12);
+        s[1] = 0x80 | ((c >> 6) & 0x3F);
+        s[2] = 0x80 | (c & 0x3F);
+        return 3;
+    }
+
+    s[0] = 0xF0 | (c >> 18);
+    s[1] = 0x80 | ((c >> 12) & 0x3F);
+    s[2] = 0x80 | ((c >> 6) & 0x3F);
+    s[3] = 0x80 | (c & 0x3F);
+    return 4;
+}
+
+enum
+{
+    MODE_ASCII,     // Only printable ASCII characters
+    MODE_TRUNCATED, // The input size is smaller than the string
+    MODE_NUL,       // A NUL character in the middle of the string
+    MODE_INVALID,   // Random bytes, surrogates and overlong encodings
+    MODE_COUNT
+};
+
+// Returns the size of the output buffer used by a conversion, which is usually
+// too small for the result.
+static size_t random_out_size(size_t max)
+{
+    if ((test_rand() % 3) == 0)
+        return test_rand() % max;
+
+    return sizeof(out_buf) - 4;
+}
+
+// Compares the output of a conversion with the reference. Only the part that
+// fits in the output buffer is compared, and nothing must be written after it.
+static bool output_matches(const char *out, size_t out_size, ssize_t size,
+                           size_t unit)
+{
+    size_t written = (out_size / unit) * unit;
+    if ((size_t)size < written)
+        written = size;
+
+    if (memcmp(out, expected, written) != 0)
+        return false;
+
+    return (uint8_t)out[written] == CANARY;
+}
+
+static void test_utf8_to_utf16(int mode)
+{
+    char *in = in_buf + test_rand() % 4;
+    size_t chars = test_rand() % 64;
+    size_t len = 0;
+
+    for (size_t i = 0; i < chars; i++)
+    {
+        uint32_t r = test_rand() % 10;
+        uint32_t c;
+
+        if ((mode == MODE_ASCII) || (r < 5))
+        {
+            in[len++] = 0x20 + test_rand() % 0x5F;
+            continue;
+        }
+
+        if ((mode == MODE_INVALID) && (r == 9))
+        {
+            in[len++] = test_rand();
+            continue;
+        }
+
+        if (r == 8)
+        {
+            c = test_rand() % 0x800;
+        }
+        else
+        {
+            // Surrogates can only be encoded by mistake
+            do
+                c = test_rand() % 0x110000;
+            while ((c >= 0xD800) && (c <= 0xDFFF) && (mode != MODE_INVALID));
+        }
+
+        len += put_utf8(in + len, c);
+    }
+
+    // Overlong encoding of '/'
+    if ((mode == MODE_INVALID) && (len > 2) && ((test_rand() % 8) == 0))
+    {
+        in[len - 2] = 0xC0;
+        in[len - 1] = 0xAF;
+    }
+
+    if ((mode == MODE_NUL) && (len > 0))
+        in[test_rand() % len] = 0;
+
+    size_t in_size = len;
+    if ((mode == MODE_TRUNCATED) && (len > 0))
+        in_size = test_rand() % len;
+
+    ssize_t size = reference(to_utf16, in, in_size, 1, expected, sizeof(expected));
+
+    size_t out_size = random_out_size(2 * chars + 4);
+    char *out = out_buf + (test_rand() % 2) * 2;
+    memset(out_buf, CANARY, sizeof(out_buf));
+
+    ssize_t result = utf8_to_utf16((char16_t *)(void *)out, out_size, in, in_size);
+    ssize_t result_len = utf8_to_utf16_len(in, in_size);
+    bool valid = utf8_validate(in, in_size);
+
+    if (size < 0)
+    {
+        CHECK(result < 0);
+        CHECK(result_len < 0);
+        CHECK(!valid);
+        return;
+    }
+
+    CHECK_EQ(result, size);
+    CHECK_EQ(result_len, size);
+    CHECK(valid);
+    CHECK(output_matches(out, out_size, size, 2));
+}
+
+static void test_utf16_to_utf8(int mode)
+{
+    char16_t *in = (char16_t *)(void *)(in_buf + (test_rand() % 2) * 2);
+    size_t units = test_rand() % 32 + 1;
+
+    for (size_t i = 0; i < units; i++)
+    {
+        uint32_t r = test_rand() % 10;
+
+        if ((mode == MODE_ASCII) || (r < 5))
+        {
+            in[i] = 0x20 + test_rand() % 0x5F;
+        }
+        else if ((r < 7) && (i + 1 < units))
+        {
+            uint32_t c = test_rand() % 0x100000;
+            in[i++] = 0xD800 | (c >> 10);
+            in[i] = 0xDC00 | (c & 0x3FF);
+        }
+        else if ((mode == MODE_INVALID) && (r == 9))
+        {
+            // Unpaired surrogate
+            in[i] = 0xD800 + test_rand() % 0x800;
+        }
+        else
+        {
+            do
+                in[i] = test_rand();
+            while ((in[i] >= 0xD800) && (in[i] <= 0xDFFF));
+        }
+    }
+
+    if (mode == MODE_NUL)
+        in[test_rand() % units] = 0;
+
+    // The size may be odd
+    size_t in_size = units * 2;
+    if (mode == MODE_TRUNCATED)
+        in_size = test_rand() % (in_size + 1);
+
+    ssize_t size = reference(to_utf8, (const char *)in, in_size, 2, expected,
+                             sizeof(expected));
+
+    size_t out_size = random_out_size(3 * units + 4);
+    char *out = out_buf + test_rand() % 4;
+    memset(out_buf, CANARY, sizeof(out_buf));
+
+    ssize_t result = utf16_to_utf8(out, out_size, in, in_size);
+    ssize_t result_len = utf16_to_utf8_len(in, in_size);
+    bool valid = utf16_validate(in, in_size);
+
+    if (size < 0)
+    {
+        CHECK(result < 0);
+        CHECK(result_len < 0);
+        CHECK(!valid);
+        return;
+    }
+
+    CHECK_EQ(result, size);
+    CHECK_EQ(result_len, size);
+    CHECK(valid);
+    CHECK(output_matches(out, out_size, size, 1));
+}
+
+static void test_fuzz(void)
+{
+    for (int n = 0; n < 1000000; n++)
+    {
+        int mode = test_rand() % MODE_COUNT;
+
+        if (n & 1)
+            test_utf16_to_utf8(mode);
+        else
+            test_utf8_to_utf16(mode);
+    }
+}
+
+static void test_decode_char(void)
+{
+    char32_t c;
+
+    CHECK_EQ(utf8_decode_char("", &c), 1);
+    CHECK_EQ(c, 0);
+    CHECK_EQ(utf8_decode_char("\xC3\xA9", &c), 2);
+    CHECK_EQ(c, 0xE9);
+    CHECK_EQ(utf8_decode_char("\xF0\x9F\x98\x80", &c), 4);
+    CHECK_EQ(c, 0x1F600);
+
+    // Truncated, overlong, surrogate and out of range
+    CHECK(utf8_decode_char("\xE3\x81", &c) < 0);
+    CHECK(utf8_decode_char("\xE0\x80\xAF", &c) < 0);
+    CHECK(utf8_decode_char("\xED\xA0\x80", &c) < 0);
+    CHECK(utf8_decode_char("\xF4\x90\x80\x80", &c) < 0);
+    CHECK(utf8_decode_char("\x80", &c) < 0);
+
+    // U+10000 is encoded as a surrogate pair, it isn't a terminator
+    char16_t out[4];
+    CHECK_EQ(utf8_to_utf16(out, sizeof(out), "\xF0\x90\x80\x80" "A", 6), 8);
+    CHECK(out[0] == 0xD800 && out[1] == 0xDC00 && out[2] == 'A' && out[3] == 0);
+}
+
+// Benchmarks
+// ==========
+
+#define NAMES       1000
+#define NAME_SIZE   48
+
+static char names[NAMES][NAME_SIZE + 4] __attribute__((aligned(4)));
+static char16_t names16[NAMES][NAME_SIZE + 2] __attribute__((aligned(4)));
+
+static volatile ssize_t bench_sink;
+
+// Converts all names "reps" times and returns the time per name in ns
+static double bench_utf8(int offset, int reps)
+{
+    static char16_t out[NAME_SIZE] __attribute__((aligned(4)));
+
+    uint64_t start = hostTimeNs();
+    for (int r = 0; r < reps; r++)
+    {
+        for (int i = 0; i < NAMES; i++)
+            bench_sink += utf8_to_utf16(out, sizeof(out), names[i] + offset, NAME_SIZE);
+    }
+
+    return (double)(hostTimeNs() - start) / (reps * NAMES);
+}
+
+static double bench_utf16(int offset, int reps)
+{
+    static char out[NAME_SIZE * 3] __attribute__((aligned(4)));
+
+    uint64_t start = hostTimeNs();
+    for (int r = 0; r < reps; r++)
+    {
+        for (int i = 0; i < NAMES; i++)
+        {
+            bench_sink += utf16_to_utf8(out, sizeof(out), names16[i] + offset,
+                                        NAME_SIZE * 2);
+        }
+    }
+
+    return (double)(hostTimeNs() - start) / (reps * NAMES);
+}
+
+static void bench(void)
+{
+    const int reps = 1000;
+
+    // File names like the ones of a directory listing. The misaligned copies
+    // start one character later.
+    for (int i = 0; i < NAMES; i++)
+    {
+        char name[NAME_SIZE];
+        snprintf(name, sizeof(name), "SOME_DIRECTORY_ENTRY_%04d.txt", i);
+
+        memcpy(names[i], name, sizeof(name));
+
+        for (size_t j = 0; j <= strlen(name); j++)
+            names16[i][j] = name[j];
+    }
+
+    printf("Converting file names on the host (ns per name):\n");
+    printf("  UTF-8 to UTF-16    fast path %6.1f   misaligned %6.1f\n",
+           bench_utf8(0, reps), bench_utf8(1, reps));
+    printf("  UTF-16 to UTF-8    fast path %6.1f   misaligned %6.1f\n",
+           bench_utf16(0, reps), bench_utf16(1, reps));
+}
+
+int main(int argc, char *argv[])
+{
+    to_utf16 = iconv_open("UTF-16LE", "UTF-8");
+    to_utf8 = iconv_open("UTF-8", "UTF-16LE");
+    if ((to_utf16 == (iconv_t)-1) || (to_utf8 == (iconv_t)-1))
+    {
+        printf("utf: iconv not available\n");
+        return 1;
+    }
+
+    test_decode_char();
+    test_fuzz();
+
+    if (test_bench_requested(argc, argv))
+        bench();
+
+    iconv_close(to_utf16);
+    iconv_close(to_utf8);
+
+    return test_end("utf");
+}
@@ -0,0 +1,649 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Tests of the texture and palette VRAM allocator used by videoGL. Random
+// sequences of allocations and frees are applied to a VRAM block, and the
+// structure of the block is checked after each one. Each allocation is compared
+// with the best fit found by checking all free nodes.
+//
+// With "-b" it replays allocation traces and prints the time per operation and
+// the fragmentation of VRAM at the end of the trace.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <nds/arm9/video.h>
+
+#include "arm9/video/vramBlock.h"
+#include "test.h"
+
+#define MAX_LIVE    4096
+
+typedef struct {
+    uint32_t index;
+    uint32_t addr;
+    uint32_t size;
+} Allocation;
+
+static Allocation live[MAX_LIVE];
+static int num_live;
+
+// Structure checks
+// ================
+
+static bool free_before(const s_vramNode *a, const s_vramNode *b)
+{
+    return (a->size < b->size) || ((a->size == b->size) && (a->addr < b->addr));
+}
+
+// Checks a subtree of the tree of free nodes: the links to the parents, the
+// order of the nodes and the priorities. All nodes of the subtree must go after
+// "lo" and before "hi" (if they aren't NULL).
+static bool check_tree(s_vramBlock *mb, int32_t i, int32_t parent,
+                       const s_vramNode *lo, const s_vramNode *hi,
+                       uint32_t *count)
+{
+    if (i == VRAM_NODE_NONE)
+        return true;
+
+    s_vramNode *n = &mb->nodes[i];
+
+    if ((n->state != VRAM_NODE_FREE) || (n->parent != parent))
+        return false;
+    if ((lo != NULL) && !free_before(lo, n))
+        return false;
+    if ((hi != NULL) && !free_before(n, hi))
+        return false;
+    if ((parent != VRAM_NODE_NONE) &&
+        (vramBlock_priority(parent) < vramBlock_priority(i)))
+        return false;
+
+    (*count)++;
+
+    return check_tree(mb, n->left, i, lo, n, count) &&
+           check_tree(mb, n->right, i, n, hi, count);
+}
+
+static void check_block(s_vramBlock *mb)
+{
+    uint32_t addr = (uint32_t)mb->startAddr;
+    uint32_t free_bytes = 0, free_nodes = 0;
+    int32_t prev = VRAM_NODE_NONE;
+    bool prev_free = false;
+
+    for (int32_t i = mb->firstNode; i != VRAM_NODE_NONE; i = mb->nodes[i].next)
+    {
+        s_vramNode *n = &mb->nodes[i];
+
+        CHECK_EQ(n->addr, addr);
+        CHECK_EQ(n->prev, prev);
+        CHECK(n->size > 0);
+        CHECK(n->state != VRAM_NODE_UNUSED);
+
+        bool is_free = n->state == VRAM_NODE_FREE;
+        if (is_free)
+        {
+            // Free nodes next to each other must be merged
+            CHECK(!prev_free);
+            free_bytes += n->size;
+            free_nodes++;
+        }
+
+        prev_free = is_free;
+        prev = i;
+        addr += n->size;
+    }
+
+    CHECK_EQ(addr, (uint32_t)mb->endAddr);
+    CHECK_EQ(free_bytes, mb->freeBytes);
+    CHECK_EQ(free_nodes, mb->freeNodes);
+
+    // Tree of free nodes
+    uint32_t listed = 0;
+    CHECK(check_tree(mb, mb->freeRoot, VRAM_NODE_NONE, NULL, NULL, &listed));
+    CHECK_EQ(listed, free_nodes);
+
+    // Allocations must keep their address and size
+    for (int i = 0; i < num_live; i++)
+    {
+        CHECK_EQ((uintptr_t)vramBlock_getAddr(mb, live[i].index), live[i].addr);
+        CHECK_EQ(vramBlock_getSize(mb, live[i].index), live[i].size);
+    }
+}
+
+// Best fit found by checking all free nodes in address order. It returns 0 if
+// there is no space.
+static uint32_t best_fit(s_vramBlock *mb, uint32_t size, uint32_t align)
+{
+    s_vramRange ranges[VRAM_MAX_RANGES];
+    int count = vramBlock_getRanges(mb, ranges);
+
+    s_vramNode *best = NULL;
+    uint32_t best_addr = 0;
+
+    for (int32_t i = mb->firstNode; i != VRAM_NODE_NONE; i = mb->nodes[i].next)
+    {
+        s_vramNode *n = &mb->nodes[i];
+        if ((n->state != VRAM_NODE_FREE) || (n->size < size))
+            continue;
+
+        if ((best != NULL) && (n->size >= best->size))
+            continue;
+
+        uint32_t addr = vramBlock_fit(n, n->addr, size, align, ranges, count);
+        if (addr != 0)
+        {
+            best = n;
+            best_addr = addr;
+        }
+    }
+
+    return best_addr;
+}
+
+// Random operations
+// =================
+
+static uint32_t random_texture_size(void)
+{
+    static const uint32_t bpp[] = { 2, 4, 8, 16 };
+
+    uint32_t w = 8 << (test_rand() % 6);
+    uint32_t h = 8 << (test_rand() % 6);
+    return w * h * bpp[test_rand() % 4] / 8;
+}
+
+static uint32_t random_palette_size(void)
+{
+    static const uint32_t colors[] = { 4, 16, 32, 256, 8 };
+
+    return colors[test_rand() % 5] * 2;
+}
+
+static void add_live(s_vramBlock *mb, uint32_t index)
+{
+    Allocation *a = &live[num_live++];
+    a->index = index;
+    a->addr = (uintptr_t)vramBlock_getAddr(mb, index);
+    a->size = vramBlock_getSize(mb, index);
+}
+
+static void free_random(s_vramBlock *mb)
+{
+    int i = test_rand() % num_live;
+    CHECK_EQ(vramBlock_deallocateBlock(mb, live[i].index), 1);
+
+    // Double free
+    CHECK_EQ(vramBlock_deallocateBlock(mb, live[i].index), 0);
+
+    live[i] = live[--num_live];
+}
+
+static void random_trace(s_vramBlock *mb, bool palettes, int ops)
+{
+    num_live = 0;
+
+    for (int n = 0; n < ops; n++)
+    {
+        if ((num_live > 0) && ((num_live == MAX_LIVE) || (test_rand() % 100 < 45)))
+        {
+            free_random(mb);
+        }
+        else
+        {
+            uint32_t size = palettes ? random_palette_size() : random_texture_size();
+            uint32_t align = palettes ? ((size == 8) ? 3 : 4) : 3;
+            uint32_t expected = best_fit(mb, size, align);
+
+            uint32_t index = vramBlock_allocateBlock(mb, size, align);
+            CHECK_EQ(index != 0, expected != 0);
+
+            if (index != 0)
+            {
+                uint32_t addr = (uintptr_t)vramBlock_getAddr(mb, index);
+                CHECK_EQ(addr, expected);
+                CHECK_EQ(addr & ((1 << align) - 1), 0);
+                add_live(mb, index);
+            }
+        }
+
+        check_block(mb);
+    }
+
+    while (num_live > 0)
+        free_random(mb);
+
+    check_block(mb);
+    CHECK_EQ(mb->freeNodes, 1);
+    CHECK_EQ(mb->freeBytes, (uint32_t)(mb->endAddr - mb->startAddr));
+}
+
+// Tests
+// =====
+
+static void test_random(void)
+{
+    VRAM_CR = 0x83838383; // All banks used for textures
+    VRAM_EFG_CR = 0x838383;
+
+    s_vramBlock *tex = vramBlock_Construct((uint8_t *)VRAM_A, (uint8_t *)VRAM_E);
+    CHECK(tex != NULL);
+    random_trace(tex, false, 20000);
+    vramBlock_Deconstruct(tex);
+
+    s_vramBlock *pal = vramBlock_Construct((uint8_t *)VRAM_E, (uint8_t *)VRAM_H);
+    CHECK(pal != NULL);
+    random_trace(pal, true, 20000);
+    vramBlock_Deconstruct(pal);
+}
+
+// Allocations must not use banks that are locked or not mapped for textures
+static void test_banks(void)
+{
+    VRAM_CR = 0x00838383; // VRAM_D isn't used for textures
+
+    s_vramBlock *mb = vramBlock_Construct((uint8_t *)VRAM_A, (uint8_t *)VRAM_E);
+    mb->lock = BIT(1); // VRAM_B
+
+    uint32_t allocated = 0;
+    num_live = 0;
+
+    while (1)
+    {
+        uint32_t size = random_texture_size();
+        uint32_t index = vramBlock_allocateBlock(mb, size, 3);
+        if (index == 0)
+        {
+            if (size <= 0x800)
+                break;
+            continue;
+        }
+
+        add_live(mb, index);
+        allocated += size;
+
+        uint32_t addr = (uintptr_t)vramBlock_getAddr(mb, index);
+        CHECK((addr + size <= (uint32_t)VRAM_B) ||
+              ((addr >= (uint32_t)VRAM_C) && (addr + size <= (uint32_t)VRAM_D)));
+    }
+
+    check_block(mb);
+    CHECK(allocated <= 2 * 0x20000);
+    CHECK(allocated > 2 * 0x20000 - 2 * 0x800);
+
+    // The locked and unused banks are still managed by the allocator
+    uint32_t freeBytes, largest, nodes;
+    vramBlock_getStats(mb, &freeBytes, &largest, &nodes);
+    CHECK_EQ(freeBytes, 4 * 0x20000 - allocated);
+    CHECK(largest >= 0x20000);
+
+    vramBlock_Deconstruct(mb);
+    VRAM_CR = 0x83838383;
+}
+
+// GL_COMPRESSED textures use two blocks at related addresses
+static void test_compressed(void)
+{
+    s_vramBlock *mb = vramBlock_Construct((uint8_t *)VRAM_A, (uint8_t *)VRAM_E);
+    num_live = 0;
+
+    // Fragment the memory a bit first
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t index = vramBlock_allocateBlock(mb, random_texture_size(), 3);
+        if (index != 0)
+            add_live(mb, index);
+    }
+    for (int i = 0; i < 32; i++)
+        free_random(mb);
+
+    for (int n = 0; n < 200; n++)
+    {
+        uint32_t size = 8 << (test_rand() % 12);
+        uint32_t index, indexExt;
+
+        if (vramBlock_allocateCompressed(mb, size, &index, &indexExt) == 0)
+            break;
+
+        add_live(mb, index);
+        add_live(mb, indexExt);
+
+        uint32_t addr = (uintptr_t)vramBlock_getAddr(mb, index);
+        uint32_t ext = (uintptr_t)vramBlock_getAddr(mb, indexExt);
+
+        CHECK_EQ(vramBlock_getSize(mb, indexExt), size / 2);
+        CHECK_EQ(ext & 3, 0);
+
+        if (addr < (uint32_t)VRAM_B)
+        {
+            CHECK_EQ(ext, (uint32_t)VRAM_B + (addr - (uint32_t)VRAM_A) / 2);
+        }
+        else
+        {
+            CHECK(addr >= (uint32_t)VRAM_C);
+            CHECK(addr + size <= (uint32_t)VRAM_D);
+            CHECK_EQ(ext, (uint32_t)VRAM_B + 0x10000 + (addr - (uint32_t)VRAM_C) / 2);
+        }
+    }
+
+    check_block(mb);
+
+    while (num_live > 0)
+        free_random(mb);
+    check_block(mb);
+
+    vramBlock_Deconstruct(mb);
+}
+
+static void test_special(void)
+{
+    s_vramBlock *mb = vramBlock_Construct((uint8_t *)VRAM_A, (uint8_t *)VRAM_E);
+    num_live = 0;
+
+    uint8_t *want = (uint8_t *)VRAM_A + 0x1234;
+    uint8_t *addr = vramBlock_examineSpecial(mb, want, 0x100, 3);
+    CHECK_EQ((uintptr_t)addr, (uintptr_t)VRAM_A + 0x1238);
+
+    // It must use the result of the last examination
+    CHECK_EQ(vramBlock_allocateSpecial(mb, addr, 0x200), 0);
+    uint32_t index = vramBlock_allocateSpecial(mb, addr, 0x100);
+    CHECK(index != 0);
+    add_live(mb, index);
+
+    // The next area is taken
+    addr = vramBlock_examineSpecial(mb, want, 0x100, 3);
+    CHECK_EQ((uintptr_t)addr, (uintptr_t)VRAM_A + 0x1338);
+
+    check_block(mb);
+
+    CHECK_EQ(vramBlock_deallocateAll(mb), 1);
+    num_live = 0;
+    check_block(mb);
+    CHECK_EQ(mb->freeNodes, 1);
+
+    vramBlock_Deconstruct(mb);
+}
+
+// Moves all allocations down to remove the free space between them, like
+// glCompactBlock() does.
+static void compact(s_vramBlock *mb)
+{
+    for (int32_t i = mb->firstNode; i != VRAM_NODE_NONE; i = mb->nodes[i].next)
+    {
+        int32_t p = mb->nodes[i].prev;
+        if ((mb->nodes[i].state != VRAM_NODE_ALLOC) || (p == VRAM_NODE_NONE) ||
+            (mb->nodes[p].state != VRAM_NODE_FREE))
+            continue;
+
+        uint32_t addr = mb->nodes[p].addr;
+        CHECK_EQ(vramBlock_moveDown(mb, i + 1, addr), 1);
+
+        for (int k = 0; k < num_live; k++)
+        {
+            if (live[k].index == (uint32_t)(i + 1))
+                live[k].addr = addr;
+        }
+
+        check_block(mb);
+    }
+
+    // Only the free space at the end is left
+    CHECK(mb->freeNodes <= 1);
+}
+
+static void test_move_down(void)
+{
+    VRAM_CR = 0x83838383;
+
+    s_vramBlock *mb = vramBlock_Construct((uint8_t *)VRAM_A, (uint8_t *)VRAM_E);
+    num_live = 0;
+
+    // Use almost all nodes of the pool so that it has to grow when the
+    // allocation is moved and a new free node is created after it.
+    for (int i = 0; i < 29; i++)
+        add_live(mb, vramBlock_allocateBlock(mb, 0x100, 3));
+
+    uint8_t *want = (uint8_t *)VRAM_A + 0x10000;
+    CHECK_EQ((uintptr_t)vramBlock_examineSpecial(mb, want, 0x100, 3), (uintptr_t)want);
+    uint32_t index = vramBlock_allocateSpecial(mb, want, 0x100);
+    CHECK(index != 0);
+    add_live(mb, index);
+    check_block(mb);
+
+    uint32_t numNodes = mb->numNodes;
+    compact(mb);
+    CHECK(mb->numNodes > numNodes);
+    CHECK_EQ((uintptr_t)vramBlock_getAddr(mb, index), (uintptr_t)VRAM_A + 29 * 0x100);
+
+    // Moves that aren't allowed
+    CHECK_EQ(vramBlock_moveDown(mb, index, (uint32_t)VRAM_A), 0);
+    CHECK_EQ(vramBlock_moveDown(mb, live[0].index, (uint32_t)VRAM_A), 0);
+
+    // Compaction after random allocations and frees
+    for (int n = 0; n < 200; n++)
+    {
+        if ((num_live > 0) && (test_rand() % 100 < 50))
+        {
+            free_random(mb);
+        }
+        else
+        {
+            index = vramBlock_allocateBlock(mb, random_texture_size(), 3);
+            if (index != 0)
+                add_live(mb, index);
+        }
+
+        if ((n % 20) == 19)
+            compact(mb);
+    }
+
+    while (num_live > 0)
+        free_random(mb);
+    check_block(mb);
+
+    vramBlock_Deconstruct(mb);
+}
+
+// Benchmarks
+// ==========
+
+#define TRACE_OPS   200000
+
+typedef struct {
+    uint32_t size; // 0 to free an allocation
+    uint32_t slot; // Index in the list of live allocations to free
+} TraceOp;
+
+static TraceOp trace[TRACE_OPS];
+
+// Textures of a few sizes are loaded and freed in random order, like when the
+// levels of a game are loaded. The number of live textures changes slowly.
+static void gen_trace_levels(void)
+{
+    int live_count = 0;
+    int target = 50;
+
+    for (int i = 0; i < TRACE_OPS; i++)
+    {
+        if ((i % 2000) == 0)
+            target = 20 + (test_rand() % 200);
+
+        if ((live_count > 0) && ((live_count > target) || (test_rand() & 1)))
+        {
+            trace[i].size = 0;
+            trace[i].slot = test_rand() % live_count;
+            live_count--;
+        }
+        else
+        {
+            trace[i].size = random_texture_size();
+            live_count++;
+        }
+    }
+}
+
+// Many small textures (fonts, sprites, particles)
+static void gen_trace_small(void)
+{
+    int live_count = 0;
+
+    for (int i = 0; i < TRACE_OPS; i++)
+    {
+        if ((live_count > 0) && ((live_count >= 1500) || (test_rand() % 100 < 48)))
+        {
+            trace[i].size = 0;
+            trace[i].slot = test_rand() % live_count;
+            live_count--;
+        }
+        else
+        {
+            trace[i].size = (8 << (test_rand() % 3)) * (8 << (test_rand() % 3));
+            live_count++;
+        }
+    }
+}
+
+// Allocator that checks all free nodes in address order, like the allocator
+// used by videoGL before the tree of free nodes was added.
+static uint32_t linear_allocate(s_vramBlock *mb, uint32_t size, uint8_t align)
+{
+    uint32_t addr = best_fit(mb, size, align);
+    if (addr == 0)
+        return 0;
+
+    vramBlock_examineSpecial(mb, (uint8_t *)addr, size, align);
+    return vramBlock_allocateSpecial(mb, (uint8_t *)addr, size);
+}
+
+static void replay(const char *name, bool linear)
+{
+    static uint32_t slots[TRACE_OPS];
+    int live_count = 0;
+    uint32_t failed = 0;
+    uint32_t max_nodes = 0;
+
+    s_vramBlock *mb = vramBlock_Construct((uint8_t *)VRAM_A, (uint8_t *)VRAM_E);
+
+    uint64_t start = hostTimeNs();
+
+    for (int i = 0; i < TRACE_OPS; i++)
+    {
+        if (trace[i].size == 0)
+        {
+            // Frees of allocations that failed are skipped
+            uint32_t slot = trace[i].slot;
+            if (slots[slot] != 0)
+                vramBlock_deallocateBlock(mb, slots[slot]);
+            slots[slot] = slots[--live_count];
+        }
+        else
+        {
+            uint32_t index = linear ? linear_allocate(mb, trace[i].size, 3)
+                                    : vramBlock_allocateBlock(mb, trace[i].size, 3);
+            if (index == 0)
+                failed++;
+            slots[live_count++] = index;
+
+            if (mb->freeNodes > max_nodes)
+                max_nodes = mb->freeNodes;
+        }
+    }
+
+    uint64_t t = hostTimeNs() - start;
+
+    uint32_t freeBytes, largest, nodes;
+    vramBlock_getStats(mb, &freeBytes, &largest, &nodes);
+
+    printf("  %-22s %6.1f ns/op  failed %5lu  free %6lu B in %4lu blocks "
+           "(max %4lu), largest %6lu B, fragmentation %4.1f%%\n",
+           name, (double)t / TRACE_OPS, (unsigned long)failed,
+           (unsigned long)freeBytes, (unsigned long)nodes,
+           (unsigned long)max_nodes, (unsigned long)largest,
+           freeBytes ? 100.0 * (freeBytes - largest) / freeBytes : 0.0);
+
+    vramBlock_Deconstruct(mb);
+}
+
+// Worst cases of the tree: many holes that are too small for the allocations,
+// which the tree skips, and many holes that are big enough but are in a locked
+// bank, which the tree has to check one by one like the linear allocator.
+#define HOLES       900
+#define HOLE_SIZE   128
+#define HOLE_OPS    20000
+
+static void replay_holes(const char *name, bool locked, bool linear)
+{
+    static uint32_t hole[HOLES], keep[HOLES];
+
+    s_vramBlock *mb = vramBlock_Construct((uint8_t *)VRAM_A, (uint8_t *)VRAM_E);
+
+    // All holes are in VRAM_A, separated by small allocations
+    for (int i = 0; i < HOLES; i++)
+    {
+        hole[i] = vramBlock_allocateBlock(mb, HOLE_SIZE, 3);
+        keep[i] = vramBlock_allocateBlock(mb, 8, 3);
+        CHECK(hole[i] != 0 && keep[i] != 0);
+        CHECK((uintptr_t)vramBlock_getAddr(mb, keep[i]) < (uintptr_t)VRAM_B);
+    }
+    for (int i = 0; i < HOLES; i++)
+        vramBlock_deallocateBlock(mb, hole[i]);
+
+    if (locked)
+        mb->lock = BIT(0); // VRAM_A
+
+    uint32_t size = locked ? HOLE_SIZE : HOLE_SIZE + 8;
+    uintptr_t end = (uintptr_t)vramBlock_getAddr(mb, keep[HOLES - 1]);
+
+    uint64_t start = hostTimeNs();
+
+    for (int i = 0; i < HOLE_OPS; i++)
+    {
+        uint32_t index = linear ? linear_allocate(mb, size, 3)
+                                : vramBlock_allocateBlock(mb, size, 3);
+        CHECK((uintptr_t)vramBlock_getAddr(mb, index) > end);
+        vramBlock_deallocateBlock(mb, index);
+    }
+
+    uint64_t t = hostTimeNs() - start;
+
+    printf("  %-22s %6.1f ns/op  %lu free blocks\n", name,
+           (double)t / HOLE_OPS, (unsigned long)mb->freeNodes);
+
+    vramBlock_Deconstruct(mb);
+}
+
+static void bench(void)
+{
+    printf("Replay of %d allocations and frees of texture VRAM:\n", TRACE_OPS);
+
+    gen_trace_levels();
+    replay("levels, tree", false);
+    replay("levels, linear", true);
+
+    gen_trace_small();
+    replay("small, tree", false);
+    replay("small, linear", true);
+
+    printf("Allocations with %d free blocks in VRAM_A:\n", HOLES);
+
+    replay_holes("too small, tree", false, false);
+    replay_holes("too small, linear", false, true);
+    replay_holes("locked bank, tree", true, false);
+    replay_holes("locked bank, linear", true, true);
+}
+
+int main(int argc, char *argv[])
+{
+    test_random();
+    test_banks();
+    test_compressed();
+    test_special();
+    test_move_down();
+
+    if (test_bench_requested(argc, argv))
+        bench();
+
+    return test_end("vramalloc");
+}
@@ -0,0 +1,368 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Parsers of BDF fonts (version 2.1, and the 2.3 extension for fonts with more
+// than one bit per pixel) and of kerning lists.
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fontgen.h"
+
+// Longer lines are truncated. The longest lines that need to be read whole are
+// bitmap rows, which have up to 255 pixels of 8 bits (510 characters).
+#define MAX_LINE_SIZE   1024
+
+typedef struct
+{
+    const char *p;
+    const char *end;
+    int number;
+    char line[MAX_LINE_SIZE];
+} Reader;
+
+static bool reader_next(Reader *r)
+{
+    if (r->p >= r->end)
+        return false;
+
+    size_t len = 0;
+    while ((r->p < r->end) && (*r->p != '\n'))
+    {
+        if (len < sizeof(r->line) - 1)
+            r->line[len++] = *r->p;
+        r->p++;
+    }
+
+    if (r->p < r->end)
+        r->p++;
+
+    while ((len > 0) && ((r->line[len - 1] == '\r') || (r->line[len - 1] == ' ')
+                         || (r->line[len - 1] == '\t')))
+        len--;
+
+    r->line[len] = '\0';
+    r->number++;
+
+    return true;
+}
+
+static bool fail(FontgenFont *font, int line, const char *fmt, ...)
+{
+    size_t len = 0;
+
+    if (line > 0)
+        len = snprintf(font->error, sizeof(font->error), "line %d: ", line);
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(font->error + len, sizeof(font->error) - len, fmt, args);
+    va_end(args);
+
+    return false;
+}
+
+// Returns true if the line starts with the keyword followed by a space or the
+// end of the line.
+static bool keyword(const char *line, const char *kw)
+{
+    size_t len = strlen(kw);
+
+    if (strncmp(line, kw, len) != 0)
+        return false;
+
+    return (line[len] == '\0') || (line[len] == ' ') || (line[len] == '\t');
+}
+
+static int hex_value(char c)
+{
+    if ((c >= '0') && (c <= '9'))
+        return c - '0';
+    if ((c >= 'A') && (c <= 'F'))
+        return c - 'A' + 10;
+    if ((c >= 'a') && (c <= 'f'))
+        return c - 'a' + 10;
+    return -1;
+}
+
+// Reads the BITMAP section of a character. Rows are padded to a byte, and the
+// first pixel is stored in the most significant bits of the first byte.
+static bool parse_bitmap(FontgenFont *font, Reader *r, int depth,
+                         FontgenGlyph *g)
+{
+    size_t row_bytes = (g->width * depth + 7) / 8;
+    unsigned int mask = (1 << depth) - 1;
+
+    g->pixels = calloc((g->width * g->height) + 1, 1);
+    if (g->pixels == NULL)
+        return fail(font, 0, "out of memory");
+
+    for (int y = 0; y < g->height; y++)
+    {
+        if (!reader_next(r))
+            return fail(font, r->number, "missing bitmap rows");
+
+        const char *line = r->line;
+        if (strlen(line) < row_bytes * 2)
+            return fail(font, r->number, "bitmap row too short");
+
+        for (int x = 0; x < g->width; x++)
+        {
+            int bit = x * depth;
+            int hi = hex_value(line[(bit >> 3) * 2]);
+            int lo = hex_value(line[(bit >> 3) * 2 + 1]);
+            if ((hi < 0) || (lo < 0))
+                return fail(font, r->number, "invalid bitmap row");
+
+            unsigned int byte = (hi << 4) | lo;
+            unsigned int v = (byte >> (8 - depth - (bit & 7))) & mask;
+
+            // Fonts of 8 bits per pixel are reduced to 4 bits per pixel
+            if (depth == 8)
+                v >>= 4;
+
+            g->pixels[y * g->width + x] = v;
+        }
+    }
+
+    return true;
+}
+
+// Reads a character from the line after STARTCHAR to ENDCHAR. Characters
+// without an encoding are skipped.
+static bool parse_char(FontgenFont *font, Reader *r, int depth)
+{
+    FontgenGlyph g = { 0 };
+    long encoding = -1;
+    bool has_advance = false;
+    bool has_bbx = false;
+    bool has_bitmap = false;
+    int start = r->number;
+
+    while (reader_next(r))
+    {
+        const char *l = r->line;
+
+        if (keyword(l, "ENCODING"))
+        {
+            if (sscanf(l, "ENCODING %ld", &encoding) != 1)
+                goto bad_line;
+        }
+        else if (keyword(l, "DWIDTH"))
+        {
+            if (sscanf(l, "DWIDTH %d", &g.advance) != 1)
+                goto bad_line;
+            has_advance = true;
+        }
+        else if (keyword(l, "BBX"))
+        {
+            if (sscanf(l, "BBX %d %d %d %d", &g.width, &g.height, &g.x_offset,
+                       &g.y_offset) != 4)
+                goto bad_line;
+            if ((g.width < 0) || (g.height < 0) || (g.width > 4096)
+                || (g.height > 4096))
+                goto bad_line;
+            has_bbx = true;
+        }
+        else if (keyword(l, "BITMAP"))
+        {
+            if (!has_bbx || has_bitmap)
+                goto bad_line;
+            has_bitmap = true;
+            if (!parse_bitmap(font, r, depth, &g))
+                goto error;
+        }
+        else if (keyword(l, "ENDCHAR"))
+        {
+            if (encoding < 0)
+            {
+                free(g.pixels);
+                return true;
+            }
+
+            if (encoding > 0x10FFFF)
+            {
+                fail(font, start, "invalid encoding %ld", encoding);
+                goto error;
+            }
+
+            if (!has_advance || !has_bitmap)
+            {
+                fail(font, start, "character without DWIDTH or BITMAP");
+                goto error;
+            }
+
+            g.codepoint = encoding;
+
+            FontgenGlyph *glyphs = realloc(font->glyphs, (font->num_glyphs + 1)
+                                           * sizeof(FontgenGlyph));
+            if (glyphs == NULL)
+            {
+                fail(font, 0, "out of memory");
+                goto error;
+            }
+
+            font->glyphs = glyphs;
+            font->glyphs[font->num_glyphs++] = g;
+            return true;
+        }
+    }
+
+    fail(font, start, "missing ENDCHAR");
+    goto error;
+
+bad_line:
+    fail(font, r->number, "invalid line: %s", r->line);
+error:
+    free(g.pixels);
+    return false;
+}
+
+bool fontgen_parse_bdf(FontgenFont *font, const char *text, size_t size)
+{
+    Reader r = { text, text + size, 0, { 0 } };
+    int depth = 1;
+    int ascent = -1, descent = -1;
+    int bbx_height = 0, bbx_y_offset = 0;
+    bool has_bbx = false;
+    bool started = false;
+
+    font->error[0] = '\0';
+
+    while (reader_next(&r))
+    {
+        const char *l = r.line;
+
+        if (!started)
+        {
+            if (!keyword(l, "STARTFONT"))
+                return fail(font, r.number, "expected STARTFONT");
+            started = true;
+        }
+        else if (keyword(l, "SIZE"))
+        {
+            int point_size, x_res, y_res;
+
+            // The bits per pixel are optional
+            if (sscanf(l, "SIZE %d %d %d %d", &point_size, &x_res, &y_res,
+                       &depth) < 3)
+                return fail(font, r.number, "invalid line: %s", l);
+
+            if ((depth != 1) && (depth != 2) && (depth != 4) && (depth != 8))
+                return fail(font, r.number, "unsupported bits per pixel: %d", depth);
+        }
+        else if (keyword(l, "FONTBOUNDINGBOX"))
+        {
+            int width, x_offset;
+
+            if (sscanf(l, "FONTBOUNDINGBOX %d %d %d %d", &width, &bbx_height,
+                       &x_offset, &bbx_y_offset) != 4)
+                return fail(font, r.number, "invalid line: %s", l);
+            has_bbx = true;
+        }
+        else if (keyword(l, "FONT_ASCENT"))
+        {
+            if (sscanf(l, "FONT_ASCENT %d", &ascent) != 1)
+                return fail(font, r.number, "invalid line: %s", l);
+        }
+        else if (keyword(l, "FONT_DESCENT"))
+        {
+            if (sscanf(l, "FONT_DESCENT %d", &descent) != 1)
+                return fail(font, r.number, "invalid line: %s", l);
+        }
+        else if (keyword(l, "STARTCHAR"))
+        {
+            if (!parse_char(font, &r, depth))
+                return false;
+        }
+        else if (keyword(l, "ENDFONT"))
+        {
+            // The properties are optional, the bounding box isn't
+            if (ascent < 0)
+                ascent = has_bbx ? bbx_height + bbx_y_offset : -1;
+            if (descent < 0)
+                descent = has_bbx ? -bbx_y_offset : -1;
+
+            if ((ascent < 0) || (descent < 0))
+                return fail(font, 0, "the font doesn't define its ascent and descent");
+
+            font->bpp = (depth == 8) ? 4 : depth;
+            font->ascent = ascent;
+            font->descent = descent;
+            return true;
+        }
+    }
+
+    return fail(font, 0, started ? "missing ENDFONT" : "empty file");
+}
+
+bool fontgen_parse_kerning(FontgenFont *font, const char *text, size_t size)
+{
+    Reader r = { text, text + size, 0, { 0 } };
+
+    font->error[0] = '\0';
+
+    while (reader_next(&r))
+    {
+        char *comment = strchr(r.line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+
+        char *p = r.line;
+        char *end;
+        long values[3];
+        int count = 0;
+
+        while (count < 3)
+        {
+            values[count] = strtol(p, &end, 0);
+            if (end == p)
+                break;
+            p = end;
+            count++;
+        }
+
+        while ((*p == ' ') || (*p == '\t'))
+            p++;
+
+        if ((count == 0) && (*p == '\0'))
+            continue;
+
+        if ((count != 3) || (*p != '\0') || (values[0] < 0) || (values[1] < 0)
+            || (values[0] > 0x10FFFF) || (values[1] > 0x10FFFF))
+            return fail(font, r.number, "invalid kerning pair: %s", r.line);
+
+        FontgenKerning *kerning = realloc(font->kerning, (font->num_kerning + 1)
+                                          * sizeof(FontgenKerning));
+        if (kerning == NULL)
+            return fail(font, 0, "out of memory");
+
+        font->kerning = kerning;
+        font->kerning[font->num_kerning++] = (FontgenKerning){
+            .left = values[0],
+            .right = values[1],
+            .amount = values[2],
+        };
+    }
+
+    return true;
+}
+
+void fontgen_free(FontgenFont *font)
+{
+    for (size_t i = 0; i < font->num_glyphs; i++)
+        free(font->glyphs[i].pixels);
+
+    free(font->glyphs);
+    free(font->kerning);
+
+    font->glyphs = NULL;
+    font->num_glyphs = 0;
+    font->kerning = NULL;
+    font->num_kerning = 0;
+}
@@ -0,0 +1,288 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Generator of the binary font format of libnds.
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nds/arm9/font.h>
+
+#include "fontgen.h"
+
+// font.c stores glyph indices in 16-bit signed integers
+#define MAX_GLYPHS      0x7FFF
+
+#define ALIGN4(x)       (((x) + 3) & ~(size_t)3)
+
+// Glyph after removing the empty rows and columns around it
+typedef struct
+{
+    int left;
+    int top;
+    int width;
+    int height;
+    int x_offset; // From the pen position to the left of the bitmap
+    int y_offset; // From the baseline to the top of the bitmap, Y points down
+    size_t bitmap;
+} Crop;
+
+static void *fail(FontgenFont *font, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(font->error, sizeof(font->error), fmt, args);
+    va_end(args);
+
+    return NULL;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+static int compare_glyphs(const void *a, const void *b)
+{
+    uint32_t ca = ((const FontgenGlyph *)a)->codepoint;
+    uint32_t cb = ((const FontgenGlyph *)b)->codepoint;
+
+    return (ca > cb) - (ca < cb);
+}
+
+static int compare_pairs(const void *a, const void *b)
+{
+    uint32_t ka = *(const uint32_t *)a;
+    uint32_t kb = *(const uint32_t *)b;
+
+    return (ka > kb) - (ka < kb);
+}
+
+static int find_glyph(const FontgenFont *font, uint32_t codepoint)
+{
+    FontgenGlyph key = { .codepoint = codepoint };
+    const FontgenGlyph *g = bsearch(&key, font->glyphs, font->num_glyphs,
+                                    sizeof(FontgenGlyph), compare_glyphs);
+
+    return (g == NULL) ? -1 : (int)(g - font->glyphs);
+}
+
+static void crop_glyph(const FontgenGlyph *g, Crop *c)
+{
+    int left = g->width, right = 0, top = g->height, bottom = 0;
+
+    for (int y = 0; y < g->height; y++)
+    {
+        for (int x = 0; x < g->width; x++)
+        {
+            if (g->pixels[y * g->width + x] == 0)
+                continue;
+
+            if (x < left)
+                left = x;
+            if (x >= right)
+                right = x + 1;
+            if (y < top)
+                top = y;
+            if (y >= bottom)
+                bottom = y + 1;
+        }
+    }
+
+    if (right == 0)
+    {
+        *c = (Crop){ 0 };
+        return;
+    }
+
+    c->left = left;
+    c->top = top;
+    c->width = right - left;
+    c->height = bottom - top;
+    c->x_offset = g->x_offset + left;
+    c->y_offset = top - (g->y_offset + g->height);
+}
+
+void *fontgen_build(FontgenFont *font, size_t *size)
+{
+    int bpp = font->bpp;
+
+    font->error[0] = '\0';
+
+    if ((bpp != 1) && (bpp != 2) && (bpp != 4))
+        return fail(font, "unsupported bits per pixel: %d", bpp);
+
+    if ((font->ascent < 0) || (font->descent < 0)
+        || (font->ascent + font->descent > 255))
+        return fail(font, "invalid ascent and descent: %d, %d", font->ascent,
+                    font->descent);
+
+    if (font->num_glyphs > MAX_GLYPHS)
+        return fail(font, "too many glyphs: %zu (max %d)", font->num_glyphs,
+                    MAX_GLYPHS);
+
+    qsort(font->glyphs, font->num_glyphs, sizeof(FontgenGlyph), compare_glyphs);
+
+    for (size_t i = 1; i < font->num_glyphs; i++)
+    {
+        if (font->glyphs[i].codepoint == font->glyphs[i - 1].codepoint)
+            return fail(font, "U+%04X is defined twice", font->glyphs[i].codepoint);
+    }
+
+    // Kerning pairs are sorted by glyph index. Each one is stored as the two
+    // indices in a word, used as sorting key, and the amount.
+    uint32_t *pairs = malloc((font->num_kerning + 1) * 2 * sizeof(uint32_t));
+    Crop *crops = malloc((font->num_glyphs + 1) * sizeof(Crop));
+    if ((pairs == NULL) || (crops == NULL))
+    {
+        free(pairs);
+        free(crops);
+        return fail(font, "out of memory");
+    }
+
+    uint8_t *blob = NULL;
+
+    for (size_t i = 0; i < font->num_kerning; i++)
+    {
+        const FontgenKerning *k = &font->kerning[i];
+        int left = find_glyph(font, k->left);
+        int right = find_glyph(font, k->right);
+
+        if ((left < 0) || (right < 0))
+        {
+            fail(font, "kerning pair U+%04X U+%04X: character not in the font",
+                 k->left, k->right);
+            goto end;
+        }
+
+        if ((k->amount < INT16_MIN) || (k->amount > INT16_MAX))
+        {
+            fail(font, "kerning pair U+%04X U+%04X: invalid amount %d",
+                 k->left, k->right, k->amount);
+            goto end;
+        }
+
+        pairs[i * 2] = ((uint32_t)left << 16) | right;
+        pairs[i * 2 + 1] = (uint16_t)k->amount;
+    }
+
+    qsort(pairs, font->num_kerning, 2 * sizeof(uint32_t), compare_pairs);
+
+    for (size_t i = 1; i < font->num_kerning; i++)
+    {
+        if (pairs[i * 2] == pairs[(i - 1) * 2])
+        {
+            const FontgenGlyph *g = font->glyphs;
+            fail(font, "kerning pair U+%04X U+%04X is defined twice",
+                 g[pairs[i * 2] >> 16].codepoint, g[pairs[i * 2] & 0xFFFF].codepoint);
+            goto end;
+        }
+    }
+
+    // Size of the bitmaps of all glyphs
+    size_t bitmaps_size = 0;
+
+    for (size_t i = 0; i < font->num_glyphs; i++)
+    {
+        const FontgenGlyph *g = &font->glyphs[i];
+        Crop *c = &crops[i];
+
+        crop_glyph(g, c);
+
+        if ((c->width > 255) || (c->height > 255) || (c->x_offset < INT8_MIN)
+            || (c->x_offset > INT8_MAX) || (c->y_offset < INT8_MIN)
+            || (c->y_offset > INT8_MAX) || (g->advance < 0) || (g->advance > 255))
+        {
+            fail(font, "U+%04X: glyph too big for the format", g->codepoint);
+            goto end;
+        }
+
+        c->bitmap = bitmaps_size;
+        bitmaps_size += ((c->width * bpp + 7) / 8) * c->height;
+    }
+
+    size_t glyphs_offset = sizeof(FontHeader);
+    size_t kerning_offset = glyphs_offset + font->num_glyphs * sizeof(FontGlyph);
+    size_t bitmaps_offset = ALIGN4(kerning_offset
+                                   + font->num_kerning * sizeof(FontKerning));
+    size_t total = ALIGN4(bitmaps_offset + bitmaps_size);
+
+    blob = calloc(total, 1);
+    if (blob == NULL)
+    {
+        fail(font, "out of memory");
+        goto end;
+    }
+
+    put32(blob + offsetof(FontHeader, magic), FONT_MAGIC);
+    blob[offsetof(FontHeader, version)] = FONT_VERSION;
+    blob[offsetof(FontHeader, bpp)] = bpp;
+    blob[offsetof(FontHeader, line_height)] = font->ascent + font->descent;
+    blob[offsetof(FontHeader, ascent)] = font->ascent;
+    put16(blob + offsetof(FontHeader, num_glyphs), font->num_glyphs);
+    put16(blob + offsetof(FontHeader, num_kerning), font->num_kerning);
+    put32(blob + offsetof(FontHeader, glyphs_offset), glyphs_offset);
+    put32(blob + offsetof(FontHeader, kerning_offset), kerning_offset);
+    put32(blob + offsetof(FontHeader, bitmaps_offset), bitmaps_offset);
+
+    for (size_t i = 0; i < font->num_glyphs; i++)
+    {
+        const FontgenGlyph *g = &font->glyphs[i];
+        const Crop *c = &crops[i];
+        uint8_t *p = blob + glyphs_offset + i * sizeof(FontGlyph);
+
+        put32(p + offsetof(FontGlyph, codepoint), g->codepoint);
+        put32(p + offsetof(FontGlyph, bitmap), c->bitmap);
+        p[offsetof(FontGlyph, width)] = c->width;
+        p[offsetof(FontGlyph, height)] = c->height;
+        p[offsetof(FontGlyph, x_offset)] = (uint8_t)c->x_offset;
+        p[offsetof(FontGlyph, y_offset)] = (uint8_t)c->y_offset;
+        p[offsetof(FontGlyph, advance)] = g->advance;
+
+        // Rows start at a byte boundary, with the first pixel in the least
+        // significant bits.
+        uint8_t *dst = blob + bitmaps_offset + c->bitmap;
+        size_t stride = (c->width * bpp + 7) / 8;
+
+        for (int y = 0; y < c->height; y++)
+        {
+            const uint8_t *src = g->pixels + (c->top + y) * g->width + c->left;
+
+            for (int x = 0; x < c->width; x++)
+            {
+                int bit = x * bpp;
+                dst[bit >> 3] |= src[x] << (bit & 7);
+            }
+
+            dst += stride;
+        }
+    }
+
+    for (size_t i = 0; i < font->num_kerning; i++)
+    {
+        uint8_t *p = blob + kerning_offset + i * sizeof(FontKerning);
+
+        put16(p + offsetof(FontKerning, left), pairs[i * 2] >> 16);
+        put16(p + offsetof(FontKerning, right), pairs[i * 2] & 0xFFFF);
+        put16(p + offsetof(FontKerning, amount), pairs[i * 2 + 1]);
+    }
+
+    *size = total;
+
+end:
+    free(pairs);
+    free(crops);
+    return blob;
+}
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#ifndef TOOLS_FONTGEN_FONTGEN_H__
+#define TOOLS_FONTGEN_FONTGEN_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Glyph of a font loaded from a BDF file. The offsets follow the conventions of
+// BDF: they go from the pen position on the baseline to the bottom left corner
+// of the bitmap, and the Y axis points up.
+typedef struct
+{
+    uint32_t codepoint;
+    int width;
+    int height;
+    int x_offset;
+    int y_offset;
+    int advance;
+    uint8_t *pixels; // One byte per pixel, from 0 to (1 << bpp) - 1
+} FontgenGlyph;
+
+// Kerning adjustment between two codepoints.
+typedef struct
+{
+    uint32_t left;
+    uint32_t right;
+    int amount;
+} FontgenKerning;
+
+typedef struct
+{
+    int bpp; // 1, 2 or 4
+    int ascent;
+    int descent;
+
+    FontgenGlyph *glyphs;
+    size_t num_glyphs;
+
+    FontgenKerning *kerning;
+    size_t num_kerning;
+
+    char error[256]; // Description of the last error
+} FontgenFont;
+
+// Parses a BDF font and adds its glyphs to an empty font (initialized to zero).
+// Glyphs without an encoding are ignored. Fonts of 8 bits per pixel are
+// reduced to 4 bits per pixel.
+//
+// It returns false on error, with a description of the error in font->error.
+bool fontgen_parse_bdf(FontgenFont *font, const char *text, size_t size);
+
+// Parses a list of kerning pairs and adds them to a font. Each line has the
+// codepoints of the left and right characters and the adjustment in pixels,
+// like "0x41 0x56 -1". Empty lines and text after '#' are ignored.
+//
+// It returns false on error, with a description of the error in font->error.
+bool fontgen_parse_kerning(FontgenFont *font, const char *text, size_t size);
+
+// Generates the binary font format of libnds (check nds/arm9/font.h). Empty
+// rows and columns around glyphs are removed.
+//
+// It returns a buffer allocated with malloc() and its size, or NULL on error,
+// with a description of the error in font->error.
+void *fontgen_build(FontgenFont *font, size_t *size);
+
+// Frees the glyphs and kerning pairs of a font.
+void fontgen_free(FontgenFont *font);
+
+#endif // TOOLS_FONTGEN_FONTGEN_H__
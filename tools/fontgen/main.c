@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Converter of BDF fonts to the font format of libnds. The output can be used
+// with fontInit().
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fontgen.h"
+
+static char *load_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char *buf = malloc(len + 1);
+    if (buf == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        fclose(f);
+        return NULL;
+    }
+
+    if (fread(buf, 1, len, f) != (size_t)len)
+    {
+        fprintf(stderr, "Can't read %s\n", path);
+        free(buf);
+        fclose(f);
+        return NULL;
+    }
+
+    fclose(f);
+
+    *size = len;
+    return buf;
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [-k kerning.txt] input.bdf output\n"
+           "\n"
+           "Converts a BDF font to the font format of libnds. Fonts with 1, 2\n"
+           "and 4 bits per pixel keep their depth. Fonts with 8 bits per pixel\n"
+           "are reduced to 4 bits per pixel.\n"
+           "\n"
+           "BDF fonts don't have kerning information. It can be provided in a\n"
+           "text file with one pair per line: the codepoints of the left and\n"
+           "right characters and the adjustment in pixels. For example:\n"
+           "\n"
+           "    0x41 0x56 -1  # A V\n",
+           name);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *kerning_path = NULL;
+    int arg = 1;
+
+    if ((argc == 5) && (strcmp(argv[1], "-k") == 0))
+    {
+        kerning_path = argv[2];
+        arg = 3;
+    }
+    else if (argc != 3)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FontgenFont font = { 0 };
+    size_t size;
+
+    char *bdf = load_file(argv[arg], &size);
+    if (bdf == NULL)
+        return 1;
+
+    if (!fontgen_parse_bdf(&font, bdf, size))
+    {
+        fprintf(stderr, "%s: %s\n", argv[arg], font.error);
+        return 1;
+    }
+
+    free(bdf);
+
+    if (kerning_path != NULL)
+    {
+        char *kerning = load_file(kerning_path, &size);
+        if (kerning == NULL)
+            return 1;
+
+        if (!fontgen_parse_kerning(&font, kerning, size))
+        {
+            fprintf(stderr, "%s: %s\n", kerning_path, font.error);
+            return 1;
+        }
+
+        free(kerning);
+    }
+
+    void *out = fontgen_build(&font, &size);
+    if (out == NULL)
+    {
+        fprintf(stderr, "%s\n", font.error);
+        return 1;
+    }
+
+    FILE *f = fopen(argv[arg + 1], "wb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Can't open %s: %s\n", argv[arg + 1], strerror(errno));
+        return 1;
+    }
+
+    if (fwrite(out, 1, size, f) != size)
+    {
+        fprintf(stderr, "Can't write %s\n", argv[arg + 1]);
+        fclose(f);
+        return 1;
+    }
+
+    fclose(f);
+
+    free(out);
+    fontgen_free(&font);
+
+    return 0;
+}
@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz16.h"
+
+#define LZ16_TYPE           0x50
+
+#define MIN_MATCH           2       // In halfwords
+#define MAX_OFFSET          0xFFFF  // In halfwords
+
+#define HASH_BITS           16
+#define MAX_CHAIN_DEPTH     128
+
+size_t lz16_compress_bound(size_t size)
+{
+    // Header, one token, all data as literals and the length bytes
+    return 4 + 1 + size + (size / 2) / 255 + 1;
+}
+
+static uint32_t hash(const uint16_t *h)
+{
+    uint32_t v = h[0] | ((uint32_t)h[1] << 16);
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static uint8_t *write_length(uint8_t *out, size_t value)
+{
+    while (value >= 255)
+    {
+        *out++ = 255;
+        value -= 255;
+    }
+    *out++ = value;
+    return out;
+}
+
+static uint8_t *write_sequence(uint8_t *out, const uint16_t *literals,
+                               size_t num_literals, size_t offset, size_t len)
+{
+    size_t l = num_literals < 15 ? num_literals : 15;
+    size_t m = 0;
+
+    if (len > 0)
+    {
+        m = len - MIN_MATCH;
+        if (m > 15)
+            m = 15;
+    }
+
+    *out++ = (l << 4) | m;
+
+    if (num_literals >= 15)
+        out = write_length(out, num_literals - 15);
+
+    for (size_t i = 0; i < num_literals; i++)
+    {
+        *out++ = literals[i] & 0xFF;
+        *out++ = literals[i] >> 8;
+    }
+
+    if (len == 0) // Last sequence
+        return out;
+
+    *out++ = offset & 0xFF;
+    *out++ = offset >> 8;
+
+    if (len - MIN_MATCH >= 15)
+        out = write_length(out, len - MIN_MATCH - 15);
+
+    return out;
+}
+
+typedef struct {
+    const uint16_t *data;
+    size_t count;
+    int32_t *head;
+    int32_t *prev;
+} MatchFinder;
+
+static void finder_insert(MatchFinder *f, size_t pos)
+{
+    if (pos + MIN_MATCH > f->count)
+        return;
+
+    uint32_t h = hash(&f->data[pos]);
+    f->prev[pos] = f->head[h];
+    f->head[h] = pos;
+}
+
+// Returns the length of the longest match at "pos" and its offset.
+static size_t finder_find(MatchFinder *f, size_t pos, size_t *offset)
+{
+    if (pos + MIN_MATCH > f->count)
+        return 0;
+
+    const uint16_t *data = f->data;
+    size_t max_len = f->count - pos;
+    size_t best_len = 0;
+    int32_t candidate = f->head[hash(&data[pos])];
+
+    for (int depth = 0; (candidate >= 0) && (depth < MAX_CHAIN_DEPTH); depth++)
+    {
+        size_t dist = pos - candidate;
+        if (dist > MAX_OFFSET)
+            break;
+
+        // Check the halfword that would make this match longer than the best
+        // one found so far before checking the whole match.
+        if (data[candidate + best_len] == data[pos + best_len])
+        {
+            size_t len = 0;
+            while ((len < max_len) && (data[candidate + len] == data[pos + len]))
+                len++;
+
+            if (len > best_len)
+            {
+                best_len = len;
+                *offset = dist;
+                if (len == max_len)
+                    break;
+            }
+        }
+
+        candidate = f->prev[candidate];
+    }
+
+    if (best_len < MIN_MATCH)
+        return 0;
+
+    return best_len;
+}
+
+size_t lz16_compress(const uint8_t *in, size_t size, uint8_t *out)
+{
+    if ((size & 1) || (size >= (1 << 24)))
+        return 0;
+
+    size_t count = size / 2;
+
+    uint16_t *data = malloc((count + 1) * sizeof(uint16_t));
+    int32_t *head = malloc((1 << HASH_BITS) * sizeof(int32_t));
+    int32_t *prev = malloc((count + 1) * sizeof(int32_t));
+
+    if ((data == NULL) || (head == NULL) || (prev == NULL))
+    {
+        free(data);
+        free(head);
+        free(prev);
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        data[i] = in[i * 2] | (in[i * 2 + 1] << 8);
+
+    for (size_t i = 0; i < (1 << HASH_BITS); i++)
+        head[i] = -1;
+
+    MatchFinder f = { data, count, head, prev };
+
+    uint32_t header = (size << 8) | LZ16_TYPE;
+    out[0] = header;
+    out[1] = header >> 8;
+    out[2] = header >> 16;
+    out[3] = header >> 24;
+
+    uint8_t *o = out + 4;
+
+    size_t pos = 0;
+    size_t literal_start = 0;
+
+    while (pos < count)
+    {
+        size_t offset = 0;
+        size_t len = finder_find(&f, pos, &offset);
+
+        if (len > 0)
+        {
+            // Lazy matching: if the match that starts at the next halfword is
+            // longer, emit this halfword as a literal.
+            finder_insert(&f, pos);
+
+            size_t next_offset = 0;
+            size_t next_len = finder_find(&f, pos + 1, &next_offset);
+
+            if (next_len > len + 1)
+            {
+                pos++;
+                offset = next_offset;
+                len = next_len;
+            }
+            else
+            {
+                // Undo the insertion, it's done again below
+                head[hash(&data[pos])] = prev[pos];
+            }
+        }
+
+        if (len == 0)
+        {
+            finder_insert(&f, pos);
+            pos++;
+            continue;
+        }
+
+        o = write_sequence(o, &data[literal_start], pos - literal_start,
+                           offset, len);
+
+        for (size_t i = 0; i < len; i++)
+            finder_insert(&f, pos + i);
+
+        pos += len;
+        literal_start = pos;
+    }
+
+    // The last sequence only has literals. If the data ends with a match it
+    // isn't needed, the decoder stops when the output buffer is full.
+    if (literal_start < count)
+        o = write_sequence(o, &data[literal_start], count - literal_start, 0, 0);
+
+    free(data);
+    free(head);
+    free(prev);
+
+    return o - out;
+}
@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#ifndef TOOLS_LZ16_LZ16_H__
+#define TOOLS_LZ16_LZ16_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Maximum size of the compressed version of "size" bytes of data, including the
+// header.
+size_t lz16_compress_bound(size_t size);
+
+// Compresses "size" bytes of data with the LZ16 format of libnds (check
+// DECOMPRESS_TYPE_LZ16 in nds/decompress.h). The size must be a multiple of 2
+// and smaller than 16 MB. The output buffer must be at least as big as the
+// value returned by lz16_compress_bound().
+//
+// It returns the size of the compressed data (including the header), or 0 on
+// error.
+size_t lz16_compress(const uint8_t *in, size_t size, uint8_t *out);
+
+#endif // TOOLS_LZ16_LZ16_H__
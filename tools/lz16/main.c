@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Compressor of the LZ16 format of libnds. The output can be decompressed with
+// decompressSoftware() and decompressSoftwareStream() using the type LZ16.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz16.h"
+
+static void *load_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    // Leave space for a padding byte
+    uint8_t *buf = malloc(len + 1);
+    if (buf == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        fclose(f);
+        return NULL;
+    }
+
+    if (fread(buf, 1, len, f) != (size_t)len)
+    {
+        fprintf(stderr, "Can't read %s\n", path);
+        free(buf);
+        fclose(f);
+        return NULL;
+    }
+
+    fclose(f);
+
+    *size = len;
+    return buf;
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s input output\n"
+           "\n"
+           "Compresses a file with the LZ16 format of libnds. If the size of\n"
+           "the file is odd, a zero byte is added to the end. The maximum\n"
+           "size of the input is 16 MB.\n",
+           name);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    size_t size;
+    uint8_t *in = load_file(argv[1], &size);
+    if (in == NULL)
+        return 1;
+
+    if (size & 1)
+        in[size++] = 0;
+
+    if (size >= (1 << 24))
+    {
+        fprintf(stderr, "The file is too big\n");
+        return 1;
+    }
+
+    uint8_t *out = malloc(lz16_compress_bound(size));
+    if (out == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    size_t out_size = lz16_compress(in, size, out);
+    if (out_size == 0)
+    {
+        fprintf(stderr, "Compression failed\n");
+        return 1;
+    }
+
+    FILE *f = fopen(argv[2], "wb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Can't open %s: %s\n", argv[2], strerror(errno));
+        return 1;
+    }
+
+    if (fwrite(out, 1, out_size, f) != out_size)
+    {
+        fprintf(stderr, "Can't write %s\n", argv[2]);
+        fclose(f);
+        return 1;
+    }
+
+    fclose(f);
+
+    free(in);
+    free(out);
+
+    return 0;
+}
@@ -0,0 +1,522 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Host tool that parses the records generated by the libnds allocation tracer
+// (see nds/memtrace.h) and prints a summary of them.
+//
+// It accepts binary files generated with MEMTRACE_OUTPUT_FILE and text logs of
+// no$gba (or any other text file) with the lines generated with
+// MEMTRACE_OUTPUT_NOCASH. Lines that don't start with "@MT:" are ignored.
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nds/memtrace.h>
+
+static const char *tag_names[MEMTRACE_TAG_COUNT] = {
+    [MEMTRACE_TAG_USER] = "user",
+    [MEMTRACE_TAG_GRF] = "grf",
+    [MEMTRACE_TAG_VIDEOGL] = "videoGL",
+    [MEMTRACE_TAG_SPRITE] = "sprite",
+    [MEMTRACE_TAG_DYNAMIC_ARRAY] = "dynamicArray",
+    [MEMTRACE_TAG_COTHREAD] = "cothread",
+    [MEMTRACE_TAG_FILESYSTEM] = "filesystem",
+    [MEMTRACE_TAG_IMAGE] = "image",
+    [MEMTRACE_TAG_CONSOLE] = "console",
+    [MEMTRACE_TAG_VRAM_UPLOAD] = "vramUpload",
+    [MEMTRACE_TAG_HDMA] = "hdma",
+    [MEMTRACE_TAG_FONT] = "font",
+    [MEMTRACE_TAG_INPUT] = "input",
+};
+
+static const char *tag_name(unsigned int tag)
+{
+    if ((tag < MEMTRACE_TAG_COUNT) && (tag_names[tag] != NULL))
+        return tag_names[tag];
+    return "?";
+}
+
+typedef struct {
+    uint64_t current;
+    uint64_t peak;
+    uint32_t allocations;
+    uint32_t frees;
+    uint32_t failures;
+} Stats;
+
+// Live blocks (open addressing hash table, the key 0 means empty)
+
+typedef struct {
+    uint32_t ptr;
+    uint32_t size;
+    uint32_t caller;
+    uint8_t tag;
+} Block;
+
+static Block *blocks;
+static uint32_t blocks_mask;
+static uint32_t blocks_used;
+
+// Call sites
+
+typedef struct {
+    uint32_t caller;
+    uint8_t tag;
+    uint32_t allocations;
+    uint64_t bytes;
+    uint32_t live; // Blocks from this call site that are still allocated
+} Site;
+
+static Site *sites;
+static size_t sites_count, sites_capacity;
+
+static Stats stats[MEMTRACE_TAG_COUNT];
+static Stats stats_all;
+static uint32_t histogram[MEMTRACE_HISTOGRAM_BUCKETS];
+static uint32_t unknown_frees;
+static uint32_t leak_records;
+static uint64_t leak_bytes;
+
+static void *xcalloc(size_t nmemb, size_t size)
+{
+    void *p = calloc(nmemb, size);
+    if (p == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static uint32_t hash(uint32_t ptr)
+{
+    return ((ptr >> 3) * 2654435761u) & blocks_mask;
+}
+
+static void blocks_insert(const Block *b)
+{
+    if ((blocks_used + 1) * 2 > blocks_mask)
+    {
+        // Grow the table
+        Block *old = blocks;
+        uint32_t old_mask = blocks_mask;
+
+        blocks_mask = blocks_mask * 2 + 1;
+        blocks = xcalloc(blocks_mask + 1, sizeof(Block));
+        blocks_used = 0;
+
+        for (uint32_t i = 0; i <= old_mask; i++)
+        {
+            if (old[i].ptr != 0)
+                blocks_insert(&old[i]);
+        }
+        free(old);
+    }
+
+    uint32_t i = hash(b->ptr);
+    while ((blocks[i].ptr != 0) && (blocks[i].ptr != b->ptr))
+        i = (i + 1) & blocks_mask;
+
+    if (blocks[i].ptr == 0)
+        blocks_used++;
+
+    blocks[i] = *b;
+}
+
+static bool blocks_remove(uint32_t ptr, Block *out)
+{
+    uint32_t i = hash(ptr);
+
+    while (blocks[i].ptr != ptr)
+    {
+        if (blocks[i].ptr == 0)
+            return false;
+        i = (i + 1) & blocks_mask;
+    }
+
+    *out = blocks[i];
+
+    // Backward shift deletion
+    uint32_t gap = i;
+    uint32_t j = i;
+    while (1)
+    {
+        j = (j + 1) & blocks_mask;
+        if (blocks[j].ptr == 0)
+            break;
+
+        uint32_t home = hash(blocks[j].ptr);
+        if (((j - home) & blocks_mask) >= ((j - gap) & blocks_mask))
+        {
+            blocks[gap] = blocks[j];
+            gap = j;
+        }
+    }
+    blocks[gap].ptr = 0;
+    blocks_used--;
+
+    return true;
+}
+
+static Site *site_get(uint32_t caller, uint8_t tag)
+{
+    for (size_t i = 0; i < sites_count; i++)
+    {
+        if ((sites[i].caller == caller) && (sites[i].tag == tag))
+            return &sites[i];
+    }
+
+    if (sites_count == sites_capacity)
+    {
+        sites_capacity = sites_capacity ? sites_capacity * 2 : 64;
+        sites = realloc(sites, sites_capacity * sizeof(Site));
+        if (sites == NULL)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+
+    Site *s = &sites[sites_count++];
+    memset(s, 0, sizeof(Site));
+    s->caller = caller;
+    s->tag = tag;
+    return s;
+}
+
+static void stats_add(Stats *s, uint32_t size)
+{
+    s->current += size;
+    s->allocations++;
+    if (s->current > s->peak)
+        s->peak = s->current;
+}
+
+static void stats_remove(Stats *s, uint32_t size)
+{
+    s->current -= size;
+    s->frees++;
+}
+
+static bool verbose = false;
+
+static void process_record(const MemTraceRecord *r)
+{
+    unsigned int tag = r->tag < MEMTRACE_TAG_COUNT ? r->tag : MEMTRACE_TAG_USER;
+
+    if (verbose)
+    {
+        static const char *types[] = { "alloc", "free", "failed", "leak" };
+        const char *type = r->type < 4 ? types[r->type] : "?";
+
+        printf("%-6s %-12s %08" PRIX32 " %8" PRIu32 " from %08" PRIX32 "\n",
+               type, tag_name(tag), r->ptr, r->size, r->caller);
+    }
+
+    switch (r->type)
+    {
+        case MEMTRACE_RECORD_ALLOC:
+        {
+            stats_add(&stats[tag], r->size);
+            stats_add(&stats_all, r->size);
+
+            unsigned int bucket = 0;
+            if (r->size > 1)
+                bucket = 31 - __builtin_clz(r->size);
+            if (bucket >= MEMTRACE_HISTOGRAM_BUCKETS)
+                bucket = MEMTRACE_HISTOGRAM_BUCKETS - 1;
+            histogram[bucket]++;
+
+            Site *s = site_get(r->caller, tag);
+            s->allocations++;
+            s->bytes += r->size;
+            s->live++;
+
+            Block b = { r->ptr, r->size, r->caller, tag };
+            blocks_insert(&b);
+            break;
+        }
+        case MEMTRACE_RECORD_FREE:
+        {
+            Block b;
+            if (!blocks_remove(r->ptr, &b))
+            {
+                unknown_frees++;
+                break;
+            }
+            stats_remove(&stats[b.tag], b.size);
+            stats_remove(&stats_all, b.size);
+            site_get(b.caller, b.tag)->live--;
+            break;
+        }
+        case MEMTRACE_RECORD_FAILED:
+            stats[tag].failures++;
+            stats_all.failures++;
+            break;
+        case MEMTRACE_RECORD_LEAK:
+            leak_records++;
+            leak_bytes += r->size;
+            break;
+        default:
+            fprintf(stderr, "Unknown record type %u\n", r->type);
+            break;
+    }
+}
+
+static uint32_t hex_value(const char *s, int digits, bool *ok)
+{
+    uint32_t v = 0;
+
+    for (int i = 0; i < digits; i++)
+    {
+        char c = s[i];
+        v <<= 4;
+        if ((c >= '0') && (c <= '9'))
+            v |= c - '0';
+        else if ((c >= 'A') && (c <= 'F'))
+            v |= c - 'A' + 10;
+        else if ((c >= 'a') && (c <= 'f'))
+            v |= c - 'a' + 10;
+        else
+            *ok = false;
+    }
+
+    return v;
+}
+
+// Parses a line with the format "@MT:TTGGPPPPPPPPSSSSSSSSCCCCCCCC". The marker
+// can be anywhere in the line, as emulators may add a prefix to it.
+static bool parse_text_record(const char *line, MemTraceRecord *r)
+{
+    const char *p = strstr(line, "@MT:");
+    if (p == NULL)
+        return false;
+
+    p += 4;
+    if (strlen(p) < 2 + 2 + 8 + 8 + 8)
+        return false;
+
+    bool ok = true;
+    r->type = hex_value(p, 2, &ok);
+    r->tag = hex_value(p + 2, 2, &ok);
+    r->reserved = 0;
+    r->ptr = hex_value(p + 4, 8, &ok);
+    r->size = hex_value(p + 12, 8, &ok);
+    r->caller = hex_value(p + 20, 8, &ok);
+
+    return ok;
+}
+
+static int parse_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    // Binary records always start with a type smaller than 4, which isn't a
+    // printable character. Text logs start with printable characters.
+    int first = fgetc(f);
+    rewind(f);
+
+    size_t count = 0;
+
+    if ((first >= 0) && (first < 4))
+    {
+        uint8_t raw[16];
+
+        while (fread(raw, sizeof(raw), 1, f) == 1)
+        {
+            // The records are little endian
+            MemTraceRecord r;
+            r.type = raw[0];
+            r.tag = raw[1];
+            r.reserved = raw[2] | (raw[3] << 8);
+            r.ptr = raw[4] | (raw[5] << 8) | (raw[6] << 16) | ((uint32_t)raw[7] << 24);
+            r.size = raw[8] | (raw[9] << 8) | (raw[10] << 16) | ((uint32_t)raw[11] << 24);
+            r.caller = raw[12] | (raw[13] << 8) | (raw[14] << 16) | ((uint32_t)raw[15] << 24);
+
+            process_record(&r);
+            count++;
+        }
+    }
+    else
+    {
+        char line[512];
+
+        while (fgets(line, sizeof(line), f) != NULL)
+        {
+            MemTraceRecord r;
+            if (!parse_text_record(line, &r))
+                continue;
+
+            process_record(&r);
+            count++;
+        }
+    }
+
+    fclose(f);
+
+    return count;
+}
+
+static int site_compare(const void *a, const void *b)
+{
+    const Site *sa = a;
+    const Site *sb = b;
+
+    if (sa->bytes != sb->bytes)
+        return sa->bytes < sb->bytes ? 1 : -1;
+    if (sa->caller != sb->caller)
+        return sa->caller < sb->caller ? -1 : 1;
+    return sa->tag - sb->tag;
+}
+
+static void print_report(size_t max_sites)
+{
+    printf("total: current %" PRIu64 " peak %" PRIu64 " allocs %" PRIu32
+           " frees %" PRIu32 " failures %" PRIu32 "\n",
+           stats_all.current, stats_all.peak, stats_all.allocations,
+           stats_all.frees, stats_all.failures);
+
+    if (unknown_frees > 0)
+        printf("frees of unknown blocks: %" PRIu32 "\n", unknown_frees);
+
+    printf("\ntags:\n");
+    for (unsigned int i = 0; i < MEMTRACE_TAG_COUNT; i++)
+    {
+        Stats *s = &stats[i];
+
+        if ((s->allocations == 0) && (s->failures == 0))
+            continue;
+
+        printf("  %-12s current %8" PRIu64 " peak %8" PRIu64 " allocs %6"
+               PRIu32 " frees %6" PRIu32 " failures %" PRIu32 "\n",
+               tag_name(i), s->current, s->peak, s->allocations, s->frees,
+               s->failures);
+    }
+
+    printf("\nsize histogram:\n");
+    for (unsigned int i = 0; i < MEMTRACE_HISTOGRAM_BUCKETS; i++)
+    {
+        if (histogram[i] == 0)
+            continue;
+
+        printf("  %6u+ : %" PRIu32 "\n", 1u << i, histogram[i]);
+    }
+
+    qsort(sites, sites_count, sizeof(Site), site_compare);
+
+    printf("\ncall sites (by bytes allocated):\n");
+    for (size_t i = 0; (i < sites_count) && (i < max_sites); i++)
+    {
+        Site *s = &sites[i];
+
+        printf("  %08" PRIX32 " %-12s allocs %6" PRIu32 " bytes %9" PRIu64
+               " live %" PRIu32 "\n", s->caller, tag_name(s->tag),
+               s->allocations, s->bytes, s->live);
+    }
+
+    // If the log has leak records, the program printed a report before exiting,
+    // so those records are the most reliable list of leaks. If not, report the
+    // blocks that haven't been freed when the log ends.
+    printf("\nleaks:\n");
+    if (leak_records > 0)
+    {
+        printf("  %" PRIu32 " blocks, %" PRIu64 " bytes (leak records)\n",
+               leak_records, leak_bytes);
+    }
+    else
+    {
+        uint64_t bytes = 0;
+
+        for (uint32_t i = 0; i <= blocks_mask; i++)
+        {
+            Block *b = &blocks[i];
+            if (b->ptr == 0)
+                continue;
+
+            printf("  %08" PRIX32 " %8" PRIu32 " %-12s from %08" PRIX32 "\n",
+                   b->ptr, b->size, tag_name(b->tag), b->caller);
+            bytes += b->size;
+        }
+
+        printf("  %" PRIu32 " blocks, %" PRIu64 " bytes not freed at the end "
+               "of the log\n", blocks_used, bytes);
+    }
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [options] file\n"
+           "\n"
+           "Parses the records generated by the libnds allocation tracer.\n"
+           "The file can be a binary file (MEMTRACE_OUTPUT_FILE) or a text\n"
+           "log with \"@MT:\" lines (MEMTRACE_OUTPUT_NOCASH).\n"
+           "\n"
+           "Options:\n"
+           "  -v      Print all records\n"
+           "  -s N    Number of call sites to print (default: 20)\n"
+           "\n"
+           "Call site addresses can be converted to source locations with:\n"
+           "  arm-none-eabi-addr2line -f -e program.elf <address>\n",
+           name);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = NULL;
+    size_t max_sites = 20;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-v") == 0)
+        {
+            verbose = true;
+        }
+        else if ((strcmp(argv[i], "-s") == 0) && (i + 1 < argc))
+        {
+            max_sites = strtoul(argv[++i], NULL, 0);
+        }
+        else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "--help") == 0))
+        {
+            usage(argv[0]);
+            return 0;
+        }
+        else if (path == NULL)
+        {
+            path = argv[i];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (path == NULL)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    blocks_mask = 1023;
+    blocks = xcalloc(blocks_mask + 1, sizeof(Block));
+
+    int count = parse_file(path);
+    if (count < 0)
+        return 1;
+
+    printf("records: %d\n", count);
+    print_report(max_sites);
+
+    return 0;
+}